@@ -0,0 +1,596 @@
+/*
+ * main.cpp - Headless preset benchmark.
+ *
+ * Loads every ".milk" preset in a directory and runs the CPU side of each
+ * one (per-frame equations, motion vectors, per-vertex mesh, custom shapes
+ * and custom waves) for a fixed number of frames, without a device.
+ * Reports per-preset and per-stage timings, heap allocations and compile
+ * time as CSV or JSON.
+ *
+ * Usage: bench <preset_dir> [-frames N] [-csv | -json] [-audio file.f32] [-o file] [-verify]
+ *        bench -noise [-threads N]
+ *        bench -mesh
+ *
+ * Audio is synthetic unless `-audio` names a raw, interleaved, stereo,
+ * 32-bit float recording at 44.1 kHz.
+ *
+ * `-verify` also runs the per-vertex code of every preset that has a
+ * lane-parallel version through the compiled code, compares the mesh UVs
+ * of the two and exits with an error if any differ.
+ *
+ * `-noise` instead times the generation of each noise texture, with one
+ * thread and with `N` (default: all cores), as CSV.
+ *
+ * `-mesh` instead times what the warp, motion vector and composite passes
+ * do with the warp mesh each frame, on interleaved vertices and on the
+ * shared mesh streams, for several mesh sizes, as CSV.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include <vis_milk2/pch.h>
+#include <vis_milk2/plugin.h>
+#include <vis_milk2/utility.h>
+#include <vis_milk2/noise.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+
+CPlugin g_plugin;
+
+// Heap allocations made through `operator new`. Allocations made by the
+// expression evaluator's C runtime `malloc()` calls are not counted.
+static std::atomic<size_t> g_nAllocs{0};
+static std::atomic<size_t> g_nAllocBytes{0};
+
+void* operator new(size_t size)
+{
+    g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+    g_nAllocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+enum
+{
+    STAGE_PER_FRAME,
+    STAGE_MOTION_VECTORS,
+    STAGE_PER_VERTEX,
+    STAGE_SHAPES,
+    STAGE_WAVES,
+    NUM_STAGES
+};
+
+static const char* g_szStageNames[NUM_STAGES] = {"per_frame", "motion_vectors", "per_vertex", "shapes", "waves"};
+
+typedef struct
+{
+    std::string name;
+    bool bLoaded;
+    double fCompileMs;
+    double fStageMs[NUM_STAGES];
+    double fTotalMs;
+    size_t nAllocs;
+    size_t nAllocBytes;
+    bool bLanes;          // the per-vertex code ran lane-parallel
+    size_t nLaneMismatch; // vertices where it disagreed with the compiled code, with `-verify`
+} td_benchresult;
+
+// Produces the audio inputs for each frame, either from a recording or
+// from a deterministic synthetic signal.
+class CAudioSource
+{
+  public:
+    CAudioSource() : m_fft(NUM_AUDIO_BUFFER_SAMPLES, NUM_FREQUENCIES), m_nPos(0)
+    {
+        for (int ch = 0; ch < 2; ch++)
+        {
+            m_fWave[ch].resize(NUM_AUDIO_BUFFER_SAMPLES);
+            m_fSpec[ch].resize(NUM_FREQUENCIES);
+        }
+        for (int i = 0; i < 3; i++)
+            m_fImm[i] = m_fAvg[i] = m_fLongAvg[i] = 1.0f;
+    }
+
+    bool LoadRaw(const wchar_t* szFile)
+    {
+        FILE* f = NULL;
+        if (_wfopen_s(&f, szFile, L"rb") != 0 || !f)
+            return false;
+        float buf[2048];
+        size_t n;
+        while ((n = fread(buf, sizeof(float), 2048, f)) > 0)
+            m_fRecording.insert(m_fRecording.end(), buf, buf + n);
+        fclose(f);
+        return m_fRecording.size() >= 2 * NUM_AUDIO_BUFFER_SAMPLES;
+    }
+
+    // Fills in the audio fields of `ef` for frame `nFrame` at `fFps`.
+    void Next(int nFrame, float fFps, td_evalframe& ef)
+    {
+        const size_t nStep = static_cast<size_t>(44100.0f / fFps);
+        for (int i = 0; i < NUM_AUDIO_BUFFER_SAMPLES; i++)
+        {
+            if (!m_fRecording.empty())
+            {
+                size_t j = (2 * (m_nPos + i)) % (m_fRecording.size() & ~static_cast<size_t>(1));
+                m_fWave[0][i] = m_fRecording[j];
+                m_fWave[1][i] = m_fRecording[j + 1];
+            }
+            else
+            {
+                // A kick every half second, a wandering mid tone and some hiss.
+                float t = (m_nPos + i) / 44100.0f;
+                float kick = std::exp(-8.0f * std::fmod(t, 0.5f)) * std::sin(6.2831853f * 55.0f * t);
+                float tone = 0.3f * std::sin(6.2831853f * (440.0f + 110.0f * std::sin(0.25f * t)) * t);
+                float hiss = 0.05f * ((warand() % 2001) / 1000.0f - 1.0f);
+                m_fWave[0][i] = kick + tone + hiss;
+                m_fWave[1][i] = kick - tone + hiss;
+            }
+        }
+        m_nPos += nStep;
+
+        for (int ch = 0; ch < 2; ch++)
+            m_fft.TimeToFrequencyDomain(m_fWave[ch], m_fSpec[ch]);
+
+        // Same band split and temporal blending as `CPlugin::DoCustomSoundAnalysis()`.
+        for (int i = 0; i < 3; i++)
+        {
+            int start = NUM_FREQUENCIES * i / 6;
+            int end = NUM_FREQUENCIES * (i + 1) / 6;
+            m_fImm[i] = 0;
+            for (int j = start; j < end; j++)
+                m_fImm[i] += m_fSpec[0][j];
+
+            float rate = AdjustRateToFPS((m_fImm[i] > m_fAvg[i]) ? 0.2f : 0.5f, 30.0f, fFps);
+            m_fAvg[i] = m_fAvg[i] * rate + m_fImm[i] * (1 - rate);
+            rate = AdjustRateToFPS((nFrame < 50) ? 0.9f : 0.992f, 30.0f, fFps);
+            m_fLongAvg[i] = m_fLongAvg[i] * rate + m_fImm[i] * (1 - rate);
+
+            ef.imm_rel[i] = (std::fabs(m_fLongAvg[i]) < 0.001f) ? 1.0f : m_fImm[i] / m_fLongAvg[i];
+            ef.avg_rel[i] = (std::fabs(m_fLongAvg[i]) < 0.001f) ? 1.0f : m_fAvg[i] / m_fLongAvg[i];
+        }
+        for (int ch = 0; ch < 2; ch++)
+        {
+            ef.pWaveform[ch] = m_fWave[ch].data();
+            ef.pSpectrum[ch] = m_fSpec[ch].data();
+        }
+    }
+
+  private:
+    FFT m_fft;
+    size_t m_nPos;
+    std::vector<float> m_fRecording;
+    std::vector<float> m_fWave[2];
+    std::vector<float> m_fSpec[2];
+    float m_fImm[3];
+    float m_fAvg[3];
+    float m_fLongAvg[3];
+};
+
+static double TicksToMs(LONGLONG ticks)
+{
+    static LARGE_INTEGER freq = {};
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    return 1000.0 * static_cast<double>(ticks) / static_cast<double>(freq.QuadPart);
+}
+
+static LONGLONG Now()
+{
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+static td_benchresult RunPreset(const std::wstring& szFile, const std::wstring& szName, int nFrames, const wchar_t* szAudioFile, bool bVerify)
+{
+    td_benchresult r{};
+    char* u8Name = _WideToUTF8(szName.c_str());
+    r.name = u8Name;
+    delete[] u8Name;
+
+    const float fFps = 60.0f;
+    td_evalframe ef{};
+    ef.fFps = fFps;
+    ef.fNextPresetTime = nFrames / fFps;
+    ef.nGridX = g_plugin.m_nGridX;
+    ef.nGridY = g_plugin.m_nGridY;
+    ef.nTexSizeX = ef.nWidth = 1024;
+    ef.nTexSizeY = ef.nHeight = 1024;
+    ef.fAspectX = ef.fAspectY = ef.fInvAspectX = ef.fInvAspectY = 1.0f;
+
+    const int nVerts = (ef.nGridX + 1) * (ef.nGridY + 1);
+    CMeshStreams mesh;
+    std::vector<td_vertinfo> vertinfo(nVerts);
+    std::vector<WFVERTEX> mv(64 * 48 * 2);
+    WFVERTEX wave[1024];
+    SPRITEVERTEX shape[512];
+    CPresetEvaluator::InitMesh(ef, mesh, vertinfo.data());
+
+    CAudioSource audio;
+    if (szAudioFile && !audio.LoadRaw(szAudioFile))
+        fwprintf(stderr, L"warning: could not read \"%s\"; using synthetic audio\n", szAudioFile);
+
+    // `CState::RecompileExpressions()` loads the per-frame variables of
+    // `g_plugin.m_pState` before running the init code, so import into it.
+    CState* pState = g_plugin.m_pState;
+    CState* pOldState = g_plugin.m_pOldState;
+    const CPresetEvaluator ev;
+    CPresetEvaluator evCompiled;
+    evCompiled.m_bLaneEval = false;
+    CMeshStreams meshCompiled;
+
+    size_t nAllocs = g_nAllocs.load();
+    size_t nAllocBytes = g_nAllocBytes.load();
+
+    LONGLONG t0 = Now();
+    r.bLoaded = pState->Import(szFile.c_str(), 0.0f, NULL);
+    r.fCompileMs = TicksToMs(Now() - t0);
+    if (!r.bLoaded)
+        return r;
+    pState->m_bBlending = false;
+    r.bLanes = (pState->m_pp_lanes != NULL);
+
+    LONGLONG stage[NUM_STAGES] = {};
+    for (int frame = 0; frame < nFrames; frame++)
+    {
+        ef.nFrame = frame;
+        ef.fTime = frame / fFps;
+        audio.Next(frame, fFps, ef);
+
+        LONGLONG t = Now();
+        ev.RunPerFrameEquations(pState, pOldState, 0, ef);
+        LONGLONG t1 = Now();
+        stage[STAGE_PER_FRAME] += t1 - t;
+
+        ev.EvalMotionVectors(pState, ef, mesh, mv.data());
+        t = Now();
+        stage[STAGE_MOTION_VECTORS] += t - t1;
+
+        ev.ComputeGridAlphaValues(pState, pOldState, ef, mesh, vertinfo.data());
+        t1 = Now();
+        stage[STAGE_PER_VERTEX] += t1 - t;
+
+        // Lane programs carry no state between vertices, so running the
+        // per-vertex code a second time does not disturb the preset.
+        if (bVerify && r.bLanes)
+        {
+            meshCompiled = mesh;
+            evCompiled.ComputeGridAlphaValues(pState, pOldState, ef, meshCompiled, vertinfo.data());
+            for (int n = 0; n < nVerts; n++)
+                if (std::fabs(mesh.GetTu()[n] - meshCompiled.GetTu()[n]) > 1e-5f || std::fabs(mesh.GetTv()[n] - meshCompiled.GetTv()[n]) > 1e-5f)
+                    r.nLaneMismatch++;
+            t1 = Now();
+        }
+
+        for (int i = 0; i < MAX_CUSTOM_SHAPES; i++)
+            if (pState->m_shape[i].enabled)
+                for (int instance = 0; instance < pState->m_shape[i].instances; instance++)
+                    ev.EvalCustomShape(pState, i, instance, ef, 1.0f, shape);
+        t = Now();
+        stage[STAGE_SHAPES] += t - t1;
+
+        for (int i = 0; i < MAX_CUSTOM_WAVES; i++)
+            if (pState->m_wave[i].enabled)
+                ev.EvalCustomWave(pState, i, ef, 1.0f, wave);
+        t1 = Now();
+        stage[STAGE_WAVES] += t1 - t;
+    }
+
+    r.nAllocs = g_nAllocs.load() - nAllocs;
+    r.nAllocBytes = g_nAllocBytes.load() - nAllocBytes;
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        r.fStageMs[s] = TicksToMs(stage[s]);
+        r.fTotalMs += r.fStageMs[s];
+    }
+    return r;
+}
+
+static std::string JsonEscape(const std::string& s)
+{
+    std::string out;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            out += c;
+    }
+    return out;
+}
+
+static void WriteCsv(FILE* out, const std::vector<td_benchresult>& results, int nFrames)
+{
+    fprintf(out, "preset,loaded,frames,compile_ms");
+    for (int s = 0; s < NUM_STAGES; s++)
+        fprintf(out, ",%s_ms", g_szStageNames[s]);
+    fprintf(out, ",total_ms,us_per_frame,allocs,alloc_bytes\n");
+    for (const td_benchresult& r : results)
+    {
+        std::string name = r.name;
+        std::replace(name.begin(), name.end(), '"', '\'');
+        fprintf(out, "\"%s\",%d,%d,%.3f", name.c_str(), r.bLoaded ? 1 : 0, nFrames, r.fCompileMs);
+        for (int s = 0; s < NUM_STAGES; s++)
+            fprintf(out, ",%.3f", r.fStageMs[s]);
+        fprintf(out, ",%.3f,%.2f,%zu,%zu\n", r.fTotalMs, 1000.0 * r.fTotalMs / std::max(nFrames, 1), r.nAllocs, r.nAllocBytes);
+    }
+}
+
+static void WriteJson(FILE* out, const std::vector<td_benchresult>& results, int nFrames)
+{
+    fprintf(out, "{\n  \"frames\": %d,\n  \"presets\": [\n", nFrames);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const td_benchresult& r = results[i];
+        fprintf(out, "    {\"preset\": \"%s\", \"loaded\": %s, \"compile_ms\": %.3f, \"stages_ms\": {", JsonEscape(r.name).c_str(), r.bLoaded ? "true" : "false", r.fCompileMs);
+        for (int s = 0; s < NUM_STAGES; s++)
+            fprintf(out, "%s\"%s\": %.3f", s ? ", " : "", g_szStageNames[s], r.fStageMs[s]);
+        fprintf(out, "}, \"total_ms\": %.3f, \"allocs\": %zu, \"alloc_bytes\": %zu}%s\n", r.fTotalMs, r.nAllocs, r.nAllocBytes, (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static int RunNoiseBench(int nThreads)
+{
+    typedef struct
+    {
+        const wchar_t* szName;
+        int size;
+        int zoom_factor;
+        bool bVolume;
+    } td_noisetex;
+    const td_noisetex textures[] = {
+        {L"noise_lq", 256, 1, false}, {L"noise_lq_lite", 32, 1, false}, {L"noise_mq", 256, 4, false},
+        {L"noise_hq", 256, 8, false}, {L"noisevol_lq", 32, 1, true},    {L"noisevol_hq", 32, 4, true},
+    };
+    const int nRuns = 50;
+    printf("name,threads,ms\n");
+    for (const td_noisetex& t : textures)
+    {
+        std::vector<uint32_t> texels(static_cast<size_t>(t.size) * t.size * (t.bVolume ? t.size : 1));
+        for (int threads : {1, nThreads})
+        {
+            LONGLONG start = Now();
+            for (int i = 0; i < nRuns; i++)
+            {
+                if (t.bVolume)
+                    GenerateNoiseVol(GetNoiseSeed(t.szName), t.size, t.zoom_factor, texels.data(), threads);
+                else
+                    GenerateNoiseTex(GetNoiseSeed(t.szName), t.size, t.zoom_factor, texels.data(), threads);
+            }
+            printf("%ls,%d,%.4f\n", t.szName, threads, TicksToMs(Now() - start) / nRuns);
+        }
+    }
+    return 0;
+}
+
+// A frame of the warp mesh's CPU work: the per-vertex code writes UVs and
+// alphas, the motion vectors and the composite grid sample them, and the
+// warp pass lays out the vertices it draws. The UVs are a cheap stand-in
+// for the per-vertex code, which is timed by the preset benchmark.
+static void WriteMeshFrame(int frame, const float* pX, const float* pY, size_t nVerts, float* pTu, float* pTv, float* pAlpha, size_t nStride)
+{
+    float fZoom = 1.0f + 0.01f * std::sin(frame * 0.1f);
+    for (size_t n = 0; n < nVerts; n++)
+    {
+        pTu[n * nStride] = pX[n] * 0.5f / fZoom + 0.5f;
+        pTv[n * nStride] = -pY[n] * 0.5f / fZoom + 0.5f;
+        pAlpha[n * nStride] = 0.5f + 0.5f * pX[n];
+    }
+}
+
+static int RunMeshBench()
+{
+    const int nFrames = 2000;
+    const int nMotionX = 64, nMotionY = 48;
+    printf("grid_x,grid_y,layout,us_per_frame,checksum\n");
+    for (int nGridX : {48, 96, 192})
+    {
+        const int nGridY = nGridX * 3 / 4;
+        CMeshStreams mesh;
+        mesh.Init(nGridX, nGridY, 1.0f, 1.0f, 1024, 1024);
+        const size_t nVerts = mesh.GetCount();
+        const size_t nGrid = nVerts;
+        const size_t nSeamStart = GetWarpSeamStart(nGridX, nGridY);
+        std::vector<MDVERTEX> warp(GetWarpVertexCount(nGridX, nGridY));
+
+        // Interleaved: every pass reads and writes whole vertices, and the
+        // warp pass copies them.
+        std::vector<MDVERTEX> verts(nVerts);
+        mesh.Gather(verts.data());
+        double fSum = 0.0;
+        LONGLONG start = Now();
+        for (int frame = 0; frame < nFrames; frame++)
+        {
+            WriteMeshFrame(frame, mesh.GetX(), mesh.GetY(), nVerts, &verts[0].tu, &verts[0].tv, &verts[0].a, sizeof(MDVERTEX) / sizeof(float));
+            for (int y = 0; y < nMotionY; y++)
+            {
+                for (int x = 0; x < nMotionX; x++)
+                {
+                    float fx = (x + 0.25f) / nMotionX, fy = (y + 0.25f) / nMotionY;
+                    int y0 = static_cast<int>(fy * nGridY);
+                    float dy = fy * nGridY - y0;
+                    int x0 = static_cast<int>(fx * nGridX);
+                    float dx = fx * nGridX - x0;
+                    const MDVERTEX* v = &verts[static_cast<size_t>(y0) * (nGridX + 1) + x0];
+                    float tu, tv;
+                    tu  = v[0].tu * (1 - dx) * (1 - dy);
+                    tv  = v[0].tv * (1 - dx) * (1 - dy);
+                    tu += v[1].tu * (dx) * (1 - dy);
+                    tv += v[1].tv * (dx) * (1 - dy);
+                    tu += v[nGridX + 1].tu * (1 - dx) * (dy);
+                    tv += v[nGridX + 1].tv * (1 - dx) * (dy);
+                    tu += v[nGridX + 2].tu * (dx) * (dy);
+                    tv += v[nGridX + 2].tv * (dx) * (dy);
+                    fSum += tu + tv;
+                }
+            }
+            for (int j = 0; j < FCGSY; j++)
+            {
+                for (int i = 0; i < FCGSX; i++)
+                {
+                    float fx = std::min(i / static_cast<float>(FCGSX - 1) * (nGridX + 1), nGridX - 1.0f);
+                    float fy = std::min(j / static_cast<float>(FCGSY - 1) * (nGridY + 1), nGridY - 1.0f);
+                    int x0 = static_cast<int>(fx), y0 = static_cast<int>(fy);
+                    double dx = fx - x0, dy = fy - y0;
+                    const MDVERTEX* v = &verts[static_cast<size_t>(y0) * (nGridX + 1) + x0];
+                    double alpha = v[0].a * 255 * (1 - dx) * (1 - dy) + v[1].a * 255 * (dx) * (1 - dy) + v[nGridX + 1].a * 255 * (1 - dx) * (dy) + v[nGridX + 2].a * 255 * (dx) * (dy);
+                    fSum += static_cast<float>(alpha / 255.0f);
+                }
+            }
+            std::copy(verts.begin(), verts.end(), warp.begin());
+            for (size_t x = 0; x < GetWarpSeamCount(nGridX); x++)
+                warp[nGrid + x] = verts[nSeamStart + x];
+            fSum += warp.back().tu;
+        }
+        printf("%d,%d,aos,%.3f,%.3f\n", nGridX, nGridY, 1000.0 * TicksToMs(Now() - start) / nFrames, fSum);
+
+        // Streams: the per-vertex code writes only the dynamic streams and
+        // the other passes read them in place.
+        fSum = 0.0;
+        start = Now();
+        for (int frame = 0; frame < nFrames; frame++)
+        {
+            WriteMeshFrame(frame, mesh.GetX(), mesh.GetY(), nVerts, mesh.GetTu(), mesh.GetTv(), mesh.GetAlpha(), 1);
+            for (int y = 0; y < nMotionY; y++)
+            {
+                for (int x = 0; x < nMotionX; x++)
+                {
+                    float u = 0.0f, v = 0.0f;
+                    mesh.SampleUV((x + 0.25f) / nMotionX, (y + 0.25f) / nMotionY, &u, &v);
+                    fSum += u + v;
+                }
+            }
+            for (int j = 0; j < FCGSY; j++)
+                for (int i = 0; i < FCGSX; i++)
+                    fSum += mesh.SampleAlpha(i / static_cast<float>(FCGSX - 1), j / static_cast<float>(FCGSY - 1));
+            mesh.Gather(warp.data());
+            for (size_t x = 0; x < GetWarpSeamCount(nGridX); x++)
+                warp[nGrid + x] = warp[nSeamStart + x];
+            fSum += warp.back().tu;
+        }
+        printf("%d,%d,streams,%.3f,%.3f\n", nGridX, nGridY, 1000.0 * TicksToMs(Now() - start) / nFrames, fSum);
+    }
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    if (argc >= 2 && !wcscmp(argv[1], L"-mesh"))
+        return RunMeshBench();
+
+    if (argc >= 2 && !wcscmp(argv[1], L"-noise"))
+    {
+        int nThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+        if (argc >= 4 && !wcscmp(argv[2], L"-threads"))
+            nThreads = std::max(1, _wtoi(argv[3]));
+        return RunNoiseBench(nThreads);
+    }
+
+    if (argc < 2)
+    {
+        fwprintf(stderr, L"Usage: %s <preset_dir> [-frames N] [-csv | -json] [-audio file.f32] [-o file] [-verify]\n       %s -noise [-threads N]\n       %s -mesh\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    std::wstring szDir = argv[1];
+    int nFrames = 600;
+    bool bJson = false;
+    bool bVerify = false;
+    const wchar_t* szAudioFile = NULL;
+    const wchar_t* szOutFile = NULL;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!wcscmp(argv[i], L"-frames") && i + 1 < argc)
+            nFrames = std::max(1, _wtoi(argv[++i]));
+        else if (!wcscmp(argv[i], L"-json"))
+            bJson = true;
+        else if (!wcscmp(argv[i], L"-csv"))
+            bJson = false;
+        else if (!wcscmp(argv[i], L"-audio") && i + 1 < argc)
+            szAudioFile = argv[++i];
+        else if (!wcscmp(argv[i], L"-o") && i + 1 < argc)
+            szOutFile = argv[++i];
+        else if (!wcscmp(argv[i], L"-verify"))
+            bVerify = true;
+        else
+        {
+            fwprintf(stderr, L"Unknown argument \"%s\"\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!szDir.empty() && szDir.back() != L'\\' && szDir.back() != L'/')
+        szDir += L'\\';
+
+    g_plugin.MilkDropPreInitialize();
+
+    std::vector<std::wstring> files;
+    WIN32_FIND_DATA fd;
+    HANDLE h = FindFirstFile((szDir + L"*.milk").c_str(), &fd);
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                files.push_back(fd.cFileName);
+        } while (FindNextFile(h, &fd));
+        FindClose(h);
+    }
+    if (files.empty())
+    {
+        fwprintf(stderr, L"No presets found in \"%s\"\n", szDir.c_str());
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<td_benchresult> results;
+    for (const std::wstring& name : files)
+        results.push_back(RunPreset(szDir + name, name, nFrames, szAudioFile, bVerify));
+
+    FILE* out = stdout;
+    if (szOutFile && (_wfopen_s(&out, szOutFile, L"w") != 0 || !out))
+    {
+        fwprintf(stderr, L"Could not open \"%s\" for writing\n", szOutFile);
+        return 1;
+    }
+    if (bJson)
+        WriteJson(out, results, nFrames);
+    else
+        WriteCsv(out, results, nFrames);
+    if (out != stdout)
+        fclose(out);
+
+    if (bVerify)
+    {
+        size_t nLanes = 0, nFailed = 0;
+        for (const td_benchresult& r : results)
+        {
+            nLanes += r.bLanes ? 1 : 0;
+            if (r.nLaneMismatch)
+            {
+                fprintf(stderr, "lane mismatch: \"%s\" (%zu vertices)\n", r.name.c_str(), r.nLaneMismatch);
+                nFailed++;
+            }
+        }
+        fprintf(stderr, "%zu of %zu presets evaluate per-vertex code lane-parallel; %zu mismatched\n", nLanes, results.size(), nFailed);
+        if (nFailed)
+            return 2;
+    }
+
+    return 0;
+}
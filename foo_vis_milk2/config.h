@@ -131,6 +131,15 @@ static constexpr GUID guid_cfg_bDebugOutput = {
 static constexpr GUID guid_cfg_szPresetDir = {
     0xfa9e467b, 0xfe6d, 0x4d79, {0x83, 0x98, 0xcd, 0x3d, 0x8b, 0xf4, 0x7a, 0x63}
 }; // {FA9E467B-FE6D-4D79-8398-CD3D8BF47A63}
+static constexpr GUID guid_cfg_nPresetCpuBudget = {
+    0x74399490, 0x3613, 0x46d5, {0xaf, 0x6e, 0xa7, 0x62, 0x3d, 0x74, 0xa6, 0xce}
+}; // {74399490-3613-46D5-AF6E-A7623D74A6CE}
+static constexpr GUID guid_cfg_bNoiseCache = {
+    0x1668f770, 0xeb30, 0x4e4f, {0x93, 0x9a, 0x15, 0xaa, 0x3a, 0x81, 0xf3, 0xa1}
+}; // {1668F770-EB30-4E4F-939A-15AA3A81F3A1}
+static constexpr GUID guid_cfg_nAudioOffset = {
+    0xe9776324, 0x9ccf, 0x4eb4, {0x81, 0x53, 0xd1, 0xc1, 0x3c, 0x2a, 0xb2, 0xa7}
+}; // {E9776324-9CCF-4EB4-8153-D1C13C2AB2A7}
 
 // State settings saved on close and restored on launch.
 // Controlled in either the context menu or via the keyboard shortcuts.
@@ -237,6 +246,9 @@ static constexpr int default_nGridX = 48; //32;
 static constexpr int default_nMaxPSVersion = -1; // -1 = auto, 0 = disable shaders, 2 = ps_2_0, 3 = ps_3_0
 static constexpr int default_nMaxImages = 32;
 static constexpr int default_nMaxBytes = 16000000;
+static constexpr int default_nPresetCpuBudget = 0; // 0 = unlimited
+static constexpr bool default_bNoiseCache = false;
+static constexpr int default_nAudioOffset = 0; // milliseconds
 static constexpr bool default_bPresetLockedByCode = false;
 static constexpr bool default_bShowShaderHelp = false;
 static constexpr float default_fBlendTimeUser = 1.7f;
@@ -276,6 +288,9 @@ enum
 {
     order_bDebugOutput,
     order_szPresetDir,
+    order_nPresetCpuBudget,
+    order_bNoiseCache,
+    order_nAudioOffset,
 };
 } // namespace
 
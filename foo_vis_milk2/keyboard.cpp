@@ -140,17 +140,17 @@
 #pragma region Keyboard Controls
 #define waitstring g_plugin.m_waitstring
 #define UI_mode g_plugin.m_UI_mode
-#ifdef TIMER_TP
-#define RemoveText() { EnterCriticalSection(&s_cs); g_plugin.ClearText(); LeaveCriticalSection(&s_cs); }
-#else
 #define RemoveText g_plugin.ClearText
-#endif
+
+// The handlers below hold `s_cs` (see `milk2_plugin_lock`) while they use
+// `g_plugin`, so the helpers they call run their commands right away.
 
 void milk2_ui_element::OnChar(TCHAR chChar, UINT nRepCnt, UINT nFlags)
 {
     UNREFERENCED_PARAMETER(nFlags);
 
     MILK2_CONSOLE_LOG("OnChar ", GetWnd())
+    milk2_plugin_lock lock;
     wchar_t buf[256]{};
     USHORT mask = 1 << (sizeof(SHORT) * 8 - 1); // get the highest-order bit
     bool bShiftHeldDown = (GetKeyState(VK_SHIFT) & mask) != 0;
@@ -853,6 +853,7 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
     UNREFERENCED_PARAMETER(nFlags);
 
     MILK2_CONSOLE_LOG("OnKeyDown ", GetWnd())
+    milk2_plugin_lock lock;
     USHORT mask = 1 << (sizeof(SHORT) * 8 - 1); // get the highest-order bit
     bool bShiftHeldDown = (GetKeyState(VK_SHIFT) & mask) != 0; // or "< 0" without masking
     bool bCtrlHeldDown = (GetKeyState(VK_CONTROL) & mask) != 0; // or "< 0" without masking
@@ -930,6 +931,18 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
                 TogglePresetInfo();
                 return;
             case VK_F5:
+#ifdef PROFILING
+                if (bCtrlHeldDown)
+                {
+                    g_plugin.ExportProfile();
+                    return;
+                }
+                if (bShiftHeldDown)
+                {
+                    g_plugin.m_bShowProfiler = !g_plugin.m_bShowProfiler;
+                    return;
+                }
+#endif
                 ToggleFps();
                 return;
             case VK_F6:
@@ -1354,7 +1367,7 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
     else if (UI_mode == UI_MENU) // Case 2: menu is up and gets the keyboard input (menu navigation).
     {
         //assert(g_plugin.m_pCurMenu);
-#ifdef TIMER_TP
+#ifdef TIMER_RT
         if (g_plugin.m_pCurMenu->HandleKeydown(reinterpret_cast<HWND>(&s_cs), WM_KEYDOWN, nChar, nRepCnt) == 0)
             return;
 #else
@@ -1432,6 +1445,7 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
                 }
                 else if (s_fullscreen)
                 {
+                    lock.Unlock();
                     ToggleFullScreen();
                 }
                 return;
@@ -1550,8 +1564,7 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
 
                         if (bShiftHeldDown && bCtrlHeldDown)
                         {
-                            for (int x = 0; x < NUM_TEX; x++)
-                                g_plugin.m_texmgr.KillTex(x);
+                            g_plugin.KillAllSprites();
                         }
                         else
                         {
@@ -1679,9 +1692,7 @@ void milk2_ui_element::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
                 if (bCtrlHeldDown)
                 {
                     // Kill all sprites.
-                    for (int x = 0; x < NUM_TEX; x++)
-                        if (g_plugin.m_texmgr.m_tex[x].pSurface)
-                            g_plugin.m_texmgr.KillTex(x);
+                    g_plugin.KillAllSprites();
                 }
                 return;
             case VK_F1:
@@ -1717,6 +1728,7 @@ void milk2_ui_element::OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
     UNREFERENCED_PARAMETER(nFlags);
 
     MILK2_CONSOLE_LOG("OnSysKeyDown ", GetWnd())
+    milk2_plugin_lock lock;
     // Bit 29: The context code. The value is 1 if the ALT key is down while the
     //         key is pressed; it is 0 if the WM_SYSKEYDOWN message is posted to
     //         the active window because no window has the keyboard focus.
@@ -1724,6 +1736,7 @@ void milk2_ui_element::OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
     //         the message is sent, or it is 0 if the key is up.
     if ((nChar == VK_RETURN && (nFlags & 0x6000) == 0x2000) && g_plugin.GetFrame() > 0)
     {
+        lock.Unlock();
         ToggleFullScreen();
         return;
     }
@@ -1735,10 +1748,12 @@ void milk2_ui_element::OnSysChar(TCHAR chChar, UINT nRepCnt, UINT nFlags)
     UNREFERENCED_PARAMETER(nFlags);
 
     MILK2_CONSOLE_LOG("OnSysChar ", GetWnd())
+    milk2_plugin_lock lock;
     if (chChar == 'k' || chChar == 'K')
     {
-        ShowPreferencesPage();
         g_plugin.OnAltK(); // Leave in as easter egg
+        lock.Unlock();
+        ShowPreferencesPage();
         return;
     }
 #if 0
@@ -1756,6 +1771,7 @@ void milk2_ui_element::OnCommand(UINT uNotifyCode, int nID, CWindow wndCtl)
     UNREFERENCED_PARAMETER(wndCtl);
 
     MILK2_CONSOLE_LOG("OnCommand ", GetWnd())
+    milk2_plugin_lock lock;
     if (g_plugin.GetScreenMode() == WINDOWED)
     {
         switch (nID)
@@ -1806,12 +1822,17 @@ void milk2_ui_element::OnCommand(UINT uNotifyCode, int nID, CWindow wndCtl)
                 }
             case ID_VIS_FS:
                 if (g_plugin.GetFrame() > 0)
+                {
+                    lock.Unlock();
                     ToggleFullScreen(); //PostMessage(WM_USER + 1667, 0, 0);
+                }
                 return;
             case ID_VIS_CFG:
+                lock.Unlock();
                 ShowPreferencesPage(); //ToggleHelp();
                 return;
             case ID_VIS_MENU:
+                lock.Unlock();
                 POINT pt;
                 GetCursorPos(&pt);
                 SendMessage(WM_CONTEXTMENU, (WPARAM)get_wnd(), ((LPARAM)pt.y << 16) | pt.x);
@@ -89,14 +89,14 @@
 #include <vis_milk2/dxcontext.h>
 #include <vis_milk2/utility.h>
 
-#define TIMER_TP // Thread pool timer
+#define TIMER_RT // Render thread
 //#define TIMER_32 // Win32 timer
 //#define TIMER_DX // DirectX step timer
-#if !defined(TIMER_TP) && !defined(TIMER_32) && !defined(TIMER_DX)
+#if !defined(TIMER_RT) && !defined(TIMER_32) && !defined(TIMER_DX)
 #error Missing timer selection.
 #endif
-#if ((defined(TIMER_TP) && (defined(TIMER_32) || defined(TIMER_DX))) || (defined(TIMER_32) && (defined(TIMER_TP) || defined(TIMER_DX))) || \
-     (defined(TIMER_DX) && (defined(TIMER_TP) || defined(TIMER_32))))
+#if ((defined(TIMER_RT) && (defined(TIMER_32) || defined(TIMER_DX))) || (defined(TIMER_32) && (defined(TIMER_RT) || defined(TIMER_DX))) || \
+     (defined(TIMER_DX) && (defined(TIMER_RT) || defined(TIMER_32))))
 #error Timer selection is not mutually exclusive.
 #endif
 #if defined(TIMER_32)
@@ -69,6 +69,9 @@ static cfg_blob cfg_stFontInfo(guid_cfg_stFontInfo, default_stFontInfo, sizeof(t
 static advconfig_branch_factory g_advconfigBranch("MilkDrop", guid_advconfig_branch, advconfig_branch::guid_branch_vis, 0);
 static advconfig_checkbox_factory cfg_bDebugOutput("Debug output", "milk2.bDebugOutput", guid_cfg_bDebugOutput, guid_advconfig_branch, order_bDebugOutput, default_bDebugOutput, 0);
 static advconfig_string_factory cfg_szPresetDir("Preset directory", "milk2.szPresetDir", guid_cfg_szPresetDir, guid_advconfig_branch, order_szPresetDir, "", advconfig_entry_string::flag_is_folder_path);
+static advconfig_integer_factory cfg_nPresetCpuBudget("Preset CPU budget per frame (microseconds, 0 = unlimited)", "milk2.nPresetCpuBudget", guid_cfg_nPresetCpuBudget, guid_advconfig_branch, order_nPresetCpuBudget, default_nPresetCpuBudget, 0, 1000000, 0);
+static advconfig_checkbox_factory cfg_bNoiseCache("Cache generated noise textures on disk", "milk2.bNoiseCache", guid_cfg_bNoiseCache, guid_advconfig_branch, order_bNoiseCache, default_bNoiseCache, 0);
+static advconfig_signed_integer_factory cfg_nAudioOffset("Audio sync offset (milliseconds, negative if the output is heard late)", "milk2.nAudioOffset", guid_cfg_nAudioOffset, guid_advconfig_branch, order_nAudioOffset, default_nAudioOffset, -1000, 1000, 0);
 // clang-format on
 } // namespace
 
@@ -1206,6 +1209,9 @@ void milk2_config::reset()
     settings.m_nMaxPSVersion = static_cast<uint32_t>(cfg_nMaxPSVersion);
     settings.m_nMaxImages = static_cast<uint32_t>(cfg_nMaxImages);
     settings.m_nMaxBytes = static_cast<uint32_t>(cfg_nMaxBytes);
+    settings.m_nPresetCpuBudget = static_cast<uint32_t>(cfg_nPresetCpuBudget.get());
+    settings.m_bNoiseCache = cfg_bNoiseCache.get();
+    settings.m_nAudioOffset = static_cast<int32_t>(cfg_nAudioOffset.get());
 
     settings.m_fBlendTimeUser = static_cast<float>(cfg_fBlendTimeUser);
     settings.m_fBlendTimeAuto = static_cast<float>(cfg_fBlendTimeAuto);
@@ -148,6 +148,9 @@ typedef struct
     int32_t m_nMaxPSVersion;
     uint32_t m_nMaxImages;
     uint32_t m_nMaxBytes;
+    uint32_t m_nPresetCpuBudget;
+    bool m_bNoiseCache;
+    int32_t m_nAudioOffset;
 
     float m_fBlendTimeUser;
     float m_fBlendTimeAuto;
@@ -7,6 +7,9 @@
 
 #include "pch.h"
 #include "supertext.h"
+
+#include <vis_milk2/extrude.h>
+
 namespace
 {
 #include <extrusionps.inc>
@@ -144,12 +147,8 @@ class PointSnapper
         return hr;
     }
 
-    static float SnapCoordinate(float x) { return floorf(16.0f * x + .5f) / 16.0f; }
-
     static D2D1_POINT_2F SnapPoint(D2D1_POINT_2F pt) { return D2D1::Point2F(SnapCoordinate(pt.x), SnapCoordinate(pt.y)); }
 
-    static XMFLOAT2 SnapPoint(XMFLOAT2 pt) { return XMFLOAT2(SnapCoordinate(pt.x), SnapCoordinate(pt.y)); }
-
   private:
     // PointSnappingSink
     // Internal sink used to implement SnapGeometry.
@@ -198,6 +197,62 @@ class PointSnapper
     };
 };
 
+// Internal sink used to implement D2DFlatten. Passes lines through and
+// replaces Beziers by line segments within the flattening tolerance.
+class FlatteningSink : public ID2D1SimplifiedGeometrySink
+{
+  public:
+    FlatteningSink(ID2D1SimplifiedGeometrySink* pSink, float flatteningTolerance) : m_pSinkNoRef(pSink), m_flatteningTolerance(flatteningTolerance), m_lastPoint({0.0f, 0.0f}) {}
+
+    STDMETHOD_(void, AddBeziers)(const D2D1_BEZIER_SEGMENT* beziers, UINT beziersCount)
+    {
+        m_points.clear();
+        for (UINT i = 0; i < beziersCount; ++i)
+        {
+            FlattenCubic(m_lastPoint,
+                         {beziers[i].point1.x, beziers[i].point1.y},
+                         {beziers[i].point2.x, beziers[i].point2.y},
+                         {beziers[i].point3.x, beziers[i].point3.y},
+                         m_flatteningTolerance,
+                         m_points);
+            m_lastPoint = m_points.back();
+        }
+
+        // `td_point2f` and `D2D1_POINT_2F` are both two floats.
+        static_assert(sizeof(td_point2f) == sizeof(D2D1_POINT_2F));
+        m_pSinkNoRef->AddLines(reinterpret_cast<const D2D1_POINT_2F*>(m_points.data()), static_cast<UINT>(m_points.size()));
+    }
+
+    STDMETHOD_(void, AddLines)(const D2D1_POINT_2F* points, UINT pointsCount)
+    {
+        if (pointsCount > 0)
+        {
+            m_lastPoint = {points[pointsCount - 1].x, points[pointsCount - 1].y};
+            m_pSinkNoRef->AddLines(points, pointsCount);
+        }
+    }
+
+    STDMETHOD_(void, BeginFigure)(D2D1_POINT_2F startPoint, D2D1_FIGURE_BEGIN figureBegin)
+    {
+        m_lastPoint = {startPoint.x, startPoint.y};
+        m_pSinkNoRef->BeginFigure(startPoint, figureBegin);
+    }
+
+    STDMETHOD_(void, EndFigure)(D2D1_FIGURE_END figureEnd) { m_pSinkNoRef->EndFigure(figureEnd); }
+
+    STDMETHOD_(void, SetFillMode)(D2D1_FILL_MODE fillMode) { m_pSinkNoRef->SetFillMode(fillMode); }
+
+    STDMETHOD_(void, SetSegmentFlags)(D2D1_PATH_SEGMENT vertexFlags) { m_pSinkNoRef->SetSegmentFlags(vertexFlags); }
+
+    STDMETHOD(Close)() { return m_pSinkNoRef->Close(); }
+
+  private:
+    ID2D1SimplifiedGeometrySink* m_pSinkNoRef;
+    float m_flatteningTolerance;
+    td_point2f m_lastPoint;
+    std::vector<td_point2f> m_points;
+};
+
 // Helper function that performs "flattening" -- transforms a geometry with Beziers into one
 // containing only line segments.
 static HRESULT D2DFlatten(ID2D1Geometry* pGeometry, float flatteningTolerance, ID2D1Geometry** ppGeometry)
@@ -216,16 +271,18 @@ static HRESULT D2DFlatten(ID2D1Geometry* pGeometry, float flatteningTolerance, I
 
         if (SUCCEEDED(hr))
         {
+            NoRefComObject<FlatteningSink> flattener(pSink, flatteningTolerance);
+
             hr = pGeometry->Simplify(
-                D2D1_GEOMETRY_SIMPLIFICATION_OPTION_LINES,
+                D2D1_GEOMETRY_SIMPLIFICATION_OPTION_CUBICS_AND_LINES,
                 NULL, // world transform
                 flatteningTolerance,
-                pSink
+                &flattener
             );
 
             if (SUCCEEDED(hr))
             {
-                hr = pSink->Close();
+                hr = flattener.Close();
 
                 if (SUCCEEDED(hr))
                 {
@@ -335,7 +392,7 @@ static HRESULT D2DCombine(D2D1_COMBINE_MODE combineMode, ID2D1Geometry* pGeometr
 class Extruder
 {
   public:
-    static HRESULT ExtrudeGeometry(ID2D1Geometry* pGeometry, float height, std::vector<PNVertex>& vertices)
+    static HRESULT ExtrudeGeometry(ID2D1Geometry* pGeometry, float height, std::vector<td_extrudevertex>& vertices)
     {
         HRESULT hr;
 
@@ -426,7 +483,7 @@ class Extruder
     class ExtrudingSink : public ID2D1SimplifiedGeometrySink, public ID2D1TessellationSink
     {
       public:
-        ExtrudingSink(float height, std::vector<PNVertex>* pVertices) : m_height(height), m_vertices(*pVertices), m_startPoint({0.0f, 0.0f}), m_lastPoint({0.0f, 0.0f}), m_hr(S_OK) {}
+        ExtrudingSink(float height, std::vector<td_extrudevertex>* pVertices) : m_height(height), m_vertices(*pVertices) {}
 
         STDMETHOD_(void, AddBeziers)(const D2D1_BEZIER_SEGMENT* /*beziers*/, UINT /*beziersCount*/)
         {
@@ -436,139 +493,23 @@ class Extruder
 
         STDMETHOD_(void, AddLines)(const D2D1_POINT_2F* points, UINT pointsCount)
         {
-            if (SUCCEEDED(m_hr))
-            {
-                for (UINT i = 0; SUCCEEDED(m_hr) && i < pointsCount; ++i)
-                {
-                    Vertex2D v{};
-
-                    v.pt = XMFLOAT2(points[i].x, points[i].y);
-
-                    // Take care to ignore degenerate segments, as we will be
-                    // unable to compute proper normals for them.
-                    // Note: This doesn't handle near-degenerate segments, which
-                    // should probably also be removed. The one complication here
-                    // is that the segments should be removed from both the outline
-                    // and the front/back tessellations.
-                    if ((m_figureVertices.empty()) ||
-                        (v.pt.x != m_figureVertices.back().pt.x) ||
-                        (v.pt.y != m_figureVertices.back().pt.y))
-                    {
-                        m_figureVertices.push_back(v);
-                        m_hr = S_OK;
-                    }
-                }
-            }
+            for (UINT i = 0; i < pointsCount; ++i)
+                m_figure.push_back({points[i].x, points[i].y});
         }
 
         STDMETHOD_(void, BeginFigure)(D2D1_POINT_2F startPoint, D2D1_FIGURE_BEGIN /*figureBegin*/)
         {
-            if (SUCCEEDED(m_hr))
-            {
-                m_figureVertices.clear();
-
-                Vertex2D v = {
-                    XMFLOAT2(startPoint.x, startPoint.y),
-                    XMFLOAT2(0.0f, 0.0f), // dummy
-                    XMFLOAT2(0.0f, 0.0f), // dummy
-                    XMFLOAT2(0.0f, 0.0f)  // dummy
-                };
-
-                m_figureVertices.push_back(v);
-                m_hr = S_OK;
-            }
+            m_figure.clear();
+            m_figure.push_back({startPoint.x, startPoint.y});
         }
 
-        STDMETHOD(Close)() { return m_hr; }
+        STDMETHOD(Close)() { return S_OK; }
 
         STDMETHOD_(void, EndFigure)(D2D1_FIGURE_END /*figureEnd*/)
         {
-            if (SUCCEEDED(m_hr))
-            {
-                XMFLOAT2 front = m_figureVertices.front().pt;
-                XMFLOAT2 back = m_figureVertices.back().pt;
-
-                if (front.x == back.x && front.y == back.y)
-                {
-                    m_figureVertices.pop_back();
-                }
-
-                // If we only have one vertex, then there is nothing to draw!
-                if (m_figureVertices.size() > 1)
-                {
-                    // Construct the triangles corresponding to the sides of
-                    // the extruded object in 3 steps:
-                    //
-                    // Step 1: Snap vertices and calculate normals.
-                    //         Note: It is important that we compute normals *before*
-                    //         snapping the vertices, otherwise, the normals will become
-                    //         discretized, which will manifest itself as faceting.
-                    for (UINT i = 0; i < static_cast<UINT>(m_figureVertices.size()); ++i)
-                    {
-                        m_figureVertices[i].norm = GetNormal(i);
-                        m_figureVertices[i].pt = PointSnapper::SnapPoint(m_figureVertices[i].pt);
-                    }
-
-                    // Step 2: Interpolate normals as appropriate.
-                    for (UINT i = 0; i < static_cast<UINT>(m_figureVertices.size()); ++i)
-                    {
-                        UINT h = static_cast<int64_t>(i + static_cast<UINT>(m_figureVertices.size()) - 1) % m_figureVertices.size();
-
-                        XMFLOAT2 n1 = m_figureVertices[h].norm;
-                        XMFLOAT2 n2 = m_figureVertices[i].norm;
-
-                        // Take a dot-product to determine if the angle between
-                        // the normals is small. If it is, then average them so we
-                        // get a smooth transition from one face to the next.
-                        if ((n1.x * n2.x + n1.y * n2.y) > .5f)
-                        {
-                            XMFLOAT2 sum;
-                            XMVECTOR vN1 = XMLoadFloat2(&m_figureVertices[h].norm);
-                            XMVECTOR vN2 = XMLoadFloat2(&m_figureVertices[i].norm);
-                            XMVECTOR vSum = vN2 + vN1;
-                            XMStoreFloat2(&sum, vSum);
-
-                            m_figureVertices[i].interpNorm1 = m_figureVertices[i].interpNorm2 = Normalize(sum);
-                        }
-                        else
-                        {
-                            m_figureVertices[i].interpNorm1 = m_figureVertices[h].norm;
-                            m_figureVertices[i].interpNorm2 = m_figureVertices[i].norm;
-                        }
-                    }
-
-                    // Step 3: Output the triangles.
-                    // interpNorm1 == end normal of previous segment
-                    // interpNorm2 == begin normal of next segment
-                    for (UINT i = 0; i < static_cast<UINT>(m_figureVertices.size()); ++i)
-                    {
-                        UINT j = static_cast<int64_t>(i + 1) % m_figureVertices.size();
-
-                        XMFLOAT2 pt = m_figureVertices[i].pt;
-                        XMFLOAT2 nextPt = m_figureVertices[j].pt;
-
-                        XMFLOAT2 ptNorm3 = m_figureVertices[i].interpNorm2;
-                        XMFLOAT2 nextPtNorm2 = m_figureVertices[j].interpNorm1;
-
-                        // These 6 vertices define two adjacent triangles that
-                        // together form a quad.
-                        PNVertex newVertices[6] = {
-                            {XMFLOAT3(pt.x,     pt.y,      m_height / 2), XMFLOAT3(ptNorm3.x,     ptNorm3.y,     0.0f)},
-                            {XMFLOAT3(pt.x,     pt.y,     -m_height / 2), XMFLOAT3(ptNorm3.x,     ptNorm3.y,     0.0f)},
-                            {XMFLOAT3(nextPt.x, nextPt.y, -m_height / 2), XMFLOAT3(nextPtNorm2.x, nextPtNorm2.y, 0.0f)},
-                            {XMFLOAT3(nextPt.x, nextPt.y, -m_height / 2), XMFLOAT3(nextPtNorm2.x, nextPtNorm2.y, 0.0f)},
-                            {XMFLOAT3(nextPt.x, nextPt.y,  m_height / 2), XMFLOAT3(nextPtNorm2.x, nextPtNorm2.y, 0.0f)},
-                            {XMFLOAT3(pt.x,     pt.y,      m_height / 2), XMFLOAT3(ptNorm3.x,     ptNorm3.y,     0.0f)},
-                        };
-
-                        for (UINT n = 0; SUCCEEDED(m_hr) && n < ARRAYSIZE(newVertices); ++n)
-                        {
-                            m_vertices.push_back(newVertices[n]);
-                            m_hr = S_OK;
-                        }
-                    }
-                }
-            }
+            // Construct the triangles corresponding to the sides of the
+            // extruded object.
+            ExtrudeFigure(m_figure, m_height, m_vertices);
         }
 
         STDMETHOD_(void, SetFillMode)(D2D1_FILL_MODE /*fillMode*/)
@@ -581,94 +522,15 @@ class Extruder
         }
         STDMETHOD_(void, AddTriangles)(const D2D1_TRIANGLE* triangles, UINT trianglesCount)
         {
-            if (SUCCEEDED(m_hr))
-            {
-                // These triangles represent the front and back faces of the extrusion.
-                for (UINT i = 0; i < trianglesCount; ++i)
-                {
-                    D2D1_TRIANGLE tri = triangles[i];
-
-                    D2D1_POINT_2F d1 = {tri.point2.x - tri.point1.x, tri.point2.y - tri.point1.y};
-                    D2D1_POINT_2F d2 = {tri.point3.x - tri.point2.x, tri.point3.y - tri.point2.y};
-
-                    tri.point1 = PointSnapper::SnapPoint(tri.point1);
-                    tri.point2 = PointSnapper::SnapPoint(tri.point2);
-                    tri.point3 = PointSnapper::SnapPoint(tri.point3);
-
-                    // Currently, tessellate does not guarantee the orientation
-                    // of the triangles it produces, so we must check here.
-                    float cross = d1.x * d2.y - d1.y * d2.x;
-                    if (cross < 0)
-                    {
-                        D2D1_POINT_2F tmp = tri.point1;
-
-                        tri.point1 = tri.point2;
-                        tri.point2 = tmp;
-                    }
-
-                    PNVertex newVertices[] = {
-                        {XMFLOAT3(tri.point1.x, tri.point1.y, m_height / 2),  XMFLOAT3(0.0f, 0.0f, 1.0f) },
-                        {XMFLOAT3(tri.point2.x, tri.point2.y, m_height / 2),  XMFLOAT3(0.0f, 0.0f, 1.0f) },
-                        {XMFLOAT3(tri.point3.x, tri.point3.y, m_height / 2),  XMFLOAT3(0.0f, 0.0f, 1.0f) },
-
-                        // Note: these points are listed in a different order
-                        // since the orientation of the back face should be
-                        // the opposite of the front face.
-                        {XMFLOAT3(tri.point2.x, tri.point2.y, -m_height / 2), XMFLOAT3(0.0f, 0.0f, -1.0f)},
-                        {XMFLOAT3(tri.point1.x, tri.point1.y, -m_height / 2), XMFLOAT3(0.0f, 0.0f, -1.0f)},
-                        {XMFLOAT3(tri.point3.x, tri.point3.y, -m_height / 2), XMFLOAT3(0.0f, 0.0f, -1.0f)},
-                    };
-
-                    for (UINT j = 0; SUCCEEDED(m_hr) && j < ARRAYSIZE(newVertices); ++j)
-                    {
-                        m_vertices.push_back(newVertices[j]);
-                        m_hr = S_OK;
-                    }
-                }
-            }
+            // These triangles represent the front and back faces of the extrusion.
+            static_assert(sizeof(td_triangle2f) == sizeof(D2D1_TRIANGLE));
+            ExtrudeCaps(reinterpret_cast<const td_triangle2f*>(triangles), trianglesCount, m_height, m_vertices);
         }
 
       private:
-        XMFLOAT2 GetNormal(UINT i)
-        {
-            UINT j = static_cast<int64_t>(i + 1) % m_figureVertices.size();
-
-            XMFLOAT2 vecij;
-            XMVECTOR pti = XMLoadFloat2(&m_figureVertices[i].pt);
-            XMVECTOR ptj = XMLoadFloat2(&m_figureVertices[j].pt);
-            XMVECTOR vij = ptj - pti;
-            XMStoreFloat2(&vecij, vij);
-
-            return Normalize(XMFLOAT2(vecij.y, vecij.x));
-        }
-
-        XMFLOAT2 Normalize(XMFLOAT2 pt)
-        {
-            XMVECTOR vt = XMLoadFloat2(&pt);
-            XMVECTOR vRet = vt / sqrtf(pt.x * pt.x + pt.y * pt.y);
-            XMFLOAT2 pRet;
-            XMStoreFloat2(&pRet, vRet);
-
-            return pRet;
-        }
-
-        struct Vertex2D
-        {
-            XMFLOAT2 pt;
-            XMFLOAT2 norm;
-            XMFLOAT2 interpNorm1;
-            XMFLOAT2 interpNorm2;
-        };
-
-        HRESULT m_hr;
-
         float m_height;
-        D2D1_POINT_2F m_lastPoint;
-        D2D1_POINT_2F m_startPoint;
-
-        std::vector<PNVertex>& m_vertices;
-
-        std::vector<Vertex2D> m_figureVertices;
+        std::vector<td_extrudevertex>& m_vertices;
+        std::vector<td_point2f> m_figure;
     };
 };
 
@@ -889,8 +751,6 @@ class OutlineRenderer : public IDWriteTextRenderer
     {"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
 };
 
-/* static*/ const UINT SuperText::sc_vertexBufferCount = 3 * 1000; // must be a multiple of 3
-
 // Constructor -- initializes member data.
 SuperText::SuperText(DXContext* lpDX) :
     m_pD2DFactory(nullptr),
@@ -899,10 +759,11 @@ SuperText::SuperText(DXContext* lpDX) :
     m_pContext(nullptr),
     m_pSwapChain(nullptr),
     m_pState(nullptr),
-    m_pVertexBuffer(nullptr),
     m_pVertexLayout(nullptr),
     m_pTextGeometry(nullptr),
-    m_pTextLayout(nullptr)
+    m_pTextLayout(nullptr),
+    m_width(0),
+    m_height(0)
 {
     m_characters = L"> ";
     m_fontFace = L"Gabriola";
@@ -920,9 +781,7 @@ SuperText::SuperText(DXContext* lpDX) :
 // Destructor -- tears down member data.
 SuperText::~SuperText()
 {
-    m_pState.Reset();
-    m_pVertexBuffer.Reset();
-    m_pVertexLayout.Reset();
+    DiscardDeviceResources();
     SafeReleaseT(&m_pTextGeometry);
     SafeReleaseT(&m_pTextLayout);
 }
@@ -966,7 +825,7 @@ HRESULT SuperText::UpdateTextGeometry()
     IDWriteTextFormat* pFormat = NULL;
 
     hr = m_pDWriteFactory->CreateTextFormat(
-        m_fontFace,
+        m_fontFace.c_str(),
         NULL,
         DWRITE_FONT_WEIGHT_EXTRA_BOLD,
         DWRITE_FONT_STYLE_NORMAL,
@@ -1186,92 +1045,95 @@ HRESULT SuperText::CreateDeviceDependentResources(ID3D11Device1* pDevice, ID3D11
     return hr;
 }
 
-HRESULT SuperText::CreateWindowSizeDependentResources(int nWidth, int nHeight)
+// Creates the shaders, input layout, sampler and constant buffers, which
+// do not depend on the window size.
+HRESULT SuperText::CreatePipelineResources()
 {
     HRESULT hr = S_OK;
 
-    if (m_pDevice && m_pSwapChain)
+    if (SUCCEEDED(hr))
     {
-        if (SUCCEEDED(hr))
-        {
-            D3D11_BUFFER_DESC bd{};
+        D3D11_BUFFER_DESC bd{};
 
-            // Create the constant buffers.
-            bd.Usage = D3D11_USAGE_DEFAULT;
-            bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            bd.CPUAccessFlags = 0;
-            bd.ByteWidth = (sizeof(ConstantBufferNeverChanges) + 15) / 16 * 16;
-            hr = m_pDevice->CreateBuffer(&bd, nullptr, &m_constantBufferNeverChanges);
+        // Create the constant buffers.
+        bd.Usage = D3D11_USAGE_DEFAULT;
+        bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        bd.CPUAccessFlags = 0;
+        bd.ByteWidth = (sizeof(ConstantBufferNeverChanges) + 15) / 16 * 16;
+        hr = m_pDevice->CreateBuffer(&bd, nullptr, m_constantBufferNeverChanges.ReleaseAndGetAddressOf());
 
-            bd.ByteWidth = (sizeof(ConstantBufferChangeOnResize) + 15) / 16 * 16;
-            hr |= m_pDevice->CreateBuffer(&bd, nullptr, &m_constantBufferChangeOnResize);
+        bd.ByteWidth = (sizeof(ConstantBufferChangeOnResize) + 15) / 16 * 16;
+        hr |= m_pDevice->CreateBuffer(&bd, nullptr, m_constantBufferChangeOnResize.ReleaseAndGetAddressOf());
 
-            bd.ByteWidth = (sizeof(ConstantBufferChangesEveryFrame) + 15) / 16 * 16;
-            hr |= m_pDevice->CreateBuffer(&bd, nullptr, &m_constantBufferChangesEveryFrame);
-        }
+        bd.ByteWidth = (sizeof(ConstantBufferChangesEveryFrame) + 15) / 16 * 16;
+        hr |= m_pDevice->CreateBuffer(&bd, nullptr, m_constantBufferChangesEveryFrame.ReleaseAndGetAddressOf());
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            D3D11_SAMPLER_DESC sampDesc{};
-            sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-            sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-            sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-            sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-            sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-            sampDesc.MinLOD = 0;
-            sampDesc.MaxLOD = FLT_MAX;
-            hr = m_pDevice->CreateSamplerState(&sampDesc, m_samplerLinear.GetAddressOf());
-        }
+    if (SUCCEEDED(hr))
+    {
+        D3D11_SAMPLER_DESC sampDesc{};
+        sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+        sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+        sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+        sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+        sampDesc.MinLOD = 0;
+        sampDesc.MaxLOD = FLT_MAX;
+        hr = m_pDevice->CreateSamplerState(&sampDesc, m_samplerLinear.ReleaseAndGetAddressOf());
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            // Create the input layout.
-            hr = m_pDevice->CreateInputLayout(sc_PNVertexLayout, ARRAYSIZE(sc_PNVertexLayout), extrusionvsCode, sizeof(extrusionvsCode), &m_pVertexLayout);
+    if (SUCCEEDED(hr))
+    {
+        // Create the input layout.
+        hr = m_pDevice->CreateInputLayout(sc_PNVertexLayout, ARRAYSIZE(sc_PNVertexLayout), extrusionvsCode, sizeof(extrusionvsCode), m_pVertexLayout.ReleaseAndGetAddressOf());
 
-            // Load the shaders [and textures].
-            hr |= m_pDevice->CreateVertexShader(extrusionvsCode, sizeof(extrusionvsCode), nullptr, &m_vertexShader);
-            hr |= m_pDevice->CreatePixelShader(extrusionpsCode, sizeof(extrusionpsCode), nullptr, &m_pixelShader);
-        }
+        // Load the shaders [and textures].
+        hr |= m_pDevice->CreateVertexShader(extrusionvsCode, sizeof(extrusionvsCode), nullptr, m_vertexShader.ReleaseAndGetAddressOf());
+        hr |= m_pDevice->CreatePixelShader(extrusionpsCode, sizeof(extrusionpsCode), nullptr, m_pixelShader.ReleaseAndGetAddressOf());
+    }
 
-        if (SUCCEEDED(hr))
-        {
-            // Set the input layout.
-            m_pContext->IASetInputLayout(m_pVertexLayout.Get());
+    if (SUCCEEDED(hr))
+    {
+        // Initialize the world matrices.
+        XMStoreFloat4x4(&m_WorldMatrix, XMMatrixIdentity());
+
+        // Initialize the view matrix.
+        XMStoreFloat4x4(&m_ViewMatrix, XMMatrixLookAtLH(XMLoadFloat3(&sc_eyeLocation), XMLoadFloat3(&sc_eyeAt), XMLoadFloat3(&sc_eyeUp)));
+
+        // Update variables that never change.
+        ConstantBufferNeverChanges constantBufferNeverChanges{};
+        XMStoreFloat4x4(&constantBufferNeverChanges.View, XMMatrixTranspose(XMLoadFloat4x4(&m_ViewMatrix)));
+        XMStoreFloat4(&constantBufferNeverChanges.LightPosition[0], XMVectorSet(1200.0f, -20.0f, 400.0f, 0.0f));
+        XMStoreFloat4(&constantBufferNeverChanges.LightColor[0], XMVectorSet(0.9f, 0.0f, 0.0f, 1.0f));
+        m_pContext->UpdateSubresource(m_constantBufferNeverChanges.Get(), 0, nullptr, &constantBufferNeverChanges, 0, 0);
+
+        ConstantBufferChangesEveryFrame changesEveryFrame{};
+        XMStoreFloat4x4(&changesEveryFrame.World, XMMatrixTranspose(XMLoadFloat4x4(&m_WorldMatrix)));
+        m_pContext->UpdateSubresource(m_constantBufferChangesEveryFrame.Get(), 0, nullptr, &changesEveryFrame, 0, 0);
+    }
+    else
+    {
+        m_constantBufferNeverChanges.Reset();
+    }
 
-            D3D11_BUFFER_DESC bd{};
-            bd.Usage = D3D11_USAGE_DYNAMIC;
-            bd.ByteWidth = sc_vertexBufferCount * sizeof(PNVertex);
-            bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-            bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-            bd.MiscFlags = 0;
+    return hr;
+}
 
-            hr = m_pDevice->CreateBuffer(&bd, NULL, m_pVertexBuffer.GetAddressOf());
+// Only updates the projection, and only when the size actually changed;
+// called every frame the title is shown.
+HRESULT SuperText::CreateWindowSizeDependentResources(int nWidth, int nHeight)
+{
+    HRESULT hr = S_OK;
+
+    if (m_pDevice && m_pSwapChain && (nWidth != m_width || nHeight != m_height || !m_constantBufferNeverChanges))
+    {
+        if (!m_constantBufferNeverChanges)
+        {
+            hr = CreatePipelineResources();
         }
 
         if (SUCCEEDED(hr))
         {
-            // Set the vertex buffer.
-            UINT stride = sizeof(PNVertex);
-            UINT offset = 0;
-            ID3D11Buffer* pVertexBuffer = m_pVertexBuffer.Get();
-
-            m_pContext->IASetVertexBuffers(
-                0, // StartSlot
-                1, // NumBuffers
-                &pVertexBuffer,
-                &stride,
-                &offset
-            );
-
-            // Set primitive topology.
-            m_pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            // Initialize the world matrices.
-            XMStoreFloat4x4(&m_WorldMatrix, XMMatrixIdentity());
-
-            // Initialize the view matrix.
-            XMStoreFloat4x4(&m_ViewMatrix, XMMatrixLookAtLH(XMLoadFloat3(&sc_eyeLocation), XMLoadFloat3(&sc_eyeAt), XMLoadFloat3(&sc_eyeUp)));
-
             // Initialize the projection matrix.
             XMStoreFloat4x4(&m_ProjectionMatrix, XMMatrixPerspectiveFovLH(
                     static_cast<float>(XM_PI) * 0.24f, // fovy
@@ -1280,28 +1142,13 @@ HRESULT SuperText::CreateWindowSizeDependentResources(int nWidth, int nHeight)
                     800.0f // zf
                 )
             );
-            // 0-degree Z-rotation
-            static const XMFLOAT4X4 Rotation0(
-                1.0f, 0.0f, 0.0f, 0.0f,
-                0.0f, 1.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 1.0f, 0.0f,
-                0.0f, 0.0f, 0.0f, 1.0f
-            );
-
-            // Update variables that never change.
-            ConstantBufferNeverChanges constantBufferNeverChanges{};
-            XMStoreFloat4x4(&constantBufferNeverChanges.View, XMMatrixTranspose(XMLoadFloat4x4(&m_ViewMatrix)));
-            XMStoreFloat4(&constantBufferNeverChanges.LightPosition[0], XMVectorSet(1200.0f, -20.0f, 400.0f, 0.0f));
-            XMStoreFloat4(&constantBufferNeverChanges.LightColor[0], XMVectorSet(0.9f, 0.0f, 0.0f, 1.0f));
-            m_pContext->UpdateSubresource(m_constantBufferNeverChanges.Get(), 0, nullptr, &constantBufferNeverChanges, 0, 0);
 
             ConstantBufferChangeOnResize changesOnResize{};
             XMStoreFloat4x4(&changesOnResize.Projection, XMMatrixTranspose(XMLoadFloat4x4(&m_ProjectionMatrix)));
             m_pContext->UpdateSubresource(m_constantBufferChangeOnResize.Get(), 0, nullptr, &changesOnResize, 0, 0);
 
-            ConstantBufferChangesEveryFrame changesEveryFrame{};
-            XMStoreFloat4x4(&changesEveryFrame.World, XMMatrixTranspose(XMLoadFloat4x4(&m_WorldMatrix)));
-            m_pContext->UpdateSubresource(m_constantBufferChangesEveryFrame.Get(), 0, nullptr, &changesEveryFrame, 0, 0);
+            m_width = nWidth;
+            m_height = nHeight;
         }
     }
 
@@ -1317,8 +1164,16 @@ HRESULT SuperText::CreateWindowSizeDependentResources(int nWidth, int nHeight)
 void SuperText::DiscardDeviceResources()
 {
     m_pState.Reset();
-    m_pVertexBuffer.Reset();
     m_pVertexLayout.Reset();
+    m_constantBufferNeverChanges.Reset();
+    m_constantBufferChangeOnResize.Reset();
+    m_constantBufferChangesEveryFrame.Reset();
+    m_samplerLinear.Reset();
+    m_vertexShader.Reset();
+    m_pixelShader.Reset();
+    m_meshes.clear();
+    m_width = 0;
+    m_height = 0;
 }
 
 //void SuperText::OnChar(SHORT key)
@@ -1346,26 +1201,91 @@ void SuperText::DiscardDeviceResources()
 //    UpdateTextGeometry();
 //}
 
+// Called every frame the title is shown, so only a change of text, face or
+// size extrudes the text again; the last few meshes are kept for titles
+// that come back, like a preset name shown again after a song title.
 HRESULT SuperText::SetTextFont(const std::wstring& str, const PCWSTR face, float size)
 {
+    auto it = std::find_if(m_meshes.begin(), m_meshes.end(), [&](const TitleMesh& mesh) {
+        return mesh.size == size && mesh.text == str && mesh.face == face;
+    });
+    if (it != m_meshes.end())
+    {
+        m_meshes.splice(m_meshes.begin(), m_meshes, it);
+        return S_OK;
+    }
+
     m_characters = str;
     m_fontFace = face;
     m_fontSize = size;
 
-    return UpdateTextGeometry();
+    HRESULT hr = UpdateTextGeometry();
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateTextMesh();
+    }
+
+    return hr;
 }
 
-// This method is called when the app needs to paint the window. It uses a D2D
-// RT to draw a gradient background into the swap chain buffer. Then, it uses
-// a separate D2D RT to draw a 2D scene into a D3D texture. This texture is
-// mapped onto a simple planar 3D model and displayed using D3D.
+// Extrudes the current text geometry into an immutable vertex buffer.
+HRESULT SuperText::CreateTextMesh()
+{
+    HRESULT hr = m_pDevice ? S_OK : E_FAIL;
+    ID2D1Geometry* pGeometry = NULL;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = GenerateTextOutline(false, &pGeometry);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        std::vector<td_extrudevertex> vertices;
+
+        hr = Extruder::ExtrudeGeometry(
+            pGeometry,
+            24.0f, // height
+            vertices
+        );
+
+        TitleMesh mesh{m_characters, m_fontFace, m_fontSize, static_cast<UINT>(vertices.size()), nullptr};
+        if (SUCCEEDED(hr) && !vertices.empty())
+        {
+            D3D11_BUFFER_DESC bd{};
+            bd.Usage = D3D11_USAGE_IMMUTABLE;
+            bd.ByteWidth = static_cast<UINT>(vertices.size() * sizeof(td_extrudevertex));
+            bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+            bd.CPUAccessFlags = 0;
+            D3D11_SUBRESOURCE_DATA initData{};
+            initData.pSysMem = vertices.data();
+            hr = m_pDevice->CreateBuffer(&bd, &initData, mesh.vertexBuffer.GetAddressOf());
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            m_meshes.push_front(std::move(mesh));
+            if (m_meshes.size() > sc_maxMeshes)
+            {
+                m_meshes.pop_back();
+            }
+        }
+
+        pGeometry->Release();
+    }
+
+    return hr;
+}
+
+// Draws the mesh of the current text, which only turns: the animation is all
+// in the world matrix.
 HRESULT SuperText::OnRender()
 {
     HRESULT hr = E_FAIL;
     static float t = 0.0f;
     static ULONGLONG dwTimeStart = 0;
 
-    if (m_pContext)
+    if (m_pContext && !m_meshes.empty() && m_constantBufferNeverChanges)
     {
         ULONGLONG dwTimeCur = GetTickCount64();
         if (dwTimeStart == 0)
@@ -1376,77 +1296,37 @@ HRESULT SuperText::OnRender()
 
         float a = (static_cast<float>(XM_PI)) / 4 * std::sin(2 * t);
 
-        // A silly way to get a blinking cursor, but it works!
-        bool showCursor = false; //std::sin(20 * t) < 0;
-
-        ID2D1Geometry* pGeometry = NULL;
-
-        // Note: We are dynamically extruding the geometry every frame here.
-        // This is somewhat wasteful, but allows us to introduce more complex
-        // geometry animations in the future.
-        hr = GenerateTextOutline(showCursor, &pGeometry);
-
-        if (SUCCEEDED(hr))
+        XMStoreFloat4x4(&m_WorldMatrix, XMMatrixRotationY(a));
+
+        // Setup the graphics pipeline.
+        const TitleMesh& mesh = m_meshes.front();
+        UINT stride = sizeof(td_extrudevertex);
+        UINT offset = 0;
+        m_pContext->IASetInputLayout(m_pVertexLayout.Get());
+        m_pContext->IASetVertexBuffers(0, 1, mesh.vertexBuffer.GetAddressOf(), &stride, &offset);
+        m_pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        m_pContext->VSSetConstantBuffers(0, 1, m_constantBufferNeverChanges.GetAddressOf());
+        m_pContext->VSSetConstantBuffers(1, 1, m_constantBufferChangeOnResize.GetAddressOf());
+        m_pContext->VSSetConstantBuffers(2, 1, m_constantBufferChangesEveryFrame.GetAddressOf());
+
+        m_pContext->PSSetConstantBuffers(0, 1, m_constantBufferNeverChanges.GetAddressOf());
+        m_pContext->PSSetSamplers(0, 1, m_samplerLinear.GetAddressOf());
+
+        // Update variables that change once per frame.
+        ConstantBufferChangesEveryFrame constantBufferChangesEveryFrame{};
+        XMStoreFloat4x4(&constantBufferChangesEveryFrame.World, XMMatrixTranspose(XMLoadFloat4x4(&m_WorldMatrix)));
+        m_pContext->UpdateSubresource(m_constantBufferChangesEveryFrame.Get(), 0, nullptr, &constantBufferChangesEveryFrame, 0, 0);
+
+        // Render the scene.
+        m_pContext->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+        m_pContext->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+        if (mesh.vertexCount > 0)
         {
-            std::vector<PNVertex> vertices;
-
-            hr = Extruder::ExtrudeGeometry(
-                pGeometry,
-                24.0f, // height
-                vertices
-            );
-
-            if (SUCCEEDED(hr))
-            {
-                XMStoreFloat4x4(&m_WorldMatrix, XMMatrixRotationY(a));
-
-                // Setup the graphics pipeline.
-                m_pContext->IASetInputLayout(m_pVertexLayout.Get());
-                m_pContext->VSSetConstantBuffers(0, 1, m_constantBufferNeverChanges.GetAddressOf());
-                m_pContext->VSSetConstantBuffers(1, 1, m_constantBufferChangeOnResize.GetAddressOf());
-                m_pContext->VSSetConstantBuffers(2, 1, m_constantBufferChangesEveryFrame.GetAddressOf());
-
-                m_pContext->PSSetConstantBuffers(0, 1, m_constantBufferNeverChanges.GetAddressOf());
-                //m_pContext->PSSetConstantBuffers(1, 1, m_constantBufferChangeOnResize.GetAddressOf());
-                //m_pContext->PSSetConstantBuffers(2, 1, m_constantBufferChangesEveryFrame.GetAddressOf());
-                m_pContext->PSSetSamplers(0, 1, m_samplerLinear.GetAddressOf());
-
-                // Update variables that change once per frame.
-                ConstantBufferChangesEveryFrame constantBufferChangesEveryFrame{};
-                XMStoreFloat4x4(&constantBufferChangesEveryFrame.World, XMMatrixTranspose(XMLoadFloat4x4(&m_WorldMatrix)));
-                m_pContext->UpdateSubresource(m_constantBufferChangesEveryFrame.Get(), 0, nullptr, &constantBufferChangesEveryFrame, 0, 0);
-
-                // Render the scene.
-                m_pContext->VSSetShader(m_vertexShader.Get(), nullptr, 0);
-                m_pContext->PSSetShader(m_pixelShader.Get(), nullptr, 0);
-
-                UINT verticesLeft = static_cast<UINT>(vertices.size());
-
-                UINT index = 0;
-
-                while (verticesLeft > 0)
-                {
-                    UINT verticesToCopy = std::min(verticesLeft, sc_vertexBufferCount);
-
-                    D3D11_MAPPED_SUBRESOURCE resource;
-                    hr = m_pContext->Map(m_pVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
-
-                    if (SUCCEEDED(hr))
-                    {
-                        memcpy(resource.pData, &vertices[index], verticesToCopy * sizeof(PNVertex));
-
-                        m_pContext->Unmap(m_pVertexBuffer.Get(), 0);
-
-                        m_pContext->Draw(verticesToCopy, 0);
-
-                        verticesLeft -= verticesToCopy;
-                        index += verticesToCopy;
-                    }
-                }
-            }
-            pGeometry->Release();
+            m_pContext->Draw(mesh.vertexCount, 0);
         }
+
+        hr = S_OK;
     }
 
     return hr;
-}
\ No newline at end of file
+}
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <list>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -16,6 +17,7 @@
 #include <DirectXMath.h>
 #include <wrl/client.h>
 #include <vis_milk2/dxcontext.h>
+#include <vis_milk2/extrude.h>
 
 struct ConstantBufferNeverChanges
 {
@@ -34,12 +36,6 @@ struct ConstantBufferChangesEveryFrame
     DirectX::XMFLOAT4X4 World;
 };
 
-struct PNVertex
-{
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT3 Norm;
-};
-
 class SuperText
 {
   public:
@@ -59,6 +55,8 @@ class SuperText
   private:
     HRESULT GenerateTextOutline(bool includeCursor, ID2D1Geometry** ppGeometry);
     HRESULT UpdateTextGeometry();
+    HRESULT CreateTextMesh();
+    HRESULT CreatePipelineResources();
     //void OnChar(SHORT key);
 
     // Device-Dependent Resources
@@ -70,7 +68,6 @@ class SuperText
     Microsoft::WRL::ComPtr<ID3D11Texture2D> m_pDepthStencil;
     Microsoft::WRL::ComPtr<ID3D11DepthStencilView> m_pDepthStencilView;
     Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_pRenderTargetView;
-    Microsoft::WRL::ComPtr<ID3D11Buffer> m_pVertexBuffer;
     Microsoft::WRL::ComPtr<ID3D11InputLayout> m_pVertexLayout;
 
     // Device-Independent Resources
@@ -92,9 +89,22 @@ class SuperText
     Microsoft::WRL::ComPtr<ID3D11PixelShader> m_pixelShader;
 
     static const D3D11_INPUT_ELEMENT_DESC sc_PNVertexLayout[];
-    static const UINT sc_vertexBufferCount;
+    static const size_t sc_maxMeshes = 4;
+
+    // Extruded text, keyed by text, face and size.
+    struct TitleMesh
+    {
+        std::wstring text;
+        std::wstring face;
+        float size;
+        UINT vertexCount;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
+    };
+    std::list<TitleMesh> m_meshes; // most recently used first
 
     std::wstring m_characters;
-    PCWSTR m_fontFace;
+    std::wstring m_fontFace;
     float m_fontSize;
+    int m_width; // of the window size dependent resources
+    int m_height;
 };
\ No newline at end of file
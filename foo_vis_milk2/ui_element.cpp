@@ -33,18 +33,18 @@ namespace
 milk2_ui_element::milk2_ui_element(ui_element_config::ptr config, ui_element_instance_callback_ptr p_callback) :
     m_callback(p_callback),
     m_bMsgHandled(TRUE),
-    play_callback_impl_base(flag_on_playback_starting | flag_on_playback_new_track | flag_on_playback_stop),
+    play_callback_impl_base(flag_on_playback_starting | flag_on_playback_new_track | flag_on_playback_stop | flag_on_playback_seek |
+                            flag_on_playback_pause | flag_on_playback_time | flag_on_playback_dynamic_info_track),
     playlist_callback_impl_base(flag_on_items_added | flag_on_items_reordered | flag_on_items_removed | flag_on_items_selection_change |
                                 flag_on_item_focus_change | flag_on_items_modified | flag_on_playlist_activate | flag_on_playlists_reorder |
-                                flag_on_playlists_removed | flag_on_playback_order_changed)
+                                flag_on_playlists_removed | flag_on_playback_order_changed | flag_on_items_replaced),
+    m_playlist_titles(this)
 {
     m_milk2 = false;
     m_in_sizemove = false;
     m_in_suspend = false;
     m_minimized = false;
-#if defined(TIMER_TP)
-    m_tpTimer = nullptr;
-#elif defined(TIMER_32)
+#if defined(TIMER_RT) || defined(TIMER_32)
     m_last_time = 0.0;
 #endif
     m_refresh_interval = 33;
@@ -139,8 +139,9 @@ int milk2_ui_element::OnCreate(LPCREATESTRUCT cs)
     {
         ResolvePwd();
         s_config.init();
-#ifdef TIMER_TP
+#ifdef TIMER_RT
         InitializeCriticalSection(&s_cs);
+        InitializeCriticalSection(&s_frame_cs);
 #endif
     }
 
@@ -162,9 +163,7 @@ int milk2_ui_element::OnCreate(LPCREATESTRUCT cs)
             FB2K_console_print(core_api::get_my_file_name(), ": Exception while creating visualization stream - ", exc);
         }
 
-#if defined(TIMER_TP)
-        m_tpTimer = CreateThreadpoolTimer(TimerCallback, this, NULL);
-#elif defined(TIMER_DX)
+#if defined(TIMER_DX)
         message_loop_v2::get()->add_idle_handler(this);
 #endif
 
@@ -200,8 +199,8 @@ void milk2_ui_element::OnClose()
 void milk2_ui_element::OnDestroy()
 {
     MILK2_CONSOLE_LOG("OnDestroy ", GetWnd())
-#if defined(TIMER_TP)
-    StopTimer();
+#if defined(TIMER_RT)
+    StopRenderLoop();
     EnterCriticalSection(&s_cs);
 #elif defined(TIMER_DX)
     message_loop_v2::get()->remove_idle_handler(this);
@@ -226,8 +225,9 @@ void milk2_ui_element::OnDestroy()
         s_milk2 = false;
 #if defined(TIMER_32)
         KillTimer(ID_REFRESH_TIMER);
-#elif defined(TIMER_TP)
+#elif defined(TIMER_RT)
         DeleteCriticalSection(&s_cs);
+        DeleteCriticalSection(&s_frame_cs);
 #endif
         wcscpy_s(s_config.settings.m_szPresetDir, g_plugin.GetPresetDir()); // save last "Load Preset" menu directory
         g_plugin.PluginQuit();
@@ -242,7 +242,7 @@ void milk2_ui_element::OnDestroy()
     {
         s_in_toggle = false;
     }
-#ifdef TIMER_TP
+#ifdef TIMER_RT
     LeaveCriticalSection(&s_cs);
 #endif
 }
@@ -261,26 +261,27 @@ void milk2_ui_element::OnTimer(UINT_PTR nIDEvent)
 void milk2_ui_element::OnPaint(CDCHandle dc)
 {
     MILK2_CONSOLE_LOG_LIMIT("OnPaint ", GetWnd())
+#ifndef TIMER_RT
     if (m_in_sizemove && m_milk2) // foobar2000 does not enter/exit size/move
     {
         Tick();
     }
     else
+#endif
     {
         PAINTSTRUCT ps;
         std::ignore = BeginPaint(&ps);
         EndPaint(&ps);
     }
-#ifdef TIMER_TP
-    StartTimer();
-#endif
     ValidateRect(NULL);
 #ifdef TIMER_32
     ULONGLONG now = GetTickCount64();
 #endif
     if (m_vis_stream.is_valid())
     {
-        BuildWaves();
+#ifndef TIMER_RT
+        BuildWaves(); // the render thread pulls its own audio
+#endif
 #ifdef TIMER_32
         ULONGLONG next_refresh = m_last_refresh + m_refresh_interval;
         // (next_refresh < now) would break when GetTickCount() overflows
@@ -344,13 +345,10 @@ void milk2_ui_element::OnMove(CPoint ptPos)
     MILK2_CONSOLE_LOG("OnMove ", GetWnd())
     if (m_milk2)
     {
-#ifdef TIMER_TP
-        if (TryEnterCriticalSection(&s_cs) == 0)
-            return;
-#endif
+#ifdef TIMER_RT
+        m_renderLoop.Post(WithLock([] { g_plugin.OnWindowMoved(); }), RC_WINDOW_MOVED);
+#else
         g_plugin.OnWindowMoved();
-#ifdef TIMER_TP
-        LeaveCriticalSection(&s_cs);
 #endif
     }
 }
@@ -387,13 +385,10 @@ void milk2_ui_element::OnSize(UINT nType, CSize size)
         if (height < 128)
             height = 128;
         MILK2_CONSOLE_LOG("OnSize1 ", nType, ", ", size.cx, ", ", size.cy, ", ", GetWnd())
-#ifdef TIMER_TP
-        if (TryEnterCriticalSection(&s_cs) == 0)
-            return;
-#endif
+#ifdef TIMER_RT
+        m_renderLoop.Post(WithLock([size] { g_plugin.OnWindowSizeChanged(size.cx, size.cy); }), RC_WINDOW_SIZE_CHANGED);
+#else
         g_plugin.OnWindowSizeChanged(size.cx, size.cy);
-#ifdef TIMER_TP
-        LeaveCriticalSection(&s_cs);
 #endif
     }
 }
@@ -410,15 +405,12 @@ void milk2_ui_element::OnExitSizeMove()
     m_in_sizemove = false;
     if (m_milk2)
     {
-#ifdef TIMER_TP
-        if (TryEnterCriticalSection(&s_cs) == 0)
-            return;
-#endif
         RECT rc;
         WIN32_OP_D(GetClientRect(&rc));
+#ifdef TIMER_RT
+        m_renderLoop.Post(WithLock([rc] { g_plugin.OnWindowSizeChanged(rc.right - rc.left, rc.bottom - rc.top); }), RC_WINDOW_SIZE_CHANGED);
+#else
         g_plugin.OnWindowSizeChanged(rc.right - rc.left, rc.bottom - rc.top);
-#ifdef TIMER_TP
-        LeaveCriticalSection(&s_cs);
 #endif
     }
 }
@@ -468,7 +460,7 @@ void milk2_ui_element::OnDisplayChange(UINT uBitsPerPixel, CSize sizeScreen)
     MILK2_CONSOLE_LOG("OnDisplayChange ", GetWnd())
     if (m_milk2)
     {
-        g_plugin.OnDisplayChange();
+        PostCommand([] { g_plugin.OnDisplayChange(); });
     }
 }
 
@@ -564,16 +556,24 @@ void milk2_ui_element::OnContextMenu(CWindow wnd, CPoint point)
     //CMenu original;
     //b = menu.LoadMenu(IDR_WINDOWED_CONTEXT_MENU);
     //menu.AppendMenu(MF_STRING, menu.GetSubMenu(0), TEXT("Winamp"));
-    menu.AppendMenu(MF_GRAYED, IDM_CURRENT_PRESET, GetCurrentPreset().c_str());
+    milk2_plugin_lock lock;
+    const std::wstring preset = GetCurrentPreset();
+    const bool bPresetLock = IsPresetLock();
+    const bool bShowPlaylist = g_plugin.m_show_playlist;
+    const bool bShowHelp = g_plugin.m_show_help;
+    const bool bStarted = g_plugin.GetFrame() > 0;
+    lock.Unlock();
+
+    menu.AppendMenu(MF_GRAYED, IDM_CURRENT_PRESET, preset.c_str());
     menu.AppendMenu(MF_SEPARATOR);
     menu.AppendMenu(MF_STRING, IDM_NEXT_PRESET, TEXT("Next Preset"));
     menu.AppendMenu(MF_STRING, IDM_PREVIOUS_PRESET, TEXT("Previous Preset"));
     menu.AppendMenu(MF_STRING, IDM_SHUFFLE_PRESET, TEXT("Random Preset"));
-    menu.AppendMenu(MF_STRING | (IsPresetLock() ? MF_CHECKED : 0), IDM_LOCK_PRESET, TEXT("Lock Preset"));
+    menu.AppendMenu(MF_STRING | (bPresetLock ? MF_CHECKED : 0), IDM_LOCK_PRESET, TEXT("Lock Preset"));
     menu.AppendMenu(MF_SEPARATOR);
     menu.AppendMenu(MF_STRING | (s_config.settings.m_bEnableDownmix ? MF_CHECKED : 0), IDM_ENABLE_DOWNMIX, TEXT("Downmix Channels"));
     menu.AppendMenu(MF_SEPARATOR);
-    menu.AppendMenu(MF_STRING | (g_plugin.m_show_playlist ? MF_CHECKED : 0), IDM_SHOW_PLAYLIST, TEXT("Show Playlist"));
+    menu.AppendMenu(MF_STRING | (bShowPlaylist ? MF_CHECKED : 0), IDM_SHOW_PLAYLIST, TEXT("Show Playlist"));
     //menu.AppendMenu(MF_STRING | (g_plugin.m_show_presets ? MF_CHECKED : 0), IDM_SHOW_PRESETS, TEXT("Show Presets"));
     //menu.AppendMenu(MF_STRING | (g_plugin.m_show_menu ? MF_CHECKED : 0), IDM_SHOW_MENU, TEXT("Show Menu"));
     menu.AppendMenu(MF_STRING | (s_config.settings.m_bShowAlbum && std::filesystem::exists(s_config.settings.m_szImgIniFile)
@@ -582,7 +582,7 @@ void milk2_ui_element::OnContextMenu(CWindow wnd, CPoint point)
                     IDM_SHOW_ALBUM, TEXT("Show Album Art"));
     menu.AppendMenu(MF_STRING, IDM_SHOW_TITLE, TEXT("Launch Title"));
     menu.AppendMenu(MF_SEPARATOR);
-    menu.AppendMenu(MF_STRING | (g_plugin.m_show_help ? MF_CHECKED : 0), IDM_SHOW_HELP, TEXT("Show Help"));
+    menu.AppendMenu(MF_STRING | (bShowHelp ? MF_CHECKED : 0), IDM_SHOW_HELP, TEXT("Show Help"));
     menu.AppendMenu(MF_STRING, IDM_SHOW_PREFS, TEXT("Launch Preferences Page"));
     menu.AppendMenu(MF_SEPARATOR);
     menu.AppendMenu(MF_STRING | (s_fullscreen ? MF_CHECKED : 0), IDM_TOGGLE_FULLSCREEN, TEXT("Fullscreen"));
@@ -596,7 +596,7 @@ void milk2_ui_element::OnContextMenu(CWindow wnd, CPoint point)
     switch (cmd)
     {
         case IDM_TOGGLE_FULLSCREEN:
-            if (g_plugin.GetFrame() > 0)
+            if (bStarted)
                 ToggleFullScreen();
             break;
         case IDM_NEXT_PRESET:
@@ -606,7 +606,7 @@ void milk2_ui_element::OnContextMenu(CWindow wnd, CPoint point)
             PrevPreset();
             break;
         case IDM_LOCK_PRESET:
-            LockPreset(!IsPresetLock());
+            LockPreset(!bPresetLock);
             break;
         case IDM_SHUFFLE_PRESET:
             RandomPreset();
@@ -704,47 +704,39 @@ LRESULT milk2_ui_element::OnMilk2Message(UINT uMsg, WPARAM wParam, LPARAM lParam
     else if (lParam == IPC_SETPLAYLISTPOS)
     {
         //MILK2_CONSOLE_LOG("IPC_SETPLAYLISTPOS")
-        SetSelectionSingle(static_cast<size_t>(g_plugin.m_playlist_pos));
+        SetSelectionSingle(static_cast<size_t>(wParam)); // the plugin's `m_playlist_pos`
         return static_cast<LRESULT>(wParam);
     }
     else if (lParam == IPC_GETLISTLENGTH)
     {
         //MILK2_CONSOLE_LOG("IPC_GETLISTLENGTH")
-        const size_t count = api->activeplaylist_get_item_count();
+        const size_t count = m_playlist_titles.GetCount(); // the rows the titles are asked for
         return static_cast<LRESULT>(count);
     }
     else if (lParam == IPC_GETLISTPOS)
     {
         //MILK2_CONSOLE_LOG("IPC_GETLISTPOS")
-        if (m_playback_control->is_playing())
-        {
-            size_t playing_index = NULL, playing_playlist = NULL;
-            bool valid = api->get_playing_item_location(&playing_playlist, &playing_index);
-            if (valid && playing_playlist == api->get_active_playlist())
-                return static_cast<LRESULT>(playing_index);
-        }
-        return -1;
+        return GetPlayingIndex();
     }
-    else if (lParam == IPC_GETPLAYLISTTITLEW || lParam == IPC_GET_PLAYING_TITLE)
+    else if (lParam == IPC_GETPLAYLISTTITLEW)
     {
-        //MILK2_CONSOLE_LOG(IPC_GETPLAYLISTTITLEW ? "IPC_GETPLAYLISTTITLEW" : "IPC_GET_PLAYING_TITLE")
-        titleformat_object::ptr title_format;
-        if (lParam == IPC_GETPLAYLISTTITLEW && m_script.is_empty())
-        {
-            pfc::string8 pattern = pfc::utf8FromWide(s_config.settings.m_szTitleFormat);
-            static_api_ptr_t<titleformat_compiler>()->compile_safe_ex(m_script, pattern);
-        }
-        if (lParam == IPC_GET_PLAYING_TITLE && m_title.is_empty())
+        //MILK2_CONSOLE_LOG("IPC_GETPLAYLISTTITLEW")
+        GetPlaylistTitle(static_cast<size_t>(wParam), m_szBuffer);
+        return reinterpret_cast<LRESULT>(m_szBuffer.c_str());
+    }
+    else if (lParam == IPC_GET_PLAYING_TITLE)
+    {
+        //MILK2_CONSOLE_LOG("IPC_GET_PLAYING_TITLE")
+        if (m_title.is_empty())
         {
             pfc::string8 pattern = default_szTitleFormat;
             static_api_ptr_t<titleformat_compiler>()->compile_safe_ex(m_title, pattern);
         }
         pfc::string_formatter state;
-        metadb_handle_list list;
-        api->activeplaylist_get_all_items(list);
-        if (list.size() == 0)
+        metadb_handle_ptr item;
+        if (api->activeplaylist_get_item_count() == 0)
             state = ""; // no playlist
-        else if (wParam == -1 || !(list.get_item(static_cast<size_t>(wParam)))->format_title(NULL, state, IPC_GETPLAYLISTTITLEW ? m_script : m_title, NULL))
+        else if (wParam == -1 || !api->activeplaylist_get_item_handle(item, static_cast<size_t>(wParam)) || !item->format_title(NULL, state, m_title, NULL))
             if (m_playback_control->is_playing())
                 state = "Opening...";
             else
@@ -792,8 +784,8 @@ LRESULT milk2_ui_element::OnMilk2Message(UINT uMsg, WPARAM wParam, LPARAM lParam
         MILK2_CONSOLE_LOG("IPC_FETCH_ALBUMART")
         if (m_art_file.empty())
         {
-            m_art_data->imgData = m_raster.data();
-            m_art_data->imgDataLen = static_cast<int>(m_raster.size());
+            m_art_data->imgData = const_cast<uint8_t*>(m_raster.GetData());
+            m_art_data->imgDataLen = static_cast<int>(m_raster.GetSize());
             m_art_data->type[0] = L'j'; m_art_data->type[1] = L'p'; m_art_data->type[2] = L'g'; m_art_data->type[3] = L'\0';
             m_art_data->gracenoteFileId = nullptr;
         }
@@ -870,8 +862,14 @@ LRESULT milk2_ui_element::OnConfigurationChange(UINT uMsg, WPARAM wParam, LPARAM
             {
                 s_config.reset();
                 m_script.reset();
+                m_playlist_titles.Reset();
+                PublishPlayState();
                 m_refresh_interval = static_cast<DWORD>(lround(1000.0f / s_config.settings.m_max_fps_fs));
+#ifdef TIMER_RT
+                m_renderLoop.Post(WithLock([settings = s_config.settings]() mutable { g_plugin.PanelSettings(&settings); }), RC_SETTINGS_CHANGED);
+#else
                 g_plugin.PanelSettings(&s_config.settings);
+#endif
                 break;
             }
         case 1: // Advanced Preferences
@@ -882,14 +880,12 @@ LRESULT milk2_ui_element::OnConfigurationChange(UINT uMsg, WPARAM wParam, LPARAM
 
     if (s_milk2 && m_milk2)
     {
-#ifdef TIMER_TP
-        EnterCriticalSection(&s_cs);
-#endif
         RECT rect{};
         GetClientRect(&rect);
+#ifdef TIMER_RT
+        m_renderLoop.Post(WithLock([rect] { g_plugin.OnWindowSizeChanged(rect.right - rect.left, rect.bottom - rect.top); }), RC_WINDOW_SIZE_CHANGED);
+#else
         g_plugin.OnWindowSizeChanged(rect.right - rect.left, rect.bottom - rect.top);
-#ifdef TIMER_TP
-        LeaveCriticalSection(&s_cs);
 #endif
     }
     SetMsgHandled(TRUE);
@@ -931,16 +927,18 @@ bool milk2_ui_element::Initialize(HWND window, int width, int height)
     }
     else
     {
-#ifdef TIMER_TP
-        EnterCriticalSection(&s_cs);
-#endif
+#ifdef TIMER_RT
+        m_renderLoop.Send(WithLock([window, width, height] { g_plugin.OnWindowSwap(window, width, height); }));
+#else
         g_plugin.OnWindowSwap(window, width, height);
-#ifdef TIMER_TP
-        LeaveCriticalSection(&s_cs);
 #endif
     }
 
     m_milk2 = true;
+    PublishPlayState();
+#ifdef TIMER_RT
+    m_renderLoop.Start();
+#endif
 
     return true;
 }
@@ -949,22 +947,12 @@ bool milk2_ui_element::Initialize(HWND window, int width, int height)
 // Executes the render.
 void milk2_ui_element::Tick()
 {
-#ifdef TIMER_TP
-    if (TryEnterCriticalSection(&s_cs) == 0)
-        return;
-#endif
-
 #ifdef TIMER_DX
     m_timer.Tick([&]() { Update(m_timer); });
 #endif
 
-    Render();
-
-#ifdef TIMER_TP
-    LeaveCriticalSection(&s_cs);
-
-    InvalidateRect(NULL, TRUE);
-#endif
+    if (Render())
+        g_plugin.PluginWaitFrame();
 }
 
 #ifdef TIMER_DX
@@ -976,14 +964,15 @@ void milk2_ui_element::Update(DX::StepTimer const& timer)
 #pragma endregion
 
 #pragma region Frame Render
-// Draws the scene.
-HRESULT milk2_ui_element::Render()
+// Draws the scene, without waiting for the frame rate limit. Returns false
+// if no frame was shown.
+bool milk2_ui_element::Render()
 {
     // Do not try to render anything before the first `Update()`.
 #ifdef TIMER_DX
     if (m_timer.GetFrameCount() == 0)
     {
-        return S_OK;
+        return false;
     }
 #else
     if (g_plugin.GetFrame() == 0)
@@ -993,7 +982,7 @@ HRESULT milk2_ui_element::Render()
 
     Clear();
 
-    return g_plugin.PluginRender(waves[0].data(), waves[1].data());
+    return g_plugin.PluginDrawFrame(waves[0].data(), waves[1].data()) != FALSE;
 }
 
 // Clears the back buffers and the window contents.
@@ -1020,6 +1009,9 @@ void milk2_ui_element::BuildWaves()
     double dt = time - m_last_time;
     m_last_time = time;
 
+    // Show the audio heard when the frame will be on screen.
+    double display_time = time + g_plugin.BeginAudioFetch();
+
     constexpr double min_time = 1.0 / 1000.0;
     constexpr double max_time = 1.0 / 10.0;
 
@@ -1034,7 +1026,7 @@ void milk2_ui_element::BuildWaves()
         dt = max_time;
 
     audio_chunk_impl chunk;
-    if (use_fake || !m_vis_stream->get_chunk_absolute(chunk, time - dt, dt))
+    if (use_fake || (!m_vis_stream->get_chunk_absolute(chunk, display_time - dt / 2.0, dt) && !m_vis_stream->get_chunk_absolute(chunk, time - dt, dt)))
     {
         //m_vis_stream->make_fake_chunk_absolute(chunk, time - dt, dt);
         for (uint32_t i = 0; i < static_cast<uint32_t>(NUM_AUDIO_BUFFER_SAMPLES); ++i)
@@ -1136,18 +1128,18 @@ void milk2_ui_element::ToggleFullScreen()
 
 void milk2_ui_element::ToggleHelp()
 {
-    g_plugin.ToggleHelp();
+    PostCommand([] { g_plugin.ToggleHelp(); });
 }
 
 void milk2_ui_element::TogglePlaylist()
 {
-    g_plugin.TogglePlaylist();
+    PostCommand([] { g_plugin.TogglePlaylist(); });
 }
 
 void milk2_ui_element::ToggleSongTitle()
 {
     s_config.settings.m_bShowSongTitle = !s_config.settings.m_bShowSongTitle;
-    g_plugin.m_bShowSongTitle = s_config.settings.m_bShowSongTitle;
+    PostCommand([show = s_config.settings.m_bShowSongTitle] { g_plugin.m_bShowSongTitle = show; });
 }
 
 void milk2_ui_element::ToggleSongLength()
@@ -1166,32 +1158,34 @@ void milk2_ui_element::ToggleSongLength()
         s_config.settings.m_bShowSongTime = true;
         s_config.settings.m_bShowSongLen = false;
     }
-    g_plugin.m_bShowSongTime = s_config.settings.m_bShowSongTime;
-    g_plugin.m_bShowSongLen = s_config.settings.m_bShowSongLen;
+    PostCommand([showTime = s_config.settings.m_bShowSongTime, showLen = s_config.settings.m_bShowSongLen] {
+        g_plugin.m_bShowSongTime = showTime;
+        g_plugin.m_bShowSongLen = showLen;
+    });
 }
 
 void milk2_ui_element::TogglePresetInfo()
 {
     s_config.settings.m_bShowPresetInfo = !s_config.settings.m_bShowPresetInfo;
-    g_plugin.m_bShowPresetInfo = s_config.settings.m_bShowPresetInfo;
+    PostCommand([show = s_config.settings.m_bShowPresetInfo] { g_plugin.m_bShowPresetInfo = show; });
 }
 
 void milk2_ui_element::ToggleFps()
 {
     s_config.settings.m_bShowFPS = !s_config.settings.m_bShowFPS;
-    g_plugin.m_bShowFPS = s_config.settings.m_bShowFPS;
+    PostCommand([show = s_config.settings.m_bShowFPS] { g_plugin.m_bShowFPS = show; });
 }
 
 void milk2_ui_element::ToggleRating()
 {
     s_config.settings.m_bShowRating = !s_config.settings.m_bShowRating;
-    g_plugin.m_bShowRating = s_config.settings.m_bShowRating;
+    PostCommand([show = s_config.settings.m_bShowRating] { g_plugin.m_bShowRating = show; });
 }
 
 void milk2_ui_element::ToggleShaderHelp()
 {
     s_config.settings.m_bShowShaderHelp = !s_config.settings.m_bShowShaderHelp;
-    g_plugin.m_bShowShaderHelp = s_config.settings.m_bShowShaderHelp;
+    PostCommand([show = s_config.settings.m_bShowShaderHelp] { g_plugin.m_bShowShaderHelp = show; });
 }
 
 const char* milk2_ui_element::ToggleShuffle(bool forward = true)
@@ -1206,12 +1200,12 @@ const char* milk2_ui_element::ToggleShuffle(bool forward = true)
 
 void milk2_ui_element::NextPreset(float fBlendTime)
 {
-    g_plugin.NextPreset(fBlendTime);
+    PostCommand([fBlendTime] { g_plugin.NextPreset(fBlendTime); });
 }
 
 void milk2_ui_element::PrevPreset(float fBlendTime)
 {
-    g_plugin.PrevPreset(fBlendTime);
+    PostCommand([fBlendTime] { g_plugin.PrevPreset(fBlendTime); });
 }
 
 bool milk2_ui_element::LoadPreset(int select)
@@ -1232,6 +1226,7 @@ bool milk2_ui_element::LoadPreset(int select)
 
 std::wstring milk2_ui_element::GetCurrentPreset()
 {
+    milk2_plugin_lock lock;
 #ifdef _DEBUG
     wchar_t buf[512]{};
     swprintf_s(buf, L"%s", (g_plugin.m_nLoadingPreset != 0) ? g_plugin.m_pNewState->m_szDesc : g_plugin.m_pState->m_szDesc);
@@ -1250,22 +1245,23 @@ std::wstring milk2_ui_element::GetCurrentPreset()
 
 void milk2_ui_element::LockPreset(bool lockUnlock)
 {
-    g_plugin.m_bPresetLockedByUser = lockUnlock;
+    PostCommand([lockUnlock] { g_plugin.m_bPresetLockedByUser = lockUnlock; });
 }
 
 bool milk2_ui_element::IsPresetLock()
 {
+    milk2_plugin_lock lock;
     return g_plugin.m_bPresetLockedByUser || g_plugin.m_bPresetLockedByCode;
 }
 
 void milk2_ui_element::RandomPreset(float fBlendTime)
 {
-    g_plugin.LoadRandomPreset(fBlendTime);
+    PostCommand([fBlendTime] { g_plugin.LoadRandomPreset(fBlendTime); });
 }
 
 void milk2_ui_element::SetPresetRating(float inc_dec)
 {
-    g_plugin.SetCurrentPresetRating(g_plugin.m_pState->m_fRating + inc_dec);
+    PostCommand([inc_dec] { g_plugin.SetCurrentPresetRating(g_plugin.m_pState->m_fRating + inc_dec); });
 }
 
 void milk2_ui_element::Seek(UINT nRepCnt, bool bShiftHeldDown, double seekDelta)
@@ -1343,6 +1339,24 @@ void milk2_ui_element::UpdateTrack()
     }
 }
 
+// Publishes what the visualization shows of the playback, so that the render
+// thread reads it rather than asking for it over IPC every frame.
+void milk2_ui_element::PublishPlayState()
+{
+    td_playstate state{};
+    const LRESULT index = GetPlayingIndex();
+    state.fPosition = m_playback_control->playback_get_position();
+    state.fLength = m_playback_control->playback_get_length();
+    state.nListLength = static_cast<int32_t>(m_playlist_titles.GetCount());
+    state.nListPos = static_cast<int32_t>(index);
+    state.bPlaying = m_playback_control->is_playing();
+    state.bPaused = m_playback_control->is_paused();
+    std::wstring title;
+    GetPlaylistTitle(static_cast<size_t>(index), title);
+    wcsncpy_s(state.szTitle, title.c_str(), _TRUNCATE);
+    g_plugin.PublishPlayState(state);
+}
+
 void milk2_ui_element::UpdateTrack(metadb_handle_ptr p_track)
 {
     UpdateTrack();
@@ -1360,11 +1374,8 @@ void milk2_ui_element::UpdateTrack(metadb_handle_ptr p_track)
         pfc::string result;
         if (success && script.is_valid() && p_track->format_title(nullptr, result, script, nullptr))
         {
-            m_art_file.clear();
-            std::vector<uint8_t> empty;
-            m_raster.swap(empty);
             m_art_file = pfc::wideFromUTF8(result).c_str();
-            m_raster.clear();
+            m_raster = CImageBuffer();
         }
     }
     else
@@ -1376,10 +1387,8 @@ void milk2_ui_element::UpdateTrack(metadb_handle_ptr p_track)
 
 void milk2_ui_element::ShowAlbumArt()
 {
-    // Kill all existing sprites.
-    for (int x = 0; x < NUM_TEX; x++)
-        g_plugin.KillSprite(x);
-
+    // The art replaces all existing sprites once it is decoded, so the old
+    // ones stay up until then.
     if (s_config.settings.m_bShowAlbum)
     {
         if (!m_art_file.empty()) // file
@@ -1388,73 +1397,159 @@ void milk2_ui_element::ShowAlbumArt()
             pfc::string8 artFile = pfc::utf8FromWide(m_art_file.c_str());
             if (filesystem::g_exists(artFile, fb2k::noAbort))
             {
+                PostCommand([] { g_plugin.KillAllSprites(); });
                 return;
             }
 
-            g_plugin.LaunchSprite(100, -1, m_art_file);
-        }
-        else if (m_raster.size() > 0) // memory
-        {
-            g_plugin.LaunchSprite(100, -1, L"", m_raster);
+            PostCommand([file = m_art_file] { g_plugin.LaunchSprite(100, -1, file, CImageBuffer(), true); });
+            return;
         }
-        else // nothing
+        else if (!m_raster.IsEmpty()) // memory
         {
+            PostCommand([raster = m_raster] { g_plugin.LaunchSprite(100, -1, L"", raster, true); });
             return;
         }
     }
+
+    // Kill all existing sprites.
+    PostCommand([] { g_plugin.KillAllSprites(); });
 }
 
 void milk2_ui_element::UpdatePlaylist()
 {
     auto api = playlist_manager::get();
     size_t total = api->activeplaylist_get_item_count();
+    LRESULT selected = -1;
     for (size_t i = 0; i < total; ++i)
     {
         if (api->activeplaylist_is_item_selected(i))
         {
-            g_plugin.m_playlist_pos = i;
+            selected = static_cast<LRESULT>(i);
         }
     }
-    g_plugin.m_playlist_top_idx = -1;
+    PostCommand([selected] {
+        if (selected != -1)
+            g_plugin.m_playlist_pos = selected;
+        g_plugin.m_playlist_top_idx = -1;
+    });
+    PublishPlayState();
 }
 
-void milk2_ui_element::LaunchSongTitle()
+// Index of the playing item in the active playlist, or -1.
+LRESULT milk2_ui_element::GetPlayingIndex()
 {
-    g_plugin.LaunchSongTitleAnim();
+    if (m_playback_control->is_playing())
+    {
+        auto api = playlist_manager::get();
+        size_t playing_index = NULL, playing_playlist = NULL;
+        bool valid = api->get_playing_item_location(&playing_playlist, &playing_index);
+        if (valid && playing_playlist == api->get_active_playlist())
+            return static_cast<LRESULT>(playing_index);
+    }
+    return -1;
 }
 
-#ifdef TIMER_TP
-// Starts the timer.
-void milk2_ui_element::StartTimer() noexcept
+void milk2_ui_element::GetPlaylistTitle(size_t index, std::wstring& title)
 {
-    MILK2_CONSOLE_LOG_LIMIT("StartTimer ", GetWnd())
-    if (m_tpTimer == nullptr)
-        return;
+    const std::wstring* formatted = m_playlist_titles.GetTitle(index);
+    if (formatted)
+        title = *formatted;
+    else if (m_playlist_titles.GetCount() == 0)
+        title = L""; // no playlist
+    else if (m_playback_control->is_playing())
+        title = L"Opening...";
+    else
+        title = L"Stopped.";
+}
+
+size_t milk2_ui_element::GetItemCount()
+{
+    return playlist_manager::get()->activeplaylist_get_item_count();
+}
+
+bool milk2_ui_element::FormatTitle(size_t nIndex, std::wstring& title)
+{
+    if (m_script.is_empty())
+    {
+        pfc::string8 pattern = pfc::utf8FromWide(s_config.settings.m_szTitleFormat);
+        static_api_ptr_t<titleformat_compiler>()->compile_safe_ex(m_script, pattern);
+    }
+
+    // One item, rather than a copy of the whole playlist per title.
+    metadb_handle_ptr item;
+    pfc::string_formatter state;
+    if (!playlist_manager::get()->activeplaylist_get_item_handle(item, nIndex) || !item->format_title(NULL, state, m_script, NULL))
+        return false;
+    title = pfc::wideFromUTF8(state);
+    return true;
+}
 
-    FILETIME DueTime{};
-    DWORD RefreshInterval = static_cast<DWORD>(lround(1000.0f / s_config.settings.m_max_fps_fs));
-    SetThreadpoolTimer(m_tpTimer, &DueTime, RefreshInterval, 0);
+void milk2_ui_element::LaunchSongTitle()
+{
+    PostCommand([] { g_plugin.LaunchSongTitleAnim(); });
 }
 
-// Stops the timer.
-void milk2_ui_element::StopTimer() noexcept
+// Runs `cmd`, which uses `g_plugin`, on the render thread under the lock,
+// after the commands posted before it. Runs it right away if the calling
+// thread holds a `milk2_plugin_lock`, or when there is no render thread.
+void milk2_ui_element::PostCommand(std::function<void()> cmd)
 {
-    MILK2_CONSOLE_LOG_LIMIT("StopTimer ", GetWnd())
-    if (m_tpTimer == nullptr)
+#ifdef TIMER_RT
+    if (!milk2_plugin_lock::IsHeld())
+    {
+        m_renderLoop.Post(WithLock(std::move(cmd)));
         return;
+    }
+#endif
+    cmd();
+}
+
+#ifdef TIMER_RT
+// Fetches the audio for the next frame on the render thread.
+void milk2_ui_element::PullAudio()
+{
+    if (m_vis_stream.is_valid())
+        BuildWaves();
+}
 
-    SetThreadpoolTimer(m_tpTimer, NULL, 0, 0);
-    WaitForThreadpoolTimerCallbacks(m_tpTimer, TRUE);
-    CloseThreadpoolTimer(m_tpTimer);
+// Renders a frame on the render thread, then waits for the frame rate
+// limit. Only the drawing holds `s_cs`, so that the UI thread can take it
+// during the wait. `s_frame_cs` keeps the render thread of the other
+// instance from starting a frame during the wait, as both share the pacer
+// and profiler.
+bool milk2_ui_element::Present()
+{
+    EnterCriticalSection(&s_frame_cs);
+    EnterCriticalSection(&s_cs);
+    bool shown = Render();
+    LeaveCriticalSection(&s_cs);
+    if (shown)
+        g_plugin.PluginWaitFrame();
+    LeaveCriticalSection(&s_frame_cs);
+    return shown;
 }
 
-// Handles a timer tick.
-VOID CALLBACK milk2_ui_element::TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer) noexcept
+// Stops the render thread after it ran the queued commands.
+void milk2_ui_element::StopRenderLoop()
 {
-    UNREFERENCED_PARAMETER(Instance);
-    UNREFERENCED_PARAMETER(Timer);
+    MILK2_CONSOLE_LOG("StopRenderLoop ", GetWnd())
+    m_renderLoop.Stop();
+#ifdef _DEBUG
+    td_renderstats stats;
+    m_renderLoop.GetStats(stats);
+    MILK2_CONSOLE_LOG("Frames ", stats.nFrames, ", skipped ", stats.nSkipped, ", commands ", stats.nCommands, ", coalesced ", stats.nCoalesced)
+#endif
+}
 
-    ((milk2_ui_element*)Context)->Tick();
+// Wraps `cmd` to hold the lock shared with the keyboard and menu handlers
+// and the render thread of the other (windowed or fullscreen) instance.
+std::function<void()> milk2_ui_element::WithLock(std::function<void()> cmd)
+{
+    return [cmd = std::move(cmd)] {
+        EnterCriticalSection(&s_cs);
+        cmd();
+        LeaveCriticalSection(&s_cs);
+    };
 }
 #endif
 
@@ -1580,15 +1675,16 @@ void milk2_ui_element::ResolvePwd()
 #endif
 }
 
-// Retrieves image raster data and clears the file path.
-void milk2_ui_element::ExtractRasterData(const uint8_t* data, size_t size) noexcept
+// Retrieves image raster data and clears the file path. The raster holds
+// a reference to `aad` instead of copying its bytes.
+void milk2_ui_element::ExtractRasterData(const album_art_data::ptr& aad) noexcept
 {
     m_art_file.clear();
-    std::vector<uint8_t> empty;
-    m_raster.swap(empty);
-    if ((data != nullptr) && (size != 0))
+    m_raster = CImageBuffer();
+    if (aad.is_valid() && (aad->data() != nullptr) && (aad->size() != 0))
     {
-        m_raster.assign(data, data + size);
+        std::shared_ptr<const void> owner(aad->data(), [aad](const void*) {});
+        m_raster = CImageBuffer(owner, static_cast<const uint8_t*>(aad->data()), aad->size());
     }
 }
 
@@ -1613,7 +1709,7 @@ void milk2_ui_element::RegisterForArtwork()
 
             if (aad.is_valid())
             {
-                ExtractRasterData(static_cast<const uint8_t*>(aad->data()), aad->size());
+                ExtractRasterData(aad);
             }
         }
     }
@@ -1633,7 +1729,7 @@ void milk2_ui_element::LoadAlbumArt(const metadb_handle_ptr& track, abort_callba
 
         if (aad.is_valid())
         {
-            ExtractRasterData(static_cast<const uint8_t*>(aad->data()), aad->size());
+            ExtractRasterData(aad);
         }
     }
     catch (const exception_album_art_not_found&)
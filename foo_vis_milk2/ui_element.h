@@ -12,6 +12,10 @@
 #ifdef TIMER_DX
 #include "steptimer.h"
 #endif
+#ifdef TIMER_RT
+#include <vis_milk2/renderloop.h>
+#endif
+#include <vis_milk2/playlistmodel.h>
 
 // Anonymous namespace is standard practice in foobar2000 components
 // to prevent name collisions.
@@ -25,15 +29,63 @@ static ULONGLONG s_count = 0ull;
 static constexpr ULONGLONG s_debug_limit = 1ull;
 static milk2_config s_config;
 static std::wstring s_pwd;
-#ifdef TIMER_TP
+#ifdef TIMER_RT
 CRITICAL_SECTION s_cs;
+CRITICAL_SECTION s_frame_cs; // held by a render thread for a whole frame
+#endif
+
+// Holds `s_cs` on the UI thread until the end of the scope, for handlers
+// that use `g_plugin` together with services that must be called from the
+// main thread. While it waits for the lock, it answers the messages that
+// the render thread sends while holding it. Release it before anything
+// that waits for a render thread, such as destroying the window.
+class milk2_plugin_lock
+{
+  public:
+    milk2_plugin_lock()
+    {
+#ifdef TIMER_RT
+        while (!TryEnterCriticalSection(&s_cs))
+        {
+            MSG msg;
+            if (MsgWaitForMultipleObjects(0, NULL, FALSE, 1, QS_SENDMESSAGE) == WAIT_OBJECT_0)
+                PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+        }
 #endif
+        ++s_depth;
+        m_locked = true;
+    }
+    ~milk2_plugin_lock() { Unlock(); }
+    milk2_plugin_lock(const milk2_plugin_lock&) = delete;
+    milk2_plugin_lock& operator=(const milk2_plugin_lock&) = delete;
+
+    void Unlock()
+    {
+        if (!m_locked)
+            return;
+        m_locked = false;
+        --s_depth;
+#ifdef TIMER_RT
+        LeaveCriticalSection(&s_cs);
+#endif
+    }
+
+    // Whether the calling thread holds a `milk2_plugin_lock`.
+    static bool IsHeld() { return s_depth > 0; }
+
+  private:
+    static inline thread_local int s_depth = 0;
+    bool m_locked;
+};
 
 #pragma region UI Element
-class milk2_ui_element : public ui_element_instance, public CWindowImpl<milk2_ui_element>, private play_callback_impl_base, private playlist_callback_impl_base, public now_playing_album_art_notify
+class milk2_ui_element : public ui_element_instance, public CWindowImpl<milk2_ui_element>, private play_callback_impl_base, private playlist_callback_impl_base, public now_playing_album_art_notify, private CPlaylistSource
 #ifdef TIMER_DX
     , public idle_handler
 #endif
+#ifdef TIMER_RT
+    , private CRenderPresenter
+#endif
 {
   public:
     DECLARE_WND_CLASS(CLASSNAME);
@@ -192,9 +244,10 @@ class milk2_ui_element : public ui_element_instance, public CWindowImpl<milk2_ui
 #ifdef TIMER_DX
     void Update(DX::StepTimer const& timer);
 #endif
-    HRESULT Render();
+    bool Render();
     void Clear();
     void BuildWaves();
+    void PostCommand(std::function<void()> cmd);
 
     // Preset information and navigation
     void PrevPreset(float fBlendTime = s_config.settings.m_fBlendTimeUser);
@@ -238,12 +291,19 @@ class milk2_ui_element : public ui_element_instance, public CWindowImpl<milk2_ui
     DX::StepTimer m_timer;
 #endif
 
-#ifdef TIMER_TP
-    // Thread pool timer
-    void StartTimer() noexcept;
-    void StopTimer() noexcept;
-    static VOID CALLBACK TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer) noexcept;
-    PTP_TIMER m_tpTimer;
+#ifdef TIMER_RT
+    // Render thread
+    void PullAudio() override;
+    bool Present() override;
+    void StopRenderLoop();
+    static std::function<void()> WithLock(std::function<void()> cmd);
+    CRenderLoop m_renderLoop{this};
+    enum milk2_render_command
+    {
+        RC_WINDOW_MOVED = 1,
+        RC_WINDOW_SIZE_CHANGED,
+        RC_SETTINGS_CHANGED
+    };
 #endif
 
     // Topmost setting
@@ -266,41 +326,55 @@ class milk2_ui_element : public ui_element_instance, public CWindowImpl<milk2_ui
     titleformat_object::ptr m_search;
     pfc::string_formatter m_state;
 
+    // Playlist titles, formatted with `m_script`
+    CPlaylistModel m_playlist_titles;
+    size_t GetItemCount() override;
+    bool FormatTitle(size_t nIndex, std::wstring& title) override;
+
     // Artwork and metadata
     std::unique_ptr<artFetchData> m_art_data;
-    std::vector<uint8_t> m_raster;
+    CImageBuffer m_raster; // shares the bytes of the album art object
     std::wstring m_art_file;
 
     // clang-format off
     // Playback callback methods
-    void on_playback_starting(play_control::t_track_command /*p_command*/, bool /*p_paused*/) { MILK2_CONSOLE_LOG("+ PlaybackStart") UpdateTrack(); }
-    void on_playback_new_track(metadb_handle_ptr p_track) { MILK2_CONSOLE_LOG("+ PlaybackNew") UpdateTrack(p_track); }
-    void on_playback_stop(play_control::t_stop_reason /*p_reason*/) { MILK2_CONSOLE_LOG("+ PlaybackStop") UpdateTrack(); }
+    void on_playback_starting(play_control::t_track_command /*p_command*/, bool /*p_paused*/) { MILK2_CONSOLE_LOG("+ PlaybackStart") UpdateTrack(); PublishPlayState(); }
+    void on_playback_new_track(metadb_handle_ptr p_track) { MILK2_CONSOLE_LOG("+ PlaybackNew") UpdateTrack(p_track); PublishPlayState(); }
+    void on_playback_stop(play_control::t_stop_reason /*p_reason*/) { MILK2_CONSOLE_LOG("+ PlaybackStop") UpdateTrack(); PublishPlayState(); }
+    void on_playback_seek(double /*p_time*/) { PublishPlayState(); }
+    void on_playback_pause(bool /*p_state*/) { PublishPlayState(); }
+    void on_playback_time(double /*p_time*/) { PublishPlayState(); }
+    void on_playback_dynamic_info_track(const file_info& /*p_info*/) { PublishPlayState(); }
 
     void UpdateTrack();
     void UpdateTrack(metadb_handle_ptr p_track);
+    void PublishPlayState();
 
     // Playlist callback methods
-    void on_items_added(size_t /*p_playlist*/, size_t /*p_start*/, metadb_handle_list_cref /*p_data*/, const bit_array& /*p_selection*/) { MILK2_CONSOLE_LOG("* PlaylistItemsAdded") UpdatePlaylist(); }
-    void on_items_reordered(size_t /*p_playlist*/, const size_t* /*p_order*/, size_t /*p_count*/) { MILK2_CONSOLE_LOG("* PlaylistItemsReordered") UpdatePlaylist(); }
-    void on_items_removed(size_t /*p_playlist*/, const bit_array& /*p_mask*/, size_t /*p_old_count*/, size_t /*p_new_count*/) { MILK2_CONSOLE_LOG("* PlaylistItemsRemoved") UpdatePlaylist(); }
+    void on_items_added(size_t p_playlist, size_t p_start, metadb_handle_list_cref p_data, const bit_array& /*p_selection*/) { MILK2_CONSOLE_LOG("* PlaylistItemsAdded") if (IsActivePlaylist(p_playlist)) m_playlist_titles.Insert(p_start, p_data.get_count()); UpdatePlaylist(); }
+    void on_items_reordered(size_t p_playlist, const size_t* p_order, size_t p_count) { MILK2_CONSOLE_LOG("* PlaylistItemsReordered") if (IsActivePlaylist(p_playlist)) m_playlist_titles.Reorder(p_order, p_count); UpdatePlaylist(); }
+    void on_items_removed(size_t p_playlist, const bit_array& p_mask, size_t /*p_old_count*/, size_t /*p_new_count*/) { MILK2_CONSOLE_LOG("* PlaylistItemsRemoved") if (IsActivePlaylist(p_playlist)) m_playlist_titles.Remove([&](size_t i) { return p_mask.get(i); }); UpdatePlaylist(); }
     void on_items_selection_change(size_t /*p_playlist*/, const bit_array& /*p_affected*/, const bit_array& /*p_state*/) { MILK2_CONSOLE_LOG("* PlaylistSelChange") UpdatePlaylist(); }
     void on_item_focus_change(size_t /*p_playlist*/, size_t /*p_from*/, size_t /*p_to*/) { MILK2_CONSOLE_LOG("* PlaylistFocusChange") UpdatePlaylist(); }
-    void on_items_modified(size_t /*p_playlist*/, const bit_array& /*p_mask*/) { MILK2_CONSOLE_LOG("* PlaylistModified") UpdatePlaylist(); }
-    void on_playlist_activate(t_size /*p_old*/, t_size /*p_new*/) { MILK2_CONSOLE_LOG("* PlaylistActivate") UpdatePlaylist(); }
+    void on_items_modified(size_t p_playlist, const bit_array& p_mask) { MILK2_CONSOLE_LOG("* PlaylistModified") if (IsActivePlaylist(p_playlist)) m_playlist_titles.Invalidate([&](size_t i) { return p_mask.get(i); }); UpdatePlaylist(); }
+    void on_items_replaced(size_t p_playlist, const bit_array& p_mask, const pfc::list_base_const_t<t_on_items_replaced_entry>& /*p_data*/) { MILK2_CONSOLE_LOG("* PlaylistReplaced") if (IsActivePlaylist(p_playlist)) m_playlist_titles.Invalidate([&](size_t i) { return p_mask.get(i); }); UpdatePlaylist(); }
+    void on_playlist_activate(t_size /*p_old*/, t_size /*p_new*/) { MILK2_CONSOLE_LOG("* PlaylistActivate") m_playlist_titles.Reset(); UpdatePlaylist(); }
     void on_playlists_reorder(const t_size* /*p_order*/, t_size /*p_count*/) { MILK2_CONSOLE_LOG("* PlaylistsReorder") UpdatePlaylist(); }
-    void on_playlists_removed(const bit_array& /*p_mask*/, t_size /*p_old_count*/, t_size /*p_new_count*/) { MILK2_CONSOLE_LOG("* PlaylistsRemoved") UpdatePlaylist(); }
+    void on_playlists_removed(const bit_array& /*p_mask*/, t_size /*p_old_count*/, t_size /*p_new_count*/) { MILK2_CONSOLE_LOG("* PlaylistsRemoved") m_playlist_titles.Reset(); UpdatePlaylist(); }
     void on_playback_order_changed(t_size /*p_new_index*/) { MILK2_CONSOLE_LOG("* PlaybackShuffle") UpdatePlaylist(); }
 
     void UpdatePlaylist();
+    bool IsActivePlaylist(size_t p_playlist) { return p_playlist == playlist_manager::get()->get_active_playlist(); }
+    LRESULT GetPlayingIndex();
+    void GetPlaylistTitle(size_t index, std::wstring& title);
     void SetSelectionSingle(size_t idx);
     void SetSelectionSingle(size_t idx, bool toggle, bool focus, bool single_only);
 
     // Artwork callback methods
-    void on_album_art(album_art_data::ptr aad) { /*MILK2_CONSOLE_LOG("% AlbumArt"); if (wcsnlen_s(s_config.settings.m_szArtworkFormat, 256) == 0 && aad.is_valid()) { ExtractRasterData(static_cast<const uint8_t*>(aad->data()), aad->size()); }*/ }
+    void on_album_art(album_art_data::ptr aad) { /*MILK2_CONSOLE_LOG("% AlbumArt"); if (wcsnlen_s(s_config.settings.m_szArtworkFormat, 256) == 0 && aad.is_valid()) { ExtractRasterData(aad); }*/ }
 
     void RegisterForArtwork();
-    void ExtractRasterData(const uint8_t* data, size_t size) noexcept;
+    void ExtractRasterData(const album_art_data::ptr& aad) noexcept;
     void LoadAlbumArt(const metadb_handle_ptr& track, abort_callback& abort);
     void ShowAlbumArt();
     // clang-format on
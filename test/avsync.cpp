@@ -0,0 +1,125 @@
+/*
+ * avsync.cpp - Tests for MilkDrop2 library's audio to display latency estimator.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <vis_milk2/avsync.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(AudioSyncTest)
+{
+  private:
+    static constexpr int64_t REFRESH = 16666667; // 60 Hz
+
+    // A 60 Hz display where presenting blocks until a refresh. Frame `n`
+    // fetches its audio 1 ms after refresh `n`, is presented 4 ms later and
+    // is shown `nLag` refreshes after that. Right after presenting, the
+    // display reports the frame shown at the last refresh.
+    static void Run(CAudioSyncEstimator& sync, uint32_t& n, int nFrames, uint32_t nLag)
+    {
+        for (int i = 0; i < nFrames; i++, n++)
+        {
+            int64_t nRefresh = 1000000000 + static_cast<int64_t>(n) * REFRESH;
+            sync.BeginFrame(nRefresh + 1000000);
+            if (n > nLag)
+                sync.OnDisplayed(n - nLag, n, nRefresh);
+            sync.EndFrame(nRefresh + 5000000, n);
+        }
+    }
+
+  public:
+    TEST_METHOD(VsyncTest)
+    {
+        CAudioSyncEstimator sync;
+        uint32_t n = 1;
+        Run(sync, n, 300, 2);
+
+        // Shown two refreshes after the refresh before the audio was fetched.
+        Assert::IsTrue(std::abs(sync.GetPredictedDelay() - (2 * REFRESH - 1000000)) < 100000);
+        td_avsyncstats stats;
+        sync.GetStats(stats);
+        Assert::AreEqual(CAudioSyncEstimator::NUM_FRAMES, stats.nFrames);
+        Assert::AreEqual(4.0f, stats.fRenderTime, 0.01f);
+        Assert::AreEqual(1.0f, stats.fQueueDepth, 0.01f);
+        Assert::AreEqual(16.667f, stats.fRefreshInterval, 0.01f);
+        Assert::IsTrue(stats.fErrorP95 < 0.1f);
+        Assert::IsTrue(std::abs(stats.fErrorMean) < 0.1f);
+    }
+
+    TEST_METHOD(ChangeTest)
+    {
+        CAudioSyncEstimator sync;
+        uint32_t n = 1;
+        Run(sync, n, 300, 2);
+
+        // One more frame queued, as when the back buffer count is raised.
+        Run(sync, n, 200, 3);
+        Assert::IsTrue(std::abs(sync.GetPredictedDelay() - (3 * REFRESH - 1000000)) < 100000);
+        td_avsyncstats stats;
+        sync.GetStats(stats);
+        Assert::AreEqual(2.0f, stats.fQueueDepth, 0.01f);
+        Assert::IsTrue(stats.fErrorP95 < 0.1f);
+    }
+
+    TEST_METHOD(NoReportsTest)
+    {
+        // Without reports from the display, the prediction is the render
+        // time plus the assumed queue, at the measured frame rate.
+        CAudioSyncEstimator sync;
+        sync.SetQueueDepth(2);
+        for (int64_t i = 1; i <= 50; i++)
+        {
+            sync.BeginFrame(i * 10000000);
+            sync.EndFrame(i * 10000000 + 3000000, static_cast<uint32_t>(i));
+        }
+        Assert::IsTrue(std::abs(sync.GetPredictedDelay() - 28000000) < 10000);
+        td_avsyncstats stats;
+        sync.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(0), stats.nFrames);
+        Assert::AreEqual(10.0f, stats.fRefreshInterval, 0.01f);
+    }
+
+    TEST_METHOD(OffsetTest)
+    {
+        CAudioSyncEstimator sync;
+        uint32_t n = 1;
+        Run(sync, n, 100, 2);
+        sync.SetOffset(-40000000);
+        int64_t nDelay = sync.GetPredictedDelay();
+        Assert::AreEqual(nDelay - 40000000, sync.BeginFrame(1000000000 + static_cast<int64_t>(n) * REFRESH + 1000000));
+    }
+
+    TEST_METHOD(StaleReportTest)
+    {
+        CAudioSyncEstimator sync;
+        uint32_t n = 1;
+        Run(sync, n, 100, 2);
+        td_avsyncstats before, after;
+        sync.GetStats(before);
+
+        // Repeated, unknown and long gone frames do not count as measured.
+        sync.OnDisplayed(n - 3, n - 1, 1000000000 + static_cast<int64_t>(n - 1) * REFRESH);
+        sync.OnDisplayed(n + 1000, n, 1000000000 + static_cast<int64_t>(n) * REFRESH);
+        sync.OnDisplayed(n - 3 - static_cast<uint32_t>(CAudioSyncEstimator::NUM_FRAMES), n + 1, 1000000000 + static_cast<int64_t>(n + 1) * REFRESH);
+        sync.GetStats(after);
+        Assert::AreEqual(before.fErrorMean, after.fErrorMean);
+        Assert::AreEqual(before.fDelay, after.fDelay);
+
+        // Starts over after a reset.
+        sync.Reset();
+        sync.GetStats(after);
+        Assert::AreEqual(static_cast<size_t>(0), after.nFrames);
+        Assert::AreEqual(0.0f, after.fDelay);
+    }
+};
+} // namespace MilkDrop2
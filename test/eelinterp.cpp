@@ -0,0 +1,197 @@
+/*
+ * eelinterp.cpp - Tests for MilkDrop2 library's run-once EEL interpreter.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vis_milk2/eelinterp.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(EelInterpTest)
+{
+  private:
+    std::map<std::string, double> vars;
+
+    static double* resolve(void* user, const char* name)
+    {
+        return &(*static_cast<std::map<std::string, double>*>(user))[name];
+    }
+
+    bool run(const char* code)
+    {
+        return EelRunOnce(code, resolve, &vars);
+    }
+
+  public:
+    TEST_METHOD_INITIALIZE(MethodInit)
+    {
+        vars.clear();
+        vars["q1"] = 2.0;
+    }
+
+    TEST_METHOD(PrecedenceTest)
+    {
+        // `-` binds tighter than `+`, `/` tighter than `*`, unary minus tighter than `^`.
+        Assert::IsTrue(run("a = 10 - 2 + 3; b = 8 / 2 * 4; c = -2 ^ 2; d = 1 + 2 * 3"));
+        Assert::AreEqual(11.0, vars["a"]);
+        Assert::AreEqual(16.0, vars["b"]);
+        Assert::AreEqual(4.0, vars["c"]);
+        Assert::AreEqual(7.0, vars["d"]);
+    }
+
+    TEST_METHOD(AssignmentTest)
+    {
+        Assert::IsTrue(run("a = b = 4; q1 += a * b; q1 /= 2;; c = min(q1, .5) + sqr(3)"));
+        Assert::AreEqual(4.0, vars["a"]);
+        Assert::AreEqual(4.0, vars["b"]);
+        Assert::AreEqual(9.0, vars["q1"]);
+        Assert::AreEqual(9.5, vars["c"]);
+    }
+
+    TEST_METHOD(ConditionalTest)
+    {
+        Assert::IsTrue(run("a = if(q1 > 1, 3, 4); b = q1 == 2; c = !q1; d = q1 ? 5 : 6; e = above(q1, 1) && below(q1, 3); f = 0 || q1"));
+        Assert::AreEqual(3.0, vars["a"]);
+        Assert::AreEqual(1.0, vars["b"]);
+        Assert::AreEqual(0.0, vars["c"]);
+        Assert::AreEqual(5.0, vars["d"]);
+        Assert::AreEqual(1.0, vars["e"]);
+        Assert::AreEqual(1.0, vars["f"]);
+
+        // Only the taken branch assigns.
+        Assert::IsTrue(run("a = if(q1, b = 1, c = 2)"));
+        Assert::AreEqual(1.0, vars["b"]);
+        Assert::AreEqual(0.0, vars["c"]);
+
+        // Too close to call between the backends' closeness tests.
+        Assert::IsFalse(run("a = q1 == 2.000001"));
+    }
+
+    TEST_METHOD(BandBorTest)
+    {
+        Assert::IsTrue(run("a = band(q1, 0); b = band(q1, 3); c = bor(0, q1); d = bor(0, 0)"));
+        Assert::AreEqual(0.0, vars["a"]);
+        Assert::AreEqual(1.0, vars["b"]);
+        Assert::AreEqual(1.0, vars["c"]);
+        Assert::AreEqual(0.0, vars["d"]);
+
+        // Unlike `&&` and `||`, the backend evaluates the second argument even
+        // when the first decides the result, so one that assigns is left to it.
+        Assert::IsTrue(run("a = 0 && (e = 1); b = q1 || (e = 2)"));
+        Assert::AreEqual(0.0, vars["e"]);
+        Assert::IsFalse(run("a = band(0, e = 1)"));
+        Assert::IsFalse(run("a = bor(q1, e = 2)"));
+        Assert::AreEqual(0.0, vars["e"]);
+    }
+
+    TEST_METHOD(UnsupportedTest)
+    {
+        const char* codes[] = {
+            "a = loop(2, b = 1)", "a = q1 | 1", "a = rand(10)", "megabuf(0) = 1", "a = 5 % 2", "a = 1e3",
+            "a = $pi",          "A = 1",      "reg00 = 1",    "a = (b = 2) + 1", "a += (a = 2)",
+        };
+        for (const char* code : codes)
+            Assert::IsFalse(run(code), std::wstring(code, code + strlen(code)).c_str());
+    }
+
+    TEST_METHOD(BailLeavesVariablesTest)
+    {
+        // The division by zero comes after `q1` is written, which must be undone.
+        Assert::IsFalse(run("q1 = 5; a = 1 / 0"));
+        Assert::AreEqual(2.0, vars["q1"]);
+        Assert::IsFalse(run("q1 = 5; a = sqrt(-4)"));
+        Assert::AreEqual(2.0, vars["q1"]);
+    }
+
+    TEST_METHOD(LaneStateTest)
+    {
+        const char* lanes[] = {"x", "zoom"};
+        const char* stateless[] = {"zoom = x * 2", "t = x; zoom = t", "if(x > .5, t = 1, t = 2); zoom = t", "zoom += q1"};
+        const char* stateful[] = {"zoom = acc; acc = x", "if(x > .5, t = 1, 0); zoom = t", "zoom = q1; q1 = x", "t += 1; zoom = t"};
+        for (const char* code : stateless)
+            Assert::IsTrue(CEelLaneProgram().Compile(code, resolve, &vars, lanes, 2), std::wstring(code, code + strlen(code)).c_str());
+        for (const char* code : stateful)
+            Assert::IsFalse(CEelLaneProgram().Compile(code, resolve, &vars, lanes, 2), std::wstring(code, code + strlen(code)).c_str());
+    }
+
+    // Each lane must match the same code written out in C++, with that
+    // lane's inputs and `q1` = 2.
+    TEST_METHOD(LaneDifferentialTest)
+    {
+        typedef void (*Reference)(double x, double y, double& zoom, double& rot);
+        const struct
+        {
+            const char* code;
+            Reference ref;
+        } cases[] = {
+            {"zoom = zoom + 0.1 * sin(x * 6); rot = if(above(y, 0.5), rot * 0.5, -rot)",
+             [](double x, double y, double& zoom, double& rot) {
+                 zoom = zoom + 0.1 * sin(x * 6);
+                 rot = (y > 0.5) ? rot * 0.5 : -rot;
+             }},
+            {"t = x * y; zoom = t + q1; rot = atan2(y - .5, x - .5)",
+             [](double x, double y, double& zoom, double& rot) {
+                 zoom = x * y + 2.0;
+                 rot = atan2(y - 0.5, x - 0.5);
+             }},
+            {"zoom = x > 0.5 ? sqrt(x) : sqr(y); rot = x * 3 == y * 3",
+             [](double x, double y, double& zoom, double& rot) {
+                 zoom = (x > 0.5) ? sqrt(x) : y * y;
+                 rot = (x * 3 == y * 3) ? 1.0 : 0.0;
+             }},
+            {"zoom += x; rot -= y * 2; rot = max(min(rot, .4), -.4)",
+             [](double x, double y, double& zoom, double& rot) {
+                 zoom += x;
+                 rot = std::max(std::min(rot - y * 2, 0.4), -0.4);
+             }},
+            {"d = sqrt(sqr(x - .5) + sqr(y - .5)); zoom = zoom + (d < .3 && d > .1) * .05",
+             [](double x, double y, double& zoom, double& /*rot*/) {
+                 double d = sqrt((x - 0.5) * (x - 0.5) + (y - 0.5) * (y - 0.5));
+                 zoom = zoom + ((d < 0.3 && d > 0.1) ? 1.0 : 0.0) * 0.05;
+             }},
+        };
+        const char* lanes[] = {"x", "y", "zoom", "rot"};
+        std::default_random_engine gen(1);
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for (const auto& c : cases)
+        {
+            const std::wstring name(c.code, c.code + strlen(c.code));
+            CEelLaneProgram program;
+            Assert::IsTrue(program.Compile(c.code, resolve, &vars, lanes, 4), name.c_str());
+            int nRuns = 0;
+            for (int iter = 0; iter < 200; iter++)
+            {
+                int nLanes = 1 + iter % EEL_LANES;
+                double in[4][EEL_LANES];
+                for (int slot = 0; slot < 4; slot++)
+                    for (int l = 0; l < EEL_LANES; l++)
+                        program.Lanes(slot)[l] = in[slot][l] = dist(gen);
+                if (!program.Run(nLanes))
+                    continue;
+                nRuns++;
+                for (int l = 0; l < nLanes; l++)
+                {
+                    double zoom = in[2][l], rot = in[3][l];
+                    c.ref(in[0][l], in[1][l], zoom, rot);
+                    Assert::AreEqual(zoom, program.Lanes(2)[l], 1e-12, name.c_str());
+                    Assert::AreEqual(rot, program.Lanes(3)[l], 1e-12, name.c_str());
+                }
+            }
+            Assert::IsTrue(nRuns > 150, name.c_str());
+        }
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,121 @@
+/*
+ * extrude.cpp - Tests for MilkDrop2 library's outline extrusion.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <vis_milk2/extrude.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(ExtrudeTest)
+{
+  public:
+    TEST_METHOD(SnapTest)
+    {
+        Assert::AreEqual(0.0625f, SnapCoordinate(0.07f));
+        Assert::AreEqual(-0.125f, SnapCoordinate(-0.12f));
+        td_point2f pt = SnapPoint({10.01f, -3.03f});
+        Assert::AreEqual(10.0f, pt.x);
+        Assert::AreEqual(-3.0f, pt.y);
+    }
+
+    TEST_METHOD(FlattenTest)
+    {
+        const td_point2f p0{0.0f, 0.0f}, p1{0.0f, 100.0f}, p2{100.0f, 100.0f}, p3{100.0f, 0.0f};
+        std::vector<td_point2f> coarse, fine;
+        FlattenCubic(p0, p1, p2, p3, 1.0f, coarse);
+        FlattenCubic(p0, p1, p2, p3, 0.01f, fine);
+
+        // Ends on the curve's end point, more finely for a lower tolerance.
+        Assert::IsTrue(coarse.size() > 1);
+        Assert::IsTrue(fine.size() > coarse.size());
+        Assert::AreEqual(100.0f, coarse.back().x);
+        Assert::AreEqual(0.0f, coarse.back().y);
+
+        // The curve's midpoint, at t = 0.5, is at (50, 75), within the
+        // tolerance of the polyline.
+        float fDistance = 100.0f;
+        td_point2f a = p0;
+        for (const td_point2f& b : coarse)
+        {
+            float dx = b.x - a.x, dy = b.y - a.y;
+            float t = std::clamp(((50.0f - a.x) * dx + (75.0f - a.y) * dy) / (dx * dx + dy * dy), 0.0f, 1.0f);
+            fDistance = std::min(fDistance, std::hypot(a.x + t * dx - 50.0f, a.y + t * dy - 75.0f));
+            a = b;
+        }
+        Assert::IsTrue(fDistance <= 1.0f);
+
+        // A straight line is a single segment.
+        std::vector<td_point2f> line;
+        FlattenCubic(p0, {1.0f, 1.0f}, {2.0f, 2.0f}, {3.0f, 3.0f}, 0.25f, line);
+        Assert::AreEqual(static_cast<size_t>(1), line.size());
+    }
+
+    TEST_METHOD(FigureTest)
+    {
+        // A closed square, with a repeated point and the closing point.
+        const std::vector<td_point2f> figure{{0.0f, 0.0f}, {10.0f, 0.0f}, {10.0f, 0.0f}, {10.0f, 10.03f}, {0.0f, 10.0f}, {0.0f, 0.0f}};
+        std::vector<td_extrudevertex> vertices;
+        ExtrudeFigure(figure, 24.0f, vertices);
+
+        // Two triangles per edge, spanning the depth, on snapped points.
+        Assert::AreEqual(static_cast<size_t>(4 * 6), vertices.size());
+        Assert::AreEqual(12.0f, vertices[0].z);
+        Assert::AreEqual(-12.0f, vertices[1].z);
+        Assert::AreEqual(10.0f, vertices[8].y);
+        Assert::AreEqual(10.0f, vertices[10].y);
+
+        // Square corners are not smoothed: normals are those of the edges.
+        for (const td_extrudevertex& v : vertices)
+        {
+            Assert::AreEqual(1.0f, v.nx * v.nx + v.ny * v.ny, 1e-5f);
+            Assert::AreEqual(0.0f, v.nz);
+        }
+        Assert::AreEqual(0.0f, vertices[0].nx, 1e-5f);
+        Assert::AreEqual(1.0f, std::abs(vertices[0].ny), 1e-5f);
+
+        // Nothing to extrude.
+        vertices.clear();
+        ExtrudeFigure({{1.0f, 1.0f}, {1.0f, 1.0f}}, 24.0f, vertices);
+        Assert::IsTrue(vertices.empty());
+    }
+
+    TEST_METHOD(CapsTest)
+    {
+        const td_triangle2f triangles[] = {
+            {{0.0f, 0.0f}, {10.0f, 0.0f}, {10.0f, 10.0f}},
+            {{0.0f, 0.0f}, {10.0f, 10.0f}, {10.0f, 0.0f}}, // wound the other way
+        };
+        std::vector<td_extrudevertex> vertices;
+        ExtrudeCaps(triangles, 2, 24.0f, vertices);
+        Assert::AreEqual(static_cast<size_t>(12), vertices.size());
+
+        // Front face at +z, back face at -z wound the other way.
+        Assert::AreEqual(12.0f, vertices[0].z);
+        Assert::AreEqual(1.0f, vertices[0].nz);
+        Assert::AreEqual(-12.0f, vertices[3].z);
+        Assert::AreEqual(-1.0f, vertices[3].nz);
+        Assert::AreEqual(vertices[0].x, vertices[4].x);
+        Assert::AreEqual(vertices[1].x, vertices[3].x);
+
+        // Both triangles come out wound the same way.
+        auto cross = [&](size_t i) {
+            const td_extrudevertex &a = vertices[i], &b = vertices[i + 1], &c = vertices[i + 2];
+            return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+        };
+        Assert::IsTrue(cross(0) > 0.0f);
+        Assert::IsTrue(cross(6) > 0.0f);
+        Assert::IsTrue(cross(3) < 0.0f);
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,166 @@
+/*
+ * fontfit.cpp - Tests for MilkDrop2 library's font size fitting.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <vis_milk2/fontfit.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(FontFitTest)
+{
+  private:
+    // Characters advance half the font size, more in bold, and italics
+    // overhang. Fails for fonts without a face.
+    class CFakeMeasurer : public CTextMeasurer
+    {
+      public:
+        explicit CFakeMeasurer(float fPadding = 0.0f) : m_fPadding(fPadding) {}
+
+        bool Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float, float, td_textsize& size) override
+        {
+            m_nMeasures++;
+            if (face.empty())
+                return false;
+            float fAdvance = (bBold ? 0.6f : 0.5f) * fSize;
+            size.fWidth = static_cast<float>(text.size()) * fAdvance + (bItalic ? 0.1f * fSize : 0.0f) + m_fPadding;
+            size.fHeight = 1.2f * fSize;
+            return true;
+        }
+
+        int m_nMeasures = 0;
+
+      private:
+        float m_fPadding; // that does not scale, like hinting
+    };
+
+    static constexpr int SIZES[] = {
+        6,   8,   10,  12,  14,  16,  20,  26,  32,  38,  44,  50,  56,  64,  72,  80,
+        88,  96,  104, 112, 120, 128, 136, 144, 160, 192, 224, 256, 288, 320, 352, 384,
+        416, 448, 480, 512
+    };
+    static constexpr int NUM_SIZES = static_cast<int>(sizeof(SIZES) / sizeof(SIZES[0]));
+
+    // The binary search the title texture used before, measuring each probe.
+    // It never picks the largest size, which only bounds the search.
+    static int SearchFit(CTextMeasurer& measurer, std::wstring_view text, bool bBold, bool bItalic, float fWidth, float fHeight)
+    {
+        int lo = 0, hi = NUM_SIZES - 1;
+        while (true)
+        {
+            int mid = (lo + hi) / 2;
+            td_textsize size;
+            measurer.Measure(text, L"Arial", bBold, bItalic, static_cast<float>(SIZES[mid]), fWidth, fHeight, size);
+            if (lo == hi - 1)
+                return lo;
+            if (size.fWidth >= fWidth || size.fHeight > fHeight)
+                hi = mid;
+            else
+                lo = mid;
+        }
+    }
+
+  public:
+    TEST_METHOD(PredictTest)
+    {
+        const wchar_t* texts[] = {L" Hi ", L" MilkDrop 2 ", L" Welcome to the jungle ", L" A very long custom message that has to be drawn small "};
+        const float widths[] = {256.0f, 512.0f, 1024.0f, 2048.0f};
+        for (const wchar_t* text : texts)
+        {
+            for (float fWidth : widths)
+            {
+                for (int nStyle = 0; nStyle < 4; nStyle++)
+                {
+                    bool bBold = (nStyle & 1) != 0, bItalic = (nStyle & 2) != 0;
+                    CFakeMeasurer measurer;
+                    CFontFitCache cache(&measurer);
+                    float fHeight = fWidth * 16 / 21;
+                    Assert::AreEqual(SearchFit(measurer, text, bBold, bItalic, fWidth, fHeight), cache.Fit(text, L"Arial", bBold, bItalic, SIZES, NUM_SIZES - 1, fWidth, fHeight));
+                }
+            }
+        }
+
+        // Measured at the reference size and verified on the first launch,
+        // only verified on the next.
+        CFakeMeasurer measurer;
+        CFontFitCache cache(&measurer);
+        int nFit = cache.Fit(L" MilkDrop 2 ", L"Arial", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        Assert::AreEqual(2, measurer.m_nMeasures);
+        Assert::AreEqual(nFit, cache.Fit(L" MilkDrop 2 ", L"Arial", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f));
+        Assert::AreEqual(3, measurer.m_nMeasures);
+
+        // Too long to fit at any size: the smallest, without verifying.
+        Assert::AreEqual(0, cache.Fit(std::wstring(500, L'x'), L"Arial", false, false, SIZES, NUM_SIZES, 256.0f, 195.0f));
+        Assert::AreEqual(4, measurer.m_nMeasures);
+    }
+
+    TEST_METHOD(VerifyTest)
+    {
+        // Padding makes small sizes wider and large sizes narrower than
+        // predicted; the verifying measurement catches the former.
+        const wchar_t* texts[] = {L" Hi ", L" MilkDrop 2 ", L" Welcome to the jungle ", L" A very long custom message that has to be drawn small "};
+        for (const wchar_t* text : texts)
+        {
+            for (float fWidth = 64.0f; fWidth <= 2048.0f; fWidth *= 1.25f)
+            {
+                CFakeMeasurer measurer(6.0f);
+                CFontFitCache cache(&measurer);
+                float fHeight = fWidth * 16 / 21;
+                int nSearch = SearchFit(measurer, text, true, true, fWidth, fHeight);
+                int nFit = cache.Fit(text, L"Arial", true, true, SIZES, NUM_SIZES - 1, fWidth, fHeight);
+                Assert::IsTrue(std::abs(nFit - nSearch) <= 1);
+                td_textsize size;
+                measurer.Measure(text, L"Arial", true, true, static_cast<float>(SIZES[nFit]), fWidth, fHeight, size);
+                Assert::IsTrue(nFit == 0 || (size.fWidth < fWidth && size.fHeight <= fHeight));
+            }
+        }
+
+        // Padding as wide as several characters: sizes 26 and 20 are
+        // predicted to fit but do not, 16 does.
+        CFakeMeasurer measurer(40.0f);
+        CFontFitCache cache(&measurer);
+        Assert::AreEqual(5, cache.Fit(L" Hi ", L"Arial", false, false, SIZES, NUM_SIZES, 80.0f, 1000.0f));
+        Assert::AreEqual(4, measurer.m_nMeasures);
+    }
+
+    TEST_METHOD(KeyTest)
+    {
+        CFakeMeasurer measurer;
+        CFontFitCache cache(&measurer);
+        cache.Fit(L" MilkDrop ", L"Arial", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        cache.Fit(L" MilkDrop ", L"Arial", false, false, SIZES, NUM_SIZES, 512.0f, 390.0f);
+
+        // Another text, face, weight or style is measured again.
+        cache.Fit(L" MilkDrop 2 ", L"Arial", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        cache.Fit(L" MilkDrop ", L"Segoe UI", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        cache.Fit(L" MilkDrop ", L"Arial", true, false, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        cache.Fit(L" MilkDrop ", L"Arial", false, true, SIZES, NUM_SIZES, 1024.0f, 780.0f);
+        td_fontfitstats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(5), stats.nEntries);
+        Assert::AreEqual(static_cast<uint64_t>(1), stats.nHits);
+        Assert::AreEqual(static_cast<uint64_t>(5), stats.nMisses);
+        Assert::AreEqual(static_cast<uint64_t>(11), stats.nProbes);
+
+        // Failures are not cached.
+        Assert::AreEqual(-1, cache.Fit(L" MilkDrop ", L"", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f));
+        Assert::AreEqual(-1, cache.Fit(L" MilkDrop ", L"", false, false, SIZES, NUM_SIZES, 1024.0f, 780.0f));
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(5), stats.nEntries);
+
+        cache.Clear();
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(0), stats.nEntries);
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,150 @@
+/*
+ * framepacer.cpp - Tests for MilkDrop2 library's frame rate limiter.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vis_milk2/framepacer.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(FramePacerTest)
+{
+  private:
+    // Simulated time: every reading of the clock takes 1 us, and sleeps
+    // wake up 0.2 to 1 ms late, in a repeating pattern.
+    class CSimClock : public CPacerClock
+    {
+      public:
+        int64_t Now() override { return m_nTime += 1000; }
+
+        void SleepUntil(int64_t nTime) override
+        {
+            m_nTime = std::max(m_nTime, nTime) + 200000 + (m_nSleeps++ % 5) * 200000;
+        }
+
+        void Advance(int64_t nTime) { m_nTime += nTime; }
+
+        int64_t m_nTime = 1000000000;
+        int m_nSleeps = 0;
+    };
+
+    static void Run(CFramePacer& pacer, CSimClock& clock, int nFrames, int64_t nCost)
+    {
+        for (int i = 0; i < nFrames; i++)
+        {
+            clock.Advance(nCost);
+            pacer.EndFrame();
+        }
+    }
+
+  public:
+    TEST_METHOD(SteadyTest)
+    {
+        CSimClock clock;
+        CFramePacer pacer(&clock);
+        pacer.SetMaxFps(60);
+        Run(pacer, clock, 300, 5000000);
+
+        td_pacerstats stats;
+        pacer.GetStats(stats);
+        Assert::AreEqual(CFramePacer::NUM_FRAMES, stats.nFrames);
+        Assert::AreEqual(16.667f, stats.fIntervalP50, 0.01f);
+        Assert::IsTrue(stats.fJitterP99 < 0.01f);
+        Assert::AreEqual(5.0f, stats.fPredictedCost, 0.01f);
+        // Sleeps until the longest oversleep before the deadline, then polls.
+        Assert::IsTrue(stats.fSpinPerFrame < 1.1f);
+        Assert::IsTrue(stats.fSleepPerFrame > 10.0f);
+        Assert::IsTrue(pacer.GetSpinMargin() >= 1000000);
+    }
+
+    TEST_METHOD(PredictTest)
+    {
+        CSimClock clock;
+        CFramePacer pacer(&clock);
+        pacer.SetMaxFps(100);
+        Run(pacer, clock, 100, 2000000);
+        Assert::IsTrue(std::abs(pacer.GetPredictedCost() - 2000000) < 10000);
+
+        // After a change in cost, the average catches up within a few dozen
+        // frames, and the ends of frames are evenly spaced again.
+        Run(pacer, clock, 60, 6000000);
+        Assert::IsTrue(std::abs(pacer.GetPredictedCost() - 6000000) < 10000);
+        pacer.Reset();
+        Run(pacer, clock, 50, 6000000);
+        td_pacerstats stats;
+        pacer.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(49), stats.nFrames);
+        Assert::AreEqual(10.0f, stats.fIntervalP50, 0.01f);
+        Assert::IsTrue(stats.fJitterP95 < 0.01f);
+    }
+
+    TEST_METHOD(LateTest)
+    {
+        CSimClock clock;
+        CFramePacer pacer(&clock);
+        pacer.SetMaxFps(50);
+        Run(pacer, clock, 20, 4000000);
+        pacer.Reset();
+        Run(pacer, clock, 1, 4000000);
+        Run(pacer, clock, 1, 70000000); // shown 70 ms late, after four deadlines
+
+        // The following frames are not hurried to catch up.
+        Run(pacer, clock, 10, 4000000);
+        td_pacerstats stats;
+        pacer.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(11), stats.nFrames);
+        Assert::AreEqual(20.0f, stats.fIntervalP50, 0.01f);
+        Assert::IsTrue(stats.fJitterP50 < 0.01f);
+        Assert::AreEqual(static_cast<uint64_t>(1), stats.nLate);
+        Assert::AreEqual(static_cast<uint64_t>(4), stats.nDropped);
+    }
+
+    TEST_METHOD(SaveCpuTest)
+    {
+        CSimClock clock;
+        CFramePacer pacer(&clock);
+        pacer.SetMaxFps(60);
+        pacer.SetSaveCpu(true);
+        Run(pacer, clock, 100, 5000000);
+        td_pacerstats stats;
+        pacer.GetStats(stats);
+        Assert::AreEqual(0.0f, stats.fSpinPerFrame);
+        Assert::IsTrue(stats.fJitterP50 > 0.1f && stats.fJitterP95 < 1.1f); // as late as the sleeps
+        Assert::AreEqual(static_cast<uint64_t>(0), stats.nLate);
+    }
+
+    TEST_METHOD(UnlimitedTest)
+    {
+        CSimClock clock;
+        CFramePacer pacer(&clock);
+        Run(pacer, clock, 10, 3000000);
+        td_pacerstats stats;
+        pacer.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(9), stats.nFrames);
+        Assert::AreEqual(0, clock.m_nSleeps);
+        Assert::AreEqual(0.0f, stats.fSpinPerFrame);
+        Assert::AreEqual(3.0f, stats.fIntervalP50, 0.01f);
+    }
+
+    TEST_METHOD(SteadyClockTest)
+    {
+        CSteadyPacerClock clock;
+        CFramePacer pacer(&clock);
+        pacer.SetMaxFps(200);
+        int64_t nStart = clock.Now();
+        for (int i = 0; i < 21; i++)
+            pacer.EndFrame();
+        Assert::IsTrue(clock.Now() - nStart >= 20 * 5000000 - 5000000);
+    }
+};
+} // namespace MilkDrop2
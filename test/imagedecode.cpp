@@ -0,0 +1,224 @@
+/*
+ * imagedecode.cpp - Tests for MilkDrop2 library's background image decoding.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vis_milk2/imagedecode.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(ImageDecodeTest)
+{
+  private:
+    static inline std::atomic<bool> s_bBlock;
+    static inline std::atomic<bool> s_bStarted;
+
+    // Reads binary PPM ("P6") images, as made by `MakeSample()`.
+    static bool DecodePPM(const wchar_t* szFilename, const uint8_t* pData, size_t nSize, int* pWidth, int* pHeight, std::vector<uint8_t>* pPixels)
+    {
+        s_bStarted = true;
+        while (s_bBlock)
+            std::this_thread::yield();
+        std::string text;
+        if (pData)
+            text.assign(reinterpret_cast<const char*>(pData), nSize);
+        else
+        {
+            std::ifstream file(std::filesystem::path(szFilename), std::ios::binary);
+            text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        int nMax = 0;
+        int nHeader = 0;
+        if (sscanf_s(text.c_str(), "P6 %d %d %d%n", pWidth, pHeight, &nMax, &nHeader) != 3 || nMax != 255)
+            return false;
+        size_t nPixels = static_cast<size_t>(*pWidth) * static_cast<size_t>(*pHeight);
+        if (text.size() < static_cast<size_t>(nHeader) + 1 + nPixels * 3)
+            return false;
+        const char* p = text.data() + nHeader + 1;
+        pPixels->resize(nPixels * 4);
+        for (size_t i = 0; i < nPixels; i++)
+        {
+            for (size_t c = 0; c < 3; c++)
+                (*pPixels)[i * 4 + c] = static_cast<uint8_t>(p[i * 3 + c]);
+            (*pPixels)[i * 4 + 3] = 255;
+        }
+        return true;
+    }
+
+    static std::string MakeSample(int w, int h, uint8_t r)
+    {
+        std::string text = "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+        for (int i = 0; i < w * h; i++)
+            text += {static_cast<char>(r), static_cast<char>(i), static_cast<char>(255 - r)};
+        return text;
+    }
+
+  public:
+    TEST_METHOD_INITIALIZE(MethodInit)
+    {
+        s_bBlock = false;
+        s_bStarted = false;
+    }
+
+    TEST_METHOD(DirectoryTest)
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / L"milk2_imagedecode_test";
+        std::filesystem::create_directories(dir);
+        std::map<uint32_t, int> tickets; // to sample index
+        CImageDecodeQueue queue;
+        queue.Start(DecodePPM, 3);
+        for (int i = 0; i < 12; i++)
+        {
+            std::filesystem::path path = dir / (L"sample" + std::to_wstring(i) + L".ppm");
+            std::ofstream(path, std::ios::binary) << MakeSample(i + 1, 2 * i + 1, static_cast<uint8_t>(i * 10));
+            tickets[queue.Submit(path.wstring().c_str(), false)] = i;
+        }
+        tickets[queue.Submit((dir / L"missing.ppm").wstring().c_str(), false)] = -1;
+
+        for (size_t nDone = 0; nDone < tickets.size();)
+        {
+            td_decodedimage image;
+            if (!queue.Poll(&image))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            nDone++;
+            int i = tickets.at(image.nTicket);
+            Assert::AreEqual(i >= 0, image.bOk);
+            if (i < 0)
+                continue;
+            Assert::AreEqual(i + 1, image.nWidth);
+            Assert::AreEqual(2 * i + 1, image.nHeight);
+            Assert::AreEqual(1, image.nMips);
+            Assert::AreEqual(static_cast<int>(i * 10), static_cast<int>(image.pixels[0]));
+            Assert::AreEqual(255, static_cast<int>(image.pixels[3]));
+        }
+        Assert::AreEqual(static_cast<size_t>(0), queue.GetPending());
+        queue.Stop();
+        std::filesystem::remove_all(dir);
+    }
+
+    TEST_METHOD(MemoryTest)
+    {
+        CImageDecodeQueue queue;
+        queue.Start(DecodePPM, 0); // decodes in `Submit()`
+        std::string sample = MakeSample(4, 4, 7);
+        uint32_t nTicket = queue.Submit(CImageBuffer::Copy(reinterpret_cast<const uint8_t*>(sample.data()), sample.size()), true);
+        const uint8_t bad[] = {'P', '5'};
+        uint32_t nBad = queue.Submit(CImageBuffer::Copy(bad, sizeof(bad)), true);
+        td_decodedimage image;
+        Assert::IsTrue(queue.Wait(nTicket, &image));
+        Assert::IsTrue(image.bOk);
+        Assert::AreEqual(3, image.nMips);
+        Assert::AreEqual(GetMipOffset(4, 4, 3), image.pixels.size());
+        Assert::IsTrue(queue.Wait(nBad, &image));
+        Assert::IsFalse(image.bOk);
+        Assert::IsFalse(queue.Wait(nBad, &image));
+    }
+
+    TEST_METHOD(CancelTest)
+    {
+        CImageDecodeQueue queue;
+        queue.Start(DecodePPM, 1);
+        std::string sample = MakeSample(2, 2, 1);
+        CImageBuffer data = CImageBuffer::Copy(reinterpret_cast<const uint8_t*>(sample.data()), sample.size());
+        s_bBlock = true;
+        uint32_t nFirst = queue.Submit(data, false);
+        uint32_t nSecond = queue.Submit(data, false);
+        uint32_t nThird = queue.Submit(data, false);
+        while (!s_bStarted)
+            std::this_thread::yield();
+        queue.Cancel(nSecond); // still queued
+        queue.Cancel(nFirst);  // being decoded
+        s_bBlock = false;
+
+        td_decodedimage image;
+        Assert::IsFalse(queue.Wait(nFirst, &image));
+        Assert::IsFalse(queue.Wait(nSecond, &image));
+        Assert::IsTrue(queue.Wait(nThird, &image));
+        Assert::IsTrue(image.bOk);
+        Assert::IsFalse(queue.Poll(&image));
+    }
+
+    TEST_METHOD(BufferTest)
+    {
+        std::string sample = MakeSample(3, 3, 9);
+        auto owner = std::make_shared<std::string>(sample);
+        std::weak_ptr<std::string> alive = owner;
+        CImageBuffer shared(owner, reinterpret_cast<const uint8_t*>(owner->data()), owner->size());
+        owner.reset();
+        CImageBuffer copy = shared; // shares the bytes, no copy
+        shared = CImageBuffer();
+        Assert::IsFalse(alive.expired());
+        Assert::IsTrue(copy.GetData() == reinterpret_cast<const uint8_t*>(alive.lock()->data()));
+
+        CImageBuffer same = CImageBuffer::Copy(reinterpret_cast<const uint8_t*>(sample.data()), sample.size());
+        Assert::IsTrue(same.GetData() != copy.GetData());
+        Assert::AreEqual(copy.GetHash(), same.GetHash());
+        sample[sample.size() - 1] ^= 1;
+        Assert::AreNotEqual(copy.GetHash(), HashImageData(reinterpret_cast<const uint8_t*>(sample.data()), sample.size()));
+        Assert::AreNotEqual(HashImageData(same.GetData(), same.GetSize() - 1), same.GetHash());
+
+        copy = CImageBuffer();
+        Assert::IsTrue(alive.expired());
+        Assert::IsTrue(CImageBuffer::Copy(nullptr, 0).IsEmpty());
+    }
+
+    TEST_METHOD(CacheTest)
+    {
+        CImageCache cache(2);
+        auto image = [](int w) {
+            auto p = std::make_shared<td_decodedimage>();
+            p->nWidth = w;
+            return std::shared_ptr<const td_decodedimage>(p);
+        };
+        Assert::IsTrue(cache.Find(1) == nullptr);
+        cache.Insert(1, image(1));
+        cache.Insert(2, image(2));
+        Assert::AreEqual(1, cache.Find(1)->nWidth); // 2 is now least recently used
+        cache.Insert(3, image(3));
+        Assert::IsTrue(cache.Find(2) == nullptr);
+        Assert::AreEqual(1, cache.Find(1)->nWidth);
+        Assert::AreEqual(3, cache.Find(3)->nWidth);
+        cache.Insert(3, image(4)); // replaces
+        Assert::AreEqual(4, cache.Find(3)->nWidth);
+        Assert::AreEqual(4u, cache.GetHits());
+        Assert::AreEqual(2u, cache.GetMisses());
+        cache.Clear();
+        Assert::IsTrue(cache.Find(1) == nullptr);
+    }
+
+    TEST_METHOD(MipTest)
+    {
+        // 3 x 2: the odd column does not make it into the 1 x 1 level.
+        std::vector<uint8_t> pixels = {
+            0, 0, 0, 0,  4, 4, 4, 4,  8, 8, 8, 8,
+            0, 0, 0, 0,  4, 4, 4, 4,  8, 8, 8, 8,
+        };
+        Assert::AreEqual(2, GenerateMips(3, 2, pixels));
+        Assert::AreEqual(static_cast<size_t>(28), pixels.size());
+        Assert::AreEqual(2, static_cast<int>(pixels[24]));
+
+        pixels.assign(static_cast<size_t>(5 * 3 * 4), 200);
+        Assert::AreEqual(3, GenerateMips(5, 3, pixels));
+        Assert::AreEqual(GetMipOffset(5, 3, 3), pixels.size());
+        Assert::AreEqual(200, static_cast<int>(pixels.back()));
+    }
+};
+} // namespace MilkDrop2
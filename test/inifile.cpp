@@ -0,0 +1,143 @@
+/*
+ * inifile.cpp - Tests for MilkDrop2 library's INI file index.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vis_milk2/inifile.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(IniFileTest)
+{
+  private:
+    CIniFile ini;
+
+    void parse(const std::string& text)
+    {
+        ini.Parse(text.data(), text.size());
+    }
+
+    std::wstring get(const wchar_t* section, const wchar_t* key)
+    {
+        wchar_t buf[64];
+        ini.GetString(section, key, L"<default>", buf, ARRAYSIZE(buf));
+        return buf;
+    }
+
+  public:
+    TEST_METHOD(LookupTest)
+    {
+        parse("top=ignored\r\n"
+              "[Message00]\r\n"
+              "  Text = Hello world  \r\n"
+              "quoted=\" padded \"\r\n"
+              "single='x\"\r\n"
+              "empty=\r\n"
+              "; text=commented out\r\n"
+              "TEXT=second\r\n"
+              "noequals\r\n"
+              "[ font00 ] trailing\n"
+              "face=Arial\n"
+              "[message00]\n"
+              "font=1\n");
+        Assert::AreEqual(std::wstring(L"Hello world"), get(L"message00", L"text"));
+        Assert::AreEqual(std::wstring(L" padded "), get(L"MESSAGE00", L"quoted"));
+        Assert::AreEqual(std::wstring(L"'x\""), get(L"message00", L"single"));
+        Assert::AreEqual(std::wstring(), get(L"message00", L"empty"));
+        Assert::AreEqual(std::wstring(), get(L"message00", L"noequals"));
+        Assert::AreEqual(std::wstring(L"Arial"), get(L"font00", L"face"));
+        Assert::AreEqual(std::wstring(L"<default>"), get(L"message00", L"missing"));
+        Assert::AreEqual(std::wstring(L"<default>"), get(L"message01", L"text"));
+        Assert::AreEqual(std::wstring(L"<default>"), get(L"", L"top"));
+
+        // Only the first section of a name is looked at.
+        Assert::AreEqual(std::wstring(L"<default>"), get(L"message00", L"font"));
+    }
+
+    TEST_METHOD(TruncateTest)
+    {
+        parse("[img00]\nimg=abcdef\n");
+        wchar_t buf[4];
+        Assert::AreEqual(static_cast<size_t>(3), ini.GetString(L"img00", L"img", L"", buf, ARRAYSIZE(buf)));
+        Assert::AreEqual(std::wstring(L"abc"), std::wstring(buf));
+        char bufA[4];
+        Assert::AreEqual(static_cast<size_t>(3), ini.GetStringA(L"img00", L"missing", "~!@#$", bufA, ARRAYSIZE(bufA)));
+        Assert::AreEqual(std::string("~!@"), std::string(bufA));
+
+        // A null default is empty.
+        Assert::AreEqual(static_cast<size_t>(0), ini.GetString(L"img00", L"missing", nullptr, buf, ARRAYSIZE(buf)));
+        Assert::AreEqual(std::wstring(), std::wstring(buf));
+        Assert::AreEqual(static_cast<size_t>(0), ini.GetStringA(L"img00", L"missing", nullptr, bufA, ARRAYSIZE(bufA)));
+        Assert::AreEqual(std::string(), std::string(bufA));
+        Assert::AreEqual(static_cast<size_t>(3), ini.GetString(L"img00", L"img", nullptr, buf, ARRAYSIZE(buf)));
+    }
+
+    TEST_METHOD(IntTest)
+    {
+        parse("[img00]\na=42\nb=-7\nc=0x00FF00\nd=  12px\ne=px\nf=\ng=+0b101\nh=0xFFFFFFFF\n");
+        Assert::AreEqual(42, ini.GetInt(L"img00", L"a", 5));
+        Assert::AreEqual(-7, ini.GetInt(L"img00", L"b", 5));
+        Assert::AreEqual(0x00FF00, ini.GetInt(L"img00", L"c", 5));
+        Assert::AreEqual(12, ini.GetInt(L"img00", L"d", 5));
+        Assert::AreEqual(0, ini.GetInt(L"img00", L"e", 5));
+        Assert::AreEqual(5, ini.GetInt(L"img00", L"f", 5));
+        Assert::AreEqual(5, ini.GetInt(L"img00", L"g", 0));
+        Assert::AreEqual(-1, ini.GetInt(L"img00", L"h", 0));
+        Assert::AreEqual(-1, ini.GetInt(L"img00", L"missing", -1));
+        Assert::IsTrue(ini.GetBool(L"img00", L"a", false));
+        Assert::IsFalse(ini.GetBool(L"img00", L"e", true));
+    }
+
+    TEST_METHOD(FloatTest)
+    {
+        parse("[message00]\nsize=62.5\nx=.25\ny=-1e-1\ntime=+3\nfade=fast\ngrowth=\n");
+        Assert::AreEqual(62.5f, ini.GetFloat(L"message00", L"size", 0.0f));
+        Assert::AreEqual(0.25f, ini.GetFloat(L"message00", L"x", 0.0f));
+        Assert::AreEqual(-0.1f, ini.GetFloat(L"message00", L"y", 0.0f));
+        Assert::AreEqual(3.0f, ini.GetFloat(L"message00", L"time", 0.0f));
+        Assert::AreEqual(0.2f, ini.GetFloat(L"message00", L"fade", 0.2f));
+        Assert::AreEqual(1.0f, ini.GetFloat(L"message00", L"growth", 1.0f));
+        Assert::AreEqual(1.5f, ini.GetFloat(L"message00", L"missing", 1.5f));
+    }
+
+    TEST_METHOD(EncodingTest)
+    {
+        parse("\xEF\xBB\xBF[message00]\ntext=caf\xC3\xA9\n");
+        Assert::AreEqual(std::wstring(L"caf\u00E9"), get(L"message00", L"text"));
+        parse("[message00]\ntext=caf\xE9\n");
+        Assert::AreEqual(std::wstring(L"caf\u00E9"), get(L"message00", L"text"));
+        char bufA[8];
+        ini.GetStringA(L"message00", L"text", "", bufA, ARRAYSIZE(bufA));
+        Assert::AreEqual(std::string("caf\xE9"), std::string(bufA));
+        parse(std::string("\xFF\xFE[\0m\0]\0\n\0k\0=\0\xAC\x20", 16));
+        Assert::AreEqual(std::wstring(L"\u20AC"), get(L"m", L"k"));
+    }
+
+    TEST_METHOD(RefreshTest)
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / L"milk2_inifile_test.ini";
+        std::ofstream(path, std::ios::binary) << "[img00]\nimg=a.png\n";
+        Assert::IsTrue(ini.Refresh(path.wstring().c_str()));
+        Assert::AreEqual(std::wstring(L"a.png"), get(L"img00", L"img"));
+
+        // A change in size is picked up even within the timestamp resolution.
+        std::ofstream(path, std::ios::binary) << "[img00]\nimg=bb.png\n";
+        Assert::IsTrue(ini.Refresh(path.wstring().c_str()));
+        Assert::AreEqual(std::wstring(L"bb.png"), get(L"img00", L"img"));
+
+        std::filesystem::remove(path);
+        Assert::IsFalse(ini.Refresh(path.wstring().c_str()));
+        Assert::AreEqual(std::wstring(L"<default>"), get(L"img00", L"img"));
+    }
+};
+} // namespace MilkDrop2
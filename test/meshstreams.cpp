@@ -0,0 +1,175 @@
+/*
+ * meshstreams.cpp - Tests for MilkDrop2 library's warp mesh vertex streams.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <vis_milk2/meshstreams.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(MeshStreamsTest)
+{
+  private:
+    // Same members as `MDVERTEX`.
+    typedef struct
+    {
+        float x, y, z;
+        float r, g, b, a;
+        float tu, tv;
+        float tu0, tv0;
+        float rad, ang;
+    } td_vertex;
+
+    static constexpr float PI = 3.1415926535897932384626433832795f;
+
+    // The interleaved mesh as the evaluator used to initialize it.
+    static std::vector<td_vertex> MakeMesh(int nGridX, int nGridY, float fAspectX, float fAspectY, int nTexSizeX, int nTexSizeY)
+    {
+        std::vector<td_vertex> verts(static_cast<size_t>(nGridX + 1) * (nGridY + 1));
+        int nVert = 0;
+        float texel_offset_x = 0.5f / static_cast<float>(nTexSizeX);
+        float texel_offset_y = 0.5f / static_cast<float>(nTexSizeY);
+        for (int y = 0; y <= nGridY; y++)
+        {
+            for (int x = 0; x <= nGridX; x++)
+            {
+                td_vertex& v = verts[nVert++];
+                v.x = x / static_cast<float>(nGridX) * 2.0f - 1.0f;
+                v.y = y / static_cast<float>(nGridY) * 2.0f - 1.0f;
+                v.z = 0.0f;
+                v.rad = std::sqrt(v.x * v.x * fAspectX * fAspectX + v.y * v.y * fAspectY * fAspectY);
+                v.ang = (y == nGridY / 2 && x == nGridX / 2) ? 0.0f : std::atan2(v.y * fAspectY, v.x * fAspectX);
+                v.tu0 =  v.x * 0.5f + 0.5f + texel_offset_x;
+                v.tv0 = -v.y * 0.5f + 0.5f + texel_offset_y;
+            }
+        }
+        return verts;
+    }
+
+    // Warped UVs and blend alphas, as the per-vertex code writes them.
+    static void Warp(CMeshStreams& mesh)
+    {
+        for (size_t n = 0; n < mesh.GetCount(); n++)
+        {
+            mesh.GetTu()[n] = mesh.GetTu0()[n] + 0.01f * std::sin(static_cast<float>(n));
+            mesh.GetTv()[n] = mesh.GetTv0()[n] - 0.02f * std::cos(static_cast<float>(n));
+            mesh.GetAlpha()[n] = static_cast<float>(n % 7) / 6.0f;
+        }
+    }
+
+  public:
+    TEST_METHOD(InitTest)
+    {
+        CMeshStreams mesh;
+        mesh.Init(48, 36, 1.0f, 0.5625f, 1024, 768);
+        std::vector<td_vertex> expected = MakeMesh(48, 36, 1.0f, 0.5625f, 1024, 768);
+        Assert::AreEqual(expected.size(), mesh.GetCount());
+        Assert::AreEqual(48, mesh.GetGridX());
+        Assert::AreEqual(36, mesh.GetGridY());
+
+        // Unwarped and opaque until the per-vertex code runs.
+        std::vector<td_vertex> verts(mesh.GetCount());
+        mesh.Gather(verts.data());
+        for (size_t n = 0; n < verts.size(); n++)
+        {
+            Assert::AreEqual(expected[n].x, verts[n].x);
+            Assert::AreEqual(expected[n].y, verts[n].y);
+            Assert::AreEqual(0.0f, verts[n].z);
+            Assert::AreEqual(expected[n].rad, verts[n].rad);
+            Assert::AreEqual(expected[n].ang, verts[n].ang);
+            Assert::AreEqual(expected[n].tu0, verts[n].tu0);
+            Assert::AreEqual(expected[n].tv0, verts[n].tv0);
+            Assert::AreEqual(expected[n].tu0, verts[n].tu);
+            Assert::AreEqual(expected[n].tv0, verts[n].tv);
+            Assert::AreEqual(1.0f, verts[n].r);
+            Assert::AreEqual(1.0f, verts[n].a);
+        }
+
+        // The left half of the middle row is on the angle-wrap seam.
+        Assert::AreEqual(PI, mesh.GetAng()[18 * 49]);
+        Assert::AreEqual(PI, mesh.GetAng()[18 * 49 + 23]);
+        Assert::AreEqual(0.0f, mesh.GetAng()[18 * 49 + 24]);
+
+        // Resizing recomputes every stream.
+        mesh.Init(32, 24, 1.0f, 1.0f, 512, 512);
+        Assert::AreEqual(static_cast<size_t>(33 * 25), mesh.GetCount());
+        Assert::AreEqual(1.0f, mesh.GetX()[32]);
+    }
+
+    TEST_METHOD(SampleTest)
+    {
+        const int nGridX = 48, nGridY = 36;
+        CMeshStreams mesh;
+        mesh.Init(nGridX, nGridY, 1.0f, 1.0f, 1024, 1024);
+        Warp(mesh);
+        std::vector<td_vertex> verts(mesh.GetCount());
+        mesh.Gather(verts.data());
+
+        for (int j = 0; j <= 20; j++)
+        {
+            for (int i = 0; i <= 20; i++)
+            {
+                float fx = i / 20.0f, fy = j / 20.0f;
+
+                // Motion vectors, as reverse propagated from interleaved vertices.
+                int y0 = static_cast<int>(fy * nGridY);
+                float dy = fy * nGridY - y0;
+                int x0 = static_cast<int>(fx * nGridX);
+                float dx = fx * nGridX - x0;
+                int x1 = x0 + 1;
+                int y1 = y0 + 1;
+                float u = -1.0f, v = -1.0f;
+                if (x1 > nGridX || y1 > nGridY)
+                {
+                    Assert::IsFalse(mesh.SampleUV(fx, fy, &u, &v));
+                }
+                else
+                {
+                    float tu, tv;
+                    tu  = verts[y0 * (nGridX + 1) + x0].tu * (1 - dx) * (1 - dy);
+                    tv  = verts[y0 * (nGridX + 1) + x0].tv * (1 - dx) * (1 - dy);
+                    tu += verts[y0 * (nGridX + 1) + x1].tu * (dx) * (1 - dy);
+                    tv += verts[y0 * (nGridX + 1) + x1].tv * (dx) * (1 - dy);
+                    tu += verts[y1 * (nGridX + 1) + x0].tu * (1 - dx) * (dy);
+                    tv += verts[y1 * (nGridX + 1) + x0].tv * (1 - dx) * (dy);
+                    tu += verts[y1 * (nGridX + 1) + x1].tu * (dx) * (dy);
+                    tv += verts[y1 * (nGridX + 1) + x1].tv * (dx) * (dy);
+                    Assert::IsTrue(mesh.SampleUV(fx, fy, &u, &v));
+                    Assert::AreEqual(tu, u);
+                    Assert::AreEqual(tv, v);
+                }
+
+                // Composite grid alphas, as interpolated from interleaved vertices.
+                float x = std::max(std::min(fx * (nGridX + 1), static_cast<float>(nGridX) - 1.0f), 0.0f);
+                float y = std::max(std::min(fy * (nGridY + 1), static_cast<float>(nGridY) - 1.0f), 0.0f);
+                int nx = static_cast<int>(x);
+                int ny = static_cast<int>(y);
+                double ddx = x - nx;
+                double ddy = y - ny;
+                double alpha = verts[(ny) * (nGridX + 1) + (nx)].a * 255 * (1 - ddx) * (1 - ddy) +
+                               verts[(ny) * (nGridX + 1) + (nx + 1)].a * 255 * (ddx) * (1 - ddy) +
+                               verts[(ny + 1) * (nGridX + 1) + (nx)].a * 255 * (1 - ddx) * (ddy) +
+                               verts[(ny + 1) * (nGridX + 1) + (nx + 1)].a * 255 * (ddx) * (ddy);
+                alpha /= 255.0f;
+                Assert::AreEqual(static_cast<float>(alpha), mesh.SampleAlpha(fx, fy));
+            }
+        }
+
+        // Outside of the mesh.
+        float u, v;
+        Assert::IsFalse(mesh.SampleUV(-0.1f, 0.5f, &u, &v));
+        Assert::IsFalse(mesh.SampleUV(0.5f, 1.5f, &u, &v));
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,115 @@
+/*
+ * noise.cpp - Tests for MilkDrop2 library's noise texture synthesis.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <vis_milk2/noise.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(NoiseTest)
+{
+  private:
+    static uint64_t Checksum(const std::vector<uint32_t>& texels)
+    {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (uint32_t t : texels)
+        {
+            h ^= t;
+            h *= 0x100000001B3ULL;
+        }
+        return h;
+    }
+
+    static std::vector<uint32_t> MakeTex(uint32_t nSeed, int size, int zoom_factor, int nThreads)
+    {
+        std::vector<uint32_t> texels(static_cast<size_t>(size * size));
+        GenerateNoiseTex(nSeed, size, zoom_factor, texels.data(), nThreads);
+        return texels;
+    }
+
+    static std::vector<uint32_t> MakeVol(uint32_t nSeed, int size, int zoom_factor, int nThreads)
+    {
+        std::vector<uint32_t> texels(static_cast<size_t>(size * size * size));
+        GenerateNoiseVol(nSeed, size, zoom_factor, texels.data(), nThreads);
+        return texels;
+    }
+
+  public:
+    TEST_METHOD(ReproducibleTest)
+    {
+        // Pixel-exact on every platform: generation is integer only.
+        Assert::AreEqual(static_cast<uint64_t>(0x9B565160A0D530F3), Checksum(MakeTex(1, 256, 1, 1)));
+        Assert::AreEqual(static_cast<uint64_t>(0x0B4D81C69E8F3EF6), Checksum(MakeTex(2, 256, 8, 1)));
+        Assert::AreEqual(static_cast<uint64_t>(0xF06DDEC94DDF5805), Checksum(MakeVol(3, 32, 4, 1)));
+        Assert::AreEqual(GetNoiseSeed(L"noise_lq"), GetNoiseSeed(L"noise_lq"));
+        Assert::AreNotEqual(GetNoiseSeed(L"noise_lq"), GetNoiseSeed(L"noise_mq"));
+        Assert::IsTrue(MakeTex(1, 32, 1, 1) != MakeTex(2, 32, 1, 1));
+    }
+
+    TEST_METHOD(ThreadsTest)
+    {
+        for (int zoom_factor : {1, 2, 4, 8})
+        {
+            Assert::IsTrue(MakeTex(7, 256, zoom_factor, 1) == MakeTex(7, 256, zoom_factor, 5));
+            Assert::IsTrue(MakeVol(7, 32, zoom_factor, 1) == MakeVol(7, 32, zoom_factor, 3));
+        }
+    }
+
+    TEST_METHOD(SmoothingTest)
+    {
+        // Neighbors in smoothed noise differ much less than in random noise.
+        std::vector<uint32_t> smooth = MakeTex(9, 64, 4, 1);
+        std::vector<uint32_t> rough = MakeTex(9, 64, 1, 1);
+        uint64_t dSmooth = 0, dRough = 0;
+        for (size_t i = 1; i < smooth.size(); i++)
+        {
+            dSmooth += static_cast<uint64_t>(std::abs(static_cast<int>((smooth[i] >> 8) & 0xFF) - static_cast<int>((smooth[i - 1] >> 8) & 0xFF)));
+            dRough += static_cast<uint64_t>(std::abs(static_cast<int>((rough[i] >> 8) & 0xFF) - static_cast<int>((rough[i - 1] >> 8) & 0xFF)));
+        }
+        Assert::IsTrue(dSmooth * 2 < dRough);
+    }
+
+    TEST_METHOD(CacheTest)
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / L"milk2_noise_test";
+        std::filesystem::remove_all(dir);
+
+        CNoiseCache first;
+        first.SetDirectory(dir.wstring());
+        std::vector<uint32_t> tex = first.Get(L"noise_hq", 64, 8, false);
+        std::vector<uint32_t> vol = first.Get(L"noisevol_hq", 16, 4, true);
+        Assert::IsTrue(&first.Get(L"noise_hq", 64, 8, false) == &first.Get(L"noise_hq", 64, 8, false));
+        Assert::AreEqual(2u, first.GetGenerated());
+        Assert::IsTrue(tex == MakeTex(GetNoiseSeed(L"noise_hq"), 64, 8, 1));
+
+        CNoiseCache second; // reads the files
+        second.SetDirectory(dir.wstring());
+        Assert::IsTrue(tex == second.Get(L"noise_hq", 64, 8, false));
+        Assert::IsTrue(vol == second.Get(L"noisevol_hq", 16, 4, true));
+        Assert::AreEqual(0u, second.GetGenerated());
+
+        // A truncated file is ignored and rewritten.
+        std::filesystem::resize_file(dir / L"noise_hq_64_8_2d.bin", 100);
+        CNoiseCache third;
+        third.SetDirectory(dir.wstring());
+        Assert::IsTrue(tex == third.Get(L"noise_hq", 64, 8, false));
+        Assert::AreEqual(1u, third.GetGenerated());
+        Assert::AreEqual(static_cast<uintmax_t>(4 + 5 * 4 + 64 * 64 * 4), std::filesystem::file_size(dir / L"noise_hq_64_8_2d.bin"));
+
+        std::filesystem::remove_all(dir);
+    }
+};
+} // namespace MilkDrop2
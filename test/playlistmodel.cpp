@@ -0,0 +1,150 @@
+/*
+ * playlistmodel.cpp - Tests for MilkDrop2 library's playlist title snapshot.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vis_milk2/playlistmodel.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(PlaylistModelTest)
+{
+  private:
+    // A playlist of song names, counting how many titles were formatted.
+    class CFakePlaylist : public CPlaylistSource
+    {
+      public:
+        explicit CFakePlaylist(size_t nItems)
+        {
+            for (size_t i = 0; i < nItems; i++)
+                m_items.push_back(L"Song " + std::to_wstring(i));
+        }
+
+        size_t GetItemCount() override
+        {
+            m_nCounts++;
+            return m_items.size();
+        }
+
+        bool FormatTitle(size_t nIndex, std::wstring& title) override
+        {
+            m_nFormats++;
+            if (nIndex >= m_items.size() || m_items[nIndex].empty())
+                return false;
+            title = m_items[nIndex];
+            return true;
+        }
+
+        std::vector<std::wstring> m_items;
+        int m_nCounts = 0;
+        int m_nFormats = 0;
+    };
+
+    static std::wstring Title(CPlaylistModel& model, size_t nIndex)
+    {
+        const std::wstring* pTitle = model.GetTitle(nIndex);
+        return pTitle ? *pTitle : L"(none)";
+    }
+
+  public:
+    TEST_METHOD(LazyTest)
+    {
+        CFakePlaylist playlist(50000);
+        CPlaylistModel model(&playlist);
+        Assert::AreEqual(static_cast<size_t>(50000), model.GetCount());
+
+        // Drawing a page many times formats only its rows, once.
+        for (int nFrame = 0; nFrame < 10; nFrame++)
+            for (size_t i = 49990; i < 50000; i++)
+                Assert::AreEqual(L"Song " + std::to_wstring(i), Title(model, i));
+        Assert::AreEqual(10, playlist.m_nFormats);
+        Assert::AreEqual(1, playlist.m_nCounts);
+
+        td_playlistmodelstats stats;
+        model.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(10), stats.nFormatted);
+        Assert::AreEqual(static_cast<uint64_t>(90), stats.nHits);
+        Assert::AreEqual(static_cast<uint64_t>(10), stats.nMisses);
+
+        // Out of range, or not formattable, and not cached.
+        Assert::IsNull(model.GetTitle(50000));
+        playlist.m_items[3].clear();
+        Assert::IsNull(model.GetTitle(3));
+        Assert::IsNull(model.GetTitle(3));
+        Assert::AreEqual(12, playlist.m_nFormats);
+    }
+
+    TEST_METHOD(EditTest)
+    {
+        CFakePlaylist playlist(5);
+        CPlaylistModel model(&playlist);
+        for (size_t i = 0; i < 5; i++)
+            model.GetTitle(i);
+
+        // Insert two items at 1.
+        playlist.m_items.insert(playlist.m_items.begin() + 1, {L"New A", L"New B"});
+        model.Insert(1, 2);
+        Assert::AreEqual(static_cast<size_t>(7), model.GetCount());
+        Assert::AreEqual(std::wstring(L"Song 0"), Title(model, 0));
+        Assert::AreEqual(std::wstring(L"New A"), Title(model, 1));
+        Assert::AreEqual(std::wstring(L"Song 4"), Title(model, 6));
+        Assert::AreEqual(6, playlist.m_nFormats);
+
+        // Remove the first and the last.
+        playlist.m_items = {L"New A", L"New B", L"Song 1", L"Song 2", L"Song 3"};
+        model.Remove([](size_t i) { return i == 0 || i == 6; });
+        Assert::AreEqual(static_cast<size_t>(5), model.GetCount());
+        Assert::AreEqual(std::wstring(L"New A"), Title(model, 0));
+        Assert::AreEqual(std::wstring(L"Song 3"), Title(model, 4));
+
+        // Reverse.
+        const size_t order[] = {4, 3, 2, 1, 0};
+        playlist.m_items = {L"Song 3", L"Song 2", L"Song 1", L"New B", L"New A"};
+        model.Reorder(order, 5);
+        for (size_t i = 0; i < 5; i++)
+            Assert::AreEqual(playlist.m_items[i], Title(model, i));
+        Assert::AreEqual(7, playlist.m_nFormats);
+
+        // Retag one.
+        playlist.m_items[2] = L"Song 1 (Remix)";
+        model.Invalidate([](size_t i) { return i == 2; });
+        Assert::AreEqual(std::wstring(L"Song 1 (Remix)"), Title(model, 2));
+        Assert::AreEqual(8, playlist.m_nFormats);
+        Assert::AreEqual(1, playlist.m_nCounts);
+    }
+
+    TEST_METHOD(ResetTest)
+    {
+        CFakePlaylist playlist(3);
+        CPlaylistModel model(&playlist);
+        Assert::AreEqual(std::wstring(L"Song 2"), Title(model, 2));
+
+        // Another playlist, snapshot on next access.
+        playlist.m_items = {L"Other"};
+        model.Reset();
+        model.Insert(0, 1); // ignored while stale
+        Assert::AreEqual(static_cast<size_t>(1), model.GetCount());
+        Assert::AreEqual(std::wstring(L"Other"), Title(model, 0));
+        Assert::IsNull(model.GetTitle(2));
+        Assert::AreEqual(2, playlist.m_nCounts);
+
+        // A notification that does not fit the snapshot resets it.
+        playlist.m_items = {L"A", L"B"};
+        const size_t order[] = {1, 0};
+        model.Reorder(order, 2);
+        Assert::AreEqual(static_cast<size_t>(2), model.GetCount());
+        Assert::AreEqual(std::wstring(L"B"), Title(model, 1));
+        Assert::AreEqual(3, playlist.m_nCounts);
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,128 @@
+/*
+ * playstate.cpp - Tests for MilkDrop2 library's published playback state.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cwchar>
+#include <thread>
+#include <vis_milk2/playstate.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(PlayStateTest)
+{
+  private:
+    // A state whose every field follows from `n`, so that a reader can tell
+    // a torn copy.
+    static void MakeState(uint32_t n, td_playstate& state)
+    {
+        state = {};
+        state.nTime = static_cast<int64_t>(n) * 1000;
+        state.fPosition = static_cast<double>(n);
+        state.fLength = static_cast<double>(n) + 1.0;
+        state.nListLength = static_cast<int32_t>(n);
+        state.nListPos = static_cast<int32_t>(n % 7);
+        state.bPlaying = 1;
+        state.bPaused = static_cast<uint8_t>(n & 1);
+        for (size_t i = 0; i < 511; i++)
+            state.szTitle[i] = static_cast<wchar_t>(L'A' + (n + i) % 26);
+    }
+
+    static bool IsConsistent(const td_playstate& state)
+    {
+        td_playstate expected;
+        MakeState(static_cast<uint32_t>(state.nListLength), expected);
+        return state.nTime == expected.nTime && state.fPosition == expected.fPosition && state.fLength == expected.fLength &&
+               state.nListPos == expected.nListPos && state.bPaused == expected.bPaused &&
+               std::wmemcmp(state.szTitle, expected.szTitle, 512) == 0;
+    }
+
+  public:
+    TEST_METHOD(PublishTest)
+    {
+        CPlayStateBlock block;
+        td_playstate state;
+        Assert::IsFalse(block.Read(state));
+        Assert::AreEqual(static_cast<uint64_t>(0), block.GetVersion());
+
+        MakeState(42, state);
+        block.Publish(state);
+        td_playstate read;
+        Assert::IsTrue(block.Read(read));
+        Assert::IsTrue(IsConsistent(read));
+        Assert::AreEqual(42, read.nListLength);
+
+        MakeState(43, state);
+        block.Publish(state);
+        Assert::IsTrue(block.Read(read));
+        Assert::AreEqual(43, read.nListLength);
+        Assert::AreEqual(static_cast<uint64_t>(2), block.GetVersion());
+    }
+
+    TEST_METHOD(PositionTest)
+    {
+        td_playstate state{};
+        state.nTime = 1'000'000'000;
+        state.fPosition = 10.0;
+        state.fLength = 12.0;
+        Assert::IsTrue(GetPlayPosition(state, 2'000'000'000) < 0.0);
+
+        // Runs on while playing, up to the length.
+        state.bPlaying = 1;
+        Assert::AreEqual(10.0, GetPlayPosition(state, 1'000'000'000));
+        Assert::AreEqual(11.5, GetPlayPosition(state, 2'500'000'000));
+        Assert::AreEqual(12.0, GetPlayPosition(state, 9'000'000'000));
+
+        // Unless paused, or unknown length.
+        state.bPaused = 1;
+        Assert::AreEqual(10.0, GetPlayPosition(state, 2'500'000'000));
+        state.bPaused = 0;
+        state.fLength = 0.0;
+        Assert::AreEqual(18.0, GetPlayPosition(state, 9'000'000'000));
+    }
+
+    TEST_METHOD(ConcurrentTest)
+    {
+        CPlayStateBlock block;
+        std::atomic<bool> bDone = false;
+        std::thread publisher([&] {
+            td_playstate state;
+            for (uint32_t n = 1; n <= 20000; n++)
+            {
+                MakeState(n, state);
+                block.Publish(state);
+            }
+            bDone = true;
+        });
+
+        // Every copy read is one state, in order.
+        int nTorn = 0;
+        int32_t nLast = 0;
+        td_playstate state;
+        while (!bDone)
+        {
+            if (block.Read(state))
+            {
+                if (!IsConsistent(state) || state.nListLength < nLast)
+                    nTorn++;
+                nLast = state.nListLength;
+            }
+        }
+        publisher.join();
+
+        Assert::AreEqual(0, nTorn);
+        Assert::IsTrue(block.Read(state));
+        Assert::AreEqual(20000, state.nListLength);
+        Assert::AreEqual(static_cast<uint64_t>(20000), block.GetVersion());
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,114 @@
+/*
+ * presetcost.cpp - Tests for MilkDrop2 library's static preset cost model.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstring>
+#include <vector>
+#include <vis_milk2/presetcost.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(PresetCostTest)
+{
+  private:
+    static float cost(const char* szText, int nGrid = 48)
+    {
+        return GetPresetCost(EstimatePresetCost(szText, strlen(szText)), nGrid, nGrid);
+    }
+
+  public:
+    TEST_METHOD(CostOrderingTest)
+    {
+        const char* plain = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\n";
+        const char* perFrame = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01 + 0.01 * sin(time) + 0.01 * cos(time * 1.3);\n";
+        const char* perPixel = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\nper_pixel_1=rot = rot + 0.1 * sin(rad * 6 + time);\n";
+        const char* wave = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\nwavecode_0_enabled=1\nwavecode_0_samples=512\nwave_0_per_point1=x = sample; y = value1;\n";
+        const char* megabuf = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01; megabuf(0) = zoom;\n";
+
+        // More work costs more.
+        Assert::IsTrue(cost(plain) < cost(perFrame));
+        Assert::IsTrue(cost(plain) < cost(perPixel));
+        Assert::IsTrue(cost(plain) < cost(wave));
+        Assert::IsTrue(cost(plain) < cost(megabuf));
+
+        // Per-pixel code is paid per vertex, so it grows with the mesh.
+        Assert::IsTrue(cost(perPixel, 96) - cost(plain, 96) > 3.0f * (cost(perPixel, 48) - cost(plain, 48)));
+
+        // Disabled waves and shapes cost nothing; samples and instances multiply.
+        const char* waveOff = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\nwavecode_0_enabled=0\nwave_0_per_point1=x = sample; y = value1;\n";
+        const char* waveFew = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\nwavecode_0_enabled=1\nwavecode_0_samples=64\nwave_0_per_point1=x = sample; y = value1;\n";
+        Assert::AreEqual(cost(plain), cost(waveOff));
+        Assert::IsTrue(cost(waveFew) < cost(wave));
+        const char* shape = "[preset00]\nshapecode_1_enabled=1\nshapecode_1_num_inst=1\nshape_1_per_frame1=x = 0.5 + 0.1 * sin(time);\n";
+        const char* shapes = "[preset00]\nshapecode_1_enabled=1\nshapecode_1_num_inst=100\nshape_1_per_frame1=x = 0.5 + 0.1 * sin(time);\n";
+        Assert::IsTrue(cost(shape) < cost(shapes));
+
+        // Initialization code runs once and is free.
+        const char* init = "[preset00]\nzoom=1.0\nper_frame_1=zoom=1.01;\nper_frame_init_1=q1 = 0.5 + 0.25 * sin(7);\n";
+        Assert::AreEqual(cost(plain), cost(init));
+    }
+
+    TEST_METHOD(BudgetWeightTest)
+    {
+        Assert::AreEqual(1.0f, GetBudgetWeight(500.0f, 0.0f)); // unlimited
+        Assert::AreEqual(1.0f, GetBudgetWeight(100.0f, 100.0f));
+        Assert::AreEqual(0.25f, GetBudgetWeight(200.0f, 100.0f));
+        Assert::AreEqual(0.0f, GetBudgetWeight(201.0f, 100.0f));
+        Assert::IsTrue(GetBudgetWeight(150.0f, 100.0f) < GetBudgetWeight(120.0f, 100.0f));
+    }
+
+    TEST_METHOD(BudgetFilterTest)
+    {
+        const std::vector<float> costs = {50.0f, 300.0f, 150.0f, 90.0f, 1000.0f};
+        const std::vector<float> ratings = {1.0f, 5.0f, 1.0f, 0.0f, 5.0f};
+        std::vector<int> picks(costs.size());
+        for (int r = 0; r < 1000; r++)
+        {
+            int n = PickPresetWithinBudget(costs.data(), ratings.data(), costs.size(), 100.0f, static_cast<float>(r) / 1000.0f);
+            Assert::IsTrue(n >= 0 && n < static_cast<int>(costs.size()));
+            picks[static_cast<size_t>(n)]++;
+        }
+
+        // Over twice the budget, or without a rating, is never picked; over
+        // the budget is picked less often than the same rating within it.
+        Assert::AreEqual(0, picks[1]);
+        Assert::AreEqual(0, picks[3]);
+        Assert::AreEqual(0, picks[4]);
+        Assert::IsTrue(picks[2] > 0 && picks[2] < picks[0]);
+
+        // Only presets that fit are picked when all ratings are 0.
+        const std::vector<float> zeros(costs.size(), 0.0f);
+        std::vector<int> evenPicks(costs.size());
+        for (int r = 0; r < 1000; r++)
+            evenPicks[static_cast<size_t>(PickPresetWithinBudget(costs.data(), zeros.data(), costs.size(), 100.0f, static_cast<float>(r) / 1000.0f))]++;
+        Assert::AreEqual(0, evenPicks[1]);
+        Assert::AreEqual(0, evenPicks[4]);
+        Assert::IsTrue(evenPicks[0] > 0 && evenPicks[2] > 0 && evenPicks[3] > 0);
+
+        // Nothing fits.
+        Assert::AreEqual(-1, PickPresetWithinBudget(costs.data(), nullptr, costs.size(), 10.0f, 0.5f));
+
+        // The last random value still picks a preset that fits.
+        Assert::AreEqual(3, PickPresetWithinBudget(costs.data(), nullptr, costs.size(), 100.0f, 0.99999f));
+    }
+
+    TEST_METHOD(NextWithinBudgetTest)
+    {
+        const std::vector<float> costs = {50.0f, 300.0f, 150.0f, 90.0f, 1000.0f};
+        Assert::AreEqual(static_cast<size_t>(2), NextPresetWithinBudget(costs.data(), costs.size(), 0, 100.0f));
+        Assert::AreEqual(static_cast<size_t>(0), NextPresetWithinBudget(costs.data(), costs.size(), 3, 100.0f));
+        Assert::AreEqual(static_cast<size_t>(1), NextPresetWithinBudget(costs.data(), costs.size(), 0, 0.0f));
+
+        // Nothing fits; move on anyway.
+        Assert::AreEqual(static_cast<size_t>(4), NextPresetWithinBudget(costs.data(), costs.size(), 3, 10.0f));
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,170 @@
+/*
+ * profiler.cpp - Tests for MilkDrop2 library's per-frame stage profiler.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <vis_milk2/profiler.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(ProfilerTest)
+{
+  private:
+    static void frame(CFrameProfiler& profiler, uint32_t nFrame)
+    {
+        profiler.BeginFrame(nFrame);
+        profiler.BeginStage(PROF_PER_FRAME_EQUATIONS);
+        profiler.EndStage(PROF_PER_FRAME_EQUATIONS);
+        profiler.EndFrame();
+    }
+
+  public:
+    TEST_METHOD(WraparoundTest)
+    {
+        auto profiler = std::make_unique<CFrameProfiler>();
+        std::vector<td_framerecord> records(CFrameProfiler::NUM_FRAMES);
+        Assert::AreEqual(static_cast<size_t>(0), profiler->Snapshot(records.data(), records.size()));
+
+        // Fewer frames than the ring holds.
+        for (uint32_t i = 0; i < 10; i++)
+            frame(*profiler, i);
+        Assert::AreEqual(static_cast<size_t>(10), profiler->Snapshot(records.data(), records.size()));
+        Assert::AreEqual(0u, records[0].nFrame);
+        Assert::AreEqual(9u, records[9].nFrame);
+
+        // Once the ring wraps, only the newest frames are kept, oldest first.
+        const uint32_t nTotal = static_cast<uint32_t>(CFrameProfiler::NUM_FRAMES) + 88;
+        for (uint32_t i = 10; i < nTotal; i++)
+            frame(*profiler, i);
+        Assert::AreEqual(CFrameProfiler::NUM_FRAMES, profiler->Snapshot(records.data(), records.size()));
+        for (size_t i = 0; i < CFrameProfiler::NUM_FRAMES; i++)
+            Assert::AreEqual(static_cast<uint32_t>(88 + i), records[i].nFrame);
+
+        // A short buffer gets the newest frames.
+        td_framerecord last[4];
+        Assert::AreEqual(static_cast<size_t>(4), profiler->Snapshot(last, 4));
+        Assert::AreEqual(nTotal - 4, last[0].nFrame);
+        Assert::AreEqual(nTotal - 1, last[3].nFrame);
+    }
+
+    TEST_METHOD(StageTest)
+    {
+        auto profiler = std::make_unique<CFrameProfiler>();
+
+        // Stages outside a frame are ignored.
+        profiler->BeginStage(PROF_BLUR_PASSES);
+        profiler->EndStage(PROF_BLUR_PASSES);
+        Assert::AreEqual(static_cast<size_t>(0), profiler->Snapshot(nullptr, 0));
+
+        profiler->BeginFrame(7);
+        profiler->BeginStage(PROF_CUSTOM_WAVES);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        profiler->EndStage(PROF_CUSTOM_WAVES);
+        profiler->BeginStage(PROF_CUSTOM_WAVES);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        profiler->EndStage(PROF_CUSTOM_WAVES);
+        profiler->EndFrame();
+
+        td_framerecord r;
+        Assert::AreEqual(static_cast<size_t>(1), profiler->Snapshot(&r, 1));
+        Assert::AreEqual(7u, r.nFrame);
+        Assert::IsTrue(r.nFrameStart <= r.nStageStart[PROF_CUSTOM_WAVES]);
+        Assert::IsTrue(r.nStageTime[PROF_CUSTOM_WAVES] >= 4000); // both runs add up
+        Assert::IsTrue(r.nFrameEnd - r.nFrameStart >= r.nStageTime[PROF_CUSTOM_WAVES]);
+        Assert::AreEqual(static_cast<int64_t>(-1), r.nStageStart[PROF_BLUR_PASSES]);
+        Assert::AreEqual(static_cast<int64_t>(0), r.nStageTime[PROF_BLUR_PASSES]);
+
+        Assert::AreEqual("EnforceMaxFPS", CFrameProfiler::GetStageName(PROF_ENFORCE_MAX_FPS));
+        Assert::AreEqual("Frame", CFrameProfiler::GetStageName(NUM_PROF_STAGES));
+    }
+
+    TEST_METHOD(SnapshotWhileWritingTest)
+    {
+        auto profiler = std::make_unique<CFrameProfiler>();
+        const uint32_t nTotal = 20 * static_cast<uint32_t>(CFrameProfiler::NUM_FRAMES);
+        std::atomic<bool> done = false;
+        std::thread writer([&] {
+            for (uint32_t i = 0; i < nTotal; i++)
+                frame(*profiler, i);
+            done = true;
+        });
+
+        // Every record copied while the ring is being overwritten belongs to
+        // one frame: a torn copy would mix the times of frames 512 apart.
+        std::vector<td_framerecord> records(CFrameProfiler::NUM_FRAMES);
+        size_t nSnapshots = 0;
+        bool bBad = false;
+        while (!done || nSnapshots == 0)
+        {
+            size_t n = profiler->Snapshot(records.data(), records.size());
+            for (size_t i = 0; i < n; i++)
+            {
+                const td_framerecord& r = records[i];
+                int64_t nStage = r.nStageStart[PROF_PER_FRAME_EQUATIONS];
+                if (nStage < r.nFrameStart || nStage + r.nStageTime[PROF_PER_FRAME_EQUATIONS] > r.nFrameEnd)
+                    bBad = true;
+                if (i > 0 && r.nFrame <= records[i - 1].nFrame)
+                    bBad = true;
+            }
+            nSnapshots++;
+        }
+        writer.join();
+        Assert::IsFalse(bBad);
+
+        Assert::AreEqual(CFrameProfiler::NUM_FRAMES, profiler->Snapshot(records.data(), records.size()));
+        Assert::AreEqual(nTotal - 1, records[CFrameProfiler::NUM_FRAMES - 1].nFrame);
+    }
+
+    TEST_METHOD(PercentileTest)
+    {
+        std::vector<float> values(100);
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = static_cast<float>((i * 37) % 100 + 1); // 1 to 100, shuffled
+        Assert::AreEqual(51.0f, CFrameProfiler::Percentile(values, 0.50f));
+        Assert::AreEqual(96.0f, CFrameProfiler::Percentile(values, 0.95f));
+        Assert::AreEqual(100.0f, CFrameProfiler::Percentile(values, 1.0f));
+        Assert::AreEqual(1.0f, CFrameProfiler::Percentile(values, 0.0f));
+
+        std::vector<float> one = {3.0f};
+        Assert::AreEqual(3.0f, CFrameProfiler::Percentile(one, 0.95f));
+    }
+
+    TEST_METHOD(StatsTest)
+    {
+        auto profiler = std::make_unique<CFrameProfiler>();
+        td_profilestats stats;
+        profiler->GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(0), stats.nFrames);
+        Assert::AreEqual(0.0f, stats.max[NUM_PROF_STAGES]);
+
+        for (uint32_t i = 0; i < 5; i++)
+        {
+            profiler->BeginFrame(i);
+            profiler->BeginStage(PROF_SHOW_TO_USER);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            profiler->EndStage(PROF_SHOW_TO_USER);
+            profiler->EndFrame();
+        }
+        profiler->GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(5), stats.nFrames);
+        Assert::IsTrue(stats.p50[PROF_SHOW_TO_USER] >= 2.0f);
+        Assert::IsTrue(stats.p50[PROF_SHOW_TO_USER] <= stats.p95[PROF_SHOW_TO_USER]);
+        Assert::IsTrue(stats.p95[PROF_SHOW_TO_USER] <= stats.max[PROF_SHOW_TO_USER]);
+        Assert::IsTrue(stats.p50[NUM_PROF_STAGES] >= stats.p50[PROF_SHOW_TO_USER]);
+        Assert::AreEqual(0.0f, stats.max[PROF_BLUR_PASSES]); // never ran
+    }
+};
+} // namespace MilkDrop2
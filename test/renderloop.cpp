@@ -0,0 +1,137 @@
+/*
+ * renderloop.cpp - Tests for MilkDrop2 library's render thread.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <vis_milk2/framepacer.h>
+#include <vis_milk2/renderloop.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(RenderLoopTest)
+{
+  private:
+    // Shows `m_nMaxFrames` frames at up to 500 frames per second, then
+    // behaves like a presenter whose device is gone.
+    class CFakePresenter : public CRenderPresenter
+    {
+      public:
+        explicit CFakePresenter(int nMaxFrames) : m_nMaxFrames(nMaxFrames), m_pacer(&m_clock) { m_pacer.SetMaxFps(500); }
+
+        void PullAudio() override { m_nPulls++; }
+
+        bool Present() override
+        {
+            m_renderThread = std::this_thread::get_id();
+            if (m_nFrames >= m_nMaxFrames)
+                return false;
+            m_pacer.EndFrame();
+            m_nFrames++;
+            return true;
+        }
+
+        // Waits up to a few seconds for the loop to catch up.
+        bool WaitForFrames(int nFrames) const
+        {
+            for (int i = 0; i < 5000 && m_nFrames < nFrames; i++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return m_nFrames >= nFrames;
+        }
+
+        int m_nMaxFrames;
+        std::atomic<int> m_nFrames = 0;
+        std::atomic<int> m_nPulls = 0;
+        std::thread::id m_renderThread;
+        CSteadyPacerClock m_clock;
+        CFramePacer m_pacer;
+    };
+
+  public:
+    TEST_METHOD(CommandTest)
+    {
+        CFakePresenter presenter(0);
+        CRenderLoop loop(&presenter);
+        std::vector<int> order;
+        std::thread::id commandThread;
+        loop.Post([&] { order.push_back(1); });
+        loop.Post([&] { order.push_back(2); commandThread = std::this_thread::get_id(); });
+        loop.Start();
+        loop.Send([&] { order.push_back(3); });
+        loop.Stop();
+
+        Assert::AreEqual(static_cast<size_t>(3), order.size());
+        for (int i = 0; i < 3; i++)
+            Assert::AreEqual(i + 1, order[i]);
+        Assert::IsTrue(commandThread == presenter.m_renderThread);
+        Assert::IsTrue(commandThread != std::this_thread::get_id());
+
+        // Stopped: sent commands run right away.
+        loop.Send([&] { order.push_back(4); });
+        Assert::AreEqual(static_cast<size_t>(4), order.size());
+    }
+
+    TEST_METHOD(CoalesceTest)
+    {
+        CFakePresenter presenter(0);
+        CRenderLoop loop(&presenter);
+        std::vector<int> order;
+        for (int i = 1; i <= 5; i++)
+        {
+            loop.Post([&order, i] { order.push_back(i * 10); }, 1); // resize
+            loop.Post([&order, i] { order.push_back(i); });         // move
+        }
+        loop.Start();
+        loop.Stop();
+
+        // Only the latest resize runs, after the moves posted before it.
+        const std::vector<int> expected = {1, 2, 3, 4, 50, 5};
+        Assert::IsTrue(expected == order);
+        td_renderstats stats;
+        loop.GetStats(stats);
+        Assert::AreEqual(static_cast<uint64_t>(6), stats.nCommands);
+        Assert::AreEqual(static_cast<uint64_t>(4), stats.nCoalesced);
+    }
+
+    TEST_METHOD(FrameTest)
+    {
+        CFakePresenter presenter(20);
+        CRenderLoop loop(&presenter);
+        loop.Start();
+        Assert::IsTrue(presenter.WaitForFrames(20));
+
+        // Idle now; a command still gets through without waiting for frames.
+        std::atomic<bool> bRan = false;
+        loop.Post([&] { bRan = true; });
+        loop.Send([] {});
+        Assert::IsTrue(bRan);
+        loop.Stop();
+
+        td_renderstats stats;
+        loop.GetStats(stats);
+        Assert::AreEqual(static_cast<uint64_t>(20), stats.nFrames);
+        Assert::IsTrue(stats.nSkipped >= 1);
+        Assert::AreEqual(static_cast<int>(stats.nFrames + stats.nSkipped), presenter.m_nPulls.load());
+        Assert::IsFalse(loop.IsRunning());
+
+        // Restarts where it left off.
+        presenter.m_nMaxFrames = 30;
+        loop.Start();
+        Assert::IsTrue(presenter.WaitForFrames(30));
+        loop.Stop();
+        loop.GetStats(stats);
+        Assert::AreEqual(static_cast<uint64_t>(30), stats.nFrames);
+    }
+};
+} // namespace MilkDrop2
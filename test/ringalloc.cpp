@@ -0,0 +1,107 @@
+/*
+ * ringalloc.cpp - Tests for MilkDrop2 library's transient buffer ring allocator.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vis_milk2/ringalloc.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(RingAllocatorTest)
+{
+  public:
+    TEST_METHOD(AppendTest)
+    {
+        CRingAllocator ring(1000);
+        td_ringalloc alloc;
+
+        // The first block discards whatever the buffer held.
+        Assert::IsTrue(ring.Allocate(52 * 4, 52, alloc));
+        Assert::AreEqual(static_cast<size_t>(0), alloc.nOffset);
+        Assert::IsTrue(alloc.bDiscard);
+
+        // Then blocks follow each other, aligned to their own vertex size.
+        Assert::IsTrue(ring.Allocate(28 * 3, 28, alloc));
+        Assert::AreEqual(static_cast<size_t>(224), alloc.nOffset);
+        Assert::IsFalse(alloc.bDiscard);
+        Assert::IsTrue(ring.Allocate(2 * 6, 2, alloc));
+        Assert::AreEqual(static_cast<size_t>(308), alloc.nOffset);
+        Assert::IsFalse(alloc.bDiscard);
+
+        td_ringallocstats stats;
+        ring.GetStats(stats);
+        Assert::AreEqual(static_cast<uint64_t>(3), stats.nAllocations);
+        Assert::AreEqual(static_cast<uint64_t>(1), stats.nDiscards);
+        Assert::AreEqual(static_cast<uint64_t>(320), stats.nBytes);
+    }
+
+    TEST_METHOD(WrapTest)
+    {
+        CRingAllocator ring(1000);
+        td_ringalloc alloc;
+        ring.Allocate(600, 4, alloc);
+
+        // Fits exactly.
+        Assert::IsTrue(ring.Allocate(400, 4, alloc));
+        Assert::AreEqual(static_cast<size_t>(600), alloc.nOffset);
+        Assert::IsFalse(alloc.bDiscard);
+
+        // Never overwrites what was written since the last discard.
+        Assert::IsTrue(ring.Allocate(4, 4, alloc));
+        Assert::AreEqual(static_cast<size_t>(0), alloc.nOffset);
+        Assert::IsTrue(alloc.bDiscard);
+        Assert::IsTrue(ring.Allocate(990, 10, alloc));
+        Assert::AreEqual(static_cast<size_t>(10), alloc.nOffset);
+        Assert::IsFalse(alloc.bDiscard);
+
+        // Alignment past the end wraps too.
+        Assert::IsTrue(ring.Allocate(0, 7, alloc));
+        Assert::IsTrue(alloc.bDiscard);
+
+        // Many frames of draws discard only when the ring is full, that is,
+        // when less than the largest block is left.
+        CRingAllocator frames(64 * 1024);
+        size_t nPrevEnd = 0;
+        for (int i = 0; i < 10000; i++)
+        {
+            size_t nSize = static_cast<size_t>(52) * (1 + i % 97);
+            Assert::IsTrue(frames.Allocate(nSize, 52, alloc));
+            Assert::AreEqual(static_cast<size_t>(0), alloc.nOffset % 52);
+            Assert::IsTrue(alloc.bDiscard ? alloc.nOffset == 0 : alloc.nOffset >= nPrevEnd);
+            Assert::IsTrue(alloc.nOffset + nSize <= frames.GetCapacity());
+            nPrevEnd = alloc.nOffset + nSize;
+        }
+        td_ringallocstats stats;
+        frames.GetStats(stats);
+        Assert::IsTrue(stats.nDiscards <= stats.nBytes / (frames.GetCapacity() - 52 * 97) + 1);
+    }
+
+    TEST_METHOD(GrowTest)
+    {
+        CRingAllocator ring(1024);
+        td_ringalloc alloc;
+        ring.Allocate(512, 4, alloc);
+
+        // Too large for the buffer; the caller makes a larger one.
+        Assert::IsFalse(ring.Allocate(5000, 4, alloc));
+        size_t nCapacity = GrowCapacity(ring.GetCapacity(), 5000);
+        Assert::AreEqual(static_cast<size_t>(8192), nCapacity);
+        ring.Reset(nCapacity);
+        Assert::IsTrue(ring.Allocate(5000, 4, alloc));
+        Assert::AreEqual(static_cast<size_t>(0), alloc.nOffset);
+        Assert::IsTrue(alloc.bDiscard);
+
+        // Growing at least doubles.
+        Assert::AreEqual(static_cast<size_t>(2048), GrowCapacity(1024, 1025));
+        Assert::AreEqual(static_cast<size_t>(1), GrowCapacity(0, 1));
+    }
+};
+} // namespace MilkDrop2
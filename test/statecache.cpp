@@ -0,0 +1,115 @@
+/*
+ * statecache.cpp - Tests for MilkDrop2 library's pipeline state object cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vector>
+#include <vis_milk2/statecache.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(StateCacheTest)
+{
+  private:
+    typedef struct
+    {
+        int nSrc;
+        int nDest;
+        int bEnable;
+    } td_fakedesc;
+
+    // Records what would be created on a device. States are the indices of
+    // their creation, plus one.
+    class CRecordingFactory : public CStateFactory
+    {
+      public:
+        void* CreateState(eStateType type, const void* pDesc) override
+        {
+            const td_fakedesc* p = static_cast<const td_fakedesc*>(pDesc);
+            if (p->nSrc < 0)
+                return nullptr;
+            m_created.push_back(type);
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(m_created.size()));
+        }
+
+        void ReleaseState(eStateType /* type */, void* /* pState */) override { m_nReleased++; }
+
+        std::vector<eStateType> m_created;
+        size_t m_nReleased = 0;
+    };
+
+  public:
+    TEST_METHOD(WarmTest)
+    {
+        CRecordingFactory factory;
+        CStateCache cache(&factory);
+        for (int nSrc = 0; nSrc < 4; nSrc++)
+            for (int nDest = 0; nDest < 4; nDest++)
+                cache.Get(STATE_BLEND, td_fakedesc{nSrc, nDest, 1});
+        cache.Get(STATE_DEPTH_STENCIL, td_fakedesc{0, 0, 1});
+        Assert::AreEqual(static_cast<size_t>(17), factory.m_created.size());
+
+        // Frames that only set warmed up states create nothing.
+        for (int nFrame = 0; nFrame < 100; nFrame++)
+        {
+            cache.Get(STATE_BLEND, td_fakedesc{nFrame % 4, 3 - nFrame % 4, 1});
+            cache.Get(STATE_BLEND, td_fakedesc{1, 2, 1});
+            cache.Get(STATE_DEPTH_STENCIL, td_fakedesc{0, 0, 1});
+        }
+        Assert::AreEqual(static_cast<size_t>(17), factory.m_created.size());
+        td_statecachestats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(17), stats.nEntries);
+        Assert::AreEqual(static_cast<uint64_t>(17), stats.nCreated);
+        Assert::AreEqual(static_cast<uint64_t>(300), stats.nHits);
+    }
+
+    TEST_METHOD(KeyTest)
+    {
+        CRecordingFactory factory;
+        CStateCache cache(&factory);
+        void* pState = cache.Get(STATE_BLEND, td_fakedesc{1, 2, 1});
+        Assert::IsTrue(pState == cache.Get(STATE_BLEND, td_fakedesc{1, 2, 1}));
+
+        // Any other field or kind is another state.
+        Assert::IsTrue(pState != cache.Get(STATE_BLEND, td_fakedesc{2, 2, 1}));
+        Assert::IsTrue(pState != cache.Get(STATE_BLEND, td_fakedesc{1, 3, 1}));
+        Assert::IsTrue(pState != cache.Get(STATE_BLEND, td_fakedesc{1, 2, 0}));
+        Assert::IsTrue(pState != cache.Get(STATE_SAMPLER, td_fakedesc{1, 2, 1}));
+        Assert::AreEqual(static_cast<size_t>(5), factory.m_created.size());
+        Assert::IsTrue(factory.m_created.back() == STATE_SAMPLER);
+
+        // Failures are not cached.
+        Assert::IsNull(cache.Get(STATE_BLEND, td_fakedesc{-1, 0, 1}));
+        Assert::IsNull(cache.Get(STATE_BLEND, td_fakedesc{-1, 0, 1}));
+        td_statecachestats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(5), stats.nEntries);
+    }
+
+    TEST_METHOD(ReleaseTest)
+    {
+        CRecordingFactory factory;
+        {
+            CStateCache cache(&factory);
+            cache.Get(STATE_BLEND, td_fakedesc{1, 2, 1});
+            cache.Get(STATE_RASTERIZER, td_fakedesc{1, 2, 1});
+            cache.Clear();
+            Assert::AreEqual(static_cast<size_t>(2), factory.m_nReleased);
+
+            // Created again after clearing, as after a device loss.
+            cache.Get(STATE_BLEND, td_fakedesc{1, 2, 1});
+            Assert::AreEqual(static_cast<size_t>(3), factory.m_created.size());
+        }
+        Assert::AreEqual(static_cast<size_t>(3), factory.m_nReleased);
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,194 @@
+/*
+ * stateshadow.cpp - Tests for MilkDrop2 library's redundant state filtering.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vector>
+#include <vis_milk2/stateshadow.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(StateShadowTest)
+{
+  private:
+    enum eOp
+    {
+        OP_BIND,
+        OP_DRAW,
+        OP_RENDER_TARGET // unbinds the textures
+    };
+
+    typedef struct
+    {
+        eOp op;
+        eBindPoint bp;
+        unsigned int nSlot;
+        uint64_t nValue;
+        uint64_t nExtra;
+    } td_command;
+
+    // The state of a device that commands are replayed on, and what it
+    // saw at every draw.
+    class CRecordingDevice
+    {
+      public:
+        void Execute(const td_command& cmd)
+        {
+            switch (cmd.op)
+            {
+                case OP_BIND:
+                    m_state[cmd.bp][cmd.nSlot][0] = cmd.nValue;
+                    m_state[cmd.bp][cmd.nSlot][1] = cmd.nExtra;
+                    m_nBinds++;
+                    break;
+                case OP_DRAW:
+                    m_draws.emplace_back(&m_state[0][0][0], &m_state[0][0][0] + sizeof(m_state) / sizeof(uint64_t));
+                    break;
+                case OP_RENDER_TARGET:
+                    for (auto& slot : m_state[BIND_PS_TEXTURE])
+                        slot[0] = slot[1] = 0;
+                    break;
+            }
+        }
+
+        uint64_t m_state[NUM_BIND_POINTS][CStateShadow::MAX_SLOTS][2] = {};
+        std::vector<std::vector<uint64_t>> m_draws;
+        uint64_t m_nBinds = 0;
+    };
+
+    static void Bind(std::vector<td_command>& frame, eBindPoint bp, uint64_t nValue, unsigned int nSlot = 0, uint64_t nExtra = 0)
+    {
+        frame.push_back({OP_BIND, bp, nSlot, nValue, nExtra});
+    }
+
+    static void Draw(std::vector<td_command>& frame) { frame.push_back({OP_DRAW, BIND_VERTEX_BUFFER, 0, 0, 0}); }
+
+    // The binds of a frame the way the renderer issues them: every draw
+    // binds its input assembler state and every pass its shaders,
+    // samplers and blend mode.
+    static std::vector<td_command> CaptureFrame(int nFrame)
+    {
+        std::vector<td_command> frame;
+        auto drawCall = [&frame](uint64_t nStride, uint64_t nTopology) {
+            Bind(frame, BIND_VERTEX_BUFFER, 0x100, 0, nStride);
+            Bind(frame, BIND_INPUT_LAYOUT, 0x200);
+            Bind(frame, BIND_TOPOLOGY, nTopology);
+            Draw(frame);
+        };
+
+        // Warp pass, to the other internal texture.
+        frame.push_back({OP_RENDER_TARGET, BIND_PS_TEXTURE, 0, 0, 0});
+        Bind(frame, BIND_VERTEX_SHADER, 0x300);
+        Bind(frame, BIND_VS_CONSTANTS, 0x400);
+        Bind(frame, BIND_PIXEL_SHADER, 0x500);
+        for (unsigned int i = 0; i < 2; i++)
+            Bind(frame, BIND_PS_SAMPLER, 0x600, i);
+        Bind(frame, BIND_PS_TEXTURE, 0x700 + nFrame % 2);
+        Bind(frame, BIND_BLEND, 0x800);
+        for (int i = 0; i < 4; i++)
+            drawCall(80, 4);
+
+        // Waveforms and shapes, with vertex colors.
+        for (int i = 0; i < 8; i++)
+        {
+            Bind(frame, BIND_VERTEX_SHADER, 0x300);
+            Bind(frame, BIND_VS_CONSTANTS, 0x400);
+            Bind(frame, BIND_PIXEL_SHADER, 0x520);
+            Bind(frame, BIND_BLEND, i % 4 ? 0x810 : 0x800);
+            Bind(frame, BIND_PS_TEXTURE, 0);
+            drawCall(80, i % 2 ? 3 : 5);
+        }
+
+        // Composite pass, to the back buffer.
+        frame.push_back({OP_RENDER_TARGET, BIND_PS_TEXTURE, 0, 0, 0});
+        Bind(frame, BIND_PIXEL_SHADER, 0x540);
+        Bind(frame, BIND_PS_TEXTURE, 0x701 - nFrame % 2);
+        Bind(frame, BIND_PS_SAMPLER, 0x610, 1);
+        Bind(frame, BIND_BLEND, 0x800);
+        drawCall(80, 4);
+        return frame;
+    }
+
+    // Replays `frame` on `device`, through `shadow` if not null.
+    static void Replay(const std::vector<td_command>& frame, CRecordingDevice& device, CStateShadow* shadow)
+    {
+        for (const td_command& cmd : frame)
+        {
+            if (shadow && cmd.op == OP_BIND && !shadow->SetSlot(cmd.bp, cmd.nSlot, cmd.nValue, cmd.nExtra))
+                continue;
+            if (shadow && cmd.op == OP_RENDER_TARGET)
+                shadow->Invalidate(BIND_PS_TEXTURE);
+            device.Execute(cmd);
+        }
+        if (shadow)
+            shadow->EndFrame();
+    }
+
+  public:
+    TEST_METHOD(ReplayTest)
+    {
+        CRecordingDevice all, filtered;
+        CStateShadow shadow;
+        for (int nFrame = 0; nFrame < 3; nFrame++)
+        {
+            std::vector<td_command> frame = CaptureFrame(nFrame);
+            Replay(frame, all, nullptr);
+            Replay(frame, filtered, &shadow);
+        }
+
+        // The device sees the same state at every draw.
+        Assert::AreEqual(all.m_draws.size(), filtered.m_draws.size());
+        for (size_t i = 0; i < all.m_draws.size(); i++)
+            Assert::IsTrue(all.m_draws[i] == filtered.m_draws[i]);
+
+        // With fewer binds.
+        td_stateshadowstats stats;
+        shadow.GetStats(stats);
+        Assert::AreEqual(filtered.m_nBinds, stats.nTotalIssued);
+        Assert::AreEqual(all.m_nBinds, stats.nTotalIssued + stats.nTotalFiltered);
+        Assert::IsTrue(stats.nTotalFiltered > stats.nTotalIssued);
+        Assert::AreEqual(stats.nIssued * 3, stats.nTotalIssued);
+    }
+
+    TEST_METHOD(SlotTest)
+    {
+        CStateShadow shadow;
+
+        // Unknown until first bound.
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, 0, 0));
+        Assert::IsFalse(shadow.SetSlot(BIND_PS_TEXTURE, 0, 0));
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, 1, 0));
+
+        // Both values count.
+        Assert::IsTrue(shadow.Set(BIND_VERTEX_BUFFER, 0x100, 80));
+        Assert::IsTrue(shadow.Set(BIND_VERTEX_BUFFER, 0x100, 28));
+        Assert::IsFalse(shadow.Set(BIND_VERTEX_BUFFER, 0x100, 28));
+
+        // Invalidation of one bind point, then of everything.
+        shadow.Invalidate(BIND_PS_TEXTURE);
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, 1, 0));
+        Assert::IsFalse(shadow.Set(BIND_VERTEX_BUFFER, 0x100, 28));
+        shadow.Invalidate();
+        Assert::IsTrue(shadow.Set(BIND_VERTEX_BUFFER, 0x100, 28));
+
+        // Untracked slots.
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, CStateShadow::MAX_SLOTS, 0));
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, CStateShadow::MAX_SLOTS, 0));
+
+        shadow.EndFrame();
+        td_stateshadowstats stats;
+        shadow.GetStats(stats);
+        Assert::AreEqual(static_cast<uint64_t>(8), stats.nIssued);
+        Assert::AreEqual(static_cast<uint64_t>(3), stats.nFiltered);
+        Assert::IsTrue(shadow.SetSlot(BIND_PS_TEXTURE, 0, 0));
+    }
+};
+} // namespace MilkDrop2
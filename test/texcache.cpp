@@ -0,0 +1,123 @@
+/*
+ * texcache.cpp - Tests for MilkDrop2 library's shader texture cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <string>
+#include <vis_milk2/texcache.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(TextureCacheTest)
+{
+  private:
+    // Stands in for a device texture.
+    typedef struct
+    {
+        int nId;
+    } td_mocktex;
+
+    static inline td_mocktex s_textures[8] = {{0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}};
+
+  public:
+    TEST_METHOD(FindTest)
+    {
+        CTextureCache<td_mocktex*> cache;
+        cache.Insert(L"noise_lq", &s_textures[0], 256, 256, 1, 262144, false, 1);
+        cache.Insert(L"clouds", &s_textures[1], 64, 32, 1, 8192, true, 1);
+        Assert::AreEqual(static_cast<size_t>(2), cache.GetCount());
+        Assert::AreEqual(static_cast<size_t>(1), cache.GetEvictableCount());
+        Assert::AreEqual(static_cast<size_t>(8192), cache.GetEvictableBytes());
+
+        auto* p = cache.Find(L"clouds");
+        Assert::IsNotNull(p);
+        Assert::IsTrue(p->texptr == &s_textures[1]);
+        Assert::AreEqual(32, p->h);
+        Assert::IsTrue(p->szName == L"clouds");
+        Assert::IsNull(cache.Find(L"Clouds"));
+        Assert::IsNull(cache.Find(L"cloud"));
+
+        // Replacing keeps one entry and its accounting.
+        cache.Insert(L"clouds", &s_textures[2], 128, 128, 1, 65536, true, 2);
+        Assert::AreEqual(static_cast<size_t>(2), cache.GetCount());
+        Assert::AreEqual(static_cast<size_t>(65536), cache.GetEvictableBytes());
+        cache.Insert(L"clouds", &s_textures[2], 128, 128, 1, 65536, false, 2);
+        Assert::AreEqual(static_cast<size_t>(0), cache.GetEvictableCount());
+        Assert::AreEqual(static_cast<size_t>(0), cache.GetEvictableBytes());
+
+        int nCount = 0;
+        cache.ForEach([&](CTextureCache<td_mocktex*>::Entry& e) { nCount += e.texptr->nId; });
+        Assert::AreEqual(2, nCount);
+        cache.Clear();
+        Assert::AreEqual(static_cast<size_t>(0), cache.GetCount());
+        Assert::IsNull(cache.Find(L"noise_lq"));
+    }
+
+    TEST_METHOD(EvictTest)
+    {
+        CTextureCache<td_mocktex*> cache;
+        cache.Insert(L"blur1", &s_textures[0], 64, 64, 1, 16384, false, 1);
+        for (int i = 1; i < 6; i++)
+            cache.Insert(L"tex" + std::to_wstring(i), &s_textures[i], 16, 16, 1, 1024 * i, true, i);
+        Assert::AreEqual(static_cast<size_t>(15 * 1024), cache.GetEvictableBytes());
+
+        // Preset 6 uses "tex1" again, so "tex2" is now the oldest.
+        Assert::IsNotNull(cache.Use(L"tex1", 6));
+        Assert::IsNotNull(cache.Use(L"blur1", 6));
+        Assert::IsNull(cache.Use(L"tex9", 6));
+
+        td_mocktex* pEvicted = nullptr;
+        Assert::IsTrue(cache.Evict(5, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[2]);
+        Assert::IsNull(cache.Find(L"tex2"));
+        Assert::IsTrue(cache.Evict(5, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[3]);
+        Assert::IsTrue(cache.Evict(5, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[4]);
+
+        // "tex5" and "tex1" are pinned by presets 5 and 6.
+        Assert::IsFalse(cache.Evict(5, &pEvicted));
+        Assert::AreEqual(static_cast<size_t>(2), cache.GetEvictableCount());
+        Assert::AreEqual(static_cast<size_t>(6 * 1024), cache.GetEvictableBytes());
+        Assert::IsTrue(cache.Evict(7, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[5]);
+        Assert::IsTrue(cache.Evict(7, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[1]);
+
+        // Textures that are not evictable always stay.
+        Assert::IsFalse(cache.Evict(100, &pEvicted));
+        Assert::AreEqual(static_cast<size_t>(1), cache.GetCount());
+        Assert::AreEqual(static_cast<size_t>(0), cache.GetEvictableBytes());
+
+        // The list is rebuilt from scratch after evicting everything.
+        cache.Insert(L"tex6", &s_textures[6], 16, 16, 1, 512, true, 8);
+        cache.Insert(L"tex7", &s_textures[7], 16, 16, 1, 512, true, 8);
+        Assert::IsTrue(cache.Evict(9, &pEvicted));
+        Assert::IsTrue(pEvicted == &s_textures[6]);
+    }
+
+    TEST_METHOD(ManyTest)
+    {
+        CTextureCache<td_mocktex*> cache;
+        for (int i = 0; i < 10000; i++)
+            cache.Insert(L"tex" + std::to_wstring(i), &s_textures[i % 8], 1, 1, 1, 1, true, i);
+        for (int i = 0; i < 10000; i += 2)
+            cache.Use(L"tex" + std::to_wstring(i), 10000);
+        td_mocktex* pEvicted = nullptr;
+        int nEvicted = 0;
+        while (cache.Evict(10000, &pEvicted))
+            nEvicted++;
+        Assert::AreEqual(5000, nEvicted);
+        for (int i = 0; i < 10000; i++)
+            Assert::AreEqual(i % 2 == 0, cache.Find(L"tex" + std::to_wstring(i)) != nullptr);
+        Assert::AreEqual(static_cast<size_t>(5000), cache.GetEvictableBytes());
+    }
+};
+} // namespace MilkDrop2
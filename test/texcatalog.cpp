@@ -0,0 +1,157 @@
+/*
+ * texcatalog.cpp - Tests for MilkDrop2 library's texture directory catalog.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vis_milk2/texcatalog.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(TextureCatalogTest)
+{
+  private:
+    // A directory in memory; the test makes changes through `Add()` and
+    // `Remove()` and counts how often it gets listed.
+    class CMockDirectory : public CTextureDirectory
+    {
+      public:
+        bool List(std::vector<std::wstring>& files) override
+        {
+            m_nLists++;
+            if (!m_bReadable)
+                return false;
+            files = m_files;
+            m_changes.clear();
+            return true;
+        }
+
+        bool PollChanges(std::vector<td_dirchange>& changes) override
+        {
+            if (m_bOverflow)
+            {
+                m_bOverflow = false;
+                m_changes.clear();
+                return false;
+            }
+            changes.insert(changes.end(), m_changes.begin(), m_changes.end());
+            m_changes.clear();
+            return true;
+        }
+
+        void Add(const std::wstring& szName)
+        {
+            m_files.push_back(szName);
+            m_changes.push_back({szName, true});
+        }
+
+        void Remove(const std::wstring& szName)
+        {
+            std::erase(m_files, szName);
+            m_changes.push_back({szName, false});
+        }
+
+        std::vector<std::wstring> m_files;
+        std::vector<td_dirchange> m_changes; // since the last poll
+        int m_nLists = 0;
+        bool m_bReadable = true;
+        bool m_bOverflow = false;
+    };
+
+    static std::vector<std::wstring> PickAll(const CTextureCatalog& catalog, const wchar_t* szPrefix)
+    {
+        std::vector<std::wstring> names;
+        for (uint32_t i = 0; i < catalog.Count(szPrefix); i++)
+            names.push_back(*catalog.Pick(szPrefix, i));
+        return names;
+    }
+
+  public:
+    TEST_METHOD(PrefixTest)
+    {
+        auto pDir = std::make_unique<CMockDirectory>();
+        pDir->m_files = {L"Clouds.jpg", L"clouds2.PNG", L"cloudy.txt", L"fire.dds", L"fireworks.tga", L"readme.txt", L"noext", L"smoke.bmp", L"cl.jpg"};
+        CMockDirectory* pMock = pDir.get();
+        CTextureCatalog catalog;
+        catalog.SetDirectory(std::move(pDir));
+        catalog.Update();
+        catalog.Update();
+        Assert::AreEqual(1, pMock->m_nLists);
+        Assert::AreEqual(static_cast<size_t>(6), catalog.GetCount());
+
+        Assert::IsTrue(PickAll(catalog, L"CLOUD") == std::vector<std::wstring>{L"Clouds.jpg", L"clouds2.PNG"});
+        Assert::IsTrue(PickAll(catalog, L"fire") == std::vector<std::wstring>{L"fire.dds", L"fireworks.tga"});
+        Assert::IsTrue(PickAll(catalog, L"cl") == std::vector<std::wstring>{L"cl.jpg", L"Clouds.jpg", L"clouds2.PNG"});
+        Assert::AreEqual(static_cast<size_t>(6), catalog.Count(L""));
+        Assert::AreEqual(static_cast<size_t>(6), catalog.Count(nullptr));
+        Assert::AreEqual(static_cast<size_t>(0), catalog.Count(L"readme"));
+        Assert::AreEqual(static_cast<size_t>(0), catalog.Count(L"z"));
+        Assert::IsTrue(catalog.Pick(L"z", 0) == nullptr);
+        Assert::IsTrue(*catalog.Pick(L"fire", 3) == L"fireworks.tga");
+    }
+
+    TEST_METHOD(ChangesTest)
+    {
+        auto pDir = std::make_unique<CMockDirectory>();
+        pDir->m_files = {L"a.jpg", L"b.jpg"};
+        CMockDirectory* pMock = pDir.get();
+        CTextureCatalog catalog;
+        catalog.SetDirectory(std::move(pDir));
+        catalog.Update();
+
+        pMock->Add(L"ab.png");
+        pMock->Add(L"ab.png");
+        pMock->Add(L"AB.png");
+        pMock->Add(L"notes.txt");
+        pMock->Remove(L"b.jpg");
+        pMock->Remove(L"missing.jpg");
+        catalog.Update();
+        Assert::AreEqual(1, pMock->m_nLists);
+        Assert::IsTrue(PickAll(catalog, L"a") == std::vector<std::wstring>{L"a.jpg", L"AB.png", L"ab.png"});
+        Assert::AreEqual(static_cast<size_t>(0), catalog.Count(L"b"));
+        pMock->Remove(L"AB.png");
+        catalog.Update();
+        Assert::IsTrue(PickAll(catalog, L"ab") == std::vector<std::wstring>{L"ab.png"});
+
+        // Lost changes make it list the directory again.
+        pMock->m_bOverflow = true;
+        pMock->m_files.push_back(L"c.jpg");
+        catalog.Update();
+        Assert::AreEqual(2, pMock->m_nLists);
+        Assert::AreEqual(static_cast<size_t>(1), catalog.Count(L"c"));
+
+        // An unreadable directory is empty, and listed again next time.
+        pMock->m_bOverflow = true;
+        pMock->m_bReadable = false;
+        catalog.Update();
+        Assert::AreEqual(static_cast<size_t>(0), catalog.GetCount());
+        pMock->m_bReadable = true;
+        catalog.Update();
+        Assert::AreEqual(4, pMock->m_nLists);
+        Assert::AreEqual(static_cast<size_t>(4), catalog.GetCount());
+
+        catalog.SetDirectory(nullptr);
+        catalog.Update();
+        Assert::AreEqual(static_cast<size_t>(0), catalog.GetCount());
+    }
+
+    TEST_METHOD(FileTest)
+    {
+        Assert::IsTrue(IsTextureFile(L"a.JPG"));
+        Assert::IsTrue(IsTextureFile(L"a.b.dib"));
+        Assert::IsFalse(IsTextureFile(L"jpg"));
+        Assert::IsFalse(IsTextureFile(L"a.jpeg"));
+        Assert::IsFalse(IsTextureFile(L"a.jpg.txt"));
+    }
+};
+} // namespace MilkDrop2
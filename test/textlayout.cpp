@@ -0,0 +1,168 @@
+/*
+ * textlayout.cpp - Tests for MilkDrop2 library's text layout cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vis_milk2/textlayout.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(TextLayoutTest)
+{
+  private:
+    // Lays out every character as a square the size of the style's font,
+    // on a single line.
+    class CFakeLayout : public CTextLayout
+    {
+      public:
+        CFakeLayout(size_t nLength, float fSize) : m_nLength(nLength), m_fSize(fSize) {}
+
+        void GetExtents(td_textextents& extents) const override { extents = {0.0f, 0.0f, static_cast<float>(m_nLength) * m_fSize, m_fSize}; }
+
+      private:
+        size_t m_nLength;
+        float m_fSize;
+    };
+
+    class CFakeShaper : public CTextShaper
+    {
+      public:
+        std::unique_ptr<CTextLayout> CreateLayout(std::wstring_view text, void* pStyle, float fWidth, float fHeight) override
+        {
+            m_nLayouts++;
+            if (fWidth <= 0.0f || fHeight <= 0.0f)
+                return nullptr;
+            return std::make_unique<CFakeLayout>(text.size(), *static_cast<const float*>(pStyle));
+        }
+
+        int m_nLayouts = 0;
+    };
+
+  public:
+    TEST_METHOD(HitTest)
+    {
+        CFakeShaper shaper;
+        CTextLayoutCache cache(&shaper);
+        float fSize = 10.0f;
+        for (int i = 0; i < 100; i++)
+        {
+            const CTextLayoutCache::td_entry* pFps = cache.Get(L"60.0 fps", &fSize, 1, 640.0f, 480.0f);
+            const CTextLayoutCache::td_entry* pPreset = cache.Get(L"Geiss - Reaction Diffusion", &fSize, 1, 640.0f, 480.0f);
+            Assert::IsNotNull(pFps);
+            Assert::IsNotNull(pPreset);
+            Assert::AreEqual(80.0f, pFps->extents.fRight);
+            Assert::AreEqual(260.0f, pPreset->extents.fRight);
+            cache.EndFrame();
+        }
+
+        // Shaped once each.
+        Assert::AreEqual(2, shaper.m_nLayouts);
+        td_textlayoutstats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(2), stats.nEntries);
+        Assert::AreEqual(static_cast<uint64_t>(198), stats.nHits);
+        Assert::AreEqual(static_cast<uint64_t>(2), stats.nMisses);
+    }
+
+    TEST_METHOD(KeyTest)
+    {
+        CFakeShaper shaper;
+        CTextLayoutCache cache(&shaper);
+        float fSize = 10.0f, fLarge = 20.0f;
+        const CTextLayoutCache::td_entry* pEntry = cache.Get(L"MilkDrop", &fSize, 1, 640.0f, 480.0f);
+        Assert::IsTrue(pEntry == cache.Get(std::wstring(L"MilkDrop"), &fSize, 1, 640.0f, 480.0f));
+
+        // Another text, style, version of the style or container is another layout.
+        Assert::IsTrue(pEntry != cache.Get(L"MilkDrop 2", &fSize, 1, 640.0f, 480.0f));
+        Assert::AreEqual(160.0f, cache.Get(L"MilkDrop", &fLarge, 2, 640.0f, 480.0f)->extents.fRight);
+        Assert::IsTrue(pEntry != cache.Get(L"MilkDrop", &fSize, 3, 640.0f, 480.0f));
+        Assert::IsTrue(pEntry != cache.Get(L"MilkDrop", &fSize, 1, 320.0f, 480.0f));
+        Assert::IsTrue(pEntry != cache.Get(L"MilkDrop", &fSize, 1, 640.0f, 2048.0f));
+        Assert::AreEqual(6, shaper.m_nLayouts);
+
+        // Failures are not cached.
+        Assert::IsNull(cache.Get(L"MilkDrop", &fSize, 1, 0.0f, 480.0f));
+        Assert::IsNull(cache.Get(L"MilkDrop", &fSize, 1, 0.0f, 480.0f));
+        Assert::AreEqual(8, shaper.m_nLayouts);
+    }
+
+    TEST_METHOD(EvictTest)
+    {
+        CFakeShaper shaper;
+        CTextLayoutCache cache(&shaper);
+        float fSize = 10.0f;
+        std::shared_ptr<CTextLayout> layout = cache.Get(L"Old title", &fSize, 1, 640.0f, 480.0f)->layout;
+        for (uint32_t i = 0; i <= CTextLayoutCache::MAX_AGE; i++)
+        {
+            cache.Get(L"Menu", &fSize, 1, 640.0f, 480.0f);
+            cache.EndFrame();
+        }
+
+        // Not used in the `MAX_AGE` frames after the one it was created in, but
+        // still usable where referenced.
+        td_textlayoutstats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(1), stats.nEntries);
+        Assert::AreEqual(static_cast<uint64_t>(1), stats.nEvicted);
+        td_textextents extents;
+        layout->GetExtents(extents);
+        Assert::AreEqual(90.0f, extents.fRight);
+
+        cache.Get(L"Old title", &fSize, 1, 640.0f, 480.0f);
+        Assert::AreEqual(3, shaper.m_nLayouts);
+        cache.Clear();
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(0), stats.nEntries);
+    }
+
+    TEST_METHOD(DiffTest)
+    {
+        const uint64_t prev[] = {1, 2, 3, 4, 5};
+        td_textdiff diff;
+
+        const uint64_t same[] = {1, 2, 3, 4, 5};
+        Assert::IsFalse(DiffTextLists(same, 5, prev, 5, diff));
+
+        // A changed item.
+        const uint64_t changed[] = {1, 2, 9, 4, 5};
+        Assert::IsTrue(DiffTextLists(changed, 5, prev, 5, diff));
+        Assert::AreEqual(static_cast<size_t>(2), diff.nPrefix);
+        Assert::AreEqual(static_cast<size_t>(3), diff.nCurEnd);
+        Assert::AreEqual(static_cast<size_t>(3), diff.nPrevEnd);
+
+        // Inserted items.
+        const uint64_t inserted[] = {1, 2, 7, 8, 3, 4, 5};
+        Assert::IsTrue(DiffTextLists(inserted, 7, prev, 5, diff));
+        Assert::AreEqual(static_cast<size_t>(2), diff.nPrefix);
+        Assert::AreEqual(static_cast<size_t>(4), diff.nCurEnd);
+        Assert::AreEqual(static_cast<size_t>(2), diff.nPrevEnd);
+
+        // Deleted items, where the suffix could also match the prefix.
+        const uint64_t deleted[] = {1, 5};
+        Assert::IsTrue(DiffTextLists(deleted, 2, prev, 5, diff));
+        Assert::AreEqual(static_cast<size_t>(1), diff.nPrefix);
+        Assert::AreEqual(static_cast<size_t>(1), diff.nCurEnd);
+        Assert::AreEqual(static_cast<size_t>(4), diff.nPrevEnd);
+
+        // Everything is new.
+        Assert::IsTrue(DiffTextLists(prev, 5, nullptr, 0, diff));
+        Assert::AreEqual(static_cast<size_t>(0), diff.nPrefix);
+        Assert::AreEqual(static_cast<size_t>(5), diff.nCurEnd);
+
+        // Text hashes depend on every character.
+        Assert::IsTrue(HashText(L"60.0 fps") != HashText(L"60.1 fps"));
+        Assert::IsTrue(HashCombine(HashText(L"fps"), 1) != HashCombine(HashText(L"fps"), 2));
+    }
+};
+} // namespace MilkDrop2
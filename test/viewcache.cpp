@@ -0,0 +1,136 @@
+/*
+ * viewcache.cpp - Tests for MilkDrop2 library's shader resource view cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstdint>
+#include <vis_milk2/viewcache.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(ViewCacheTest)
+{
+  private:
+    // A reference counted resource, as on a device.
+    typedef struct
+    {
+        int nRefs;
+        bool bFails; // views of it cannot be created
+    } td_fakeresource;
+
+    // A view references its resource, like Direct3D 11 views do.
+    class CMockFactory : public CViewFactory
+    {
+      public:
+        void* CreateView(void* pResource) override
+        {
+            td_fakeresource* pRes = static_cast<td_fakeresource*>(pResource);
+            if (pRes->bFails)
+                return nullptr;
+            m_nCreated++;
+            pRes->nRefs++;
+            return pRes;
+        }
+
+        void ReleaseView(void* pView) override
+        {
+            m_nReleased++;
+            static_cast<td_fakeresource*>(pView)->nRefs--;
+        }
+
+        bool IsOrphaned(void* pResource) override { return static_cast<td_fakeresource*>(pResource)->nRefs <= 1; }
+
+        int m_nCreated = 0;
+        int m_nReleased = 0;
+    };
+
+  public:
+    TEST_METHOD(BindTest)
+    {
+        CMockFactory factory;
+        CViewCache cache(&factory);
+        td_fakeresource blur{1, false}, noise{1, false};
+        cache.Get(&blur); // created with the texture
+        for (int nFrame = 0; nFrame < 100; nFrame++)
+        {
+            Assert::IsTrue(cache.Get(&blur) == &blur);
+            Assert::IsTrue(cache.Get(&noise) == &noise);
+            Assert::AreEqual(static_cast<size_t>(0), cache.Collect());
+        }
+
+        // One view each, for as long as their owners keep them.
+        Assert::AreEqual(2, factory.m_nCreated);
+        Assert::AreEqual(0, factory.m_nReleased);
+        Assert::AreEqual(2, blur.nRefs);
+        td_viewcachestats stats;
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(2), stats.nEntries);
+        Assert::AreEqual(static_cast<uint64_t>(199), stats.nHits);
+
+        // Failures are not cached.
+        td_fakeresource staging{1, true};
+        Assert::IsNull(cache.Get(&staging));
+        Assert::IsNull(cache.Get(&staging));
+        cache.GetStats(stats);
+        Assert::AreEqual(static_cast<size_t>(2), stats.nEntries);
+    }
+
+    TEST_METHOD(LifetimeTest)
+    {
+        CMockFactory factory;
+        td_fakeresource title{1, false}, preset{1, false};
+        {
+            CViewCache cache(&factory);
+            cache.Get(&title);
+            cache.Get(&preset);
+
+            // The owner releases the preset texture; its view keeps it until
+            // the end of the frame.
+            preset.nRefs--;
+            Assert::AreEqual(1, preset.nRefs);
+            Assert::AreEqual(static_cast<size_t>(1), cache.Collect());
+            Assert::AreEqual(0, preset.nRefs);
+            Assert::AreEqual(1, factory.m_nReleased);
+            Assert::AreEqual(static_cast<size_t>(0), cache.Collect());
+
+            // Removed explicitly, then bound again.
+            cache.Remove(&title);
+            Assert::AreEqual(1, title.nRefs);
+            cache.Get(&title);
+            Assert::AreEqual(3, factory.m_nCreated);
+        }
+
+        // Every view created is released.
+        Assert::AreEqual(3, factory.m_nReleased);
+        Assert::AreEqual(1, title.nRefs);
+    }
+
+    TEST_METHOD(InsertTest)
+    {
+        CMockFactory factory;
+        CViewCache cache(&factory);
+        td_fakeresource disk{1, false};
+
+        // A view created by a texture loader.
+        disk.nRefs++;
+        cache.Insert(&disk, &disk);
+        Assert::IsTrue(cache.Get(&disk) == &disk);
+        Assert::AreEqual(0, factory.m_nCreated);
+
+        // Replacing it releases the previous one.
+        disk.nRefs++;
+        cache.Insert(&disk, &disk);
+        Assert::AreEqual(1, factory.m_nReleased);
+        Assert::AreEqual(2, disk.nRefs);
+        cache.Clear();
+        Assert::AreEqual(1, disk.nRefs);
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,172 @@
+/*
+ * warpmesh.cpp - Tests for MilkDrop2 library's warp mesh index lists.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vis_milk2/warpmesh.h>
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace MilkDrop2
+{
+TEST_CLASS(WarpMeshTest)
+{
+  private:
+    // The members of a warp mesh vertex that the seam and culling touch.
+    typedef struct
+    {
+        float x, y;
+        float a;
+        float ang;
+    } td_vertex;
+
+    static constexpr float PI = 3.1415926535897932384626433832795f;
+
+    static std::vector<td_vertex> MakeGrid(int nGridX, int nGridY)
+    {
+        std::vector<td_vertex> verts;
+        for (int y = 0; y <= nGridY; y++)
+        {
+            for (int x = 0; x <= nGridX; x++)
+            {
+                // Alpha opaque, transparent or in between by region, as when
+                // blending presets.
+                int nRegion = (x / 3 + y / 2) % 3;
+                float a = nRegion == 0 ? 0.0f : nRegion == 1 ? 1.0f : 0.5f;
+                verts.push_back({static_cast<float>(x), static_cast<float>(y), a, static_cast<float>(x * 100 + y)});
+            }
+        }
+        return verts;
+    }
+
+    static bool IsNeeded(const td_vertex& v1, const td_vertex& v2, const td_vertex& v3, bool bFlipCulling)
+    {
+        uint32_t d1 = static_cast<uint32_t>(v1.a * 255);
+        uint32_t d2 = static_cast<uint32_t>(v2.a * 255);
+        uint32_t d3 = static_cast<uint32_t>(v3.a * 255);
+        return bFlipCulling ? (d1 & d2 & d3) < 255 : (d1 | d2 | d3) > 0;
+    }
+
+    // The triangles the warp blit drew before the mesh was indexed: the
+    // vertices of each triangle of the list copied out, in two halves, with
+    // the seam's `ang` set for each half.
+    static std::vector<td_vertex> DrawDeindexed(std::vector<td_vertex> verts, int nGridX, int nGridY, bool bCullTiles, bool bFlipCulling)
+    {
+        std::vector<int> list;
+        for (int quadrant = 0; quadrant < 4; quadrant++)
+        {
+            for (int slice = 0; slice < nGridY / 2; slice++)
+            {
+                for (int i = 0; i < nGridX / 2; i++)
+                {
+                    int xref = (quadrant & 1) ? nGridX - 1 - i : i;
+                    int yref = (quadrant & 2) ? nGridY - 1 - slice : slice;
+                    int v = xref + yref * (nGridX + 1);
+                    for (int n : {v, v + 1, v + nGridX + 1, v + 1, v + nGridX + 1, v + nGridX + 2})
+                        list.push_back(n);
+                }
+            }
+        }
+
+        std::vector<td_vertex> drawn;
+        const size_t nHalf = list.size() / 2;
+        for (int half = 0; half < 2; half++)
+        {
+            for (int x = 0; x < nGridX / 2; x++)
+                verts[(nGridY / 2) * (nGridX + 1) + x].ang = half ? PI : -PI;
+            for (size_t i = half * nHalf; i < (half + 1) * nHalf; i += 3)
+            {
+                const td_vertex& v1 = verts[list[i]];
+                const td_vertex& v2 = verts[list[i + 1]];
+                const td_vertex& v3 = verts[list[i + 2]];
+                if (bCullTiles && !IsNeeded(v1, v2, v3, bFlipCulling))
+                    continue;
+                drawn.insert(drawn.end(), {v1, v2, v3});
+            }
+        }
+        return drawn;
+    }
+
+    // The triangles drawn from the indexed mesh, with the copy of the seam.
+    static std::vector<td_vertex> DrawIndexed(const std::vector<td_vertex>& grid, int nGridX, int nGridY, bool bCullTiles, bool bFlipCulling)
+    {
+        std::vector<td_vertex> verts = grid;
+        const size_t nSeamStart = GetWarpSeamStart(nGridX, nGridY);
+        for (size_t x = 0; x < GetWarpSeamCount(nGridX); x++)
+        {
+            verts[nSeamStart + x].ang = -PI;
+            verts.push_back(verts[nSeamStart + x]);
+            verts.back().ang = PI;
+        }
+        Assert::AreEqual(GetWarpVertexCount(nGridX, nGridY), verts.size());
+
+        std::vector<uint16_t> indices;
+        BuildWarpIndices(nGridX, nGridY, indices);
+        Assert::AreEqual(static_cast<size_t>(nGridX) * nGridY * 6, indices.size());
+        if (bCullTiles)
+        {
+            std::vector<uint16_t> culled(indices.size());
+            culled.resize(CullTriangles(indices.data(), indices.size(), &verts[0].a, sizeof(td_vertex) / sizeof(float), bFlipCulling, culled.data()));
+            indices = culled;
+        }
+
+        std::vector<td_vertex> drawn;
+        for (uint16_t n : indices)
+        {
+            Assert::IsTrue(n < verts.size());
+            drawn.push_back(verts[n]);
+        }
+        return drawn;
+    }
+
+    static void AssertSameTriangles(const std::vector<td_vertex>& expected, const std::vector<td_vertex>& actual)
+    {
+        Assert::AreEqual(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            Assert::AreEqual(expected[i].x, actual[i].x);
+            Assert::AreEqual(expected[i].y, actual[i].y);
+            Assert::AreEqual(expected[i].a, actual[i].a);
+            Assert::AreEqual(expected[i].ang, actual[i].ang);
+        }
+    }
+
+  public:
+    TEST_METHOD(SameTrianglesTest)
+    {
+        const int sizes[][2] = {{8, 6}, {48, 36}, {192, 144}};
+        for (const auto& size : sizes)
+        {
+            std::vector<td_vertex> grid = MakeGrid(size[0], size[1]);
+            AssertSameTriangles(DrawDeindexed(grid, size[0], size[1], false, false), DrawIndexed(grid, size[0], size[1], false, false));
+        }
+    }
+
+    TEST_METHOD(CullTest)
+    {
+        std::vector<td_vertex> grid = MakeGrid(48, 36);
+        std::vector<td_vertex> all = DrawIndexed(grid, 48, 36, false, false);
+        for (bool bFlipCulling : {false, true})
+        {
+            std::vector<td_vertex> drawn = DrawIndexed(grid, 48, 36, true, bFlipCulling);
+            AssertSameTriangles(DrawDeindexed(grid, 48, 36, true, bFlipCulling), drawn);
+            Assert::IsTrue(drawn.size() < all.size());
+            Assert::IsTrue(drawn.size() > 0);
+        }
+
+        // Nothing to draw when the mesh is entirely blended out.
+        for (td_vertex& v : grid)
+            v.a = 0.0f;
+        Assert::AreEqual(static_cast<size_t>(0), DrawIndexed(grid, 48, 36, true, false).size());
+        Assert::AreEqual(all.size(), DrawIndexed(grid, 48, 36, true, true).size());
+    }
+};
+} // namespace MilkDrop2
@@ -0,0 +1,136 @@
+/*
+ * avsync.cpp - Audio to display latency estimator.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "avsync.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+constexpr int64_t kMaxDelay = 500000000;      // 500 ms
+constexpr int64_t kMaxCorrection = 100000000; // 100 ms
+constexpr uint32_t kMaxRefreshGap = 120;      // refreshes between reports to measure the interval over
+
+float ToMs(int64_t ns)
+{
+    return static_cast<float>(static_cast<double>(ns) * 1e-6);
+}
+
+// Moving average with weight 1/8, starting at the first sample.
+int64_t Average(int64_t nAverage, int64_t nSample)
+{
+    return nAverage ? nAverage + (nSample - nAverage) / 8 : nSample;
+}
+} // namespace
+
+CAudioSyncEstimator::CAudioSyncEstimator() : m_nOffset(0), m_fQueuePrior(1.0f), m_predictions{}, m_errors{}
+{
+    Reset();
+}
+
+void CAudioSyncEstimator::Reset()
+{
+    m_nFrameStart = 0;
+    m_nFrameShowTime = 0;
+    m_nLastFrameEnd = 0;
+    m_nRenderTime = 0;
+    m_nFrameInterval = 0;
+    m_nRefreshInterval = 0;
+    m_fQueueDepth = -1.0f;
+    m_nCorrection = 0;
+    m_bShown = false;
+    m_nLastShownId = 0;
+    m_nLastShownRefresh = 0;
+    m_nLastShownTime = 0;
+    m_predictions.fill({0, 0, false});
+    m_nErrors = 0;
+}
+
+int64_t CAudioSyncEstimator::GetPredictedDelay() const
+{
+    float fQueue = m_fQueueDepth >= 0.0f ? m_fQueueDepth : m_fQueuePrior;
+    int64_t nRefresh = m_nRefreshInterval ? m_nRefreshInterval : m_nFrameInterval;
+    int64_t nDelay = m_nRenderTime + static_cast<int64_t>((fQueue + 0.5f) * static_cast<float>(nRefresh)) + m_nCorrection;
+    return std::clamp(nDelay, static_cast<int64_t>(0), kMaxDelay);
+}
+
+int64_t CAudioSyncEstimator::BeginFrame(int64_t nNow)
+{
+    int64_t nDelay = GetPredictedDelay();
+    m_nFrameStart = nNow;
+    m_nFrameShowTime = nNow + nDelay;
+    return nDelay + m_nOffset;
+}
+
+void CAudioSyncEstimator::EndFrame(int64_t nNow, uint32_t nPresentId)
+{
+    if (m_nLastFrameEnd)
+        m_nFrameInterval = Average(m_nFrameInterval, nNow - m_nLastFrameEnd);
+    m_nLastFrameEnd = nNow;
+    if (!m_nFrameStart)
+        return;
+    m_nRenderTime = Average(m_nRenderTime, nNow - m_nFrameStart);
+    m_nFrameStart = 0;
+
+    // Presented but not shown yet, not counting this frame.
+    if (m_bShown)
+    {
+        int32_t nQueued = std::max(static_cast<int32_t>(nPresentId - m_nLastShownId) - 1, 0);
+        float fQueued = static_cast<float>(nQueued);
+        m_fQueueDepth = m_fQueueDepth >= 0.0f ? m_fQueueDepth + (fQueued - m_fQueueDepth) / 8.0f : fQueued;
+    }
+
+    m_predictions[nPresentId & (NUM_FRAMES - 1)] = {nPresentId, m_nFrameShowTime, true};
+}
+
+void CAudioSyncEstimator::OnDisplayed(uint32_t nPresentId, uint32_t nRefresh, int64_t nTime)
+{
+    if (m_bShown && nPresentId == m_nLastShownId)
+        return;
+
+    if (m_bShown && nRefresh != m_nLastShownRefresh && nRefresh - m_nLastShownRefresh <= kMaxRefreshGap && nTime > m_nLastShownTime)
+        m_nRefreshInterval = Average(m_nRefreshInterval, (nTime - m_nLastShownTime) / static_cast<int64_t>(nRefresh - m_nLastShownRefresh));
+    m_bShown = true;
+    m_nLastShownId = nPresentId;
+    m_nLastShownRefresh = nRefresh;
+    m_nLastShownTime = nTime;
+
+    td_prediction& prediction = m_predictions[nPresentId & (NUM_FRAMES - 1)];
+    if (!prediction.bPending || prediction.nPresentId != nPresentId)
+        return;
+    prediction.bPending = false;
+    int64_t nError = nTime - prediction.nShowTime;
+    m_errors[m_nErrors++ & (NUM_FRAMES - 1)] = nError;
+    m_nCorrection = std::clamp(m_nCorrection + nError / 8, -kMaxCorrection, kMaxCorrection);
+}
+
+void CAudioSyncEstimator::GetStats(td_avsyncstats& stats) const
+{
+    size_t nFrames = static_cast<size_t>(std::min<uint64_t>(m_nErrors, NUM_FRAMES));
+    std::vector<int64_t> magnitudes(nFrames);
+    int64_t nSum = 0;
+    for (size_t i = 0; i < nFrames; i++)
+    {
+        nSum += m_errors[i];
+        magnitudes[i] = std::abs(m_errors[i]);
+    }
+    stats.nFrames = nFrames;
+    stats.fRenderTime = ToMs(m_nRenderTime);
+    stats.fQueueDepth = m_fQueueDepth >= 0.0f ? m_fQueueDepth : m_fQueuePrior;
+    stats.fRefreshInterval = ToMs(m_nRefreshInterval ? m_nRefreshInterval : m_nFrameInterval);
+    stats.fDelay = ToMs(GetPredictedDelay());
+    stats.fErrorMean = nFrames ? ToMs(nSum / static_cast<int64_t>(nFrames)) : 0.0f;
+    stats.fErrorP95 = 0.0f;
+    if (nFrames)
+    {
+        size_t n = std::min(nFrames - 1, nFrames * 95 / 100);
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + static_cast<ptrdiff_t>(n), magnitudes.end());
+        stats.fErrorP95 = ToMs(magnitudes[n]);
+    }
+}
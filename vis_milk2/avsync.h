@@ -0,0 +1,105 @@
+/*
+ * avsync.h - Audio to display latency estimator header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Estimated latency, in milliseconds.
+typedef struct
+{
+    size_t nFrames;         // shown frames with a measured error in the history
+    float fRenderTime;      // from fetching the audio to presenting the frame
+    float fQueueDepth;      // frames waiting in the swap chain ahead of a new one
+    float fRefreshInterval; // of the display, or between frames if unknown
+    float fDelay;           // predicted, from fetching the audio to the frame being shown
+    float fErrorMean;       // of the time a frame was shown minus the prediction
+    float fErrorP95;        // of the absolute error
+} td_avsyncstats;
+
+// Predicts when a frame being rendered will be shown, so that the audio it
+// visualizes is the audio heard at that moment rather than when it was
+// fetched.
+//
+// The delay is the time spent rendering, a moving average of recent frames,
+// plus the time the presented frame waits in the swap chain: the frames
+// queued ahead of it and half a refresh on average before the next one.
+// The queue depth and refresh interval are measured from the times at which
+// the display reports frames as shown, when it does. Those reports are
+// also compared to the prediction for each frame; the mean error corrects
+// the next predictions and is available as a measure of the sync.
+//
+// Times are in nanoseconds on the clock the caller uses for all of them.
+class CAudioSyncEstimator
+{
+  public:
+    static constexpr size_t NUM_FRAMES = 64; // history of predictions; must be a power of 2
+
+    CAudioSyncEstimator();
+
+    // Frames assumed to wait in the swap chain until the display reports
+    // when frames are shown.
+    void SetQueueDepth(int nFrames) { m_fQueuePrior = static_cast<float>(nFrames); }
+
+    // Added to the delay returned by `BeginFrame()`: negative to show
+    // earlier audio, for outputs that are heard later than the player
+    // reports, such as wireless speakers.
+    void SetOffset(int64_t nOffset) { m_nOffset = nOffset; }
+
+    // Call when fetching the audio of a frame. Returns how long after
+    // `nNow` the frame should be shown, plus the offset: the audio to fetch
+    // is the audio that plays that much later.
+    int64_t BeginFrame(int64_t nNow);
+
+    // Call once the frame was presented, as the swap chain's present number
+    // `nPresentId`, after passing on what the display reported since.
+    void EndFrame(int64_t nNow, uint32_t nPresentId);
+
+    // Call with what the display reports: present `nPresentId` was shown at
+    // `nTime`, on refresh `nRefresh`. Repeated reports are ignored.
+    void OnDisplayed(uint32_t nPresentId, uint32_t nRefresh, int64_t nTime);
+
+    // Forgets all measurements, for example after the swap chain was
+    // re-created.
+    void Reset();
+
+    // Without the offset.
+    int64_t GetPredictedDelay() const;
+
+    void GetStats(td_avsyncstats& stats) const;
+
+  private:
+    typedef struct
+    {
+        uint32_t nPresentId;
+        int64_t nShowTime; // predicted
+        bool bPending;     // not reported as shown yet
+    } td_prediction;
+
+    int64_t m_nOffset;
+    float m_fQueuePrior;
+
+    int64_t m_nFrameStart;      // 0 outside of a frame
+    int64_t m_nFrameShowTime;   // predicted for the frame being rendered
+    int64_t m_nLastFrameEnd;    // 0 before the first frame
+    int64_t m_nRenderTime;      // 0 until measured
+    int64_t m_nFrameInterval;   // 0 until measured
+    int64_t m_nRefreshInterval; // 0 until measured
+    float m_fQueueDepth;        // negative until measured
+    int64_t m_nCorrection;      // mean error of past predictions
+
+    bool m_bShown; // a frame was reported as shown
+    uint32_t m_nLastShownId;
+    uint32_t m_nLastShownRefresh;
+    int64_t m_nLastShownTime;
+
+    std::array<td_prediction, NUM_FRAMES> m_predictions; // by present number
+    std::array<int64_t, NUM_FRAMES> m_errors;
+    uint64_t m_nErrors; // recorded so far
+};
@@ -14,6 +14,7 @@
 #include <DirectXHelpers.h>
 #include <DDSTextureLoader.h>
 #include <WICTextureLoader.h>
+#include <wincodec.h>
 #include "support.h"
 #include "utility.h"
 
@@ -26,8 +27,97 @@ namespace
 #include <texture0ps.inc>
 #include <colorps.inc>
 #include <texture1ps.inc>
+
+uint64_t Handle(const void* p)
+{
+    return reinterpret_cast<uintptr_t>(p);
 }
 
+// Blending is done the same way on alpha as on color. Color factors are
+// mapped to the matching alpha factors, which alpha blending requires.
+D3D11_BLEND_DESC BlendDesc(bool bEnable, D3D11_BLEND srcBlend, D3D11_BLEND destBlend)
+{
+    // Factors do not matter when blending is disabled; normalize them so
+    // that all disabled states share one object.
+    if (!bEnable)
+    {
+        srcBlend = D3D11_BLEND_ONE;
+        destBlend = D3D11_BLEND_ZERO;
+    }
+
+    D3D11_BLEND srcAlphaBlend = srcBlend;
+    D3D11_BLEND destAlphaBlend = destBlend;
+
+    if (srcBlend == D3D11_BLEND_SRC_COLOR || srcBlend == D3D11_BLEND_INV_SRC_COLOR)
+        srcAlphaBlend = static_cast<D3D11_BLEND>(srcAlphaBlend + 2);
+    else if (srcBlend == D3D11_BLEND_DEST_COLOR || srcBlend == D3D11_BLEND_INV_DEST_COLOR)
+        srcAlphaBlend = static_cast<D3D11_BLEND>(srcAlphaBlend - 2);
+
+    if (destBlend == D3D11_BLEND_SRC_COLOR || destBlend == D3D11_BLEND_INV_SRC_COLOR)
+        destAlphaBlend = static_cast<D3D11_BLEND>(destAlphaBlend + 2);
+    else if (destBlend == D3D11_BLEND_DEST_COLOR || destBlend == D3D11_BLEND_INV_DEST_COLOR)
+        destAlphaBlend = static_cast<D3D11_BLEND>(destAlphaBlend - 2);
+
+    D3D11_BLEND_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.RenderTarget[0].BlendEnable = bEnable;
+    desc.RenderTarget[0].SrcBlend = srcBlend;
+    desc.RenderTarget[0].DestBlend = destBlend;
+    desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+    desc.RenderTarget[0].SrcBlendAlpha = srcAlphaBlend;
+    desc.RenderTarget[0].DestBlendAlpha = destAlphaBlend;
+    desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+    desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    return desc;
+}
+
+// As DirectX Tool Kit's `CommonStates::DepthDefault()` and `DepthNone()`.
+D3D11_DEPTH_STENCIL_DESC DepthDesc(bool bEnabled)
+{
+    D3D11_DEPTH_STENCIL_DESC desc;
+    ZeroMemory(&desc, sizeof(desc)); // has padding
+    desc.DepthEnable = bEnabled;
+    desc.DepthWriteMask = bEnabled ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+    desc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+    desc.StencilEnable = FALSE;
+    desc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+    desc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+    desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+    desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+    desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+    desc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+    desc.BackFace = desc.FrontFace;
+    return desc;
+}
+
+// As `CommonStates::CullNone()` and its siblings, for any combination.
+D3D11_RASTERIZER_DESC RasterizerDesc(D3D11_CULL_MODE cullMode, D3D11_FILL_MODE fillMode)
+{
+    D3D11_RASTERIZER_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.CullMode = cullMode;
+    desc.FillMode = fillMode;
+    desc.DepthClipEnable = TRUE;
+    desc.MultisampleEnable = TRUE;
+    return desc;
+}
+
+// As `CommonStates::PointWrap()` and its siblings, for any combination.
+D3D11_SAMPLER_DESC SamplerDesc(D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE addressMode, D3D_FEATURE_LEVEL featureLevel)
+{
+    D3D11_SAMPLER_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.Filter = filter;
+    desc.AddressU = addressMode;
+    desc.AddressV = addressMode;
+    desc.AddressW = addressMode;
+    desc.MaxAnisotropy = featureLevel > D3D_FEATURE_LEVEL_9_1 ? D3D11_MAX_MAXANISOTROPY : 2;
+    desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    desc.MaxLOD = D3D11_FLOAT32_MAX;
+    return desc;
+}
+} // namespace
+
 D3D11Shim::D3D11Shim(ID3D11Device* pDevice, ID3D11DeviceContext* pContext) :
     m_pDevice(pDevice),
     m_pContext(pContext),
@@ -37,10 +127,13 @@ D3D11Shim::D3D11Shim(ID3D11Device* pDevice, ID3D11DeviceContext* pContext) :
     m_pVBuffer(nullptr),
     m_pIBuffer(nullptr),
     m_pIFanBuffer(nullptr),
+    m_vertexRing(0),
+    m_indexRing(0),
     m_pCBuffer(nullptr),
     m_bCBufferIsDirty(false),
     m_uCurrShader(0),
-    m_pState(nullptr),
+    m_stateCache(this),
+    m_viewCache(this),
     m_transforms({})
 {
     for (size_t i = 0; i < MAX_NUM_SHADERS; i++)
@@ -57,14 +150,14 @@ D3D11Shim::~D3D11Shim()
     SafeRelease(m_pIBuffer);
     SafeRelease(m_pIFanBuffer);
     SafeRelease(m_pCBuffer);
-    SafeRelease(m_pState);
     SafeRelease(m_pImmContext);
-    m_states.reset();
+    m_stateCache.Clear();
+    m_viewCache.Clear();
 }
 
 void D3D11Shim::Initialize()
 {
-    m_states = std::make_unique<CommonStates>(m_pDevice);
+    WarmStateCache();
 
     // Note: These must match layouts in "support.h"!
     D3D11_INPUT_ELEMENT_DESC MilkDropLayout[] = {
@@ -94,15 +187,17 @@ void D3D11Shim::Initialize()
     m_pDevice->CreatePixelShader(colorpsCode, sizeof(colorpsCode), NULL, &m_pPShader[2]);
     m_pDevice->CreatePixelShader(texture1psCode, sizeof(texture1psCode), NULL, &m_pPShader[3]);
 
-    CD3D11_BUFFER_DESC bDesc(sizeof(MDVERTEX) * MAX_VERTICES_COUNT, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+    CD3D11_BUFFER_DESC bDesc(VERTEX_RING_SIZE, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
     m_pDevice->CreateBuffer(&bDesc, NULL, &m_pVBuffer);
+    m_vertexRing.Reset(VERTEX_RING_SIZE);
 
-    bDesc.ByteWidth = sizeof(uint16_t) * MAX_INDICES_COUNT;
+    bDesc.ByteWidth = INDEX_RING_SIZE;
     bDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
     m_pDevice->CreateBuffer(&bDesc, NULL, &m_pIBuffer);
+    m_indexRing.Reset(INDEX_RING_SIZE);
 
     std::vector<uint16_t> indices;
-    for (size_t i = 1; i < MAX_VERTICES_COUNT / 6 - 2; ++i)
+    for (size_t i = 1; i <= FAN_TRIANGLES_COUNT; ++i)
     {
         indices.push_back(0);
         indices.push_back(static_cast<uint16_t>(i));
@@ -131,6 +226,17 @@ void D3D11Shim::Initialize()
     m_pDevice->GetImmediateContext(&m_pImmContext);
 }
 
+void D3D11Shim::EndFrame()
+{
+    m_viewCache.Collect();
+    m_shadow.EndFrame();
+}
+
+void D3D11Shim::InvalidateState()
+{
+    m_shadow.Invalidate();
+}
+
 bool D3D11Shim::CreateTexture(unsigned int uWidth, unsigned int uHeight, unsigned int mipLevels, UINT bindFlags, DXGI_FORMAT format,
                               ID3D11Texture2D** ppTexture, unsigned int miscFlags, D3D11_USAGE usage)
 {
@@ -141,7 +247,11 @@ bool D3D11Shim::CreateTexture(unsigned int uWidth, unsigned int uHeight, unsigne
     if (usage == D3D11_USAGE_STAGING)
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE /*| D3D11_CPU_ACCESS_READ*/;
 
-    return (S_OK == m_pDevice->CreateTexture2D(&texDesc, NULL, ppTexture));
+    if (S_OK != m_pDevice->CreateTexture2D(&texDesc, NULL, ppTexture))
+        return false;
+    if (bindFlags & D3D11_BIND_SHADER_RESOURCE)
+        m_viewCache.Get(static_cast<ID3D11Resource*>(*ppTexture));
+    return true;
 }
 
 bool D3D11Shim::CreateVolumeTexture(unsigned int uWidth, unsigned int uHeight, unsigned int uDepth, unsigned int mipLevels, UINT bindFlags,
@@ -154,65 +264,88 @@ bool D3D11Shim::CreateVolumeTexture(unsigned int uWidth, unsigned int uHeight, u
     if (usage == D3D11_USAGE_STAGING)
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ;
 
-    return (S_OK == m_pDevice->CreateTexture3D(&texDesc, NULL, ppTexture));
+    if (S_OK != m_pDevice->CreateTexture3D(&texDesc, NULL, ppTexture))
+        return false;
+    if (bindFlags & D3D11_BIND_SHADER_RESOURCE)
+        m_viewCache.Get(static_cast<ID3D11Resource*>(*ppTexture));
+    return true;
 }
 
 void D3D11Shim::DrawPrimitive(unsigned int primType, unsigned int iPrimCount, const void* pVData, unsigned int vertexStride)
 {
-    if (m_bCBufferIsDirty)
-    {
-        D3D11_MAPPED_SUBRESOURCE res{};
-        if (S_OK == m_pContext->Map(m_pCBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
-        {
-            memcpy(res.pData, &m_transforms, sizeof(cbTransforms));
-            m_pContext->Unmap(m_pCBuffer, 0);
-        }
-        m_bCBufferIsDirty = false;
-    }
+    UpdateCBuffer();
 
     int numVerts = NumVertsFromType(primType, iPrimCount);
-    UpdateVBuffer(numVerts, pVData, vertexStride);
+    UINT uBaseVertex;
+    if (numVerts <= 0 || !UpdateVBuffer(numVerts, pVData, vertexStride, uBaseVertex))
+        return;
 
-    unsigned int offsets = 0;
-    m_pContext->IASetVertexBuffers(0, 1, &m_pVBuffer, &vertexStride, &offsets);
-    m_pContext->IASetInputLayout(m_pInputLayout);
+    BindVertexBuffer(m_pVBuffer, vertexStride);
     if (primType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLEFAN)
     {
-        m_pContext->IASetIndexBuffer(m_pIFanBuffer, DXGI_FORMAT_R16_UINT, 0);
-        m_pContext->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        m_pContext->DrawIndexed(iPrimCount * 3, 0, 0);
+        UINT uStartIndex = 0;
+        if (iPrimCount <= FAN_TRIANGLES_COUNT)
+            BindIndexBuffer(m_pIFanBuffer);
+        else
+        {
+            // Longer than the fans the fan index buffer has indices for.
+            std::vector<uint16_t> indices(static_cast<size_t>(iPrimCount) * 3);
+            for (size_t i = 0; i < iPrimCount; i++)
+            {
+                indices[3 * i + 1] = static_cast<uint16_t>(i + 1);
+                indices[3 * i + 2] = static_cast<uint16_t>(i + 2);
+            }
+            if (!UpdateIBuffer(static_cast<unsigned int>(indices.size()), indices.data(), uStartIndex))
+                return;
+            BindIndexBuffer(m_pIBuffer);
+        }
+        BindTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        m_pContext->DrawIndexed(iPrimCount * 3, uStartIndex, uBaseVertex);
     }
     else
     {
-        m_pContext->IASetPrimitiveTopology(static_cast<D3D_PRIMITIVE_TOPOLOGY>(primType));
-        m_pContext->Draw(numVerts, 0);
+        BindTopology(static_cast<D3D_PRIMITIVE_TOPOLOGY>(primType));
+        m_pContext->Draw(numVerts, uBaseVertex);
     }
 }
 
 void D3D11Shim::DrawIndexedPrimitive(unsigned int primType, unsigned int uStartVertex, unsigned int iNumVertices, unsigned int iPrimCount,
                                      const void* pIData, const void* pVData, unsigned int vertexStride)
 {
-    if (m_bCBufferIsDirty)
-    {
-        D3D11_MAPPED_SUBRESOURCE res;
-        if (SUCCEEDED(m_pContext->Map(m_pCBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &res)))
-        {
-            memcpy(res.pData, &m_transforms, sizeof(cbTransforms));
-            m_pContext->Unmap(m_pCBuffer, 0);
-        }
-        m_bCBufferIsDirty = false;
-    }
+    UpdateCBuffer();
 
     int numIndices = NumVertsFromType(primType, iPrimCount);
-    UpdateVBuffer(iNumVertices, pVData, vertexStride);
-    UpdateIBuffer(numIndices, pIData);
+    UINT uBaseVertex, uStartIndex;
+    if (numIndices <= 0 || !UpdateVBuffer(iNumVertices, pVData, vertexStride, uBaseVertex) || !UpdateIBuffer(numIndices, pIData, uStartIndex))
+        return;
+
+    BindVertexBuffer(m_pVBuffer, vertexStride);
+    BindIndexBuffer(m_pIBuffer);
+    BindTopology(static_cast<D3D_PRIMITIVE_TOPOLOGY>(primType));
+    m_pContext->DrawIndexed(numIndices, uStartIndex, uBaseVertex + uStartVertex);
+}
+
+bool D3D11Shim::CreateIndexBuffer(const uint16_t* pIData, unsigned int iNumIndices, ID3D11Buffer** ppBuffer)
+{
+    CD3D11_BUFFER_DESC bDesc(static_cast<UINT>(sizeof(uint16_t) * iNumIndices), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+    D3D11_SUBRESOURCE_DATA bData = {pIData};
+    return iNumIndices > 0 && SUCCEEDED(m_pDevice->CreateBuffer(&bDesc, &bData, ppBuffer));
+}
+
+// Draws a triangle list whose indices are in `pIBuffer`, uploading only the
+// vertices.
+void D3D11Shim::DrawIndexedMesh(ID3D11Buffer* pIBuffer, unsigned int iNumIndices, unsigned int iNumVertices, const void* pVData, unsigned int vertexStride)
+{
+    UpdateCBuffer();
 
-    unsigned int offsets = 0;
-    m_pContext->IASetVertexBuffers(0, 1, &m_pVBuffer, &vertexStride, &offsets);
-    m_pContext->IASetIndexBuffer(m_pIBuffer, DXGI_FORMAT_R16_UINT, 0);
-    m_pContext->IASetInputLayout(m_pInputLayout);
-    m_pContext->IASetPrimitiveTopology((D3D_PRIMITIVE_TOPOLOGY)primType);
-    m_pContext->DrawIndexed(numIndices, 0, uStartVertex);
+    UINT uBaseVertex;
+    if (!pIBuffer || iNumIndices == 0 || !UpdateVBuffer(iNumVertices, pVData, vertexStride, uBaseVertex))
+        return;
+
+    BindVertexBuffer(m_pVBuffer, vertexStride);
+    BindIndexBuffer(pIBuffer);
+    BindTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_pContext->DrawIndexed(iNumIndices, 0, uBaseVertex);
 }
 
 void D3D11Shim::GetRenderTarget(ID3D11Texture2D** ppTexture)
@@ -243,67 +376,22 @@ void D3D11Shim::GetViewport(D3D11_VIEWPORT* vp)
 
 void D3D11Shim::SetBlendState(bool bEnable, D3D11_BLEND srcBlend, D3D11_BLEND destBlend)
 {
-    if (m_pState)
-    {
-        m_pState->Release();
-        m_pState = nullptr;
-    }
-
-    D3D11_BLEND_DESC desc{};
-    desc.RenderTarget[0].BlendEnable = bEnable; //(srcBlend != D3D11_BLEND_ONE) || (destBlend != D3D11_BLEND_ZERO);
-    desc.RenderTarget[0].SrcBlend = srcBlend;
-    desc.RenderTarget[0].DestBlend = destBlend;
-    desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-
-    D3D11_BLEND srcAlphaBlend = srcBlend;
-    D3D11_BLEND destAlphaBlend = destBlend;
-
-    if (srcBlend == D3D11_BLEND_SRC_COLOR || srcBlend == D3D11_BLEND_INV_SRC_COLOR)
-        srcAlphaBlend = static_cast<D3D11_BLEND>(srcAlphaBlend + 2);
-    else if (srcBlend == D3D11_BLEND_DEST_COLOR || srcBlend == D3D11_BLEND_INV_DEST_COLOR)
-        srcAlphaBlend = static_cast<D3D11_BLEND>(srcAlphaBlend - 2);
-
-    if (destBlend == D3D11_BLEND_SRC_COLOR || destBlend == D3D11_BLEND_INV_SRC_COLOR)
-        destAlphaBlend = static_cast<D3D11_BLEND>(destAlphaBlend + 2);
-    else if (destBlend == D3D11_BLEND_DEST_COLOR || destBlend == D3D11_BLEND_INV_DEST_COLOR)
-        destAlphaBlend = static_cast<D3D11_BLEND>(destAlphaBlend - 2);
-
-    desc.RenderTarget[0].SrcBlendAlpha = srcAlphaBlend;
-    desc.RenderTarget[0].DestBlendAlpha = destAlphaBlend;
-    desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-    desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-
-    if (SUCCEEDED(m_pDevice->CreateBlendState(&desc, &m_pState)))
-        m_pContext->OMSetBlendState(m_pState, 0, 0xFFFFFFFF);
+    ID3D11BlendState* pState = static_cast<ID3D11BlendState*>(m_stateCache.Get(STATE_BLEND, BlendDesc(bEnable, srcBlend, destBlend)));
+    if (pState && m_shadow.Set(BIND_BLEND, Handle(pState)))
+        m_pContext->OMSetBlendState(pState, 0, 0xFFFFFFFF);
 }
 
 void D3D11Shim::SetDepth(bool bEnabled)
 {
-    ID3D11DepthStencilState* pState = bEnabled ? m_states->DepthDefault() : m_states->DepthNone();
-    if (pState)
+    ID3D11DepthStencilState* pState = static_cast<ID3D11DepthStencilState*>(m_stateCache.Get(STATE_DEPTH_STENCIL, DepthDesc(bEnabled)));
+    if (pState && m_shadow.Set(BIND_DEPTH_STENCIL, Handle(pState)))
         m_pContext->OMSetDepthStencilState(pState, 0);
 }
 
 void D3D11Shim::SetRasterizerState(D3D11_CULL_MODE cullMode, D3D11_FILL_MODE fillMode)
 {
-    ID3D11RasterizerState* pState = nullptr;
-
-    if (fillMode == D3D11_FILL_SOLID)
-    {
-        if (cullMode == D3D11_CULL_NONE)
-            pState = m_states->CullNone();
-        if (cullMode == D3D11_CULL_FRONT)
-            pState = m_states->CullClockwise();
-        if (cullMode == D3D11_CULL_BACK)
-            pState = m_states->CullCounterClockwise();
-    }
-    else if (fillMode == D3D11_FILL_WIREFRAME)
-    {
-        if (cullMode == D3D11_CULL_NONE)
-            pState = m_states->Wireframe();
-    }
-
-    if (pState)
+    ID3D11RasterizerState* pState = static_cast<ID3D11RasterizerState*>(m_stateCache.Get(STATE_RASTERIZER, RasterizerDesc(cullMode, fillMode)));
+    if (pState && m_shadow.Set(BIND_RASTERIZER, Handle(pState)))
         m_pContext->RSSetState(pState);
 }
 
@@ -331,6 +419,9 @@ void D3D11Shim::SetRenderTarget(ID3D11Texture2D* pTexture, ID3D11DepthStencilVie
 
     m_pContext->OMSetRenderTargets(1, &pRTView, pDSView);
 
+    // The device unbinds textures that are now bound as the render target.
+    m_shadow.Invalidate(BIND_PS_TEXTURE);
+
     SafeRelease(pRTView);
     if (!ppView)
         SafeRelease(pDSView);
@@ -338,68 +429,28 @@ void D3D11Shim::SetRenderTarget(ID3D11Texture2D* pTexture, ID3D11DepthStencilVie
 
 void D3D11Shim::SetSamplerState(UINT uSlot, D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE addressMode)
 {
-    ID3D11SamplerState* pState = nullptr;
-    if (addressMode == D3D11_TEXTURE_ADDRESS_WRAP)
-    {
-        if (filter == D3D11_FILTER_MIN_MAG_MIP_POINT)
-            pState = m_states->PointWrap();
-        if (filter == D3D11_FILTER_MIN_MAG_MIP_LINEAR)
-            pState = m_states->LinearWrap();
-        if (filter == D3D11_FILTER_ANISOTROPIC)
-            pState = m_states->AnisotropicWrap();
-    }
-    if (addressMode == D3D11_TEXTURE_ADDRESS_CLAMP)
-    {
-        if (filter == D3D11_FILTER_MIN_MAG_MIP_POINT)
-            pState = m_states->PointClamp();
-        if (filter == D3D11_FILTER_MIN_MAG_MIP_LINEAR)
-            pState = m_states->LinearClamp();
-        if (filter == D3D11_FILTER_ANISOTROPIC)
-            pState = m_states->AnisotropicClamp();
-    }
-
-    if (pState)
+    ID3D11SamplerState* pState = static_cast<ID3D11SamplerState*>(m_stateCache.Get(STATE_SAMPLER, SamplerDesc(filter, addressMode, m_pDevice->GetFeatureLevel())));
+    if (pState && m_shadow.SetSlot(BIND_PS_SAMPLER, uSlot, Handle(pState)))
         m_pContext->PSSetSamplers(uSlot, 1, &pState);
 }
 
 void D3D11Shim::SetShader(unsigned int iIndex)
 {
-    m_pContext->VSSetShader(m_pVShader, NULL, 0);
-    m_pContext->VSSetConstantBuffers(0, 1, &m_pCBuffer);
+    BindVertexShader(m_pVShader);
+    BindConstantBuffers(BIND_VS_CONSTANTS, 1, &m_pCBuffer);
 
     if (iIndex >= MAX_NUM_SHADERS)
         return;
 
-    m_pContext->PSSetShader(m_pPShader[iIndex], NULL, 0);
+    BindPixelShader(m_pPShader[iIndex]);
     m_uCurrShader = iIndex;
 }
 
 void D3D11Shim::SetTexture(unsigned int iSlot, ID3D11Resource* pResource)
 {
-    ID3D11ShaderResourceView* views[1] = {NULL};
-    if (pResource)
-    {
-        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-        D3D11_RESOURCE_DIMENSION dim{};
-        pResource->GetType(&dim);
-
-        if (dim == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
-        {
-            CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc1(reinterpret_cast<ID3D11Texture2D*>(pResource), D3D11_SRV_DIMENSION_TEXTURE2D);
-            srvDesc = srvDesc1;
-        }
-        if (dim == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
-        {
-            CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc1(reinterpret_cast<ID3D11Texture3D*>(pResource));
-            srvDesc = srvDesc1;
-        }
-        m_pDevice->CreateShaderResourceView(pResource, &srvDesc, &views[0]);
-    }
-
-    m_pContext->PSSetShaderResources(iSlot, 1, views);
-
-    if (views[0])
-        views[0]->Release();
+    ID3D11ShaderResourceView* views[1] = {pResource ? static_cast<ID3D11ShaderResourceView*>(m_viewCache.Get(pResource)) : NULL};
+    if (m_shadow.SetSlot(BIND_PS_TEXTURE, iSlot, Handle(views[0])))
+        m_pContext->PSSetShaderResources(iSlot, 1, views);
 }
 
 void D3D11Shim::SetTransform(unsigned int transType, DirectX::XMMATRIX* pMatrix)
@@ -416,10 +467,7 @@ void D3D11Shim::SetTransform(unsigned int transType, DirectX::XMMATRIX* pMatrix)
 
 void D3D11Shim::SetVertexColor(bool bUseColor)
 {
-    if (!bUseColor)
-        m_pContext->PSSetShader(m_pPShader[m_uCurrShader], NULL, 0);
-    else
-        m_pContext->PSSetShader(m_pPShader[2], NULL, 0);
+    BindPixelShader(m_pPShader[bUseColor ? 2 : m_uCurrShader]);
 }
 
 HRESULT D3D11Shim::CreateVertexShader(const void* pByteCode, SIZE_T codeLength, ID3D11VertexShader** ppShader,
@@ -445,10 +493,10 @@ void D3D11Shim::SetVertexShader(ID3D11VertexShader* pVShader, CConstantTable* pT
         pTable->ApplyChanges(m_pContext);
         ID3D11Buffer** ppBuffers = new ID3D11Buffer*[pTable->GetBuffersCount()];
         pTable->GetBuffers(ppBuffers);
-        m_pContext->VSSetConstantBuffers(0, static_cast<UINT>(pTable->GetBuffersCount()), ppBuffers);
+        BindConstantBuffers(BIND_VS_CONSTANTS, static_cast<UINT>(pTable->GetBuffersCount()), ppBuffers);
         delete[] ppBuffers;
     }
-    m_pContext->VSSetShader((pVShader ? pVShader : m_pVShader), NULL, 0);
+    BindVertexShader(pVShader ? pVShader : m_pVShader);
 }
 
 void D3D11Shim::SetPixelShader(ID3D11PixelShader* pPShader, CConstantTable* pTable)
@@ -458,10 +506,10 @@ void D3D11Shim::SetPixelShader(ID3D11PixelShader* pPShader, CConstantTable* pTab
         pTable->ApplyChanges(m_pContext);
         ID3D11Buffer** ppBuffers = new ID3D11Buffer*[pTable->GetBuffersCount()];
         pTable->GetBuffers(ppBuffers);
-        m_pContext->PSSetConstantBuffers(0, static_cast<UINT>(pTable->GetBuffersCount()), ppBuffers);
+        BindConstantBuffers(BIND_PS_CONSTANTS, static_cast<UINT>(pTable->GetBuffersCount()), ppBuffers);
         delete[] ppBuffers;
     }
-    m_pContext->PSSetShader((pPShader ? pPShader : m_pPShader[m_uCurrShader]), NULL, 0);
+    BindPixelShader(pPShader ? pPShader : m_pPShader[m_uCurrShader]);
 }
 
 void D3D11Shim::ClearRenderTarget(ID3D11Texture2D* pRTTexture, const float color[4])
@@ -489,18 +537,117 @@ HRESULT D3D11Shim::CreateTextureFromFile(LPCWSTR szFileName, ID3D11Resource** te
     //char* u8FileName = _WideToUTF8(szFileName);
     std::wstring strFileName(szFileName);
     //delete[] u8FileName;
+    ID3D11ShaderResourceView* pView = nullptr;
+    HRESULT hr;
     if (GetExtension(strFileName) == L"dds")
-        return CreateDDSTextureFromFile(m_pDevice, szFileName, texture, reinterpret_cast<ID3D11ShaderResourceView**>(NULL)); // or `ThrowIfFailed()`
+        hr = CreateDDSTextureFromFile(m_pDevice, szFileName, texture, &pView); // or `ThrowIfFailed()`
     else
-        return CreateWICTextureFromFile(m_pDevice, szFileName, texture, reinterpret_cast<ID3D11ShaderResourceView**>(NULL)); // or `ThrowIfFailed()`
+        hr = CreateWICTextureFromFile(m_pDevice, szFileName, texture, &pView); // or `ThrowIfFailed()`
+    if (SUCCEEDED(hr) && pView)
+        m_viewCache.Insert(*texture, pView);
+    return hr;
 }
 
 HRESULT D3D11Shim::CreateTextureFromMemory(const uint8_t* data, size_t dataSize, ID3D11Resource** texture, UINT type)
 {
+    ID3D11ShaderResourceView* pView = nullptr;
+    HRESULT hr;
     if (type == 0)
-        return CreateDDSTextureFromMemory(m_pDevice, data, dataSize, texture, reinterpret_cast<ID3D11ShaderResourceView**>(NULL)); // or `ThrowIfFailed()`
+        hr = CreateDDSTextureFromMemory(m_pDevice, data, dataSize, texture, &pView); // or `ThrowIfFailed()`
     else
-        return CreateWICTextureFromMemory(m_pDevice, data, dataSize, texture, reinterpret_cast<ID3D11ShaderResourceView**>(NULL)); // or `ThrowIfFailed()`
+        hr = CreateWICTextureFromMemory(m_pDevice, data, dataSize, texture, &pView); // or `ThrowIfFailed()`
+    if (SUCCEEDED(hr) && pView)
+        m_viewCache.Insert(*texture, pView);
+    return hr;
+}
+
+// `pixels` holds the RGBA rows of each mip level, largest first.
+HRESULT D3D11Shim::CreateTextureFromPixels(const uint8_t* pixels, unsigned int uWidth, unsigned int uHeight, unsigned int mipLevels, ID3D11Resource** texture)
+{
+    CD3D11_TEXTURE2D_DESC texDesc(DXGI_FORMAT_R8G8B8A8_UNORM, uWidth, uHeight, 1, mipLevels, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE);
+    std::vector<D3D11_SUBRESOURCE_DATA> initData(mipLevels);
+    for (unsigned int i = 0, w = uWidth, h = uHeight; i < mipLevels; i++)
+    {
+        initData[i].pSysMem = pixels;
+        initData[i].SysMemPitch = w * 4;
+        initData[i].SysMemSlicePitch = 0;
+        pixels += static_cast<size_t>(w) * h * 4;
+        w = std::max(w / 2, 1U);
+        h = std::max(h / 2, 1U);
+    }
+
+    ID3D11Texture2D* pTexture = nullptr;
+    HRESULT hr = m_pDevice->CreateTexture2D(&texDesc, initData.data(), &pTexture);
+    *texture = pTexture;
+    if (SUCCEEDED(hr))
+        m_viewCache.Get(static_cast<ID3D11Resource*>(pTexture));
+    return hr;
+}
+
+bool D3D11Shim::DecodeImage(const wchar_t* szFilename, const uint8_t* pData, size_t nSize, int* pWidth, int* pHeight, std::vector<uint8_t>* pPixels)
+{
+    // Worker threads start without COM; on a thread that already has it,
+    // this fails with `RPC_E_CHANGED_MODE` and the existing apartment is used.
+    HRESULT hrCom = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    bool bOk = false;
+    {
+        Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+        Microsoft::WRL::ComPtr<IWICStream> stream;
+        Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+        Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+        Microsoft::WRL::ComPtr<IWICBitmapScaler> scaler;
+        Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+        UINT w = 0, h = 0;
+
+        HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()));
+        if (SUCCEEDED(hr) && pData)
+        {
+            hr = factory->CreateStream(stream.GetAddressOf());
+            if (SUCCEEDED(hr))
+                hr = stream->InitializeFromMemory(const_cast<BYTE*>(pData), static_cast<DWORD>(nSize));
+            if (SUCCEEDED(hr))
+                hr = factory->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf());
+        }
+        else if (SUCCEEDED(hr))
+            hr = factory->CreateDecoderFromFilename(szFilename, nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf());
+        if (SUCCEEDED(hr))
+            hr = decoder->GetFrame(0, frame.GetAddressOf());
+        if (SUCCEEDED(hr))
+            hr = frame->GetSize(&w, &h);
+        IWICBitmapSource* source = frame.Get();
+
+        // Scale down to the largest size a texture can have, keeping the aspect ratio.
+        constexpr UINT maxSize = D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+        if (SUCCEEDED(hr) && (w > maxSize || h > maxSize))
+        {
+            float ar = static_cast<float>(h) / static_cast<float>(w);
+            w = w > h ? maxSize : std::max(static_cast<UINT>(static_cast<float>(maxSize) / ar), 1U);
+            h = w == maxSize ? std::max(static_cast<UINT>(static_cast<float>(maxSize) * ar), 1U) : maxSize;
+            hr = factory->CreateBitmapScaler(scaler.GetAddressOf());
+            if (SUCCEEDED(hr))
+                hr = scaler->Initialize(frame.Get(), w, h, WICBitmapInterpolationModeFant);
+            source = scaler.Get();
+        }
+
+        if (SUCCEEDED(hr))
+            hr = factory->CreateFormatConverter(converter.GetAddressOf());
+        if (SUCCEEDED(hr))
+            hr = converter->Initialize(source, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeMedianCut);
+        if (SUCCEEDED(hr))
+        {
+            pPixels->resize(static_cast<size_t>(w) * h * 4);
+            hr = converter->CopyPixels(nullptr, w * 4, static_cast<UINT>(pPixels->size()), pPixels->data());
+        }
+        if (SUCCEEDED(hr))
+        {
+            *pWidth = static_cast<int>(w);
+            *pHeight = static_cast<int>(h);
+            bOk = true;
+        }
+    }
+    if (SUCCEEDED(hrCom))
+        CoUninitialize();
+    return bOk;
 }
 
 bool D3D11Shim::LockRect(ID3D11Resource* pResource, UINT uSubRes, D3D11_MAP mapType, D3D11_MAPPED_SUBRESOURCE* res)
@@ -514,6 +661,166 @@ void D3D11Shim::UnlockRect(ID3D11Resource* pResource, UINT uSubRes)
     m_pImmContext->Unmap(pResource, uSubRes);
 }
 
+void* D3D11Shim::CreateState(eStateType type, const void* pDesc)
+{
+    HRESULT hr = E_INVALIDARG;
+    void* pState = nullptr;
+    switch (type)
+    {
+        case STATE_BLEND:
+            hr = m_pDevice->CreateBlendState(static_cast<const D3D11_BLEND_DESC*>(pDesc), reinterpret_cast<ID3D11BlendState**>(&pState));
+            break;
+        case STATE_DEPTH_STENCIL:
+            hr = m_pDevice->CreateDepthStencilState(static_cast<const D3D11_DEPTH_STENCIL_DESC*>(pDesc), reinterpret_cast<ID3D11DepthStencilState**>(&pState));
+            break;
+        case STATE_RASTERIZER:
+            hr = m_pDevice->CreateRasterizerState(static_cast<const D3D11_RASTERIZER_DESC*>(pDesc), reinterpret_cast<ID3D11RasterizerState**>(&pState));
+            break;
+        case STATE_SAMPLER:
+            hr = m_pDevice->CreateSamplerState(static_cast<const D3D11_SAMPLER_DESC*>(pDesc), reinterpret_cast<ID3D11SamplerState**>(&pState));
+            break;
+    }
+    return SUCCEEDED(hr) ? pState : nullptr;
+}
+
+void D3D11Shim::ReleaseState(eStateType /* type */, void* pState)
+{
+    static_cast<ID3D11DeviceChild*>(pState)->Release();
+}
+
+// Creates the states that rendering uses, so that none are created while
+// rendering frames.
+void D3D11Shim::WarmStateCache()
+{
+    const std::pair<D3D11_BLEND, D3D11_BLEND> blends[] = {
+        {D3D11_BLEND_SRC_ALPHA,      D3D11_BLEND_INV_SRC_ALPHA},
+        {D3D11_BLEND_SRC_ALPHA,      D3D11_BLEND_ONE},
+        {D3D11_BLEND_ONE,            D3D11_BLEND_ONE},
+        {D3D11_BLEND_ONE,            D3D11_BLEND_ZERO},
+        {D3D11_BLEND_DEST_COLOR,     D3D11_BLEND_ONE},
+        {D3D11_BLEND_INV_DEST_COLOR, D3D11_BLEND_ZERO},
+        {D3D11_BLEND_INV_SRC_ALPHA,  D3D11_BLEND_SRC_ALPHA},
+        {D3D11_BLEND_SRC_COLOR,      D3D11_BLEND_INV_SRC_COLOR},
+        {D3D11_BLEND_ZERO,           D3D11_BLEND_DEST_COLOR},
+        {D3D11_BLEND_ZERO,           D3D11_BLEND_INV_DEST_COLOR},
+        {D3D11_BLEND_ZERO,           D3D11_BLEND_INV_SRC_COLOR},
+    };
+    m_stateCache.Get(STATE_BLEND, BlendDesc(false, D3D11_BLEND_ONE, D3D11_BLEND_ZERO));
+    for (const auto& [srcBlend, destBlend] : blends)
+        m_stateCache.Get(STATE_BLEND, BlendDesc(true, srcBlend, destBlend));
+
+    m_stateCache.Get(STATE_DEPTH_STENCIL, DepthDesc(true));
+    m_stateCache.Get(STATE_DEPTH_STENCIL, DepthDesc(false));
+
+    for (D3D11_CULL_MODE cullMode : {D3D11_CULL_NONE, D3D11_CULL_FRONT, D3D11_CULL_BACK})
+        m_stateCache.Get(STATE_RASTERIZER, RasterizerDesc(cullMode, D3D11_FILL_SOLID));
+    m_stateCache.Get(STATE_RASTERIZER, RasterizerDesc(D3D11_CULL_NONE, D3D11_FILL_WIREFRAME));
+
+    D3D_FEATURE_LEVEL featureLevel = m_pDevice->GetFeatureLevel();
+    for (D3D11_TEXTURE_ADDRESS_MODE addressMode : {D3D11_TEXTURE_ADDRESS_WRAP, D3D11_TEXTURE_ADDRESS_CLAMP})
+        for (D3D11_FILTER filter : {D3D11_FILTER_MIN_MAG_MIP_POINT, D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_FILTER_ANISOTROPIC})
+            m_stateCache.Get(STATE_SAMPLER, SamplerDesc(filter, addressMode, featureLevel));
+}
+
+void* D3D11Shim::CreateView(void* pResource)
+{
+    ID3D11Resource* pRes = static_cast<ID3D11Resource*>(pResource);
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    D3D11_RESOURCE_DIMENSION dim{};
+    pRes->GetType(&dim);
+
+    if (dim == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+    {
+        CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc1(reinterpret_cast<ID3D11Texture2D*>(pRes), D3D11_SRV_DIMENSION_TEXTURE2D);
+        srvDesc = srvDesc1;
+    }
+    if (dim == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
+    {
+        CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc1(reinterpret_cast<ID3D11Texture3D*>(pRes));
+        srvDesc = srvDesc1;
+    }
+
+    ID3D11ShaderResourceView* pView = nullptr;
+    m_pDevice->CreateShaderResourceView(pRes, &srvDesc, &pView);
+    return pView;
+}
+
+void D3D11Shim::ReleaseView(void* pView)
+{
+    static_cast<ID3D11ShaderResourceView*>(pView)->Release();
+}
+
+// A view holds a reference on its resource, so the owner has released a
+// resource that only has that one left.
+bool D3D11Shim::IsOrphaned(void* pResource)
+{
+    ID3D11Resource* pRes = static_cast<ID3D11Resource*>(pResource);
+    pRes->AddRef();
+    return pRes->Release() <= 1;
+}
+
+// The input layout is the same for every vertex buffer, which only has a
+// different stride for each vertex type.
+void D3D11Shim::BindVertexBuffer(ID3D11Buffer* pBuffer, UINT uStride)
+{
+    UINT uOffset = 0;
+    if (m_shadow.Set(BIND_VERTEX_BUFFER, Handle(pBuffer), uStride))
+        m_pContext->IASetVertexBuffers(0, 1, &pBuffer, &uStride, &uOffset);
+    if (m_shadow.Set(BIND_INPUT_LAYOUT, Handle(m_pInputLayout)))
+        m_pContext->IASetInputLayout(m_pInputLayout);
+}
+
+void D3D11Shim::BindIndexBuffer(ID3D11Buffer* pBuffer)
+{
+    if (m_shadow.Set(BIND_INDEX_BUFFER, Handle(pBuffer)))
+        m_pContext->IASetIndexBuffer(pBuffer, DXGI_FORMAT_R16_UINT, 0);
+}
+
+void D3D11Shim::BindTopology(D3D_PRIMITIVE_TOPOLOGY topology)
+{
+    if (m_shadow.Set(BIND_TOPOLOGY, topology))
+        m_pContext->IASetPrimitiveTopology(topology);
+}
+
+void D3D11Shim::BindVertexShader(ID3D11VertexShader* pShader)
+{
+    if (m_shadow.Set(BIND_VERTEX_SHADER, Handle(pShader)))
+        m_pContext->VSSetShader(pShader, NULL, 0);
+}
+
+void D3D11Shim::BindPixelShader(ID3D11PixelShader* pShader)
+{
+    if (m_shadow.Set(BIND_PIXEL_SHADER, Handle(pShader)))
+        m_pContext->PSSetShader(pShader, NULL, 0);
+}
+
+// Binds buffers to slots [0, uCount) in one call if any changed.
+void D3D11Shim::BindConstantBuffers(eBindPoint bp, UINT uCount, ID3D11Buffer* const* ppBuffers)
+{
+    bool bChanged = false;
+    for (UINT i = 0; i < uCount; i++)
+        bChanged |= m_shadow.SetSlot(bp, i, Handle(ppBuffers[i]));
+    if (!bChanged)
+        return;
+    if (bp == BIND_VS_CONSTANTS)
+        m_pContext->VSSetConstantBuffers(0, uCount, ppBuffers);
+    else
+        m_pContext->PSSetConstantBuffers(0, uCount, ppBuffers);
+}
+
+void D3D11Shim::UpdateCBuffer()
+{
+    if (!m_bCBufferIsDirty)
+        return;
+    D3D11_MAPPED_SUBRESOURCE res{};
+    if (S_OK == m_pContext->Map(m_pCBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+    {
+        memcpy(res.pData, &m_transforms, sizeof(cbTransforms));
+        m_pContext->Unmap(m_pCBuffer, 0);
+    }
+    m_bCBufferIsDirty = false;
+}
+
 int D3D11Shim::NumVertsFromType(unsigned int primType, int iPrimCount)
 {
     switch (primType)
@@ -534,22 +841,58 @@ int D3D11Shim::NumVertsFromType(unsigned int primType, int iPrimCount)
     }
 }
 
-void D3D11Shim::UpdateVBuffer(unsigned int iNumVerts, const void* pVData, unsigned int vertexStride)
+// Appends the vertices to the vertex ring. `uBaseVertex` is where they
+// start, in vertices of `vertexStride` bytes.
+bool D3D11Shim::UpdateVBuffer(unsigned int iNumVerts, const void* pVData, unsigned int vertexStride, UINT& uBaseVertex)
 {
+    size_t nSize = static_cast<size_t>(iNumVerts) * vertexStride;
+    td_ringalloc alloc;
+    if (!m_vertexRing.Allocate(nSize, vertexStride, alloc) &&
+        !(GrowBuffer(&m_pVBuffer, m_vertexRing, D3D11_BIND_VERTEX_BUFFER, nSize) && m_vertexRing.Allocate(nSize, vertexStride, alloc)))
+        return false;
+
     D3D11_MAPPED_SUBRESOURCE res;
-    if (S_OK == m_pContext->Map(m_pVBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
-    {
-        memcpy(res.pData, pVData, std::min(iNumVerts, MAX_VERTICES_COUNT) * vertexStride);
-        m_pContext->Unmap(m_pVBuffer, 0);
-    }
+    if (S_OK != m_pContext->Map(m_pVBuffer, 0, alloc.bDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &res))
+        return false;
+    memcpy(static_cast<uint8_t*>(res.pData) + alloc.nOffset, pVData, nSize);
+    m_pContext->Unmap(m_pVBuffer, 0);
+    uBaseVertex = static_cast<UINT>(alloc.nOffset / vertexStride);
+    return true;
 }
 
-void D3D11Shim::UpdateIBuffer(unsigned int iNumIndices, const void* pIData)
+// Appends the indices to the index ring. `uStartIndex` is where they start.
+bool D3D11Shim::UpdateIBuffer(unsigned int iNumIndices, const void* pIData, UINT& uStartIndex)
 {
+    size_t nSize = static_cast<size_t>(iNumIndices) * sizeof(uint16_t);
+    td_ringalloc alloc;
+    if (!m_indexRing.Allocate(nSize, sizeof(uint16_t), alloc) &&
+        !(GrowBuffer(&m_pIBuffer, m_indexRing, D3D11_BIND_INDEX_BUFFER, nSize) && m_indexRing.Allocate(nSize, sizeof(uint16_t), alloc)))
+        return false;
+
     D3D11_MAPPED_SUBRESOURCE res;
-    if (S_OK == m_pContext->Map(m_pIBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
-    {
-        memcpy(res.pData, pIData, std::min(iNumIndices, MAX_INDICES_COUNT) * sizeof(uint16_t));
-        m_pContext->Unmap(m_pIBuffer, 0);
-    }
-}
\ No newline at end of file
+    if (S_OK != m_pContext->Map(m_pIBuffer, 0, alloc.bDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &res))
+        return false;
+    memcpy(static_cast<uint8_t*>(res.pData) + alloc.nOffset, pIData, nSize);
+    m_pContext->Unmap(m_pIBuffer, 0);
+    uStartIndex = static_cast<UINT>(alloc.nOffset / sizeof(uint16_t));
+    return true;
+}
+
+// Replaces a ring's buffer with one that holds at least `nSize` bytes, for
+// a draw with more data than the ring holds. Draws in flight keep the old
+// one alive.
+bool D3D11Shim::GrowBuffer(ID3D11Buffer** ppBuffer, CRingAllocator& ring, UINT bindFlags, size_t nSize)
+{
+    size_t nCapacity = GrowCapacity(ring.GetCapacity(), nSize);
+    if (nCapacity > static_cast<size_t>(D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM) * 1024 * 1024)
+        return false;
+
+    ID3D11Buffer* pBuffer = nullptr;
+    CD3D11_BUFFER_DESC bDesc(static_cast<UINT>(nCapacity), bindFlags, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+    if (FAILED(m_pDevice->CreateBuffer(&bDesc, NULL, &pBuffer)))
+        return false;
+    SafeRelease(*ppBuffer);
+    *ppBuffer = pBuffer;
+    ring.Reset(nCapacity);
+    return true;
+}
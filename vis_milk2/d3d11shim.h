@@ -9,17 +9,24 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <d3d11_1.h>
 #include <DirectXMath.h>
-#include <CommonStates.h>
 #include "constanttable.h"
+#include "ringalloc.h"
+#include "statecache.h"
+#include "stateshadow.h"
+#include "viewcache.h"
 
 #define MAX_NUM_SHADERS (4)
 #define MAX_VERTICES_COUNT (3072U)
 #define MAX_INDICES_COUNT (MAX_VERTICES_COUNT * 3)
+#define FAN_TRIANGLES_COUNT (MAX_VERTICES_COUNT / 6 - 3)
+#define VERTEX_RING_SIZE (1024U * 1024U) // bytes, grows for larger draws
+#define INDEX_RING_SIZE (256U * 1024U)
 #define D3D_PRIMITIVE_TOPOLOGY_TRIANGLEFAN D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP + 1 // D3DPT_TRIANGLEFAN (0x6): Triangle fans are not supported in Direct3D 10 or later.
 
-class D3D11Shim
+class D3D11Shim : private CStateFactory, private CViewFactory
 {
   public:
     D3D11Shim(ID3D11Device* pDevice, ID3D11DeviceContext* pContext);
@@ -27,12 +34,26 @@ class D3D11Shim
 
     void Initialize();
 
+    // Releases the views of textures released during the frame and
+    // closes its bind counters.
+    void EndFrame();
+
+    // Forgets the bound state, after code that binds state directly on
+    // the device context.
+    void InvalidateState();
+    void GetStateStats(td_stateshadowstats& stats) const { m_shadow.GetStats(stats); }
+
     bool CreateTexture(unsigned int uWidth, unsigned int uHeight, unsigned int mipLevels, UINT bindFlags, DXGI_FORMAT format, ID3D11Texture2D** ppTexture, unsigned int miscFlags = 0, D3D11_USAGE usage = D3D11_USAGE_DEFAULT);
     bool CreateVolumeTexture(unsigned int uWidth, unsigned int uHeight, unsigned int uDepth, unsigned int mipLevels, UINT bindFlags, DXGI_FORMAT format, ID3D11Texture3D** ppTexture, unsigned int miscFlags = 0, D3D11_USAGE usage = D3D11_USAGE_DEFAULT);
 
     void DrawPrimitive(unsigned int primType, unsigned int iPrimCount, const void* pVData, unsigned int vertexStride);
     void DrawIndexedPrimitive(unsigned int primType, unsigned int uStartIndex, unsigned int iNumVertices, unsigned int iPrimCount, const void* pIData, const void* pVData, unsigned int vertexStride);
 
+    // Meshes whose topology does not change from frame to frame keep their
+    // indices in a static index buffer, and only upload their vertices.
+    bool CreateIndexBuffer(const uint16_t* pIData, unsigned int iNumIndices, ID3D11Buffer** ppBuffer);
+    void DrawIndexedMesh(ID3D11Buffer* pIBuffer, unsigned int iNumIndices, unsigned int iNumVertices, const void* pVData, unsigned int vertexStride);
+
     void GetRenderTarget(ID3D11Texture2D** ppTexture);
     void GetDepthView(ID3D11DepthStencilView** ppView);
     void GetViewport(D3D11_VIEWPORT* vp);
@@ -60,6 +81,11 @@ class D3D11Shim
 
     HRESULT CreateTextureFromFile(LPCWSTR szFileName, ID3D11Resource** texture);
     HRESULT CreateTextureFromMemory(const uint8_t* data, size_t dataSize, ID3D11Resource** texture, UINT type = 0);
+    HRESULT CreateTextureFromPixels(const uint8_t* pixels, unsigned int uWidth, unsigned int uHeight, unsigned int mipLevels, ID3D11Resource** texture);
+
+    // Decodes an image file, or an encoded image in memory, to 8-bit RGBA
+    // with WIC. Can be called from any thread (an `ImageDecoder`).
+    static bool DecodeImage(const wchar_t* szFilename, const uint8_t* pData, size_t nSize, int* pWidth, int* pHeight, std::vector<uint8_t>* pPixels);
 
     UINT GetMaxPrimitiveCount() { return MAX_VERTICES_COUNT; };
 
@@ -71,9 +97,24 @@ class D3D11Shim
         DirectX::XMFLOAT4X4 proj;
     };
 
+    void* CreateState(eStateType type, const void* pDesc) override;
+    void ReleaseState(eStateType type, void* pState) override;
+    void WarmStateCache();
+    void* CreateView(void* pResource) override;
+    void ReleaseView(void* pView) override;
+    bool IsOrphaned(void* pResource) override;
+
+    void BindVertexBuffer(ID3D11Buffer* pBuffer, UINT uStride);
+    void BindIndexBuffer(ID3D11Buffer* pBuffer);
+    void BindTopology(D3D_PRIMITIVE_TOPOLOGY topology);
+    void BindVertexShader(ID3D11VertexShader* pShader);
+    void BindPixelShader(ID3D11PixelShader* pShader);
+    void BindConstantBuffers(eBindPoint bp, UINT uCount, ID3D11Buffer* const* ppBuffers);
+    void UpdateCBuffer();
     int NumVertsFromType(unsigned int primType, int iPrimCount);
-    void UpdateVBuffer(unsigned int iNumVerts, const void* pVData, unsigned int vertexStride);
-    void UpdateIBuffer(unsigned int iNumIndices, const void* pIData);
+    bool UpdateVBuffer(unsigned int iNumVerts, const void* pVData, unsigned int vertexStride, UINT& uBaseVertex);
+    bool UpdateIBuffer(unsigned int iNumIndices, const void* pIData, UINT& uStartIndex);
+    bool GrowBuffer(ID3D11Buffer** ppBuffer, CRingAllocator& ring, UINT bindFlags, size_t nSize);
 
     cbTransforms m_transforms;
     ID3D11Device* m_pDevice;
@@ -85,10 +126,12 @@ class D3D11Shim
     ID3D11Buffer* m_pVBuffer;
     ID3D11Buffer* m_pIBuffer;
     ID3D11Buffer* m_pIFanBuffer;
+    CRingAllocator m_vertexRing; // transient vertices of each draw, in `m_pVBuffer`
+    CRingAllocator m_indexRing;  // and indices, in `m_pIBuffer`
     ID3D11Buffer* m_pCBuffer;
     bool m_bCBufferIsDirty;
     unsigned int m_uCurrShader;
-    ID3D11BlendState* m_pState;
-
-    std::unique_ptr<DirectX::CommonStates> m_states;
+    CStateCache m_stateCache; // blend, depth, rasterizer and sampler states, created once each
+    CViewCache m_viewCache;   // shader resource views, one per texture
+    CStateShadow m_shadow;    // bound state, to drop redundant binds
 };
\ No newline at end of file
@@ -103,6 +103,22 @@ void DXContext::Show()
     m_deviceResources->Present();
 }
 
+// Number of times the swap chain was presented.
+bool DXContext::GetLastPresentCount(UINT& nPresentCount) const
+{
+    IDXGISwapChain1* swapChain = m_deviceResources->GetSwapChain();
+    return swapChain && SUCCEEDED(swapChain->GetLastPresentCount(&nPresentCount));
+}
+
+// When the frame shown at the last refresh was presented and shown. Not
+// available in windowed mode before Windows 8, nor while the statistics
+// are disjoint, such as after a mode change.
+bool DXContext::GetFrameStatistics(DXGI_FRAME_STATISTICS& stats) const
+{
+    IDXGISwapChain1* swapChain = m_deviceResources->GetSwapChain();
+    return swapChain && SUCCEEDED(swapChain->GetFrameStatistics(&stats)) && stats.PresentCount != 0;
+}
+
 // Clear the back buffers.
 void DXContext::Clear()
 {
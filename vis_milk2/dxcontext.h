@@ -78,6 +78,8 @@ class DXContext final
     void OnDisplayChange();
     inline HWND GetHwnd() const { return m_hwnd; };
     void Show();
+    bool GetLastPresentCount(UINT& nPresentCount) const;
+    bool GetFrameStatistics(DXGI_FRAME_STATISTICS& stats) const;
     void Clear();
     void RestoreTarget();
     int GetBitDepth() const { return m_bpp; };
@@ -0,0 +1,793 @@
+/*
+ * eelinterp.cpp - Interpreter for run-once and lane-parallel EEL code.
+ *
+ * Init code runs exactly once per load, so building a compiled program for
+ * it is wasted work; per-vertex code runs the same program for every mesh
+ * vertex, so evaluating several vertices per tree walk amortizes the
+ * dispatch and lets the compiler vectorize the lane loops. Both walk a flat
+ * expression tree that follows the operator precedence of the EEL2 grammar
+ * (note that `%` binds tighter than `/`, which binds tighter than `*`, and
+ * `-` tighter than `+`).
+ *
+ * Conditionals evaluate both branches under a lane mask, so that lanes
+ * taking different branches stay in step.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "eelinterp.h"
+
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace
+{
+enum EelOp
+{
+    EOP_CONST,
+    EOP_VAR,
+    EOP_ASSIGN,
+    EOP_ADD_ASSIGN,
+    EOP_SUB_ASSIGN,
+    EOP_MUL_ASSIGN,
+    EOP_DIV_ASSIGN,
+    EOP_SEQ,
+    EOP_IF,
+    EOP_AND,
+    EOP_OR,
+    EOP_BAND, // `band()` and `bor()` evaluate both arguments
+    EOP_BOR,
+    EOP_NOT,
+    EOP_NEG,
+    EOP_EQ,
+    EOP_NE,
+    EOP_LT,
+    EOP_GT,
+    EOP_LE,
+    EOP_GE,
+    EOP_ADD,
+    EOP_SUB,
+    EOP_MUL,
+    EOP_DIV,
+    EOP_POW,
+    EOP_CALL,
+};
+
+enum EelFunc
+{
+    EFN_SIN,
+    EFN_COS,
+    EFN_TAN,
+    EFN_ASIN,
+    EFN_ACOS,
+    EFN_ATAN,
+    EFN_ATAN2,
+    EFN_EXP,
+    EFN_LOG,
+    EFN_LOG10,
+    EFN_SQRT,
+    EFN_SQR,
+    EFN_ABS,
+    EFN_MIN,
+    EFN_MAX,
+    EFN_FLOOR,
+    EFN_CEIL,
+    EFN_SIGN,
+};
+
+typedef struct
+{
+    const char* szName;
+    EelOp op;
+    int fn; // `EelFunc` for `EOP_CALL`
+    int nArgs;
+} td_eelfunc;
+
+// clang-format off
+const td_eelfunc g_funcs[] = {
+    {"sin", EOP_CALL, EFN_SIN, 1},     {"cos", EOP_CALL, EFN_COS, 1},     {"tan", EOP_CALL, EFN_TAN, 1},
+    {"asin", EOP_CALL, EFN_ASIN, 1},   {"acos", EOP_CALL, EFN_ACOS, 1},   {"atan", EOP_CALL, EFN_ATAN, 1},
+    {"atan2", EOP_CALL, EFN_ATAN2, 2}, {"exp", EOP_CALL, EFN_EXP, 1},     {"log", EOP_CALL, EFN_LOG, 1},
+    {"log10", EOP_CALL, EFN_LOG10, 1}, {"sqrt", EOP_CALL, EFN_SQRT, 1},   {"sqr", EOP_CALL, EFN_SQR, 1},
+    {"abs", EOP_CALL, EFN_ABS, 1},     {"min", EOP_CALL, EFN_MIN, 2},     {"max", EOP_CALL, EFN_MAX, 2},
+    {"floor", EOP_CALL, EFN_FLOOR, 1}, {"ceil", EOP_CALL, EFN_CEIL, 1},   {"sign", EOP_CALL, EFN_SIGN, 1},
+    {"pow", EOP_POW, 0, 2},            {"above", EOP_GT, 0, 2},           {"below", EOP_LT, 0, 2},
+    {"equal", EOP_EQ, 0, 2},           {"band", EOP_BAND, 0, 2},          {"bor", EOP_BOR, 0, 2},
+    {"bnot", EOP_NOT, 0, 1},           {"if", EOP_IF, 0, 3},
+};
+// clang-format on
+
+// The backends treat values within this distance of zero (or of each other,
+// for `==`) as zero or equal, or not, depending on the backend and operator.
+constexpr double CLOSE_FACTOR = 0.00001;
+
+constexpr unsigned ALL_LANES = (1u << EEL_LANES) - 1;
+
+class CEelParser
+{
+  public:
+    CEelParser(const char* code, std::vector<td_eelnode>& nodes, std::vector<std::string>& vars) : m_p(code), m_nodes(nodes), m_vars(vars), m_bOk(true), m_nDepth(0) {}
+
+    // Returns the root node, or -1 if the code is outside the handled subset.
+    int Parse()
+    {
+        int root = Expression();
+        SkipSpace();
+        return (m_bOk && *m_p == '\0') ? root : -1;
+    }
+
+  private:
+    static constexpr int MAX_DEPTH = 256;
+
+    void SkipSpace()
+    {
+        while (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n')
+            m_p++;
+    }
+
+    bool Peek(const char* tok)
+    {
+        SkipSpace();
+        return strncmp(m_p, tok, strlen(tok)) == 0;
+    }
+
+    bool Accept(const char* tok)
+    {
+        if (!Peek(tok))
+            return false;
+        m_p += strlen(tok);
+        return true;
+    }
+
+    int Fail()
+    {
+        m_bOk = false;
+        return -1;
+    }
+
+    // Operands of operators and function arguments may not assign, so that
+    // the order the backend evaluates them in cannot change the result.
+    // Sequences, conditionals and the value of a plain assignment may
+    // contain one, as their operands are evaluated in a fixed order.
+    int Add(EelOp op, int a = -1, int b = -1, int c = -1)
+    {
+        if (!m_bOk)
+            return -1;
+        bool bOrdered = (op == EOP_SEQ || op == EOP_ASSIGN || op == EOP_IF || op == EOP_AND || op == EOP_OR);
+        bool bAssigns = (op >= EOP_ASSIGN && op <= EOP_DIV_ASSIGN);
+        for (int child : {a, b, c})
+        {
+            if (child < 0 || !m_nodes[static_cast<size_t>(child)].bAssigns)
+                continue;
+            if (!bOrdered)
+                return Fail();
+            bAssigns = true;
+        }
+        m_nodes.push_back({op, 0, a, b, c, -1, 0.0, bAssigns});
+        return static_cast<int>(m_nodes.size()) - 1;
+    }
+
+    // expression: if_else_expr (';' if_else_expr?)*
+    int Expression()
+    {
+        if (++m_nDepth > MAX_DEPTH)
+            return Fail();
+        int n = IfElse();
+        while (m_bOk && Accept(";"))
+        {
+            SkipSpace();
+            if (*m_p == ';')
+                continue;
+            if (*m_p == '\0' || *m_p == ')')
+                break;
+            n = Add(EOP_SEQ, n, IfElse());
+        }
+        m_nDepth--;
+        return n;
+    }
+
+    // Only the full `c ? a : b` form is handled.
+    int IfElse()
+    {
+        int n = Logical();
+        if (!m_bOk || !Accept("?"))
+            return n;
+        int a = IfElse();
+        if (!m_bOk || !Accept(":"))
+            return Fail();
+        return Add(EOP_IF, n, a, IfElse());
+    }
+
+    int Logical()
+    {
+        int n = Compare();
+        while (m_bOk)
+        {
+            if (Accept("&&"))
+                n = Add(EOP_AND, n, Compare());
+            else if (Accept("||"))
+                n = Add(EOP_OR, n, Compare());
+            else
+                break;
+        }
+        return n;
+    }
+
+    int Compare()
+    {
+        int n = Bitwise();
+        while (m_bOk)
+        {
+            EelOp op;
+            if (Peek("===") || Peek("!=="))
+                return Fail();
+            if (Accept("=="))
+                op = EOP_EQ;
+            else if (Accept("!="))
+                op = EOP_NE;
+            else if (Accept("<="))
+                op = EOP_LE;
+            else if (Accept(">="))
+                op = EOP_GE;
+            else if (Peek("<") && m_p[1] != '<' && Accept("<"))
+                op = EOP_LT;
+            else if (Peek(">") && m_p[1] != '>' && Accept(">"))
+                op = EOP_GT;
+            else
+                break;
+            n = Add(op, n, Bitwise());
+        }
+        return n;
+    }
+
+    // `&`, `|` and `~` are not handled.
+    int Bitwise()
+    {
+        int n = AddExpr();
+        SkipSpace();
+        if ((m_p[0] == '&' && m_p[1] != '&') || (m_p[0] == '|' && m_p[1] != '|') || m_p[0] == '~')
+            return Fail();
+        return n;
+    }
+
+    int AddExpr()
+    {
+        int n = SubExpr();
+        while (m_bOk && !Peek("+=") && Accept("+"))
+            n = Add(EOP_ADD, n, SubExpr());
+        return n;
+    }
+
+    int SubExpr()
+    {
+        int n = MulExpr();
+        while (m_bOk && !Peek("-=") && Accept("-"))
+            n = Add(EOP_SUB, n, MulExpr());
+        return n;
+    }
+
+    int MulExpr()
+    {
+        int n = DivExpr();
+        while (m_bOk && !Peek("*=") && Accept("*"))
+            n = Add(EOP_MUL, n, DivExpr());
+        return n;
+    }
+
+    int DivExpr()
+    {
+        int n = ModExpr();
+        while (m_bOk && !Peek("/=") && Accept("/"))
+            n = Add(EOP_DIV, n, ModExpr());
+        return n;
+    }
+
+    // `%`, `<<` and `>>` are not handled.
+    int ModExpr()
+    {
+        int n = PowExpr();
+        if (Peek("%") || Peek("<<") || Peek(">>"))
+            return Fail();
+        return n;
+    }
+
+    int PowExpr()
+    {
+        int n = Unary();
+        while (m_bOk && !Peek("^=") && Accept("^"))
+            n = Add(EOP_POW, n, Unary());
+        return n;
+    }
+
+    int Unary()
+    {
+        if (!m_bOk || ++m_nDepth > MAX_DEPTH)
+            return Fail();
+        int n;
+        if (Accept("+"))
+            n = Unary();
+        else if (Accept("-"))
+            n = Add(EOP_NEG, Unary());
+        else if (Peek("!") && !Peek("!="))
+        {
+            Accept("!");
+            n = Add(EOP_NOT, Unary());
+        }
+        else
+            n = Assignment();
+        m_nDepth--;
+        return n;
+    }
+
+    int Assignment()
+    {
+        SkipSpace();
+        const char* start = m_p;
+        int n = Value();
+        if (!m_bOk)
+            return -1;
+
+        EelOp op;
+        if (Peek("=="))
+            return n; // a comparison
+        else if (Accept("="))
+            op = EOP_ASSIGN;
+        else if (Accept("+="))
+            op = EOP_ADD_ASSIGN;
+        else if (Accept("-="))
+            op = EOP_SUB_ASSIGN;
+        else if (Accept("*="))
+            op = EOP_MUL_ASSIGN;
+        else if (Accept("/="))
+            op = EOP_DIV_ASSIGN;
+        else if (Peek("%=") || Peek("^=") || Peek("|=") || Peek("&=") || Peek("~="))
+            return Fail();
+        else
+            return n;
+
+        // Only plain variables can be assigned to here.
+        if (m_nodes[static_cast<size_t>(n)].op != EOP_VAR || *start == '(')
+            return Fail();
+        int var = m_nodes[static_cast<size_t>(n)].var;
+        n = Add(op, IfElse());
+        if (n < 0)
+            return -1;
+        m_nodes[static_cast<size_t>(n)].var = var;
+        return n;
+    }
+
+    int Value()
+    {
+        SkipSpace();
+        if (Accept("("))
+        {
+            int n = Expression();
+            if (!Accept(")"))
+                return Fail();
+            return NoIndex(n);
+        }
+        if ((*m_p >= '0' && *m_p <= '9') || (*m_p == '.' && m_p[1] >= '0' && m_p[1] <= '9'))
+            return NoIndex(Number());
+        if ((*m_p >= 'a' && *m_p <= 'z') || *m_p == '_')
+            return NoIndex(Identifier());
+        return Fail(); // `$` constants, strings, uppercase names, ...
+    }
+
+    // `x[i]` is memory access, which is not handled.
+    int NoIndex(int n)
+    {
+        if (Peek("["))
+            return Fail();
+        return n;
+    }
+
+    int Number()
+    {
+        const char* start = m_p;
+        while (*m_p >= '0' && *m_p <= '9')
+            m_p++;
+        if (*m_p == '.')
+        {
+            m_p++;
+            while (*m_p >= '0' && *m_p <= '9')
+                m_p++;
+        }
+        // Exponents, hex and the like are left to the backend.
+        if ((*m_p >= 'a' && *m_p <= 'z') || (*m_p >= 'A' && *m_p <= 'Z') || *m_p == '_' || *m_p == '.' || *m_p == '$' || *m_p == '#')
+            return Fail();
+        double v = 0.0;
+        if (*start == '.')
+        {
+            // `from_chars` needs a leading digit.
+            std::string s = "0" + std::string(start, m_p);
+            std::from_chars(s.data(), s.data() + s.size(), v);
+        }
+        else
+            std::from_chars(start, m_p, v);
+        int n = Add(EOP_CONST);
+        m_nodes[static_cast<size_t>(n)].value = v;
+        return n;
+    }
+
+    int Identifier()
+    {
+        const char* start = m_p;
+        while ((*m_p >= 'a' && *m_p <= 'z') || (*m_p >= '0' && *m_p <= '9') || *m_p == '_')
+            m_p++;
+        // Uppercase letters, namespaces (`a.b`) and string variables are left to the backend.
+        if ((*m_p >= 'A' && *m_p <= 'Z') || *m_p == '.' || *m_p == '#' || *m_p == '$')
+            return Fail();
+        std::string name(start, m_p);
+
+        if (Accept("("))
+            return Call(name);
+
+        // Global registers and memory are resolved specially by the backends.
+        if (name == "gmem" || (name.size() == 5 && name.compare(0, 3, "reg") == 0 && isdigit(name[3]) && isdigit(name[4])))
+            return Fail();
+        int slot = -1;
+        for (size_t i = 0; i < m_vars.size() && slot < 0; i++)
+            if (m_vars[i] == name)
+                slot = static_cast<int>(i);
+        if (slot < 0)
+        {
+            m_vars.push_back(name);
+            slot = static_cast<int>(m_vars.size()) - 1;
+        }
+        int n = Add(EOP_VAR);
+        m_nodes[static_cast<size_t>(n)].var = slot;
+        return n;
+    }
+
+    int Call(const std::string& name)
+    {
+        const td_eelfunc* f = nullptr;
+        for (const auto& g : g_funcs)
+            if (name == g.szName)
+                f = &g;
+        if (!f)
+            return Fail(); // `rand`, `megabuf`, `loop`, `int`, user functions, ...
+
+        int args[3] = {-1, -1, -1};
+        for (int i = 0; i < f->nArgs; i++)
+        {
+            if (i > 0 && !Accept(","))
+                return Fail();
+            args[i] = Expression();
+            if (!m_bOk)
+                return -1;
+        }
+        if (!Accept(")"))
+            return Fail();
+        int n = Add(f->op, args[0], args[1], args[2]);
+        if (n >= 0)
+            m_nodes[static_cast<size_t>(n)].fn = f->fn;
+        return n;
+    }
+
+    const char* m_p;
+    std::vector<td_eelnode>& m_nodes;
+    std::vector<std::string>& m_vars;
+    bool m_bOk;
+    int m_nDepth;
+};
+
+// Returns true if no variable in `written` can be read by node `i` before
+// the program assigns it. `assigned` holds the variables assigned on every
+// path so far.
+bool IsStateless(const std::vector<td_eelnode>& nodes, int i, const std::vector<bool>& written, std::vector<bool>& assigned)
+{
+    if (i < 0)
+        return true;
+    const td_eelnode& n = nodes[static_cast<size_t>(i)];
+    size_t var = static_cast<size_t>(n.var);
+    switch (n.op)
+    {
+        case EOP_VAR:
+            return !written[var] || assigned[var];
+        case EOP_ASSIGN:
+        case EOP_ADD_ASSIGN:
+        case EOP_SUB_ASSIGN:
+        case EOP_MUL_ASSIGN:
+        case EOP_DIV_ASSIGN:
+            if (n.op != EOP_ASSIGN && !assigned[var])
+                return false;
+            if (!IsStateless(nodes, n.a, written, assigned))
+                return false;
+            assigned[var] = true;
+            return true;
+        case EOP_IF:
+        {
+            if (!IsStateless(nodes, n.a, written, assigned))
+                return false;
+            std::vector<bool> other = assigned;
+            if (!IsStateless(nodes, n.b, written, assigned) || !IsStateless(nodes, n.c, written, other))
+                return false;
+            for (size_t v = 0; v < assigned.size(); v++)
+                assigned[v] = assigned[v] && other[v];
+            return true;
+        }
+        case EOP_AND:
+        case EOP_OR:
+        {
+            if (!IsStateless(nodes, n.a, written, assigned))
+                return false;
+            std::vector<bool> other = assigned;
+            return IsStateless(nodes, n.b, written, other);
+        }
+        default:
+            return IsStateless(nodes, n.a, written, assigned) && IsStateless(nodes, n.b, written, assigned) && IsStateless(nodes, n.c, written, assigned);
+    }
+}
+
+class CEelEvaluator
+{
+  public:
+    CEelEvaluator(const std::vector<td_eelnode>& nodes, std::vector<td_eellanes>& vars) : m_nodes(nodes), m_vars(vars), m_bOk(true) {}
+
+    bool Run(int root, unsigned mask)
+    {
+        Eval(root, mask);
+        return m_bOk;
+    }
+
+  private:
+    // Non-finite values, subnormals and negative zero are where the backends
+    // (and the JIT's denormal flushing) can disagree, so stop there.
+    td_eellanes Check(const td_eellanes& r, unsigned mask)
+    {
+        for (int l = 0; l < EEL_LANES; l++)
+        {
+            if (!(mask & (1u << l)))
+                continue;
+            int c = std::fpclassify(r.v[l]);
+            if (c == FP_NAN || c == FP_INFINITE || c == FP_SUBNORMAL || (c == FP_ZERO && std::signbit(r.v[l])))
+                m_bOk = false;
+        }
+        return r;
+    }
+
+    // Returns the lanes of `mask` where `r` is nonzero, stopping where the
+    // backends' closeness tests could disagree.
+    unsigned NonZero(const td_eellanes& r, unsigned mask)
+    {
+        unsigned t = 0;
+        for (int l = 0; l < EEL_LANES; l++)
+        {
+            if (!(mask & (1u << l)))
+                continue;
+            double a = fabs(r.v[l]);
+            if (a >= 2.0 * CLOSE_FACTOR)
+                t |= 1u << l;
+            else if (a != 0.0)
+                m_bOk = false;
+        }
+        return t;
+    }
+
+    static td_eellanes Bool(unsigned t)
+    {
+        td_eellanes r;
+        for (int l = 0; l < EEL_LANES; l++)
+            r.v[l] = (t & (1u << l)) ? 1.0 : 0.0;
+        return r;
+    }
+
+    template <typename F>
+    static td_eellanes Map(const td_eellanes& a, const td_eellanes& b, F f)
+    {
+        td_eellanes r;
+        for (int l = 0; l < EEL_LANES; l++)
+            r.v[l] = f(a.v[l], b.v[l]);
+        return r;
+    }
+
+    template <typename F>
+    static unsigned Test(const td_eellanes& a, const td_eellanes& b, unsigned mask, F f)
+    {
+        unsigned t = 0;
+        for (int l = 0; l < EEL_LANES; l++)
+            if (f(a.v[l], b.v[l]))
+                t |= 1u << l;
+        return t & mask;
+    }
+
+    // Writes the lanes of `mask` to `var`.
+    static td_eellanes Store(td_eellanes& var, const td_eellanes& r, unsigned mask)
+    {
+        for (int l = 0; l < EEL_LANES; l++)
+            if (mask & (1u << l))
+                var.v[l] = r.v[l];
+        return r;
+    }
+
+    td_eellanes Eval(int i, unsigned mask)
+    {
+        td_eellanes r = {};
+        if (!m_bOk)
+            return r;
+        const td_eelnode& n = m_nodes[static_cast<size_t>(i)];
+        td_eellanes* var = (n.var >= 0) ? &m_vars[static_cast<size_t>(n.var)] : nullptr;
+        switch (n.op)
+        {
+            case EOP_CONST:
+                for (double& v : r.v)
+                    v = n.value;
+                return r;
+            case EOP_VAR: return *var;
+            case EOP_ASSIGN: return Store(*var, Eval(n.a, mask), mask);
+            case EOP_ADD_ASSIGN: r = Eval(n.a, mask); return Store(*var, Check(Map(*var, r, [](double a, double b) { return a + b; }), mask), mask);
+            case EOP_SUB_ASSIGN: r = Eval(n.a, mask); return Store(*var, Check(Map(*var, r, [](double a, double b) { return a - b; }), mask), mask);
+            case EOP_MUL_ASSIGN: r = Eval(n.a, mask); return Store(*var, Check(Map(*var, r, [](double a, double b) { return a * b; }), mask), mask);
+            case EOP_DIV_ASSIGN: r = Eval(n.a, mask); return Store(*var, Check(Map(*var, r, [](double a, double b) { return a / b; }), mask), mask);
+            case EOP_SEQ: Eval(n.a, mask); return Eval(n.b, mask);
+            case EOP_IF:
+            {
+                unsigned t = NonZero(Eval(n.a, mask), mask);
+                if (t)
+                    Store(r, Eval(n.b, t), t);
+                if (mask & ~t)
+                    Store(r, Eval(n.c, mask & ~t), mask & ~t);
+                return r;
+            }
+            case EOP_AND:
+            {
+                unsigned t = NonZero(Eval(n.a, mask), mask);
+                return Bool(t ? NonZero(Eval(n.b, t), t) : 0);
+            }
+            case EOP_OR:
+            {
+                unsigned t = NonZero(Eval(n.a, mask), mask);
+                unsigned f = mask & ~t;
+                return Bool(t | (f ? NonZero(Eval(n.b, f), f) : 0));
+            }
+            case EOP_NOT: return Bool(mask & ~NonZero(Eval(n.a, mask), mask));
+            case EOP_NEG:
+                r = Eval(n.a, mask);
+                for (double& v : r.v)
+                    v = -v;
+                return Check(r, mask);
+            default: break;
+        }
+
+        td_eellanes a = Eval(n.a, mask);
+        td_eellanes b = (n.b >= 0) ? Eval(n.b, mask) : r;
+        switch (n.op)
+        {
+            case EOP_EQ:
+            case EOP_NE:
+            {
+                unsigned ne = NonZero(Map(a, b, [](double x, double y) { return x - y; }), mask);
+                return Bool((n.op == EOP_EQ) ? (mask & ~ne) : ne);
+            }
+            case EOP_LT: return Bool(Test(a, b, mask, [](double x, double y) { return x < y; }));
+            case EOP_GT: return Bool(Test(a, b, mask, [](double x, double y) { return x > y; }));
+            case EOP_LE: return Bool(Test(a, b, mask, [](double x, double y) { return x <= y; }));
+            case EOP_GE: return Bool(Test(a, b, mask, [](double x, double y) { return x >= y; }));
+            case EOP_BAND: return Bool(NonZero(a, mask) & NonZero(b, mask));
+            case EOP_BOR: return Bool(NonZero(a, mask) | NonZero(b, mask));
+            case EOP_ADD: return Check(Map(a, b, [](double x, double y) { return x + y; }), mask);
+            case EOP_SUB: return Check(Map(a, b, [](double x, double y) { return x - y; }), mask);
+            case EOP_MUL: return Check(Map(a, b, [](double x, double y) { return x * y; }), mask);
+            case EOP_DIV: return Check(Map(a, b, [](double x, double y) { return x / y; }), mask);
+            case EOP_POW: return Check(Map(a, b, [](double x, double y) { return pow(x, y); }), mask);
+            case EOP_CALL: return Check(Call(static_cast<EelFunc>(n.fn), a, b, mask), mask);
+            default: break;
+        }
+        return r;
+    }
+
+    td_eellanes Call(EelFunc fn, const td_eellanes& a, const td_eellanes& b, unsigned mask)
+    {
+        switch (fn)
+        {
+            case EFN_SIN: return Map(a, b, [](double x, double) { return sin(x); });
+            case EFN_COS: return Map(a, b, [](double x, double) { return cos(x); });
+            case EFN_TAN: return Map(a, b, [](double x, double) { return tan(x); });
+            case EFN_ASIN: return Map(a, b, [](double x, double) { return asin(x); });
+            case EFN_ACOS: return Map(a, b, [](double x, double) { return acos(x); });
+            case EFN_ATAN: return Map(a, b, [](double x, double) { return atan(x); });
+            case EFN_ATAN2: return Map(a, b, [](double x, double y) { return atan2(x, y); });
+            case EFN_EXP: return Map(a, b, [](double x, double) { return exp(x); });
+            case EFN_LOG: return Map(a, b, [](double x, double) { return log(x); });
+            case EFN_LOG10: return Map(a, b, [](double x, double) { return log10(x); });
+            case EFN_SQRT:
+                // EEL2 takes the square root of the absolute value.
+                if (Test(a, a, mask, [](double x, double) { return x < 0.0; }))
+                    m_bOk = false;
+                return Map(a, b, [](double x, double) { return sqrt(x); });
+            case EFN_SQR: return Map(a, b, [](double x, double) { return x * x; });
+            case EFN_ABS: return Map(a, b, [](double x, double) { return fabs(x); });
+            case EFN_MIN: return Map(a, b, [](double x, double y) { return (x < y) ? x : y; });
+            case EFN_MAX: return Map(a, b, [](double x, double y) { return (x > y) ? x : y; });
+            case EFN_FLOOR: return Map(a, b, [](double x, double) { return floor(x); });
+            case EFN_CEIL: return Map(a, b, [](double x, double) { return ceil(x); });
+            case EFN_SIGN: return Map(a, b, [](double x, double) { return (x > 0.0) ? 1.0 : (x < 0.0) ? -1.0 : 0.0; });
+        }
+        return a;
+    }
+
+    const std::vector<td_eelnode>& m_nodes;
+    std::vector<td_eellanes>& m_vars;
+    bool m_bOk;
+};
+} // namespace
+
+bool EelRunOnce(const char* code, EelVarResolver resolve, void* user)
+{
+    std::vector<td_eelnode> nodes;
+    std::vector<std::string> names;
+    nodes.reserve(64);
+    int root = CEelParser(code, nodes, names).Parse();
+    if (root < 0)
+        return false;
+
+    // Run against copies, in the first lane, and only write back if the
+    // whole program ran.
+    std::vector<double*> ptrs(names.size());
+    std::vector<td_eellanes> vars(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if ((ptrs[i] = resolve(user, names[i].c_str())) == nullptr)
+            return false;
+        vars[i].v[0] = *ptrs[i];
+    }
+    if (!CEelEvaluator(nodes, vars).Run(root, 1u))
+        return false;
+    for (size_t i = 0; i < names.size(); i++)
+        *ptrs[i] = vars[i].v[0];
+    return true;
+}
+
+bool CEelLaneProgram::Compile(const char* code, EelVarResolver resolve, void* user, const char* const* szLaneVars, int nLaneVars)
+{
+    m_nodes.clear();
+    m_nRoot = -1;
+    std::vector<std::string> names(szLaneVars, szLaneVars + nLaneVars);
+    int root = CEelParser(code, m_nodes, names).Parse();
+    if (root < 0)
+        return false;
+
+    m_pVars.resize(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        if ((m_pVars[i] = resolve(user, names[i].c_str())) == nullptr)
+            return false;
+
+    std::vector<bool> written(names.size(), false);
+    for (const td_eelnode& n : m_nodes)
+        if (n.op >= EOP_ASSIGN && n.op <= EOP_DIV_ASSIGN)
+            written[static_cast<size_t>(n.var)] = true;
+    std::vector<bool> assigned(names.size(), false);
+    for (int i = 0; i < nLaneVars; i++)
+        assigned[static_cast<size_t>(i)] = true;
+    if (!IsStateless(m_nodes, root, written, assigned))
+        return false;
+
+    m_nWritten.clear();
+    for (size_t i = static_cast<size_t>(nLaneVars); i < names.size(); i++)
+        if (written[i])
+            m_nWritten.push_back(static_cast<int>(i));
+    m_lanes.assign(names.size(), td_eellanes{});
+    m_nLaneVars = nLaneVars;
+    m_nRoot = root;
+    return true;
+}
+
+bool CEelLaneProgram::Run(int nLanes)
+{
+    if (m_nRoot < 0)
+        return false;
+    for (size_t i = static_cast<size_t>(m_nLaneVars); i < m_lanes.size(); i++)
+        for (double& v : m_lanes[i].v)
+            v = *m_pVars[i];
+    unsigned mask = ALL_LANES >> (EEL_LANES - nLanes);
+    if (!CEelEvaluator(m_nodes, m_lanes).Run(m_nRoot, mask))
+        return false;
+    for (int i : m_nWritten)
+        *m_pVars[static_cast<size_t>(i)] = m_lanes[static_cast<size_t>(i)].v[nLanes - 1];
+    return true;
+}
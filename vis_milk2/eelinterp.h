@@ -0,0 +1,90 @@
+/*
+ * eelinterp.h - Interpreter for run-once and lane-parallel EEL code header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Number of invocations `CEelLaneProgram` evaluates at once.
+#define EEL_LANES 4
+
+// Returns the address of the VM variable `name`, creating it if needed.
+typedef double* (*EelVarResolver)(void* user, const char* name);
+
+// Handled subset of the language:
+//   numbers, variables, `;`, `( )`, `= += -= *= /=`, `+ - * / ^`,
+//   `== != < > <= >=`, `&& ||`, unary `+ - !`, `? :`,
+//   `if above below equal band bor bnot sign`, and
+//   `sin cos tan asin acos atan atan2 exp log log10 pow sqrt sqr abs min max floor ceil`.
+// Anything else (loops, memory, registers, `rand`, user functions, ...) is
+// left to the regular backend, as are programs where an operand or a function
+// argument assigns (unlike `&&` and `||`, `band` and `bor` always evaluate
+// both arguments).
+
+// Runs `code` once without compiling it, reading and writing variables
+// through `resolve`.
+//
+// Returns false, leaving every variable unchanged, if the code uses anything
+// outside the subset above or if any intermediate result is not finite,
+// subnormal, negative zero or too close to zero to tell true from false
+// (where the expression backends may differ). The caller should then
+// compile and execute the code as usual.
+bool EelRunOnce(const char* code, EelVarResolver resolve, void* user);
+
+typedef struct
+{
+    double v[EEL_LANES];
+} td_eellanes;
+
+typedef struct
+{
+    int op;
+    int fn;   // function for calls
+    int a;    // operands, as node indices
+    int b;
+    int c;
+    int var;  // variable slot for variables and assignments
+    double value;
+    bool bAssigns; // the subtree writes to a variable
+} td_eelnode;
+
+// A per-vertex (or per-point) program evaluated for `EEL_LANES`
+// invocations at a time, one per lane.
+//
+// Only programs without state carried from one invocation to the next can
+// be run this way: every variable the program writes must be either one of
+// the lane variables the host sets before each invocation, or assigned on
+// every path before it is read. Variables the program only reads are taken
+// from the VM when `Run()` is called, the same for all lanes.
+class CEelLaneProgram
+{
+  public:
+    CEelLaneProgram() : m_nLaneVars(0), m_nRoot(-1) {}
+
+    // Returns false if `code` is outside the subset or carries state.
+    // `szLaneVars` become slots `0` to `nLaneVars - 1`.
+    bool Compile(const char* code, EelVarResolver resolve, void* user, const char* const* szLaneVars, int nLaneVars);
+
+    // Lanes of lane variable `slot`, to be filled in before `Run()` and read afterwards.
+    double* Lanes(int slot) { return m_lanes[static_cast<size_t>(slot)].v; }
+
+    // Evaluates the first `nLanes` lanes. Afterwards the VM holds the
+    // variables of the last lane, as if the invocations had run in order.
+    // Returns false if any lane hit a value where the backends may differ;
+    // the caller must then run those invocations through the backend. No
+    // VM variable is changed in that case.
+    bool Run(int nLanes);
+
+  private:
+    std::vector<td_eelnode> m_nodes;
+    std::vector<double*> m_pVars;     // VM address of each slot
+    std::vector<td_eellanes> m_lanes; // lanes of each slot
+    std::vector<int> m_nWritten;      // slots the program assigns, past the lane variables
+    int m_nLaneVars;
+    int m_nRoot;
+};
@@ -0,0 +1,986 @@
+/*
+ * evaluator.cpp - Renderer-independent preset evaluation.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "pch.h"
+#include "evaluator.h"
+#include "utility.h"
+
+void CPresetEvaluator::InitMesh(const td_evalframe& f, CMeshStreams& mesh, td_vertinfo* vertinfo)
+{
+    mesh.Init(f.nGridX, f.nGridY, f.fAspectX, f.fAspectY, f.nTexSizeX, f.nTexSizeY);
+    const float* pRad = mesh.GetRad();
+    const float* pAng = mesh.GetAng();
+    const int nVerts = static_cast<int>(mesh.GetCount());
+    for (int n = 0; n < nVerts; n++)
+    {
+        vertinfo[n].rad = pRad[n];
+        vertinfo[n].ang = pAng[n];
+        vertinfo[n].a = 1;
+        vertinfo[n].c = 0;
+    }
+}
+
+// Loads the `var_pf_*` variables in this CState object with the correct values.
+// for vars that affect pixel motion, that means evaluating them at time==-1,
+// (i.e. no blending with blend to value); the blending of the file dx/dy
+// will be done *after* execution of the per-vertex code.
+// for vars that do NOT affect pixel motion, evaluate them at the current time,
+// so that if they're blending, both states see the blended value.
+// clang-format off
+void CPresetEvaluator::LoadPerFrameEvallibVars(CState* pState, const td_evalframe& f) const
+{
+    // 1. Vars that affect pixel motion (eval at time == -1).
+    *pState->var_pf_zoom        = (double)pState->m_fZoom.eval(-1.0f); // f.fTime);
+    *pState->var_pf_zoomexp     = (double)pState->m_fZoomExponent.eval(-1.0f); // f.fTime);
+    *pState->var_pf_rot         = (double)pState->m_fRot.eval(-1.0f); //f.fTime);
+    *pState->var_pf_warp        = (double)pState->m_fWarpAmount.eval(-1.0f); //f.fTime);
+    *pState->var_pf_cx          = (double)pState->m_fRotCX.eval(-1.0f); //f.fTime);
+    *pState->var_pf_cy          = (double)pState->m_fRotCY.eval(-1.0f); //f.fTime);
+    *pState->var_pf_dx          = (double)pState->m_fXPush.eval(-1.0f); //f.fTime);
+    *pState->var_pf_dy          = (double)pState->m_fYPush.eval(-1.0f); //f.fTime);
+    *pState->var_pf_sx          = (double)pState->m_fStretchX.eval(-1.0f); //f.fTime);
+    *pState->var_pf_sy          = (double)pState->m_fStretchY.eval(-1.0f); //f.fTime);
+    // Read-only.
+    *pState->var_pf_time        = (double)(f.fTime - f.fStartTime);
+    *pState->var_pf_fps         = (double)f.fFps;
+    *pState->var_pf_bass        = (double)f.imm_rel[0];
+    *pState->var_pf_mid         = (double)f.imm_rel[1];
+    *pState->var_pf_treb        = (double)f.imm_rel[2];
+    *pState->var_pf_bass_att    = (double)f.avg_rel[0];
+    *pState->var_pf_mid_att     = (double)f.avg_rel[1];
+    *pState->var_pf_treb_att    = (double)f.avg_rel[2];
+    *pState->var_pf_frame       = (double)f.nFrame;
+    //*pState->var_pf_monitor     = 0; -leave this as it was set in the per-frame INIT code!
+    for (int vi=0; vi<NUM_Q_VAR; vi++)
+        *pState->var_pf_q[vi]   = pState->q_values_after_init_code[vi]; //0.0f;
+    *pState->var_pf_monitor     = pState->monitor_after_init_code;
+    *pState->var_pf_progress    = (f.fTime - f.fPresetStartTime) / (f.fNextPresetTime - f.fPresetStartTime);
+
+    // 2. Vars that do NOT affect pixel motion (eval at time == now).
+    *pState->var_pf_decay         = (double)pState->m_fDecay.eval(f.fTime);
+    *pState->var_pf_wave_a        = (double)pState->m_fWaveAlpha.eval(f.fTime);
+    *pState->var_pf_wave_r        = (double)pState->m_fWaveR.eval(f.fTime);
+    *pState->var_pf_wave_g        = (double)pState->m_fWaveG.eval(f.fTime);
+    *pState->var_pf_wave_b        = (double)pState->m_fWaveB.eval(f.fTime);
+    *pState->var_pf_wave_x        = (double)pState->m_fWaveX.eval(f.fTime);
+    *pState->var_pf_wave_y        = (double)pState->m_fWaveY.eval(f.fTime);
+    *pState->var_pf_wave_mystery  = (double)pState->m_fWaveParam.eval(f.fTime);
+    *pState->var_pf_wave_mode     = (double)pState->m_nWaveMode; //?!?! -why won't it work if set to pState->m_nWaveMode???
+    *pState->var_pf_ob_size       = (double)pState->m_fOuterBorderSize.eval(f.fTime);
+    *pState->var_pf_ob_r          = (double)pState->m_fOuterBorderR.eval(f.fTime);
+    *pState->var_pf_ob_g          = (double)pState->m_fOuterBorderG.eval(f.fTime);
+    *pState->var_pf_ob_b          = (double)pState->m_fOuterBorderB.eval(f.fTime);
+    *pState->var_pf_ob_a          = (double)pState->m_fOuterBorderA.eval(f.fTime);
+    *pState->var_pf_ib_size       = (double)pState->m_fInnerBorderSize.eval(f.fTime);
+    *pState->var_pf_ib_r          = (double)pState->m_fInnerBorderR.eval(f.fTime);
+    *pState->var_pf_ib_g          = (double)pState->m_fInnerBorderG.eval(f.fTime);
+    *pState->var_pf_ib_b          = (double)pState->m_fInnerBorderB.eval(f.fTime);
+    *pState->var_pf_ib_a          = (double)pState->m_fInnerBorderA.eval(f.fTime);
+    *pState->var_pf_mv_x          = (double)pState->m_fMvX.eval(f.fTime);
+    *pState->var_pf_mv_y          = (double)pState->m_fMvY.eval(f.fTime);
+    *pState->var_pf_mv_dx         = (double)pState->m_fMvDX.eval(f.fTime);
+    *pState->var_pf_mv_dy         = (double)pState->m_fMvDY.eval(f.fTime);
+    *pState->var_pf_mv_l          = (double)pState->m_fMvL.eval(f.fTime);
+    *pState->var_pf_mv_r          = (double)pState->m_fMvR.eval(f.fTime);
+    *pState->var_pf_mv_g          = (double)pState->m_fMvG.eval(f.fTime);
+    *pState->var_pf_mv_b          = (double)pState->m_fMvB.eval(f.fTime);
+    *pState->var_pf_mv_a          = (double)pState->m_fMvA.eval(f.fTime);
+    *pState->var_pf_echo_zoom     = (double)pState->m_fVideoEchoZoom.eval(f.fTime);
+    *pState->var_pf_echo_alpha    = (double)pState->m_fVideoEchoAlpha.eval(f.fTime);
+    *pState->var_pf_echo_orient   = (double)pState->m_nVideoEchoOrientation;
+    *pState->var_pf_wave_usedots  = (double)pState->m_bWaveDots;
+    *pState->var_pf_wave_thick    = (double)pState->m_bWaveThick;
+    *pState->var_pf_wave_additive = (double)pState->m_bAdditiveWaves;
+    *pState->var_pf_wave_brighten = (double)pState->m_bMaximizeWaveColor;
+    *pState->var_pf_darken_center = (double)pState->m_bDarkenCenter;
+    *pState->var_pf_gamma         = (double)pState->m_fGammaAdj.eval(f.fTime);
+    *pState->var_pf_wrap          = (double)pState->m_bTexWrap;
+    *pState->var_pf_invert        = (double)pState->m_bInvert;
+    *pState->var_pf_brighten      = (double)pState->m_bBrighten;
+    *pState->var_pf_darken        = (double)pState->m_bDarken;
+    *pState->var_pf_solarize      = (double)pState->m_bSolarize;
+    *pState->var_pf_meshx         = (double)f.nGridX;
+    *pState->var_pf_meshy         = (double)f.nGridY;
+    *pState->var_pf_pixelsx       = (double)f.nWidth;
+    *pState->var_pf_pixelsy       = (double)f.nHeight;
+    *pState->var_pf_aspectx       = (double)f.fInvAspectX;
+    *pState->var_pf_aspecty       = (double)f.fInvAspectY;
+    *pState->var_pf_blur1min      = (double)pState->m_fBlur1Min.eval(f.fTime);
+    *pState->var_pf_blur2min      = (double)pState->m_fBlur2Min.eval(f.fTime);
+    *pState->var_pf_blur3min      = (double)pState->m_fBlur3Min.eval(f.fTime);
+    *pState->var_pf_blur1max      = (double)pState->m_fBlur1Max.eval(f.fTime);
+    *pState->var_pf_blur2max      = (double)pState->m_fBlur2Max.eval(f.fTime);
+    *pState->var_pf_blur3max      = (double)pState->m_fBlur3Max.eval(f.fTime);
+    *pState->var_pf_blur1_edge_darken = (double)pState->m_fBlur1EdgeDarken.eval(f.fTime);
+}
+
+// Run per-frame calculations.
+float CPresetEvaluator::RunPerFrameEquations(CState* pCurState, CState* pOldState, int code, const td_evalframe& f) const
+{
+    /*
+      Code is only valid when blending.
+          OLDcomp ~ blend-from preset has a composite shader.
+          NEWwarp ~ blend-to preset has a warp shader, etc.
+
+      code OLDcomp NEWcomp OLDwarp NEWwarp
+        0
+        1            1
+        2                            1
+        3            1               1
+        4     1
+        5     1      1
+        6     1                      1
+        7     1      1               1
+        8                    1
+        9            1       1
+        10                   1       1
+        11           1       1       1
+        12    1              1
+        13    1      1       1
+        14    1              1       1
+        15    1      1       1       1
+    */
+
+    // When blending booleans (like darken, invert, etc) for pre-shader presets,
+    // if blending to/from a pixel-shader preset, it is possible to tune the snap
+    // point (when it changes during the blend) for a less jumpy transition.
+    float fSnapPoint = 0.5f;
+    if (pCurState->m_bBlending)
+    {
+        switch (code)
+        {
+            case 4:
+            case 6:
+            case 12:
+            case 14:
+                // Old preset (only) had a comp shader.
+                fSnapPoint = -0.01f;
+                break;
+            case 1:
+            case 3:
+            case 9:
+            case 11:
+                // New preset (only) has a comp shader.
+                fSnapPoint = 1.01f;
+                break;
+            case 0:
+            case 2:
+            case 8:
+            case 10:
+                // Neither old or new preset had a comp shader.
+                fSnapPoint = 0.5f;
+                break;
+            case 5:
+            case 7:
+            case 13:
+            case 15:
+                // Both old and new presets use a comp shader - so it won't matter.
+                fSnapPoint = 0.5f;
+                break;
+        }
+    }
+
+    int num_reps = (pCurState->m_bBlending) ? 2 : 1;
+    for (int rep = 0; rep < num_reps; rep++)
+    {
+        CState* pState;
+
+        if (rep == 0)
+            pState = pCurState;
+        else
+            pState = pOldState;
+
+        // Values that will affect the pixel motion (and will be automatically blended
+        // LATER, when the results of 2 sets of these params creates 2 different U/V
+        // meshes that get blended together).
+        LoadPerFrameEvallibVars(pState, f);
+
+        // Also do just a once-per-frame init for the *per-**VERTEX*** *READ-ONLY* variables
+        // (the non-read-only ones will be reset/restored at the start of each vertex)
+        *pState->var_pv_time     = *pState->var_pf_time;
+        *pState->var_pv_fps      = *pState->var_pf_fps;
+        *pState->var_pv_frame    = *pState->var_pf_frame;
+        *pState->var_pv_progress = *pState->var_pf_progress;
+        *pState->var_pv_bass     = *pState->var_pf_bass;
+        *pState->var_pv_mid      = *pState->var_pf_mid;
+        *pState->var_pv_treb     = *pState->var_pf_treb;
+        *pState->var_pv_bass_att = *pState->var_pf_bass_att;
+        *pState->var_pv_mid_att  = *pState->var_pf_mid_att;
+        *pState->var_pv_treb_att = *pState->var_pf_treb_att;
+        *pState->var_pv_meshx    = (double)f.nGridX;
+        *pState->var_pv_meshy    = (double)f.nGridY;
+        *pState->var_pv_pixelsx  = (double)f.nWidth;
+        *pState->var_pv_pixelsy  = (double)f.nHeight;
+        *pState->var_pv_aspectx  = (double)f.fInvAspectX;
+        *pState->var_pv_aspecty  = (double)f.fInvAspectY;
+        //*pState->var_pv_monitor = *pState->var_pf_monitor;
+
+#ifndef _NO_EXPR_
+        // Execute once-per-frame expressions.
+        if (pState->m_pf_codehandle)
+        {
+            NSEEL_code_execute(pState->m_pf_codehandle);
+        }
+#endif
+
+        // Save some things for next frame.
+        pState->monitor_after_init_code = *pState->var_pf_monitor;
+
+        // Save some things for per-vertex code.
+        for (int vi = 0; vi < NUM_Q_VAR; vi++)
+            *pState->var_pv_q[vi] = *pState->var_pf_q[vi];
+
+        // Range checks.
+        *pState->var_pf_gamma = std::max(0.0, std::min(double(8), *pState->var_pf_gamma));
+        *pState->var_pf_echo_zoom = std::max(0.001, std::min(double(1000), *pState->var_pf_echo_zoom));
+
+        /*
+        if (pCurState->m_bRedBlueStereo || m_bAlways3D)
+        {
+            // Override wave colors.
+            *pState->var_pf_wave_r = 0.35f * (*pState->var_pf_wave_r) + 0.65f;
+            *pState->var_pf_wave_g = 0.35f * (*pState->var_pf_wave_g) + 0.65f;
+            *pState->var_pf_wave_b = 0.35f * (*pState->var_pf_wave_b) + 0.65f;
+        }
+        */
+    }
+
+    if (pCurState->m_bBlending)
+    {
+        // For all variables that do NOT affect pixel motion, blend them NOW,
+        // so later the user can just access pCurState->m_pf_whatever.
+        double mix = (double)CosineInterp(pCurState->m_fBlendProgress);
+        double mix2 = 1.0 - mix;
+        *pCurState->var_pf_decay        = mix * (*pCurState->var_pf_decay)        + mix2 * (*pOldState->var_pf_decay);
+        *pCurState->var_pf_wave_a       = mix * (*pCurState->var_pf_wave_a)       + mix2 * (*pOldState->var_pf_wave_a);
+        *pCurState->var_pf_wave_r       = mix * (*pCurState->var_pf_wave_r)       + mix2 * (*pOldState->var_pf_wave_r);
+        *pCurState->var_pf_wave_g       = mix * (*pCurState->var_pf_wave_g)       + mix2 * (*pOldState->var_pf_wave_g);
+        *pCurState->var_pf_wave_b       = mix * (*pCurState->var_pf_wave_b)       + mix2 * (*pOldState->var_pf_wave_b);
+        *pCurState->var_pf_wave_x       = mix * (*pCurState->var_pf_wave_x)       + mix2 * (*pOldState->var_pf_wave_x);
+        *pCurState->var_pf_wave_y       = mix * (*pCurState->var_pf_wave_y)       + mix2 * (*pOldState->var_pf_wave_y);
+        *pCurState->var_pf_wave_mystery = mix * (*pCurState->var_pf_wave_mystery) + mix2 * (*pOldState->var_pf_wave_mystery);
+        // wave_mode: exempt (integer)
+        *pCurState->var_pf_ob_size       = mix * (*pCurState->var_pf_ob_size)    + mix2 * (*pOldState->var_pf_ob_size);
+        *pCurState->var_pf_ob_r          = mix * (*pCurState->var_pf_ob_r)       + mix2 * (*pOldState->var_pf_ob_r);
+        *pCurState->var_pf_ob_g          = mix * (*pCurState->var_pf_ob_g)       + mix2 * (*pOldState->var_pf_ob_g);
+        *pCurState->var_pf_ob_b          = mix * (*pCurState->var_pf_ob_b)       + mix2 * (*pOldState->var_pf_ob_b);
+        *pCurState->var_pf_ob_a          = mix * (*pCurState->var_pf_ob_a)       + mix2 * (*pOldState->var_pf_ob_a);
+        *pCurState->var_pf_ib_size       = mix * (*pCurState->var_pf_ib_size)    + mix2 * (*pOldState->var_pf_ib_size);
+        *pCurState->var_pf_ib_r          = mix * (*pCurState->var_pf_ib_r)       + mix2 * (*pOldState->var_pf_ib_r);
+        *pCurState->var_pf_ib_g          = mix * (*pCurState->var_pf_ib_g)       + mix2 * (*pOldState->var_pf_ib_g);
+        *pCurState->var_pf_ib_b          = mix * (*pCurState->var_pf_ib_b)       + mix2 * (*pOldState->var_pf_ib_b);
+        *pCurState->var_pf_ib_a          = mix * (*pCurState->var_pf_ib_a)       + mix2 * (*pOldState->var_pf_ib_a);
+        *pCurState->var_pf_mv_x          = mix * (*pCurState->var_pf_mv_x)       + mix2 * (*pOldState->var_pf_mv_x);
+        *pCurState->var_pf_mv_y          = mix * (*pCurState->var_pf_mv_y)       + mix2 * (*pOldState->var_pf_mv_y);
+        *pCurState->var_pf_mv_dx         = mix * (*pCurState->var_pf_mv_dx)      + mix2 * (*pOldState->var_pf_mv_dx);
+        *pCurState->var_pf_mv_dy         = mix * (*pCurState->var_pf_mv_dy)      + mix2 * (*pOldState->var_pf_mv_dy);
+        *pCurState->var_pf_mv_l          = mix * (*pCurState->var_pf_mv_l)       + mix2 * (*pOldState->var_pf_mv_l);
+        *pCurState->var_pf_mv_r          = mix * (*pCurState->var_pf_mv_r)       + mix2 * (*pOldState->var_pf_mv_r);
+        *pCurState->var_pf_mv_g          = mix * (*pCurState->var_pf_mv_g)       + mix2 * (*pOldState->var_pf_mv_g);
+        *pCurState->var_pf_mv_b          = mix * (*pCurState->var_pf_mv_b)       + mix2 * (*pOldState->var_pf_mv_b);
+        *pCurState->var_pf_mv_a          = mix * (*pCurState->var_pf_mv_a)       + mix2 * (*pOldState->var_pf_mv_a);
+        *pCurState->var_pf_echo_zoom     = mix * (*pCurState->var_pf_echo_zoom)  + mix2 * (*pOldState->var_pf_echo_zoom);
+        *pCurState->var_pf_echo_alpha    = mix * (*pCurState->var_pf_echo_alpha) + mix2 * (*pOldState->var_pf_echo_alpha);
+        *pCurState->var_pf_echo_orient   = (mix < fSnapPoint) ? *pOldState->var_pf_echo_orient   : *pCurState->var_pf_echo_orient;
+        *pCurState->var_pf_wave_usedots  = (mix < fSnapPoint) ? *pOldState->var_pf_wave_usedots  : *pCurState->var_pf_wave_usedots;
+        *pCurState->var_pf_wave_thick    = (mix < fSnapPoint) ? *pOldState->var_pf_wave_thick    : *pCurState->var_pf_wave_thick;
+        *pCurState->var_pf_wave_additive = (mix < fSnapPoint) ? *pOldState->var_pf_wave_additive : *pCurState->var_pf_wave_additive;
+        *pCurState->var_pf_wave_brighten = (mix < fSnapPoint) ? *pOldState->var_pf_wave_brighten : *pCurState->var_pf_wave_brighten;
+        *pCurState->var_pf_darken_center = (mix < fSnapPoint) ? *pOldState->var_pf_darken_center : *pCurState->var_pf_darken_center;
+        *pCurState->var_pf_gamma         = mix * (*pCurState->var_pf_gamma) + mix2 * (*pOldState->var_pf_gamma);
+        *pCurState->var_pf_wrap          = (mix < fSnapPoint) ? *pOldState->var_pf_wrap     : *pCurState->var_pf_wrap;
+        *pCurState->var_pf_invert        = (mix < fSnapPoint) ? *pOldState->var_pf_invert   : *pCurState->var_pf_invert;
+        *pCurState->var_pf_brighten      = (mix < fSnapPoint) ? *pOldState->var_pf_brighten : *pCurState->var_pf_brighten;
+        *pCurState->var_pf_darken        = (mix < fSnapPoint) ? *pOldState->var_pf_darken   : *pCurState->var_pf_darken;
+        *pCurState->var_pf_solarize      = (mix < fSnapPoint) ? *pOldState->var_pf_solarize : *pCurState->var_pf_solarize;
+        *pCurState->var_pf_blur1min      = mix * (*pCurState->var_pf_blur1min) + mix2 * (*pOldState->var_pf_blur1min);
+        *pCurState->var_pf_blur2min      = mix * (*pCurState->var_pf_blur2min) + mix2 * (*pOldState->var_pf_blur2min);
+        *pCurState->var_pf_blur3min      = mix * (*pCurState->var_pf_blur3min) + mix2 * (*pOldState->var_pf_blur3min);
+        *pCurState->var_pf_blur1max      = mix * (*pCurState->var_pf_blur1max) + mix2 * (*pOldState->var_pf_blur1max);
+        *pCurState->var_pf_blur2max      = mix * (*pCurState->var_pf_blur2max) + mix2 * (*pOldState->var_pf_blur2max);
+        *pCurState->var_pf_blur3max      = mix * (*pCurState->var_pf_blur3max) + mix2 * (*pOldState->var_pf_blur3max);
+        *pCurState->var_pf_blur1_edge_darken = mix * (*pCurState->var_pf_blur1_edge_darken) + mix2 * (*pOldState->var_pf_blur1_edge_darken);
+    }
+
+    return fSnapPoint;
+}
+// clang-format on
+
+void CPresetEvaluator::LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int instance, const td_evalframe& f) const
+{
+    *pState->m_shape[i].var_pf_time      = (double)(f.fTime - f.fStartTime);
+    *pState->m_shape[i].var_pf_frame     = (double)f.nFrame;
+    *pState->m_shape[i].var_pf_fps       = (double)f.fFps;
+    *pState->m_shape[i].var_pf_progress  = (f.fTime - f.fPresetStartTime) / (f.fNextPresetTime - f.fPresetStartTime);
+    *pState->m_shape[i].var_pf_bass      = (double)f.imm_rel[0];
+    *pState->m_shape[i].var_pf_mid       = (double)f.imm_rel[1];
+    *pState->m_shape[i].var_pf_treb      = (double)f.imm_rel[2];
+    *pState->m_shape[i].var_pf_bass_att  = (double)f.avg_rel[0];
+    *pState->m_shape[i].var_pf_mid_att   = (double)f.avg_rel[1];
+    *pState->m_shape[i].var_pf_treb_att  = (double)f.avg_rel[2];
+    for (int vi = 0; vi < NUM_Q_VAR; vi++)
+        *pState->m_shape[i].var_pf_q[vi] = *pState->var_pf_q[vi];
+    for (int vi = 0; vi < NUM_T_VAR; vi++)
+        *pState->m_shape[i].var_pf_t[vi] = pState->m_shape[i].t_values_after_init_code[vi];
+    *pState->m_shape[i].var_pf_x         = pState->m_shape[i].x;
+    *pState->m_shape[i].var_pf_y         = pState->m_shape[i].y;
+    *pState->m_shape[i].var_pf_rad       = pState->m_shape[i].rad;
+    *pState->m_shape[i].var_pf_ang       = pState->m_shape[i].ang;
+    *pState->m_shape[i].var_pf_tex_zoom  = pState->m_shape[i].tex_zoom;
+    *pState->m_shape[i].var_pf_tex_ang   = pState->m_shape[i].tex_ang;
+    *pState->m_shape[i].var_pf_sides     = pState->m_shape[i].sides;
+    *pState->m_shape[i].var_pf_additive  = pState->m_shape[i].additive;
+    *pState->m_shape[i].var_pf_textured  = pState->m_shape[i].textured;
+    *pState->m_shape[i].var_pf_instances = pState->m_shape[i].instances;
+    *pState->m_shape[i].var_pf_instance  = instance;
+    *pState->m_shape[i].var_pf_thick     = pState->m_shape[i].thickOutline;
+    *pState->m_shape[i].var_pf_r         = pState->m_shape[i].r;
+    *pState->m_shape[i].var_pf_g         = pState->m_shape[i].g;
+    *pState->m_shape[i].var_pf_b         = pState->m_shape[i].b;
+    *pState->m_shape[i].var_pf_a         = pState->m_shape[i].a;
+    *pState->m_shape[i].var_pf_r2        = pState->m_shape[i].r2;
+    *pState->m_shape[i].var_pf_g2        = pState->m_shape[i].g2;
+    *pState->m_shape[i].var_pf_b2        = pState->m_shape[i].b2;
+    *pState->m_shape[i].var_pf_a2        = pState->m_shape[i].a2;
+    *pState->m_shape[i].var_pf_border_r  = pState->m_shape[i].border_r;
+    *pState->m_shape[i].var_pf_border_g  = pState->m_shape[i].border_g;
+    *pState->m_shape[i].var_pf_border_b  = pState->m_shape[i].border_b;
+    *pState->m_shape[i].var_pf_border_a  = pState->m_shape[i].border_a;
+}
+
+void CPresetEvaluator::LoadCustomWavePerFrameEvallibVars(CState* pState, int i, const td_evalframe& f) const
+{
+    *pState->m_wave[i].var_pf_time      = (double)(f.fTime - f.fStartTime);
+    *pState->m_wave[i].var_pf_frame     = (double)f.nFrame;
+    *pState->m_wave[i].var_pf_fps       = (double)f.fFps;
+    *pState->m_wave[i].var_pf_progress  = (f.fTime - f.fPresetStartTime) / (f.fNextPresetTime - f.fPresetStartTime);
+    *pState->m_wave[i].var_pf_bass      = (double)f.imm_rel[0];
+    *pState->m_wave[i].var_pf_mid       = (double)f.imm_rel[1];
+    *pState->m_wave[i].var_pf_treb      = (double)f.imm_rel[2];
+    *pState->m_wave[i].var_pf_bass_att  = (double)f.avg_rel[0];
+    *pState->m_wave[i].var_pf_mid_att   = (double)f.avg_rel[1];
+    *pState->m_wave[i].var_pf_treb_att  = (double)f.avg_rel[2];
+    for (int vi = 0; vi < NUM_Q_VAR; vi++)
+        *pState->m_wave[i].var_pf_q[vi] = *pState->var_pf_q[vi];
+    for (int vi = 0; vi < NUM_T_VAR; vi++)
+        *pState->m_wave[i].var_pf_t[vi] = pState->m_wave[i].t_values_after_init_code[vi];
+    *pState->m_wave[i].var_pf_r         = pState->m_wave[i].r;
+    *pState->m_wave[i].var_pf_g         = pState->m_wave[i].g;
+    *pState->m_wave[i].var_pf_b         = pState->m_wave[i].b;
+    *pState->m_wave[i].var_pf_a         = pState->m_wave[i].a;
+    *pState->m_wave[i].var_pf_samples   = pState->m_wave[i].samples;
+}
+
+// Runs the per-vertex code of `pState` for vertices `n` to `n + nLanes - 1`
+// through its lane program. Returns false if any of them must be run through
+// the compiled code instead.
+static bool RunPerVertexLanes(CState* pState, const td_evalframe& f, const float* pX, const float* pY, const td_vertinfo* vertinfo, int n, int nLanes)
+{
+    CEelLaneProgram* pLanes = pState->m_pp_lanes;
+    const double* pf[NUM_PV_LANES] = {NULL, NULL, NULL, NULL, pState->var_pf_zoom, pState->var_pf_zoomexp, pState->var_pf_rot, pState->var_pf_warp,
+                                      pState->var_pf_cx, pState->var_pf_cy, pState->var_pf_dx, pState->var_pf_dy, pState->var_pf_sx, pState->var_pf_sy};
+    for (int l = 0; l < nLanes; l++)
+    {
+        pLanes->Lanes(PV_LANE_X)[l] = (double)(pX[n + l] * 0.5f * f.fAspectX + 0.5f);
+        pLanes->Lanes(PV_LANE_Y)[l] = (double)(pY[n + l] * -0.5f * f.fAspectY + 0.5f);
+        pLanes->Lanes(PV_LANE_RAD)[l] = (double)vertinfo[n + l].rad;
+        pLanes->Lanes(PV_LANE_ANG)[l] = (double)vertinfo[n + l].ang;
+        for (int slot = PV_LANE_ZOOM; slot < NUM_PV_LANES; slot++)
+            pLanes->Lanes(slot)[l] = *pf[slot];
+    }
+    return pLanes->Run(nLanes);
+}
+
+void CPresetEvaluator::ComputeGridAlphaValues(CState* pCurState, CState* pOldState, const td_evalframe& f, CMeshStreams& mesh, const td_vertinfo* vertinfo) const
+{
+    const float* pX = mesh.GetX();
+    const float* pY = mesh.GetY();
+    float* pTu = mesh.GetTu();
+    float* pTv = mesh.GetTv();
+    float* pAlpha = mesh.GetAlpha();
+
+    float fBlend = pCurState->m_fBlendProgress;
+
+    // Warp.
+    float fWarpTime = f.fTime * pCurState->m_fWarpAnimSpeed;
+    float fWarpScaleInv = 1.0f / pCurState->m_fWarpScale.eval(f.fTime);
+    float w[4];
+    w[0] = 11.68f + 4.0f * cosf(fWarpTime * 1.413f + 10);
+    w[1] =  8.77f + 3.0f * cosf(fWarpTime * 1.113f + 7);
+    w[2] = 10.54f + 3.0f * cosf(fWarpTime * 1.233f + 3);
+    w[3] = 11.49f + 4.0f * cosf(fWarpTime * 0.933f + 5);
+
+    // Texel alignment.
+    float texel_offset_x = 0.5f / (float)f.nTexSizeX;
+    float texel_offset_y = 0.5f / (float)f.nTexSizeY;
+
+    int num_reps = (pCurState->m_bBlending) ? 2 : 1;
+
+    // To blend the two PV equations together, simulate both to get the final UV coords,
+    // then blend those final UV coords. Also write out an alpha value so that
+    // the second draw pass (which might use a different shader) can do blending.
+    for (int rep = 0; rep < num_reps; rep++)
+    {
+        CState* pState = (rep == 0) ? pCurState : pOldState;
+
+        // Cache the doubles as floats so that computations are a bit faster.
+        float fZoom    = static_cast<float>(*pState->var_pf_zoom);
+        float fZoomExp = static_cast<float>(*pState->var_pf_zoomexp);
+        float fRot     = static_cast<float>(*pState->var_pf_rot);
+        float fWarp    = static_cast<float>(*pState->var_pf_warp);
+        float fCX      = static_cast<float>(*pState->var_pf_cx);
+        float fCY      = static_cast<float>(*pState->var_pf_cy);
+        float fDX      = static_cast<float>(*pState->var_pf_dx);
+        float fDY      = static_cast<float>(*pState->var_pf_dy);
+        float fSX      = static_cast<float>(*pState->var_pf_sx);
+        float fSY      = static_cast<float>(*pState->var_pf_sy);
+
+        int n = 0;
+        const int nVerts = (f.nGridX + 1) * (f.nGridY + 1);
+        CEelLaneProgram* pLanes = m_bLaneEval ? pState->m_pp_lanes : NULL;
+        bool bLanesValid = false; // the lanes hold the results for the current batch of vertices
+
+        for (int y = 0; y <= f.nGridY; y++)
+        {
+            for (int x = 0; x <= f.nGridX; x++)
+            {
+                int lane = n % EEL_LANES;
+                if (pLanes && lane == 0)
+                    bLanesValid = RunPerVertexLanes(pState, f, pX, pY, vertinfo, n, std::min(EEL_LANES, nVerts - n));
+
+                if (bLanesValid)
+                {
+                    fZoom    = static_cast<float>(pLanes->Lanes(PV_LANE_ZOOM)[lane]);
+                    fZoomExp = static_cast<float>(pLanes->Lanes(PV_LANE_ZOOMEXP)[lane]);
+                    fRot     = static_cast<float>(pLanes->Lanes(PV_LANE_ROT)[lane]);
+                    fWarp    = static_cast<float>(pLanes->Lanes(PV_LANE_WARP)[lane]);
+                    fCX      = static_cast<float>(pLanes->Lanes(PV_LANE_CX)[lane]);
+                    fCY      = static_cast<float>(pLanes->Lanes(PV_LANE_CY)[lane]);
+                    fDX      = static_cast<float>(pLanes->Lanes(PV_LANE_DX)[lane]);
+                    fDY      = static_cast<float>(pLanes->Lanes(PV_LANE_DY)[lane]);
+                    fSX      = static_cast<float>(pLanes->Lanes(PV_LANE_SX)[lane]);
+                    fSY      = static_cast<float>(pLanes->Lanes(PV_LANE_SY)[lane]);
+                }
+                else if (pState->m_pp_codehandle)
+                {
+                    // Restore all the variables to their original states,
+                    // run the user-defined equations, then move the
+                    // results into local vars for computation as floats.
+                    *pState->var_pv_x       = (double)(pX[n] * 0.5f * f.fAspectX + 0.5f);
+                    *pState->var_pv_y       = (double)(pY[n] * -0.5f * f.fAspectY + 0.5f);
+                    *pState->var_pv_rad     = (double)vertinfo[n].rad;
+                    *pState->var_pv_ang     = (double)vertinfo[n].ang;
+                    *pState->var_pv_zoom    = *pState->var_pf_zoom;
+                    *pState->var_pv_zoomexp = *pState->var_pf_zoomexp;
+                    *pState->var_pv_rot     = *pState->var_pf_rot;
+                    *pState->var_pv_warp    = *pState->var_pf_warp;
+                    *pState->var_pv_cx      = *pState->var_pf_cx;
+                    *pState->var_pv_cy      = *pState->var_pf_cy;
+                    *pState->var_pv_dx      = *pState->var_pf_dx;
+                    *pState->var_pv_dy      = *pState->var_pf_dy;
+                    *pState->var_pv_sx      = *pState->var_pf_sx;
+                    *pState->var_pv_sy      = *pState->var_pf_sy;
+
+#ifndef _NO_EXPR_
+                    NSEEL_code_execute(pState->m_pp_codehandle);
+#endif
+
+                    fZoom    = static_cast<float>(*pState->var_pv_zoom);
+                    fZoomExp = static_cast<float>(*pState->var_pv_zoomexp);
+                    fRot     = static_cast<float>(*pState->var_pv_rot);
+                    fWarp    = static_cast<float>(*pState->var_pv_warp);
+                    fCX      = static_cast<float>(*pState->var_pv_cx);
+                    fCY      = static_cast<float>(*pState->var_pv_cy);
+                    fDX      = static_cast<float>(*pState->var_pv_dx);
+                    fDY      = static_cast<float>(*pState->var_pv_dy);
+                    fSX      = static_cast<float>(*pState->var_pv_sx);
+                    fSY      = static_cast<float>(*pState->var_pv_sy);
+                }
+
+                float fZoom2 = powf(fZoom, powf(fZoomExp, vertinfo[n].rad * 2.0f - 1.0f));
+
+                // Initial texcoords, with built-in zoom factor.
+                float fZoom2Inv = 1.0f / fZoom2;
+                float u = pX[n] * f.fAspectX * 0.5f * fZoom2Inv + 0.5f;
+                float v = -pY[n] * f.fAspectY * 0.5f * fZoom2Inv + 0.5f;
+
+                // Stretch on X, Y.
+                u = (u - fCX) / fSX + fCX;
+                v = (v - fCY) / fSY + fCY;
+
+                // Warping.
+                u += fWarp * 0.0035f * sinf(fWarpTime * 0.333f + fWarpScaleInv * (pX[n] * w[0] - pY[n] * w[3]));
+                v += fWarp * 0.0035f * cosf(fWarpTime * 0.375f - fWarpScaleInv * (pX[n] * w[2] + pY[n] * w[1]));
+                u += fWarp * 0.0035f * cosf(fWarpTime * 0.753f - fWarpScaleInv * (pX[n] * w[1] - pY[n] * w[2]));
+                v += fWarp * 0.0035f * sinf(fWarpTime * 0.825f + fWarpScaleInv * (pX[n] * w[0] + pY[n] * w[3]));
+
+                // Rotation.
+                float u2 = u - fCX;
+                float v2 = v - fCY;
+
+                float cos_rot = cosf(fRot);
+                float sin_rot = sinf(fRot);
+                u = u2 * cos_rot - v2 * sin_rot + fCX;
+                v = u2 * sin_rot + v2 * cos_rot + fCY;
+
+                // Translation.
+                u -= fDX;
+                v -= fDY;
+
+                // Undo aspect ratio fix.
+                u = (u - 0.5f) * f.fInvAspectX + 0.5f;
+                v = (v - 0.5f) * f.fInvAspectY + 0.5f;
+
+                // Final half-texel-offset translation.
+                u += texel_offset_x;
+                v += texel_offset_y;
+
+                if (rep == 0)
+                {
+                    // UV's for `pCurState`.
+                    pTu[n] = u;
+                    pTv[n] = v;
+                    pAlpha[n] = 1.0f;
+                }
+                else
+                {
+                    // Blend to UV's for `pOldState`.
+                    float mix2 = vertinfo[n].a * fBlend + vertinfo[n].c;
+                    mix2 = std::max(0.0f, std::min(1.0f, mix2));
+                    // If fBlend un-flipped, then mix2 is 0 at the beginning of a blend, 1 at the end...
+                    //                       and alphas are 0 at the beginning, 1 at the end.
+                    pTu[n] = pTu[n] * (mix2) + u * (1 - mix2);
+                    pTv[n] = pTv[n] * (mix2) + v * (1 - mix2);
+                    // Set the alpha values for blending between two presets.
+                    pAlpha[n] = mix2;
+                }
+
+                n++;
+            }
+        }
+    }
+}
+
+int CPresetEvaluator::EvalCustomWave(CState* pState, int i, const td_evalframe& f, float alpha_mult, WFVERTEX* v) const
+{
+    int nSamples = pState->m_wave[i].samples;
+    int max_samples = pState->m_wave[i].bSpectrum ? 512 : NUM_WAVEFORM_SAMPLES;
+    if (nSamples > max_samples)
+        nSamples = max_samples;
+    nSamples -= pState->m_wave[i].sep;
+
+    // 1. Execute per-frame code.
+    LoadCustomWavePerFrameEvallibVars(pState, i, f);
+
+    // 2.a. Do just a once-per-frame init for the *per-point* *READ-ONLY* variables
+    //      (the non-read-only ones will be reset/restored at the start of each vertex).
+    *pState->m_wave[i].var_pp_time     = *pState->m_wave[i].var_pf_time;
+    *pState->m_wave[i].var_pp_fps      = *pState->m_wave[i].var_pf_fps;
+    *pState->m_wave[i].var_pp_frame    = *pState->m_wave[i].var_pf_frame;
+    *pState->m_wave[i].var_pp_progress = *pState->m_wave[i].var_pf_progress;
+    *pState->m_wave[i].var_pp_bass     = *pState->m_wave[i].var_pf_bass;
+    *pState->m_wave[i].var_pp_mid      = *pState->m_wave[i].var_pf_mid;
+    *pState->m_wave[i].var_pp_treb     = *pState->m_wave[i].var_pf_treb;
+    *pState->m_wave[i].var_pp_bass_att = *pState->m_wave[i].var_pf_bass_att;
+    *pState->m_wave[i].var_pp_mid_att  = *pState->m_wave[i].var_pf_mid_att;
+    *pState->m_wave[i].var_pp_treb_att = *pState->m_wave[i].var_pf_treb_att;
+
+    NSEEL_code_execute(pState->m_wave[i].m_pf_codehandle);
+
+    for (int vi = 0; vi < NUM_Q_VAR; vi++)
+        *pState->m_wave[i].var_pp_q[vi] = *pState->m_wave[i].var_pf_q[vi];
+    for (int vi = 0; vi < NUM_T_VAR; vi++)
+        *pState->m_wave[i].var_pp_t[vi] = *pState->m_wave[i].var_pf_t[vi];
+
+    nSamples = (int)*pState->m_wave[i].var_pf_samples;
+    nSamples = std::min(512, nSamples);
+
+    if (!((nSamples >= 2) || (pState->m_wave[i].bUseDots && nSamples >= 1)))
+        return 0;
+
+    float tempdata[2][512];
+    float mult = ((pState->m_wave[i].bSpectrum) ? 0.15f : 0.004f) * pState->m_wave[i].scaling * pState->m_fWaveScale.eval(-1.0f);
+    const float* pdata1 = (pState->m_wave[i].bSpectrum) ? f.pSpectrum[0] : f.pWaveform[0];
+    const float* pdata2 = (pState->m_wave[i].bSpectrum) ? f.pSpectrum[1] : f.pWaveform[1];
+
+    // Initialize `tempdata[2][512]`.
+    int j0 = (pState->m_wave[i].bSpectrum) ? 0 : (max_samples - nSamples) / 2 - pState->m_wave[i].sep / 2;
+    int j1 = (pState->m_wave[i].bSpectrum) ? 0 : (max_samples - nSamples) / 2 + pState->m_wave[i].sep / 2;
+    float t = (pState->m_wave[i].bSpectrum) ? (max_samples - pState->m_wave[i].sep) / (float)nSamples : 1.0f;
+    float mix1 = powf(pState->m_wave[i].smoothing * 0.98f, 0.5f); // lower exponent -> more default smoothing
+    float mix2 = 1.0f - mix1;
+    // Smoothing.
+    tempdata[0][0] = pdata1[j0];
+    tempdata[1][0] = pdata2[j1];
+    for (int j = 1; j < nSamples; j++)
+    {
+        tempdata[0][j] = pdata1[(int)(j * t) + j0] * mix2 + tempdata[0][j - 1] * mix1;
+        tempdata[1][j] = pdata2[(int)(j * t) + j1] * mix2 + tempdata[1][j - 1] * mix1;
+    }
+    // Smooth again, backwards (this fixes the asymmetry of the beginning and end).
+    for (int j = nSamples - 2; j >= 0; j--)
+    {
+        tempdata[0][j] = tempdata[0][j] * mix2 + tempdata[0][j + 1] * mix1;
+        tempdata[1][j] = tempdata[1][j] * mix2 + tempdata[1][j + 1] * mix1;
+    }
+    // Finally, scale to final size.
+    for (int j = 0; j < nSamples; j++)
+    {
+        tempdata[0][j] *= mult;
+        tempdata[1][j] *= mult;
+    }
+
+    // 2. For each point, execute per-point code.
+    float j_mult = 1.0f / (float)(nSamples - 1);
+    for (int j = 0; j < nSamples; j++)
+    {
+        float t2 = j * j_mult;
+        float value1 = tempdata[0][j];
+        float value2 = tempdata[1][j];
+        *pState->m_wave[i].var_pp_sample = t2;
+        *pState->m_wave[i].var_pp_value1 = value1;
+        *pState->m_wave[i].var_pp_value2 = value2;
+        *pState->m_wave[i].var_pp_x = 0.5f + value1;
+        *pState->m_wave[i].var_pp_y = 0.5f + value2;
+        *pState->m_wave[i].var_pp_r = *pState->m_wave[i].var_pf_r;
+        *pState->m_wave[i].var_pp_g = *pState->m_wave[i].var_pf_g;
+        *pState->m_wave[i].var_pp_b = *pState->m_wave[i].var_pf_b;
+        *pState->m_wave[i].var_pp_a = *pState->m_wave[i].var_pf_a;
+
+#ifndef _NO_EXPR_
+        NSEEL_code_execute(pState->m_wave[i].m_pp_codehandle);
+#endif
+
+        v[j].x = (float)(*pState->m_wave[i].var_pp_x * 2 - 1) * f.fInvAspectX;
+        v[j].y = (float)(*pState->m_wave[i].var_pp_y * -2 + 1) * f.fInvAspectY;
+        v[j].z = 0;
+        v[j].a = COLOR_NORM(*pState->m_wave[i].var_pp_a * alpha_mult);
+        v[j].r = COLOR_NORM(*pState->m_wave[i].var_pp_r);
+        v[j].g = COLOR_NORM(*pState->m_wave[i].var_pp_g);
+        v[j].b = COLOR_NORM(*pState->m_wave[i].var_pp_b);
+    }
+
+    return nSamples;
+}
+
+int CPresetEvaluator::EvalCustomShape(CState* pState, int i, int instance, const td_evalframe& f, float alpha_mult, SPRITEVERTEX* v) const
+{
+    // 1. Execute per-frame code.
+    LoadCustomShapePerFrameEvallibVars(pState, i, instance, f);
+
+#ifndef _NO_EXPR_
+    if (pState->m_shape[i].m_pf_codehandle)
+    {
+        NSEEL_code_execute(pState->m_shape[i].m_pf_codehandle);
+    }
+#endif
+
+    int sides = (int)(*pState->m_shape[i].var_pf_sides);
+    if (sides < 3) sides = 3;
+    if (sides > 100) sides = 100;
+
+    // 2. Build the fan.
+    v[0].x = (float)(*pState->m_shape[i].var_pf_x * 2 - 1); // * ASPECT;
+    v[0].y = (float)(*pState->m_shape[i].var_pf_y * -2 + 1);
+    v[0].z = 0;
+    v[0].tu = 0.5f;
+    v[0].tv = 0.5f;
+    v[0].a = COLOR_NORM(*pState->m_shape[i].var_pf_a * alpha_mult);
+    v[0].r = COLOR_NORM(*pState->m_shape[i].var_pf_r);
+    v[0].g = COLOR_NORM(*pState->m_shape[i].var_pf_g);
+    v[0].b = COLOR_NORM(*pState->m_shape[i].var_pf_b);
+    v[1].a = COLOR_NORM(*pState->m_shape[i].var_pf_a2 * alpha_mult);
+    v[1].r = COLOR_NORM(*pState->m_shape[i].var_pf_r2);
+    v[1].g = COLOR_NORM(*pState->m_shape[i].var_pf_g2);
+    v[1].b = COLOR_NORM(*pState->m_shape[i].var_pf_b2);
+    for (int j = 1; j < sides + 1; j++)
+    {
+        float t = (j - 1) / (float)sides;
+        v[j].x = v[0].x + (float)*pState->m_shape[i].var_pf_rad * cosf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_ang + 3.1415927f * 0.25f) * f.fAspectY; // DON'T TOUCH!
+        v[j].y = v[0].y + (float)*pState->m_shape[i].var_pf_rad * sinf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_ang + 3.1415927f * 0.25f);              // DON'T TOUCH!
+        v[j].z = 0;
+        v[j].tu = 0.5f + 0.5f * cosf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_tex_ang + 3.1415927f * 0.25f) / ((float)*pState->m_shape[i].var_pf_tex_zoom) * f.fAspectY; // DON'T TOUCH!
+        v[j].tv = 0.5f + 0.5f * sinf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_tex_ang + 3.1415927f * 0.25f) / ((float)*pState->m_shape[i].var_pf_tex_zoom);              // DON'T TOUCH!
+        COPY_COLOR(v[j], v[1]);
+    }
+    v[sides + 1] = v[1];
+
+    return sides;
+}
+
+int CPresetEvaluator::EvalMotionVectors(CState* pState, const td_evalframe& f, const CMeshStreams& mesh, WFVERTEX* v) const
+{
+    // FLEXIBLE MOTION VECTOR FIELD
+    if ((float)*pState->var_pf_mv_a < 0.001f)
+        return 0;
+
+    int nX = (int)(*pState->var_pf_mv_x); // + 0.999f);
+    int nY = (int)(*pState->var_pf_mv_y); // + 0.999f);
+    float dx = (float)*pState->var_pf_mv_x - nX;
+    float dy = (float)*pState->var_pf_mv_y - nY;
+    if (nX > 64) { nX = 64; dx = 0; }
+    if (nY > 48) { nY = 48; dy = 0; }
+
+    if (nX <= 0 || nY <= 0)
+        return 0;
+
+    float dx2 = (float)(*pState->var_pf_mv_dx);
+    float dy2 = (float)(*pState->var_pf_mv_dy);
+
+    float len_mult = (float)*pState->var_pf_mv_l;
+    if (dx < 0) dx = 0;
+    if (dy < 0) dy = 0;
+    if (dx > 1) dx = 1;
+    if (dy > 1) dy = 1;
+    float inv_texsize = 1.0f / (float)f.nTexSizeX;
+    float min_len = 1.0f * inv_texsize;
+
+    WFVERTEX c;
+    c.r = COLOR_NORM((float)*pState->var_pf_mv_r);
+    c.g = COLOR_NORM((float)*pState->var_pf_mv_g);
+    c.b = COLOR_NORM((float)*pState->var_pf_mv_b);
+    c.a = COLOR_NORM((float)*pState->var_pf_mv_a);
+
+    int n = 0;
+    for (int y = 0; y < nY; y++)
+    {
+        float fy = (y + 0.25f) / (float)(nY + dy + 0.25f - 1.0f);
+
+        // Now move by offset.
+        fy -= dy2;
+
+        if (fy <= 0.0001f || fy >= 0.9999f)
+            continue;
+
+        for (int x = 0; x < nX; x++)
+        {
+            float fx = (x + 0.25f) / (float)(nX + dx + 0.25f - 1.0f);
+
+            // Now move by offset.
+            fx += dx2;
+
+            if (fx > 0.0001f && fx < 0.9999f)
+            {
+                float fx2 = 0.0f, fy2 = 0.0f;
+                ReversePropagatePoint(mesh, fx, fy, &fx2, &fy2); // NOTE: THIS IS REALLY A REVERSE-PROPAGATION
+
+                // Enforce minimum trail lengths.
+                // Note: `dx` and `dy` are reused here, which also nudges the
+                //       spacing of the remaining vectors (as it always has).
+                {
+                    dx = (fx2 - fx);
+                    dy = (fy2 - fy);
+                    dx *= len_mult;
+                    dy *= len_mult;
+                    float len = sqrtf(dx * dx + dy * dy);
+
+                    if (len > min_len)
+                    {
+                    }
+                    else if (len > 0.00000001f)
+                    {
+                        len = min_len / len;
+                        dx *= len;
+                        dy *= len;
+                    }
+                    else
+                    {
+                        dx = min_len;
+                        dy = min_len;
+                    }
+
+                    fx2 = fx + dx;
+                    fy2 = fy + dy;
+                }
+
+                v[n].x = fx * 2.0f - 1.0f;
+                v[n].y = fy * 2.0f - 1.0f;
+                v[n].z = 0.0f;
+                COPY_COLOR(v[n], c);
+                v[n + 1].x = fx2 * 2.0f - 1.0f;
+                v[n + 1].y = fy2 * 2.0f - 1.0f;
+                v[n + 1].z = 0.0f;
+                COPY_COLOR(v[n + 1], c);
+
+                n += 2;
+            }
+        }
+    }
+
+    return n;
+}
+
+bool CPresetEvaluator::ReversePropagatePoint(const CMeshStreams& mesh, float fx, float fy, float* fx2, float* fy2)
+{
+    float tu, tv;
+    if (!mesh.SampleUV(fx, fy, &tu, &tv))
+        return false;
+
+    *fx2 = tu;
+    *fy2 = 1.0f - tv;
+    return true;
+}
+
+void CPresetEvaluator::RandomizeBlendPattern(const td_evalframe& f, td_vertinfo* vertinfo) const
+{
+    if (!vertinfo)
+        return;
+
+    // Note: now avoid constant uniform blend because it is half-speed for shader blending.
+    //       (both old and new shaders would have to run on every pixel...)
+    int mixtype = 1 + (warand() % 3); //warand()%4;
+
+    if (mixtype == 0)
+    {
+        // Constant, uniform blend.
+        int nVert = 0;
+        for (int y = 0; y <= f.nGridY; y++)
+        {
+            for (int x = 0; x <= f.nGridX; x++)
+            {
+                vertinfo[nVert].a = 1;
+                vertinfo[nVert].c = 0;
+                nVert++;
+            }
+        }
+    }
+    else if (mixtype == 1)
+    {
+        // Directional wipe.
+        float ang = FRAND * 6.28f;
+        float vx = cosf(ang);
+        float vy = sinf(ang);
+        float band = 0.1f + 0.2f * FRAND; // 0.2 is good
+        float inv_band = 1.0f / band;
+
+        int nVert = 0;
+        for (int y = 0; y <= f.nGridY; y++)
+        {
+            float fy = (y / (float)f.nGridY) * f.fAspectY;
+            for (int x = 0; x <= f.nGridX; x++)
+            {
+                float fx = (x / (float)f.nGridX) * f.fAspectX;
+
+                // at t==0, mix rangse from -10..0
+                // at t==1, mix ranges from   1..11
+
+                float t = (fx - 0.5f) * vx + (fy - 0.5f) * vy + 0.5f;
+                t = (t - 0.5f) / sqrtf(2.0f) + 0.5f;
+
+                vertinfo[nVert].a = inv_band * (1 + band);
+                vertinfo[nVert].c = -inv_band + inv_band * t; //(x/(float)f.nGridX - 0.5f)/band;
+                nVert++;
+            }
+        }
+    }
+    else if (mixtype == 2)
+    {
+        // Plasma transition.
+        float band = 0.12f + 0.13f * FRAND; //0.02f + 0.18f*FRAND;
+        float inv_band = 1.0f / band;
+
+        // First generate plasma array of height values.
+        vertinfo[0].c = FRAND;
+        vertinfo[f.nGridX].c = FRAND;
+        vertinfo[f.nGridY * (f.nGridX + 1)].c = FRAND;
+        vertinfo[f.nGridY * (f.nGridX + 1) + f.nGridX].c = FRAND;
+        GenPlasma(f, vertinfo, 0, f.nGridX, 0, f.nGridY, 0.25f);
+
+        // then find min,max so we can normalize to [0..1] range and then to the proper 'constant offset' range.
+        float minc = vertinfo[0].c;
+        float maxc = vertinfo[0].c;
+        int x, y, nVert;
+
+        nVert = 0;
+        for (y = 0; y <= f.nGridY; y++)
+        {
+            for (x = 0; x <= f.nGridX; x++)
+            {
+                if (minc > vertinfo[nVert].c)
+                    minc = vertinfo[nVert].c;
+                if (maxc < vertinfo[nVert].c)
+                    maxc = vertinfo[nVert].c;
+                nVert++;
+            }
+        }
+
+        float mult = 1.0f / (maxc - minc);
+        nVert = 0;
+        for (y = 0; y <= f.nGridY; y++)
+        {
+            for (x = 0; x <= f.nGridX; x++)
+            {
+                float t = (vertinfo[nVert].c - minc) * mult;
+                vertinfo[nVert].a = inv_band * (1 + band);
+                vertinfo[nVert].c = -inv_band + inv_band * t;
+                nVert++;
+            }
+        }
+    }
+    else if (mixtype == 3)
+    {
+        // Radial blend.
+        float band = 0.02f + 0.14f * FRAND + 0.34f * FRAND;
+        float inv_band = 1.0f / band;
+        float dir = (float)((warand() % 2) * 2 - 1); // 1=outside-in, -1=inside-out
+
+        int nVert = 0;
+        for (int y = 0; y <= f.nGridY; y++)
+        {
+            float dy = (y / (float)f.nGridY - 0.5f) * f.fAspectY;
+            for (int x = 0; x <= f.nGridX; x++)
+            {
+                float dx = (x / (float)f.nGridX - 0.5f) * f.fAspectX;
+                float t = sqrtf(dx * dx + dy * dy) * 1.41421f;
+                if (dir == -1)
+                    t = 1 - t;
+
+                vertinfo[nVert].a = inv_band * (1 + band);
+                vertinfo[nVert].c = -inv_band + inv_band * t;
+                nVert++;
+            }
+        }
+    }
+}
+
+void CPresetEvaluator::GenPlasma(const td_evalframe& f, td_vertinfo* vertinfo, int x0, int x1, int y0, int y1, float dt) const
+{
+    int midx = (x0 + x1) / 2;
+    int midy = (y0 + y1) / 2;
+    float t00 = vertinfo[y0 * (f.nGridX + 1) + x0].c;
+    float t01 = vertinfo[y0 * (f.nGridX + 1) + x1].c;
+    float t10 = vertinfo[y1 * (f.nGridX + 1) + x0].c;
+    float t11 = vertinfo[y1 * (f.nGridX + 1) + x1].c;
+
+    if (y1 - y0 >= 2)
+    {
+        if (x0 == 0)
+            vertinfo[midy * (f.nGridX + 1) + x0].c = 0.5f * (t00 + t10) + (FRAND * 2 - 1) * dt * f.fAspectY;
+        vertinfo[midy * (f.nGridX + 1) + x1].c = 0.5f * (t01 + t11) + (FRAND * 2 - 1) * dt * f.fAspectY;
+    }
+    if (x1 - x0 >= 2)
+    {
+        if (y0 == 0)
+            vertinfo[y0 * (f.nGridX + 1) + midx].c = 0.5f * (t00 + t01) + (FRAND * 2 - 1) * dt * f.fAspectX;
+        vertinfo[y1 * (f.nGridX + 1) + midx].c = 0.5f * (t10 + t11) + (FRAND * 2 - 1) * dt * f.fAspectX;
+    }
+
+    if (y1 - y0 >= 2 && x1 - x0 >= 2)
+    {
+        // Do midpoint and recurse.
+        t00 = vertinfo[midy * (f.nGridX + 1) + x0].c;
+        t01 = vertinfo[midy * (f.nGridX + 1) + x1].c;
+        t10 = vertinfo[y0 * (f.nGridX + 1) + midx].c;
+        t11 = vertinfo[y1 * (f.nGridX + 1) + midx].c;
+        vertinfo[midy * (f.nGridX + 1) + midx].c = 0.25f * (t10 + t11 + t00 + t01) + (FRAND * 2 - 1) * dt;
+
+        GenPlasma(f, vertinfo, x0, midx, y0, midy, dt * 0.5f);
+        GenPlasma(f, vertinfo, midx, x1, y0, midy, dt * 0.5f);
+        GenPlasma(f, vertinfo, x0, midx, midy, y1, dt * 0.5f);
+        GenPlasma(f, vertinfo, midx, x1, midy, y1, dt * 0.5f);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * evaluator.h - Renderer-independent preset evaluation header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include "meshstreams.h"
+#include "state.h"
+#include "support.h"
+
+int warand();
+
+#define FRAND ((warand() % 7381) / 7380.0f)
+
+// clang-format off
+typedef struct { float rad; float ang; float a; float c; } td_vertinfo; //blending: mix = std::max(0, std::min(1, a * t + c));
+// clang-format on
+
+// Everything the preset expressions read from the host for one frame.
+// The plugin fills this in from the live shell; a headless driver can
+// fill it in from synthetic or recorded audio.
+typedef struct
+{
+    float fTime;            // current time, in seconds
+    float fStartTime;       // time of the first frame
+    float fPresetStartTime; // time the current preset was loaded
+    float fNextPresetTime;  // time of the next automatic preset switch
+    float fFps;
+    int nFrame;
+    float imm_rel[3];       // bass, mids, treble (relative to song; 1=avg, 0.9~below, 1.1~above)
+    float avg_rel[3];       // bass, mids, treble (relative to song; 1=avg, 0.9~below, 1.1~above)
+    const float* pWaveform[2]; // `NUM_WAVEFORM_SAMPLES` valid samples per channel
+    const float* pSpectrum[2]; // `NUM_FREQUENCIES` samples per channel
+    int nGridX;
+    int nGridY;
+    int nTexSizeX;
+    int nTexSizeY;
+    int nWidth;
+    int nHeight;
+    float fAspectX;
+    float fAspectY;
+    float fInvAspectX;
+    float fInvAspectY;
+} td_evalframe;
+
+// Runs the CPU side of a preset: per-frame equations, the per-vertex warp
+// mesh, custom waves and shapes, motion vectors and blend patterns.
+// Nothing in here touches the device; the results are left in the
+// `CState` variables and in the caller's vertex arrays, ready to draw.
+class CPresetEvaluator
+{
+  public:
+    CPresetEvaluator() : m_bLaneEval(true) {}
+
+    // Sizes `mesh` to the grid of `f`, computing its static streams, and
+    // fills in the polar coordinates of `vertinfo` to match.
+    static void InitMesh(const td_evalframe& f, CMeshStreams& mesh, td_vertinfo* vertinfo);
+
+    void LoadPerFrameEvallibVars(CState* pState, const td_evalframe& f) const;
+    void LoadCustomWavePerFrameEvallibVars(CState* pState, int i, const td_evalframe& f) const;
+    void LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int instance, const td_evalframe& f) const;
+
+    // Runs the per-frame code of the current (and, when blending, old)
+    // preset and blends the non-motion variables. Returns the snap point
+    // for blended booleans.
+    float RunPerFrameEquations(CState* pState, CState* pOldState, int code, const td_evalframe& f) const;
+
+    // Runs the per-vertex code and fills in the UV and blend alpha streams
+    // of `mesh`.
+    void ComputeGridAlphaValues(CState* pState, CState* pOldState, const td_evalframe& f, CMeshStreams& mesh, const td_vertinfo* vertinfo) const;
+
+    // Runs custom wave `i` and writes up to 512 points to `v`.
+    // Returns the number of points to draw, or 0 if there is nothing to draw.
+    int EvalCustomWave(CState* pState, int i, const td_evalframe& f, float alpha_mult, WFVERTEX* v) const;
+
+    // Runs one instance of custom shape `i` and writes its fan
+    // (`sides + 2` vertices, at most 102) to `v`. Returns the number of sides.
+    int EvalCustomShape(CState* pState, int i, int instance, const td_evalframe& f, float alpha_mult, SPRITEVERTEX* v) const;
+
+    // Fills `v` with line-list vertices for the motion vector field of
+    // `pState`. `v` must hold at least `64 * 48 * 2` vertices.
+    // Returns the number of vertices written.
+    int EvalMotionVectors(CState* pState, const td_evalframe& f, const CMeshStreams& mesh, WFVERTEX* v) const;
+
+    // Fills in the `a` and `c` blend coefficients of `vertinfo` with a random transition pattern.
+    void RandomizeBlendPattern(const td_evalframe& f, td_vertinfo* vertinfo) const;
+
+    static bool ReversePropagatePoint(const CMeshStreams& mesh, float fx, float fy, float* fx2, float* fy2);
+
+    // Evaluate per-vertex code `EEL_LANES` vertices at a time where the
+    // preset allows it. Turning this off forces the compiled code, for
+    // comparing the two.
+    bool m_bLaneEval;
+
+  private:
+    void GenPlasma(const td_evalframe& f, td_vertinfo* vertinfo, int x0, int x1, int y0, int y1, float dt) const;
+};
@@ -0,0 +1,143 @@
+/*
+ * extrude.cpp - Outline flattening and extrusion.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "extrude.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+constexpr int kMaxCubicSegments = 1000;
+
+td_point2f Normalize(td_point2f pt)
+{
+    float fLength = std::sqrt(pt.x * pt.x + pt.y * pt.y);
+    return {pt.x / fLength, pt.y / fLength};
+}
+
+typedef struct
+{
+    td_point2f pt;
+    td_point2f norm;
+    td_point2f interpNorm1; // end normal of the previous edge
+    td_point2f interpNorm2; // begin normal of the next edge
+} td_figurevertex;
+} // namespace
+
+float SnapCoordinate(float x)
+{
+    return std::floor(16.0f * x + 0.5f) / 16.0f;
+}
+
+td_point2f SnapPoint(td_point2f pt)
+{
+    return {SnapCoordinate(pt.x), SnapCoordinate(pt.y)};
+}
+
+void FlattenCubic(td_point2f p0, td_point2f p1, td_point2f p2, td_point2f p3, float fTolerance, std::vector<td_point2f>& points)
+{
+    // Wang's formula: the number of uniform segments that keeps the
+    // polyline within the tolerance, from the curve's second differences.
+    float ddx0 = p0.x - 2.0f * p1.x + p2.x, ddy0 = p0.y - 2.0f * p1.y + p2.y;
+    float ddx1 = p1.x - 2.0f * p2.x + p3.x, ddy1 = p1.y - 2.0f * p2.y + p3.y;
+    float fMax = std::sqrt(std::max(ddx0 * ddx0 + ddy0 * ddy0, ddx1 * ddx1 + ddy1 * ddy1));
+    int nSegments = fTolerance > 0.0f ? static_cast<int>(std::ceil(std::sqrt(0.75f * fMax / fTolerance))) : kMaxCubicSegments;
+    nSegments = std::clamp(nSegments, 1, kMaxCubicSegments);
+
+    for (int i = 1; i < nSegments; i++)
+    {
+        float t = static_cast<float>(i) / static_cast<float>(nSegments);
+        float u = 1.0f - t;
+        float b0 = u * u * u, b1 = 3.0f * u * u * t, b2 = 3.0f * u * t * t, b3 = t * t * t;
+        points.push_back({b0 * p0.x + b1 * p1.x + b2 * p2.x + b3 * p3.x, b0 * p0.y + b1 * p1.y + b2 * p2.y + b3 * p3.y});
+    }
+    points.push_back(p3);
+}
+
+void ExtrudeFigure(const std::vector<td_point2f>& figure, float fDepth, std::vector<td_extrudevertex>& vertices)
+{
+    // Degenerate edges have no normal.
+    std::vector<td_figurevertex> v;
+    v.reserve(figure.size());
+    for (const td_point2f& pt : figure)
+        if (v.empty() || pt.x != v.back().pt.x || pt.y != v.back().pt.y)
+            v.push_back({pt, {}, {}, {}});
+    if (v.size() > 1 && v.front().pt.x == v.back().pt.x && v.front().pt.y == v.back().pt.y)
+        v.pop_back();
+    if (v.size() < 2)
+        return;
+    const size_t n = v.size();
+
+    // Normals of the edges starting at each point, before snapping so that
+    // they are not discretized, which would show as faceting.
+    for (size_t i = 0; i < n; i++)
+    {
+        const td_point2f& next = v[(i + 1) % n].pt;
+        v[i].norm = Normalize({next.y - v[i].pt.y, next.x - v[i].pt.x});
+    }
+    for (td_figurevertex& fv : v)
+        fv.pt = SnapPoint(fv.pt);
+
+    // Where the angle between edges is small, average their normals for a
+    // smooth transition from one face to the next.
+    for (size_t i = 0; i < n; i++)
+    {
+        const td_point2f& n1 = v[(i + n - 1) % n].norm;
+        const td_point2f& n2 = v[i].norm;
+        if (n1.x * n2.x + n1.y * n2.y > 0.5f)
+        {
+            v[i].interpNorm1 = v[i].interpNorm2 = Normalize({n1.x + n2.x, n1.y + n2.y});
+        }
+        else
+        {
+            v[i].interpNorm1 = n1;
+            v[i].interpNorm2 = n2;
+        }
+    }
+
+    // Two triangles per edge.
+    const float z = fDepth / 2;
+    vertices.reserve(vertices.size() + 6 * n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const td_figurevertex& a = v[i];
+        const td_figurevertex& b = v[(i + 1) % n];
+        const td_point2f& na = a.interpNorm2;
+        const td_point2f& nb = b.interpNorm1;
+        vertices.push_back({a.pt.x, a.pt.y,  z, na.x, na.y, 0.0f});
+        vertices.push_back({a.pt.x, a.pt.y, -z, na.x, na.y, 0.0f});
+        vertices.push_back({b.pt.x, b.pt.y, -z, nb.x, nb.y, 0.0f});
+        vertices.push_back({b.pt.x, b.pt.y, -z, nb.x, nb.y, 0.0f});
+        vertices.push_back({b.pt.x, b.pt.y,  z, nb.x, nb.y, 0.0f});
+        vertices.push_back({a.pt.x, a.pt.y,  z, na.x, na.y, 0.0f});
+    }
+}
+
+void ExtrudeCaps(const td_triangle2f* pTriangles, size_t nTriangles, float fDepth, std::vector<td_extrudevertex>& vertices)
+{
+    const float z = fDepth / 2;
+    vertices.reserve(vertices.size() + 6 * nTriangles);
+    for (size_t i = 0; i < nTriangles; i++)
+    {
+        const td_triangle2f& tri = pTriangles[i];
+        td_point2f p1 = SnapPoint(tri.a), p2 = SnapPoint(tri.b), p3 = SnapPoint(tri.c);
+
+        // Orientation from the unsnapped points.
+        float fCross = (tri.b.x - tri.a.x) * (tri.c.y - tri.b.y) - (tri.b.y - tri.a.y) * (tri.c.x - tri.b.x);
+        if (fCross < 0.0f)
+            std::swap(p1, p2);
+
+        // The back face is wound the other way.
+        vertices.push_back({p1.x, p1.y,  z, 0.0f, 0.0f,  1.0f});
+        vertices.push_back({p2.x, p2.y,  z, 0.0f, 0.0f,  1.0f});
+        vertices.push_back({p3.x, p3.y,  z, 0.0f, 0.0f,  1.0f});
+        vertices.push_back({p2.x, p2.y, -z, 0.0f, 0.0f, -1.0f});
+        vertices.push_back({p1.x, p1.y, -z, 0.0f, 0.0f, -1.0f});
+        vertices.push_back({p3.x, p3.y, -z, 0.0f, 0.0f, -1.0f});
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * extrude.h - Outline flattening and extrusion header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+typedef struct
+{
+    float x;
+    float y;
+} td_point2f;
+
+typedef struct
+{
+    td_point2f a;
+    td_point2f b;
+    td_point2f c;
+} td_triangle2f;
+
+// Matches the `POSITION`, `NORMAL` input layout of the extrusion shaders.
+typedef struct
+{
+    float x, y, z;
+    float nx, ny, nz;
+} td_extrudevertex;
+
+// Front and back faces and side walls are generated separately, so their
+// vertices must line up exactly to avoid cracks. Points are snapped to a
+// grid of 1/16 units, before and after tessellating, because tessellation
+// jitters vertices slightly.
+float SnapCoordinate(float x);
+td_point2f SnapPoint(td_point2f pt);
+
+// Appends the points of the cubic Bézier curve from `p0` to `p3` to
+// `points`, not including `p0`, so that the polyline they form is nowhere
+// farther than `fTolerance` from the curve.
+void FlattenCubic(td_point2f p0, td_point2f p1, td_point2f p2, td_point2f p3, float fTolerance, std::vector<td_point2f>& points);
+
+// Appends the side walls of the closed figure `figure`, as two triangles
+// per edge, spanning `fDepth` centered on z = 0. Repeated points are
+// skipped. Normals are computed before snapping the points, and averaged
+// across corners of less than 60 degrees so that curves look smooth.
+void ExtrudeFigure(const std::vector<td_point2f>& figure, float fDepth, std::vector<td_extrudevertex>& vertices);
+
+// Appends the front (+z) and back (-z) faces of a figure from a
+// tessellation of its interior, at `fDepth / 2` from z = 0, wound the same
+// way regardless of how the tessellation winds them.
+void ExtrudeCaps(const td_triangle2f* pTriangles, size_t nTriangles, float fDepth, std::vector<td_extrudevertex>& vertices);
@@ -0,0 +1,82 @@
+/*
+ * fontfit.cpp - Font size fitting.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "fontfit.h"
+
+#include "textlayout.h"
+
+namespace
+{
+bool Fits(const td_textsize& size, float fWidth, float fHeight)
+{
+    return size.fWidth < fWidth && size.fHeight <= fHeight;
+}
+} // namespace
+
+int CFontFitCache::Fit(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, const int* pSizes, int nSizes, float fWidth, float fHeight)
+{
+    if (nSizes <= 0)
+        return -1;
+
+    uint64_t nHash = HashCombine(HashText(text), HashText(face));
+    nHash = HashCombine(nHash, (bBold ? 1 : 0) | (bItalic ? 2 : 0));
+    const td_cached* pCached = nullptr;
+    auto range = m_entries.equal_range(nHash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const td_cached& cached = it->second;
+        if (cached.bBold == bBold && cached.bItalic == bItalic && cached.text == text && cached.face == face)
+        {
+            pCached = &cached;
+            m_nHits++;
+            break;
+        }
+    }
+    if (!pCached)
+    {
+        m_nMisses++;
+        td_textsize reference;
+        if (!Measure(text, face, bBold, bItalic, REFERENCE_SIZE, fWidth, fHeight, reference))
+            return -1;
+        pCached = &m_entries.emplace(nHash, td_cached{std::wstring(text), std::wstring(face), bBold, bItalic, reference})->second;
+    }
+
+    // Largest size predicted to fit.
+    int nFit = nSizes - 1;
+    for (; nFit >= 0; nFit--)
+    {
+        float fScale = static_cast<float>(pSizes[nFit]) / REFERENCE_SIZE;
+        if (Fits({pCached->reference.fWidth * fScale, pCached->reference.fHeight * fScale}, fWidth, fHeight))
+            break;
+    }
+
+    // Metrics do not scale exactly, as padding and hinting do not grow with
+    // the size; a size predicted to just fit, and the ones below it, may not.
+    for (; nFit > 0; nFit--)
+    {
+        td_textsize size;
+        if (!Measure(text, face, bBold, bItalic, static_cast<float>(pSizes[nFit]), fWidth, fHeight, size))
+            return -1;
+        if (Fits(size, fWidth, fHeight))
+            return nFit;
+    }
+    return 0;
+}
+
+bool CFontFitCache::Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float fWidth, float fHeight, td_textsize& size)
+{
+    m_nProbes++;
+    return m_pMeasurer->Measure(text, face, bBold, bItalic, fSize, fWidth, fHeight, size);
+}
+
+void CFontFitCache::GetStats(td_fontfitstats& stats) const
+{
+    stats.nEntries = m_entries.size();
+    stats.nHits = m_nHits;
+    stats.nMisses = m_nMisses;
+    stats.nProbes = m_nProbes;
+}
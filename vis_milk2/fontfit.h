@@ -0,0 +1,82 @@
+/*
+ * fontfit.h - Font size fitting header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+typedef struct
+{
+    float fWidth;
+    float fHeight;
+} td_textsize;
+
+// Measures texts for a text backend, such as DirectWrite.
+class CTextMeasurer
+{
+  public:
+    virtual ~CTextMeasurer() = default;
+
+    // Measures the ink of `text`, on a single line, in the font of face
+    // `face` at size `fSize`, laid out in a container of the given size.
+    // Returns false on failure.
+    virtual bool Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float fWidth, float fHeight, td_textsize& size) = 0;
+};
+
+typedef struct
+{
+    size_t nEntries; // texts measured at the reference size
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nProbes; // measurements, including at the reference size
+} td_fontfitstats;
+
+// Picks the largest font size a text fits in a container at, as for the
+// custom messages that fill the title texture.
+//
+// Texts without hinting scale with the font size, so each text is measured
+// once at `REFERENCE_SIZE` and the fitting size is predicted from that, then
+// verified by measuring it, and each smaller size until one fits. Measurements are keyed by the text and
+// the face, weight and italic of the font, and kept until `Clear()`.
+class CFontFitCache
+{
+  public:
+    static constexpr float REFERENCE_SIZE = 64.0f;
+
+    explicit CFontFitCache(CTextMeasurer* pMeasurer) : m_pMeasurer(pMeasurer), m_nHits(0), m_nMisses(0), m_nProbes(0) {}
+
+    // Returns the index of the largest of the ascending font sizes `pSizes`
+    // at which `text` is narrower than `fWidth` and no taller than
+    // `fHeight`, or 0 if it fits at none. Returns -1 if measuring failed.
+    int Fit(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, const int* pSizes, int nSizes, float fWidth, float fHeight);
+
+    void Clear() { m_entries.clear(); }
+
+    void GetStats(td_fontfitstats& stats) const;
+
+  private:
+    typedef struct
+    {
+        std::wstring text;
+        std::wstring face;
+        bool bBold;
+        bool bItalic;
+        td_textsize reference; // at `REFERENCE_SIZE`
+    } td_cached;
+
+    bool Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float fWidth, float fHeight, td_textsize& size);
+
+    CTextMeasurer* m_pMeasurer;
+    std::unordered_multimap<uint64_t, td_cached> m_entries; // by hash of the key
+    uint64_t m_nHits;
+    uint64_t m_nMisses;
+    uint64_t m_nProbes;
+};
@@ -0,0 +1,163 @@
+/*
+ * framepacer.cpp - Frame rate limiter.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "framepacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int64_t kInitialSpinMargin = 1000000; // 1 ms
+constexpr int64_t kMinSpinMargin = 50000;
+constexpr int64_t kMaxSpinMargin = 4000000;
+
+float ToMs(int64_t ns)
+{
+    return static_cast<float>(static_cast<double>(ns) * 1e-6);
+}
+
+float Percentile(std::vector<int64_t>& values, float p)
+{
+    if (values.empty())
+        return 0.0f;
+    size_t n = std::min(values.size() - 1, static_cast<size_t>(p * static_cast<float>(values.size())));
+    std::nth_element(values.begin(), values.begin() + static_cast<ptrdiff_t>(n), values.end());
+    return ToMs(values[n]);
+}
+} // namespace
+
+int64_t CSteadyPacerClock::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CSteadyPacerClock::SleepUntil(int64_t nTime)
+{
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(nTime))));
+}
+
+CFramePacer::CFramePacer(CPacerClock* pClock) : m_pClock(pClock), m_nInterval(0), m_bSaveCpu(false), m_nSpinMargin(kInitialSpinMargin), m_oversleeps{}, m_nSleeps(0), m_frames{}
+{
+    Reset();
+}
+
+void CFramePacer::SetMaxFps(int max_fps)
+{
+    m_nInterval = max_fps > 0 ? 1000000000LL / max_fps : 0;
+}
+
+void CFramePacer::Reset()
+{
+    m_nDeadline = 0;
+    m_nFrameStart = 0;
+    m_nLastFrameEnd = 0;
+    m_nPredictedCost = 0;
+    m_nFrames = 0;
+    m_nLate = 0;
+    m_nDropped = 0;
+}
+
+void CFramePacer::EndFrame()
+{
+    int64_t now = m_pClock->Now();
+    td_pacedframe frame = {};
+    if (m_nLastFrameEnd)
+        frame.nInterval = now - m_nLastFrameEnd;
+    m_nLastFrameEnd = now;
+
+    // Predict the cost of the next frame from this one.
+    if (m_nFrameStart)
+    {
+        int64_t nCost = now - m_nFrameStart;
+        m_nPredictedCost = m_nPredictedCost ? m_nPredictedCost + (nCost - m_nPredictedCost) / 8 : nCost;
+    }
+    else
+        m_nDeadline = now;
+
+    if (m_nInterval > 0)
+    {
+        // Shown on a later refresh than intended.
+        int64_t nLateness = now - m_nDeadline;
+        if (m_nFrameStart && nLateness > m_nInterval / 2)
+        {
+            m_nLate++;
+            m_nDropped += static_cast<uint64_t>(nLateness / m_nInterval) + 1;
+        }
+
+        int64_t nCost = std::clamp(m_nPredictedCost, static_cast<int64_t>(0), m_nInterval);
+        m_nDeadline += m_nInterval;
+        int64_t nStart = m_nDeadline - nCost;
+        if (nStart < now)
+        {
+            // Missed the schedule; start now and move the deadlines back.
+            nStart = now;
+            m_nDeadline = now + nCost;
+        }
+        Wait(nStart, frame);
+    }
+
+    if (frame.nInterval)
+        m_frames[m_nFrames++ & (NUM_FRAMES - 1)] = frame;
+    m_nFrameStart = m_pClock->Now();
+}
+
+void CFramePacer::Wait(int64_t nUntil, td_pacedframe& frame)
+{
+    int64_t t = m_pClock->Now();
+    int64_t nWake = m_bSaveCpu ? nUntil : nUntil - m_nSpinMargin;
+    if (nWake > t)
+    {
+        m_pClock->SleepUntil(nWake);
+        int64_t t2 = m_pClock->Now();
+        frame.nSleep = t2 - t;
+        t = t2;
+
+        // Keep the margin at the longest recent oversleep.
+        if (!m_bSaveCpu)
+        {
+            m_oversleeps[m_nSleeps++ % m_oversleeps.size()] = std::max(t - nWake, static_cast<int64_t>(0));
+            int64_t nLongest = *std::max_element(m_oversleeps.begin(), m_oversleeps.begin() + static_cast<ptrdiff_t>(std::min<size_t>(m_nSleeps, m_oversleeps.size())));
+            m_nSpinMargin = std::clamp(nLongest + kMinSpinMargin, kMinSpinMargin, kMaxSpinMargin);
+        }
+    }
+    if (!m_bSaveCpu)
+    {
+        int64_t nSpinStart = t;
+        while (t < nUntil)
+            t = m_pClock->Now();
+        frame.nSpin = t - nSpinStart;
+    }
+}
+
+void CFramePacer::GetStats(td_pacerstats& stats) const
+{
+    size_t nFrames = static_cast<size_t>(std::min<uint64_t>(m_nFrames, NUM_FRAMES));
+    std::vector<int64_t> intervals, jitter;
+    int64_t nSleep = 0, nSpin = 0;
+    for (size_t i = 0; i < nFrames; i++)
+    {
+        const td_pacedframe& frame = m_frames[(m_nFrames - 1 - i) & (NUM_FRAMES - 1)];
+        intervals.push_back(frame.nInterval);
+        jitter.push_back(m_nInterval > 0 ? std::abs(frame.nInterval - m_nInterval) : 0);
+        nSleep += frame.nSleep;
+        nSpin += frame.nSpin;
+    }
+    stats.nFrames = nFrames;
+    stats.fIntervalP50 = Percentile(intervals, 0.5f);
+    stats.fJitterP50 = Percentile(jitter, 0.5f);
+    stats.fJitterP95 = Percentile(jitter, 0.95f);
+    stats.fJitterP99 = Percentile(jitter, 0.99f);
+    stats.fPredictedCost = ToMs(m_nPredictedCost);
+    stats.fSleepPerFrame = nFrames ? ToMs(nSleep / static_cast<int64_t>(nFrames)) : 0.0f;
+    stats.fSpinPerFrame = nFrames ? ToMs(nSpin / static_cast<int64_t>(nFrames)) : 0.0f;
+    stats.nLate = m_nLate;
+    stats.nDropped = m_nDropped;
+}
@@ -0,0 +1,111 @@
+/*
+ * framepacer.h - Frame rate limiter header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Time source and wait primitive for `CFramePacer`, in nanoseconds.
+class CPacerClock
+{
+  public:
+    virtual ~CPacerClock() = default;
+
+    // Monotonic time.
+    virtual int64_t Now() = 0;
+
+    // Blocks without using the CPU until about `nTime`. May wake up late.
+    virtual void SleepUntil(int64_t nTime) = 0;
+};
+
+// `std::chrono::steady_clock` and `std::this_thread::sleep_until()`.
+class CSteadyPacerClock : public CPacerClock
+{
+  public:
+    int64_t Now() override;
+    void SleepUntil(int64_t nTime) override;
+};
+
+// Pacing over the frames currently held in the history, in milliseconds.
+typedef struct
+{
+    size_t nFrames;
+    float fIntervalP50; // time between the ends of consecutive frames
+    float fJitterP50;   // distance of the interval from the target
+    float fJitterP95;
+    float fJitterP99;
+    float fPredictedCost; // of the next frame
+    float fSleepPerFrame;
+    float fSpinPerFrame; // CPU spent waiting
+    uint64_t nLate;    // frames shown over half an interval after their deadline, since `Reset()`
+    uint64_t nDropped; // deadlines that passed without a new frame
+} td_pacerstats;
+
+// Limits the frame rate, spacing the ends of frames (when they are shown)
+// evenly.
+//
+// Frames are given deadlines `1 / max_fps` apart. After a frame, the pacer
+// waits until the next deadline minus the predicted cost of rendering the
+// next frame, a moving average of recent frames, so that it ends close to
+// its deadline. Most of the wait is spent sleeping; the last stretch, as
+// long as the clock has recently overslept by, is spent polling the clock.
+// A frame that misses its deadline moves the following ones back instead
+// of making the next frames hurry, and is counted as late, along with the
+// deadlines it let pass.
+class CFramePacer
+{
+  public:
+    static constexpr size_t NUM_FRAMES = 256; // statistics window; must be a power of 2
+
+    explicit CFramePacer(CPacerClock* pClock);
+
+    // 0 for unlimited.
+    void SetMaxFps(int max_fps);
+
+    // Only sleep, never poll the clock; less precise.
+    void SetSaveCpu(bool bSaveCpu) { m_bSaveCpu = bSaveCpu; }
+
+    // Call once a frame has been shown. Waits until the next one should
+    // start rendering.
+    void EndFrame();
+
+    // Forgets the frame history, for example after the window was hidden.
+    void Reset();
+
+    void GetStats(td_pacerstats& stats) const;
+    int64_t GetPredictedCost() const { return m_nPredictedCost; }
+    int64_t GetSpinMargin() const { return m_nSpinMargin; }
+
+  private:
+    typedef struct
+    {
+        int64_t nInterval;
+        int64_t nSleep;
+        int64_t nSpin;
+    } td_pacedframe;
+
+    void Wait(int64_t nUntil, td_pacedframe& frame);
+
+    CPacerClock* m_pClock;
+    int64_t m_nInterval; // target; 0 when unlimited
+    bool m_bSaveCpu;
+
+    int64_t m_nDeadline;      // of the frame being rendered
+    int64_t m_nFrameStart;    // 0 before the first frame
+    int64_t m_nLastFrameEnd;  // 0 before the first frame
+    int64_t m_nPredictedCost; // rendering time of the next frame
+    int64_t m_nSpinMargin;    // how long before a wake-up to stop sleeping
+    std::array<int64_t, 32> m_oversleeps; // recent lateness of sleeps
+    size_t m_nSleeps;
+
+    std::array<td_pacedframe, NUM_FRAMES> m_frames;
+    uint64_t m_nFrames; // recorded so far, not counting the first frame, which has no interval
+    uint64_t m_nLate;
+    uint64_t m_nDropped;
+};
@@ -0,0 +1,289 @@
+/*
+ * imagedecode.cpp - Background image decoding.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "imagedecode.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint64_t HashImageData(const uint8_t* pData, size_t nSize)
+{
+    // Eight bytes per step, then a final avalanche, so that hashing a large
+    // image costs about as much as copying it.
+    constexpr uint64_t kMul = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = nSize * kMul;
+    size_t i = 0;
+    for (; i + 8 <= nSize; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, pData + i, 8);
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    for (size_t s = 0; i < nSize; i++, s += 8)
+        tail |= static_cast<uint64_t>(pData[i]) << s;
+    h = (h ^ tail) * kMul;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+CImageBuffer::CImageBuffer(std::shared_ptr<const void> owner, const uint8_t* pData, size_t nSize)
+    : m_owner(std::move(owner)), m_pData(pData), m_nSize(pData ? nSize : 0), m_nHash(HashImageData(pData, m_nSize))
+{
+}
+
+CImageBuffer CImageBuffer::Copy(const uint8_t* pData, size_t nSize)
+{
+    if (!pData || !nSize)
+        return CImageBuffer();
+    auto bytes = std::make_shared<std::vector<uint8_t>>(pData, pData + nSize);
+    return CImageBuffer(bytes, bytes->data(), bytes->size());
+}
+
+std::shared_ptr<const td_decodedimage> CImageCache::Find(uint64_t nHash)
+{
+    auto it = m_index.find(nHash);
+    if (it == m_index.end())
+    {
+        m_nMisses++;
+        return nullptr;
+    }
+    m_nHits++;
+    m_images.splice(m_images.begin(), m_images, it->second);
+    return it->second->second;
+}
+
+void CImageCache::Insert(uint64_t nHash, std::shared_ptr<const td_decodedimage> image)
+{
+    auto it = m_index.find(nHash);
+    if (it != m_index.end())
+    {
+        it->second->second = std::move(image);
+        m_images.splice(m_images.begin(), m_images, it->second);
+        return;
+    }
+    m_images.emplace_front(nHash, std::move(image));
+    m_index[nHash] = m_images.begin();
+    while (m_images.size() > m_nCapacity)
+    {
+        m_index.erase(m_images.back().first);
+        m_images.pop_back();
+    }
+}
+
+void CImageCache::Clear()
+{
+    m_images.clear();
+    m_index.clear();
+}
+
+size_t GetMipOffset(int nWidth, int nHeight, int nLevel)
+{
+    size_t nOffset = 0;
+    for (int i = 0; i < nLevel; i++)
+    {
+        nOffset += static_cast<size_t>(nWidth) * static_cast<size_t>(nHeight) * 4;
+        nWidth = std::max(nWidth / 2, 1);
+        nHeight = std::max(nHeight / 2, 1);
+    }
+    return nOffset;
+}
+
+int GenerateMips(int nWidth, int nHeight, std::vector<uint8_t>& pixels)
+{
+    int nMips = 1;
+    int w = nWidth;
+    int h = nHeight;
+    pixels.reserve(GetMipOffset(nWidth, nHeight, 32));
+    while (w > 1 || h > 1)
+    {
+        size_t nSrc = GetMipOffset(nWidth, nHeight, nMips - 1);
+        int dw = std::max(w / 2, 1);
+        int dh = std::max(h / 2, 1);
+        pixels.resize(nSrc + static_cast<size_t>(w) * static_cast<size_t>(h) * 4 + static_cast<size_t>(dw) * static_cast<size_t>(dh) * 4);
+        const uint8_t* src = pixels.data() + nSrc;
+        uint8_t* dst = pixels.data() + nSrc + static_cast<size_t>(w) * static_cast<size_t>(h) * 4;
+        for (int y = 0; y < dh; y++)
+        {
+            // The last row or column of an odd size is skipped; a single one is used twice.
+            const uint8_t* row0 = src + static_cast<size_t>(y * 2) * static_cast<size_t>(w) * 4;
+            const uint8_t* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, h - 1)) * static_cast<size_t>(w) * 4;
+            for (int x = 0; x < dw; x++)
+            {
+                size_t x0 = static_cast<size_t>(x * 2) * 4;
+                size_t x1 = static_cast<size_t>(std::min(x * 2 + 1, w - 1)) * 4;
+                for (size_t c = 0; c < 4; c++)
+                    *dst++ = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+        w = dw;
+        h = dh;
+        nMips++;
+    }
+    return nMips;
+}
+
+void CImageDecodeQueue::Start(ImageDecoder decoder, int nThreads)
+{
+    Stop();
+    m_decoder = decoder;
+    m_bStop = false;
+    for (int i = 0; i < nThreads; i++)
+        m_threads.emplace_back(&CImageDecodeQueue::Worker, this);
+}
+
+void CImageDecodeQueue::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+    m_threads.clear();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_requests.clear();
+    m_results.clear();
+    m_active.clear();
+    m_cancelled.clear();
+    m_done.notify_all();
+}
+
+uint32_t CImageDecodeQueue::Submit(const wchar_t* szFilename, bool bMips)
+{
+    td_decoderequest request{0, szFilename, {}, bMips};
+    return Enqueue(request);
+}
+
+uint32_t CImageDecodeQueue::Submit(const CImageBuffer& data, bool bMips)
+{
+    td_decoderequest request{0, {}, data, bMips};
+    return Enqueue(request);
+}
+
+uint32_t CImageDecodeQueue::Enqueue(td_decoderequest& request)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (++m_nNextTicket == 0)
+        m_nNextTicket = 1;
+    uint32_t nTicket = m_nNextTicket;
+    request.nTicket = nTicket;
+    m_active.insert(nTicket);
+    if (m_threads.empty())
+    {
+        lock.unlock();
+        td_decodedimage image;
+        Decode(request, &image);
+        lock.lock();
+        m_active.erase(nTicket);
+        m_results.push_back(std::move(image));
+        return nTicket;
+    }
+    m_requests.push_back(std::move(request));
+    lock.unlock();
+    m_wake.notify_one();
+    return nTicket;
+}
+
+void CImageDecodeQueue::Cancel(uint32_t nTicket)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto result = std::find_if(m_results.begin(), m_results.end(), [=](const td_decodedimage& r) { return r.nTicket == nTicket; });
+    if (result != m_results.end())
+    {
+        m_results.erase(result);
+        return;
+    }
+    if (!m_active.erase(nTicket))
+        return;
+    auto request = std::find_if(m_requests.begin(), m_requests.end(), [=](const td_decoderequest& r) { return r.nTicket == nTicket; });
+    if (request != m_requests.end())
+        m_requests.erase(request);
+    else
+        m_cancelled.insert(nTicket);
+    m_done.notify_all();
+}
+
+bool CImageDecodeQueue::Poll(td_decodedimage* pImage)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_results.empty())
+        return false;
+    *pImage = std::move(m_results.front());
+    m_results.erase(m_results.begin());
+    return true;
+}
+
+bool CImageDecodeQueue::Wait(uint32_t nTicket, td_decodedimage* pImage)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;)
+    {
+        auto result = std::find_if(m_results.begin(), m_results.end(), [=](const td_decodedimage& r) { return r.nTicket == nTicket; });
+        if (result != m_results.end())
+        {
+            *pImage = std::move(*result);
+            m_results.erase(result);
+            return true;
+        }
+        if (!m_active.count(nTicket))
+            return false;
+        m_done.wait(lock);
+    }
+}
+
+size_t CImageDecodeQueue::GetPending()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_active.size() + m_results.size();
+}
+
+void CImageDecodeQueue::Decode(td_decoderequest& request, td_decodedimage* pImage) const
+{
+    pImage->nTicket = request.nTicket;
+    pImage->nWidth = 0;
+    pImage->nHeight = 0;
+    pImage->nMips = 1;
+    pImage->pixels.clear();
+    const uint8_t* pData = request.data.IsEmpty() ? nullptr : request.data.GetData();
+    pImage->bOk = m_decoder && m_decoder(request.szFilename.c_str(), pData, request.data.GetSize(), &pImage->nWidth, &pImage->nHeight, &pImage->pixels) &&
+                  pImage->nWidth > 0 && pImage->nHeight > 0 &&
+                  pImage->pixels.size() == static_cast<size_t>(pImage->nWidth) * static_cast<size_t>(pImage->nHeight) * 4;
+    if (!pImage->bOk)
+        pImage->pixels.clear();
+    else if (request.bMips)
+        pImage->nMips = GenerateMips(pImage->nWidth, pImage->nHeight, pImage->pixels);
+}
+
+void CImageDecodeQueue::Worker()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;)
+    {
+        m_wake.wait(lock, [this] { return m_bStop || !m_requests.empty(); });
+        if (m_bStop)
+            return;
+        td_decoderequest request = std::move(m_requests.front());
+        m_requests.pop_front();
+
+        lock.unlock();
+        td_decodedimage image;
+        Decode(request, &image);
+        request.data = CImageBuffer();
+        lock.lock();
+
+        if (m_cancelled.erase(request.nTicket) == 0 && !m_bStop)
+            m_results.push_back(std::move(image));
+        m_active.erase(request.nTicket);
+        m_done.notify_all();
+    }
+}
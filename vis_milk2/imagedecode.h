@@ -0,0 +1,157 @@
+/*
+ * imagedecode.h - Background image decoding header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Content hash of an encoded image, as used to key `CImageCache`.
+uint64_t HashImageData(const uint8_t* pData, size_t nSize);
+
+// Immutable, reference-counted encoded image bytes. Copies share the bytes,
+// and whatever owns them, such as the host's album art object, is kept
+// alive until the last copy is gone.
+class CImageBuffer
+{
+  public:
+    CImageBuffer() : m_pData(nullptr), m_nSize(0), m_nHash(0) {}
+    CImageBuffer(std::shared_ptr<const void> owner, const uint8_t* pData, size_t nSize);
+
+    // Makes a buffer owning a copy of `pData`.
+    static CImageBuffer Copy(const uint8_t* pData, size_t nSize);
+
+    const uint8_t* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_nSize; }
+    bool IsEmpty() const { return m_nSize == 0; }
+    uint64_t GetHash() const { return m_nHash; }
+
+  private:
+    std::shared_ptr<const void> m_owner;
+    const uint8_t* m_pData;
+    size_t m_nSize;
+    uint64_t m_nHash; // computed once, the bytes never change
+};
+
+// Decodes the image file `szFilename`, or the encoded image in `pData` if
+// it is not `nullptr`, to tightly packed 8-bit RGBA rows.
+typedef bool (*ImageDecoder)(const wchar_t* szFilename, const uint8_t* pData, size_t nSize, int* pWidth, int* pHeight, std::vector<uint8_t>* pPixels);
+
+typedef struct
+{
+    uint32_t nTicket;
+    bool bOk;
+    int nWidth;
+    int nHeight;
+    int nMips;                   // levels in `pixels`, 1 without mipmaps
+    std::vector<uint8_t> pixels; // RGBA rows of each level, largest first
+} td_decodedimage;
+
+// Keeps the last few decoded images by the hash of their encoded bytes,
+// so that the same album art on consecutive tracks is only decoded once.
+// Not thread safe; used from the render thread.
+class CImageCache
+{
+  public:
+    explicit CImageCache(size_t nCapacity = 4) : m_nCapacity(nCapacity), m_nHits(0), m_nMisses(0) {}
+
+    // Returns `nullptr` if the image is not cached.
+    std::shared_ptr<const td_decodedimage> Find(uint64_t nHash);
+    void Insert(uint64_t nHash, std::shared_ptr<const td_decodedimage> image);
+    void Clear();
+
+    uint32_t GetHits() const { return m_nHits; }
+    uint32_t GetMisses() const { return m_nMisses; }
+
+  private:
+    typedef std::list<std::pair<uint64_t, std::shared_ptr<const td_decodedimage>>> ImageList;
+
+    size_t m_nCapacity;
+    ImageList m_images; // most recently used first
+    std::unordered_map<uint64_t, ImageList::iterator> m_index;
+    uint32_t m_nHits;
+    uint32_t m_nMisses;
+};
+
+// Offset of mip level `nLevel` in the pixels of a `nWidth` x `nHeight` image.
+size_t GetMipOffset(int nWidth, int nHeight, int nLevel);
+
+// Appends the mip chain of the RGBA image in `pixels`, each level a box
+// filter of the one before it. Returns the number of levels, including
+// the original.
+int GenerateMips(int nWidth, int nHeight, std::vector<uint8_t>& pixels);
+
+// Decodes images on a pool of worker threads.
+//
+// Requests are submitted from one thread and their results picked up with
+// `Poll()` or `Wait()`, typically by the render thread once per frame, so
+// that the texture being replaced stays in use until the new one is ready.
+// Results come out in the order they finish, not the order they were
+// submitted. Without worker threads, images are decoded in `Submit()`.
+class CImageDecodeQueue
+{
+  public:
+    CImageDecodeQueue() : m_decoder(nullptr), m_nNextTicket(0), m_bStop(false) {}
+    ~CImageDecodeQueue() { Stop(); }
+
+    void Start(ImageDecoder decoder, int nThreads);
+
+    // Joins the workers, dropping all requests and results.
+    void Stop();
+
+    // Returns a ticket identifying the request, never 0.
+    uint32_t Submit(const wchar_t* szFilename, bool bMips);
+    uint32_t Submit(const CImageBuffer& data, bool bMips);
+
+    // Drops the request, whether it is queued, being decoded or finished.
+    void Cancel(uint32_t nTicket);
+
+    // Takes any finished image. Returns false if there is none yet.
+    bool Poll(td_decodedimage* pImage);
+
+    // Takes the result of `nTicket`, waiting for it if needed. Returns
+    // false if the ticket is unknown, cancelled or already taken.
+    bool Wait(uint32_t nTicket, td_decodedimage* pImage);
+
+    // Number of requests submitted but not yet taken.
+    size_t GetPending();
+
+  private:
+    typedef struct
+    {
+        uint32_t nTicket;
+        std::wstring szFilename;
+        CImageBuffer data;
+        bool bMips;
+    } td_decoderequest;
+
+    uint32_t Enqueue(td_decoderequest& request);
+    void Decode(td_decoderequest& request, td_decodedimage* pImage) const;
+    void Worker();
+
+    ImageDecoder m_decoder;
+    uint32_t m_nNextTicket;
+    bool m_bStop;
+    std::mutex m_lock;
+    std::condition_variable m_wake; // a request was queued, or stopping
+    std::condition_variable m_done; // a request finished
+    std::deque<td_decoderequest> m_requests;
+    std::vector<td_decodedimage> m_results;
+    std::unordered_set<uint32_t> m_active;    // queued or being decoded
+    std::unordered_set<uint32_t> m_cancelled; // being decoded, to be dropped
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,285 @@
+/*
+ * inifile.cpp - In-memory INI file index.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "inifile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cwchar>
+#include <cwctype>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+static std::wstring ToLower(const wchar_t* s, size_t nLen)
+{
+    std::wstring lower(s, nLen);
+    for (wchar_t& c : lower)
+        c = static_cast<wchar_t>(std::towlower(static_cast<wint_t>(c)));
+    return lower;
+}
+
+static bool IsBlank(wchar_t c)
+{
+    return c == L' ' || c == L'\t' || c == L'\r' || c == L'\v' || c == L'\f';
+}
+
+// Trims `[*pBegin, *pEnd)` in place.
+static void Trim(const wchar_t** pBegin, const wchar_t** pEnd)
+{
+    while (*pBegin < *pEnd && IsBlank(**pBegin))
+        (*pBegin)++;
+    while (*pEnd > *pBegin && IsBlank((*pEnd)[-1]))
+        (*pEnd)--;
+}
+
+static void AppendCodePoint(std::wstring& out, uint32_t cp)
+{
+    if constexpr (sizeof(wchar_t) == 2)
+    {
+        if (cp >= 0x10000)
+        {
+            cp -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+            out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+            return;
+        }
+    }
+    out.push_back(static_cast<wchar_t>(cp));
+}
+
+// Decodes UTF-8 into `out`; returns false on the first invalid sequence.
+static bool DecodeUtf8(const unsigned char* p, const unsigned char* end, std::wstring& out)
+{
+    while (p < end)
+    {
+        uint32_t cp = *p++;
+        int nTrail = 0;
+        uint32_t nMin = 0;
+        if (cp >= 0xF0 && cp <= 0xF4)
+            nTrail = 3, cp &= 0x07, nMin = 0x10000;
+        else if (cp >= 0xE0 && cp <= 0xEF)
+            nTrail = 2, cp &= 0x0F, nMin = 0x800;
+        else if (cp >= 0xC2 && cp <= 0xDF)
+            nTrail = 1, cp &= 0x1F, nMin = 0x80;
+        else if (cp >= 0x80)
+            return false;
+        if (end - p < nTrail)
+            return false;
+        for (int i = 0; i < nTrail; i++, p++)
+        {
+            if ((*p & 0xC0) != 0x80)
+                return false;
+            cp = (cp << 6) | (*p & 0x3F);
+        }
+        if (cp < nMin || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return false;
+        AppendCodePoint(out, cp);
+    }
+    return true;
+}
+
+static std::wstring Decode(const char* pData, size_t nLen)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pData);
+    const unsigned char* end = p + nLen;
+    std::wstring text;
+    if (nLen >= 2 && p[0] == 0xFF && p[1] == 0xFE)
+    {
+        text.reserve(nLen / 2);
+        for (p += 2; end - p >= 2; p += 2)
+            text.push_back(static_cast<wchar_t>(p[0] | (p[1] << 8)));
+        return text;
+    }
+    if (nLen >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF)
+        p += 3;
+    text.reserve(static_cast<size_t>(end - p));
+    if (DecodeUtf8(p, end, text))
+        return text;
+    text.assign(p, end);
+    return text;
+}
+
+bool CIniFile::Refresh(const wchar_t* szPath)
+{
+    std::error_code ec;
+    std::filesystem::path path(szPath);
+    uintmax_t nSize = std::filesystem::file_size(path, ec);
+    std::filesystem::file_time_type mtime = ec ? std::filesystem::file_time_type() : std::filesystem::last_write_time(path, ec);
+    if (ec)
+    {
+        Clear();
+        return false;
+    }
+    if (m_bLoaded && m_szPath == szPath && m_nSize == nSize && m_mtime == mtime)
+        return true;
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> data(static_cast<size_t>(nSize));
+    if (!file || !file.read(data.data(), static_cast<std::streamsize>(data.size())))
+    {
+        Clear();
+        return false;
+    }
+    Parse(data.data(), data.size());
+    m_szPath = szPath;
+    m_nSize = nSize;
+    m_mtime = mtime;
+    m_bLoaded = true;
+    return true;
+}
+
+void CIniFile::Parse(const char* pData, size_t nLen)
+{
+    Clear();
+    std::wstring text = Decode(pData, nLen);
+    std::unordered_set<std::wstring> seen;
+    KeyMap* pKeys = nullptr; // `nullptr` for keys before the first section or in a repeated one
+    const wchar_t* p = text.c_str();
+    const wchar_t* end = p + text.size();
+    while (p < end)
+    {
+        const wchar_t* eol = p;
+        while (eol < end && *eol != L'\n')
+            eol++;
+        const wchar_t* s = p;
+        const wchar_t* e = eol;
+        p = eol + 1;
+        Trim(&s, &e);
+        if (s == e || *s == L';')
+            continue;
+
+        if (*s == L'[')
+        {
+            const wchar_t* close = ++s;
+            while (close < e && *close != L']')
+                close++;
+            Trim(&s, &close);
+            std::wstring name = ToLower(s, static_cast<size_t>(close - s));
+            pKeys = seen.insert(name).second ? &m_sections[name] : nullptr;
+            continue;
+        }
+        if (!pKeys)
+            continue;
+
+        const wchar_t* eq = s;
+        while (eq < e && *eq != L'=')
+            eq++;
+        const wchar_t* ks = s;
+        const wchar_t* ke = eq;
+        Trim(&ks, &ke);
+        const wchar_t* vs = eq < e ? eq + 1 : e;
+        const wchar_t* ve = e;
+        Trim(&vs, &ve);
+        if (ve - vs >= 2 && (*vs == L'"' || *vs == L'\'') && ve[-1] == *vs)
+            vs++, ve--;
+        pKeys->emplace(ToLower(ks, static_cast<size_t>(ke - ks)), std::wstring(vs, ve));
+    }
+}
+
+void CIniFile::Clear()
+{
+    m_sections.clear();
+    m_szPath.clear();
+    m_nSize = 0;
+    m_bLoaded = false;
+}
+
+const std::wstring* CIniFile::Find(const wchar_t* szSection, const wchar_t* szKey) const
+{
+    auto section = m_sections.find(ToLower(szSection, wcslen(szSection)));
+    if (section == m_sections.end())
+        return nullptr;
+    auto key = section->second.find(ToLower(szKey, wcslen(szKey)));
+    return key == section->second.end() ? nullptr : &key->second;
+}
+
+size_t CIniFile::GetString(const wchar_t* szSection, const wchar_t* szKey, const wchar_t* szDefault, wchar_t* szOut, size_t nSize) const
+{
+    if (nSize == 0)
+        return 0;
+    if (!szDefault)
+        szDefault = L"";
+    const std::wstring* value = Find(szSection, szKey);
+    const wchar_t* src = value ? value->c_str() : szDefault;
+    size_t nLen = std::min(value ? value->size() : wcslen(szDefault), nSize - 1);
+    std::wmemcpy(szOut, src, nLen);
+    szOut[nLen] = L'\0';
+    return nLen;
+}
+
+size_t CIniFile::GetStringA(const wchar_t* szSection, const wchar_t* szKey, const char* szDefault, char* szOut, size_t nSize) const
+{
+    if (nSize == 0)
+        return 0;
+    if (!szDefault)
+        szDefault = "";
+    const std::wstring* value = Find(szSection, szKey);
+    size_t nLen = 0;
+    if (value)
+        for (; nLen < value->size() && nLen < nSize - 1; nLen++)
+            szOut[nLen] = (*value)[nLen] < 0x100 ? static_cast<char>((*value)[nLen]) : '?';
+    else
+        for (; szDefault[nLen] && nLen < nSize - 1; nLen++)
+            szOut[nLen] = szDefault[nLen];
+    szOut[nLen] = '\0';
+    return nLen;
+}
+
+int CIniFile::GetInt(const wchar_t* szSection, const wchar_t* szKey, int nDefault) const
+{
+    const std::wstring* value = Find(szSection, szKey);
+    if (!value || value->empty())
+        return nDefault;
+
+    const wchar_t* p = value->c_str();
+    bool bNegative = false;
+    if (*p == L'+' || *p == L'-')
+        bNegative = (*p++ == L'-');
+    unsigned int nBase = 10;
+    if (p[0] == L'0' && (p[1] == L'x' || p[1] == L'X'))
+        nBase = 16, p += 2;
+    else if (p[0] == L'0' && (p[1] == L'o' || p[1] == L'O'))
+        nBase = 8, p += 2;
+    else if (p[0] == L'0' && (p[1] == L'b' || p[1] == L'B'))
+        nBase = 2, p += 2;
+    unsigned int n = 0;
+    for (;; p++)
+    {
+        unsigned int digit;
+        if (*p >= L'0' && *p <= L'9')
+            digit = static_cast<unsigned int>(*p - L'0');
+        else if (*p >= L'a' && *p <= L'f')
+            digit = static_cast<unsigned int>(*p - L'a' + 10);
+        else if (*p >= L'A' && *p <= L'F')
+            digit = static_cast<unsigned int>(*p - L'A' + 10);
+        else
+            break;
+        if (digit >= nBase)
+            break;
+        n = n * nBase + digit; // wraps around like the profile API
+    }
+    return static_cast<int>(bNegative ? 0u - n : n);
+}
+
+float CIniFile::GetFloat(const wchar_t* szSection, const wchar_t* szKey, float fDefault) const
+{
+    const std::wstring* value = Find(szSection, szKey);
+    if (!value || value->empty())
+        return fDefault;
+
+    // Numbers are ASCII, so anything else just ends the number.
+    char buf[64];
+    size_t nLen = 0;
+    for (; nLen < value->size() && nLen < sizeof(buf) - 1; nLen++)
+        buf[nLen] = (*value)[nLen] < 0x80 ? static_cast<char>((*value)[nLen]) : '\0';
+    buf[nLen] = '\0';
+    const char* first = buf[0] == '+' ? buf + 1 : buf;
+    float f;
+    auto [ptr, ec] = std::from_chars(first, buf + nLen, f);
+    return (ec == std::errc() && ptr != first) ? f : fDefault;
+}
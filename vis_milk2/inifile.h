@@ -0,0 +1,75 @@
+/*
+ * inifile.h - In-memory INI file index header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// An INI file parsed once into a section and key index, standing in for
+// repeated `GetPrivateProfile*()` calls on the same file (each of which
+// opens and scans the whole file again).
+//
+// Lookups follow the profile API: section and key names are matched
+// without regard to case, whitespace around names and values is trimmed,
+// a value enclosed in matching quotes has them removed, lines starting
+// with ';' are comments, and only the first occurrence of a section and
+// of a key within it is seen.
+//
+// Files are read as UTF-16LE if they start with its byte order mark, as
+// UTF-8 if they start with its byte order mark or are valid UTF-8, and
+// otherwise as Latin-1 (the profile API would use the ANSI code page).
+class CIniFile
+{
+  public:
+    CIniFile() : m_nSize(0), m_bLoaded(false) {}
+
+    // Loads `szPath` if it differs from the file loaded last, or if its
+    // size or modification time changed since. Returns false if the file
+    // cannot be read, in which case every lookup returns the default.
+    bool Refresh(const wchar_t* szPath);
+
+    // Replaces the contents with the INI text in `pData`.
+    void Parse(const char* pData, size_t nLen);
+
+    void Clear();
+
+    // Returns the value, or `nullptr` if the key is missing.
+    const std::wstring* Find(const wchar_t* szSection, const wchar_t* szKey) const;
+
+    // As `GetPrivateProfileString()`: copies the value, or `szDefault` (""
+    // if `nullptr`) if the key is missing, truncated to fit `nSize` characters with the
+    // terminator. Returns the number of characters copied.
+    size_t GetString(const wchar_t* szSection, const wchar_t* szKey, const wchar_t* szDefault, wchar_t* szOut, size_t nSize) const;
+
+    // Same as `GetString()`, narrowing the value to Latin-1 ('?' for
+    // characters outside of it).
+    size_t GetStringA(const wchar_t* szSection, const wchar_t* szKey, const char* szDefault, char* szOut, size_t nSize) const;
+
+    // As `GetPrivateProfileInt()`: `nDefault` if the key is missing or
+    // empty, otherwise the leading integer of the value (0 if there is
+    // none), with an optional sign and "0x", "0o" or "0b" prefix.
+    int GetInt(const wchar_t* szSection, const wchar_t* szKey, int nDefault) const;
+    bool GetBool(const wchar_t* szSection, const wchar_t* szKey, bool bDefault) const { return GetInt(szSection, szKey, bDefault) != 0; }
+
+    // As `GetPrivateProfileFloat()`: `fDefault` if the key is missing,
+    // empty or does not start with a number, which is always parsed with
+    // '.' as decimal separator.
+    float GetFloat(const wchar_t* szSection, const wchar_t* szKey, float fDefault) const;
+
+  private:
+    typedef std::unordered_map<std::wstring, std::wstring> KeyMap;
+
+    std::unordered_map<std::wstring, KeyMap> m_sections; // by lowercase section, then lowercase key
+    std::wstring m_szPath;
+    std::filesystem::file_time_type m_mtime;
+    uintmax_t m_nSize;
+    bool m_bLoaded;
+};
@@ -0,0 +1,104 @@
+/*
+ * meshstreams.cpp - Warp mesh vertex streams.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "meshstreams.h"
+
+#include <algorithm>
+#include <cmath>
+
+void CMeshStreams::Init(int nGridX, int nGridY, float fAspectX, float fAspectY, int nTexSizeX, int nTexSizeY)
+{
+    m_nGridX = nGridX;
+    m_nGridY = nGridY;
+    const size_t nCount = static_cast<size_t>(nGridX + 1) * (nGridY + 1);
+    for (std::vector<float>* pStream : {&m_x, &m_y, &m_rad, &m_ang, &m_tu0, &m_tv0, &m_tu, &m_tv, &m_alpha})
+        pStream->resize(nCount);
+
+    size_t n = 0;
+    float texel_offset_x = 0.5f / static_cast<float>(nTexSizeX);
+    float texel_offset_y = 0.5f / static_cast<float>(nTexSizeY);
+    for (int y = 0; y <= nGridY; y++)
+    {
+        for (int x = 0; x <= nGridX; x++)
+        {
+            float fx = x / static_cast<float>(nGridX) * 2.0f - 1.0f;
+            float fy = y / static_cast<float>(nGridY) * 2.0f - 1.0f;
+            m_x[n] = fx;
+            m_y[n] = fy;
+
+            // Polar coordinates, being conscious of aspect ratio.
+            m_rad[n] = std::sqrt(fx * fx * fAspectX * fAspectX + fy * fy * fAspectY * fAspectY);
+            if (y == nGridY / 2 && x == nGridX / 2)
+                m_ang[n] = 0.0f;
+            else
+                m_ang[n] = std::atan2(fy * fAspectY, fx * fAspectX);
+
+            m_tu0[n] =  fx * 0.5f + 0.5f + texel_offset_x;
+            m_tv0[n] = -fy * 0.5f + 0.5f + texel_offset_y;
+            m_tu[n] = m_tu0[n];
+            m_tv[n] = m_tv0[n];
+            m_alpha[n] = 1.0f;
+            n++;
+        }
+    }
+}
+
+bool CMeshStreams::SampleUV(float fx, float fy, float* pU, float* pV) const
+{
+    int y0 = static_cast<int>(fy * m_nGridY);
+    float dy = fy * m_nGridY - y0;
+
+    int x0 = static_cast<int>(fx * m_nGridX);
+    float dx = fx * m_nGridX - x0;
+
+    int x1 = x0 + 1;
+    int y1 = y0 + 1;
+
+    if (x0 < 0 || y0 < 0 || x1 > m_nGridX || y1 > m_nGridY)
+        return false;
+
+    const size_t n00 = static_cast<size_t>(y0) * (m_nGridX + 1) + x0;
+    const size_t n01 = static_cast<size_t>(y0) * (m_nGridX + 1) + x1;
+    const size_t n10 = static_cast<size_t>(y1) * (m_nGridX + 1) + x0;
+    const size_t n11 = static_cast<size_t>(y1) * (m_nGridX + 1) + x1;
+    float tu, tv;
+    tu  = m_tu[n00] * (1 - dx) * (1 - dy);
+    tv  = m_tv[n00] * (1 - dx) * (1 - dy);
+    tu += m_tu[n01] * (dx) * (1 - dy);
+    tv += m_tv[n01] * (dx) * (1 - dy);
+    tu += m_tu[n10] * (1 - dx) * (dy);
+    tv += m_tv[n10] * (1 - dx) * (dy);
+    tu += m_tu[n11] * (dx) * (dy);
+    tv += m_tv[n11] * (dx) * (dy);
+
+    *pU = tu;
+    *pV = tv;
+    return true;
+}
+
+float CMeshStreams::SampleAlpha(float fx, float fy) const
+{
+    float x = fx * (m_nGridX + 1);
+    float y = fy * (m_nGridY + 1);
+    x = std::max(std::min(x, static_cast<float>(m_nGridX) - 1.0f), 0.0f);
+    y = std::max(std::min(y, static_cast<float>(m_nGridY) - 1.0f), 0.0f);
+    int nx = static_cast<int>(x);
+    int ny = static_cast<int>(y);
+    double dx = x - nx;
+    double dy = y - ny;
+    // clang-format off
+    double alpha00 = (m_alpha[static_cast<size_t>(ny) * (m_nGridX + 1) + (nx)] * 255);
+    double alpha01 = (m_alpha[static_cast<size_t>(ny) * (m_nGridX + 1) + (nx + 1)] * 255);
+    double alpha10 = (m_alpha[static_cast<size_t>(ny + 1) * (m_nGridX + 1) + (nx)] * 255);
+    double alpha11 = (m_alpha[static_cast<size_t>(ny + 1) * (m_nGridX + 1) + (nx + 1)] * 255);
+    double alpha = alpha00 * (1 - dx) * (1 - dy) +
+                   alpha01 * (dx) * (1 - dy) +
+                   alpha10 * (1 - dx) * (dy) +
+                   alpha11 * (dx) * (dy);
+    // clang-format on
+    return static_cast<float>(alpha / 255.0f);
+}
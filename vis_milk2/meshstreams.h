@@ -0,0 +1,93 @@
+/*
+ * meshstreams.h - Warp mesh vertex streams header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// The `(nGridX + 1) * (nGridY + 1)` vertices of the warp mesh, row by row,
+// as one array per attribute. Positions, polar coordinates and the static
+// texture coordinates only change when the mesh is resized; the per-vertex
+// code writes the warped texture coordinates and blend alphas every frame.
+// The warp blit, the motion vectors and the final composite read the same
+// streams, each through the view it needs.
+class CMeshStreams
+{
+  public:
+    CMeshStreams() : m_nGridX(0), m_nGridY(0) {}
+
+    // Sizes the mesh and computes its static streams. Texture coordinates
+    // start unwarped and alphas opaque.
+    void Init(int nGridX, int nGridY, float fAspectX, float fAspectY, int nTexSizeX, int nTexSizeY);
+
+    int GetGridX() const { return m_nGridX; }
+    int GetGridY() const { return m_nGridY; }
+    size_t GetCount() const { return m_x.size(); }
+
+    // Static, in [-1, 1] with y up, and polar, aspect corrected.
+    const float* GetX() const { return m_x.data(); }
+    const float* GetY() const { return m_y.data(); }
+    const float* GetRad() const { return m_rad.data(); }
+    const float* GetAng() const { return m_ang.data(); }
+    const float* GetTu0() const { return m_tu0.data(); }
+    const float* GetTv0() const { return m_tv0.data(); }
+
+    // Dynamic.
+    float* GetTu() { return m_tu.data(); }
+    float* GetTv() { return m_tv.data(); }
+    float* GetAlpha() { return m_alpha.data(); }
+    const float* GetTu() const { return m_tu.data(); }
+    const float* GetTv() const { return m_tv.data(); }
+    const float* GetAlpha() const { return m_alpha.data(); }
+
+    // Bilinearly interpolates the warped texture coordinates at `(fx, fy)`,
+    // in [0, 1] across the mesh. Returns false outside of it.
+    bool SampleUV(float fx, float fy, float* pU, float* pV) const;
+
+    // Bilinearly interpolates the blend alpha at `(fx, fy)` in [0, 1],
+    // clamped to the mesh the way the final composite always has.
+    float SampleAlpha(float fx, float fy) const;
+
+    // Interleaves the streams into `pVerts`, one vertex per mesh vertex, for
+    // a vertex type with the members of `MDVERTEX`; white and at z = 0.
+    template <typename T>
+    void Gather(T* pVerts) const
+    {
+        const size_t nCount = GetCount();
+        for (size_t n = 0; n < nCount; n++)
+        {
+            T& v = pVerts[n];
+            v.x = m_x[n];
+            v.y = m_y[n];
+            v.z = 0.0f;
+            v.r = 1.0f;
+            v.g = 1.0f;
+            v.b = 1.0f;
+            v.a = m_alpha[n];
+            v.tu = m_tu[n];
+            v.tv = m_tv[n];
+            v.tu0 = m_tu0[n];
+            v.tv0 = m_tv0[n];
+            v.rad = m_rad[n];
+            v.ang = m_ang[n];
+        }
+    }
+
+  private:
+    int m_nGridX;
+    int m_nGridY;
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_rad;
+    std::vector<float> m_ang;
+    std::vector<float> m_tu0;
+    std::vector<float> m_tv0;
+    std::vector<float> m_tu;
+    std::vector<float> m_tv;
+    std::vector<float> m_alpha;
+};
@@ -34,9 +34,6 @@
 #include "support.h"
 #include "d3d11shim.h"
 
-#define COLOR_NORM(x) (((int)(x * 255) & 0xFF) / 255.0f)
-#define COPY_COLOR(x, y) { x.a = y.a; x.r = y.r; x.g = y.g; x.b = y.b; }
-
 static constexpr float VERT_CLIP = 0.75f; //1.0f, 0.45f - warning: top/bottom can get clipped if less than 0.65/0.4!
 
 // This function evaluates whether the floating-point
@@ -258,67 +255,31 @@ bool CPlugin::RenderStringToTitleTexture()
     if (!m_supertext.bIsSongTitle)
     {
         // Custom message -> pick font to use that will best fill the texture.
-        std::unique_ptr<TextStyle> gdi_font;
-
-        int lo = 0;
-        int hi = sizeof(g_title_font_sizes) / sizeof(int) - 1;
+        // The largest size only bounds the search.
+        bool bBold = m_supertext.bBold != 0, bItal = m_supertext.bItal != 0;
+        m_titleMeasurer.SetFactory(m_lpDX->GetDWriteFactory());
+        int nFit = m_titleFit.Fit(szTextToDraw, m_supertext.nFontFace, bBold, bItal, g_title_font_sizes, static_cast<int>(ARRAYSIZE(g_title_font_sizes)) - 1,
+                                  rect.right - rect.left, rect.bottom - rect.top);
+        TextStyle* gdi_font = nFit < 0 ? nullptr : m_titleMeasurer.GetStyle(m_supertext.nFontFace, bBold, bItal, static_cast<float>(g_title_font_sizes[nFit]));
 
-        // Limit the size of the font used.
-        //int user_title_size = GetFontHeight(SONGTITLE_FONT);
-        //while (g_title_font_sizes[hi] > user_title_size * 2 && hi > 4)
-        //    hi--;
-
-        D2D1_RECT_F temp{};
-        while (true) //(lo < hi-1)
+        if (gdi_font)
         {
-            int mid = (lo + hi) / 2;
-
-            // Create new DirectWrite font at 'mid' size.
-            gdi_font = std::make_unique<TextStyle>(
-                m_supertext.nFontFace,
-                static_cast<float>(g_title_font_sizes[mid]),
-                m_supertext.bBold ? DWRITE_FONT_WEIGHT_BLACK : DWRITE_FONT_WEIGHT_REGULAR,
-                m_supertext.bItal ? DWRITE_FONT_STYLE_ITALIC: DWRITE_FONT_STYLE_NORMAL,
-                DWRITE_TEXT_ALIGNMENT_CENTER,
-                DWRITE_TRIMMING_GRANULARITY_NONE
-            );
-
-            if (gdi_font)
+            D2D1_RECT_F temp = rect;
+            if (!m_ddsTitle.IsVisible())
             {
-                temp = rect;
-                if (!m_ddsTitle.IsVisible())
-                {
-                    m_ddsTitle.Initialize(pRenderTarget.Get() /*m_lpDX->GetD2DDeviceContext()*/);
-                }
-                m_ddsTitle.SetAlignment(AlignCenter, AlignCenter);
-                m_ddsTitle.SetTextColor(fTextColor);
-                m_ddsTitle.SetTextOpacity(fTextColor.a);
-                m_ddsTitle.SetContainer(temp);
-                m_ddsTitle.SetText(szTextToDraw);
-                m_ddsTitle.SetTextStyle(gdi_font.get());
-                m_ddsTitle.SetTextShadow(true);
-
-                // Compute size of text if drawn with font of this size.
-                temp = m_ddsTitle.GetBounds(m_lpDX->GetDWriteFactory());
-                float h = temp.bottom - temp.top;
-
-                if (lo == hi - 1)
-                    break; // DONE; but the 'lo'-size font is ready for use!
-
-                // Adjust and prepare to reiterate.
-                if (temp.right >= rect.right || h > rect.bottom - rect.top)
-                    hi = mid;
-                else
-                    lo = mid;
+                m_ddsTitle.Initialize(pRenderTarget.Get() /*m_lpDX->GetD2DDeviceContext()*/);
             }
+            m_ddsTitle.SetAlignment(AlignCenter, AlignCenter);
+            m_ddsTitle.SetTextColor(fTextColor);
+            m_ddsTitle.SetTextOpacity(fTextColor.a);
+            m_ddsTitle.SetContainer(temp);
+            m_ddsTitle.SetText(szTextToDraw);
+            m_ddsTitle.SetTextStyle(gdi_font);
+            m_ddsTitle.SetTextShadow(true);
+            temp = m_ddsTitle.GetBounds(m_lpDX->GetDWriteFactory());
 
-            gdi_font.reset();
-        }
-
-        if (gdi_font)
-        {
-            // Do actual drawing and set `m_supertext.nFontSizeUsed`; use 'lo' size.
-            int h = m_text.DrawD2DText(gdi_font.get(), &m_ddsTitle, szTextToDraw, &temp, /*DT_NOPREFIX |*/ DT_SINGLELINE | DT_CENTER | DT_CALCRECT, textColor, false);
+            // Do actual drawing and set `m_supertext.nFontSizeUsed`.
+            int h = m_text.DrawD2DText(gdi_font, &m_ddsTitle, szTextToDraw, &temp, /*DT_NOPREFIX |*/ DT_SINGLELINE | DT_CENTER | DT_CALCRECT, textColor, false);
             temp.left = 0.0f;
             temp.right = static_cast<FLOAT>(m_nTitleTexSizeX); // now allow text to go all the way over, since actually drawing!
             temp.top = static_cast<FLOAT>(m_nTitleTexSizeY / 2 - h / 2);
@@ -327,7 +288,7 @@ bool CPlugin::RenderStringToTitleTexture()
             pRenderTarget->BeginDraw();
             m_ddsTitle.Render(pRenderTarget.Get(), m_lpDX->GetDWriteFactory());
             hr = pRenderTarget->EndDraw();
-            m_supertext.nFontSizeUsed = m_text.DrawD2DText(gdi_font.get(), &m_ddsTitle, szTextToDraw, &temp, /*DT_NOPREFIX |*/ DT_SINGLELINE | DT_CENTER, textColor, false);
+            m_supertext.nFontSizeUsed = m_text.DrawD2DText(gdi_font, &m_ddsTitle, szTextToDraw, &temp, /*DT_NOPREFIX |*/ DT_SINGLELINE | DT_CENTER, textColor, false);
             m_ddsTitle.ReleaseDeviceDependentResources();
 
             ret = true;
@@ -336,9 +297,6 @@ bool CPlugin::RenderStringToTitleTexture()
         {
             ret = false;
         }
-
-        // Clean up font.
-        gdi_font.release();
     }
     else // Song title
     {
@@ -439,289 +397,51 @@ bool CPlugin::RenderStringToTitleTexture()
     return ret;
 }
 
-// Loads the `var_pf_*` variables in this CState object with the correct values.
-// for vars that affect pixel motion, that means evaluating them at time==-1,
-// (i.e. no blending with blend to value); the blending of the file dx/dy
-// will be done *after* execution of the per-vertex code.
-// for vars that do NOT affect pixel motion, evaluate them at the current time,
-// so that if they're blending, both states see the blended value.
-// clang-format off
+// Gathers the inputs the preset expressions read this frame.
+td_evalframe CPlugin::GetEvalFrame() const
+{
+    td_evalframe f;
+    f.fTime = GetTime();
+    f.fStartTime = m_fStartTime;
+    f.fPresetStartTime = m_fPresetStartTime;
+    f.fNextPresetTime = m_fNextPresetTime;
+    f.fFps = GetFps();
+    f.nFrame = static_cast<int>(GetFrame());
+    for (int i = 0; i < 3; i++)
+    {
+        f.imm_rel[i] = mdsound.imm_rel[i];
+        f.avg_rel[i] = mdsound.avg_rel[i];
+    }
+    for (int ch = 0; ch < 2; ch++)
+    {
+        f.pWaveform[ch] = m_sound.fWaveform[ch].data();
+        f.pSpectrum[ch] = m_sound.fSpectrum[ch].data();
+    }
+    f.nGridX = m_nGridX;
+    f.nGridY = m_nGridY;
+    f.nTexSizeX = m_nTexSizeX;
+    f.nTexSizeY = m_nTexSizeY;
+    f.nWidth = GetWidth();
+    f.nHeight = GetHeight();
+    f.fAspectX = m_fAspectX;
+    f.fAspectY = m_fAspectY;
+    f.fInvAspectX = m_fInvAspectX;
+    f.fInvAspectY = m_fInvAspectY;
+    return f;
+}
+
 void CPlugin::LoadPerFrameEvallibVars(CState* pState)
 {
-    // 1. Vars that affect pixel motion (eval at time == -1).
-    *pState->var_pf_zoom        = (double)pState->m_fZoom.eval(-1.0f); // GetTime());
-    *pState->var_pf_zoomexp     = (double)pState->m_fZoomExponent.eval(-1.0f); // GetTime());
-    *pState->var_pf_rot         = (double)pState->m_fRot.eval(-1.0f); //GetTime());
-    *pState->var_pf_warp        = (double)pState->m_fWarpAmount.eval(-1.0f); //GetTime());
-    *pState->var_pf_cx          = (double)pState->m_fRotCX.eval(-1.0f); //GetTime());
-    *pState->var_pf_cy          = (double)pState->m_fRotCY.eval(-1.0f); //GetTime());
-    *pState->var_pf_dx          = (double)pState->m_fXPush.eval(-1.0f); //GetTime());
-    *pState->var_pf_dy          = (double)pState->m_fYPush.eval(-1.0f); //GetTime());
-    *pState->var_pf_sx          = (double)pState->m_fStretchX.eval(-1.0f); //GetTime());
-    *pState->var_pf_sy          = (double)pState->m_fStretchY.eval(-1.0f); //GetTime());
-    // Read-only.
-    *pState->var_pf_time        = (double)(GetTime() - m_fStartTime);
-    *pState->var_pf_fps         = (double)GetFps();
-    *pState->var_pf_bass        = (double)mdsound.imm_rel[0];
-    *pState->var_pf_mid         = (double)mdsound.imm_rel[1];
-    *pState->var_pf_treb        = (double)mdsound.imm_rel[2];
-    *pState->var_pf_bass_att    = (double)mdsound.avg_rel[0];
-    *pState->var_pf_mid_att     = (double)mdsound.avg_rel[1];
-    *pState->var_pf_treb_att    = (double)mdsound.avg_rel[2];
-    *pState->var_pf_frame       = (double)GetFrame();
-    //*pState->var_pf_monitor     = 0; -leave this as it was set in the per-frame INIT code!
-    for (int vi=0; vi<NUM_Q_VAR; vi++)
-        *pState->var_pf_q[vi]   = pState->q_values_after_init_code[vi]; //0.0f;
-    *pState->var_pf_monitor     = pState->monitor_after_init_code;
-    *pState->var_pf_progress    = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
-
-    // 2. Vars that do NOT affect pixel motion (eval at time == now).
-    *pState->var_pf_decay         = (double)pState->m_fDecay.eval(GetTime());
-    *pState->var_pf_wave_a        = (double)pState->m_fWaveAlpha.eval(GetTime());
-    *pState->var_pf_wave_r        = (double)pState->m_fWaveR.eval(GetTime());
-    *pState->var_pf_wave_g        = (double)pState->m_fWaveG.eval(GetTime());
-    *pState->var_pf_wave_b        = (double)pState->m_fWaveB.eval(GetTime());
-    *pState->var_pf_wave_x        = (double)pState->m_fWaveX.eval(GetTime());
-    *pState->var_pf_wave_y        = (double)pState->m_fWaveY.eval(GetTime());
-    *pState->var_pf_wave_mystery  = (double)pState->m_fWaveParam.eval(GetTime());
-    *pState->var_pf_wave_mode     = (double)pState->m_nWaveMode; //?!?! -why won't it work if set to pState->m_nWaveMode???
-    *pState->var_pf_ob_size       = (double)pState->m_fOuterBorderSize.eval(GetTime());
-    *pState->var_pf_ob_r          = (double)pState->m_fOuterBorderR.eval(GetTime());
-    *pState->var_pf_ob_g          = (double)pState->m_fOuterBorderG.eval(GetTime());
-    *pState->var_pf_ob_b          = (double)pState->m_fOuterBorderB.eval(GetTime());
-    *pState->var_pf_ob_a          = (double)pState->m_fOuterBorderA.eval(GetTime());
-    *pState->var_pf_ib_size       = (double)pState->m_fInnerBorderSize.eval(GetTime());
-    *pState->var_pf_ib_r          = (double)pState->m_fInnerBorderR.eval(GetTime());
-    *pState->var_pf_ib_g          = (double)pState->m_fInnerBorderG.eval(GetTime());
-    *pState->var_pf_ib_b          = (double)pState->m_fInnerBorderB.eval(GetTime());
-    *pState->var_pf_ib_a          = (double)pState->m_fInnerBorderA.eval(GetTime());
-    *pState->var_pf_mv_x          = (double)pState->m_fMvX.eval(GetTime());
-    *pState->var_pf_mv_y          = (double)pState->m_fMvY.eval(GetTime());
-    *pState->var_pf_mv_dx         = (double)pState->m_fMvDX.eval(GetTime());
-    *pState->var_pf_mv_dy         = (double)pState->m_fMvDY.eval(GetTime());
-    *pState->var_pf_mv_l          = (double)pState->m_fMvL.eval(GetTime());
-    *pState->var_pf_mv_r          = (double)pState->m_fMvR.eval(GetTime());
-    *pState->var_pf_mv_g          = (double)pState->m_fMvG.eval(GetTime());
-    *pState->var_pf_mv_b          = (double)pState->m_fMvB.eval(GetTime());
-    *pState->var_pf_mv_a          = (double)pState->m_fMvA.eval(GetTime());
-    *pState->var_pf_echo_zoom     = (double)pState->m_fVideoEchoZoom.eval(GetTime());
-    *pState->var_pf_echo_alpha    = (double)pState->m_fVideoEchoAlpha.eval(GetTime());
-    *pState->var_pf_echo_orient   = (double)pState->m_nVideoEchoOrientation;
-    *pState->var_pf_wave_usedots  = (double)pState->m_bWaveDots;
-    *pState->var_pf_wave_thick    = (double)pState->m_bWaveThick;
-    *pState->var_pf_wave_additive = (double)pState->m_bAdditiveWaves;
-    *pState->var_pf_wave_brighten = (double)pState->m_bMaximizeWaveColor;
-    *pState->var_pf_darken_center = (double)pState->m_bDarkenCenter;
-    *pState->var_pf_gamma         = (double)pState->m_fGammaAdj.eval(GetTime());
-    *pState->var_pf_wrap          = (double)pState->m_bTexWrap;
-    *pState->var_pf_invert        = (double)pState->m_bInvert;
-    *pState->var_pf_brighten      = (double)pState->m_bBrighten;
-    *pState->var_pf_darken        = (double)pState->m_bDarken;
-    *pState->var_pf_solarize      = (double)pState->m_bSolarize;
-    *pState->var_pf_meshx         = (double)m_nGridX;
-    *pState->var_pf_meshy         = (double)m_nGridY;
-    *pState->var_pf_pixelsx       = (double)GetWidth();
-    *pState->var_pf_pixelsy       = (double)GetHeight();
-    *pState->var_pf_aspectx       = (double)m_fInvAspectX;
-    *pState->var_pf_aspecty       = (double)m_fInvAspectY;
-    *pState->var_pf_blur1min      = (double)pState->m_fBlur1Min.eval(GetTime());
-    *pState->var_pf_blur2min      = (double)pState->m_fBlur2Min.eval(GetTime());
-    *pState->var_pf_blur3min      = (double)pState->m_fBlur3Min.eval(GetTime());
-    *pState->var_pf_blur1max      = (double)pState->m_fBlur1Max.eval(GetTime());
-    *pState->var_pf_blur2max      = (double)pState->m_fBlur2Max.eval(GetTime());
-    *pState->var_pf_blur3max      = (double)pState->m_fBlur3Max.eval(GetTime());
-    *pState->var_pf_blur1_edge_darken = (double)pState->m_fBlur1EdgeDarken.eval(GetTime());
+    m_evaluator.LoadPerFrameEvallibVars(pState, GetEvalFrame());
 }
 
 // Run per-frame calculations.
 void CPlugin::RunPerFrameEquations(int code)
 {
-    /*
-      Code is only valid when blending.
-          OLDcomp ~ blend-from preset has a composite shader.
-          NEWwarp ~ blend-to preset has a warp shader, etc.
-
-      code OLDcomp NEWcomp OLDwarp NEWwarp
-        0
-        1            1
-        2                            1
-        3            1               1
-        4     1
-        5     1      1
-        6     1                      1
-        7     1      1               1
-        8                    1
-        9            1       1
-        10                   1       1
-        11           1       1       1
-        12    1              1
-        13    1      1       1
-        14    1              1       1
-        15    1      1       1       1
-    */
-
-    // When blending booleans (like darken, invert, etc) for pre-shader presets,
-    // if blending to/from a pixel-shader preset, it is possible to tune the snap
-    // point (when it changes during the blend) for a less jumpy transition.
-    m_fSnapPoint = 0.5f;
-    if (m_pState->m_bBlending)
-    {
-        switch (code)
-        {
-            case 4:
-            case 6:
-            case 12:
-            case 14:
-                // Old preset (only) had a comp shader.
-                m_fSnapPoint = -0.01f;
-                break;
-            case 1:
-            case 3:
-            case 9:
-            case 11:
-                // New preset (only) has a comp shader.
-                m_fSnapPoint = 1.01f;
-                break;
-            case 0:
-            case 2:
-            case 8:
-            case 10:
-                // Neither old or new preset had a comp shader.
-                m_fSnapPoint = 0.5f;
-                break;
-            case 5:
-            case 7:
-            case 13:
-            case 15:
-                // Both old and new presets use a comp shader - so it won't matter.
-                m_fSnapPoint = 0.5f;
-                break;
-        }
-    }
-
-    int num_reps = (m_pState->m_bBlending) ? 2 : 1;
-    for (int rep = 0; rep < num_reps; rep++)
-    {
-        CState* pState;
-
-        if (rep == 0)
-            pState = m_pState;
-        else
-            pState = m_pOldState;
-
-        // Values that will affect the pixel motion (and will be automatically blended
-        // LATER, when the results of 2 sets of these params creates 2 different U/V
-        // meshes that get blended together).
-        LoadPerFrameEvallibVars(pState);
-
-        // Also do just a once-per-frame init for the *per-**VERTEX*** *READ-ONLY* variables
-        // (the non-read-only ones will be reset/restored at the start of each vertex)
-        *pState->var_pv_time     = *pState->var_pf_time;
-        *pState->var_pv_fps      = *pState->var_pf_fps;
-        *pState->var_pv_frame    = *pState->var_pf_frame;
-        *pState->var_pv_progress = *pState->var_pf_progress;
-        *pState->var_pv_bass     = *pState->var_pf_bass;
-        *pState->var_pv_mid      = *pState->var_pf_mid;
-        *pState->var_pv_treb     = *pState->var_pf_treb;
-        *pState->var_pv_bass_att = *pState->var_pf_bass_att;
-        *pState->var_pv_mid_att  = *pState->var_pf_mid_att;
-        *pState->var_pv_treb_att = *pState->var_pf_treb_att;
-        *pState->var_pv_meshx    = (double)m_nGridX;
-        *pState->var_pv_meshy    = (double)m_nGridY;
-        *pState->var_pv_pixelsx  = (double)GetWidth();
-        *pState->var_pv_pixelsy  = (double)GetHeight();
-        *pState->var_pv_aspectx  = (double)m_fInvAspectX;
-        *pState->var_pv_aspecty  = (double)m_fInvAspectY;
-        //*pState->var_pv_monitor = *pState->var_pf_monitor;
-
-#ifndef _NO_EXPR_
-        // Execute once-per-frame expressions.
-        if (pState->m_pf_codehandle)
-        {
-            NSEEL_code_execute(pState->m_pf_codehandle);
-        }
-#endif
-
-        // Save some things for next frame.
-        pState->monitor_after_init_code = *pState->var_pf_monitor;
-
-        // Save some things for per-vertex code.
-        for (int vi = 0; vi < NUM_Q_VAR; vi++)
-            *pState->var_pv_q[vi] = *pState->var_pf_q[vi];
+    PROFILE_SCOPE(m_profiler, PROF_PER_FRAME_EQUATIONS);
 
-        // Range checks.
-        *pState->var_pf_gamma = std::max(0.0, std::min(double(8), *pState->var_pf_gamma));
-        *pState->var_pf_echo_zoom = std::max(0.001, std::min(double(1000), *pState->var_pf_echo_zoom));
-
-        /*
-        if (m_pState->m_bRedBlueStereo || m_bAlways3D)
-        {
-            // Override wave colors.
-            *pState->var_pf_wave_r = 0.35f * (*pState->var_pf_wave_r) + 0.65f;
-            *pState->var_pf_wave_g = 0.35f * (*pState->var_pf_wave_g) + 0.65f;
-            *pState->var_pf_wave_b = 0.35f * (*pState->var_pf_wave_b) + 0.65f;
-        }
-        */
-    }
-
-    if (m_pState->m_bBlending)
-    {
-        // For all variables that do NOT affect pixel motion, blend them NOW,
-        // so later the user can just access m_pState->m_pf_whatever.
-        double mix = (double)CosineInterp(m_pState->m_fBlendProgress);
-        double mix2 = 1.0 - mix;
-        *m_pState->var_pf_decay        = mix * (*m_pState->var_pf_decay)        + mix2 * (*m_pOldState->var_pf_decay);
-        *m_pState->var_pf_wave_a       = mix * (*m_pState->var_pf_wave_a)       + mix2 * (*m_pOldState->var_pf_wave_a);
-        *m_pState->var_pf_wave_r       = mix * (*m_pState->var_pf_wave_r)       + mix2 * (*m_pOldState->var_pf_wave_r);
-        *m_pState->var_pf_wave_g       = mix * (*m_pState->var_pf_wave_g)       + mix2 * (*m_pOldState->var_pf_wave_g);
-        *m_pState->var_pf_wave_b       = mix * (*m_pState->var_pf_wave_b)       + mix2 * (*m_pOldState->var_pf_wave_b);
-        *m_pState->var_pf_wave_x       = mix * (*m_pState->var_pf_wave_x)       + mix2 * (*m_pOldState->var_pf_wave_x);
-        *m_pState->var_pf_wave_y       = mix * (*m_pState->var_pf_wave_y)       + mix2 * (*m_pOldState->var_pf_wave_y);
-        *m_pState->var_pf_wave_mystery = mix * (*m_pState->var_pf_wave_mystery) + mix2 * (*m_pOldState->var_pf_wave_mystery);
-        // wave_mode: exempt (integer)
-        *m_pState->var_pf_ob_size       = mix * (*m_pState->var_pf_ob_size)    + mix2 * (*m_pOldState->var_pf_ob_size);
-        *m_pState->var_pf_ob_r          = mix * (*m_pState->var_pf_ob_r)       + mix2 * (*m_pOldState->var_pf_ob_r);
-        *m_pState->var_pf_ob_g          = mix * (*m_pState->var_pf_ob_g)       + mix2 * (*m_pOldState->var_pf_ob_g);
-        *m_pState->var_pf_ob_b          = mix * (*m_pState->var_pf_ob_b)       + mix2 * (*m_pOldState->var_pf_ob_b);
-        *m_pState->var_pf_ob_a          = mix * (*m_pState->var_pf_ob_a)       + mix2 * (*m_pOldState->var_pf_ob_a);
-        *m_pState->var_pf_ib_size       = mix * (*m_pState->var_pf_ib_size)    + mix2 * (*m_pOldState->var_pf_ib_size);
-        *m_pState->var_pf_ib_r          = mix * (*m_pState->var_pf_ib_r)       + mix2 * (*m_pOldState->var_pf_ib_r);
-        *m_pState->var_pf_ib_g          = mix * (*m_pState->var_pf_ib_g)       + mix2 * (*m_pOldState->var_pf_ib_g);
-        *m_pState->var_pf_ib_b          = mix * (*m_pState->var_pf_ib_b)       + mix2 * (*m_pOldState->var_pf_ib_b);
-        *m_pState->var_pf_ib_a          = mix * (*m_pState->var_pf_ib_a)       + mix2 * (*m_pOldState->var_pf_ib_a);
-        *m_pState->var_pf_mv_x          = mix * (*m_pState->var_pf_mv_x)       + mix2 * (*m_pOldState->var_pf_mv_x);
-        *m_pState->var_pf_mv_y          = mix * (*m_pState->var_pf_mv_y)       + mix2 * (*m_pOldState->var_pf_mv_y);
-        *m_pState->var_pf_mv_dx         = mix * (*m_pState->var_pf_mv_dx)      + mix2 * (*m_pOldState->var_pf_mv_dx);
-        *m_pState->var_pf_mv_dy         = mix * (*m_pState->var_pf_mv_dy)      + mix2 * (*m_pOldState->var_pf_mv_dy);
-        *m_pState->var_pf_mv_l          = mix * (*m_pState->var_pf_mv_l)       + mix2 * (*m_pOldState->var_pf_mv_l);
-        *m_pState->var_pf_mv_r          = mix * (*m_pState->var_pf_mv_r)       + mix2 * (*m_pOldState->var_pf_mv_r);
-        *m_pState->var_pf_mv_g          = mix * (*m_pState->var_pf_mv_g)       + mix2 * (*m_pOldState->var_pf_mv_g);
-        *m_pState->var_pf_mv_b          = mix * (*m_pState->var_pf_mv_b)       + mix2 * (*m_pOldState->var_pf_mv_b);
-        *m_pState->var_pf_mv_a          = mix * (*m_pState->var_pf_mv_a)       + mix2 * (*m_pOldState->var_pf_mv_a);
-        *m_pState->var_pf_echo_zoom     = mix * (*m_pState->var_pf_echo_zoom)  + mix2 * (*m_pOldState->var_pf_echo_zoom);
-        *m_pState->var_pf_echo_alpha    = mix * (*m_pState->var_pf_echo_alpha) + mix2 * (*m_pOldState->var_pf_echo_alpha);
-        *m_pState->var_pf_echo_orient   = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_echo_orient   : *m_pState->var_pf_echo_orient;
-        *m_pState->var_pf_wave_usedots  = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_wave_usedots  : *m_pState->var_pf_wave_usedots;
-        *m_pState->var_pf_wave_thick    = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_wave_thick    : *m_pState->var_pf_wave_thick;
-        *m_pState->var_pf_wave_additive = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_wave_additive : *m_pState->var_pf_wave_additive;
-        *m_pState->var_pf_wave_brighten = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_wave_brighten : *m_pState->var_pf_wave_brighten;
-        *m_pState->var_pf_darken_center = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_darken_center : *m_pState->var_pf_darken_center;
-        *m_pState->var_pf_gamma         = mix * (*m_pState->var_pf_gamma) + mix2 * (*m_pOldState->var_pf_gamma);
-        *m_pState->var_pf_wrap          = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_wrap     : *m_pState->var_pf_wrap;
-        *m_pState->var_pf_invert        = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_invert   : *m_pState->var_pf_invert;
-        *m_pState->var_pf_brighten      = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_brighten : *m_pState->var_pf_brighten;
-        *m_pState->var_pf_darken        = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_darken   : *m_pState->var_pf_darken;
-        *m_pState->var_pf_solarize      = (mix < m_fSnapPoint) ? *m_pOldState->var_pf_solarize : *m_pState->var_pf_solarize;
-        *m_pState->var_pf_blur1min      = mix * (*m_pState->var_pf_blur1min) + mix2 * (*m_pOldState->var_pf_blur1min);
-        *m_pState->var_pf_blur2min      = mix * (*m_pState->var_pf_blur2min) + mix2 * (*m_pOldState->var_pf_blur2min);
-        *m_pState->var_pf_blur3min      = mix * (*m_pState->var_pf_blur3min) + mix2 * (*m_pOldState->var_pf_blur3min);
-        *m_pState->var_pf_blur1max      = mix * (*m_pState->var_pf_blur1max) + mix2 * (*m_pOldState->var_pf_blur1max);
-        *m_pState->var_pf_blur2max      = mix * (*m_pState->var_pf_blur2max) + mix2 * (*m_pOldState->var_pf_blur2max);
-        *m_pState->var_pf_blur3max      = mix * (*m_pState->var_pf_blur3max) + mix2 * (*m_pOldState->var_pf_blur3max);
-        *m_pState->var_pf_blur1_edge_darken = mix * (*m_pState->var_pf_blur1_edge_darken) + mix2 * (*m_pOldState->var_pf_blur1_edge_darken);
-    }
+    m_fSnapPoint = m_evaluator.RunPerFrameEquations(m_pState, m_pOldState, code, GetEvalFrame());
 }
-// clang-format on
 
 void CPlugin::RenderFrame(int bRedraw)
 {
@@ -980,6 +700,7 @@ void CPlugin::RenderFrame(int bRedraw)
         if (!RenderStringToTitleTexture())
             m_supertext.fStartTime = -1.0f;
         m_supertext.bRedrawSuperText = false;
+        lpDevice->InvalidateState(); // Direct2D shares the device context
     }
 
     // Set up to render [from NULL] to VS0 (for motion vectors).
@@ -1171,190 +892,30 @@ void CPlugin::RenderFrame(int bRedraw)
 
 void CPlugin::DrawMotionVectors()
 {
-    // FLEXIBLE MOTION VECTOR FIELD
-    if ((float)*m_pState->var_pf_mv_a >= 0.001f)
-    {
-        D3D11Shim* lpDevice = GetDevice();
-        if (!lpDevice)
-            return;
-
-        lpDevice->SetTexture(0, NULL);
-        lpDevice->SetVertexShader(NULL, NULL);
-        lpDevice->SetVertexColor(true);
-        //lpDevice->SetFVF(WFVERTEX_FORMAT);
-        //-------------------------------------------------------
-
-        int nX = (int)(*m_pState->var_pf_mv_x); // + 0.999f);
-        int nY = (int)(*m_pState->var_pf_mv_y); // + 0.999f);
-        float dx = (float)*m_pState->var_pf_mv_x - nX;
-        float dy = (float)*m_pState->var_pf_mv_y - nY;
-        if (nX > 64) { nX = 64; dx = 0; }
-        if (nY > 48) { nY = 48; dy = 0; }
-
-        if (nX > 0 && nY > 0)
-        {
-            /*
-            float dx2 = m_fMotionVectorsTempDx; //(*m_pState->var_pf_mv_dx) * 0.05f*GetTime(); // 0..1 range
-            float dy2 = m_fMotionVectorsTempDy; //(*m_pState->var_pf_mv_dy) * 0.05f*GetTime(); // 0..1 range
-            if (GetFps() > 2.0f && GetFps() < 300.0f)
-            {
-                dx2 += (float)(*m_pState->var_pf_mv_dx) * 0.05f / GetFps();
-                dy2 += (float)(*m_pState->var_pf_mv_dy) * 0.05f / GetFps();
-            }
-            if (dx2 > 1.0f) dx2 -= (int)dx2;
-            if (dy2 > 1.0f) dy2 -= (int)dy2;
-            if (dx2 < 0.0f) dx2 = 1.0f - (-dx2 - (int)(-dx2));
-            if (dy2 < 0.0f) dy2 = 1.0f - (-dy2 - (int)(-dy2));
-            // Hack: when there is only 1 motion vector on the screen, to keep it in.
-            //       the center, we gradually migrate it toward 0.5.
-            dx2 = dx2*0.995f + 0.5f*0.005f;
-            dy2 = dy2*0.995f + 0.5f*0.005f;
-            // safety catch
-            if (dx2 < 0 || dx2 > 1 || dy2 < 0 || dy2 > 1)
-            {
-                dx2 = 0.5f;
-                dy2 = 0.5f;
-            }
-            m_fMotionVectorsTempDx = dx2;
-            m_fMotionVectorsTempDy = dy2;*/
-            float dx2 = (float)(*m_pState->var_pf_mv_dx);
-            float dy2 = (float)(*m_pState->var_pf_mv_dy);
-
-            float len_mult = (float)*m_pState->var_pf_mv_l;
-            if (dx < 0) dx = 0;
-            if (dy < 0) dy = 0;
-            if (dx > 1) dx = 1;
-            if (dy > 1) dy = 1;
-            //dx = dx * 1.0f / (float)nX;
-            //dy = dy * 1.0f / (float)nY;
-            float inv_texsize = 1.0f / (float)m_nTexSizeX;
-            float min_len = 1.0f * inv_texsize;
-
-            WFVERTEX v[(64 + 1) * 2];
-            ZeroMemory(v, sizeof(WFVERTEX) * (64 + 1) * 2);
-            v[0].r = COLOR_NORM((float)*m_pState->var_pf_mv_r);
-            v[0].g = COLOR_NORM((float)*m_pState->var_pf_mv_g);
-            v[0].b = COLOR_NORM((float)*m_pState->var_pf_mv_b);
-            v[0].a = COLOR_NORM((float)*m_pState->var_pf_mv_a);
-
-            for (int x = 1; x < (nX + 1) * 2; x++)
-                COPY_COLOR(v[x], v[0]);
-            lpDevice->SetBlendState(true, D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA);
-
-            for (int y = 0; y < nY; y++)
-            {
-                float fy = (y + 0.25f) / (float)(nY + dy + 0.25f - 1.0f);
-
-                // now move by offset
-                fy -= dy2;
-
-                if (fy > 0.0001f && fy < 0.9999f)
-                {
-                    int n = 0;
-                    for (int x = 0; x < nX; x++)
-                    {
-                        //float fx = (x + 0.25f) / (float)(nX + dx + 0.25f - 1.0f);
-                        float fx = (x + 0.25f) / (float)(nX + dx + 0.25f - 1.0f);
-
-                        // Now move by offset.
-                        fx += dx2;
-
-                        if (fx > 0.0001f && fx < 0.9999f)
-                        {
-                            float fx2, fy2;
-                            ReversePropagatePoint(fx, fy, &fx2, &fy2); // NOTE: THIS IS REALLY A REVERSE-PROPAGATION
-                            //fx2 = fx*2 - fx2;
-                            //fy2 = fy*2 - fy2;
-                            //fx2 = fx + 1.0f/(float)m_nTexSize;
-                            //fy2 = 1-(fy + 1.0f/(float)m_nTexSize);
-
-                            // Enforce minimum trail lengths.
-                            {
-                                dx = (fx2 - fx);
-                                dy = (fy2 - fy);
-                                dx *= len_mult;
-                                dy *= len_mult;
-                                float len = sqrtf(dx * dx + dy * dy);
-
-                                if (len > min_len)
-                                {
-                                }
-                                else if (len > 0.00000001f)
-                                {
-                                    len = min_len / len;
-                                    dx *= len;
-                                    dy *= len;
-                                }
-                                else
-                                {
-                                    dx = min_len;
-                                    dy = min_len;
-                                }
-
-                                fx2 = fx + dx;
-                                fy2 = fy + dy;
-                            }
-
-                            v[n].x = fx * 2.0f - 1.0f;
-                            v[n].y = fy * 2.0f - 1.0f;
-                            v[n + 1].x = fx2 * 2.0f - 1.0f;
-                            v[n + 1].y = fy2 * 2.0f - 1.0f;
-
-                            // actually, project it in the reverse direction
-                            //v[n+1].x = v[n].x*2.0f - v[n+1].x;// + dx*2;
-                            //v[n+1].y = v[n].y*2.0f - v[n+1].y;// + dy*2;
-                            //v[n].x += dx*2;
-                            //v[n].y += dy*2;
+    D3D11Shim* lpDevice = GetDevice();
+    if (!lpDevice)
+        return;
 
-                            n += 2;
-                        }
-                    }
+    m_mv_verts.resize(64 * 48 * 2);
+    WFVERTEX* v = m_mv_verts.data();
+    int n = m_evaluator.EvalMotionVectors(m_pState, GetEvalFrame(), m_mesh, v);
+    if (n == 0)
+        return;
 
-                    // Draw it.
-                    lpDevice->DrawPrimitive(D3D_PRIMITIVE_TOPOLOGY_LINELIST, n / 2, v, sizeof(WFVERTEX));
-                }
-            }
+    lpDevice->SetTexture(0, NULL);
+    lpDevice->SetVertexShader(NULL, NULL);
+    lpDevice->SetVertexColor(true);
+    lpDevice->SetBlendState(true, D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA);
 
-            lpDevice->SetBlendState(false);
-        }
+    // Draw it, in batches that fit the vertex buffer.
+    constexpr int nBatch = (64 + 1) * 2 * 8;
+    for (int start = 0; start < n; start += nBatch)
+    {
+        int count = std::min(nBatch, n - start);
+        lpDevice->DrawPrimitive(D3D_PRIMITIVE_TOPOLOGY_LINELIST, count / 2, &v[start], sizeof(WFVERTEX));
     }
-}
 
-bool CPlugin::ReversePropagatePoint(float fx, float fy, float* fx2, float* fy2) const
-{
-    //float fy = y / (float)nMotionVectorsY;
-    int y0 = (int)(fy * m_nGridY);
-    float dy = fy * m_nGridY - y0;
-
-    //float fx = x / (float)nMotionVectorsX;
-    int x0 = (int)(fx * m_nGridX);
-    float dx = fx * m_nGridX - x0;
-
-    int x1 = x0 + 1;
-    int y1 = y0 + 1;
-
-    if (x0 < 0) return false;
-    if (y0 < 0) return false;
-    //if (x1 < 0) return false;
-    //if (y1 < 0) return false;
-    //if (x0 > m_nGridX) return false;
-    //if (y0 > m_nGridY) return false;
-    if (x1 > m_nGridX) return false;
-    if (y1 > m_nGridY) return false;
-
-    float tu, tv;
-    tu  = m_verts[y0 * (m_nGridX + 1) + x0].tu * (1 - dx) * (1 - dy);
-    tv  = m_verts[y0 * (m_nGridX + 1) + x0].tv * (1 - dx) * (1 - dy);
-    tu += m_verts[y0 * (m_nGridX + 1) + x1].tu * (dx) * (1 - dy);
-    tv += m_verts[y0 * (m_nGridX + 1) + x1].tv * (dx) * (1 - dy);
-    tu += m_verts[y1 * (m_nGridX + 1) + x0].tu * (1 - dx) * (dy);
-    tv += m_verts[y1 * (m_nGridX + 1) + x0].tv * (1 - dx) * (dy);
-    tu += m_verts[y1 * (m_nGridX + 1) + x1].tu * (dx) * (dy);
-    tv += m_verts[y1 * (m_nGridX + 1) + x1].tv * (dx) * (dy);
-
-    *fx2 = tu;
-    *fy2 = 1.0f - tv;
-    return true;
+    lpDevice->SetBlendState(false);
 }
 
 void CPlugin::GetSafeBlurMinMax(CState* pState, float* blur_min, float* blur_max)
@@ -1402,6 +963,8 @@ void CPlugin::GetSafeBlurMinMax(CState* pState, float* blur_min, float* blur_max
 //       up for the composite pass is probably more important.
 void CPlugin::BlurPasses()
 {
+    PROFILE_SCOPE(m_profiler, PROF_BLUR_PASSES);
+
 #if (NUM_BLUR_TEX > 0)
     D3D11Shim* lpDevice = GetDevice();
     if (!lpDevice)
@@ -1571,192 +1134,9 @@ void CPlugin::BlurPasses()
 
 void CPlugin::ComputeGridAlphaValues()
 {
-    float fBlend = m_pState->m_fBlendProgress; //std::max(0, min(1, (m_pState->m_fBlendProgress * 1.6f - 0.3f)));
-    /*
-    switch (code) //if (nPassOverride==0)
-    {
-        //case 8:
-        //case 9:
-        //case 12:
-        //case 13:
-            // note - these are the 4 cases where the old preset uses a warp shader, but new preset doesn't.
-            fBlend = 1 - fBlend; // <-- THIS IS THE KEY - FLIPS THE ALPHAS AND EVERYTHING ELSE JUST WORKS.
-            break;
-    }
-    */
-    //fBlend = 1 - fBlend; // <-- THIS IS THE KEY - FLIPS THE ALPHAS AND EVERYTHING ELSE JUST WORKS.
-    //bool bBlending = m_pState->m_bBlending; //(fBlend >= 0.0001f && fBlend <= 0.9999f);
-
-    // Warp.
-    float fWarpTime = GetTime() * m_pState->m_fWarpAnimSpeed;
-    float fWarpScaleInv = 1.0f / m_pState->m_fWarpScale.eval(GetTime());
-    float f[4];
-    f[0] = 11.68f + 4.0f * cosf(fWarpTime * 1.413f + 10);
-    f[1] =  8.77f + 3.0f * cosf(fWarpTime * 1.113f + 7);
-    f[2] = 10.54f + 3.0f * cosf(fWarpTime * 1.233f + 3);
-    f[3] = 11.49f + 4.0f * cosf(fWarpTime * 0.933f + 5);
-
-    // Texel alignment.
-    float texel_offset_x = 0.5f / (float)m_nTexSizeX;
-    float texel_offset_y = 0.5f / (float)m_nTexSizeY;
-
-    int num_reps = (m_pState->m_bBlending) ? 2 : 1;
-    int start_rep = 0;
-
-    // FIRST WE HAVE 1-2 PASSES FOR CRUNCHING THE PER-VERTEX EQUATIONS
-    for (int rep = start_rep; rep < num_reps; rep++)
-    {
-        // to blend the two PV equations together, we simulate both to get the final UV coords,
-        // then we blend those final UV coords.  We also write out an alpha value so that
-        // the second DRAW pass below (which might use a different shader) can do blending.
-        CState* pState;
-
-        if (rep == 0)
-            pState = m_pState;
-        else
-            pState = m_pOldState;
-
-        // Cache the doubles as floats so that computations are a bit faster.
-        float fZoom    = static_cast<float>(*pState->var_pf_zoom);
-        float fZoomExp = static_cast<float>(*pState->var_pf_zoomexp);
-        float fRot     = static_cast<float>(*pState->var_pf_rot);
-        float fWarp    = static_cast<float>(*pState->var_pf_warp);
-        float fCX      = static_cast<float>(*pState->var_pf_cx);
-        float fCY      = static_cast<float>(*pState->var_pf_cy);
-        float fDX      = static_cast<float>(*pState->var_pf_dx);
-        float fDY      = static_cast<float>(*pState->var_pf_dy);
-        float fSX      = static_cast<float>(*pState->var_pf_sx);
-        float fSY      = static_cast<float>(*pState->var_pf_sy);
-
-        int n = 0;
-
-        for (int y = 0; y <= m_nGridY; y++)
-        {
-            for (int x = 0; x <= m_nGridX; x++)
-            {
-                // Note: x, y, z are now set at init. time - no need to mess with them!
-                //m_verts[n].x = i / (float)m_nGridX * 2.0f - 1.0f;
-                //m_verts[n].y = j / (float)m_nGridY * 2.0f - 1.0f;
-                //m_verts[n].z = 0.0f;
+    PROFILE_SCOPE(m_profiler, PROF_GRID_ALPHA_VALUES);
 
-                if (pState->m_pp_codehandle)
-                {
-                    // Restore all the variables to their original states,
-                    // run the user-defined equations, then move the
-                    // results into local vars for computation as floats
-                    *pState->var_pv_x       = (double)(m_verts[n].x * 0.5f * m_fAspectX + 0.5f);
-                    *pState->var_pv_y       = (double)(m_verts[n].y * -0.5f * m_fAspectY + 0.5f);
-                    *pState->var_pv_rad     = (double)m_vertinfo[n].rad;
-                    *pState->var_pv_ang     = (double)m_vertinfo[n].ang;
-                    *pState->var_pv_zoom    = *pState->var_pf_zoom;
-                    *pState->var_pv_zoomexp = *pState->var_pf_zoomexp;
-                    *pState->var_pv_rot     = *pState->var_pf_rot;
-                    *pState->var_pv_warp    = *pState->var_pf_warp;
-                    *pState->var_pv_cx      = *pState->var_pf_cx;
-                    *pState->var_pv_cy      = *pState->var_pf_cy;
-                    *pState->var_pv_dx      = *pState->var_pf_dx;
-                    *pState->var_pv_dy      = *pState->var_pf_dy;
-                    *pState->var_pv_sx      = *pState->var_pf_sx;
-                    *pState->var_pv_sy      = *pState->var_pf_sy;
-                    //*pState->var_pv_time    = *pState->var_pv_time; // (these are all now initialized
-                    //*pState->var_pv_bass    = *pState->var_pv_bass; //  just once per frame)
-                    //*pState->var_pv_mid     = *pState->var_pv_mid;
-                    //*pState->var_pv_treb    = *pState->var_pv_treb;
-                    //*pState->var_pv_bass_att = *pState->var_pv_bass_att;
-                    //*pState->var_pv_mid_att = *pState->var_pv_mid_att;
-                    //*pState->var_pv_treb_att = *pState->var_pv_treb_att;
-
-#ifndef _NO_EXPR_
-                    NSEEL_code_execute(pState->m_pp_codehandle);
-#endif
-
-                    fZoom    = static_cast<float>(*pState->var_pv_zoom);
-                    fZoomExp = static_cast<float>(*pState->var_pv_zoomexp);
-                    fRot     = static_cast<float>(*pState->var_pv_rot);
-                    fWarp    = static_cast<float>(*pState->var_pv_warp);
-                    fCX      = static_cast<float>(*pState->var_pv_cx);
-                    fCY      = static_cast<float>(*pState->var_pv_cy);
-                    fDX      = static_cast<float>(*pState->var_pv_dx);
-                    fDY      = static_cast<float>(*pState->var_pv_dy);
-                    fSX      = static_cast<float>(*pState->var_pv_sx);
-                    fSY      = static_cast<float>(*pState->var_pv_sy);
-                }
-
-                float fZoom2 = powf(fZoom, powf(fZoomExp, m_vertinfo[n].rad * 2.0f - 1.0f));
-
-                // initial texcoords, w/built-in zoom factor
-                float fZoom2Inv = 1.0f / fZoom2;
-                float u = m_verts[n].x * m_fAspectX * 0.5f * fZoom2Inv + 0.5f;
-                float v = -m_verts[n].y * m_fAspectY * 0.5f * fZoom2Inv + 0.5f;
-                //float u_orig = u;
-                //float v_orig = v;
-                //m_verts[n].tr = u_orig + texel_offset_x;
-                //m_verts[n].ts = v_orig + texel_offset_y;
-
-                // Stretch on X, Y.
-                u = (u - fCX) / fSX + fCX;
-                v = (v - fCY) / fSY + fCY;
-
-                // Warping.
-                //if (fWarp > 0.001f || fWarp < -0.001f)
-                //{
-                u += fWarp * 0.0035f * sinf(fWarpTime * 0.333f + fWarpScaleInv * (m_verts[n].x * f[0] - m_verts[n].y * f[3]));
-                v += fWarp * 0.0035f * cosf(fWarpTime * 0.375f - fWarpScaleInv * (m_verts[n].x * f[2] + m_verts[n].y * f[1]));
-                u += fWarp * 0.0035f * cosf(fWarpTime * 0.753f - fWarpScaleInv * (m_verts[n].x * f[1] - m_verts[n].y * f[2]));
-                v += fWarp * 0.0035f * sinf(fWarpTime * 0.825f + fWarpScaleInv * (m_verts[n].x * f[0] + m_verts[n].y * f[3]));
-                //}
-
-                // Rotation.
-                float u2 = u - fCX;
-                float v2 = v - fCY;
-
-                float cos_rot = cosf(fRot);
-                float sin_rot = sinf(fRot);
-                u = u2 * cos_rot - v2 * sin_rot + fCX;
-                v = u2 * sin_rot + v2 * cos_rot + fCY;
-
-                // translation:
-                u -= fDX;
-                v -= fDY;
-
-                // undo aspect ratio fix:
-                u = (u - 0.5f) * m_fInvAspectX + 0.5f;
-                v = (v - 0.5f) * m_fInvAspectY + 0.5f;
-
-                // final half-texel-offset translation:
-                u += texel_offset_x;
-                v += texel_offset_y;
-
-                if (rep == 0)
-                {
-                    // UV's for m_pState
-                    m_verts[n].tu = u;
-                    m_verts[n].tv = v;
-                    m_verts[n].a = 1.0f;
-                    m_verts[n].r = 1.0f;
-                    m_verts[n].g = 1.0f;
-                    m_verts[n].b = 1.0f;
-                }
-                else
-                {
-                    // Blend to UV's for `m_pOldState`.
-                    float mix2 = m_vertinfo[n].a * fBlend + m_vertinfo[n].c; //fCosineBlend2;
-                    mix2 = std::max(0.0f, std::min(1.0f, mix2));
-                    // if fBlend un-flipped, then mix2 is 0 at the beginning of a blend, 1 at the end...
-                    //                       and alphas are 0 at the beginning, 1 at the end.
-                    m_verts[n].tu = m_verts[n].tu * (mix2) + u * (1 - mix2);
-                    m_verts[n].tv = m_verts[n].tv * (mix2) + v * (1 - mix2);
-                    // Set the alpha values for blending between two presets:
-                    m_verts[n].a = mix2;
-                    m_verts[n].r = 1.0f;
-                    m_verts[n].g = 1.0f;
-                    m_verts[n].b = 1.0f;
-                }
-
-                n++;
-            }
-        }
-    }
+    m_evaluator.ComputeGridAlphaValues(m_pState, m_pOldState, GetEvalFrame(), m_mesh, m_vertinfo);
 }
 
 void CPlugin::WarpedBlit_NoShaders(int /* nPass */, bool bAlphaBlend, bool bFlipAlpha, bool bCullTiles, bool bFlipCulling)
@@ -1832,56 +1212,22 @@ void CPlugin::WarpedBlit_NoShaders(int /* nPass */, bool bAlphaBlend, bool bFlip
     else
         lpDevice->SetBlendState(false);
 
-    int nAlphaTestValue = 0;
-    if (bFlipCulling)
-        nAlphaTestValue = 1 - nAlphaTestValue;
-
-    // Hurl the triangles at the video card.
-    // Going to un-index it, to not stress non-performant drivers.
+    // Hurl the triangles at the video card, flipping the sign on Y and
+    // factoring in the decay color.
     // If blending, skip any polygon that is all alpha-blended out.
-    // This also respects the `MaxPrimCount` limit of the video card.
-    MDVERTEX tempv[1024 * 3];
-    int max_prims_per_batch = std::min(lpDevice->GetMaxPrimitiveCount(), static_cast<UINT>(ARRAYSIZE(tempv) / 3)) - 4;
-    int primCount = m_nGridX * m_nGridY * 2;
-    int src_idx = 0;
-    //int prims_sent = 0;
-    while (src_idx < primCount * 3)
+    const size_t nGrid = static_cast<size_t>(m_nGridX + 1) * (m_nGridY + 1);
+    const size_t nSeamStart = GetWarpSeamStart(m_nGridX, m_nGridY);
+    m_mesh.Gather(m_warp_verts.data());
+    for (size_t x = 0; x < GetWarpSeamCount(m_nGridX); x++)
+        m_warp_verts[nGrid + x] = m_warp_verts[nSeamStart + x];
+    for (MDVERTEX& v : m_warp_verts)
     {
-        int prims_queued = 0;
-        int i = 0;
-        while (prims_queued < max_prims_per_batch && src_idx < primCount * 3)
-        {
-            // Copy 3 vertices.
-            for (int j = 0; j < 3; j++)
-            {
-                tempv[i++] = m_verts[m_indices_list[src_idx++]];
-                // Flip sign on Y and factor in the decay color!
-                tempv[i - 1].y *= -1;
-                tempv[i - 1].r = cDecay;
-                tempv[i - 1].g = cDecay;
-                tempv[i - 1].b = cDecay;
-            }
-            if (bCullTiles)
-            {
-                DWORD d1 = static_cast<DWORD>(tempv[i - 3].a * 255);
-                DWORD d2 = static_cast<DWORD>(tempv[i - 2].a * 255);
-                DWORD d3 = static_cast<DWORD>(tempv[i - 1].a * 255);
-                bool bIsNeeded;
-                if (nAlphaTestValue)
-                    bIsNeeded = ((d1 & d2 & d3) < 255); //(d1 < 255) || (d2 < 255) || (d3 < 255);
-                else
-                    bIsNeeded = ((d1 | d2 | d3) > 0); //(d1 > 0) || (d2 > 0) || (d3 > 0);
-                if (!bIsNeeded)
-                    i -= 3;
-                else
-                    prims_queued++;
-            }
-            else
-                prims_queued++;
-        }
-        if (prims_queued > 0)
-            lpDevice->DrawPrimitive(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, prims_queued, tempv, sizeof(MDVERTEX));
+        v.y *= -1;
+        v.r = cDecay;
+        v.g = cDecay;
+        v.b = cDecay;
     }
+    DrawMesh(m_lpWarpIndices, m_indices_list.data(), m_indices_list.size(), m_warp_verts.data(), m_warp_verts.size(), bCullTiles, bFlipCulling);
 
     /*if (!bCullTiles)
     {
@@ -2005,10 +1351,6 @@ void CPlugin::WarpedBlit_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
     //float texel_offset_x = 0.5f / static_cast<float>(m_nTexSizeX);
     //float texel_offset_y = 0.5f / static_cast<float>(m_nTexSizeY);
 
-    int nAlphaTestValue = 0;
-    if (bFlipCulling)
-        nAlphaTestValue = 1 - nAlphaTestValue;
-
     if (bAlphaBlend)
     {
         if (bFlipAlpha)
@@ -2037,57 +1379,20 @@ void CPlugin::WarpedBlit_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
         lpDevice->SetPixelShader(si->ptr, si->CT);
 
         // Hurl the triangles at the video card.
-        // Going to un-index it, to not stress non-performant drivers.
-        // Divide it into the two halves of the screen (top/bottom) so can hack
-        // the 'ang' values along the angle-wrap seam, halfway through the draw.
+        // The bottom half of the screen is drawn first, then the top half; the
+        // 'ang' values along the angle-wrap [0 <-> 2pi] seam are hacked to -pi
+        // in the grid and to pi in the copy of the seam that the top half uses.
         // If we're blending, we'll skip any polygon that is all alpha-blended out.
-        // This also respects the MaxPrimCount limit of the video card.
-        MDVERTEX tempv[1024 * 3];
-        int max_prims_per_batch = std::min(lpDevice->GetMaxPrimitiveCount(), static_cast<UINT>(ARRAYSIZE(tempv) / 3)) - 4;
-        for (int half = 0; half < 2; half++)
+        const size_t nGrid = static_cast<size_t>(m_nGridX + 1) * (m_nGridY + 1);
+        const size_t nSeamStart = GetWarpSeamStart(m_nGridX, m_nGridY);
+        m_mesh.Gather(m_warp_verts.data());
+        for (size_t x = 0; x < GetWarpSeamCount(m_nGridX); x++)
         {
-            // hack / restore the ang values along the angle-wrap [0 <-> 2pi] seam...
-            float new_ang = half ? 3.1415926535897932384626433832795f : -3.1415926535897932384626433832795f;
-            int y_offset = (m_nGridY / 2) * (m_nGridX + 1);
-            for (int x = 0; x < m_nGridX / 2; x++)
-                m_verts[y_offset + x].ang = new_ang;
-
-            // Send half of the polys.
-            int primCount = m_nGridX * m_nGridY * 2 / 2; // in this case, to draw HALF the polys
-            int src_idx = 0;
-            int src_idx_offset = half * primCount * 3;
-            //int prims_sent = 0;
-            while (src_idx < primCount * 3)
-            {
-                int prims_queued = 0;
-                int i = 0;
-                while (prims_queued < max_prims_per_batch && src_idx < primCount * 3)
-                {
-                    // copy 3 verts
-                    for (int j = 0; j < 3; j++)
-                        tempv[i++] = m_verts[m_indices_list[src_idx_offset + src_idx++]];
-                    if (bCullTiles)
-                    {
-                        DWORD d1 = static_cast<DWORD>(tempv[i - 3].a * 255);
-                        DWORD d2 = static_cast<DWORD>(tempv[i - 2].a * 255);
-                        DWORD d3 = static_cast<DWORD>(tempv[i - 1].a * 255);
-                        bool bIsNeeded;
-                        if (nAlphaTestValue)
-                            bIsNeeded = ((d1 & d2 & d3) < 255); //(d1 < 255) || (d2 < 255) || (d3 < 255);
-                        else
-                            bIsNeeded = ((d1 | d2 | d3) > 0); //(d1 > 0) || (d2 > 0) || (d3 > 0);
-                        if (!bIsNeeded)
-                            i -= 3;
-                        else
-                            prims_queued++;
-                    }
-                    else
-                        prims_queued++;
-                }
-                if (prims_queued > 0)
-                    lpDevice->DrawPrimitive(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, prims_queued, tempv, sizeof(MDVERTEX));
-            }
+            m_warp_verts[nGrid + x] = m_warp_verts[nSeamStart + x];
+            m_warp_verts[nGrid + x].ang = 3.1415926535897932384626433832795f;
+            m_warp_verts[nSeamStart + x].ang = -3.1415926535897932384626433832795f;
         }
+        DrawMesh(m_lpWarpIndices, m_indices_list.data(), m_indices_list.size(), m_warp_verts.data(), m_warp_verts.size(), bCullTiles, bFlipCulling);
     }
 
     lpDevice->SetBlendState(false);
@@ -2095,8 +1400,29 @@ void CPlugin::WarpedBlit_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
     RestoreShaderParams();
 }
 
+// Draws the triangles of a mesh whose indices are in `pIBuffer`, uploading
+// only its vertices. When culling tiles, draws only the triangles that are
+// not entirely alpha-blended out, by compacting the indices instead.
+void CPlugin::DrawMesh(ID3D11Buffer* pIBuffer, const uint16_t* pIndices, size_t nIndices, const MDVERTEX* pVerts, size_t nVerts, bool bCullTiles, bool bFlipCulling)
+{
+    D3D11Shim* lpDevice = GetDevice();
+    if (!bCullTiles)
+    {
+        lpDevice->DrawIndexedMesh(pIBuffer, static_cast<unsigned int>(nIndices), static_cast<unsigned int>(nVerts), pVerts, sizeof(MDVERTEX));
+        return;
+    }
+
+    if (m_cull_indices.size() < nIndices)
+        m_cull_indices.resize(nIndices);
+    size_t nCulled = CullTriangles(pIndices, nIndices, &pVerts[0].a, sizeof(MDVERTEX) / sizeof(float), bFlipCulling, m_cull_indices.data());
+    if (nCulled > 0)
+        lpDevice->DrawIndexedPrimitive(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, 0, static_cast<unsigned int>(nVerts), static_cast<unsigned int>(nCulled / 3), m_cull_indices.data(), pVerts, sizeof(MDVERTEX));
+}
+
 void CPlugin::DrawCustomShapes()
 {
+    PROFILE_SCOPE(m_profiler, PROF_CUSTOM_SHAPES);
+
     D3D11Shim* lpDevice = GetDevice();
     if (!lpDevice)
         return;
@@ -2104,6 +1430,7 @@ void CPlugin::DrawCustomShapes()
     //lpDevice->SetTexture(0, m_lpVS[0]);//NULL);
     //lpDevice->SetVertexShader(SPRITEVERTEX_FORMAT);
 
+    const td_evalframe f = GetEvalFrame();
     int num_reps = (m_pState->m_bBlending) ? 2 : 1;
     for (int rep = 0; rep < num_reps; rep++)
     {
@@ -2146,61 +1473,12 @@ void CPlugin::DrawCustomShapes()
 
                 for (int instance = 0; instance < pState->m_shape[i].instances; instance++)
                 {
-                    // 1. Execute per-frame code.
-                    LoadCustomShapePerFrameEvallibVars(pState, i, instance);
-
-#ifndef _NO_EXPR_
-                    if (pState->m_shape[i].m_pf_codehandle)
-                    {
-                        NSEEL_code_execute(pState->m_shape[i].m_pf_codehandle);
-                    }
-#endif
-
-                    // save changes to t1-t8 this frame
-                    /*
-                    pState->m_shape[i].t_values_after_init_code[0] = *pState->m_shape[i].var_pf_t1;
-                    pState->m_shape[i].t_values_after_init_code[1] = *pState->m_shape[i].var_pf_t2;
-                    pState->m_shape[i].t_values_after_init_code[2] = *pState->m_shape[i].var_pf_t3;
-                    pState->m_shape[i].t_values_after_init_code[3] = *pState->m_shape[i].var_pf_t4;
-                    pState->m_shape[i].t_values_after_init_code[4] = *pState->m_shape[i].var_pf_t5;
-                    pState->m_shape[i].t_values_after_init_code[5] = *pState->m_shape[i].var_pf_t6;
-                    pState->m_shape[i].t_values_after_init_code[6] = *pState->m_shape[i].var_pf_t7;
-                    pState->m_shape[i].t_values_after_init_code[7] = *pState->m_shape[i].var_pf_t8;
-                    */
-
-                    int sides = (int)(*pState->m_shape[i].var_pf_sides);
-                    if (sides<3) sides=3;
-                    if (sides>100) sides=100;
-
-                    lpDevice->SetBlendState(true, D3D11_BLEND_SRC_ALPHA, ((int)(*pState->m_shape[i].var_pf_additive) != 0) ? D3D11_BLEND_ONE : D3D11_BLEND_INV_SRC_ALPHA);
-
                     SPRITEVERTEX v[512]; // for textured shapes (has texcoords)
                     WFVERTEX v2[512];    // for untextured shapes + borders
 
-                    v[0].x = (float)(*pState->m_shape[i].var_pf_x * 2 - 1); // * ASPECT;
-                    v[0].y = (float)(*pState->m_shape[i].var_pf_y * -2 + 1);
-                    v[0].z = 0;
-                    v[0].tu = 0.5f;
-                    v[0].tv = 0.5f;
-                    v[0].a = COLOR_NORM(*pState->m_shape[i].var_pf_a * alpha_mult);
-                    v[0].r = COLOR_NORM(*pState->m_shape[i].var_pf_r);
-                    v[0].g = COLOR_NORM(*pState->m_shape[i].var_pf_g);
-                    v[0].b = COLOR_NORM(*pState->m_shape[i].var_pf_b);
-                    v[1].a = COLOR_NORM(*pState->m_shape[i].var_pf_a2 * alpha_mult);
-                    v[1].r = COLOR_NORM(*pState->m_shape[i].var_pf_r2);
-                    v[1].g = COLOR_NORM(*pState->m_shape[i].var_pf_g2);
-                    v[1].b = COLOR_NORM(*pState->m_shape[i].var_pf_b2);
-                    for (int j = 1; j < sides + 1; j++)
-                    {
-                        float t = (j - 1) / (float)sides;
-                        v[j].x = v[0].x + (float)*pState->m_shape[i].var_pf_rad * cosf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_ang + 3.1415927f * 0.25f) * m_fAspectY; // DON'T TOUCH!
-                        v[j].y = v[0].y + (float)*pState->m_shape[i].var_pf_rad * sinf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_ang + 3.1415927f * 0.25f);              // DON'T TOUCH!
-                        v[j].z = 0;
-                        v[j].tu = 0.5f + 0.5f * cosf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_tex_ang + 3.1415927f * 0.25f) / ((float)*pState->m_shape[i].var_pf_tex_zoom) * m_fAspectY; // DON'T TOUCH!
-                        v[j].tv = 0.5f + 0.5f * sinf(t * 3.1415927f * 2 + (float)*pState->m_shape[i].var_pf_tex_ang + 3.1415927f * 0.25f) / ((float)*pState->m_shape[i].var_pf_tex_zoom);              // DON'T TOUCH!
-                        COPY_COLOR(v[j], v[1]);
-                    }
-                    v[sides + 1] = v[1];
+                    int sides = m_evaluator.EvalCustomShape(pState, i, instance, f, alpha_mult, v);
+
+                    lpDevice->SetBlendState(true, D3D11_BLEND_SRC_ALPHA, ((int)(*pState->m_shape[i].var_pf_additive) != 0) ? D3D11_BLEND_ONE : D3D11_BLEND_INV_SRC_ALPHA);
 
                     if ((int)(*pState->m_shape[i].var_pf_textured) != 0)
                     {
@@ -2274,67 +1552,12 @@ void CPlugin::DrawCustomShapes()
 
 void CPlugin::LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int instance)
 {
-    *pState->m_shape[i].var_pf_time      = (double)(GetTime() - m_fStartTime);
-    *pState->m_shape[i].var_pf_frame     = (double)GetFrame();
-    *pState->m_shape[i].var_pf_fps       = (double)GetFps();
-    *pState->m_shape[i].var_pf_progress  = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
-    *pState->m_shape[i].var_pf_bass      = (double)mdsound.imm_rel[0];
-    *pState->m_shape[i].var_pf_mid       = (double)mdsound.imm_rel[1];
-    *pState->m_shape[i].var_pf_treb      = (double)mdsound.imm_rel[2];
-    *pState->m_shape[i].var_pf_bass_att  = (double)mdsound.avg_rel[0];
-    *pState->m_shape[i].var_pf_mid_att   = (double)mdsound.avg_rel[1];
-    *pState->m_shape[i].var_pf_treb_att  = (double)mdsound.avg_rel[2];
-    for (int vi = 0; vi < NUM_Q_VAR; vi++)
-        *pState->m_shape[i].var_pf_q[vi] = *pState->var_pf_q[vi];
-    for (int vi = 0; vi < NUM_T_VAR; vi++)
-        *pState->m_shape[i].var_pf_t[vi] = pState->m_shape[i].t_values_after_init_code[vi];
-    *pState->m_shape[i].var_pf_x         = pState->m_shape[i].x;
-    *pState->m_shape[i].var_pf_y         = pState->m_shape[i].y;
-    *pState->m_shape[i].var_pf_rad       = pState->m_shape[i].rad;
-    *pState->m_shape[i].var_pf_ang       = pState->m_shape[i].ang;
-    *pState->m_shape[i].var_pf_tex_zoom  = pState->m_shape[i].tex_zoom;
-    *pState->m_shape[i].var_pf_tex_ang   = pState->m_shape[i].tex_ang;
-    *pState->m_shape[i].var_pf_sides     = pState->m_shape[i].sides;
-    *pState->m_shape[i].var_pf_additive  = pState->m_shape[i].additive;
-    *pState->m_shape[i].var_pf_textured  = pState->m_shape[i].textured;
-    *pState->m_shape[i].var_pf_instances = pState->m_shape[i].instances;
-    *pState->m_shape[i].var_pf_instance  = instance;
-    *pState->m_shape[i].var_pf_thick     = pState->m_shape[i].thickOutline;
-    *pState->m_shape[i].var_pf_r         = pState->m_shape[i].r;
-    *pState->m_shape[i].var_pf_g         = pState->m_shape[i].g;
-    *pState->m_shape[i].var_pf_b         = pState->m_shape[i].b;
-    *pState->m_shape[i].var_pf_a         = pState->m_shape[i].a;
-    *pState->m_shape[i].var_pf_r2        = pState->m_shape[i].r2;
-    *pState->m_shape[i].var_pf_g2        = pState->m_shape[i].g2;
-    *pState->m_shape[i].var_pf_b2        = pState->m_shape[i].b2;
-    *pState->m_shape[i].var_pf_a2        = pState->m_shape[i].a2;
-    *pState->m_shape[i].var_pf_border_r  = pState->m_shape[i].border_r;
-    *pState->m_shape[i].var_pf_border_g  = pState->m_shape[i].border_g;
-    *pState->m_shape[i].var_pf_border_b  = pState->m_shape[i].border_b;
-    *pState->m_shape[i].var_pf_border_a  = pState->m_shape[i].border_a;
+    m_evaluator.LoadCustomShapePerFrameEvallibVars(pState, i, instance, GetEvalFrame());
 }
 
 void CPlugin::LoadCustomWavePerFrameEvallibVars(CState* pState, int i)
 {
-    *pState->m_wave[i].var_pf_time      = (double)(GetTime() - m_fStartTime);
-    *pState->m_wave[i].var_pf_frame     = (double)GetFrame();
-    *pState->m_wave[i].var_pf_fps       = (double)GetFps();
-    *pState->m_wave[i].var_pf_progress  = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
-    *pState->m_wave[i].var_pf_bass      = (double)mdsound.imm_rel[0];
-    *pState->m_wave[i].var_pf_mid       = (double)mdsound.imm_rel[1];
-    *pState->m_wave[i].var_pf_treb      = (double)mdsound.imm_rel[2];
-    *pState->m_wave[i].var_pf_bass_att  = (double)mdsound.avg_rel[0];
-    *pState->m_wave[i].var_pf_mid_att   = (double)mdsound.avg_rel[1];
-    *pState->m_wave[i].var_pf_treb_att  = (double)mdsound.avg_rel[2];
-    for (int vi = 0; vi < NUM_Q_VAR; vi++)
-        *pState->m_wave[i].var_pf_q[vi] = *pState->var_pf_q[vi];
-    for (int vi = 0; vi < NUM_T_VAR; vi++)
-        *pState->m_wave[i].var_pf_t[vi] = pState->m_wave[i].t_values_after_init_code[vi];
-    *pState->m_wave[i].var_pf_r         = pState->m_wave[i].r;
-    *pState->m_wave[i].var_pf_g         = pState->m_wave[i].g;
-    *pState->m_wave[i].var_pf_b         = pState->m_wave[i].b;
-    *pState->m_wave[i].var_pf_a         = pState->m_wave[i].a;
-    *pState->m_wave[i].var_pf_samples   = pState->m_wave[i].samples;
+    m_evaluator.LoadCustomWavePerFrameEvallibVars(pState, i, GetEvalFrame());
 }
 
 // Does a better-than-linear smooth on a wave. Roughly doubles the number of points.
@@ -2370,6 +1593,8 @@ int SmoothWave(WFVERTEX* vi, int nVertsIn, WFVERTEX* vo)
 
 void CPlugin::DrawCustomWaves()
 {
+    PROFILE_SCOPE(m_profiler, PROF_CUSTOM_WAVES);
+
     D3D11Shim* lpDevice = GetDevice();
     if (!lpDevice)
         return;
@@ -2379,6 +1604,7 @@ void CPlugin::DrawCustomWaves()
     lpDevice->SetVertexColor(true);
 
     // note: read in all sound data from CPluginShell's m_sound
+    const td_evalframe f = GetEvalFrame();
     int num_reps = (m_pState->m_bBlending) ? 2 : 1;
     for (int rep = 0; rep < num_reps; rep++)
     {
@@ -2391,117 +1617,11 @@ void CPlugin::DrawCustomWaves()
         {
             if (pState->m_wave[i].enabled)
             {
-                int nSamples = pState->m_wave[i].samples;
-                int max_samples = pState->m_wave[i].bSpectrum ? 512 : NUM_WAVEFORM_SAMPLES;
-                if (nSamples > max_samples)
-                    nSamples = max_samples;
-                nSamples -= pState->m_wave[i].sep;
-
-                // 1. execute per-frame code
-                LoadCustomWavePerFrameEvallibVars(pState, i);
-
-                // 2.a. do just a once-per-frame init for the *per-point* *READ-ONLY* variables
-                //     (the non-read-only ones will be reset/restored at the start of each vertex)
-                *pState->m_wave[i].var_pp_time     = *pState->m_wave[i].var_pf_time;
-                *pState->m_wave[i].var_pp_fps      = *pState->m_wave[i].var_pf_fps;
-                *pState->m_wave[i].var_pp_frame    = *pState->m_wave[i].var_pf_frame;
-                *pState->m_wave[i].var_pp_progress = *pState->m_wave[i].var_pf_progress;
-                *pState->m_wave[i].var_pp_bass     = *pState->m_wave[i].var_pf_bass;
-                *pState->m_wave[i].var_pp_mid      = *pState->m_wave[i].var_pf_mid;
-                *pState->m_wave[i].var_pp_treb     = *pState->m_wave[i].var_pf_treb;
-                *pState->m_wave[i].var_pp_bass_att = *pState->m_wave[i].var_pf_bass_att;
-                *pState->m_wave[i].var_pp_mid_att  = *pState->m_wave[i].var_pf_mid_att;
-                *pState->m_wave[i].var_pp_treb_att = *pState->m_wave[i].var_pf_treb_att;
-
-                NSEEL_code_execute(pState->m_wave[i].m_pf_codehandle);
-
-                for (int vi = 0; vi < NUM_Q_VAR; vi++)
-                    *pState->m_wave[i].var_pp_q[vi] = *pState->m_wave[i].var_pf_q[vi];
-                for (int vi = 0; vi < NUM_T_VAR; vi++)
-                    *pState->m_wave[i].var_pp_t[vi] = *pState->m_wave[i].var_pf_t[vi];
-
-                nSamples = (int)*pState->m_wave[i].var_pf_samples;
-                nSamples = std::min(512, nSamples);
-
-                if ((nSamples >= 2) || (pState->m_wave[i].bUseDots && nSamples >= 1))
+                // 1-2. Execute per-frame and per-point code.
+                WFVERTEX v[1024];
+                int nSamples = m_evaluator.EvalCustomWave(pState, i, f, alpha_mult, v);
+                if (nSamples > 0)
                 {
-                    float tempdata[2][512];
-                    float mult = ((pState->m_wave[i].bSpectrum) ? 0.15f : 0.004f) * pState->m_wave[i].scaling * pState->m_fWaveScale.eval(-1.0f);
-                    float* pdata1 = (pState->m_wave[i].bSpectrum) ? m_sound.fSpectrum[0].data() : m_sound.fWaveform[0].data();
-                    float* pdata2 = (pState->m_wave[i].bSpectrum) ? m_sound.fSpectrum[1].data() : m_sound.fWaveform[1].data();
-
-                    // initialize tempdata[2][512]
-                    int j0 = (pState->m_wave[i].bSpectrum) ? 0 : (max_samples - nSamples) / 2 /*(1 - pState->m_wave[i].bSpectrum)*/ - pState->m_wave[i].sep / 2;
-                    int j1 = (pState->m_wave[i].bSpectrum) ? 0 : (max_samples - nSamples) / 2 /*(1 - pState->m_wave[i].bSpectrum)*/ + pState->m_wave[i].sep / 2;
-                    float t = (pState->m_wave[i].bSpectrum) ? (max_samples - pState->m_wave[i].sep) / (float)nSamples : 1.0f;
-                    float mix1 = powf(pState->m_wave[i].smoothing * 0.98f, 0.5f); // lower exponent -> more default smoothing
-                    float mix2 = 1.0f - mix1;
-                    // SMOOTHING:
-                    tempdata[0][0] = pdata1[j0];
-                    tempdata[1][0] = pdata2[j1];
-                    for (int j = 1; j < nSamples; j++)
-                    {
-                        tempdata[0][j] = pdata1[(int)(j * t) + j0] * mix2 + tempdata[0][j - 1] * mix1;
-                        tempdata[1][j] = pdata2[(int)(j * t) + j1] * mix2 + tempdata[1][j - 1] * mix1;
-                    }
-                    // smooth again, backwards: [this fixes the asymmetry of the beginning & end..]
-                    for (int j = nSamples - 2; j >= 0; j--)
-                    {
-                        tempdata[0][j] = tempdata[0][j] * mix2 + tempdata[0][j + 1] * mix1;
-                        tempdata[1][j] = tempdata[1][j] * mix2 + tempdata[1][j + 1] * mix1;
-                    }
-                    // finally, scale to final size:
-                    for (int j = 0; j < nSamples; j++)
-                    {
-                        tempdata[0][j] *= mult;
-                        tempdata[1][j] *= mult;
-                    }
-
-                    // 2. For each point, execute per-point code.
-                    // to do:
-                    //  -add any of the m_wave[i].xxx menu-accessible vars to the code?
-                    WFVERTEX v[1024];
-                    float j_mult = 1.0f / (float)(nSamples - 1);
-                    for (int j = 0; j < nSamples; j++)
-                    {
-                        float t2 = j * j_mult;
-                        float value1 = tempdata[0][j];
-                        float value2 = tempdata[1][j];
-                        *pState->m_wave[i].var_pp_sample = t2;
-                        *pState->m_wave[i].var_pp_value1 = value1;
-                        *pState->m_wave[i].var_pp_value2 = value2;
-                        *pState->m_wave[i].var_pp_x = 0.5f + value1;
-                        *pState->m_wave[i].var_pp_y = 0.5f + value2;
-                        *pState->m_wave[i].var_pp_r = *pState->m_wave[i].var_pf_r;
-                        *pState->m_wave[i].var_pp_g = *pState->m_wave[i].var_pf_g;
-                        *pState->m_wave[i].var_pp_b = *pState->m_wave[i].var_pf_b;
-                        *pState->m_wave[i].var_pp_a = *pState->m_wave[i].var_pf_a;
-
-#ifndef _NO_EXPR_
-                        NSEEL_code_execute(pState->m_wave[i].m_pp_codehandle);
-#endif
-
-                        v[j].x = (float)(*pState->m_wave[i].var_pp_x * 2 - 1) * m_fInvAspectX;
-                        v[j].y = (float)(*pState->m_wave[i].var_pp_y * -2 + 1) * m_fInvAspectY;
-                        v[j].z = 0;
-                        v[j].a = COLOR_NORM(*pState->m_wave[i].var_pp_a * alpha_mult);
-                        v[j].r = COLOR_NORM(*pState->m_wave[i].var_pp_r);
-                        v[j].g = COLOR_NORM(*pState->m_wave[i].var_pp_g);
-                        v[j].b = COLOR_NORM(*pState->m_wave[i].var_pp_b);
-                    }
-
-                    // Save changes to t1-t8 this frame.
-                    /*
-                    pState->m_wave[i].t_values_after_init_code[0] = *pState->m_wave[i].var_pp_t1;
-                    pState->m_wave[i].t_values_after_init_code[1] = *pState->m_wave[i].var_pp_t2;
-                    pState->m_wave[i].t_values_after_init_code[2] = *pState->m_wave[i].var_pp_t3;
-                    pState->m_wave[i].t_values_after_init_code[3] = *pState->m_wave[i].var_pp_t4;
-                    pState->m_wave[i].t_values_after_init_code[4] = *pState->m_wave[i].var_pp_t5;
-                    pState->m_wave[i].t_values_after_init_code[5] = *pState->m_wave[i].var_pp_t6;
-                    pState->m_wave[i].t_values_after_init_code[6] = *pState->m_wave[i].var_pp_t7;
-                    pState->m_wave[i].t_values_after_init_code[7] = *pState->m_wave[i].var_pp_t8;
-                    */
-
                     // 3. Smooth it.
                     WFVERTEX* pVerts = v;
                     WFVERTEX v3[2048];
@@ -3796,6 +2916,8 @@ void CPlugin::ApplyShaderParams(CShaderParams* p, CConstantTable* pCT, CState* p
 // Note: Draws the whole screen! (one big quad)
 void CPlugin::ShowToUser_NoShaders() //int bRedraw, int nPassOverride)
 {
+    PROFILE_SCOPE(m_profiler, PROF_SHOW_TO_USER);
+
     D3D11Shim* lpDevice = GetDevice();
     if (!lpDevice)
         return;
@@ -4091,6 +3213,8 @@ void CPlugin::ShowToUser_NoShaders() //int bRedraw, int nPassOverride)
 
 void CPlugin::ShowToUser_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, bool bCullTiles, bool bFlipCulling) //int bRedraw, int nPassOverride)
 {
+    PROFILE_SCOPE(m_profiler, PROF_SHOW_TO_USER);
+
     D3D11Shim* lpDevice = GetDevice();
     if (!lpDevice)
         return;
@@ -4168,28 +3292,10 @@ void CPlugin::ShowToUser_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
                 // TODO: During blend, only send the triangles needed.
 
                 // If blending, also set up the alpha values; pull them from the alphas used for the warped blit.
-                double alpha = 1.0;
+                float alpha = 1.0f;
                 if (m_pState->m_bBlending)
                 {
-                    x *= (m_nGridX + 1);
-                    y *= (m_nGridY + 1);
-                    x = std::max(std::min(x, static_cast<float>(m_nGridX) - 1.0f), 0.0f);
-                    y = std::max(std::min(y, static_cast<float>(m_nGridY) - 1.0f), 0.0f);
-                    int nx = static_cast<int>(x);
-                    int ny = static_cast<int>(y);
-                    double dx = x - nx;
-                    double dy = y - ny;
-                    // clang-format off
-                    double alpha00 = (m_verts[(ny) * (m_nGridX + 1) + (nx)].a * 255);
-                    double alpha01 = (m_verts[(ny) * (m_nGridX + 1) + (nx + 1)].a * 255);
-                    double alpha10 = (m_verts[(ny + 1) * (m_nGridX + 1) + (nx)].a * 255);
-                    double alpha11 = (m_verts[(ny + 1) * (m_nGridX + 1) + (nx + 1)].a * 255);
-                    alpha = alpha00 * (1 - dx) * (1 - dy) +
-                            alpha01 * (dx) * (1 - dy) +
-                            alpha10 * (1 - dx) * (dy) +
-                            alpha11 * (dx) * (dy);
-                    // clang-format on
-                    alpha /= 255.0f;
+                    alpha = m_mesh.SampleAlpha(x, y);
                     //if (bFlipAlpha)
                     //    alpha = 1 - alpha;
                     //alpha = (m_verts[y * (m_nGridX + 1) + x].Diffuse >> 24) / 255.0f;
@@ -4197,15 +3303,11 @@ void CPlugin::ShowToUser_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
                 p->r = col[0];
                 p->g = col[1];
                 p->b = col[2];
-                p->a = static_cast<float>(alpha);
+                p->a = alpha;
             }
         }
     }
 
-    int nAlphaTestValue = 0;
-    if (bFlipCulling)
-        nAlphaTestValue = 1 - nAlphaTestValue;
-
     if (bAlphaBlend)
     {
         if (bFlipAlpha)
@@ -4237,44 +3339,8 @@ void CPlugin::ShowToUser_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, b
         lpDevice->SetPixelShader(si->ptr, si->CT);
 
         // Hurl the triangles at the video card.
-        // Going to un-index it, to not stress non-performant drivers.
-        // Not a big deal - only ~800 polys / 24kb of data.
         // If blending, skip any polygon that is all alpha-blended out.
-        // This also respects the `MaxPrimCount` limit of the video card.
-        MDVERTEX tempv[1024 * 3];
-        int primCount = (FCGSX - 2) * (FCGSY - 2) * 2; // although, some might not be drawn!
-        int max_prims_per_batch = std::min(lpDevice->GetMaxPrimitiveCount(), static_cast<UINT>(ARRAYSIZE(tempv) / 3)) - 4;
-        int src_idx = 0;
-        while (src_idx < primCount * 3)
-        {
-            int prims_queued = 0;
-            int i = 0;
-            while (prims_queued < max_prims_per_batch && src_idx < primCount * 3)
-            {
-                // copy 3 verts
-                for (int j = 0; j < 3; j++)
-                    tempv[i++] = m_comp_verts[m_comp_indices[src_idx++]];
-                if (bCullTiles)
-                {
-                    DWORD d1 = static_cast<DWORD>(tempv[i - 3].a * 255);
-                    DWORD d2 = static_cast<DWORD>(tempv[i - 2].a * 255);
-                    DWORD d3 = static_cast<DWORD>(tempv[i - 1].a * 255);
-                    bool bIsNeeded;
-                    if (nAlphaTestValue)
-                        bIsNeeded = ((d1 & d2 & d3) < 255); //(d1 < 255) || (d2 < 255) || (d3 < 255);
-                    else
-                        bIsNeeded = ((d1 | d2 | d3) > 0); //(d1 > 0) || (d2 > 0) || (d3 > 0);
-                    if (!bIsNeeded)
-                        i -= 3;
-                    else
-                        prims_queued++;
-                }
-                else
-                    prims_queued++;
-            }
-            if (prims_queued > 0)
-                lpDevice->DrawPrimitive(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, prims_queued, tempv, sizeof(MDVERTEX));
-        }
+        DrawMesh(m_lpCompIndices, m_comp_indices, ARRAYSIZE(m_comp_indices), m_comp_verts, ARRAYSIZE(m_comp_verts), bCullTiles, bFlipCulling);
     }
 
     lpDevice->SetBlendState(false);
@@ -4304,6 +3370,7 @@ void CPlugin::ShowSongTitleAnim(int w, int h, float fProgress)
     m_superTitle->CreateWindowSizeDependentResources(w, h);
     m_superTitle->SetTextFont(m_supertext.szText, m_supertext.nFontFace, static_cast<float>(m_supertext.nFontSizeUsed));
     m_superTitle->OnRender();
+    lpDevice->InvalidateState(); // binds its own pipeline
 #else
     if (m_supertext.bIsSongTitle)
     {
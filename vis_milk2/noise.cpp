@@ -0,0 +1,285 @@
+/*
+ * noise.cpp - Noise texture synthesis.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "noise.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <thread>
+
+namespace
+{
+constexpr char kNoiseMagic[4] = {'M', 'D', 'N', 'Z'};
+constexpr uint32_t kNoiseVersion = 1;
+
+// "lowbias32" integer hash; a bijection on 32 bits.
+inline uint32_t Hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Runs `fn(begin, end)` over `[0, nCount)` split among up to `nThreads` threads.
+template <typename F>
+void ParallelFor(int nCount, int nThreads, F fn)
+{
+    nThreads = std::min(nThreads, nCount / 8); // not worth a thread for a few lines
+    if (nThreads <= 1)
+    {
+        fn(0, nCount);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(static_cast<size_t>(nThreads - 1));
+    for (int t = 1; t < nThreads; t++)
+        threads.emplace_back(fn, nCount * t / nThreads, nCount * (t + 1) / nThreads);
+    fn(0, nCount / nThreads);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Cubic interpolation weights for `t = k / zoom_factor`, scaled by
+// `zoom_factor`^3 so that they are exact integers.
+void GetCubicWeights(int zoom_factor, std::vector<int32_t>& weights)
+{
+    const int32_t z = zoom_factor;
+    weights.resize(static_cast<size_t>(zoom_factor) * 4);
+    for (int32_t k = 0; k < z; k++)
+    {
+        int32_t* w = &weights[static_cast<size_t>(k) * 4];
+        w[0] = -k * k * k + 2 * k * k * z - k * z * z;
+        w[1] = k * k * k - 2 * k * k * z + z * z * z;
+        w[2] = -k * k * k + k * k * z + k * z * z;
+        w[3] = k * k * k - k * k * z;
+    }
+}
+
+// Interpolates each 8-bit channel of four texels, clamping to [0, 255].
+// `recip` is `ceil(2^48 / zoom_factor^3)`, which makes the multiply and
+// shift an exact floor division for any sum the weights can produce.
+inline uint32_t CubicInterpolate(uint32_t y0, uint32_t y1, uint32_t y2, uint32_t y3, const int32_t* w, uint64_t recip)
+{
+    uint32_t ret = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        int32_t s = w[0] * static_cast<int32_t>((y0 >> shift) & 0xFF) +
+                    w[1] * static_cast<int32_t>((y1 >> shift) & 0xFF) +
+                    w[2] * static_cast<int32_t>((y2 >> shift) & 0xFF) +
+                    w[3] * static_cast<int32_t>((y3 >> shift) & 0xFF);
+        int32_t v = s > 0 ? std::min(static_cast<int32_t>((static_cast<uint64_t>(s) * recip) >> 48), 255) : 0;
+        ret |= static_cast<uint32_t>(v) << shift;
+    }
+    return ret;
+}
+
+// A volume of `depth` slices; textures have one.
+void GenerateNoise(uint32_t nSeed, int size, int depth, int zoom_factor, uint32_t* pTexels, int nThreads)
+{
+    const size_t line = static_cast<size_t>(size);
+    const size_t slice = line * line;
+    const int nLines = size * depth;
+
+    // Random texels. Each channel is hashed from the seed and its index,
+    // without branches, so the loop vectorizes. Channels are offset into
+    // the upper part of their byte and can reach 9 bits; the ninth is ORed
+    // into the lowest bit of the channel above, or dropped for the top one,
+    // as it always has been.
+    const uint32_t key = Hash32(nSeed ^ 0x6D696C6Bu);
+    const uint32_t range = (zoom_factor > 1) ? 216 : 256;
+    ParallelFor(nLines, nThreads, [=](int begin, int end) {
+        for (size_t i = static_cast<size_t>(begin) * line; i < static_cast<size_t>(end) * line; i++)
+        {
+            uint32_t texel = 0;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                uint32_t h = Hash32((static_cast<uint32_t>(i) * 4 + c) + key);
+                texel |= ((((h >> 16) * range) >> 16) + range / 2) << (24 - c * 8);
+            }
+            pTexels[i] = texel;
+        }
+    });
+
+    if (zoom_factor <= 1)
+        return;
+
+    std::vector<int32_t> weights;
+    GetCubicWeights(zoom_factor, weights);
+    const int32_t* w = weights.data();
+    const uint64_t denom = static_cast<uint64_t>(zoom_factor) * static_cast<uint64_t>(zoom_factor) * static_cast<uint64_t>(zoom_factor);
+    const uint64_t recip = ((1ULL << 48) + denom - 1) / denom;
+    const int zf = zoom_factor;
+    auto wrap = [=](int base, int offset) { return static_cast<size_t>((base + offset) % size); };
+
+    // First go across, blending cubically on X, but only on the main lines.
+    // Each span between two main texels shares the same four of them.
+    ParallelFor(nLines, nThreads, [=](int begin, int end) {
+        for (int n = begin; n < end; n++)
+        {
+            int z = n / size;
+            int y = n % size;
+            if (z % zf || y % zf)
+                continue;
+            uint32_t* dst = pTexels + static_cast<size_t>(n) * line;
+            for (int base_x = 0; base_x < size; base_x += zf)
+            {
+                uint32_t y0 = dst[wrap(base_x + size, -zf)];
+                uint32_t y1 = dst[base_x];
+                uint32_t y2 = dst[wrap(base_x, zf)];
+                uint32_t y3 = dst[wrap(base_x, zf * 2)];
+                for (int k = 1; k < zf && base_x + k < size; k++)
+                    dst[base_x + k] = CubicInterpolate(y0, y1, y2, y3, w + k * 4, recip);
+            }
+        }
+    });
+
+    // Next go down, doing cubic interpolation along Y, on the main slices.
+    ParallelFor(nLines, nThreads, [=](int begin, int end) {
+        for (int n = begin; n < end; n++)
+        {
+            int z = n / size;
+            int y = n % size;
+            if (z % zf || !(y % zf))
+                continue;
+            int base_y = (y / zf) * zf + size;
+            const uint32_t* src = pTexels + static_cast<size_t>(z) * slice;
+            const uint32_t* y0 = src + wrap(base_y, -zf) * line;
+            const uint32_t* y1 = src + wrap(base_y, 0) * line;
+            const uint32_t* y2 = src + wrap(base_y, zf) * line;
+            const uint32_t* y3 = src + wrap(base_y, zf * 2) * line;
+            uint32_t* dst = pTexels + static_cast<size_t>(n) * line;
+            for (size_t x = 0; x < line; x++)
+                dst[x] = CubicInterpolate(y0[x], y1[x], y2[x], y3[x], w + (y % zf) * 4, recip);
+        }
+    });
+
+    if (depth <= 1)
+        return;
+
+    // Next go through, doing cubic interpolation along Z, everywhere.
+    ParallelFor(nLines, nThreads, [=](int begin, int end) {
+        for (int n = begin; n < end; n++)
+        {
+            int z = n / size;
+            int y = n % size;
+            if (!(z % zf))
+                continue;
+            int base_z = (z / zf) * zf + depth;
+            const uint32_t* y0 = pTexels + static_cast<size_t>((base_z - zf) % depth) * slice + static_cast<size_t>(y) * line;
+            const uint32_t* y1 = pTexels + static_cast<size_t>(base_z % depth) * slice + static_cast<size_t>(y) * line;
+            const uint32_t* y2 = pTexels + static_cast<size_t>((base_z + zf) % depth) * slice + static_cast<size_t>(y) * line;
+            const uint32_t* y3 = pTexels + static_cast<size_t>((base_z + zf * 2) % depth) * slice + static_cast<size_t>(y) * line;
+            uint32_t* dst = pTexels + static_cast<size_t>(n) * line;
+            for (size_t x = 0; x < line; x++)
+                dst[x] = CubicInterpolate(y0[x], y1[x], y2[x], y3[x], w + (z % zf) * 4, recip);
+        }
+    });
+}
+} // namespace
+
+uint32_t GetNoiseSeed(const wchar_t* szName)
+{
+    uint32_t h = 0x811C9DC5u; // FNV-1a
+    for (; *szName; szName++)
+    {
+        h ^= static_cast<uint32_t>(*szName);
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+void GenerateNoiseTex(uint32_t nSeed, int size, int zoom_factor, uint32_t* pTexels, int nThreads)
+{
+    GenerateNoise(nSeed, size, 1, zoom_factor, pTexels, nThreads);
+}
+
+void GenerateNoiseVol(uint32_t nSeed, int size, int zoom_factor, uint32_t* pTexels, int nThreads)
+{
+    GenerateNoise(nSeed, size, size, zoom_factor, pTexels, nThreads);
+}
+
+const std::vector<uint32_t>& CNoiseCache::Get(const wchar_t* szName, int size, int zoom_factor, bool bVolume)
+{
+    std::wstring szKey = std::wstring(szName) + L"_" + std::to_wstring(size) + L"_" + std::to_wstring(zoom_factor) + (bVolume ? L"_3d" : L"_2d");
+    auto it = m_surfaces.find(szKey);
+    if (it != m_surfaces.end())
+        return it->second;
+
+    std::vector<uint32_t>& texels = m_surfaces[szKey];
+    const uint32_t nSeed = GetNoiseSeed(szName);
+    const std::wstring szFile = m_szDir.empty() ? std::wstring() : (std::filesystem::path(m_szDir) / (szKey + L".bin")).wstring();
+    if (!szFile.empty() && ReadFile(szFile, nSeed, size, zoom_factor, bVolume, texels))
+        return texels;
+
+    const size_t line = static_cast<size_t>(size);
+    texels.resize(line * line * (bVolume ? line : 1));
+    int nThreads = m_nThreads > 0 ? m_nThreads : static_cast<int>(std::min(std::thread::hardware_concurrency(), 8u));
+    if (bVolume)
+        GenerateNoiseVol(nSeed, size, zoom_factor, texels.data(), nThreads);
+    else
+        GenerateNoiseTex(nSeed, size, zoom_factor, texels.data(), nThreads);
+    m_nGenerated++;
+
+    if (!szFile.empty())
+        WriteFile(szFile, nSeed, size, zoom_factor, bVolume, texels);
+    return texels;
+}
+
+bool CNoiseCache::ReadFile(const std::wstring& szFile, uint32_t nSeed, int size, int zoom_factor, bool bVolume, std::vector<uint32_t>& texels) const
+{
+    std::ifstream file(std::filesystem::path(szFile), std::ios::binary);
+    if (!file)
+        return false;
+    char magic[4] = {};
+    uint32_t header[5] = {};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    const uint32_t expected[5] = {kNoiseVersion, nSeed, static_cast<uint32_t>(size), static_cast<uint32_t>(zoom_factor), bVolume ? 3u : 2u};
+    if (!file || !std::equal(magic, magic + 4, kNoiseMagic) || !std::equal(header, header + 5, expected))
+        return false;
+
+    const size_t line = static_cast<size_t>(size);
+    texels.resize(line * line * (bVolume ? line : 1));
+    file.read(reinterpret_cast<char*>(texels.data()), static_cast<std::streamsize>(texels.size() * sizeof(uint32_t)));
+    if (!file || file.peek() != std::ifstream::traits_type::eof())
+    {
+        texels.clear();
+        return false;
+    }
+    return true;
+}
+
+// Writes to a temporary file first, so that a reader never sees half a surface.
+void CNoiseCache::WriteFile(const std::wstring& szFile, uint32_t nSeed, int size, int zoom_factor, bool bVolume, const std::vector<uint32_t>& texels) const
+{
+    std::error_code ec;
+    std::filesystem::path path(szFile);
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::filesystem::path temp = path;
+    temp += L".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        const uint32_t header[5] = {kNoiseVersion, nSeed, static_cast<uint32_t>(size), static_cast<uint32_t>(zoom_factor), bVolume ? 3u : 2u};
+        file.write(kNoiseMagic, sizeof(kNoiseMagic));
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(texels.data()), static_cast<std::streamsize>(texels.size() * sizeof(uint32_t)));
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+        std::filesystem::remove(temp, ec);
+}
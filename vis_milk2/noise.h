@@ -0,0 +1,60 @@
+/*
+ * noise.h - Noise texture synthesis header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Seed of the noise texture named `szName`. The same name always gives the
+// same noise, so that generated surfaces can be cached across sessions.
+uint32_t GetNoiseSeed(const wchar_t* szName);
+
+// Fills `pTexels` with a `size` x `size` (x `size` for volumes) RGBA noise
+// texture, rows and slices tightly packed.
+// `zoom_factor`: how zoomed-in the texture features should be.
+//   1 -> random noise
+//   2/4/8... -> cubic interpolated between random texels `zoom_factor` apart
+// Each texel is a pure function of `nSeed` and its position, and smoothing
+// uses integer arithmetic only, so the output is the same on every
+// platform and for any number of threads.
+void GenerateNoiseTex(uint32_t nSeed, int size, int zoom_factor, uint32_t* pTexels, int nThreads);
+void GenerateNoiseVol(uint32_t nSeed, int size, int zoom_factor, uint32_t* pTexels, int nThreads);
+
+// Keeps generated noise surfaces for the session, so that re-creating the
+// device only copies them. With a directory set, surfaces are also read
+// from and written to files there.
+class CNoiseCache
+{
+  public:
+    CNoiseCache() : m_nThreads(0), m_nGenerated(0) {}
+
+    // Empty to keep surfaces in memory only.
+    void SetDirectory(const std::wstring& szDir) { m_szDir = szDir; }
+
+    // Number of worker threads for generating; 0 picks from the CPU count.
+    void SetThreads(int nThreads) { m_nThreads = nThreads; }
+
+    // Texels of the named surface, generated or read on first use.
+    const std::vector<uint32_t>& Get(const wchar_t* szName, int size, int zoom_factor, bool bVolume);
+
+    void Clear() { m_surfaces.clear(); }
+
+    // Number of surfaces generated rather than copied or read.
+    uint32_t GetGenerated() const { return m_nGenerated; }
+
+  private:
+    bool ReadFile(const std::wstring& szFile, uint32_t nSeed, int size, int zoom_factor, bool bVolume, std::vector<uint32_t>& texels) const;
+    void WriteFile(const std::wstring& szFile, uint32_t nSeed, int size, int zoom_factor, bool bVolume, const std::vector<uint32_t>& texels) const;
+
+    std::wstring m_szDir;
+    int m_nThreads;
+    uint32_t m_nGenerated;
+    std::map<std::wstring, std::vector<uint32_t>> m_surfaces; // by name, size, zoom and dimensions
+};
@@ -0,0 +1,120 @@
+/*
+ * playlistmodel.cpp - Playlist title snapshot.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "playlistmodel.h"
+
+#include <algorithm>
+#include <utility>
+
+void CPlaylistModel::Sync()
+{
+    if (m_bStale)
+    {
+        m_titles.clear();
+        m_titles.resize(m_pSource->GetItemCount(), {std::wstring(), false});
+        m_bStale = false;
+    }
+}
+
+size_t CPlaylistModel::GetCount()
+{
+    Sync();
+    return m_titles.size();
+}
+
+const std::wstring* CPlaylistModel::GetTitle(size_t nIndex)
+{
+    Sync();
+    if (nIndex >= m_titles.size())
+        return nullptr;
+
+    td_title& title = m_titles[nIndex];
+    if (title.bFormatted)
+    {
+        m_nHits++;
+        return &title.text;
+    }
+
+    m_nMisses++;
+    if (!m_pSource->FormatTitle(nIndex, title.text))
+        return nullptr;
+    title.bFormatted = true;
+    return &title.text;
+}
+
+void CPlaylistModel::Insert(size_t nStart, size_t nCount)
+{
+    if (m_bStale)
+        return;
+    if (nStart > m_titles.size())
+    {
+        m_bStale = true;
+        return;
+    }
+    m_titles.insert(m_titles.begin() + static_cast<ptrdiff_t>(nStart), nCount, {std::wstring(), false});
+}
+
+void CPlaylistModel::Remove(const std::function<bool(size_t)>& isRemoved)
+{
+    if (m_bStale)
+        return;
+    size_t nKept = 0;
+    for (size_t i = 0; i < m_titles.size(); i++)
+    {
+        if (!isRemoved(i))
+        {
+            if (nKept != i)
+                m_titles[nKept] = std::move(m_titles[i]);
+            nKept++;
+        }
+    }
+    m_titles.resize(nKept);
+}
+
+void CPlaylistModel::Reorder(const size_t* pOrder, size_t nCount)
+{
+    if (m_bStale)
+        return;
+    if (nCount != m_titles.size())
+    {
+        m_bStale = true;
+        return;
+    }
+    std::vector<td_title> titles(nCount);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        if (pOrder[i] >= nCount)
+        {
+            m_bStale = true;
+            return;
+        }
+        titles[i] = std::move(m_titles[pOrder[i]]);
+    }
+    m_titles = std::move(titles);
+}
+
+void CPlaylistModel::Invalidate(const std::function<bool(size_t)>& isModified)
+{
+    if (m_bStale)
+        return;
+    for (size_t i = 0; i < m_titles.size(); i++)
+    {
+        if (isModified(i))
+        {
+            m_titles[i].text.clear();
+            m_titles[i].bFormatted = false;
+        }
+    }
+}
+
+void CPlaylistModel::GetStats(td_playlistmodelstats& stats) const
+{
+    stats.nItems = m_bStale ? 0 : m_titles.size();
+    stats.nFormatted = m_bStale ? 0 : static_cast<size_t>(std::count_if(m_titles.begin(), m_titles.end(), [](const td_title& title) { return title.bFormatted; }));
+    stats.nHits = m_nHits;
+    stats.nMisses = m_nMisses;
+}
@@ -0,0 +1,88 @@
+/*
+ * playlistmodel.h - Playlist title snapshot header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The playlist shown on screen, as the host player exposes it.
+class CPlaylistSource
+{
+  public:
+    virtual ~CPlaylistSource() = default;
+
+    virtual size_t GetItemCount() = 0;
+
+    // Formats the title of item `nIndex`. Returns false if it could not be
+    // formatted, for example if the item is gone.
+    virtual bool FormatTitle(size_t nIndex, std::wstring& title) = 0;
+};
+
+typedef struct
+{
+    size_t nItems;
+    size_t nFormatted; // titles currently held
+    uint64_t nHits;
+    uint64_t nMisses;
+} td_playlistmodelstats;
+
+// Snapshot of the titles of a playlist, so that drawing a page of it formats
+// only the rows shown, and only the first time they are shown.
+//
+// The snapshot is kept in step with the playlist by the change notifications
+// of the host: added, removed and reordered items move their titles along,
+// modified items drop theirs. Anything else, such as switching playlists or
+// changing the title format, resets it. Titles are formatted lazily, when a
+// row is requested.
+class CPlaylistModel
+{
+  public:
+    explicit CPlaylistModel(CPlaylistSource* pSource) : m_pSource(pSource), m_bStale(true), m_nHits(0), m_nMisses(0) {}
+
+    size_t GetCount();
+
+    // Returns the title of item `nIndex`, or null if out of range or the
+    // source could not format it. Valid until the next change.
+    const std::wstring* GetTitle(size_t nIndex);
+
+    // The whole playlist changed.
+    void Reset() { m_bStale = true; }
+
+    // `nCount` items were inserted at `nStart`.
+    void Insert(size_t nStart, size_t nCount);
+
+    // The items for which `isRemoved(nOldIndex)` is true were removed.
+    void Remove(const std::function<bool(size_t)>& isRemoved);
+
+    // Item `i` is now previous item `pOrder[i]`, for `i` in `[0, nCount)`.
+    void Reorder(const size_t* pOrder, size_t nCount);
+
+    // The items for which `isModified(nIndex)` is true changed, so their
+    // titles have to be formatted again.
+    void Invalidate(const std::function<bool(size_t)>& isModified);
+
+    void GetStats(td_playlistmodelstats& stats) const;
+
+  private:
+    typedef struct
+    {
+        std::wstring text;
+        bool bFormatted;
+    } td_title;
+
+    void Sync();
+
+    CPlaylistSource* m_pSource;
+    std::vector<td_title> m_titles;
+    bool m_bStale; // sized from the source on next access
+    uint64_t m_nHits;
+    uint64_t m_nMisses;
+};
@@ -0,0 +1,63 @@
+/*
+ * playstate.cpp - Published playback state.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "playstate.h"
+
+#include <cstring>
+
+double GetPlayPosition(const td_playstate& state, int64_t nNow)
+{
+    if (!state.bPlaying)
+        return -1.0;
+    double fPosition = state.fPosition;
+    if (!state.bPaused && nNow > state.nTime)
+        fPosition += static_cast<double>(nNow - state.nTime) * 1e-9;
+    if (state.fLength > 0.0 && fPosition > state.fLength)
+        fPosition = state.fLength;
+    return fPosition;
+}
+
+CPlayStateBlock::CPlayStateBlock() : m_nSeq(0)
+{
+    for (std::atomic<uint64_t>& word : m_words)
+        word.store(0, std::memory_order_relaxed);
+}
+
+void CPlayStateBlock::Publish(const td_playstate& state)
+{
+    uint64_t words[NUM_WORDS] = {};
+    std::memcpy(words, &state, sizeof(td_playstate));
+
+    uint64_t nSeq = m_nSeq.load(std::memory_order_relaxed);
+    m_nSeq.store(nSeq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < NUM_WORDS; i++)
+        m_words[i].store(words[i], std::memory_order_relaxed);
+    m_nSeq.store(nSeq + 2, std::memory_order_release);
+}
+
+bool CPlayStateBlock::Read(td_playstate& state) const
+{
+    uint64_t words[NUM_WORDS];
+    for (int nTry = 0; nTry < MAX_READ_TRIES; nTry++)
+    {
+        uint64_t nSeq = m_nSeq.load(std::memory_order_acquire);
+        if (nSeq == 0)
+            return false;
+        if (nSeq & 1)
+            continue;
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_nSeq.load(std::memory_order_relaxed) == nSeq)
+        {
+            std::memcpy(&state, words, sizeof(td_playstate));
+            return true;
+        }
+    }
+    return false;
+}
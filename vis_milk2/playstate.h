@@ -0,0 +1,63 @@
+/*
+ * playstate.h - Published playback state header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// What the visualization shows of the playback: the song title, position
+// and length, and the place of the playing song in the playlist.
+typedef struct
+{
+    int64_t nTime;        // when the position was taken, on the reader's clock, in nanoseconds
+    double fPosition;     // in seconds
+    double fLength;       // in seconds; 0 if unknown, as for streams
+    int32_t nListLength;  // items in the active playlist
+    int32_t nListPos;     // of the playing item in the active playlist; -1 if not in it
+    uint8_t bPlaying;
+    uint8_t bPaused;
+    wchar_t szTitle[512]; // of the playing item, as the playlist shows it
+} td_playstate;
+
+// Playback position at `nNow`, extrapolated from when it was taken while
+// playing. Negative if not playing.
+double GetPlayPosition(const td_playstate& state, int64_t nNow);
+
+// Hands the playback state from the thread that follows the player to the
+// render thread, without either waiting on the other.
+//
+// A sequence lock: the writer makes the version odd while it copies a new
+// state in, and even again once done; readers copy the state out and retry
+// if the version was odd or changed meanwhile. The state is stored as
+// atomic words so that reading it while it is written is not a data race.
+// There must be a single writer at a time.
+class CPlayStateBlock
+{
+  public:
+    static constexpr int MAX_READ_TRIES = 64; // before giving up on a writer that keeps writing
+
+    CPlayStateBlock();
+
+    void Publish(const td_playstate& state);
+
+    // Copies the last published state. Returns false if none was published
+    // yet, or if no consistent copy could be taken.
+    bool Read(td_playstate& state) const;
+
+    // Number of states published, so far.
+    uint64_t GetVersion() const { return m_nSeq.load(std::memory_order_acquire) / 2; }
+
+  private:
+    static_assert(std::is_trivially_copyable_v<td_playstate>);
+    static constexpr size_t NUM_WORDS = (sizeof(td_playstate) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> m_nSeq; // odd while writing
+    std::atomic<uint64_t> m_words[NUM_WORDS];
+};
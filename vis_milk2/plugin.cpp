@@ -84,6 +84,7 @@
 //#include "resource.h"
 #include <nu/AutoChar.h>
 #include <nu/AutoWide.h>
+#include <unordered_map>
 
 //#pragma comment(lib, "d3dcompiler.lib")
 //#pragma comment(lib, "dxguid.lib")
@@ -387,7 +388,6 @@ static void OnUserEditedWarpShaders(LPARAM param1, LPARAM param2)
 {
     UNREFERENCED_PARAMETER(param1);
     UNREFERENCED_PARAMETER(param2);
-    g_plugin.m_bNeedRescanTexturesDir = true;
     g_plugin.ClearErrors(ERR_PRESET);
     if (g_plugin.m_nMaxPSVersion == 0)
         return;
@@ -404,7 +404,6 @@ static void OnUserEditedCompShaders(LPARAM param1, LPARAM param2)
 {
     UNREFERENCED_PARAMETER(param1);
     UNREFERENCED_PARAMETER(param2);
-    g_plugin.m_bNeedRescanTexturesDir = true;
     g_plugin.ClearErrors(ERR_PRESET);
     if (g_plugin.m_nMaxPSVersion == 0)
         return;
@@ -529,6 +528,9 @@ void CPlugin::MilkDropPreInitialize()
     m_nMaxPSVersion = -1;
     m_nMaxImages = 32;
     m_nMaxBytes = 16000000;
+    m_nPresetCpuBudget = 0;
+    m_bNoiseCache = false;
+    m_nAudioOffset = 0;
 
     //m_pFragmentLinker = NULL;
     //m_pCompiledFragments = NULL;
@@ -545,7 +547,6 @@ void CPlugin::MilkDropPreInitialize()
     ZeroMemory(m_BlurShaders, sizeof(m_BlurShaders));
     m_bWarpShaderLock = false;
     m_bCompShaderLock = false;
-    m_bNeedRescanTexturesDir = true;
 
     // RUNTIME SETTINGS THAT MilkDrop ADDED
     m_prev_time = GetTime() - 0.0333f; // note: this will be updated each frame, at bottom of `MilkDropRenderFn()`.
@@ -606,6 +607,9 @@ void CPlugin::MilkDropPreInitialize()
     m_bShowRating = false;
     m_bShowPresetInfo = false;
     m_bShowDebugInfo = false;
+#ifdef PROFILING
+    m_bShowProfiler = false;
+#endif
     m_bShowSongTitle = false;
     m_bShowSongTime = false;
     m_bShowSongLen = false;
@@ -623,11 +627,11 @@ void CPlugin::MilkDropPreInitialize()
     m_lpDDSTitle = NULL;
     m_nTitleTexSizeX = 0;
     m_nTitleTexSizeY = 0;
-    m_verts = NULL;
     m_verts_temp = NULL;
     m_vertinfo = NULL;
-    m_indices_list = NULL;
     m_indices_strip = NULL;
+    m_lpWarpIndices = NULL;
+    m_lpCompIndices = NULL;
 
     m_bHasFocus = true;
     m_bHadFocus = false;
@@ -723,6 +727,10 @@ void CPlugin::MilkDropReadConfig()
     m_nMaxPSVersion_ConfigPanel = GetPrivateProfileInt(L"settings", L"MaxPSVersion", m_nMaxPSVersion_ConfigPanel, pIni);
     m_nMaxImages = GetPrivateProfileInt(L"settings", L"MaxImages", m_nMaxImages, pIni);
     m_nMaxBytes = GetPrivateProfileInt(L"settings", L"MaxBytes", m_nMaxBytes, pIni);
+    m_nPresetCpuBudget = GetPrivateProfileInt(L"settings", L"PresetCpuBudget", m_nPresetCpuBudget, pIni);
+    m_bNoiseCache = GetPrivateProfileBool(L"settings", L"bNoiseCache", m_bNoiseCache, pIni);
+    m_nAudioOffset = GetPrivateProfileInt(L"settings", L"AudioOffset", m_nAudioOffset, pIni);
+    m_avsync.SetOffset(static_cast<int64_t>(m_nAudioOffset) * 1000000);
 
     m_fBlendTimeUser = GetPrivateProfileFloat(L"settings", L"fBlendTimeUser", m_fBlendTimeUser, pIni);
     m_fBlendTimeAuto = GetPrivateProfileFloat(L"settings", L"fBlendTimeAuto", m_fBlendTimeAuto, pIni);
@@ -814,6 +822,9 @@ void CPlugin::MilkDropWriteConfig()
     WritePrivateProfileInt(m_nMaxPSVersion_ConfigPanel, L"MaxPSVersion", pIni, L"settings");
     WritePrivateProfileInt(m_nMaxImages, L"MaxImages", pIni, L"settings");
     WritePrivateProfileInt(m_nMaxBytes, L"MaxBytes", pIni, L"settings");
+    WritePrivateProfileInt(m_nPresetCpuBudget, L"PresetCpuBudget", pIni, L"settings");
+    WritePrivateProfileInt(m_bNoiseCache, L"bNoiseCache", pIni, L"settings");
+    WritePrivateProfileInt(m_nAudioOffset, L"AudioOffset", pIni, L"settings");
 
     WritePrivateProfileFloat(m_fBlendTimeAuto, L"fBlendTimeAuto", pIni, L"settings");
     WritePrivateProfileFloat(m_fBlendTimeUser, L"fBlendTimeUser", pIni, L"settings");
@@ -887,6 +898,10 @@ bool CPlugin::PanelSettings(plugin_config* settings)
     m_nMaxPSVersion_ConfigPanel = settings->m_nMaxPSVersion;
     m_nMaxImages = settings->m_nMaxImages;
     m_nMaxBytes = settings->m_nMaxBytes;
+    m_nPresetCpuBudget = settings->m_nPresetCpuBudget;
+    m_bNoiseCache = settings->m_bNoiseCache;
+    m_nAudioOffset = settings->m_nAudioOffset;
+    m_avsync.SetOffset(static_cast<int64_t>(m_nAudioOffset) * 1000000);
 
     m_fBlendTimeUser = settings->m_fBlendTimeUser;
     m_fBlendTimeAuto = settings->m_fBlendTimeAuto;
@@ -974,6 +989,107 @@ static void StripComments(char* str)
     *dest++ = '\0';
 }
 
+// Lists a directory with `FindFirstFile()` and watches it for files being
+// added, removed and renamed with `ReadDirectoryChangesW()`.
+class CWin32TextureDirectory : public CTextureDirectory
+{
+  public:
+    explicit CWin32TextureDirectory(const std::wstring& szDir) : m_szDir(szDir), m_hDir(INVALID_HANDLE_VALUE), m_overlapped{}, m_bWatching(false)
+    {
+        m_overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+
+    ~CWin32TextureDirectory() override
+    {
+        StopWatching();
+        if (m_overlapped.hEvent)
+            CloseHandle(m_overlapped.hEvent);
+    }
+
+    bool List(std::vector<std::wstring>& files) override
+    {
+        StopWatching();
+        WIN32_FIND_DATAW ffd = {0};
+        HANDLE hFindFile = FindFirstFile((m_szDir + L"*.*").c_str(), &ffd); // note: returns filename without path
+        if (hFindFile == INVALID_HANDLE_VALUE)
+            return false;
+        do
+        {
+            if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                files.push_back(ffd.cFileName);
+        } while (FindNextFileW(hFindFile, &ffd));
+        FindClose(hFindFile);
+
+        // Changes made between listing and watching are picked up with the
+        // next listing; missing one is harmless.
+        m_hDir = CreateFile(m_szDir.substr(0, m_szDir.length() - 1).c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        Watch();
+        return true;
+    }
+
+    bool PollChanges(std::vector<td_dirchange>& changes) override
+    {
+        if (!m_bWatching)
+            return true; // unwatchable directories are only listed once
+        DWORD dwBytes = 0;
+        if (!GetOverlappedResult(m_hDir, &m_overlapped, &dwBytes, FALSE))
+        {
+            if (GetLastError() == ERROR_IO_INCOMPLETE)
+                return true; // no changes yet
+            m_bWatching = false;
+            return false;
+        }
+        m_bWatching = false;
+        if (dwBytes == 0)
+            return false; // too many changes for the buffer
+
+        for (const BYTE* p = reinterpret_cast<const BYTE*>(m_buffer);;)
+        {
+            const FILE_NOTIFY_INFORMATION* pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+            std::wstring szName(pInfo->FileName, pInfo->FileNameLength / sizeof(wchar_t));
+            if (pInfo->Action == FILE_ACTION_ADDED || pInfo->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                changes.push_back({szName, true});
+            else if (pInfo->Action == FILE_ACTION_REMOVED || pInfo->Action == FILE_ACTION_RENAMED_OLD_NAME)
+                changes.push_back({szName, false});
+            if (!pInfo->NextEntryOffset)
+                break;
+            p += pInfo->NextEntryOffset;
+        }
+        return Watch();
+    }
+
+  private:
+    bool Watch()
+    {
+        if (m_hDir == INVALID_HANDLE_VALUE || !m_overlapped.hEvent)
+            return true;
+        ResetEvent(m_overlapped.hEvent);
+        m_bWatching = ReadDirectoryChangesW(m_hDir, m_buffer, sizeof(m_buffer), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &m_overlapped, NULL) != FALSE;
+        return m_bWatching;
+    }
+
+    void StopWatching()
+    {
+        if (m_hDir == INVALID_HANDLE_VALUE)
+            return;
+        if (m_bWatching)
+        {
+            DWORD dwBytes;
+            CancelIo(m_hDir);
+            GetOverlappedResult(m_hDir, &m_overlapped, &dwBytes, TRUE);
+            m_bWatching = false;
+        }
+        CloseHandle(m_hDir);
+        m_hDir = INVALID_HANDLE_VALUE;
+    }
+
+    std::wstring m_szDir; // with trailing backslash
+    HANDLE m_hDir;
+    OVERLAPPED m_overlapped;
+    bool m_bWatching;
+    DWORD m_buffer[4096]; // `FILE_NOTIFY_INFORMATION` records, `DWORD`-aligned
+};
+
 // This gets called only once, when your plugin is actually launched.
 // If only the config panel is launched, this does NOT get called.
 // (whereas `MilkDropPreInitialize()` still does).
@@ -1018,6 +1134,8 @@ int CPlugin::AllocateMilkDropNonDX11()
 
     BuildMenus();
 
+    m_textureCatalog.SetDirectory(std::make_unique<CWin32TextureDirectory>(std::wstring(m_szMilkdrop2Path) + L"textures\\"));
+
     m_pState->Initialize();
     m_pOldState->Initialize();
     m_pNewState->Initialize();
@@ -1073,6 +1191,8 @@ void CPlugin::CleanUpMilkDropNonDX11()
 
     SetScrollLock(m_bOrigScrollLockState, m_bPreventScollLockHandling);
 
+    m_textureCatalog.SetDirectory(nullptr);
+
     m_pState->Finish();
     m_pOldState->Finish();
     m_pNewState->Finish();
@@ -1100,6 +1220,39 @@ static int GetNearestPow2Size(int w, int h)
     return log2size;
 }
 
+// Dimensions of a 2D or 3D texture and the size of all its mip levels.
+static size_t GetTextureSize(ID3D11Resource* texptr, int* w, int* h, int* d)
+{
+    D3D11_RESOURCE_DIMENSION type;
+    texptr->GetType(&type);
+    UINT nMips = 1;
+    DXGI_FORMAT fmt = DXGI_FORMAT_UNKNOWN;
+    *w = *h = *d = 1;
+    if (type == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+    {
+        D3D11_TEXTURE2D_DESC texDesc;
+        reinterpret_cast<ID3D11Texture2D*>(texptr)->GetDesc(&texDesc);
+        *w = texDesc.Width;
+        *h = texDesc.Height;
+        nMips = texDesc.MipLevels;
+        fmt = texDesc.Format;
+    }
+    else if (type == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
+    {
+        D3D11_TEXTURE3D_DESC texDesc;
+        reinterpret_cast<ID3D11Texture3D*>(texptr)->GetDesc(&texDesc);
+        *w = texDesc.Width;
+        *h = texDesc.Height;
+        *d = std::max(static_cast<UINT>(1), texDesc.Depth);
+        nMips = texDesc.MipLevels;
+        fmt = texDesc.Format;
+    }
+    size_t nBits = 0;
+    for (UINT i = 0; i < std::max(static_cast<UINT>(1), nMips); i++)
+        nBits += static_cast<size_t>(std::max(*w >> i, 1)) * std::max(*h >> i, 1) * std::max(*d >> i, 1) * GetDX11TexFormatBitsPerPixel(fmt);
+    return nBits / 8;
+}
+
 // Allocate and initialize all the DX11 stuff here: textures,
 // surfaces, vertex/index buffers, fonts, and so on.
 // If anything fails here, return FALSE to safely exit the plugin,
@@ -1444,18 +1597,12 @@ int CPlugin::AllocateMilkDropDX11()
                 break;
             }
 
-            // Add it to `m_textures[]`.
-            TexInfo x;
-            swprintf_s(x.texname, L"blur%d%s", i / 2 + 1, (i % 2) ? L"" : L"doNOTuseME");
-            x.texptr = m_lpBlur[i];
-            //x.texsize_param = NULL;
-            x.w = w2;
-            x.h = h2;
-            x.d = 1;
-            x.bEvictable = false;
-            x.nAge = m_nPresetsLoadedTotal;
-            x.nSizeInBytes = 0;
-            m_textures.push_back(x);
+            // Add it to `m_textures`.
+            wchar_t texname[32];
+            swprintf_s(texname, L"blur%d%s", i / 2 + 1, (i % 2) ? L"" : L"doNOTuseME");
+            int d;
+            size_t nSizeInBytes = GetTextureSize(m_lpBlur[i], &w2, &h2, &d);
+            m_textures.Insert(texname, m_lpBlur[i], w2, h2, d, nSizeInBytes, false, m_nPresetsLoadedTotal);
         }
 #endif
     }
@@ -1553,7 +1700,7 @@ int CPlugin::AllocateMilkDropDX11()
 
     // Build index list for final composite blit.
     // Order should be friendly for interpolation of 'ang' value!
-    int* cur_index = &m_comp_indices[0];
+    uint16_t* cur_index = &m_comp_indices[0];
     for (int y = 0; y < FCGSY - 1; y++)
     {
         if (y == FCGSY / 2 - 1)
@@ -1568,25 +1715,26 @@ int CPlugin::AllocateMilkDropDX11()
 
             if (((int)left_half + (int)top_half + (int)center_4) % 2)
             {
-                *(cur_index + 0) = (y) * FCGSX + (x);
-                *(cur_index + 1) = (y) * FCGSX + (x + 1);
-                *(cur_index + 2) = (y + 1) * FCGSX + (x + 1);
-                *(cur_index + 3) = (y + 1) * FCGSX + (x + 1);
-                *(cur_index + 4) = (y + 1) * FCGSX + (x);
-                *(cur_index + 5) = (y) * FCGSX + (x);
+                *(cur_index + 0) = static_cast<uint16_t>((y) * FCGSX + (x));
+                *(cur_index + 1) = static_cast<uint16_t>((y) * FCGSX + (x + 1));
+                *(cur_index + 2) = static_cast<uint16_t>((y + 1) * FCGSX + (x + 1));
+                *(cur_index + 3) = static_cast<uint16_t>((y + 1) * FCGSX + (x + 1));
+                *(cur_index + 4) = static_cast<uint16_t>((y + 1) * FCGSX + (x));
+                *(cur_index + 5) = static_cast<uint16_t>((y) * FCGSX + (x));
             }
             else
             {
-                *(cur_index + 0) = (y + 1) * FCGSX + (x);
-                *(cur_index + 1) = (y) * FCGSX + (x);
-                *(cur_index + 2) = (y) * FCGSX + (x + 1);
-                *(cur_index + 3) = (y) * FCGSX + (x + 1);
-                *(cur_index + 4) = (y + 1) * FCGSX + (x + 1);
-                *(cur_index + 5) = (y + 1) * FCGSX + (x);
+                *(cur_index + 0) = static_cast<uint16_t>((y + 1) * FCGSX + (x));
+                *(cur_index + 1) = static_cast<uint16_t>((y) * FCGSX + (x));
+                *(cur_index + 2) = static_cast<uint16_t>((y) * FCGSX + (x + 1));
+                *(cur_index + 3) = static_cast<uint16_t>((y) * FCGSX + (x + 1));
+                *(cur_index + 4) = static_cast<uint16_t>((y + 1) * FCGSX + (x + 1));
+                *(cur_index + 5) = static_cast<uint16_t>((y + 1) * FCGSX + (x));
             }
             cur_index += 6;
         }
     }
+    GetDevice()->CreateIndexBuffer(m_comp_indices, static_cast<unsigned int>(ARRAYSIZE(m_comp_indices)), &m_lpCompIndices);
 
     /*
     if (m_bFixSlowText && !m_bSeparateTextWindow)
@@ -1646,14 +1794,14 @@ int CPlugin::AllocateMilkDropDX11()
 #endif
 
     m_texmgr.Init(GetDevice());
+    m_spriteDecoder.Start(D3D11Shim::DecodeImage, 1);
+    m_textureDecoder.Start(D3D11Shim::DecodeImage, 2);
 
     //DumpDebugMessage("Init: mesh allocation");
-    m_verts = new MDVERTEX[(m_nGridX + 1) * (m_nGridY + 1)];
     m_verts_temp = new MDVERTEX[(m_nGridX + 2) * 4];
     m_vertinfo = new td_vertinfo[(m_nGridX + 1) * (m_nGridY + 1)];
     m_indices_strip = new int[(m_nGridX + 2) * (m_nGridY * 2)];
-    m_indices_list = new int[m_nGridX * m_nGridY * 6];
-    if (!m_verts || !m_vertinfo)
+    if (!m_verts_temp || !m_vertinfo)
     {
         /*
         swprintf_s(buf, L"Could not allocate mesh - out of memory.");
@@ -1663,36 +1811,7 @@ int CPlugin::AllocateMilkDropDX11()
         return false;
     }
 
-    int nVert = 0;
-    float texel_offset_x = 0.5f / static_cast<float>(m_nTexSizeX);
-    float texel_offset_y = 0.5f / static_cast<float>(m_nTexSizeY);
-    for (int y = 0; y <= m_nGridY; y++)
-    {
-        for (int x = 0; x <= m_nGridX; x++)
-        {
-            // Precompute x, y, z.
-            m_verts[nVert].x = x / static_cast<float>(m_nGridX) * 2.0f - 1.0f;
-            m_verts[nVert].y = y / static_cast<float>(m_nGridY) * 2.0f - 1.0f;
-            m_verts[nVert].z = 0.0f;
-
-            // Precompute rad, ang, being conscious of aspect ratio.
-            m_vertinfo[nVert].rad = std::sqrt(m_verts[nVert].x * m_verts[nVert].x * m_fAspectX * m_fAspectX +
-                                              m_verts[nVert].y * m_verts[nVert].y * m_fAspectY * m_fAspectY);
-            if (y == m_nGridY / 2 && x == m_nGridX / 2)
-                m_vertinfo[nVert].ang = 0.0f;
-            else
-                m_vertinfo[nVert].ang = std::atan2(m_verts[nVert].y * m_fAspectY, m_verts[nVert].x * m_fAspectX);
-            m_vertinfo[nVert].a = 1;
-            m_vertinfo[nVert].c = 0;
-
-            m_verts[nVert].rad = m_vertinfo[nVert].rad;
-            m_verts[nVert].ang = m_vertinfo[nVert].ang;
-            m_verts[nVert].tu0 =  m_verts[nVert].x * 0.5f + 0.5f + texel_offset_x;
-            m_verts[nVert].tv0 = -m_verts[nVert].y * 0.5f + 0.5f + texel_offset_y;
-
-            nVert++;
-        }
-    }
+    m_evaluator.InitMesh(GetEvalFrame(), m_mesh, m_vertinfo);
 
     // Generate triangle strips for the 4 quadrants.
     // Each quadrant has `m_nGridY/2` strips.
@@ -1723,40 +1842,18 @@ int CPlugin::AllocateMilkDropDX11()
     }
 
     // Also generate triangle lists for drawing the main warp mesh.
-    int nVert_list = 0;
-    for (int quadrant = 0; quadrant < 4; quadrant++)
-    {
-        for (int slice = 0; slice < m_nGridY / 2; slice++)
-        {
-            for (int i = 0; i < m_nGridX / 2; i++)
-            {
-                // quadrants: 2 3
-                //            0 1
-                xref = i;
-                yref = slice;
-
-                if (quadrant & 1)
-                    xref = m_nGridX - 1 - xref;
-                if (quadrant & 2)
-                    yref = m_nGridY - 1 - yref;
-
-                int v = xref + (yref) * (m_nGridX + 1);
-
-                m_indices_list[nVert_list++] = v;
-                m_indices_list[nVert_list++] = v + 1;
-                m_indices_list[nVert_list++] = v + m_nGridX + 1;
-                m_indices_list[nVert_list++] = v + 1;
-                m_indices_list[nVert_list++] = v + m_nGridX + 1;
-                m_indices_list[nVert_list++] = v + m_nGridX + 1 + 1;
-            }
-        }
-    }
+    m_indices_list.clear();
+    BuildWarpIndices(m_nGridX, m_nGridY, m_indices_list);
+    GetDevice()->CreateIndexBuffer(m_indices_list.data(), static_cast<unsigned int>(m_indices_list.size()), &m_lpWarpIndices);
+    m_warp_verts.resize(GetWarpVertexCount(m_nGridX, m_nGridY));
+    m_cull_indices.resize(m_indices_list.size());
 
     // GENERATED TEXTURES FOR SHADERS
     //-------------------------------
     if (m_nMaxPSVersion > 0)
     {
-        // Generate noise textures
+        // Generate noise textures, or copy them if they were generated before.
+        m_noiseCache.SetDirectory(m_bNoiseCache ? std::wstring(m_szMilkdrop2Path) + L"cache\\" : std::wstring());
         if (!AddNoiseTex(L"noise_lq", 256, 1)) return false;
         if (!AddNoiseTex(L"noise_lq_lite", 32, 1)) return false;
         if (!AddNoiseTex(L"noise_mq", 256, 4)) return false;
@@ -1778,42 +1875,6 @@ int CPlugin::AllocateMilkDropDX11()
     return true;
 }
 
-static float fCubicInterpolate(float y0, float y1, float y2, float y3, float t)
-{
-    float a0, a1, a2, a3, t2;
-
-    t2 = t * t;
-    a0 = y3 - y2 - y0 + y1;
-    a1 = y0 - y1 - a0;
-    a2 = y2 - y0;
-    a3 = y1;
-
-    return (a0 * t * t2 + a1 * t2 + a2 * t + a3);
-}
-
-// Performs cubic interpolation on a D3DCOLOR value.
-static DWORD dwCubicInterpolate(DWORD y0, DWORD y1, DWORD y2, DWORD y3, float t)
-{
-    DWORD ret = 0;
-    DWORD shift = 0;
-    for (int i = 0; i < 4; i++)
-    {
-        float f = fCubicInterpolate(((y0 >> shift) & 0xFF) / 255.0f,
-                                    ((y1 >> shift) & 0xFF) / 255.0f,
-                                    ((y2 >> shift) & 0xFF) / 255.0f,
-                                    ((y3 >> shift) & 0xFF) / 255.0f,
-                                    t);
-        if (f < 0)
-            f = 0;
-        if (f > 1)
-            f = 1;
-        ret |= (static_cast<DWORD>(f * 255)) << shift;
-        shift += 8;
-    }
-
-    return ret;
-}
-
 // `size`: width and height of the texture;
 // `zoom_factor`: how zoomed-in the texture features should be.
 //   1 -> random noise
@@ -1869,94 +1930,18 @@ bool CPlugin::AddNoiseTex(const wchar_t* szTexName, int size, int zoom_factor)
         return false;
     }
 
-    // Write to the bits...
-    DWORD* dst = (DWORD*)r.pData;
-    int dwords_per_line = r.RowPitch / sizeof(DWORD);
-    int RANGE = (zoom_factor > 1) ? 216 : 256;
+    // Copy the cached noise to the bits...
+    const std::vector<uint32_t>& texels = m_noiseCache.Get(szTexName, size, zoom_factor, false);
     for (int y = 0; y < size; y++)
-    {
-        LARGE_INTEGER q;
-        if (!QueryPerformanceCounter(&q))
-            throw std::exception();
-        srand(q.LowPart ^ q.HighPart ^ warand());
-        for (int x = 0; x < size; x++)
-        {
-            dst[x] = (((DWORD)(warand() % RANGE) + RANGE / 2) << 24) |
-                     (((DWORD)(warand() % RANGE) + RANGE / 2) << 16) |
-                     (((DWORD)(warand() % RANGE) + RANGE / 2) << 8) |
-                     (((DWORD)(warand() % RANGE) + RANGE / 2));
-        }
-        // Swap some pixels randomly, to improve "randomness".
-        for (int x = 0; x < size; x++)
-        {
-            int x1 = (warand() ^ q.LowPart) % size;
-            int x2 = (warand() ^ q.HighPart) % size;
-            DWORD temp = dst[x2];
-            dst[x2] = dst[x1];
-            dst[x1] = temp;
-        }
-        dst += dwords_per_line;
-    }
-
-    // Smoothing.
-    if (zoom_factor > 1)
-    {
-        // First go across, blending cubically on 'X', but only on the main lines.
-        DWORD* dstZF = (DWORD*)r.pData;
-        for (int y = 0; y < size; y += zoom_factor)
-            for (int x = 0; x < size; x++)
-                if (x % zoom_factor)
-                {
-                    int base_x = (x / zoom_factor) * zoom_factor + size;
-                    int base_y = y * dwords_per_line;
-                    DWORD y0 = dstZF[base_y + ((base_x - zoom_factor) % size)];
-                    DWORD y1 = dstZF[base_y + ((base_x) % size)];
-                    DWORD y2 = dstZF[base_y + ((base_x + zoom_factor) % size)];
-                    DWORD y3 = dstZF[base_y + ((base_x + zoom_factor * 2) % size)];
-
-                    float t = (x % zoom_factor) / (float)zoom_factor;
-
-                    DWORD result = dwCubicInterpolate(y0, y1, y2, y3, t);
-
-                    dstZF[y * dwords_per_line + x] = result;
-                }
-
-        // Next go down, doing cubic interpolation along 'Y', on every line.
-        for (int x = 0; x < size; x++)
-            for (int y = 0; y < size; y++)
-                if (y % zoom_factor)
-                {
-                    int base_y = (y / zoom_factor) * zoom_factor + size;
-                    DWORD y0 = dstZF[((base_y - zoom_factor) % size) * dwords_per_line + x];
-                    DWORD y1 = dstZF[((base_y) % size) * dwords_per_line + x];
-                    DWORD y2 = dstZF[((base_y + zoom_factor) % size) * dwords_per_line + x];
-                    DWORD y3 = dstZF[((base_y + zoom_factor * 2) % size) * dwords_per_line + x];
-
-                    float t = (y % zoom_factor) / (float)zoom_factor;
-
-                    DWORD result = dwCubicInterpolate(y0, y1, y2, y3, t);
-
-                    dstZF[y * dwords_per_line + x] = result;
-                }
-    }
+        memcpy(static_cast<BYTE*>(r.pData) + y * r.RowPitch, &texels[static_cast<size_t>(y * size)], size * sizeof(uint32_t));
 
     // Unlock texture.
     lpDevice->UnlockRect(pNoiseTex, 0);
     //lpDevice->CopyResource(pNoiseTex, pStaging);
     SafeRelease(pStaging);
 
-    // Add it to `m_textures[]`.
-    TexInfo x;
-    wcscpy_s(x.texname, szTexName);
-    x.texptr = pNoiseTex;
-    //x.texsize_param = NULL;
-    x.w = size;
-    x.h = size;
-    x.d = 1;
-    x.bEvictable = false;
-    x.nAge = m_nPresetsLoadedTotal;
-    x.nSizeInBytes = 0;
-    m_textures.push_back(x);
+    // Add it to `m_textures`.
+    m_textures.Insert(szTexName, pNoiseTex, size, size, 1, static_cast<size_t>(size * size) * sizeof(uint32_t), false, m_nPresetsLoadedTotal);
 
     return true;
 }
@@ -2016,121 +2001,19 @@ bool CPlugin::AddNoiseVol(const wchar_t* szTexName, int size, int zoom_factor)
         return false;
     }
 
-    // Write to the bits...
-    int dwords_per_slice = r.DepthPitch / sizeof(DWORD);
-    int dwords_per_line = r.RowPitch / sizeof(DWORD);
-    int RANGE = (zoom_factor > 1) ? 216 : 256;
+    // Copy the cached noise to the bits...
+    const std::vector<uint32_t>& texels = m_noiseCache.Get(szTexName, size, zoom_factor, true);
     for (int z = 0; z < size; z++)
-    {
-        DWORD* dst = (DWORD*)r.pData + z * dwords_per_slice;
         for (int y = 0; y < size; y++)
-        {
-            LARGE_INTEGER q;
-            if (!QueryPerformanceCounter(&q))
-                throw std::exception();
-            srand(q.LowPart ^ q.HighPart ^ warand());
-            for (int x = 0; x < size; x++)
-            {
-                dst[x] = (((DWORD)(warand() % RANGE) + RANGE / 2) << 24) |
-                         (((DWORD)(warand() % RANGE) + RANGE / 2) << 16) |
-                         (((DWORD)(warand() % RANGE) + RANGE / 2) << 8) |
-                         (((DWORD)(warand() % RANGE) + RANGE / 2));
-            }
-            // swap some pixels randomly, to improve 'randomness'
-            for (int x = 0; x < size; x++)
-            {
-                int x1 = (warand() ^ q.LowPart) % size;
-                int x2 = (warand() ^ q.HighPart) % size;
-                DWORD temp = dst[x2];
-                dst[x2] = dst[x1];
-                dst[x1] = temp;
-            }
-            dst += dwords_per_line;
-        }
-    }
-
-    // Smoothing.
-    if (zoom_factor > 1)
-    {
-        // First go ACROSS, blending cubically on X, but only on the main lines.
-        DWORD* dst = (DWORD*)r.pData;
-        for (int z = 0; z < size; z += zoom_factor)
-            for (int y = 0; y < size; y += zoom_factor)
-                for (int x = 0; x < size; x++)
-                    if (x % zoom_factor)
-                    {
-                        int base_x = (x / zoom_factor) * zoom_factor + size;
-                        int base_y = z * dwords_per_slice + y * dwords_per_line;
-                        DWORD y0 = dst[base_y + ((base_x - zoom_factor) % size)];
-                        DWORD y1 = dst[base_y + ((base_x) % size)];
-                        DWORD y2 = dst[base_y + ((base_x + zoom_factor) % size)];
-                        DWORD y3 = dst[base_y + ((base_x + zoom_factor * 2) % size)];
-
-                        float t = (x % zoom_factor) / (float)zoom_factor;
-
-                        DWORD result = dwCubicInterpolate(y0, y1, y2, y3, t);
-
-                        dst[z * dwords_per_slice + y * dwords_per_line + x] = result;
-                    }
-
-        // next go down, doing cubic interp along Y, on the main slices.
-        for (int z = 0; z < size; z += zoom_factor)
-            for (int x = 0; x < size; x++)
-                for (int y = 0; y < size; y++)
-                    if (y % zoom_factor)
-                    {
-                        int base_y = (y / zoom_factor) * zoom_factor + size;
-                        int base_z = z * dwords_per_slice;
-                        DWORD y0 = dst[((base_y - zoom_factor) % size) * dwords_per_line + base_z + x];
-                        DWORD y1 = dst[((base_y) % size) * dwords_per_line + base_z + x];
-                        DWORD y2 = dst[((base_y + zoom_factor) % size) * dwords_per_line + base_z + x];
-                        DWORD y3 = dst[((base_y + zoom_factor * 2) % size) * dwords_per_line + base_z + x];
-
-                        float t = (y % zoom_factor) / (float)zoom_factor;
-
-                        DWORD result = dwCubicInterpolate(y0, y1, y2, y3, t);
-
-                        dst[y * dwords_per_line + base_z + x] = result;
-                    }
-
-        // next go through, doing cubic interp along Z, everywhere.
-        for (int x = 0; x < size; x++)
-            for (int y = 0; y < size; y++)
-                for (int z = 0; z < size; z++)
-                    if (z % zoom_factor)
-                    {
-                        int base_y = y * dwords_per_line;
-                        int base_z = (z / zoom_factor) * zoom_factor + size;
-                        DWORD y0 = dst[((base_z - zoom_factor) % size) * dwords_per_slice + base_y + x];
-                        DWORD y1 = dst[((base_z) % size) * dwords_per_slice + base_y + x];
-                        DWORD y2 = dst[((base_z + zoom_factor) % size) * dwords_per_slice + base_y + x];
-                        DWORD y3 = dst[((base_z + zoom_factor * 2) % size) * dwords_per_slice + base_y + x];
-
-                        float t = (z % zoom_factor) / (float)zoom_factor;
-
-                        DWORD result = dwCubicInterpolate(y0, y1, y2, y3, t);
-
-                        dst[z * dwords_per_slice + base_y + x] = result;
-                    }
-    }
+            memcpy(static_cast<BYTE*>(r.pData) + z * r.DepthPitch + y * r.RowPitch, &texels[static_cast<size_t>((z * size + y) * size)], size * sizeof(uint32_t));
 
     // Unlock texture.
     lpDevice->UnlockRect(pNoiseTex, 0);
     //lpDevice->CopyResource(pNoiseTex, pStaging);
     SafeRelease(pStaging);
 
-    // Add it to `m_textures[]`.
-    TexInfo x;
-    wcscpy_s(x.texname, szTexName);
-    x.texptr = pNoiseTex;
-    //x.texsize_param = NULL;
-    x.w = size;
-    x.h = size;
-    x.d = size;
-    x.bEvictable = false;
-    x.nAge = m_nPresetsLoadedTotal;
-    x.nSizeInBytes = 0;
-    m_textures.push_back(x);
+    // Add it to `m_textures`.
+    m_textures.Insert(szTexName, pNoiseTex, size, size, size, static_cast<size_t>(size * size * size) * sizeof(uint32_t), false, m_nPresetsLoadedTotal);
 
     return true;
 }
@@ -2192,149 +2075,118 @@ void CShaderParams::Clear()
     }
 }
 
+// Evicts the least recently used disk texture, unless the preset being
+// loaded or the one being blended from uses it.
 bool CPlugin::EvictSomeTexture()
 {
-#if _DEBUG
-    // Note: this won't evict a texture whose age is zero,
-    //       or whose reported size is zero!
-    {
-        int nEvictableFiles = 0;
-        int nEvictableBytes = 0;
-        size_t N = m_textures.size();
-        for (size_t i = 0; i < N; i++)
-            if (m_textures[i].bEvictable && m_textures[i].texptr)
-            {
-                nEvictableFiles++;
-                nEvictableBytes += m_textures[i].nSizeInBytes;
-            }
-        wchar_t buf[1024];
-        swprintf_s(buf, L"Evicting at %d textures, %.1f MB\n", nEvictableFiles, nEvictableBytes * 0.000001f);
-        //OutputDebugString(buf);
-    }
-#endif
-
-    size_t N = m_textures.size();
-
-    // find age gap
-    int newest = 99999999;
-    int oldest = 0;
-    bool bAtLeastOneFound = false;
-    for (size_t i = 0; i < N; i++)
-        if (m_textures[i].bEvictable && m_textures[i].nSizeInBytes > 0 && m_textures[i].nAge < m_nPresetsLoadedTotal - 1) // note: -1 here keeps images around for the blend-from preset, too...
-        {
-            newest = std::min(newest, m_textures[i].nAge);
-            oldest = std::max(oldest, m_textures[i].nAge);
-            bAtLeastOneFound = true;
-        }
-    if (!bAtLeastOneFound)
-        return false;
-
-    // find the "biggest" texture, but dilate things so that the newest textures
-    // are HALF as big as the oldest textures, and thus, less likely to get booted.
-    int biggest_bytes = 0;
-    int biggest_index = -1;
-    for (size_t i = 0; i < N; i++)
-        if (m_textures[i].bEvictable && m_textures[i].nSizeInBytes > 0 && m_textures[i].nAge < m_nPresetsLoadedTotal - 1) // note: -1 here keeps images around for the blend-from preset, too...
-        {
-            float size_mult = 1.0f + (m_textures[i].nAge - newest) / (float)(oldest - newest);
-            int bytes = static_cast<int>(m_textures[i].nSizeInBytes * size_mult);
-            if (bytes > biggest_bytes)
-            {
-                biggest_bytes = bytes;
-                biggest_index = static_cast<int>(i);
-            }
-        }
-    if (biggest_index == -1)
+    ID3D11Resource* texptr = NULL;
+    if (!m_textures.Evict(m_nPresetsLoadedTotal - 1, &texptr)) // note: -1 here keeps images around for the blend-from preset, too...
         return false;
 
     // Evict that sucker.
-    assert(m_textures[biggest_index].texptr);
+    assert(texptr);
 
     // Notify all CShaderParams classes that we're releasing a bindable texture!!
     for (auto const& i : global_CShaderParams_master_list)
-        i->OnTextureEvict(m_textures[biggest_index].texptr);
+        i->OnTextureEvict(texptr);
 
     // 2. Erase the texture itself.
-    SafeRelease(m_textures[biggest_index].texptr);
-    m_textures.erase(m_textures.begin() + biggest_index);
+    SafeRelease(texptr);
 
     return true;
 }
 
+// Evicts textures until those cached are within `m_nMaxImages` and
+// `m_nMaxBytes`, or until nothing else can go.
+void CPlugin::EvictTexturesOverBudget()
+{
+    while (m_textures.GetEvictableCount() >= static_cast<size_t>(std::max(m_nMaxImages, 0)) ||
+           m_textures.GetEvictableBytes() >= static_cast<size_t>(std::max(m_nMaxBytes, 0)))
+    {
+        if (!EvictSomeTexture())
+            break; // nothing left to evict, just give up
+    }
+}
+
 std::wstring texture_exts[] = {L"jpg", L"png", L"dds", L"tga", L"bmp", L"dib"};
 const wchar_t szExtsWithSlashes[] = L"jpg|png|dds|etc.";
-typedef std::vector<std::wstring> StringVec;
+// Picks a random texture from the textures directory, whose name starts
+// with `prefix` if it is not empty.
 static bool PickRandomTexture(const wchar_t* prefix, wchar_t* szRetTextureFilename) // should be MAX_PATH chars
 {
-    static StringVec texfiles;
-    static DWORD texfiles_timestamp = 0; // update this a max of every ~2 seconds or so
+    g_plugin.m_textureCatalog.Update();
+    const std::wstring* pName = g_plugin.m_textureCatalog.Pick(prefix, static_cast<uint32_t>(warand()));
+    if (!pName)
+        return false;
+    wcscpy_s(szRetTextureFilename, MAX_PATH, pName->c_str());
+    return true;
+}
 
-    // If it's been more than a few seconds since the last textures dir scan, redo it.
-    // (..just enough to make sure we don't do it more than once per preset load)
-    //DWORD t = timeGetTime(); // in milliseconds
-    //if (abs(t - texfiles_timestamp) > 2000)
-    if (g_plugin.m_bNeedRescanTexturesDir)
+// Starts decoding the disk textures sampled by the shaders of `pState`, so
+// that `CShaderParams::CacheParams()` finds them ready when the preset's
+// shaders are compiled. Built-in and random textures are skipped, as are
+// DDS files, which are cheap to load.
+void CPlugin::PrefetchTextures(const CState* pState)
+{
+    CancelTexturePrefetch();
+    for (const char* szText : {pState->m_szWarpShadersText, pState->m_szCompShadersText})
     {
-        g_plugin.m_bNeedRescanTexturesDir = false; //texfiles_timestamp = t;
-        texfiles.clear();
-
-        wchar_t szMask[MAX_PATH];
-        swprintf_s(szMask, L"%stextures\\*.*", g_plugin.m_szMilkdrop2Path);
-
-        WIN32_FIND_DATAW ffd = {0};
-
-        HANDLE hFindFile = INVALID_HANDLE_VALUE;
-        if ((hFindFile = FindFirstFile(szMask, &ffd)) == INVALID_HANDLE_VALUE) // note: returns filename without path
-            return false;
-
-        // First, count valid texture files.
-        do
+        for (const char* p = strstr(szText, "sampler_"); p; p = strstr(p, "sampler_"))
         {
-            if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            bool bWordStart = p == szText || !(isalnum(static_cast<unsigned char>(p[-1])) || p[-1] == '_');
+            p += 8;
+            size_t len = 0;
+            while (isalnum(static_cast<unsigned char>(p[len])) || p[len] == '_')
+                len++;
+            if (!bWordStart || len == 0 || len >= MAX_PATH)
                 continue;
 
-            wchar_t* ext = wcsrchr(ffd.cFileName, L'.');
-            if (!ext)
+            // Peel off "XY_" prefix, as `CacheParams()` does.
+            std::wstring szRootName(p, p + len);
+            if (szRootName.length() > 3 && szRootName[2] == L'_')
+                szRootName.erase(0, 3);
+            if (szRootName == L"main" || !wcsncmp(szRootName.c_str(), L"blur", 4) || !wcsncmp(szRootName.c_str(), L"rand", 4) ||
+                m_textures.Find(szRootName))
                 continue;
 
-            for (int i = 0; i < sizeof(texture_exts) / sizeof(texture_exts[0]); i++)
-                if (!_wcsicmp(texture_exts[i].c_str(), ext + 1))
+            wchar_t szFilename[MAX_PATH];
+            for (int z = 0; z < sizeof(texture_exts) / sizeof(texture_exts[0]); z++)
+            {
+                swprintf_s(szFilename, L"%stextures\\%s.%s", m_szMilkdrop2Path, szRootName.c_str(), texture_exts[z].c_str());
+                if (GetFileAttributes(szFilename) == INVALID_FILE_ATTRIBUTES)
                 {
-                    // Valid texture found - add it to the list. ("heart.jpg", for example).
-                    texfiles.push_back(ffd.cFileName);
-                    continue;
+                    swprintf_s(szFilename, L"%s%s.%s", m_szPresetDir, szRootName.c_str(), texture_exts[z].c_str());
+                    if (GetFileAttributes(szFilename) == INVALID_FILE_ATTRIBUTES)
+                        continue;
                 }
-        } while (FindNextFileW(hFindFile, &ffd));
-        FindClose(hFindFile);
+                if (texture_exts[z] != L"dds" && !m_prefetchedTextures.count(szFilename))
+                    m_prefetchedTextures[szFilename] = m_textureDecoder.Submit(szFilename, false);
+                break;
+            }
+        }
     }
+}
 
-    if (texfiles.size() == 0)
-        return false;
+void CPlugin::CancelTexturePrefetch()
+{
+    for (const auto& prefetched : m_prefetchedTextures)
+        m_textureDecoder.Cancel(prefetched.second);
+    m_prefetchedTextures.clear();
+}
 
-    // Then randomly pick one.
-    if (prefix == NULL || prefix[0] == 0)
+// Creates the texture from the prefetched image, if any, or from the file.
+HRESULT CPlugin::LoadDiskTexture(const wchar_t* szFilename, ID3D11Resource** ppTexture)
+{
+    auto it = m_prefetchedTextures.find(szFilename);
+    if (it != m_prefetchedTextures.end())
     {
-        // Pick randomly from entire list.
-        int i = warand() % texfiles.size();
-        wcscpy_s(szRetTextureFilename, MAX_PATH, texfiles[i].c_str());
+        td_decodedimage image;
+        bool bReady = m_textureDecoder.Wait(it->second, &image) && image.bOk;
+        m_prefetchedTextures.erase(it);
+        if (bReady)
+            return GetDevice()->CreateTextureFromPixels(image.pixels.data(), static_cast<unsigned int>(image.nWidth), static_cast<unsigned int>(image.nHeight), static_cast<unsigned int>(image.nMips), ppTexture);
     }
-    else
-    {
-        // Only pick from files with the right prefix.
-        StringVec temp_list;
-        size_t N = texfiles.size();
-        size_t len = wcslen(prefix);
-        for (size_t i = 0; i < N; i++)
-            if (!_wcsnicmp(prefix, texfiles[i].c_str(), len))
-                temp_list.push_back(texfiles[i]);
-        N = temp_list.size();
-        if (N == 0)
-            return false;
-        // Pick randomly from the subset.
-        int j = warand() % temp_list.size();
-        wcscpy_s(szRetTextureFilename, MAX_PATH, temp_list[j].c_str());
-    }
-    return true;
+    return GetDevice()->CreateTextureFromFile(szFilename, ppTexture);
 }
 
 void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
@@ -2535,45 +2387,17 @@ void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
                 // See if <szRootName>.tga or .jpg has already been loaded.
                 //   (if so, grab a pointer to it)
                 //   (if NOT, create & load it).
-                size_t N1 = g_plugin.m_textures.size();
-                for (size_t n = 0; n < N1; n++)
-                {
-                    if (!wcscmp(g_plugin.m_textures[n].texname, szRootName))
-                    {
-                        // Found a match - texture was already loaded.
-                        m_texture_bindings[cd.BindPoint].texptr = g_plugin.m_textures[n].texptr;
-                        // Also bump its age down to zero! (for cache management)
-                        g_plugin.m_textures[n].nAge = g_plugin.m_nPresetsLoadedTotal;
-                        break;
-                    }
-                }
+                // Also bump its age down to zero! (for cache management)
+                if (TexInfo* pTex = g_plugin.m_textures.Use(szRootName, g_plugin.m_nPresetsLoadedTotal))
+                    m_texture_bindings[cd.BindPoint].texptr = pTex->texptr; // found a match - texture was already loaded
                 // If still not found, load it up / make a new texture.
                 if (!m_texture_bindings[cd.BindPoint].texptr)
                 {
-                    TexInfo x;
-                    wcsncpy_s(x.texname, szRootName, 254);
-                    x.texptr = NULL;
-                    //x.texsize_param = NULL;
+                    ID3D11Resource* texptr = NULL;
 
                     // Check if we need to evict anything from the cache,
                     // due to our own cache constraints...
-                    while (1)
-                    {
-                        int nTexturesCached = 0;
-                        int nBytesCached = 0;
-                        size_t N2 = g_plugin.m_textures.size();
-                        for (size_t n = 0; n < N2; n++)
-                            if (g_plugin.m_textures[n].bEvictable && g_plugin.m_textures[n].texptr)
-                            {
-                                nBytesCached += g_plugin.m_textures[n].nSizeInBytes;
-                                nTexturesCached++;
-                            }
-                        if (nTexturesCached < g_plugin.m_nMaxImages && nBytesCached < g_plugin.m_nMaxBytes)
-                            break;
-                        // Otherwise, evict now - and loop until within the constraints.
-                        if (!g_plugin.EvictSomeTexture())
-                            break; // or if there was nothing to evict, just give up
-                    }
+                    g_plugin.EvictTexturesOverBudget();
 
                     // Load the texture.
                     wchar_t szFilename[MAX_PATH];
@@ -2591,7 +2415,7 @@ void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
                         // Keep trying to load it - if it fails due to memory, evict something and try again.
                         while (1)
                         {
-                            HRESULT hr = g_plugin.GetDevice()->CreateTextureFromFile(szFilename, &x.texptr);
+                            HRESULT hr = g_plugin.LoadDiskTexture(szFilename, &texptr);
                             if (hr == E_OUTOFMEMORY)
                             {
                                 // Out of memory - try evicting something old and/or big.
@@ -2599,40 +2423,13 @@ void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
                                     continue;
                             }
 
-                            if (hr == S_OK)
-                            {
-                                D3D11_RESOURCE_DIMENSION type;
-                                x.texptr->GetType(&type);
-                                if (type == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
-                                {
-                                    D3D11_TEXTURE2D_DESC texDesc;
-                                    reinterpret_cast<ID3D11Texture2D*>(x.texptr)->GetDesc(&texDesc);
-                                    x.w = texDesc.Width;
-                                    x.h = texDesc.Height;
-                                    x.d = 1;
-                                    int nPixels = texDesc.Width * texDesc.Height;
-                                    int BitsPerPixel = GetDX11TexFormatBitsPerPixel(texDesc.Format);
-                                    x.nSizeInBytes = nPixels * BitsPerPixel / 8 + 16384; //plus some overhead
-                                }
-                                if (type == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
-                                {
-                                    D3D11_TEXTURE3D_DESC texDesc;
-                                    reinterpret_cast<ID3D11Texture3D*>(x.texptr)->GetDesc(&texDesc);
-                                    x.w = texDesc.Width;
-                                    x.h = texDesc.Height;
-                                    x.d = texDesc.Depth;
-                                    x.bEvictable = true;
-                                    x.nAge = g_plugin.m_nPresetsLoadedTotal;
-                                    int nPixels = texDesc.Width * texDesc.Height * std::max(static_cast<UINT>(1), texDesc.Depth);
-                                    int BitsPerPixel = GetDX11TexFormatBitsPerPixel(texDesc.Format);
-                                    x.nSizeInBytes = nPixels * BitsPerPixel / 8 + 16384; // plus some overhead
-                                }
-                            }
                             break;
                         }
+                        if (texptr)
+                            break;
                     }
 
-                    if (!x.texptr)
+                    if (!texptr)
                     {
                         /*
                         wchar_t buf[2048] = {0}, title[64] = {0};
@@ -2646,8 +2443,10 @@ void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
                         return;
                     }
 
-                    g_plugin.m_textures.push_back(x);
-                    m_texture_bindings[cd.BindPoint].texptr = x.texptr;
+                    int w, h, d;
+                    size_t nSizeInBytes = GetTextureSize(texptr, &w, &h, &d);
+                    g_plugin.m_textures.Insert(szRootName, texptr, w, h, d, nSizeInBytes, true, g_plugin.m_nPresetsLoadedTotal);
+                    m_texture_bindings[cd.BindPoint].texptr = texptr;
                 }
             }
         }
@@ -2732,22 +2531,17 @@ void CShaderParams::CacheParams(CConstantTable* pCT, bool /* bHardErrors */)
 
                     // see if <szRootName>.tga or .jpg has already been loaded.
                     bool bTexFound = false;
-                    size_t N = g_plugin.m_textures.size();
-                    for (size_t n = 0; n < N; n++)
+                    if (const TexInfo* pTex = g_plugin.m_textures.Find(szRootName))
                     {
-                        if (!wcscmp(g_plugin.m_textures[n].texname, szRootName))
-                        {
-                            // Found a match - texture was loaded.
-                            TexSizeParamInfo y;
-                            y.texname = szRootName; // for debugging
-                            y.texsize_param = h;
-                            y.w = g_plugin.m_textures[n].w;
-                            y.h = g_plugin.m_textures[n].h;
-                            texsize_params.push_back(y);
-
-                            bTexFound = true;
-                            break;
-                        }
+                        // Found a match - texture was loaded.
+                        TexSizeParamInfo y;
+                        y.texname = szRootName; // for debugging
+                        y.texsize_param = h;
+                        y.w = pTex->w;
+                        y.h = pTex->h;
+                        texsize_params.push_back(y);
+
+                        bTexFound = true;
                     }
 
                     if (!bTexFound)
@@ -3164,18 +2958,19 @@ void CPlugin::CleanUpMilkDropDX11(int /* final_cleanup */)
     // Force this.
     m_pState->m_bBlending = false;
 
-    for (size_t i = 0; i < m_textures.size(); i++)
-        if (m_textures[i].texptr)
+    m_textures.ForEach([](TexInfo& t) {
+        if (t.texptr)
         {
             // Notify all CShaderParams classes that we're releasing a bindable texture!!
             for (auto const& j : global_CShaderParams_master_list)
-                j->OnTextureEvict(m_textures[i].texptr);
+                j->OnTextureEvict(t.texptr);
 
-            SafeRelease(m_textures[i].texptr);
+            SafeRelease(t.texptr);
         }
-    m_textures.clear();
+    });
+    m_textures.Clear();
 
-    // DON'T RELEASE blur textures - they were already released because they're in m_textures[].
+    // DON'T RELEASE blur textures - they were already released because they're in `m_textures`.
 #if (NUM_BLUR_TEX > 0)
     for (int i = 0; i < NUM_BLUR_TEX; i++)
         m_lpBlur[i] = NULL; //SafeRelease(m_lpBlur[i]);
@@ -3226,18 +3021,17 @@ void CPlugin::CleanUpMilkDropDX11(int /* final_cleanup */)
     SafeRelease(m_lpVS[1]);
     SafeRelease(m_lpDDSTitle);
     m_ddsTitle.ReleaseDeviceDependentResources();
+    m_titleMeasurer.Clear();
 #ifdef _SUPERTEXT
     m_superTitle.reset();
 #endif
 
+    m_spriteDecoder.Stop();
+    m_pendingSprites.clear();
+    m_textureDecoder.Stop();
+    m_prefetchedTextures.clear();
     m_texmgr.Finish();
 
-    if (m_verts != NULL)
-    {
-        delete m_verts;
-        m_verts = NULL;
-    }
-
     if (m_verts_temp != NULL)
     {
         delete m_verts_temp;
@@ -3250,11 +3044,10 @@ void CPlugin::CleanUpMilkDropDX11(int /* final_cleanup */)
         m_vertinfo = NULL;
     }
 
-    if (m_indices_list != NULL)
-    {
-        delete m_indices_list;
-        m_indices_list = NULL;
-    }
+    m_indices_list.clear();
+    m_warp_verts.clear();
+    SafeRelease(m_lpWarpIndices);
+    SafeRelease(m_lpCompIndices);
 
     if (m_indices_strip != NULL)
     {
@@ -3374,7 +3167,7 @@ void CPlugin::MilkDropRenderFrame(int redraw)
 
     if (!redraw)
     {
-        GetWinampSongTitle(GetWinampWindow(), m_szSongTitle, ARRAYSIZE(m_szSongTitle));
+        GetSongTitle(m_szSongTitle, ARRAYSIZE(m_szSongTitle));
         if (wcscmp(m_szSongTitle, m_szSongTitlePrev) != 0)
         {
             wcscpy_s(m_szSongTitlePrev, m_szSongTitle);
@@ -3398,7 +3191,10 @@ void CPlugin::MilkDropRenderFrame(int redraw)
     PrepareFor2DDrawing(GetDevice());
 
     if (!redraw)
+    {
         DoCustomSoundAnalysis(); // emulates old pre-VMS milkdrop sound analysis
+        FinishPendingSprites();
+    }
 
     RenderFrame(redraw); // see "milkdropfs.cpp"
 
@@ -3705,6 +3501,43 @@ void CPlugin::MilkDropRenderUI(int* upper_left_corner_y, int* upper_right_corner
             }
         }
 
+#ifdef PROFILING
+        // e) Frame profiler percentiles.
+        if (m_bShowProfiler)
+        {
+            td_profilestats stats;
+            m_profiler.GetStats(stats);
+            SelectFont(SIMPLE_FONT);
+            for (int i = 0; i <= NUM_PROF_STAGES; i++)
+            {
+                int stage = (i == 0) ? NUM_PROF_STAGES : i - 1; // whole frame first
+                swprintf_s(buf, L" %hs: p50 %5.2f  p95 %5.2f  max %5.2f ms ", CFrameProfiler::GetStageName(stage), stats.p50[stage], stats.p95[stage], stats.max[stage]);
+                MilkDropTextOut_Shadow(buf, m_profilerText[i], 0xFFFFFFFF, MTO_UPPER_RIGHT);
+            }
+            swprintf_s(buf, L" image cache: %u hits  %u misses ", m_imageCache.GetHits(), m_imageCache.GetMisses());
+            MilkDropTextOut_Shadow(buf, m_profilerText[NUM_PROF_STAGES + 1], 0xFFFFFFFF, MTO_UPPER_RIGHT);
+            td_pacerstats pacing;
+            m_pacer.GetStats(pacing);
+            swprintf_s(buf, L" pacing: jitter p50 %4.2f  p99 %4.2f  cost %5.2f  spin %4.2f ms  late %llu  dropped %llu ", pacing.fJitterP50, pacing.fJitterP99, pacing.fPredictedCost, pacing.fSpinPerFrame, pacing.nLate, pacing.nDropped);
+            MilkDropTextOut_Shadow(buf, m_profilerText[NUM_PROF_STAGES + 2], 0xFFFFFFFF, MTO_UPPER_RIGHT);
+            td_avsyncstats sync;
+            m_avsync.GetStats(sync);
+            swprintf_s(buf, L" audio sync: delay %5.2f  queue %3.1f  error mean %5.2f  p95 %5.2f ms ", sync.fDelay, sync.fQueueDepth, sync.fErrorMean, sync.fErrorP95);
+            MilkDropTextOut_Shadow(buf, m_profilerText[NUM_PROF_STAGES + 3], 0xFFFFFFFF, MTO_UPPER_RIGHT);
+        }
+        else
+        {
+            for (int i = 0; i <= NUM_PROF_STAGES + 3; i++)
+            {
+                if (m_profilerText[i].IsVisible())
+                {
+                    m_profilerText[i].SetVisible(false);
+                    m_text.UnregisterElement(&m_profilerText[i]);
+                }
+            }
+        }
+#endif
+
         // NOTE: Custom timed message comes at the end!!
     }
 
@@ -3728,7 +3561,7 @@ void CPlugin::MilkDropRenderUI(int* upper_left_corner_y, int* upper_right_corner
         {
             wchar_t buf4[512] = {0};
             SelectFont(DECORATIVE_FONT);
-            GetWinampSongTitle(GetWinampWindow(), buf4, ARRAYSIZE(buf4)); // defined in "support.h/cpp"
+            GetSongTitle(buf4, ARRAYSIZE(buf4));
             if (buf4[0])
                 MilkDropTextOut_Shadow(buf4, m_songTitle, 0xFFFFFFFF, MTO_LOWER_LEFT);
         }
@@ -3746,8 +3579,8 @@ void CPlugin::MilkDropRenderUI(int* upper_left_corner_y, int* upper_right_corner
         {
             wchar_t buf2[64] = {0};
             wchar_t buf3[64] = {0}; // add extra space to end, so italicized fonts do not get clipped
-            GetWinampSongPosAsText(GetWinampWindow(), buf); // defined in "support.h/cpp"
-            GetWinampSongLenAsText(GetWinampWindow(), buf2); // defined in "support.h/cpp"
+            GetSongPosAsText(buf);
+            GetSongLenAsText(buf2);
             if (buf2[0])
             {
                 if (m_bShowSongTime && m_bShowSongLen)
@@ -5150,14 +4983,30 @@ void CPlugin::LoadRandomPreset(float fBlendTime)
 
     if (m_bSequentialPresetOrder)
     {
-        m_nCurrentPreset++;
-        if (m_nCurrentPreset < m_nDirs || m_nCurrentPreset >= m_nPresets)
-            m_nCurrentPreset = m_nDirs;
+        if (m_nPresetCpuBudget > 0)
+        {
+            // Skip the presets over twice the budget.
+            std::vector<float> costs = GetPresetCosts();
+            size_t nCurrent = (m_nCurrentPreset >= m_nDirs && m_nCurrentPreset < m_nPresets) ? static_cast<size_t>(m_nCurrentPreset - m_nDirs) : costs.size() - 1;
+            m_nCurrentPreset = m_nDirs + static_cast<int>(NextPresetWithinBudget(costs.data(), costs.size(), nCurrent, static_cast<float>(m_nPresetCpuBudget)));
+        }
+        else
+        {
+            m_nCurrentPreset++;
+            if (m_nCurrentPreset < m_nDirs || m_nCurrentPreset >= m_nPresets)
+                m_nCurrentPreset = m_nDirs;
+        }
     }
     else
     {
-        // Pick a random file.
-        if (!m_bEnableRating || (m_presets[static_cast<size_t>(m_nPresets) - 1].fRatingCum < 0.1f)) //|| (m_nRatingReadProgress < m_nPresets))
+        // Pick a random file. If every preset is over twice the CPU budget,
+        // the plain pick below ignores it.
+        int nWithinBudget = (m_nPresetCpuBudget > 0) ? PickRandomPresetWithinBudget() : -1;
+        if (nWithinBudget >= 0)
+        {
+            m_nCurrentPreset = nWithinBudget;
+        }
+        else if (!m_bEnableRating || (m_presets[static_cast<size_t>(m_nPresets) - 1].fRatingCum < 0.1f)) //|| (m_nRatingReadProgress < m_nPresets))
         {
             m_nCurrentPreset = m_nDirs + (warand() % (m_nPresets - m_nDirs));
         }
@@ -5210,164 +5059,40 @@ void CPlugin::LoadRandomPreset(float fBlendTime)
     LoadPreset(szFile, fBlendTime);
 }
 
-void CPlugin::RandomizeBlendPattern()
+// Like the rating-weighted pick in `LoadRandomPreset()`, but presets whose
+// estimated cost at the current mesh size is over the CPU budget are
+// down-weighted, and those over twice the budget are left out. When all
+// ratings of the presets that fit are 0, they are picked evenly.
+// Returns -1 if nothing fits, so the caller can fall back to the plain pick.
+int CPlugin::PickRandomPresetWithinBudget() const
 {
-    if (!m_vertinfo)
-        return;
-
-    // Note: now avoid constant uniform blend because it is half-speed for shader blending.
-    //       (both old and new shaders would have to run on every pixel...)
-    int mixtype = 1 + (warand() % 3); //warand()%4;
-
-    if (mixtype == 0)
-    {
-        // Constant, uniform blend.
-        int nVert = 0;
-        for (int y = 0; y <= m_nGridY; y++)
-        {
-            for (int x = 0; x <= m_nGridX; x++)
-            {
-                m_vertinfo[nVert].a = 1;
-                m_vertinfo[nVert].c = 0;
-                nVert++;
-            }
-        }
-    }
-    else if (mixtype == 1)
-    {
-        // Directional wipe.
-        float ang = FRAND * 6.28f;
-        float vx = cosf(ang);
-        float vy = sinf(ang);
-        float band = 0.1f + 0.2f * FRAND; // 0.2 is good
-        float inv_band = 1.0f / band;
-
-        int nVert = 0;
-        for (int y = 0; y <= m_nGridY; y++)
-        {
-            float fy = (y / (float)m_nGridY) * m_fAspectY;
-            for (int x = 0; x <= m_nGridX; x++)
-            {
-                float fx = (x / (float)m_nGridX) * m_fAspectX;
-
-                // at t==0, mix rangse from -10..0
-                // at t==1, mix ranges from   1..11
-
-                float t = (fx - 0.5f) * vx + (fy - 0.5f) * vy + 0.5f;
-                t = (t - 0.5f) / sqrtf(2.0f) + 0.5f;
-
-                m_vertinfo[nVert].a = inv_band * (1 + band);
-                m_vertinfo[nVert].c = -inv_band + inv_band * t; //(x/(float)m_nGridX - 0.5f)/band;
-                nVert++;
-            }
-        }
-    }
-    else if (mixtype == 2)
-    {
-        // Plasma transition.
-        float band = 0.12f + 0.13f * FRAND; //0.02f + 0.18f*FRAND;
-        float inv_band = 1.0f / band;
-
-        // First generate plasma array of height values.
-        m_vertinfo[0].c = FRAND;
-        m_vertinfo[m_nGridX].c = FRAND;
-        m_vertinfo[m_nGridY * (m_nGridX + 1)].c = FRAND;
-        m_vertinfo[m_nGridY * (m_nGridX + 1) + m_nGridX].c = FRAND;
-        GenPlasma(0, m_nGridX, 0, m_nGridY, 0.25f);
-
-        // then find min,max so we can normalize to [0..1] range and then to the proper 'constant offset' range.
-        float minc = m_vertinfo[0].c;
-        float maxc = m_vertinfo[0].c;
-        int x, y, nVert;
-
-        nVert = 0;
-        for (y = 0; y <= m_nGridY; y++)
-        {
-            for (x = 0; x <= m_nGridX; x++)
-            {
-                if (minc > m_vertinfo[nVert].c)
-                    minc = m_vertinfo[nVert].c;
-                if (maxc < m_vertinfo[nVert].c)
-                    maxc = m_vertinfo[nVert].c;
-                nVert++;
-            }
-        }
-
-        float mult = 1.0f / (maxc - minc);
-        nVert = 0;
-        for (y = 0; y <= m_nGridY; y++)
-        {
-            for (x = 0; x <= m_nGridX; x++)
-            {
-                float t = (m_vertinfo[nVert].c - minc) * mult;
-                m_vertinfo[nVert].a = inv_band * (1 + band);
-                m_vertinfo[nVert].c = -inv_band + inv_band * t;
-                nVert++;
-            }
-        }
-    }
-    else if (mixtype == 3)
-    {
-        // Radial blend.
-        float band = 0.02f + 0.14f * FRAND + 0.34f * FRAND;
-        float inv_band = 1.0f / band;
-        float dir = (float)((warand() % 2) * 2 - 1); // 1=outside-in, -1=inside-out
-
-        int nVert = 0;
-        for (int y = 0; y <= m_nGridY; y++)
-        {
-            float dy = (y / (float)m_nGridY - 0.5f) * m_fAspectY;
-            for (int x = 0; x <= m_nGridX; x++)
-            {
-                float dx = (x / (float)m_nGridX - 0.5f) * m_fAspectX;
-                float t = sqrtf(dx * dx + dy * dy) * 1.41421f;
-                if (dir == -1)
-                    t = 1 - t;
-
-                m_vertinfo[nVert].a = inv_band * (1 + band);
-                m_vertinfo[nVert].c = -inv_band + inv_band * t;
-                nVert++;
-            }
-        }
-    }
+    std::vector<float> costs = GetPresetCosts();
+    std::vector<float> ratings;
+    if (m_bEnableRating)
+        for (int i = m_nDirs; i < m_nPresets; i++)
+            ratings.push_back(m_presets[i].fRatingThis);
+
+    float fRandom = (warand() % 14345) / 14345.0f;
+    int nPick = PickPresetWithinBudget(costs.data(), ratings.empty() ? nullptr : ratings.data(), costs.size(), static_cast<float>(m_nPresetCpuBudget), fRandom);
+    return (nPick < 0) ? -1 : m_nDirs + nPick;
 }
 
-void CPlugin::GenPlasma(int x0, int x1, int y0, int y1, float dt)
+// Estimated cost of each preset (not directory) at the current mesh size.
+std::vector<float> CPlugin::GetPresetCosts() const
 {
-    int midx = (x0 + x1) / 2;
-    int midy = (y0 + y1) / 2;
-    float t00 = m_vertinfo[y0 * (m_nGridX + 1) + x0].c;
-    float t01 = m_vertinfo[y0 * (m_nGridX + 1) + x1].c;
-    float t10 = m_vertinfo[y1 * (m_nGridX + 1) + x0].c;
-    float t11 = m_vertinfo[y1 * (m_nGridX + 1) + x1].c;
-
-    if (y1 - y0 >= 2)
-    {
-        if (x0 == 0)
-            m_vertinfo[midy * (m_nGridX + 1) + x0].c = 0.5f * (t00 + t10) + (FRAND * 2 - 1) * dt * m_fAspectY;
-        m_vertinfo[midy * (m_nGridX + 1) + x1].c = 0.5f * (t01 + t11) + (FRAND * 2 - 1) * dt * m_fAspectY;
-    }
-    if (x1 - x0 >= 2)
-    {
-        if (y0 == 0)
-            m_vertinfo[y0 * (m_nGridX + 1) + midx].c = 0.5f * (t00 + t01) + (FRAND * 2 - 1) * dt * m_fAspectX;
-        m_vertinfo[y1 * (m_nGridX + 1) + midx].c = 0.5f * (t10 + t11) + (FRAND * 2 - 1) * dt * m_fAspectX;
-    }
+    std::vector<float> costs;
+    costs.reserve(static_cast<size_t>(m_nPresets - m_nDirs));
+    for (int i = m_nDirs; i < m_nPresets; i++)
+        costs.push_back(GetPresetCost(m_presets[i].cost, m_nGridX, m_nGridY));
+    return costs;
+}
 
-    if (y1 - y0 >= 2 && x1 - x0 >= 2)
-    {
-        // Do midpoint and recurse.
-        t00 = m_vertinfo[midy * (m_nGridX + 1) + x0].c;
-        t01 = m_vertinfo[midy * (m_nGridX + 1) + x1].c;
-        t10 = m_vertinfo[y0 * (m_nGridX + 1) + midx].c;
-        t11 = m_vertinfo[y1 * (m_nGridX + 1) + midx].c;
-        m_vertinfo[midy * (m_nGridX + 1) + midx].c = 0.25f * (t10 + t11 + t00 + t01) + (FRAND * 2 - 1) * dt;
+void CPlugin::RandomizeBlendPattern()
+{
+    if (!m_vertinfo)
+        return;
 
-        GenPlasma(x0, midx, y0, midy, dt * 0.5f);
-        GenPlasma(midx, x1, y0, midy, dt * 0.5f);
-        GenPlasma(x0, midx, midy, y1, dt * 0.5f);
-        GenPlasma(midx, x1, midy, y1, dt * 0.5f);
-    }
+    m_evaluator.RandomizeBlendPattern(GetEvalFrame(), m_vertinfo);
 }
 
 void CPlugin::LoadPreset(const wchar_t* szPresetFilename, float fBlendTime)
@@ -5464,6 +5189,7 @@ void CPlugin::LoadPreset(const wchar_t* szPresetFilename, float fBlendTime)
         ApplyFlags ^= (m_bCompShaderLock ? STATE_COMP : 0);
 
         m_pNewState->Import(szPresetFilename, GetTime(), m_pOldState, ApplyFlags);
+        PrefetchTextures(m_pNewState);
 
         m_nLoadingPreset = 1; // this will cause `LoadPresetTick()` to get called over the next few frames...
 
@@ -5518,8 +5244,9 @@ void CPlugin::LoadPresetTick()
         m_shaders = m_NewShaders;
         ZeroMemory(&m_NewShaders, sizeof(PShaderSet));
 
-        // End slow-preset-load mode.
+        // End slow-preset-load mode, dropping prefetched textures the shaders did not use.
         m_nLoadingPreset = 0;
+        CancelTexturePrefetch();
 
         OnFinishedLoadingPreset();
     }
@@ -5599,6 +5326,35 @@ static char* NextLine(char* p)
     return s;
 }
 
+// Cost estimates from earlier scans, keyed by full path and only touched by
+// the scanning thread. An entry is reused while the file size and time match.
+typedef struct
+{
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeLow;
+    td_presetcost cost;
+} td_presetcostentry;
+static std::unordered_map<std::wstring, td_presetcostentry> s_presetCostCache;
+
+static td_presetcost GetCachedPresetCost(const wchar_t* szFullPath, const WIN32_FIND_DATA& fd)
+{
+    auto it = s_presetCostCache.find(szFullPath);
+    if (it != s_presetCostCache.end() && it->second.nFileSizeLow == fd.nFileSizeLow && CompareFileTime(&it->second.ftLastWriteTime, &fd.ftLastWriteTime) == 0)
+        return it->second.cost;
+
+    td_presetcost cost = {};
+    FILE* f;
+    if (_wfopen_s(&f, szFullPath, L"rb") == 0)
+    {
+        std::string text(fd.nFileSizeLow, '\0');
+        text.resize(fread(text.data(), 1, text.size(), f));
+        fclose(f);
+        cost = EstimatePresetCost(text.data(), text.size());
+    }
+    s_presetCostCache[szFullPath] = {fd.ftLastWriteTime, fd.nFileSizeLow, cost};
+    return cost;
+}
+
 // NOTE - this is run in a separate thread!!!
 static unsigned int WINAPI __UpdatePresetList(void* lpVoid)
 {
@@ -5676,6 +5432,7 @@ retry:
     }
 
     int nMaxPSVersion = g_plugin.m_nMaxPSVersion;
+    bool bEstimateCost = g_plugin.m_nPresetCpuBudget > 0;
     wchar_t szPresetDir[MAX_PATH];
     wcscpy_s(szPresetDir, g_plugin.m_szPresetDir);
 
@@ -5691,6 +5448,7 @@ retry:
         bool bSkip = false;
         bool bIsDir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
         float fRating = 0;
+        td_presetcost cost = {};
 
         wchar_t szFilename[512] = {0};
         wcscpy_s(szFilename, fd.cFileName);
@@ -5794,6 +5552,11 @@ retry:
                     if (!bRatingKnown)
                         fRating = GetPrivateProfileFloat(L"preset00", L"fRating", 3.0f, szFullPath);
                     fRating = std::max(0.0f, std::min(5.0f, fRating));
+
+                    // The header is enough for the rating, but the cost
+                    // model needs the whole file; skip it unless asked for.
+                    if (!bSkip && bEstimateCost)
+                        cost = GetCachedPresetCost(szFullPath, fd);
                 }
             }
         }
@@ -5808,6 +5571,7 @@ retry:
             x.szFilename = szFilename;
             x.fRatingThis = fRating;
             x.fRatingCum = fPrevPresetRatingCum + fRating;
+            x.cost = cost;
             temp_presets.push_back(x);
 
             temp_nPresets++;
@@ -6480,6 +6244,27 @@ void CPlugin::SetCurrentPresetRating(float fNewRating)
     }
 }
 
+#ifdef PROFILING
+// Writes the frames held by the profiler to "profile.json" in the MilkDrop 2
+// folder, for loading into Chrome's "about:tracing" or Perfetto.
+void CPlugin::ExportProfile()
+{
+    wchar_t szFile[MAX_PATH];
+    swprintf_s(szFile, L"%sprofile.json", m_szMilkdrop2Path);
+
+    std::string trace = m_profiler.ToChromeTrace();
+    FILE* f = NULL;
+    if (_wfopen_s(&f, szFile, L"wb") != 0 || !f)
+    {
+        AddError(WASABI_API_LNGSTRINGW(IDS_ERROR_UNABLE_TO_SAVE_THE_FILE), 6.0f, ERR_MISC, true);
+        return;
+    }
+    fwrite(trace.data(), 1, trace.size(), f);
+    fclose(f);
+    AddError(WASABI_API_LNGSTRINGW(IDS_SAVE_SUCCESSFUL), 3.0f, ERR_NOTIFY, false);
+}
+#endif
+
 void CPlugin::ReadCustomMessages()
 {
     // First, clear all old data
@@ -6524,7 +6309,7 @@ void CPlugin::ReadCustomMessages()
     }
 
     // Then read in the new file.
-    if (!FileExists(m_szMsgIniFile))
+    if (!m_msgIni.Refresh(m_szMsgIniFile))
         return;
 
     for (int n = 0; n < MAX_CUSTOM_MESSAGE_FONTS; n++)
@@ -6533,12 +6318,12 @@ void CPlugin::ReadCustomMessages()
         swprintf_s(szSectionName, L"font%02d", n);
 
         // Get face, bold, italic, x, y for this custom message FONT.
-        GetPrivateProfileString(szSectionName, L"face", L"Arial", m_customMessageFont[n].szFace, ARRAYSIZE(m_customMessageFont[n].szFace), m_szMsgIniFile);
-        m_customMessageFont[n].bBold = GetPrivateProfileBool(szSectionName, L"bold", m_customMessageFont[n].bBold, m_szMsgIniFile);
-        m_customMessageFont[n].bItal = GetPrivateProfileBool(szSectionName, L"ital", m_customMessageFont[n].bItal, m_szMsgIniFile);
-        m_customMessageFont[n].nColorR = GetPrivateProfileInt(szSectionName, L"r", m_customMessageFont[n].nColorR, m_szMsgIniFile);
-        m_customMessageFont[n].nColorG = GetPrivateProfileInt(szSectionName, L"g", m_customMessageFont[n].nColorG, m_szMsgIniFile);
-        m_customMessageFont[n].nColorB = GetPrivateProfileInt(szSectionName, L"b", m_customMessageFont[n].nColorB, m_szMsgIniFile);
+        m_msgIni.GetString(szSectionName, L"face", L"Arial", m_customMessageFont[n].szFace, ARRAYSIZE(m_customMessageFont[n].szFace));
+        m_customMessageFont[n].bBold = m_msgIni.GetBool(szSectionName, L"bold", m_customMessageFont[n].bBold);
+        m_customMessageFont[n].bItal = m_msgIni.GetBool(szSectionName, L"ital", m_customMessageFont[n].bItal);
+        m_customMessageFont[n].nColorR = m_msgIni.GetInt(szSectionName, L"r", m_customMessageFont[n].nColorR);
+        m_customMessageFont[n].nColorG = m_msgIni.GetInt(szSectionName, L"g", m_customMessageFont[n].nColorG);
+        m_customMessageFont[n].nColorB = m_msgIni.GetInt(szSectionName, L"b", m_customMessageFont[n].nColorB);
     }
 
     for (int n = 0; n < MAX_CUSTOM_MESSAGES; n++)
@@ -6547,33 +6332,33 @@ void CPlugin::ReadCustomMessages()
         swprintf_s(szSectionName, L"message%02d", n);
 
         // Get fontID, size, text, etc. for this custom message.
-        GetPrivateProfileString(szSectionName, L"text", L"", m_customMessage[n].szText, ARRAYSIZE(m_customMessage[n].szText), m_szMsgIniFile);
+        m_msgIni.GetString(szSectionName, L"text", L"", m_customMessage[n].szText, ARRAYSIZE(m_customMessage[n].szText));
         if (m_customMessage[n].szText[0])
         {
-            m_customMessage[n].nFont = GetPrivateProfileInt(szSectionName, L"font", m_customMessage[n].nFont, m_szMsgIniFile);
-            m_customMessage[n].fSize = GetPrivateProfileFloat(szSectionName, L"size", m_customMessage[n].fSize, m_szMsgIniFile);
-            m_customMessage[n].x = GetPrivateProfileFloat(szSectionName, L"x", m_customMessage[n].x, m_szMsgIniFile);
-            m_customMessage[n].y = GetPrivateProfileFloat(szSectionName, L"y", m_customMessage[n].y, m_szMsgIniFile);
-            m_customMessage[n].randx = GetPrivateProfileFloat(szSectionName, L"randx", m_customMessage[n].randx, m_szMsgIniFile);
-            m_customMessage[n].randy = GetPrivateProfileFloat(szSectionName, L"randy", m_customMessage[n].randy, m_szMsgIniFile);
-
-            m_customMessage[n].growth = GetPrivateProfileFloat(szSectionName, L"growth", m_customMessage[n].growth, m_szMsgIniFile);
-            m_customMessage[n].fTime = GetPrivateProfileFloat(szSectionName, L"time", m_customMessage[n].fTime, m_szMsgIniFile);
-            m_customMessage[n].fFade = GetPrivateProfileFloat(szSectionName, L"fade", m_customMessage[n].fFade, m_szMsgIniFile);
-            m_customMessage[n].nColorR = GetPrivateProfileInt(szSectionName, L"r", m_customMessage[n].nColorR, m_szMsgIniFile);
-            m_customMessage[n].nColorG = GetPrivateProfileInt(szSectionName, L"g", m_customMessage[n].nColorG, m_szMsgIniFile);
-            m_customMessage[n].nColorB = GetPrivateProfileInt(szSectionName, L"b", m_customMessage[n].nColorB, m_szMsgIniFile);
-            m_customMessage[n].nRandR = GetPrivateProfileInt(szSectionName, L"randr", m_customMessage[n].nRandR, m_szMsgIniFile);
-            m_customMessage[n].nRandG = GetPrivateProfileInt(szSectionName, L"randg", m_customMessage[n].nRandG, m_szMsgIniFile);
-            m_customMessage[n].nRandB = GetPrivateProfileInt(szSectionName, L"randb", m_customMessage[n].nRandB, m_szMsgIniFile);
+            m_customMessage[n].nFont = m_msgIni.GetInt(szSectionName, L"font", m_customMessage[n].nFont);
+            m_customMessage[n].fSize = m_msgIni.GetFloat(szSectionName, L"size", m_customMessage[n].fSize);
+            m_customMessage[n].x = m_msgIni.GetFloat(szSectionName, L"x", m_customMessage[n].x);
+            m_customMessage[n].y = m_msgIni.GetFloat(szSectionName, L"y", m_customMessage[n].y);
+            m_customMessage[n].randx = m_msgIni.GetFloat(szSectionName, L"randx", m_customMessage[n].randx);
+            m_customMessage[n].randy = m_msgIni.GetFloat(szSectionName, L"randy", m_customMessage[n].randy);
+
+            m_customMessage[n].growth = m_msgIni.GetFloat(szSectionName, L"growth", m_customMessage[n].growth);
+            m_customMessage[n].fTime = m_msgIni.GetFloat(szSectionName, L"time", m_customMessage[n].fTime);
+            m_customMessage[n].fFade = m_msgIni.GetFloat(szSectionName, L"fade", m_customMessage[n].fFade);
+            m_customMessage[n].nColorR = m_msgIni.GetInt(szSectionName, L"r", m_customMessage[n].nColorR);
+            m_customMessage[n].nColorG = m_msgIni.GetInt(szSectionName, L"g", m_customMessage[n].nColorG);
+            m_customMessage[n].nColorB = m_msgIni.GetInt(szSectionName, L"b", m_customMessage[n].nColorB);
+            m_customMessage[n].nRandR = m_msgIni.GetInt(szSectionName, L"randr", m_customMessage[n].nRandR);
+            m_customMessage[n].nRandG = m_msgIni.GetInt(szSectionName, L"randg", m_customMessage[n].nRandG);
+            m_customMessage[n].nRandB = m_msgIni.GetInt(szSectionName, L"randb", m_customMessage[n].nRandB);
 
             // Overrides: r,g,b,face,bold,ital
-            GetPrivateProfileString(szSectionName, L"face", L"", m_customMessage[n].szFace, ARRAYSIZE(m_customMessage[n].szFace), m_szMsgIniFile);
-            m_customMessage[n].bBold = GetPrivateProfileInt(szSectionName, L"bold", -1, m_szMsgIniFile);
-            m_customMessage[n].bItal = GetPrivateProfileInt(szSectionName, L"ital", -1, m_szMsgIniFile);
-            m_customMessage[n].nColorR = GetPrivateProfileInt(szSectionName, L"r", -1, m_szMsgIniFile);
-            m_customMessage[n].nColorG = GetPrivateProfileInt(szSectionName, L"g", -1, m_szMsgIniFile);
-            m_customMessage[n].nColorB = GetPrivateProfileInt(szSectionName, L"b", -1, m_szMsgIniFile);
+            m_msgIni.GetString(szSectionName, L"face", L"", m_customMessage[n].szFace, ARRAYSIZE(m_customMessage[n].szFace));
+            m_customMessage[n].bBold = m_msgIni.GetInt(szSectionName, L"bold", -1);
+            m_customMessage[n].bItal = m_msgIni.GetInt(szSectionName, L"ital", -1);
+            m_customMessage[n].nColorR = m_msgIni.GetInt(szSectionName, L"r", -1);
+            m_customMessage[n].nColorG = m_msgIni.GetInt(szSectionName, L"g", -1);
+            m_customMessage[n].nColorB = m_msgIni.GetInt(szSectionName, L"b", -1);
 
             m_customMessage[n].bOverrideFace = (m_customMessage[n].szFace[0] != 0);
             m_customMessage[n].bOverrideBold = (m_customMessage[n].bBold != -1);
@@ -6692,22 +6477,22 @@ void CPlugin::LaunchSongTitleAnim()
     m_supertext.fStartTime = GetTime();
 }
 
-bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filename, const std::vector<uint8_t>& data)
+bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filename, const CImageBuffer& data, bool bReplaceAll)
 {
-    char initcode[8192], code[8192], sectionA[64];
+    char initcode[8192], code[8192];
     char szTemp[8192];
     wchar_t img[512], section[64];
 
+    m_imgIni.Refresh(m_szImgIniFile);
     initcode[0] = '\0';
     code[0] = '\0';
     img[0] = '\0';
     swprintf_s(section, L"img%02d", nSpriteNum);
-    sprintf_s(sectionA, "img%02d", nSpriteNum);
 
     // 1. Read in image filename.
     if (nSpriteNum >= 0 && nSpriteNum < 100)
     {
-        GetPrivateProfileString(section, L"img", L"", img, ARRAYSIZE(img) - 1, m_szImgIniFile);
+        m_imgIni.GetString(section, L"img", L"", img, ARRAYSIZE(img) - 1);
         if (img[0] == L'\0')
         {
             wchar_t buf[1024] = {0};
@@ -6730,7 +6515,7 @@ bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filena
         {
             wcsncpy_s(img, filename.c_str(), 512);
         }
-        else if (!data.empty())
+        else if (!data.IsEmpty())
         {
         }
         else
@@ -6741,14 +6526,14 @@ bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filena
     //UINT ck_lo = GetPrivateProfileInt(section, "colorkey_lo", 0x00000000, m_szImgIniFile);
     //UINT ck_hi = GetPrivateProfileInt(section, "colorkey_hi", 0x00202020, m_szImgIniFile);
     // FIRST try 'colorkey_lo' (for backwards compatibility) and then try 'colorkey'
-    UINT ck = GetPrivateProfileInt(section, L"colorkey_lo", 0x00000000, m_szImgIniFile);
-    ck = GetPrivateProfileInt(section, L"colorkey", ck, m_szImgIniFile);
+    UINT ck = static_cast<UINT>(m_imgIni.GetInt(section, L"colorkey_lo", 0x00000000));
+    ck = static_cast<UINT>(m_imgIni.GetInt(section, L"colorkey", static_cast<int>(ck)));
 
     // 3. Read in init code and per-frame code.
     for (int n = 0; n < 2; n++)
     {
         char* pStr = (n == 0) ? initcode : code;
-        char szLineName[32] = {0};
+        wchar_t szLineName[32] = {0};
         size_t len;
 
         int line = 1;
@@ -6758,11 +6543,11 @@ bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filena
         while (!bDone)
         {
             if (n == 0)
-                sprintf_s(szLineName, "init_%d", line);
+                swprintf_s(szLineName, L"init_%d", line);
             else
-                sprintf_s(szLineName, "code_%d", line);
+                swprintf_s(szLineName, L"code_%d", line);
 
-            GetPrivateProfileStringA(sectionA, szLineName, "~!@#$", szTemp, 8192, AutoChar(m_szImgIniFile));
+            m_imgIni.GetStringA(section, szLineName, "~!@#$", szTemp, 8192);
             len = strlen(szTemp);
 
             if ((strcmp(szTemp, "~!@#$") == 0) || // if the key was missing,
@@ -6781,9 +6566,69 @@ bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filena
         pStr[char_pos++] = '\0'; // null-terminate
     }
 
+    // 4. Decode anything but DDS files in the background; the sprite is
+    //    started by `FinishPendingSprites()` once its image is ready.
+    //    Images in memory that were decoded recently start right away.
+    const wchar_t* ext = wcsrchr(img, L'.');
+    bool bFile = (nSpriteNum >= 0 && nSpriteNum < 100) || !filename.empty();
+    std::shared_ptr<const td_decodedimage> cached = bFile ? nullptr : m_imageCache.Find(data.GetHash());
+    if (bReplaceAll)
+    {
+        for (auto it = m_pendingSprites.begin(); it != m_pendingSprites.end();)
+        {
+            if (it->second.bReplaceAll)
+            {
+                m_spriteDecoder.Cancel(it->first);
+                it = m_pendingSprites.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    if (!cached && (!bFile || !ext || _wcsicmp(ext, L".dds") != 0))
+    {
+        uint32_t nTicket = bFile ? m_spriteDecoder.Submit(img, false) : m_spriteDecoder.Submit(data, false);
+        m_pendingSprites[nTicket] = {nSpriteNum, nSlot, bReplaceAll, bFile ? img : L"album", initcode, code, ck, bFile ? 0 : data.GetHash()};
+        return true;
+    }
+
+    if (bReplaceAll)
+        KillAllSprites();
+    nSlot = PickSpriteSlot(nSlot);
+    int ret = cached ? m_texmgr.LoadTex(*cached, L"album", nSlot, initcode, code, GetTime(), GetFrame(), ck)
+                     : m_texmgr.LoadTex(img, nSlot, initcode, code, GetTime(), GetFrame(), ck);
+    m_texmgr.m_tex[nSlot].nUserData = nSpriteNum;
+    return ReportSpriteResult(nSpriteNum, ret);
+}
+
+void CPlugin::FinishPendingSprites()
+{
+    td_decodedimage image;
+    while (m_spriteDecoder.Poll(&image))
+    {
+        auto it = m_pendingSprites.find(image.nTicket);
+        if (it == m_pendingSprites.end())
+            continue;
+        td_pendingsprite sprite = std::move(it->second);
+        m_pendingSprites.erase(it);
+        auto decoded = std::make_shared<td_decodedimage>(std::move(image));
+        if (sprite.nHash && decoded->bOk)
+            m_imageCache.Insert(sprite.nHash, decoded);
+        if (sprite.bReplaceAll)
+            KillAllSprites();
+        int nSlot = PickSpriteSlot(sprite.nSlot);
+        int ret = m_texmgr.LoadTex(*decoded, sprite.szName.c_str(), nSlot, sprite.szInitCode.data(), sprite.szCode.data(), GetTime(), GetFrame(), sprite.ck);
+        m_texmgr.m_tex[nSlot].nUserData = sprite.nSpriteNum;
+        ReportSpriteResult(sprite.nSpriteNum, ret);
+    }
+}
+
+// Returns `nSlot`, or if it is -1, the first empty slot. If there is
+// none, chucks the oldest sprite and returns its slot.
+int CPlugin::PickSpriteSlot(int nSlot)
+{
     if (nSlot == -1)
     {
-        // Find first empty slot; if none, chuck the oldest sprite and take its slot.
         int oldest_index = 0;
         int oldest_frame = m_texmgr.m_tex[0].nStartFrame;
         for (int x = 0; x < NUM_TEX; x++)
@@ -6806,20 +6651,12 @@ bool CPlugin::LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filena
             m_texmgr.KillTex(nSlot);
         }
     }
+    return nSlot;
+}
 
-    int ret = -1;
-    if ((nSpriteNum >= 0 && nSpriteNum < 100) || !filename.empty())
-    {
-        ret = m_texmgr.LoadTex(img, nSlot, initcode, code, GetTime(), GetFrame(), ck);
-    }
-    else if (!data.empty())
-    {
-        ret = m_texmgr.LoadTex(data, nSlot, initcode, code, GetTime(), GetFrame(), ck);
-    }
-    else
-        return false;
-    m_texmgr.m_tex[nSlot].nUserData = nSpriteNum;
-
+// Shows any error or warning from `texmgr::LoadTex()`.
+bool CPlugin::ReportSpriteResult(int nSpriteNum, int ret)
+{
     wchar_t buf[1024] = {0};
     switch (ret & TEXMGR_ERROR_MASK)
     {
@@ -6870,6 +6707,16 @@ void CPlugin::KillSprite(int iSlot)
     m_texmgr.KillTex(iSlot);
 }
 
+// Kills all sprites, including those still being decoded.
+void CPlugin::KillAllSprites()
+{
+    for (const auto& pending : m_pendingSprites)
+        m_spriteDecoder.Cancel(pending.first);
+    m_pendingSprites.clear();
+    for (int x = 0; x < NUM_TEX; x++)
+        m_texmgr.KillTex(x);
+}
+
 void CPlugin::DoCustomSoundAnalysis()
 {
     std::copy(m_sound.fWaveform[0].begin(), m_sound.fWaveform[0].end(), mdsound.fWave[0].begin());
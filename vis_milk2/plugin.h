@@ -32,23 +32,27 @@
 #define __NULLSOFT_DX_PLUGIN_H__
 
 #include <list>
+#include <unordered_map>
 #include <vector>
 #include "md_defines.h"
 #include "pluginshell.h"
 #include "support.h"
 #include "texmgr.h"
 #include "state.h"
+#include "evaluator.h"
+#include "inifile.h"
+#include "presetcost.h"
+#include "noise.h"
+#include "texcache.h"
+#include "texcatalog.h"
 #include "menu.h"
 #include "constanttable.h"
+#include "warpmesh.h"
 #ifdef _FOOBAR
 #include <foo_vis_milk2/settings.h>
 #include <foo_vis_milk2/supertext.h>
 #endif
 
-int warand();
-
-#define FRAND ((warand() % 7381) / 7380.0f)
-
 static constexpr int FCGSX = 32; // final composite grid size - number vertices - should be EVEN.
 static constexpr int FCGSY = 24; // final composite grid size - number vertices - should be EVEN.
                                  // number of grid *cells* is two less,
@@ -59,7 +63,6 @@ static constexpr int PRESET_HIST_LEN = 64 + 2; // this is 2 more than the DESIRE
 // clang-format off
 typedef enum { TEX_DISK, TEX_VS, TEX_BLUR0, TEX_BLUR1, TEX_BLUR2, TEX_BLUR3, TEX_BLUR4, TEX_BLUR5, TEX_BLUR6, TEX_BLUR_LAST } tex_code;
 typedef enum { UI_REGULAR, UI_MENU, UI_LOAD, UI_LOAD_DEL, UI_LOAD_RENAME, UI_SAVEAS, UI_SAVE_OVERWRITE, UI_EDIT_MENU_STRING, UI_CHANGEDIR, UI_IMPORT_WAVE, UI_EXPORT_WAVE, UI_IMPORT_SHAPE, UI_EXPORT_SHAPE, UI_UPGRADE_PIXEL_SHADER, UI_MASHUP } ui_mode;
-typedef struct { float rad; float ang; float a; float c; } td_vertinfo; //blending: mix = std::max(0, std::min(1, a * t + c));
 // clang-format on
 
 typedef struct
@@ -162,16 +165,20 @@ typedef struct
     int nColorB;
 } td_supertext;
 
+// A sprite waiting for its image to be decoded.
 typedef struct
 {
-    wchar_t texname[256]; // ~filename, but without path or extension!
-    ID3D11Resource* texptr;
-    int w, h, d;
-    //D3DXHANDLE texsize_param;
-    bool bEvictable;
-    int nAge;         // only valid if bEvictable is true
-    int nSizeInBytes; // only valid if bEvictable is true
-} TexInfo;
+    int nSpriteNum;
+    int nSlot;
+    bool bReplaceAll; // kill all other sprites once it is up
+    std::wstring szName;
+    std::string szInitCode;
+    std::string szCode;
+    unsigned int ck;
+    uint64_t nHash; // of the encoded image, to cache the decoded one; 0 for files
+} td_pendingsprite;
+
+typedef td_cachedtex<ID3D11Resource*> TexInfo;
 
 typedef struct
 {
@@ -290,6 +297,7 @@ typedef struct
     std::wstring szFilename; // without path
     float fRatingThis;
     float fRatingCum;
+    td_presetcost cost; // zero unless the preset CPU budget is enabled
 } PresetInfo;
 typedef std::vector<PresetInfo> PresetList;
 
@@ -350,6 +358,9 @@ class CPlugin : public CPluginShell
     int m_nMaxPSVersion; // the minimum of the other two
     int m_nMaxImages;
     int m_nMaxBytes;
+    int m_nPresetCpuBudget; // estimated microseconds per frame; 0 = unlimited
+    bool m_bNoiseCache;     // keep generated noise textures on disk
+    int m_nAudioOffset;     // milliseconds added to the predicted display delay when fetching audio
 
     // PIXEL SHADERS
     UINT m_dwShaderFlags; // Shader compilation/linking flags
@@ -372,9 +383,15 @@ class CPlugin : public CPluginShell
     bool RecompileVShader(const char* szShadersText, VShaderInfo* si, int shaderType, bool bHardErrors);
     bool RecompilePShader(const char* szShadersText, PShaderInfo* si, int shaderType, bool bHardErrors, int PSVersion);
     bool EvictSomeTexture();
-    typedef std::vector<TexInfo> TexInfoList;
-    TexInfoList m_textures;
-    bool m_bNeedRescanTexturesDir;
+    void EvictTexturesOverBudget();
+    void PrefetchTextures(const CState* pState);
+    void CancelTexturePrefetch();
+    HRESULT LoadDiskTexture(const wchar_t* szFilename, ID3D11Resource** ppTexture);
+    CTextureCache<ID3D11Resource*> m_textures; // by name (~filename, but without path or extension!)
+    CNoiseCache m_noiseCache; // generated noise textures, kept across device re-creation
+    CImageDecodeQueue m_textureDecoder;                              // disk textures of the preset being loaded
+    std::unordered_map<std::wstring, uint32_t> m_prefetchedTextures; // decode ticket by filename
+    CTextureCatalog m_textureCatalog; // files in "textures\", for random textures
 
     // Input layouts.
     //ID3D11InputLayout* m_pMilkDropVertDecl;
@@ -466,6 +483,9 @@ class CPlugin : public CPluginShell
     bool m_bShowRating;
     bool m_bShowPresetInfo;
     bool m_bShowDebugInfo;
+#ifdef PROFILING
+    bool m_bShowProfiler;
+#endif
     bool m_bShowSongTitle;
     bool m_bShowSongTime;
     bool m_bShowSongLen;
@@ -497,6 +517,8 @@ class CPlugin : public CPluginShell
     wchar_t m_szMilkdrop2Path[MAX_PATH]; // ends in a backslash
     wchar_t m_szMsgIniFile[MAX_PATH];
     wchar_t m_szImgIniFile[MAX_PATH];
+    CIniFile m_msgIni; // contents of `m_szMsgIniFile`
+    CIniFile m_imgIni; // contents of `m_szImgIniFile`
     wchar_t m_szPresetDir[MAX_PATH];
 
     float m_fRandStart[4];
@@ -512,15 +534,21 @@ class CPlugin : public CPluginShell
     int m_nHighestBlurTexUsedThisFrame;
     ID3D11Texture2D* m_lpDDSTitle;
     int m_nTitleTexSizeX, m_nTitleTexSizeY;
-    MDVERTEX* m_verts;
+    CMeshStreams m_mesh; // warp mesh, shared by the warp, motion vector and composite passes
     MDVERTEX* m_verts_temp;
     td_vertinfo* m_vertinfo;
     int* m_indices_strip;
-    int* m_indices_list;
+    std::vector<uint16_t> m_indices_list; // warp mesh triangles, see `BuildWarpIndices()`
+    ID3D11Buffer* m_lpWarpIndices;        // and in a static index buffer
+    std::vector<MDVERTEX> m_warp_verts;   // `m_mesh` as drawn, with the seam copy
+    std::vector<uint16_t> m_cull_indices; // triangles left after culling tiles
+    CPresetEvaluator m_evaluator;
+    std::vector<WFVERTEX> m_mv_verts; // motion vector line list
 
     // Final composite grid.
     MDVERTEX m_comp_verts[FCGSX * FCGSY];
-    int m_comp_indices[(FCGSX - 2) * (FCGSY - 2) * 2 * 3];
+    uint16_t m_comp_indices[(FCGSX - 2) * (FCGSY - 2) * 2 * 3];
+    ID3D11Buffer* m_lpCompIndices;
 
     bool m_bHasFocus;
     bool m_bHadFocus;
@@ -534,6 +562,12 @@ class CPlugin : public CPluginShell
     td_custom_msg m_customMessage[MAX_CUSTOM_MESSAGES];
 
     texmgr m_texmgr; // for user sprites
+    // The sprite functions and `m_pendingSprites` belong to the thread that
+    // renders, or to whoever holds the lock it renders under; the UI posts
+    // album art launches and kills to the render thread.
+    CImageDecodeQueue m_spriteDecoder;
+    std::unordered_map<uint32_t, td_pendingsprite> m_pendingSprites; // by decode ticket
+    CImageCache m_imageCache;                                        // decoded album art
 
     td_supertext m_supertext; // **contains info about current Song Title or Custom Message.**
 #ifdef _SUPERTEXT
@@ -564,7 +598,7 @@ class CPlugin : public CPluginShell
     void ClearTooltip();
     void ClearText();
     void RandomizeBlendPattern();
-    void GenPlasma(int x0, int x1, int y0, int y1, float dt);
+    td_evalframe GetEvalFrame() const;
     void LoadPerFrameEvallibVars(CState* pState);
     void LoadCustomWavePerFrameEvallibVars(CState* pState, int i);
     void LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int instance);
@@ -574,6 +608,8 @@ class CPlugin : public CPluginShell
     bool PanelSettings(plugin_config* settings);
 #endif
     void LoadRandomPreset(float fBlendTime);
+    int PickRandomPresetWithinBudget() const;
+    std::vector<float> GetPresetCosts() const;
     void LoadPreset(const wchar_t* szPresetFilename, float fBlendTime);
     void LoadPresetTick();
     void SetPresetListPosition(std::wstring search);
@@ -585,10 +621,12 @@ class CPlugin : public CPluginShell
     void RenamePresetFile(wchar_t* szOldFile, wchar_t* szNewFile);
     void SetCurrentPresetRating(float fNewRating);
     void SeekToPreset(wchar_t cStartChar);
-    bool ReversePropagatePoint(float fx, float fy, float* fx2, float* fy2) const;
     void ClearGraphicsWindow(); // for windowed mode only
     void LaunchCustomMessage(int nMsgNum);
     void ReadCustomMessages();
+#ifdef PROFILING
+    void ExportProfile();
+#endif
     void LaunchSongTitleAnim();
 
     bool RenderStringToTitleTexture();
@@ -603,6 +641,7 @@ class CPlugin : public CPluginShell
     void WarpedBlit_NoShaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, bool bCullTiles, bool bFlipCulling);
     void ShowToUser_Shaders(int nPass, bool bAlphaBlend, bool bFlipAlpha, bool bCullTiles, bool bFlipCulling);
     void ShowToUser_NoShaders();
+    void DrawMesh(ID3D11Buffer* pIBuffer, const uint16_t* pIndices, size_t nIndices, const MDVERTEX* pVerts, size_t nVerts, bool bCullTiles, bool bFlipCulling);
     void BlurPasses();
     void GetSafeBlurMinMax(CState* pState, float* blur_min, float* blur_max);
     void RunPerFrameEquations(int code);
@@ -610,8 +649,12 @@ class CPlugin : public CPluginShell
     void MergeSortPresets(int left, int right);
     void BuildMenus();
     void SetMenusForPresetVersion(int WarpPSVersion, int CompPSVersion);
-    bool LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filename = L"", const std::vector<uint8_t>& vec = std::vector<uint8_t>());
+    bool LaunchSprite(int nSpriteNum, int nSlot, const std::wstring& filename = L"", const CImageBuffer& data = CImageBuffer(), bool bReplaceAll = false);
+    int PickSpriteSlot(int nSlot);
+    bool ReportSpriteResult(int nSpriteNum, int ret);
+    void FinishPendingSprites();
     void KillSprite(int iSlot);
+    void KillAllSprites();
     void DoCustomSoundAnalysis();
     void DrawMotionVectors();
 
@@ -682,6 +725,9 @@ class CPlugin : public CPluginShell
     TextElement m_presetRating;
     TextElement m_fpsDisplay;
     TextElement m_debugInfo;
+#ifdef PROFILING
+    TextElement m_profilerText[NUM_PROF_STAGES + 4]; // whole frame, stages, image cache, frame pacing, audio sync
+#endif
     TextElement m_toolTip;
     TextElement m_songTitle;
     TextElement m_songStats;
@@ -691,6 +737,8 @@ class CPlugin : public CPluginShell
     TextElement m_loadPresetDir;
     TextElement m_loadPresetItem[MAX_PRESETS_PER_PAGE];
     TextElement m_ddsTitle;
+    CDWriteTextMeasurer m_titleMeasurer;        // custom messages' styles, kept across launches
+    CFontFitCache m_titleFit{&m_titleMeasurer}; // and their sizes in the title texture
 };
 
 #endif
\ No newline at end of file
@@ -49,6 +49,56 @@
 extern wchar_t* g_szHelp;
 //extern winampVisModule mod1;
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Set up here rather than on first use, so reading the clock writes nothing
+// and is safe on any thread.
+CWin32PacerClock::CWin32PacerClock() : m_hTimer(CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS)), m_nFreq(GetQpcFrequency())
+{
+    if (!m_hTimer) // older Windows
+        m_hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+}
+
+CWin32PacerClock::~CWin32PacerClock()
+{
+    if (m_hTimer)
+        CloseHandle(m_hTimer);
+}
+
+int64_t CWin32PacerClock::GetQpcFrequency()
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return freq.QuadPart;
+}
+
+int64_t CWin32PacerClock::Now()
+{
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return FromQpc(t.QuadPart);
+}
+
+int64_t CWin32PacerClock::FromQpc(int64_t nCounter) const
+{
+    return nCounter / m_nFreq * 1000000000LL + nCounter % m_nFreq * 1000000000LL / m_nFreq;
+}
+
+void CWin32PacerClock::SleepUntil(int64_t nTime)
+{
+    int64_t nWait = nTime - Now();
+    if (nWait <= 0)
+        return;
+    LARGE_INTEGER due;
+    due.QuadPart = -(nWait / 100); // relative, in 100 ns units
+    if (m_hTimer && SetWaitableTimer(m_hTimer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(m_hTimer, INFINITE);
+    else
+        Sleep(static_cast<DWORD>(nWait / 1000000));
+}
+
 CPluginShell::CPluginShell() { /* This should remain empty! */ }
 CPluginShell::~CPluginShell() { /* This should remain empty! */ }
 
@@ -224,6 +274,7 @@ void CPluginShell::OnWindowSizeChanged(int width, int height)
 
 void CPluginShell::OnWindowSwap(HWND window, int width, int height)
 {
+    m_avsync.Reset(); // new swap chain
     if (!m_lpDX->OnWindowSwap(window, width, height))
         return;
 }
@@ -278,6 +329,8 @@ void CPluginShell::ToggleFullScreen()
     DXCONTEXT_PARAMS params{};
     StuffParams(&params);
 
+    m_avsync.Reset();
+    m_avsync.SetQueueDepth(static_cast<int>(params.back_buffer_count) - 1);
     if (!m_lpDX->StartOrRestartDevice(&params))
     {
         // Note: A basic warning message box will have already been given.
@@ -310,9 +363,55 @@ void CPluginShell::TogglePlaylist()
 {
     m_show_playlist = !m_show_playlist;
     m_playlist_top_idx = -1; // <- invalidates playlist cache
+    m_playlist_pos_sent = -1;
     //int ret = CheckMenuItem(m_context_menu, ID_SHOWPLAYLIST, MF_BYCOMMAND | (m_show_playlist ? MF_CHECKED : MF_UNCHECKED));
 }
 
+void CPluginShell::PublishPlayState(td_playstate& state)
+{
+    state.nTime = GetPlayStateTime();
+    m_playState.Publish(state);
+}
+
+// Reads the performance counter directly, so the host's thread never
+// touches the render thread's pacer clock.
+int64_t CPluginShell::GetPlayStateTime()
+{
+    LARGE_INTEGER t, freq;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&freq);
+    return t.QuadPart / freq.QuadPart * 1000000000LL + t.QuadPart % freq.QuadPart * 1000000000LL / freq.QuadPart;
+}
+
+// Once the host publishes its playback state, reading it never waits on
+// the host's UI thread, unlike the IPC round trip it replaces.
+void CPluginShell::GetSongTitle(wchar_t* szSongTitle, size_t nSize)
+{
+    td_playstate state;
+    if (m_playState.Read(state))
+        wcsncpy_s(szSongTitle, nSize, state.szTitle, _TRUNCATE);
+    else
+        GetWinampSongTitle(m_hWndWinamp, szSongTitle, nSize);
+}
+
+void CPluginShell::GetSongPosAsText(wchar_t* szSongPos)
+{
+    td_playstate state;
+    if (m_playState.Read(state))
+        SongPosToText(llround(GetPlayPosition(state, GetPlayStateTime()) * 1000.0), szSongPos);
+    else
+        GetWinampSongPosAsText(m_hWndWinamp, szSongPos);
+}
+
+void CPluginShell::GetSongLenAsText(wchar_t* szSongLen)
+{
+    td_playstate state;
+    if (m_playState.Read(state))
+        SongLenToText(state.bPlaying ? llround(state.fLength * 1000.0) : -1, szSongLen);
+    else
+        GetWinampSongLenAsText(m_hWndWinamp, szSongLen);
+}
+
 int CPluginShell::InitDirectX()
 {
     DXCONTEXT_PARAMS params{};
@@ -334,6 +433,8 @@ int CPluginShell::InitDirectX()
     }
 
     m_lpDX->GetDeviceResources()->RegisterDeviceNotify(this);
+    m_avsync.Reset();
+    m_avsync.SetQueueDepth(static_cast<int>(params.back_buffer_count) - 1);
 
     // Initialize graphics.
     if (!m_lpDX->StartOrRestartDevice(&params))
@@ -518,6 +619,7 @@ int CPluginShell::PluginPreInitialize(HWND hWinampWnd, HINSTANCE hWinampInstance
     m_playlist_pageups = 0;
     m_playlist_top_idx = -1; // `m_playlist_width_pixels` and `m_playlist[256][256]` will be considered invalid whenever `m_playlist_top_idx` is -1.
     m_playlist_btm_idx = -1;
+    m_playlist_pos_sent = -1;
     m_exiting = 0;
     m_upper_left_corner_y = 0;
     m_lower_left_corner_y = 0;
@@ -544,7 +646,7 @@ int CPluginShell::PluginPreInitialize(HWND hWinampWnd, HINSTANCE hWinampInstance
     {
         throw std::exception(); //m_high_perf_timer_freq.QuadPart = 0;
     }
-    m_prev_end_of_frame.QuadPart = 0;
+    m_pacer.Reset();
 
     // PRIVATE AUDIO PROCESSING DATA
     memset(m_oldwave[0], 0, sizeof(float) * NUM_AUDIO_BUFFER_SAMPLES);
@@ -781,6 +883,20 @@ int CPluginShell::PluginRender(float* pWaveL, float* pWaveR)
 #endif
 {
     // Return `FALSE' here to tell Winamp to terminate the plugin.
+    if (!PluginDrawFrame(pWaveL, pWaveR))
+        return false; // EXIT THE PLUGIN
+    PluginWaitFrame();
+    return true;
+}
+
+// Draws and shows a frame without waiting for the frame rate limit, so
+// that the caller can wait without holding its locks.
+#ifndef _FOOBAR
+int CPluginShell::PluginDrawFrame(unsigned char* pWaveL, unsigned char* pWaveR)
+#else
+int CPluginShell::PluginDrawFrame(float* pWaveL, float* pWaveR)
+#endif
+{
     if (!m_lpDX || !m_lpDX->m_ready)
     {
         // Note: 'm_ready' will go false when a device reset fatally fails
@@ -831,18 +947,33 @@ int CPluginShell::PluginRender(float* pWaveL, float* pWaveR)
     */
 
     DoTime();
-    AnalyzeNewSound(pWaveL, pWaveR);
-    AlignWaves();
+    PROFILE_FRAME_BEGIN(m_profiler, m_frame);
+    {
+        PROFILE_SCOPE(m_profiler, PROF_ANALYZE_NEW_SOUND);
+        AnalyzeNewSound(pWaveL, pWaveR);
+    }
+    {
+        PROFILE_SCOPE(m_profiler, PROF_ALIGN_WAVES);
+        AlignWaves();
+    }
 
     DrawAndDisplay(0);
 
-    EnforceMaxFPS();
-
     m_frame++;
 
     return true;
 }
 
+// Waits until the next frame should start, then closes the frame's profile.
+void CPluginShell::PluginWaitFrame()
+{
+    {
+        PROFILE_SCOPE(m_profiler, PROF_ENFORCE_MAX_FPS);
+        EnforceMaxFPS();
+    }
+    PROFILE_FRAME_END(m_profiler);
+}
+
 void CPluginShell::DrawAndDisplay(int redraw)
 {
     int cx = m_lpDX->m_client_width;
@@ -860,8 +991,30 @@ void CPluginShell::DrawAndDisplay(int redraw)
     RenderBuiltInTextMsgs();
     MilkDropRenderUI(&m_upper_left_corner_y, &m_upper_right_corner_y, &m_lower_left_corner_y, &m_lower_right_corner_y, m_left_edge, m_right_edge);
     RenderPlaylist();
-    m_text.DrawNow();
+    {
+        PROFILE_SCOPE(m_profiler, PROF_TEXT_DRAW_NOW);
+        m_text.DrawNow();
+    }
     m_lpDX->Show();
+    m_lpDX->m_lpDevice->EndFrame();
+    UpdateAudioSync();
+}
+
+double CPluginShell::BeginAudioFetch()
+{
+    return static_cast<double>(m_avsync.BeginFrame(m_pacerClock.Now())) * 1e-9;
+}
+
+// Tells the audio sync estimator which frame was just presented and which
+// one the display showed last, if the swap chain reports it.
+void CPluginShell::UpdateAudioSync()
+{
+    DXGI_FRAME_STATISTICS stats;
+    if (m_lpDX->GetFrameStatistics(stats))
+        m_avsync.OnDisplayed(stats.PresentCount, stats.SyncRefreshCount, m_pacerClock.FromQpc(stats.SyncQPCTime.QuadPart));
+    UINT nPresentCount;
+    if (m_lpDX->GetLastPresentCount(nPresentCount))
+        m_avsync.EndFrame(m_pacerClock.Now(), nPresentCount);
 }
 
 void CPluginShell::EnforceMaxFPS()
@@ -873,105 +1026,12 @@ void CPluginShell::EnforceMaxFPS()
         case FULLSCREEN: max_fps = m_max_fps_fs; break;
     }
 
-    if (max_fps <= 0)
-        return;
-
-    float fps_lo = (float)max_fps;
-    float fps_hi = (float)max_fps;
-
-    // Find the optimal lo/hi bounds for the fps
-    // that will result in a maximum difference,
-    // in the time for a single frame, of 0.003 seconds -
-    // the assumed granularity for Sleep(1) -
-    //
-    // Using this range of acceptable fps
-    // will allow us to do (sloppy) fps limiting
-    // using only Sleep(1), and never the
-    // second half of it: Sleep(0) in a tight loop,
-    // which sucks up the CPU (whereas Sleep(1)
-    // leaves it idle).
-    //
-    // The original equation:
-    //   1 / (max_fps * t1) = 1 / (max_fps / t1) - 0.003
-    // where:
-    //   t1 > 0
-    //   max_fps * t1 is the upper range for fps
-    //   max_fps / t1 is the lower range for fps
-    if (m_save_cpu)
-    {
-        float a = 1;
-        float b = -0.003f * max_fps;
-        float c = -1.0f;
-        float det = b * b - 4 * a * c;
-        if (det > 0)
-        {
-            float t1 = (-b + sqrtf(det)) / (2 * a);
-            //float t2 = (-b - sqrtf(det)) / (2 * a);
-
-            if (t1 > 1.0f)
-            {
-                fps_lo = max_fps / t1;
-                fps_hi = max_fps * t1;
-                // Verify: Now [1.0f / fps_lo - 1.0f / fps_hi] should equal 0.003 seconds.
-                // Note: Allowing tolerance to go beyond these values for `fps_lo` and `fps_hi` would gain nothing.
-            }
-        }
-    }
-
-    if (m_high_perf_timer_freq.QuadPart > 0)
-    {
-        LARGE_INTEGER t;
-        QueryPerformanceCounter(&t);
-
-        if (m_prev_end_of_frame.QuadPart != 0)
-        {
-            int ticks_to_wait_lo = (int)((float)m_high_perf_timer_freq.QuadPart / (float)fps_hi);
-            int ticks_to_wait_hi = (int)((float)m_high_perf_timer_freq.QuadPart / (float)fps_lo);
-            int done = 0;
-            //int loops = 0;
-            do
-            {
-                QueryPerformanceCounter(&t);
-
-                __int64 t2 = t.QuadPart - m_prev_end_of_frame.QuadPart;
-                if (t2 > 2147483000)
-                    done = 1;
-                if (t.QuadPart < m_prev_end_of_frame.QuadPart) // time wrap
-                    done = 1;
-
-                // This is sloppy - if your freq. is high, this can overflow (to a (-) int) in just a few minutes
-                // but it's ok, we have protection for that above.
-                int ticks_passed = (int)(t.QuadPart - m_prev_end_of_frame.QuadPart);
-                if (ticks_passed >= ticks_to_wait_lo)
-                    done = 1;
-
-                if (!done)
-                {
-                    // if > 0.01s left, do Sleep(1), which will actually sleep some
-                    //   steady amount of up to 3 ms (depending on the OS),
-                    //   and do so in a nice way (cpu meter drops; laptop battery spared).
-                    // otherwise, do a few Sleep(0)'s, which just give up the timeslice,
-                    //   but don't really save cpu or battery, but do pass a tiny
-                    //   amount of time.
-
-                    //if (ticks_left > (int)m_high_perf_timer_freq.QuadPart / 500)
-                    if (ticks_to_wait_hi - ticks_passed > (int)m_high_perf_timer_freq.QuadPart / 100)
-                        Sleep(5);
-                    else if (ticks_to_wait_hi - ticks_passed > (int)m_high_perf_timer_freq.QuadPart / 1000)
-                        Sleep(1);
-                    else
-                        for (int i = 0; i < 10; i++)
-                            Sleep(0); // causes thread to give up its timeslice
-                }
-            } while (!done);
-        }
-
-        m_prev_end_of_frame = t;
-    }
-    else
-    {
-        Sleep(1000 / max_fps);
-    }
+    // With `m_save_cpu`, only sleep, which can run up to a millisecond
+    // late; otherwise, poll the clock for the last stretch before the
+    // frame starts.
+    m_pacer.SetMaxFps(max_fps);
+    m_pacer.SetSaveCpu(m_save_cpu != 0);
+    m_pacer.EndFrame();
 }
 
 void CPluginShell::DoTime()
@@ -1369,9 +1429,19 @@ void CPluginShell::RenderPlaylist()
     if (m_show_playlist)
     {
         D2D1_RECT_F r;
-        DWORD_PTR pSongs = NULL, p_now_playing = NULL;
-        SendMessageTimeout(m_hWndWinamp, WM_USER, 0, IPC_GETLISTLENGTH, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &pSongs); int nSongs = static_cast<int>(pSongs);
-        SendMessageTimeout(m_hWndWinamp, WM_USER, 0, IPC_GETLISTPOS, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &p_now_playing); int now_playing = static_cast<int>(p_now_playing);
+        int nSongs = 0, now_playing = -1;
+        td_playstate state;
+        if (m_playState.Read(state))
+        {
+            nSongs = state.nListLength;
+            now_playing = state.nListPos;
+        }
+        else
+        {
+            DWORD_PTR pSongs = NULL, p_now_playing = NULL;
+            SendMessageTimeout(m_hWndWinamp, WM_USER, 0, IPC_GETLISTLENGTH, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &pSongs); nSongs = static_cast<int>(pSongs);
+            SendMessageTimeout(m_hWndWinamp, WM_USER, 0, IPC_GETLISTPOS, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &p_now_playing); now_playing = static_cast<int>(p_now_playing);
+        }
         DWORD dwFlags = DT_SINGLELINE; //| DT_NOPREFIX | DT_WORD_ELLIPSIS; // Note: `dwFlags` is used for both DDRAW and DX9
         int nFontHeight = GetFontHeight(PLAYLIST_FONT);
         if (nSongs <= 0)
@@ -1397,7 +1467,11 @@ void CPluginShell::RenderPlaylist()
                 m_playlist_pos = nSongs - 1;
 
 #ifdef _FOOBAR
-            SendMessageTimeout(m_hWndWinamp, WM_USER, m_playlist_pos, IPC_SETPLAYLISTPOS, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, NULL);
+            if (m_playlist_pos != m_playlist_pos_sent)
+            {
+                SendMessageTimeout(m_hWndWinamp, WM_USER, m_playlist_pos, IPC_SETPLAYLISTPOS, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, NULL);
+                m_playlist_pos_sent = m_playlist_pos;
+            }
 #endif
 
             int cur_page = static_cast<int>(m_playlist_pos / disp_lines);
@@ -36,6 +36,10 @@
 #include "defines.h"
 #include "shell_defines.h"
 #include "fft.h"
+#include "profiler.h"
+#include "framepacer.h"
+#include "avsync.h"
+#include "playstate.h"
 #include "dxcontext.h"
 #include "d3d11shim.h"
 #include "textmgr.h"
@@ -63,6 +67,29 @@ typedef struct
     std::array<std::vector<float>, 2> fSpectrum; // NUM_FREQUENCIES samples for each channel
 } td_soundinfo; // ...range is 0 Hz to 22050 Hz, evenly spaced.
 
+// `QueryPerformanceCounter()` and a high-resolution waitable timer, where
+// available (Windows 10, version 1803 and later).
+class CWin32PacerClock : public CPacerClock
+{
+  public:
+    CWin32PacerClock();
+    ~CWin32PacerClock() override;
+    CWin32PacerClock(const CWin32PacerClock&) = delete;
+    CWin32PacerClock& operator=(const CWin32PacerClock&) = delete;
+
+    int64_t Now() override;
+    void SleepUntil(int64_t nTime) override; // render thread only
+
+    // Converts a performance counter value to the time of `Now()`.
+    int64_t FromQpc(int64_t nCounter) const;
+
+  private:
+    static int64_t GetQpcFrequency();
+
+    HANDLE m_hTimer;
+    const int64_t m_nFreq;
+};
+
 class CPluginShell : public DX::IDeviceNotify
 {
   public:
@@ -73,9 +100,12 @@ class CPluginShell : public DX::IDeviceNotify
     int PluginInitialize(int iWidth, int iHeight);
 #ifndef _FOOBAR
     int PluginRender(unsigned char* pWaveL, unsigned char* pWaveR);
+    int PluginDrawFrame(unsigned char* pWaveL, unsigned char* pWaveR);
 #else
     int PluginRender(float* pWaveL, float* pWaveR);
+    int PluginDrawFrame(float* pWaveL, float* pWaveR);
 #endif
+    void PluginWaitFrame();
     void PluginQuit();
     void OnWindowSizeChanged(int width, int height);
     void OnWindowSwap(HWND window, int width, int height);
@@ -85,6 +115,7 @@ class CPluginShell : public DX::IDeviceNotify
     void ToggleFullScreen();
     void ToggleHelp();
     void TogglePlaylist();
+    void PublishPlayState(td_playstate& state); // called by the host, from one thread at a time, when the playback changes; stamps the time
 
     void ReadFont(const int n);
     void WriteFont(const int n);
@@ -100,6 +131,7 @@ class CPluginShell : public DX::IDeviceNotify
     HINSTANCE GetInstance() const; // returns handle to the plugin DLL module; used for things like loading resources (dialogs, bitmaps, icons...) that are built into the plugin.
     wchar_t* GetPluginsDirPath(); // usually returns 'c:\\program files\\winamp\\plugins\\'
     wchar_t* GetConfigIniFile(); // usually returns 'c:\\program files\\winamp\\plugins\\something.ini' - filename is determined from identifiers in "defines.h"
+    double BeginAudioFetch(); // call when fetching the audio of a frame; returns how many seconds later the frame will be shown, so that the audio heard then can be fetched
 
     // FONTS & TEXT
     // ------------------------------------------------------------
@@ -141,6 +173,19 @@ class CPluginShell : public DX::IDeviceNotify
     // MISCELLANEOUS
     // ------------------------------------------------------------
     td_soundinfo m_sound; // a structure always containing the most recent sound analysis information; defined in "pluginshell.h".
+#ifdef PROFILING
+    CFrameProfiler m_profiler; // per-frame stage timings; see "profiler.h"
+#endif
+    CWin32PacerClock m_pacerClock;
+    CFramePacer m_pacer{&m_pacerClock}; // frame rate limiting; see "framepacer.h"
+    CAudioSyncEstimator m_avsync;       // display time of the frame being rendered; see "avsync.h"
+    CPlayStateBlock m_playState;        // playback state published by the host; see "playstate.h"
+
+    // The playback state the host published, or Winamp's, over IPC, until it does.
+    void GetSongTitle(wchar_t* szSongTitle, size_t nSize);
+    void GetSongPosAsText(wchar_t* szSongPos);
+    void GetSongLenAsText(wchar_t* szSongLen);
+    static int64_t GetPlayStateTime(); // clock of `td_playstate::nTime`; any thread, unlike `m_pacerClock`
 
     // CONFIG PANEL SETTINGS
     // ------------------------------------------------------------
@@ -191,6 +236,7 @@ class CPluginShell : public DX::IDeviceNotify
     int m_playlist_pageups; // can be + or -
     int m_playlist_top_idx; // used to track when the playlist cache (`m_playlist`) needs updating
     int m_playlist_btm_idx; // used to track when the playlist cache (`m_playlist`) needs updating
+    LRESULT m_playlist_pos_sent; // selection last sent to Winamp; -1 to send it again
     int m_exiting;
 
   private:
@@ -241,7 +287,6 @@ class CPluginShell : public DX::IDeviceNotify
 
     float m_time_hist[TIME_HIST_SLOTS]; // cumulative
     int m_time_hist_pos;
-    LARGE_INTEGER m_prev_end_of_frame;
 
     // PRIVATE AUDIO PROCESSING DATA
     FFT m_fftobj{NUM_AUDIO_BUFFER_SAMPLES, NUM_FREQUENCIES};
@@ -279,6 +324,7 @@ class CPluginShell : public DX::IDeviceNotify
   protected:
     void RenderPlaylist();
     void EnforceMaxFPS();
+    void UpdateAudioSync();
 
   private:
     void OnDeviceLost() override;
@@ -0,0 +1,190 @@
+/*
+ * presetcost.cpp - Static preset cost model.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "presetcost.h"
+#include "md_defines.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Rough weights, in microseconds. Expression code is interpreted, so its
+// cost grows with the length of the source; the rest are fixed overheads
+// per evaluation.
+static constexpr float COST_PER_CODE_BYTE = 0.002f;  // one evaluation of one byte of EEL source
+static constexpr float COST_PER_VERTEX = 0.1f;       // built-in warp math, per mesh vertex
+static constexpr float COST_PER_WAVE_SAMPLE = 0.05f; // smoothing and vertex output, per custom wave sample
+static constexpr float COST_PER_SHAPE = 1.0f;        // variable setup and fan output, per shape instance
+static constexpr float COST_MEGABUF = 200.0f;        // page faults and cache misses of the shared buffers
+static constexpr float COST_PER_SHADER_BYTE = 0.01f; // shader compilation, amortized over the first second
+
+typedef struct
+{
+    bool bEnabled;
+    int nCount; // samples for waves, instances for shapes
+    size_t nPerFrameBytes;
+    size_t nPerPointBytes;
+} td_customcode;
+
+// Returns the index after `prefix` in `key` (for example 2 for "wave_2_..."),
+// and sets `rest` to the text after the separating '_'; -1 if `key` does not match.
+static int ParseIndexedKey(const char* key, const char* prefix, const char** rest)
+{
+    size_t len = strlen(prefix);
+    if (strncmp(key, prefix, len) != 0 || key[len] < '0' || key[len] > '9')
+        return -1;
+    char* end = nullptr;
+    long i = strtol(key + len, &end, 10);
+    if (*end != '_')
+        return -1;
+    *rest = end + 1;
+    return static_cast<int>(i);
+}
+
+td_presetcost EstimatePresetCost(const char* szText, size_t nLen)
+{
+    size_t nPerFrameBytes = 0;
+    size_t nPerPixelBytes = 0;
+    size_t nShaderBytes = 0;
+    bool bMegabuf = false;
+    td_customcode waves[MAX_CUSTOM_WAVES] = {};
+    td_customcode shapes[MAX_CUSTOM_SHAPES] = {};
+    for (auto& w : waves)
+        w.nCount = 512;
+    for (auto& s : shapes)
+        s.nCount = 1;
+
+    const char* p = szText;
+    const char* end = szText + nLen;
+    char key[64];
+    while (p < end)
+    {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol)
+            eol = end;
+        const char* eq = static_cast<const char*>(memchr(p, '=', static_cast<size_t>(eol - p)));
+        if (eq && static_cast<size_t>(eq - p) < sizeof(key))
+        {
+            memcpy(key, p, static_cast<size_t>(eq - p));
+            key[eq - p] = '\0';
+            const char* val = eq + 1;
+            size_t nValLen = static_cast<size_t>(eol - val);
+            bool bCode = true;
+
+            const char* rest = nullptr;
+            int i;
+            if (!strncmp(key, "per_frame_init_", 15))
+            {
+                // Runs once, when the preset is loaded.
+            }
+            else if (!strncmp(key, "per_frame_", 10))
+                nPerFrameBytes += nValLen;
+            else if (!strncmp(key, "per_pixel_", 10))
+                nPerPixelBytes += nValLen;
+            else if (!strncmp(key, "warp_", 5) || !strncmp(key, "comp_", 5))
+            {
+                nShaderBytes += nValLen;
+                bCode = false;
+            }
+            else if ((i = ParseIndexedKey(key, "wavecode_", &rest)) >= 0 && i < MAX_CUSTOM_WAVES)
+            {
+                if (!strcmp(rest, "enabled"))
+                    waves[i].bEnabled = atoi(val) != 0;
+                else if (!strcmp(rest, "samples"))
+                    waves[i].nCount = std::clamp(atoi(val), 0, 512);
+                bCode = false;
+            }
+            else if ((i = ParseIndexedKey(key, "wave_", &rest)) >= 0 && i < MAX_CUSTOM_WAVES)
+            {
+                if (!strncmp(rest, "per_frame", 9))
+                    waves[i].nPerFrameBytes += nValLen;
+                else if (!strncmp(rest, "per_point", 9))
+                    waves[i].nPerPointBytes += nValLen;
+            }
+            else if ((i = ParseIndexedKey(key, "shapecode_", &rest)) >= 0 && i < MAX_CUSTOM_SHAPES)
+            {
+                if (!strcmp(rest, "enabled"))
+                    shapes[i].bEnabled = atoi(val) != 0;
+                else if (!strcmp(rest, "num_inst"))
+                    shapes[i].nCount = std::clamp(atoi(val), 1, 1024);
+                bCode = false;
+            }
+            else if ((i = ParseIndexedKey(key, "shape_", &rest)) >= 0 && i < MAX_CUSTOM_SHAPES)
+            {
+                if (!strncmp(rest, "per_frame", 9))
+                    shapes[i].nPerFrameBytes += nValLen;
+            }
+            else
+                bCode = false;
+
+            // Matches `gmegabuf(` too.
+            if (bCode && !bMegabuf && nValLen >= 8)
+                for (const char* s = val; s + 8 <= eol && !bMegabuf; s++)
+                    bMegabuf = (strncmp(s, "megabuf(", 8) == 0);
+        }
+        p = eol + 1;
+    }
+
+    auto code = [](size_t nBytes) { return static_cast<float>(nBytes) * COST_PER_CODE_BYTE; };
+    td_presetcost cost;
+    cost.fPerFrame = code(nPerFrameBytes) + static_cast<float>(nShaderBytes) * COST_PER_SHADER_BYTE;
+    cost.fPerVertex = COST_PER_VERTEX + code(nPerPixelBytes);
+    for (const auto& w : waves)
+        if (w.bEnabled)
+            cost.fPerFrame += code(w.nPerFrameBytes) + static_cast<float>(w.nCount) * (COST_PER_WAVE_SAMPLE + code(w.nPerPointBytes));
+    for (const auto& s : shapes)
+        if (s.bEnabled)
+            cost.fPerFrame += static_cast<float>(s.nCount) * (COST_PER_SHAPE + code(s.nPerFrameBytes));
+    if (bMegabuf)
+        cost.fPerFrame += COST_MEGABUF;
+    return cost;
+}
+
+float GetBudgetWeight(float fCost, float fBudget)
+{
+    if (fBudget <= 0.0f || fCost <= fBudget)
+        return 1.0f;
+    if (fCost > 2.0f * fBudget)
+        return 0.0f;
+    return (fBudget / fCost) * (fBudget / fCost);
+}
+
+int PickPresetWithinBudget(const float* pCosts, const float* pWeights, size_t nCount, float fBudget, float fRandom)
+{
+    std::vector<float> cdf(nCount);
+    for (const float* pW : {pWeights, static_cast<const float*>(nullptr)})
+    {
+        float fTotal = 0.0f;
+        for (size_t i = 0; i < nCount; i++)
+        {
+            fTotal += (pW ? pW[i] : 1.0f) * GetBudgetWeight(pCosts[i], fBudget);
+            cdf[i] = fTotal;
+        }
+        if (fTotal > 0.0f)
+        {
+            // Below the total, so that the preset found has a weight.
+            float fPos = std::min(fRandom * fTotal, std::nextafter(fTotal, 0.0f));
+            return static_cast<int>(std::upper_bound(cdf.begin(), cdf.end(), fPos) - cdf.begin());
+        }
+        if (!pW)
+            break;
+    }
+    return -1;
+}
+
+size_t NextPresetWithinBudget(const float* pCosts, size_t nCount, size_t nCurrent, float fBudget)
+{
+    for (size_t k = 1; k <= nCount; k++)
+    {
+        size_t i = (nCurrent + k) % nCount;
+        if (GetBudgetWeight(pCosts[i], fBudget) > 0.0f)
+            return i;
+    }
+    return (nCurrent + 1) % nCount;
+}
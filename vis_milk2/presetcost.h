@@ -0,0 +1,49 @@
+/*
+ * presetcost.h - Static preset cost model header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+
+// Estimated CPU time a preset needs each frame, in microseconds, split into
+// a part that does not depend on the mesh and a part paid once per mesh vertex.
+typedef struct
+{
+    float fPerFrame;
+    float fPerVertex;
+} td_presetcost;
+
+// Estimates the cost of a preset from the text of its `.milk` file, without
+// compiling it. The model looks at the size of the per-frame and per-pixel
+// code, the enabled custom waves (times their sample counts) and shapes
+// (times their instance counts), `megabuf` use and the shader length.
+// It is only meant to rank presets against each other and against a budget.
+td_presetcost EstimatePresetCost(const char* szText, size_t nLen);
+
+// Total estimated microseconds per frame on a `nGridX` x `nGridY` mesh.
+inline float GetPresetCost(const td_presetcost& cost, int nGridX, int nGridY)
+{
+    return cost.fPerFrame + cost.fPerVertex * static_cast<float>((nGridX + 1) * (nGridY + 1));
+}
+
+// How much a preset costing `fCost` is weighted down under `fBudget`, both
+// in estimated microseconds per frame: 1 within the budget, falling with
+// the square of the overshoot above it, and 0 over twice the budget. A
+// budget of 0 is unlimited.
+float GetBudgetWeight(float fCost, float fBudget);
+
+// Picks one of `nCount` presets at random, in proportion to its weight in
+// `pWeights` (all 1 if `nullptr`) times its budget weight, where `fRandom`
+// is in [0, 1). If no preset both fits the budget and has a weight, for
+// example when all ratings are 0, the weights are ignored. Returns -1 if
+// every preset is over twice the budget.
+int PickPresetWithinBudget(const float* pCosts, const float* pWeights, size_t nCount, float fBudget, float fRandom);
+
+// Returns the first of `nCount` presets after `nCurrent`, wrapping around,
+// that is not over twice the budget, or the one right after `nCurrent` if
+// none is.
+size_t NextPresetWithinBudget(const float* pCosts, size_t nCount, size_t nCurrent, float fBudget);
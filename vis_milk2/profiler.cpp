@@ -0,0 +1,176 @@
+/*
+ * profiler.cpp - Per-frame stage profiler.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static_assert((CFrameProfiler::NUM_FRAMES & (CFrameProfiler::NUM_FRAMES - 1)) == 0, "NUM_FRAMES must be a power of 2");
+
+static const char* s_szStageNames[NUM_PROF_STAGES] = {
+    "AnalyzeNewSound",
+    "AlignWaves",
+    "RunPerFrameEquations",
+    "ComputeGridAlphaValues",
+    "DrawCustomShapes",
+    "DrawCustomWaves",
+    "BlurPasses",
+    "ShowToUser",
+    "CTextManager::DrawNow",
+    "EnforceMaxFPS",
+};
+
+CFrameProfiler::CFrameProfiler() : m_epoch(std::chrono::steady_clock::now()), m_current{}, m_bInFrame(false), m_ring{}, m_nPublished(0)
+{
+    for (auto& s : m_seq)
+        s.store(0, std::memory_order_relaxed);
+    std::fill(std::begin(m_nOpen), std::end(m_nOpen), -1);
+}
+
+int64_t CFrameProfiler::Now() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+const char* CFrameProfiler::GetStageName(int stage)
+{
+    return (stage >= 0 && stage < NUM_PROF_STAGES) ? s_szStageNames[stage] : "Frame";
+}
+
+void CFrameProfiler::BeginFrame(uint32_t nFrame)
+{
+    m_current.nFrame = nFrame;
+    m_current.nFrameStart = Now();
+    m_current.nFrameEnd = -1;
+    for (int i = 0; i < NUM_PROF_STAGES; i++)
+    {
+        m_current.nStageStart[i] = -1;
+        m_current.nStageTime[i] = 0;
+        m_nOpen[i] = -1;
+    }
+    m_bInFrame = true;
+}
+
+void CFrameProfiler::BeginStage(ProfileStage stage)
+{
+    if (!m_bInFrame)
+        return;
+    int64_t t = Now();
+    m_nOpen[stage] = t;
+    if (m_current.nStageStart[stage] < 0)
+        m_current.nStageStart[stage] = t;
+}
+
+void CFrameProfiler::EndStage(ProfileStage stage)
+{
+    if (!m_bInFrame || m_nOpen[stage] < 0)
+        return;
+    m_current.nStageTime[stage] += Now() - m_nOpen[stage];
+    m_nOpen[stage] = -1;
+}
+
+void CFrameProfiler::EndFrame()
+{
+    if (!m_bInFrame)
+        return;
+    m_bInFrame = false;
+    m_current.nFrameEnd = Now();
+
+    // Sequence lock: odd while writing, even once the record is complete.
+    // The value also says which publication the slot holds, so a reader
+    // that was lapped by the writer does not take a newer frame for an
+    // older one.
+    uint64_t n = m_nPublished.load(std::memory_order_relaxed);
+    size_t slot = static_cast<size_t>(n) & (NUM_FRAMES - 1);
+    uint32_t seq = static_cast<uint32_t>(n) * 2;
+    m_seq[slot].store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_ring[slot] = m_current;
+    m_seq[slot].store(seq + 2, std::memory_order_release);
+    m_nPublished.store(n + 1, std::memory_order_release);
+}
+
+size_t CFrameProfiler::Snapshot(td_framerecord* pOut, size_t nMax) const
+{
+    uint64_t nEnd = m_nPublished.load(std::memory_order_acquire);
+    uint64_t nCount = std::min<uint64_t>({nEnd, static_cast<uint64_t>(NUM_FRAMES), static_cast<uint64_t>(nMax)});
+    size_t nCopied = 0;
+    for (uint64_t n = nEnd - nCount; n < nEnd; n++)
+    {
+        size_t slot = static_cast<size_t>(n) & (NUM_FRAMES - 1);
+        uint32_t seq = static_cast<uint32_t>(n) * 2 + 2;
+        if (m_seq[slot].load(std::memory_order_acquire) != seq)
+            continue; // being written, or already holds a newer frame
+        td_framerecord rec = m_ring[slot];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_seq[slot].load(std::memory_order_relaxed) != seq)
+            continue; // overwritten while copying
+        pOut[nCopied++] = rec;
+    }
+    return nCopied;
+}
+
+void CFrameProfiler::GetStats(td_profilestats& stats) const
+{
+    std::vector<td_framerecord> frames(NUM_FRAMES);
+    frames.resize(Snapshot(frames.data(), frames.size()));
+    stats.nFrames = frames.size();
+
+    std::vector<float> ms(frames.size());
+    for (int stage = 0; stage <= NUM_PROF_STAGES; stage++)
+    {
+        if (frames.empty())
+        {
+            stats.p50[stage] = stats.p95[stage] = stats.max[stage] = 0.0f;
+            continue;
+        }
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            int64_t us = (stage < NUM_PROF_STAGES) ? frames[i].nStageTime[stage] : frames[i].nFrameEnd - frames[i].nFrameStart;
+            ms[i] = static_cast<float>(us) * 0.001f;
+        }
+        stats.p50[stage] = Percentile(ms, 0.50f);
+        stats.p95[stage] = Percentile(ms, 0.95f);
+        stats.max[stage] = *std::max_element(ms.begin(), ms.end());
+    }
+}
+
+float CFrameProfiler::Percentile(std::vector<float>& values, float p)
+{
+    size_t k = std::min(values.size() - 1, static_cast<size_t>(p * static_cast<float>(values.size())));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(k), values.end());
+    return values[k];
+}
+
+std::string CFrameProfiler::ToChromeTrace() const
+{
+    std::vector<td_framerecord> frames(NUM_FRAMES);
+    frames.resize(Snapshot(frames.data(), frames.size()));
+
+    // Stages that run more than once per frame are shown as a single
+    // event starting at their first entry and lasting their total time.
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char buf[256];
+    bool bFirst = true;
+    auto event = [&](const char* name, uint32_t nFrame, int64_t ts, int64_t dur) {
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld,\"args\":{\"frame\":%u}}",
+                 bFirst ? "" : ",\n", name, static_cast<long long>(ts), static_cast<long long>(dur), nFrame);
+        out += buf;
+        bFirst = false;
+    };
+    for (const td_framerecord& f : frames)
+    {
+        event("Frame", f.nFrame, f.nFrameStart, f.nFrameEnd - f.nFrameStart);
+        for (int stage = 0; stage < NUM_PROF_STAGES; stage++)
+            if (f.nStageStart[stage] >= 0)
+                event(s_szStageNames[stage], f.nFrame, f.nStageStart[stage], f.nStageTime[stage]);
+    }
+    out += "\n]}\n";
+    return out;
+}
@@ -0,0 +1,117 @@
+/*
+ * profiler.h - Per-frame stage profiler header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Instrumented stages of a frame, in the order they usually run.
+enum ProfileStage
+{
+    PROF_ANALYZE_NEW_SOUND,
+    PROF_ALIGN_WAVES,
+    PROF_PER_FRAME_EQUATIONS,
+    PROF_GRID_ALPHA_VALUES,
+    PROF_CUSTOM_SHAPES,
+    PROF_CUSTOM_WAVES,
+    PROF_BLUR_PASSES,
+    PROF_SHOW_TO_USER,
+    PROF_TEXT_DRAW_NOW,
+    PROF_ENFORCE_MAX_FPS,
+    NUM_PROF_STAGES
+};
+
+// Timings of one frame, in microseconds since the profiler was created.
+typedef struct
+{
+    uint32_t nFrame;
+    int64_t nFrameStart;
+    int64_t nFrameEnd;
+    int64_t nStageStart[NUM_PROF_STAGES]; // first entry into the stage; -1 if the stage did not run
+    int64_t nStageTime[NUM_PROF_STAGES];  // total time spent in the stage (stages can run more than once per frame)
+} td_framerecord;
+
+// Percentiles over the frames currently held in the ring, in milliseconds.
+// Index `NUM_PROF_STAGES` is the whole frame.
+typedef struct
+{
+    size_t nFrames;
+    float p50[NUM_PROF_STAGES + 1];
+    float p95[NUM_PROF_STAGES + 1];
+    float max[NUM_PROF_STAGES + 1];
+} td_profilestats;
+
+// Collects stage timings on the render thread into a ring of frame records.
+// Publishing a frame is lock-free; readers on any thread copy out a
+// consistent snapshot and skip slots that are being overwritten.
+class CFrameProfiler
+{
+  public:
+    static constexpr size_t NUM_FRAMES = 512; // must be a power of 2
+
+    CFrameProfiler();
+
+    // Render thread only.
+    void BeginFrame(uint32_t nFrame);
+    void EndFrame();
+    void BeginStage(ProfileStage stage);
+    void EndStage(ProfileStage stage);
+
+    // Any thread.
+    size_t Snapshot(td_framerecord* pOut, size_t nMax) const; // oldest first; returns the number copied
+    void GetStats(td_profilestats& stats) const;
+    std::string ToChromeTrace() const; // Chrome "about:tracing" / Perfetto JSON
+    static const char* GetStageName(int stage);
+
+    // Value of rank `p * size`, clamped to the largest, in `values`, which
+    // it reorders; for example the 51st smallest of 100 for `p` = 0.5.
+    static float Percentile(std::vector<float>& values, float p);
+
+  private:
+    int64_t Now() const;
+
+    std::chrono::steady_clock::time_point m_epoch;
+    td_framerecord m_current;
+    int64_t m_nOpen[NUM_PROF_STAGES];
+    bool m_bInFrame;
+
+    std::array<td_framerecord, NUM_FRAMES> m_ring;
+    std::array<std::atomic<uint32_t>, NUM_FRAMES> m_seq; // 2n + 1 while frame n is being written, 2n + 2 once done
+    std::atomic<uint64_t> m_nPublished;
+};
+
+// Times the enclosing scope as `stage`.
+class CProfileScope
+{
+  public:
+    CProfileScope(CFrameProfiler& profiler, ProfileStage stage) : m_profiler(profiler), m_stage(stage) { m_profiler.BeginStage(m_stage); }
+    ~CProfileScope() { m_profiler.EndStage(m_stage); }
+    CProfileScope(const CProfileScope&) = delete;
+    CProfileScope& operator=(const CProfileScope&) = delete;
+
+  private:
+    CFrameProfiler& m_profiler;
+    ProfileStage m_stage;
+};
+
+// Instrumentation compiles away entirely unless `PROFILING` is defined.
+#ifdef PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, stage) CProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, stage)
+#define PROFILE_FRAME_BEGIN(profiler, frame) (profiler).BeginFrame(frame)
+#define PROFILE_FRAME_END(profiler) (profiler).EndFrame()
+#else
+#define PROFILE_SCOPE(profiler, stage)
+#define PROFILE_FRAME_BEGIN(profiler, frame)
+#define PROFILE_FRAME_END(profiler)
+#endif
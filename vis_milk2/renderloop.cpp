@@ -0,0 +1,121 @@
+/*
+ * renderloop.cpp - Render thread.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "renderloop.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+CRenderLoop::CRenderLoop(CRenderPresenter* pPresenter) : m_pPresenter(pPresenter), m_bStop(false), m_nFrames(0), m_nSkipped(0), m_nCommands(0), m_nCoalesced(0)
+{
+}
+
+CRenderLoop::~CRenderLoop()
+{
+    Stop();
+}
+
+void CRenderLoop::Start()
+{
+    if (m_thread.joinable())
+        return;
+    m_bStop = false;
+    m_thread = std::thread(&CRenderLoop::Run, this);
+}
+
+void CRenderLoop::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void CRenderLoop::Post(std::function<void()> cmd, uint32_t nKey)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (nKey)
+        {
+            auto it = std::find_if(m_commands.begin(), m_commands.end(), [nKey](const td_command& queued) { return queued.nKey == nKey; });
+            if (it != m_commands.end())
+            {
+                m_commands.erase(it);
+                m_nCoalesced++;
+            }
+        }
+        m_commands.push_back({std::move(cmd), nKey});
+    }
+    m_wake.notify_one();
+}
+
+void CRenderLoop::Send(std::function<void()> cmd)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_thread.joinable() || m_bStop || IsRenderThread())
+    {
+        lock.unlock();
+        cmd();
+        return;
+    }
+
+    // The loop drains the queue before exiting, so the command always runs.
+    bool bFinished = false;
+    auto run = [&] {
+        cmd();
+        std::lock_guard<std::mutex> done(m_mutex);
+        bFinished = true;
+        m_done.notify_all();
+    };
+    m_commands.push_back({run, 0});
+    m_wake.notify_one();
+    m_done.wait(lock, [&] { return bFinished; });
+}
+
+void CRenderLoop::GetStats(td_renderstats& stats) const
+{
+    stats.nFrames = m_nFrames;
+    stats.nSkipped = m_nSkipped;
+    stats.nCommands = m_nCommands;
+    stats.nCoalesced = m_nCoalesced;
+}
+
+bool CRenderLoop::RunCommands()
+{
+    std::vector<td_command> commands;
+    bool bStop;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        commands.swap(m_commands);
+        bStop = m_bStop;
+    }
+    for (td_command& command : commands)
+        command.cmd();
+    m_nCommands += commands.size();
+    return !bStop;
+}
+
+void CRenderLoop::Run()
+{
+    while (RunCommands())
+    {
+        m_pPresenter->PullAudio();
+        if (m_pPresenter->Present())
+        {
+            m_nFrames++;
+            continue;
+        }
+        m_nSkipped++;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS), [this] { return m_bStop || !m_commands.empty(); });
+    }
+}
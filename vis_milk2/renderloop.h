@@ -0,0 +1,105 @@
+/*
+ * renderloop.h - Render thread header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What the render thread does every frame, implemented by the host window.
+class CRenderPresenter
+{
+  public:
+    virtual ~CRenderPresenter() = default;
+
+    // Fetches the audio for the next frame.
+    virtual void PullAudio() = 0;
+
+    // Renders and shows a frame, then waits as long as the frame rate limit
+    // requires. Returns false if no frame could be shown, for example
+    // before the device is ready.
+    virtual bool Present() = 0;
+};
+
+// Counts since the loop was created.
+typedef struct
+{
+    uint64_t nFrames;    // shown
+    uint64_t nSkipped;   // the presenter could not show
+    uint64_t nCommands;  // run
+    uint64_t nCoalesced; // replaced by a later command with the same key before running
+} td_renderstats;
+
+// Owns the thread that renders, so that frames are neither delayed nor
+// skipped while the UI thread is busy.
+//
+// While the loop runs, other threads hand work for the renderer to it as
+// commands, which run in order before the next frame. A command posted with a key replaces any queued command with
+// the same key and moves to the back of the queue, so that a burst of
+// window resizes only resizes once, after whatever was posted before.
+//
+// Frames are paced by the presenter. While it cannot show frames, the loop
+// waits `IDLE_WAIT_MS` or until a command arrives before trying again.
+class CRenderLoop
+{
+  public:
+    static constexpr int IDLE_WAIT_MS = 30;
+
+    explicit CRenderLoop(CRenderPresenter* pPresenter);
+    ~CRenderLoop();
+    CRenderLoop(const CRenderLoop&) = delete;
+    CRenderLoop& operator=(const CRenderLoop&) = delete;
+
+    // Does nothing if the thread is already running.
+    void Start();
+
+    // Runs the commands queued so far, then waits for the thread to exit.
+    void Stop();
+
+    bool IsRunning() const { return m_thread.joinable(); }
+    bool IsRenderThread() const { return std::this_thread::get_id() == m_thread.get_id(); }
+
+    // Queues `cmd` to run on the render thread. Commands posted while the
+    // loop is stopped run once it starts.
+    void Post(std::function<void()> cmd, uint32_t nKey = 0);
+
+    // Runs `cmd` on the render thread and waits for it to finish. Runs it
+    // right away when called from the render thread or while the loop is
+    // stopped.
+    void Send(std::function<void()> cmd);
+
+    void GetStats(td_renderstats& stats) const;
+
+  private:
+    typedef struct
+    {
+        std::function<void()> cmd;
+        uint32_t nKey; // 0 if not coalesced
+    } td_command;
+
+    void Run();
+    bool RunCommands(); // false once stopping
+
+    CRenderPresenter* m_pPresenter;
+    std::thread m_thread;
+
+    std::mutex m_mutex; // guards the members below
+    std::condition_variable m_wake; // commands queued or stopping
+    std::condition_variable m_done; // a sent command finished
+    std::vector<td_command> m_commands;
+    bool m_bStop;
+
+    std::atomic<uint64_t> m_nFrames;
+    std::atomic<uint64_t> m_nSkipped;
+    std::atomic<uint64_t> m_nCommands;
+    std::atomic<uint64_t> m_nCoalesced;
+};
@@ -0,0 +1,43 @@
+/*
+ * ringalloc.cpp - Transient buffer ring allocator.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "ringalloc.h"
+
+bool CRingAllocator::Allocate(size_t nSize, size_t nAlign, td_ringalloc& alloc)
+{
+    if (nSize > m_nCapacity || nAlign == 0)
+        return false;
+
+    size_t nOffset = (m_nHead + nAlign - 1) / nAlign * nAlign;
+    alloc.bDiscard = nOffset > m_nCapacity || nSize > m_nCapacity - nOffset;
+    if (alloc.bDiscard)
+    {
+        nOffset = 0;
+        m_stats.nDiscards++;
+        m_stats.nBytes += nSize;
+    }
+    else
+        m_stats.nBytes += nOffset + nSize - m_nHead;
+    alloc.nOffset = nOffset;
+    m_nHead = nOffset + nSize;
+    m_stats.nAllocations++;
+    return true;
+}
+
+void CRingAllocator::Reset(size_t nCapacity)
+{
+    m_nCapacity = nCapacity;
+    m_nHead = nCapacity;
+}
+
+size_t GrowCapacity(size_t nCapacity, size_t nSize)
+{
+    size_t nNew = nCapacity ? nCapacity * 2 : 1;
+    while (nNew < nSize)
+        nNew *= 2;
+    return nNew;
+}
@@ -0,0 +1,62 @@
+/*
+ * ringalloc.h - Transient buffer ring allocator header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef struct
+{
+    size_t nOffset; // bytes, a multiple of the alignment
+    bool bDiscard;  // the ring wrapped; map the buffer with discard
+} td_ringalloc;
+
+typedef struct
+{
+    uint64_t nAllocations;
+    uint64_t nDiscards; // wraps, including the first allocation
+    uint64_t nBytes;    // allocated, including alignment
+} td_ringallocstats;
+
+// Places the data of successive draws one after the other in a dynamic
+// buffer, so that it is written without discarding the buffer every draw.
+//
+// Data is appended at increasing offsets, where the device is not reading
+// yet, so the buffer can be mapped without overwriting. The last discard
+// is the fence: every block since may still be in use by draws in flight,
+// so when a block does not fit in what is left, the ring wraps to the
+// start and the buffer must be discarded, which gives it fresh storage
+// while the device finishes with the old one. Offsets are aligned to the
+// vertex or index size, rather than a power of two, so that a draw can
+// address its data with a base vertex or start index.
+class CRingAllocator
+{
+  public:
+    explicit CRingAllocator(size_t nCapacity) : m_nCapacity(nCapacity), m_nHead(nCapacity), m_stats{} {}
+
+    // Reserves `nSize` bytes at an offset that is a multiple of `nAlign`.
+    // Returns false if they do not fit in the buffer at all; the caller
+    // then needs a larger buffer.
+    bool Allocate(size_t nSize, size_t nAlign, td_ringalloc& alloc);
+
+    // For a new buffer of `nCapacity` bytes, such as a larger one. The
+    // next allocation discards it.
+    void Reset(size_t nCapacity);
+
+    size_t GetCapacity() const { return m_nCapacity; }
+    void GetStats(td_ringallocstats& stats) const { stats = m_stats; }
+
+  private:
+    size_t m_nCapacity;
+    size_t m_nHead; // end of the last block; the capacity until the first discard
+    td_ringallocstats m_stats;
+};
+
+// Capacity of a buffer that holds at least `nSize` bytes, for growing one
+// of `nCapacity` bytes: at least doubled, so that growing is rare.
+size_t GrowCapacity(size_t nCapacity, size_t nSize);
@@ -37,6 +37,9 @@
 
 extern CPlugin g_plugin; // declared in "main.cpp"
 
+// Names of the `PV_LANE_*` variables.
+static const char* s_szPerVertexLaneVars[NUM_PV_LANES] = {"x", "y", "rad", "ang", "zoom", "zoomexp", "rot", "warp", "cx", "cy", "dx", "dy", "sx", "sy"};
+
 // These are intended to replace `GetPrivateProfileInt()/FloatString()`,
 // which are very slow for large files (they always start from the top).
 // (really slow - some preset loads were taking 90 ms because of these!)
@@ -210,6 +213,7 @@ void CState::Initialize()
     // it is a SUBSET of the per-vertex calculation variable list.
     m_pf_codehandle = NULL;
     m_pp_codehandle = NULL;
+    m_pp_lanes = NULL;
     m_pf_eel = NSEEL_VM_alloc();
     m_pv_eel = NSEEL_VM_alloc();
     for (int i = 0; i < MAX_CUSTOM_WAVES; i++)
@@ -1503,6 +1507,12 @@ void CState::FreeVarsAndCode(bool bFree)
             NSEEL_code_free(m_pp_codehandle);
         m_pp_codehandle = NULL;
     }
+    if (m_pp_lanes)
+    {
+        if (bFree)
+            delete m_pp_lanes;
+        m_pp_lanes = NULL;
+    }
 
     for (int i = 0; i < MAX_CUSTOM_WAVES; i++)
     {
@@ -1589,6 +1599,11 @@ void CState::RecompileExpressions(int flags, int bReInit)
             NSEEL_code_free(m_pp_codehandle);
             m_pp_codehandle = NULL;
         }
+        if (m_pp_lanes)
+        {
+            delete m_pp_lanes;
+            m_pp_lanes = NULL;
+        }
     }
     if (flags & RECOMPILE_WAVE_CODE)
     {
@@ -1684,9 +1699,10 @@ void CState::RecompileExpressions(int flags, int bReInit)
             StripLinefeedCharsAndComments(m_szPerFrameInit, buf);
             if (buf[0] && bReInit)
             {
-                NSEEL_CODEHANDLE pf_codehandle_init;
+                // Execute the code, save the values of q1..q32.
+                g_plugin.LoadPerFrameEvallibVars(g_plugin.m_pState);
 
-                if ((pf_codehandle_init = NSEEL_code_compile(m_pf_eel, buf, 0)) == NULL)
+                if (!ExecuteInitCode(m_pf_eel, buf))
                 {
                     wchar_t err[1024], fmt[256];
                     LoadString(g_plugin.GetInstance(), IDS_WARNING_PRESET_X_ERROR_IN_PRESET_INIT_CODE, fmt, 256);
@@ -1699,17 +1715,9 @@ void CState::RecompileExpressions(int flags, int bReInit)
                 }
                 else
                 {
-                    // Now execute the code, save the values of q1..q32, and clean up the code!
-                    g_plugin.LoadPerFrameEvallibVars(g_plugin.m_pState);
-
-                    NSEEL_code_execute(pf_codehandle_init);
-
                     for (int vi = 0; vi < NUM_Q_VAR; vi++)
                         q_values_after_init_code[vi] = *var_pf_q[vi];
                     monitor_after_init_code = *var_pf_monitor;
-
-                    NSEEL_code_free(pf_codehandle_init);
-                    pf_codehandle_init = NULL;
                 }
             }
 
@@ -1737,6 +1745,20 @@ void CState::RecompileExpressions(int flags, int bReInit)
                     swprintf_s(err, fmt, m_szDesc);
                     g_plugin.AddError(err, 6.0f, ERR_PRESET, true);
                 }
+#if !(defined(NS_EEL2) && defined(_M_IX86))
+                else
+                {
+                    // Also build a lane-parallel version, if the code does not
+                    // carry state from one vertex to the next. The compiled code
+                    // stays as the fallback.
+                    m_pp_lanes = new CEelLaneProgram();
+                    if (!m_pp_lanes->Compile(buf, ResolveEelVar, m_pv_eel, s_szPerVertexLaneVars, NUM_PV_LANES))
+                    {
+                        delete m_pp_lanes;
+                        m_pp_lanes = NULL;
+                    }
+                }
+#endif
             }
 
             //resetVars(NULL);
@@ -1752,8 +1774,13 @@ void CState::RecompileExpressions(int flags, int bReInit)
                 {
 #ifndef _NO_EXPR_
                     {
-                        NSEEL_CODEHANDLE codehandle_temp;
-                        if ((codehandle_temp = NSEEL_code_compile(m_wave[i].m_pf_eel, buf, 0)) == NULL)
+                        // Execute the code, save the values of t1..t8.
+                        g_plugin.LoadCustomWavePerFrameEvallibVars(g_plugin.m_pState, i);
+                        // Note: q values at this point will actually be same as
+                        //       q_values_after_init_code[], since no per-frame code
+                        //       has actually been executed yet!
+
+                        if (!ExecuteInitCode(m_wave[i].m_pf_eel, buf))
                         {
                             wchar_t err[1024], fmt[256];
                             LoadString(g_plugin.GetInstance(), IDS_WARNING_PRESET_X_ERROR_IN_WAVE_X_INIT_CODE, fmt, 256);
@@ -1767,19 +1794,8 @@ void CState::RecompileExpressions(int flags, int bReInit)
                         }
                         else
                         {
-                            // Now execute the code, save the values of t1..t8, and clean up the code!
-                            g_plugin.LoadCustomWavePerFrameEvallibVars(g_plugin.m_pState, i);
-                            // Note: q values at this point will actually be same as
-                            //       q_values_after_init_code[], since no per-frame code
-                            //       has actually been executed yet!
-
-                            NSEEL_code_execute(codehandle_temp);
-
                             for (int vi = 0; vi < NUM_T_VAR; vi++)
                                 m_wave[i].t_values_after_init_code[vi] = *m_wave[i].var_pf_t[vi];
-
-                            NSEEL_code_free(codehandle_temp);
-                            codehandle_temp = NULL;
                         }
                     }
 #endif
@@ -1825,8 +1841,13 @@ void CState::RecompileExpressions(int flags, int bReInit)
                 {
 #ifndef _NO_EXPR_
                     {
-                        NSEEL_CODEHANDLE codehandle_temp;
-                        if ((codehandle_temp = NSEEL_code_compile(m_shape[i].m_pf_eel, buf, 0)) == NULL)
+                        // Execute the code, save the values of t1..t8.
+                        g_plugin.LoadCustomShapePerFrameEvallibVars(g_plugin.m_pState, i, 0);
+                        // note: q values at this point will actually be same as
+                        //       q_values_after_init_code[], since no per-frame code
+                        //       has actually been executed yet!
+
+                        if (!ExecuteInitCode(m_shape[i].m_pf_eel, buf))
                         {
                             wchar_t err[1024], fmt[256];
                             LoadString(g_plugin.GetInstance(), IDS_WARNING_PRESET_X_ERROR_IN_SHAPE_X_INIT_CODE, fmt, 256);
@@ -1840,19 +1861,8 @@ void CState::RecompileExpressions(int flags, int bReInit)
                         }
                         else
                         {
-                            // Now execute the code, save the values of q1..q8, and clean up the code!
-                            g_plugin.LoadCustomShapePerFrameEvallibVars(g_plugin.m_pState, i, 0);
-                            // note: q values at this point will actually be same as
-                            //       q_values_after_init_code[], since no per-frame code
-                            //       has actually been executed yet!
-
-                            NSEEL_code_execute(codehandle_temp);
-
                             for (int vi = 0; vi < NUM_T_VAR; vi++)
                                 m_shape[i].t_values_after_init_code[vi] = *m_shape[i].var_pf_t[vi];
-
-                            NSEEL_code_free(codehandle_temp);
-                            codehandle_temp = NULL;
                         }
                     }
 #endif
@@ -38,12 +38,34 @@
 #else
 #include <projectm-eval/ns-eel2-shim/ns-eel.h>
 #endif
+#include "eelinterp.h"
 
 // Flags for `CState::RecompileExpressions()`.
 static constexpr int RECOMPILE_PRESET_CODE = 1;
 static constexpr int RECOMPILE_WAVE_CODE = 2;
 static constexpr int RECOMPILE_SHAPE_CODE = 4;
 
+// Per-vertex variables the evaluator sets before each vertex, in the
+// order of the lane slots of `CState::m_pp_lanes`.
+enum
+{
+    PV_LANE_X,
+    PV_LANE_Y,
+    PV_LANE_RAD,
+    PV_LANE_ANG,
+    PV_LANE_ZOOM,
+    PV_LANE_ZOOMEXP,
+    PV_LANE_ROT,
+    PV_LANE_WARP,
+    PV_LANE_CX,
+    PV_LANE_CY,
+    PV_LANE_DX,
+    PV_LANE_DY,
+    PV_LANE_SX,
+    PV_LANE_SY,
+    NUM_PV_LANES
+};
+
 static constexpr int NUM_Q_VAR = 32;
 static constexpr int NUM_T_VAR = 8;
 
@@ -375,6 +397,7 @@ class CState
     // For arbitrary function evaluation.
     NSEEL_CODEHANDLE m_pf_codehandle;
     NSEEL_CODEHANDLE m_pp_codehandle;
+    CEelLaneProgram* m_pp_lanes; // `m_pp_codehandle` for `EEL_LANES` vertices at a time, if the code allows it
     char m_szPerFrameInit[MAX_BIGSTRING_LEN];
     char m_szPerFrameExpr[MAX_BIGSTRING_LEN];
     char m_szPerPixelExpr[MAX_BIGSTRING_LEN];
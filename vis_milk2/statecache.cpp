@@ -0,0 +1,62 @@
+/*
+ * statecache.cpp - Pipeline state object cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "statecache.h"
+
+#include <cstring>
+
+namespace
+{
+// FNV-1a over the kind and the descriptor bytes.
+uint64_t HashDesc(eStateType type, const uint8_t* pDesc, size_t nSize)
+{
+    uint64_t nHash = (0xCBF29CE484222325ULL ^ static_cast<uint64_t>(type)) * 0x100000001B3ULL;
+    for (size_t i = 0; i < nSize; i++)
+    {
+        nHash ^= pDesc[i];
+        nHash *= 0x100000001B3ULL;
+    }
+    return nHash;
+}
+} // namespace
+
+void* CStateCache::Get(eStateType type, const void* pDesc, size_t nSize)
+{
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pDesc);
+    uint64_t nHash = HashDesc(type, pBytes, nSize);
+    auto range = m_entries.equal_range(nHash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const td_cached& cached = it->second;
+        if (cached.type == type && cached.desc.size() == nSize && std::memcmp(cached.desc.data(), pBytes, nSize) == 0)
+        {
+            m_nHits++;
+            return cached.pState;
+        }
+    }
+
+    void* pState = m_pFactory->CreateState(type, pDesc);
+    if (!pState)
+        return nullptr;
+    m_nCreated++;
+    m_entries.emplace(nHash, td_cached{type, std::vector<uint8_t>(pBytes, pBytes + nSize), pState});
+    return pState;
+}
+
+void CStateCache::Clear()
+{
+    for (auto& [nHash, cached] : m_entries)
+        m_pFactory->ReleaseState(cached.type, cached.pState);
+    m_entries.clear();
+}
+
+void CStateCache::GetStats(td_statecachestats& stats) const
+{
+    stats.nEntries = m_entries.size();
+    stats.nCreated = m_nCreated;
+    stats.nHits = m_nHits;
+}
@@ -0,0 +1,91 @@
+/*
+ * statecache.h - Pipeline state object cache header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Kinds of immutable pipeline state objects, each created from its own
+// descriptor structure.
+enum eStateType
+{
+    STATE_BLEND,
+    STATE_DEPTH_STENCIL,
+    STATE_RASTERIZER,
+    STATE_SAMPLER,
+    NUM_STATE_TYPES
+};
+
+// Creates and releases state objects on a device, such as Direct3D 11.
+class CStateFactory
+{
+  public:
+    virtual ~CStateFactory() = default;
+
+    // Creates the state object of kind `type` described by `pDesc`, which
+    // only the factory knows the type of. Returns null on failure.
+    virtual void* CreateState(eStateType type, const void* pDesc) = 0;
+    virtual void ReleaseState(eStateType type, void* pState) = 0;
+};
+
+typedef struct
+{
+    size_t nEntries;   // cached now
+    uint64_t nCreated; // by the factory, ever
+    uint64_t nHits;
+} td_statecachestats;
+
+// State objects by descriptor, so that setting a state that was used
+// before, like an alpha blend mode that changes every frame, never creates
+// a new one.
+//
+// Objects are keyed by a hash of the whole descriptor and compared byte by
+// byte, so descriptors must not leave padding uninitialized. The cache owns
+// the objects and releases them when cleared; callers do not reference
+// them beyond the next `Clear()`.
+class CStateCache
+{
+  public:
+    explicit CStateCache(CStateFactory* pFactory) : m_pFactory(pFactory), m_nCreated(0), m_nHits(0) {}
+    CStateCache(const CStateCache&) = delete;
+    CStateCache& operator=(const CStateCache&) = delete;
+    ~CStateCache() { Clear(); }
+
+    // Returns the state object of kind `type` for the `nSize` bytes of
+    // descriptor at `pDesc`, creating it if not cached. Returns null if the
+    // factory failed; failures are not cached.
+    void* Get(eStateType type, const void* pDesc, size_t nSize);
+
+    template <typename T>
+    void* Get(eStateType type, const T& desc)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "descriptors are compared as bytes");
+        return Get(type, &desc, sizeof(T));
+    }
+
+    // Releases every object.
+    void Clear();
+
+    void GetStats(td_statecachestats& stats) const;
+
+  private:
+    typedef struct
+    {
+        eStateType type;
+        std::vector<uint8_t> desc;
+        void* pState;
+    } td_cached;
+
+    CStateFactory* m_pFactory;
+    std::unordered_multimap<uint64_t, td_cached> m_entries; // by hash of the type and descriptor
+    uint64_t m_nCreated;
+    uint64_t m_nHits;
+};
@@ -0,0 +1,50 @@
+/*
+ * stateshadow.cpp - Redundant state filtering.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "stateshadow.h"
+
+bool CStateShadow::SetSlot(eBindPoint bp, unsigned int nSlot, uint64_t nValue, uint64_t nExtra)
+{
+    if (nSlot >= MAX_SLOTS)
+    {
+        m_nIssued++;
+        return true;
+    }
+
+    td_slot& slot = m_slots[bp][nSlot];
+    if (slot.bKnown && slot.nValue == nValue && slot.nExtra == nExtra)
+    {
+        m_nFiltered++;
+        return false;
+    }
+    slot = {true, nValue, nExtra};
+    m_nIssued++;
+    return true;
+}
+
+void CStateShadow::Invalidate(eBindPoint bp)
+{
+    for (td_slot& slot : m_slots[bp])
+        slot.bKnown = false;
+}
+
+void CStateShadow::Invalidate()
+{
+    for (int bp = 0; bp < NUM_BIND_POINTS; bp++)
+        Invalidate(static_cast<eBindPoint>(bp));
+}
+
+void CStateShadow::EndFrame()
+{
+    m_stats.nIssued = m_nIssued;
+    m_stats.nFiltered = m_nFiltered;
+    m_stats.nTotalIssued += m_nIssued;
+    m_stats.nTotalFiltered += m_nFiltered;
+    m_nIssued = 0;
+    m_nFiltered = 0;
+    Invalidate();
+}
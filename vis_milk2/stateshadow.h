@@ -0,0 +1,86 @@
+/*
+ * stateshadow.h - Redundant state filtering header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Pipeline state that the renderer binds, each with `CStateShadow::MAX_SLOTS`
+// slots at most.
+enum eBindPoint
+{
+    BIND_VERTEX_BUFFER, // buffer; stride and offset
+    BIND_INDEX_BUFFER,
+    BIND_INPUT_LAYOUT,
+    BIND_TOPOLOGY,
+    BIND_VERTEX_SHADER,
+    BIND_PIXEL_SHADER,
+    BIND_VS_CONSTANTS, // by slot
+    BIND_PS_CONSTANTS, // by slot
+    BIND_PS_SAMPLER,   // by slot
+    BIND_PS_TEXTURE,   // by slot
+    BIND_BLEND,
+    BIND_DEPTH_STENCIL,
+    BIND_RASTERIZER,
+    NUM_BIND_POINTS
+};
+
+typedef struct
+{
+    uint64_t nIssued;   // binds passed on to the device in the last frame
+    uint64_t nFiltered; // binds dropped in the last frame
+    uint64_t nTotalIssued;
+    uint64_t nTotalFiltered;
+} td_stateshadowstats;
+
+// Shadow copy of the bound state, so that binds that would not change it
+// are not passed on to the device.
+//
+// Values are handles, or enumerations, with an optional second value for
+// binds that take parameters, like a vertex buffer's stride and offset. A
+// slot is unknown until first bound and after it is invalidated, which
+// code that changes the device's state directly must do. Slots past
+// `MAX_SLOTS` are not tracked and always bound.
+class CStateShadow
+{
+  public:
+    static constexpr unsigned int MAX_SLOTS = 16;
+
+    CStateShadow() : m_slots{}, m_nIssued(0), m_nFiltered(0), m_stats{} {}
+
+    // Records binding `nValue` and `nExtra` at `nSlot` of `bp`. Returns
+    // true if the bind changes the state and must be issued.
+    bool SetSlot(eBindPoint bp, unsigned int nSlot, uint64_t nValue, uint64_t nExtra = 0);
+    // For bind points with a single slot.
+    bool Set(eBindPoint bp, uint64_t nValue, uint64_t nExtra = 0) { return SetSlot(bp, 0, nValue, nExtra); }
+
+    // Forgets the state of every slot of `bp`, for example the textures
+    // that binding a render target may unbind.
+    void Invalidate(eBindPoint bp);
+
+    // Forgets all state.
+    void Invalidate();
+
+    // Closes the frame's counters, and forgets all state, which other
+    // code may change between frames.
+    void EndFrame();
+
+    void GetStats(td_stateshadowstats& stats) const { stats = m_stats; }
+
+  private:
+    typedef struct
+    {
+        bool bKnown;
+        uint64_t nValue;
+        uint64_t nExtra;
+    } td_slot;
+
+    td_slot m_slots[NUM_BIND_POINTS][MAX_SLOTS];
+    uint64_t m_nIssued;
+    uint64_t m_nFiltered;
+    td_stateshadowstats m_stats;
+};
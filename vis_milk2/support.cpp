@@ -205,11 +205,23 @@ void GetWinampSongTitle(HWND hWndWinamp, wchar_t* szSongTitle, size_t nSize)
 
 void GetWinampSongPosAsText(HWND hWndWinamp, wchar_t* szSongPos)
 {
-    // Note: `sizeof(szSongPos[])` must be at least 64.
-    szSongPos[0] = L'\0';
     DWORD_PTR nSongPosMS = NULL;
     SendMessageTimeout(hWndWinamp, WM_USER, 0, IPC_GETOUTPUTTIME, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &nSongPosMS);
-    if (static_cast<LRESULT>(nSongPosMS) > 0)
+    SongPosToText(static_cast<LRESULT>(nSongPosMS), szSongPos);
+}
+
+void GetWinampSongLenAsText(HWND hWndWinamp, wchar_t* szSongLen)
+{
+    DWORD_PTR nSongLenMS = NULL;
+    SendMessageTimeout(hWndWinamp, WM_USER, 2, IPC_GETOUTPUTTIME, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &nSongLenMS);
+    SongLenToText(static_cast<LRESULT>(nSongLenMS), szSongLen);
+}
+
+void SongPosToText(LONGLONG nSongPosMS, wchar_t* szSongPos)
+{
+    // Note: `sizeof(szSongPos[])` must be at least 64.
+    szSongPos[0] = L'\0';
+    if (nSongPosMS > 0)
     {
         wchar_t tmp[16];
         float time_s = nSongPosMS * 0.001f;
@@ -223,13 +235,11 @@ void GetWinampSongPosAsText(HWND hWndWinamp, wchar_t* szSongPos)
     }
 }
 
-void GetWinampSongLenAsText(HWND hWndWinamp, wchar_t* szSongLen)
+void SongLenToText(LONGLONG nSongLenMS, wchar_t* szSongLen)
 {
     // Note: `sizeof(szSongLen[])` must be at least 64.
     szSongLen[0] = L'\0';
-    DWORD_PTR nSongLenMS = NULL;
-    SendMessageTimeout(hWndWinamp, WM_USER, 2, IPC_GETOUTPUTTIME, SMTO_NORMAL | SMTO_ABORTIFHUNG | SMTO_ERRORONEXIT, 100, &nSongLenMS);
-    if (static_cast<LRESULT>(nSongLenMS) > 0)
+    if (nSongLenMS > 0)
     {
         unsigned int len_s = static_cast<unsigned int>(nSongLenMS / 1000);
         unsigned int minutes = len_s / 60;
@@ -54,6 +54,8 @@ void GetWinampSongPosAsText(HWND hWndWinamp, wchar_t* szSongPos);
 void GetWinampSongLenAsText(HWND hWndWinamp, wchar_t* szSongLen);
 float GetWinampSongPos(HWND hWndWinamp); // returns answer in seconds
 float GetWinampSongLen(HWND hWndWinamp); // returns answer in seconds
+void SongPosToText(LONGLONG nSongPosMS, wchar_t* szSongPos); // as "m:ss.cc"; empty if not positive
+void SongLenToText(LONGLONG nSongLenMS, wchar_t* szSongLen); // as "m:ss"; empty if not positive
 
 int GetDX11TexFormatBitsPerPixel(DXGI_FORMAT fmt);
 
@@ -94,6 +96,9 @@ typedef struct _SIMPLEVERTEX
     DWORD Diffuse;  // diffuse color, also acts as filler to 16 bytes
 } SIMPLEVERTEX, *LPSIMPLEVERTEX;
 
+#define COLOR_NORM(x) (((int)(x * 255) & 0xFF) / 255.0f)
+#define COPY_COLOR(x, y) { x.a = y.a; x.r = y.r; x.g = y.g; x.b = y.b; }
+
 #ifdef PROFILING
 #define PROFILE_BEGIN \
     LARGE_INTEGER tx, freq, ty; \
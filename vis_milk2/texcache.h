@@ -0,0 +1,165 @@
+/*
+ * texcache.h - Shader texture cache header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// A texture that presets can bind by name.
+template <typename T>
+struct td_cachedtex
+{
+    std::wstring_view szName; // the key in the cache
+    T texptr;
+    int w, h, d;
+    bool bEvictable;      // disk textures; the blur and noise textures stay
+    int nAge;             // serial number of the last preset that used it
+    size_t nSizeInBytes;  // all mip levels
+    td_cachedtex* pOlder; // least recently used neighbors, if evictable
+    td_cachedtex* pNewer;
+};
+
+// Textures of the loaded presets, by name (a file name without its path or
+// extension, such as "noise_lq" or "blur1").
+//
+// Evictable textures are also kept on a list in the order they were last
+// used. Every use stamps the texture with the serial number of the preset,
+// which only ever grows, so the least recently used texture is also the
+// one with the lowest age and `Evict()` only looks at the end of the list.
+// Lookups, inserts and evictions all take constant time.
+//
+// The cache does not own the texture handles; `T` is typically a pointer
+// to a device resource that the caller releases when it is evicted.
+template <typename T>
+class CTextureCache
+{
+  public:
+    typedef td_cachedtex<T> Entry;
+
+    CTextureCache() : m_pOldest(nullptr), m_pNewest(nullptr), m_nEvictableCount(0), m_nEvictableBytes(0) {}
+    CTextureCache(const CTextureCache&) = delete;
+    CTextureCache& operator=(const CTextureCache&) = delete;
+
+    // Returns `nullptr` if no texture has that name.
+    Entry* Find(std::wstring_view szName)
+    {
+        auto it = m_entries.find(szName);
+        return it == m_entries.end() ? nullptr : &it->second;
+    }
+
+    // Like `Find()`, but also marks the texture as used by preset `nAge`.
+    Entry* Use(std::wstring_view szName, int nAge)
+    {
+        Entry* p = Find(szName);
+        if (p)
+        {
+            p->nAge = nAge;
+            if (p->bEvictable)
+            {
+                Unlink(p);
+                Link(p);
+            }
+        }
+        return p;
+    }
+
+    // Adds a texture, replacing any of the same name without releasing it.
+    Entry& Insert(std::wstring_view szName, T texptr, int w, int h, int d, size_t nSizeInBytes, bool bEvictable, int nAge)
+    {
+        auto it = m_entries.find(szName);
+        if (it == m_entries.end())
+            it = m_entries.emplace(std::wstring(szName), Entry{}).first;
+        else if (it->second.bEvictable)
+            Unlink(&it->second);
+        Entry& e = it->second;
+        e.szName = it->first;
+        e.texptr = texptr;
+        e.w = w;
+        e.h = h;
+        e.d = d;
+        e.bEvictable = bEvictable;
+        e.nAge = nAge;
+        e.nSizeInBytes = nSizeInBytes;
+        e.pOlder = e.pNewer = nullptr;
+        if (bEvictable)
+            Link(&e);
+        return e;
+    }
+
+    // Removes the least recently used evictable texture, unless it was used
+    // by preset `nMinAge` or later, and returns its handle in `pTexptr`.
+    bool Evict(int nMinAge, T* pTexptr)
+    {
+        Entry* p = m_pOldest;
+        if (!p || p->nAge >= nMinAge)
+            return false;
+        *pTexptr = p->texptr;
+        Unlink(p);
+        m_entries.erase(m_entries.find(p->szName));
+        return true;
+    }
+
+    // Calls `f(entry)` for every texture.
+    template <typename F>
+    void ForEach(F f)
+    {
+        for (auto& i : m_entries)
+            f(i.second);
+    }
+
+    void Clear()
+    {
+        m_entries.clear();
+        m_pOldest = m_pNewest = nullptr;
+        m_nEvictableCount = 0;
+        m_nEvictableBytes = 0;
+    }
+
+    size_t GetCount() const { return m_entries.size(); }
+    size_t GetEvictableCount() const { return m_nEvictableCount; }
+    size_t GetEvictableBytes() const { return m_nEvictableBytes; }
+
+  private:
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::wstring_view s) const { return std::hash<std::wstring_view>{}(s); }
+    };
+    typedef std::unordered_map<std::wstring, Entry, NameHash, std::equal_to<>> EntryMap;
+
+    void Link(Entry* p)
+    {
+        p->pOlder = m_pNewest;
+        p->pNewer = nullptr;
+        if (m_pNewest)
+            m_pNewest->pNewer = p;
+        else
+            m_pOldest = p;
+        m_pNewest = p;
+        m_nEvictableCount++;
+        m_nEvictableBytes += p->nSizeInBytes;
+    }
+
+    void Unlink(Entry* p)
+    {
+        (p->pOlder ? p->pOlder->pNewer : m_pOldest) = p->pNewer;
+        (p->pNewer ? p->pNewer->pOlder : m_pNewest) = p->pOlder;
+        p->pOlder = p->pNewer = nullptr;
+        m_nEvictableCount--;
+        m_nEvictableBytes -= p->nSizeInBytes;
+    }
+
+    EntryMap m_entries; // nodes do not move, so the list can point into them
+    Entry* m_pOldest;
+    Entry* m_pNewest;
+    size_t m_nEvictableCount;
+    size_t m_nEvictableBytes;
+};
@@ -0,0 +1,117 @@
+/*
+ * texcatalog.cpp - Texture directory catalog.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "texcatalog.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+#include <iterator>
+
+static std::wstring ToLower(const wchar_t* s, size_t nLen)
+{
+    std::wstring lower(s, nLen);
+    for (wchar_t& c : lower)
+        c = static_cast<wchar_t>(std::towlower(c));
+    return lower;
+}
+
+// Orders entries by key, then by name, which can differ in case only.
+static bool EntryLess(const std::wstring& szKeyA, const std::wstring& szNameA, const std::wstring& szKeyB, const std::wstring& szNameB)
+{
+    return szKeyA < szKeyB || (szKeyA == szKeyB && szNameA < szNameB);
+}
+
+bool IsTextureFile(const wchar_t* szFilename)
+{
+    static const wchar_t* const exts[] = {L"jpg", L"png", L"dds", L"tga", L"bmp", L"dib"};
+    const wchar_t* ext = wcsrchr(szFilename, L'.');
+    if (!ext)
+        return false;
+    std::wstring lower = ToLower(ext + 1, wcslen(ext + 1));
+    return std::any_of(std::begin(exts), std::end(exts), [&](const wchar_t* e) { return lower == e; });
+}
+
+void CTextureCatalog::SetDirectory(std::unique_ptr<CTextureDirectory> pDir)
+{
+    m_pDir = std::move(pDir);
+    m_entries.clear();
+    m_bNeedList = m_pDir != nullptr;
+}
+
+void CTextureCatalog::Update()
+{
+    if (!m_pDir)
+        return;
+
+    std::vector<td_dirchange> changes;
+    if (!m_bNeedList && !m_pDir->PollChanges(changes))
+        m_bNeedList = true;
+
+    if (m_bNeedList)
+    {
+        std::vector<std::wstring> files;
+        m_entries.clear();
+        if (!m_pDir->List(files))
+            return; // try again next time
+        m_bNeedList = false;
+        for (std::wstring& szName : files)
+            if (IsTextureFile(szName.c_str()))
+                m_entries.push_back({ToLower(szName.c_str(), szName.length()), std::move(szName)});
+        std::sort(m_entries.begin(), m_entries.end(), [](const td_entry& a, const td_entry& b) { return EntryLess(a.szKey, a.szName, b.szKey, b.szName); });
+        return;
+    }
+
+    for (const td_dirchange& change : changes)
+    {
+        if (change.bAdded)
+            Add(change.szName);
+        else
+            Remove(change.szName);
+    }
+}
+
+void CTextureCatalog::Add(const std::wstring& szName)
+{
+    if (!IsTextureFile(szName.c_str()))
+        return;
+    td_entry entry = {ToLower(szName.c_str(), szName.length()), szName};
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), entry, [](const td_entry& a, const td_entry& b) { return EntryLess(a.szKey, a.szName, b.szKey, b.szName); });
+    if (it == m_entries.end() || it->szName != szName)
+        m_entries.insert(it, std::move(entry));
+}
+
+void CTextureCatalog::Remove(const std::wstring& szName)
+{
+    std::wstring szKey = ToLower(szName.c_str(), szName.length());
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), szKey, [&](const td_entry& e, const std::wstring& key) { return EntryLess(e.szKey, e.szName, key, szName); });
+    if (it != m_entries.end() && it->szName == szName)
+        m_entries.erase(it);
+}
+
+std::pair<CTextureCatalog::EntryIter, CTextureCatalog::EntryIter> CTextureCatalog::FindPrefix(const wchar_t* szPrefix) const
+{
+    std::wstring szKey = ToLower(szPrefix ? szPrefix : L"", szPrefix ? wcslen(szPrefix) : 0);
+    auto first = std::lower_bound(m_entries.begin(), m_entries.end(), szKey, [](const td_entry& e, const std::wstring& key) { return e.szKey < key; });
+    auto last = std::upper_bound(first, m_entries.cend(), szKey, [](const std::wstring& key, const td_entry& e) { return e.szKey.compare(0, key.length(), key) > 0; });
+    return {first, last};
+}
+
+size_t CTextureCatalog::Count(const wchar_t* szPrefix) const
+{
+    auto range = FindPrefix(szPrefix);
+    return static_cast<size_t>(range.second - range.first);
+}
+
+const std::wstring* CTextureCatalog::Pick(const wchar_t* szPrefix, uint32_t nIndex) const
+{
+    auto range = FindPrefix(szPrefix);
+    size_t nCount = static_cast<size_t>(range.second - range.first);
+    if (nCount == 0)
+        return nullptr;
+    return &(range.first + nIndex % nCount)->szName;
+}
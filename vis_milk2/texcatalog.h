@@ -0,0 +1,85 @@
+/*
+ * texcatalog.h - Texture directory catalog header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A file added to or removed from a watched directory. Renames come as the
+// removal of the old name and the addition of the new one.
+typedef struct
+{
+    std::wstring szName; // without path
+    bool bAdded;
+} td_dirchange;
+
+// Directory access for `CTextureCatalog`, so that the platform's file
+// system and change notifications can be swapped out.
+class CTextureDirectory
+{
+  public:
+    virtual ~CTextureDirectory() = default;
+
+    // Lists the files of the directory, without their path, and starts
+    // watching it for changes. Returns false if it cannot be read.
+    virtual bool List(std::vector<std::wstring>& files) = 0;
+
+    // Appends the changes since the last call or `List()` to `changes`.
+    // Returns false if changes were lost and the directory must be listed
+    // again.
+    virtual bool PollChanges(std::vector<td_dirchange>& changes) = 0;
+};
+
+// Whether `szFilename` has the extension of a texture MilkDrop can load.
+bool IsTextureFile(const wchar_t* szFilename);
+
+// Texture files of a directory, for picking random textures by prefix.
+//
+// File names are kept sorted by their lower-case form, so that the names
+// sharing a prefix form a range found with two binary searches, and any of
+// them can be picked by index. The directory is listed once and then kept
+// up to date from its change notifications.
+class CTextureCatalog
+{
+  public:
+    CTextureCatalog() : m_bNeedList(false) {}
+
+    // Empty to catalog nothing.
+    void SetDirectory(std::unique_ptr<CTextureDirectory> pDir);
+
+    // Lists the directory if needed, or applies its changes.
+    void Update();
+
+    // Number of textures whose names start with `szPrefix`, ignoring case.
+    size_t Count(const wchar_t* szPrefix) const;
+
+    // Name of texture `nIndex` modulo `Count(szPrefix)` of those starting with
+    // `szPrefix`, ignoring case, or `nullptr` if there are none.
+    const std::wstring* Pick(const wchar_t* szPrefix, uint32_t nIndex) const;
+
+    size_t GetCount() const { return m_entries.size(); }
+
+  private:
+    typedef struct
+    {
+        std::wstring szKey; // lower case
+        std::wstring szName;
+    } td_entry;
+    typedef std::vector<td_entry>::const_iterator EntryIter;
+
+    void Add(const std::wstring& szName);
+    void Remove(const std::wstring& szName);
+    std::pair<EntryIter, EntryIter> FindPrefix(const wchar_t* szPrefix) const;
+
+    std::unique_ptr<CTextureDirectory> m_pDir;
+    bool m_bNeedList;
+    std::vector<td_entry> m_entries; // by key
+};
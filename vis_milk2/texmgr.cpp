@@ -540,27 +540,10 @@ int texmgr::LoadTex(wchar_t* szFilename, int iSlot, char* szInitCode, char* szCo
         */
     }
 
-    m_tex[iSlot].fStartTime = time;
-    m_tex[iSlot].nStartFrame = static_cast<int>(frame);
-
-    int ret = TEXMGR_ERR_SUCCESS;
-
-    // Compile and run initialization code.
-    if (!RunInitCode(iSlot, szInitCode))
-        ret |= TEXMGR_WARN_ERROR_IN_INIT_CODE;
-
-    // Compile and save per-frame code.
-    strcpy_s(m_tex[iSlot].m_szExpr, szCode);
-    FreeCode(iSlot);
-    if (!RecompileExpressions(iSlot))
-        ret |= TEXMGR_WARN_ERROR_IN_REG_CODE;
-
-    //DumpDebugMessage("texmgr: success");
-
-    return ret;
+    return StartTex(iSlot, szInitCode, szCode, time, frame);
 }
 
-int texmgr::LoadTex(std::vector<uint8_t> rawdata, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int /* ck */)
+int texmgr::LoadTex(const CImageBuffer& rawdata, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int /* ck */)
 {
     if (iSlot < 0)
         return TEXMGR_ERR_BAD_INDEX;
@@ -572,7 +555,7 @@ int texmgr::LoadTex(std::vector<uint8_t> rawdata, int iSlot, char* szInitCode, c
 
     wcscpy_s(m_tex[iSlot].szFileName, L"album");
 
-    HRESULT hr = m_lpDD->CreateTextureFromMemory(rawdata.data(), rawdata.size(), &m_tex[iSlot].pSurface, 1);
+    HRESULT hr = m_lpDD->CreateTextureFromMemory(rawdata.GetData(), rawdata.GetSize(), &m_tex[iSlot].pSurface, 1);
     if (hr != S_OK)
     {
         switch (hr)
@@ -598,6 +581,46 @@ int texmgr::LoadTex(std::vector<uint8_t> rawdata, int iSlot, char* szInitCode, c
 
     m_tex[iSlot].img_w = tex2DDesc.Width;
     m_tex[iSlot].img_h = tex2DDesc.Height;
+
+    return StartTex(iSlot, szInitCode, szCode, time, frame);
+}
+
+// Loads an image decoded by `CImageDecodeQueue`.
+int texmgr::LoadTex(const td_decodedimage& image, const wchar_t* szName, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int /* ck */)
+{
+    if (iSlot < 0)
+        return TEXMGR_ERR_BAD_INDEX;
+    if (iSlot >= NUM_TEX)
+        return TEXMGR_ERR_BAD_INDEX;
+
+    // Free old resources.
+    KillTex(iSlot);
+
+    wcscpy_s(m_tex[iSlot].szFileName, szName);
+
+    if (!image.bOk)
+        return TEXMGR_ERR_BADFILE;
+    HRESULT hr = m_lpDD->CreateTextureFromPixels(image.pixels.data(), static_cast<unsigned int>(image.nWidth), static_cast<unsigned int>(image.nHeight), static_cast<unsigned int>(image.nMips), &m_tex[iSlot].pSurface);
+    if (hr != S_OK)
+    {
+        switch (hr)
+        {
+            case E_OUTOFMEMORY:
+                return TEXMGR_ERR_OUTOFMEM;
+            default:
+                return TEXMGR_ERR_BADFILE;
+        }
+    }
+
+    m_tex[iSlot].img_w = image.nWidth;
+    m_tex[iSlot].img_h = image.nHeight;
+
+    return StartTex(iSlot, szInitCode, szCode, time, frame);
+}
+
+// Starts the sprite in `iSlot`, whose texture was just loaded.
+int texmgr::StartTex(int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame)
+{
     m_tex[iSlot].fStartTime = time;
     m_tex[iSlot].nStartFrame = static_cast<int>(frame);
 
@@ -676,9 +699,6 @@ bool texmgr::RunInitCode(int iSlot, char* szInitCode)
     FreeVars(iSlot);
     RegisterBuiltInVariables(iSlot);
 
-    strcpy_s(m_tex[iSlot].m_szExpr, szInitCode);
-    bool ret = RecompileExpressions(iSlot);
-
     // Set default values of output variables.
     // By not setting these every frame, the values are allowed to
     // persist from frame-to-frame.
@@ -700,11 +720,18 @@ bool texmgr::RunInitCode(int iSlot, char* szInitCode)
     *(m_tex[iSlot].var_burn) = 1.0;
 
 #ifndef _NO_EXPR_
-    if (m_tex[iSlot].m_codehandle)
-        NSEEL_code_execute(m_tex[iSlot].m_codehandle);
+    // Strip line feed control characters and comments, as `RecompileExpressions()` does.
+    strcpy_s(m_tex[iSlot].m_szExpr, szInitCode);
+    char buf[sizeof(m_tex[iSlot].m_szExpr)];
+    StripLinefeedCharsAndComments(m_tex[iSlot].m_szExpr, buf);
+    const char* p = buf;
+    while (*p == ' ')
+        p++;
+    if (*p)
+        return ExecuteInitCode(m_tex[iSlot].tex_eel_ctx, buf);
 #endif
 
-    return ret;
+    return true;
 }
 
 bool texmgr::RecompileExpressions(int iSlot)
@@ -33,6 +33,7 @@
 
 #include "md_defines.h"
 #include "d3d11shim.h"
+#include "imagedecode.h"
 #ifdef NS_EEL2
 #include <eel2/ns-eel.h>
 #else
@@ -98,7 +99,8 @@ class texmgr
 
     void Init(D3D11Shim* lpDD); // DirectDraw object
     int LoadTex(wchar_t* szFilename, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int ck);
-    int LoadTex(std::vector<uint8_t> rawdata, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int ck);
+    int LoadTex(const CImageBuffer& rawdata, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int ck);
+    int LoadTex(const td_decodedimage& image, const wchar_t* szName, int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame, unsigned int ck);
     void KillTex(int iSlot);
     void Finish();
 
@@ -106,6 +108,7 @@ class texmgr
 
   protected:
     //bool TryCreateDDrawSurface(int iSlot, int w, int h);
+    int StartTex(int iSlot, char* szInitCode, char* szCode, float time, uint32_t frame);
     void FreeVars(int iSlot);
     void FreeCode(int iSlot);
     void RegisterBuiltInVariables(int iSlot);
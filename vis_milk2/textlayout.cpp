@@ -0,0 +1,109 @@
+/*
+ * textlayout.cpp - Text layout cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "textlayout.h"
+
+#include <bit>
+
+namespace
+{
+uint64_t HashKey(std::wstring_view text, uint64_t nStyleId, float fWidth, float fHeight)
+{
+    uint64_t nHash = HashText(text);
+    nHash = HashCombine(nHash, nStyleId);
+    nHash = HashCombine(nHash, std::bit_cast<uint32_t>(fWidth));
+    return HashCombine(nHash, std::bit_cast<uint32_t>(fHeight));
+}
+} // namespace
+
+uint64_t HashText(std::wstring_view text, uint64_t nHash)
+{
+    for (wchar_t c : text)
+    {
+        nHash ^= static_cast<uint16_t>(c);
+        nHash *= 0x100000001B3ULL;
+    }
+    return nHash;
+}
+
+uint64_t HashCombine(uint64_t nHash, uint64_t nValue)
+{
+    // Boost's `hash_combine()`, mixed further with part of MurmurHash3's
+    // finalizer so that close values, like sizes, spread over all bits.
+    nHash ^= nValue + 0x9E3779B97F4A7C15ULL + (nHash << 6) + (nHash >> 2);
+    nHash ^= nHash >> 33;
+    nHash *= 0xFF51AFD7ED558CCDULL;
+    nHash ^= nHash >> 33;
+    return nHash;
+}
+
+const CTextLayoutCache::td_entry* CTextLayoutCache::Get(std::wstring_view text, void* pStyle, uint64_t nStyleId, float fWidth, float fHeight)
+{
+    uint64_t nHash = HashKey(text, nStyleId, fWidth, fHeight);
+    auto range = m_entries.equal_range(nHash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        td_cached& cached = it->second;
+        if (cached.nStyleId == nStyleId && cached.fWidth == fWidth && cached.fHeight == fHeight && cached.text == text)
+        {
+            cached.nLastUsed = m_nFrame;
+            m_nHits++;
+            return &cached.entry;
+        }
+    }
+
+    m_nMisses++;
+    std::shared_ptr<CTextLayout> layout = m_pShaper->CreateLayout(text, pStyle, fWidth, fHeight);
+    if (!layout)
+        return nullptr;
+    td_cached cached{std::wstring(text), nStyleId, fWidth, fHeight, m_nFrame, {std::move(layout), {}}};
+    cached.entry.layout->GetExtents(cached.entry.extents);
+    return &m_entries.emplace(nHash, std::move(cached))->second.entry;
+}
+
+void CTextLayoutCache::EndFrame()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (m_nFrame - it->second.nLastUsed >= MAX_AGE)
+        {
+            it = m_entries.erase(it);
+            m_nEvicted++;
+        }
+        else
+            ++it;
+    }
+    m_nFrame++;
+}
+
+void CTextLayoutCache::GetStats(td_textlayoutstats& stats) const
+{
+    stats.nEntries = m_entries.size();
+    stats.nHits = m_nHits;
+    stats.nMisses = m_nMisses;
+    stats.nEvicted = m_nEvicted;
+}
+
+bool DiffTextLists(const uint64_t* pCur, size_t nCur, const uint64_t* pPrev, size_t nPrev, td_textdiff& diff)
+{
+    size_t nPrefix = 0;
+    while (nPrefix < nCur && nPrefix < nPrev && pCur[nPrefix] == pPrev[nPrefix])
+        nPrefix++;
+
+    // Common suffix, not overlapping the prefix.
+    size_t nCurEnd = nCur, nPrevEnd = nPrev;
+    while (nCurEnd > nPrefix && nPrevEnd > nPrefix && pCur[nCurEnd - 1] == pPrev[nPrevEnd - 1])
+    {
+        nCurEnd--;
+        nPrevEnd--;
+    }
+
+    diff.nPrefix = nPrefix;
+    diff.nCurEnd = nCurEnd;
+    diff.nPrevEnd = nPrevEnd;
+    return nCurEnd > nPrefix || nPrevEnd > nPrefix;
+}
@@ -0,0 +1,125 @@
+/*
+ * textlayout.h - Text layout cache header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Ink extents of a laid out text, relative to its layout origin. May extend
+// past the container, for example for italic overhangs.
+typedef struct
+{
+    float fLeft;
+    float fTop;
+    float fRight;
+    float fBottom;
+} td_textextents;
+
+// A shaped and laid out text, ready to draw.
+class CTextLayout
+{
+  public:
+    virtual ~CTextLayout() = default;
+
+    virtual void GetExtents(td_textextents& extents) const = 0;
+};
+
+// Shapes texts for a text backend, such as DirectWrite.
+class CTextShaper
+{
+  public:
+    virtual ~CTextShaper() = default;
+
+    // Lays out `text` in `pStyle`, which only the shaper knows the type of,
+    // in a container of the given size. Returns null on failure.
+    virtual std::unique_ptr<CTextLayout> CreateLayout(std::wstring_view text, void* pStyle, float fWidth, float fHeight) = 0;
+};
+
+typedef struct
+{
+    size_t nEntries; // cached now
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvicted;
+} td_textlayoutstats;
+
+// Keeps the layouts of recently drawn texts, so that a text drawn every
+// frame, like the FPS, the preset name or a menu line, is shaped once rather
+// than every time its element is laid out again.
+//
+// Layouts are keyed by a hash of the text, the style and the container
+// size; a style has to change its identifier whenever it changes. Layouts
+// not used for `MAX_AGE` frames are evicted at the end of a frame.
+class CTextLayoutCache
+{
+  public:
+    static constexpr uint32_t MAX_AGE = 120; // frames
+
+    typedef struct
+    {
+        std::shared_ptr<CTextLayout> layout;
+        td_textextents extents;
+    } td_entry;
+
+    explicit CTextLayoutCache(CTextShaper* pShaper) : m_pShaper(pShaper), m_nFrame(0), m_nHits(0), m_nMisses(0), m_nEvicted(0) {}
+
+    // Returns the layout of `text` in style `pStyle`, identified by
+    // `nStyleId`, creating it if not cached. Returns null if the shaper
+    // failed. The entry is valid until the next `EndFrame()` or `Clear()`;
+    // the layout itself for as long as it is referenced.
+    const td_entry* Get(std::wstring_view text, void* pStyle, uint64_t nStyleId, float fWidth, float fHeight);
+
+    // Ages the layouts and evicts those not used for too long.
+    void EndFrame();
+
+    void Clear() { m_entries.clear(); }
+
+    void GetStats(td_textlayoutstats& stats) const;
+
+  private:
+    typedef struct
+    {
+        std::wstring text;
+        uint64_t nStyleId;
+        float fWidth;
+        float fHeight;
+        uint32_t nLastUsed; // frame
+        td_entry entry;
+    } td_cached;
+
+    CTextShaper* m_pShaper;
+    std::unordered_multimap<uint64_t, td_cached> m_entries; // by hash of the key
+    uint32_t m_nFrame;
+    uint64_t m_nHits;
+    uint64_t m_nMisses;
+    uint64_t m_nEvicted;
+};
+
+// FNV-1a over the UTF-16 code units of `text`, continuing from `nHash`.
+uint64_t HashText(std::wstring_view text, uint64_t nHash = 0xCBF29CE484222325ULL);
+
+// Mixes `nValue` into `nHash`, for hashing the rest of a text's key.
+uint64_t HashCombine(uint64_t nHash, uint64_t nValue);
+
+// Difference between the texts drawn in two consecutive frames, each given
+// as the hashes of its text, style, position and colors. Texts are
+// matched from both ends; those in between were deleted from the previous
+// frame's list and added to the current one.
+typedef struct
+{
+    size_t nPrefix;  // texts at the start both lists have in common
+    size_t nCurEnd;  // texts `[nPrefix, nCurEnd)` of the current list were added
+    size_t nPrevEnd; // texts `[nPrefix, nPrevEnd)` of the previous list were deleted
+} td_textdiff;
+
+// O(n) in the length of the lists. Returns false if they are the same.
+bool DiffTextLists(const uint64_t* pCur, size_t nCur, const uint64_t* pPrev, size_t nPrev, td_textdiff& diff);
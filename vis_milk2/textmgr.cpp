@@ -31,6 +31,9 @@
 #include "pch.h"
 #include "textmgr.h"
 
+#include <atomic>
+#include <bit>
+
 using namespace DX;
 using namespace D2D1;
 using Microsoft::WRL::ComPtr;
@@ -40,6 +43,21 @@ using Microsoft::WRL::ComPtr;
 wchar_t g_szMsgPool[2][MAX_MSG_CHARS];
 #endif
 
+static std::atomic<uint64_t> s_nextTextStyleId = 1;
+
+#ifndef _FOOBAR
+// Hash of everything `DrawNow()` compares a message by between frames.
+static uint64_t HashMessage(const td_string& s)
+{
+    uint64_t hash = HashText(s.msg);
+    hash = HashCombine(hash, reinterpret_cast<uintptr_t>(s.font));
+    hash = HashCombine(hash, (static_cast<uint64_t>(s.flags) << 32) | s.color);
+    hash = HashCombine(hash, s.bgColor);
+    hash = HashCombine(hash, (static_cast<uint64_t>(std::bit_cast<uint32_t>(s.rect.left)) << 32) | std::bit_cast<uint32_t>(s.rect.top));
+    return HashCombine(hash, (static_cast<uint64_t>(std::bit_cast<uint32_t>(s.rect.right)) << 32) | std::bit_cast<uint32_t>(s.rect.bottom));
+}
+#endif
+
 #pragma region TextStyle
 TextStyle::TextStyle(std::wstring fontName,
                      float fontSize,
@@ -54,8 +72,15 @@ TextStyle::TextStyle(std::wstring fontName,
     m_textAlignment(textAlignment),
     m_paragraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_NEAR),
     m_wordWrapping(DWRITE_WORD_WRAPPING_NO_WRAP),
-    m_trimmingGranularity(trimmingGranularity)
+    m_trimmingGranularity(trimmingGranularity),
+    m_id(s_nextTextStyleId++)
+{
+}
+
+void TextStyle::Changed()
 {
+    m_id = s_nextTextStyleId++;
+    m_textFormat = nullptr;
 }
 
 void TextStyle::SetFontName(std::wstring fontName)
@@ -63,7 +88,7 @@ void TextStyle::SetFontName(std::wstring fontName)
     if (m_fontName != fontName)
     {
         m_fontName = fontName;
-        m_textFormat = nullptr;
+        Changed();
     }
 }
 
@@ -72,7 +97,7 @@ void TextStyle::SetFontSize(float fontSize)
     if (m_fontSize != fontSize)
     {
         m_fontSize = fontSize;
-        m_textFormat = nullptr;
+        Changed();
     }
 }
 
@@ -81,7 +106,7 @@ void TextStyle::SetFontWeight(DWRITE_FONT_WEIGHT fontWeight)
     if (m_fontWeight != fontWeight)
     {
         m_fontWeight = fontWeight;
-        m_textFormat = nullptr;
+        Changed();
     }
 }
 
@@ -90,7 +115,7 @@ void TextStyle::SetFontStyle(DWRITE_FONT_STYLE fontStyle)
     if (m_fontStyle != fontStyle)
     {
         m_fontStyle = fontStyle;
-        m_textFormat = nullptr;
+        Changed();
     }
 }
 
@@ -99,7 +124,7 @@ void TextStyle::SetTextAlignment(DWRITE_TEXT_ALIGNMENT textAlignment)
     if (m_textAlignment != textAlignment)
     {
         m_textAlignment = textAlignment;
-        m_textFormat = nullptr;
+        Changed();
     }
 }
 
@@ -210,6 +235,8 @@ TextElement::TextElement() :
     m_hasShadow(false),
     m_textExtents{},
     m_textStyle(nullptr),
+    m_textStyleId(0),
+    m_layoutCache(nullptr),
     m_isFadingOut(false),
     m_isFadingIn(false),
     m_fadeOutTime(0.0f),
@@ -282,10 +309,10 @@ void TextElement::Render(ID2D1RenderTarget* d2dRenderTarget, IDWriteFactory* dwr
     if (m_hasShadow)
     {
         m_shadowColorBrush->SetOpacity(m_textColorBrush->GetOpacity() * 0.5f);
-        d2dRenderTarget->DrawTextLayout(Point2F(origin.x + 1.0f, origin.y + 1.0f), m_textLayout.Get(), m_shadowColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
+        d2dRenderTarget->DrawTextLayout(Point2F(origin.x + 1.0f, origin.y + 1.0f), GetTextLayout(), m_shadowColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
     }
 
-    d2dRenderTarget->DrawTextLayout(origin, m_textLayout.Get(), m_textColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
+    d2dRenderTarget->DrawTextLayout(origin, GetTextLayout(), m_textColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
 }
 
 void TextElement::Render(ID2D1DeviceContext* d2dContext, IDWriteFactory* dwriteFactory)
@@ -307,10 +334,10 @@ void TextElement::Render(ID2D1DeviceContext* d2dContext, IDWriteFactory* dwriteF
     if (m_hasShadow)
     {
         m_shadowColorBrush->SetOpacity(m_textColorBrush->GetOpacity() * 0.5f);
-        d2dContext->DrawTextLayout(Point2F(origin.x + 1.0f, origin.y + 1.0f), m_textLayout.Get(), m_shadowColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
+        d2dContext->DrawTextLayout(Point2F(origin.x + 1.0f, origin.y + 1.0f), GetTextLayout(), m_shadowColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
     }
 
-    d2dContext->DrawTextLayout(origin, m_textLayout.Get(), m_textColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
+    d2dContext->DrawTextLayout(origin, GetTextLayout(), m_textColorBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
 }
 
 void TextElement::ReleaseDeviceDependentResources()
@@ -320,7 +347,7 @@ void TextElement::ReleaseDeviceDependentResources()
     m_textColorBrush.Reset();
     m_shadowColorBrush.Reset();
     m_boxColorBrush.Reset();
-    m_textLayout.Reset();
+    m_textLayout.reset();
 }
 
 void TextElement::SetTextColor(const D2D1_COLOR_F& textColor)
@@ -356,7 +383,7 @@ void TextElement::SetText(std::wstring text)
     if (m_text != text)
     {
         m_text = text;
-        m_textLayout = nullptr;
+        m_textLayout.reset();
     }
 }
 
@@ -380,32 +407,93 @@ void TextElement::CalculateSize(IDWriteFactory* dwriteFactory)
 {
     CreateTextLayout(dwriteFactory);
 
-    DWRITE_TEXT_METRICS metrics;
-    DWRITE_OVERHANG_METRICS overhangMetrics;
-    ThrowIfFailed(m_textLayout->GetMetrics(&metrics));
-    ThrowIfFailed(m_textLayout->GetOverhangMetrics(&overhangMetrics));
-
-    m_textExtents = RectF(-overhangMetrics.left,
-                          -overhangMetrics.top,
-                          overhangMetrics.right + metrics.layoutWidth,
-                          overhangMetrics.bottom + metrics.layoutHeight);
-
     m_size = SizeF(m_textExtents.right - m_textExtents.left, m_textExtents.bottom - m_textExtents.top);
 }
 
+// The layout is kept until the text or the style changes, in the container
+// it was first laid out in. Metrics are only read when it is created.
 void TextElement::CreateTextLayout(IDWriteFactory* dwriteFactory)
 {
-    if ((m_textLayout == nullptr) || m_textStyle->HasTextFormatChanged())
+    if ((m_textLayout != nullptr) && (m_textStyleId == m_textStyle->GetId()))
+        return;
+
+    const float width = m_container.right - m_container.left;
+    const float height = m_container.bottom - m_container.top;
+    td_textextents extents;
+    if (m_layoutCache)
+    {
+        const CTextLayoutCache::td_entry* entry = m_layoutCache->Get(m_text, m_textStyle, m_textStyle->GetId(), width, height);
+        if (entry == nullptr)
+            ThrowIfFailed(E_FAIL);
+        m_textLayout = entry->layout;
+        extents = entry->extents;
+    }
+    else
     {
-        //m_textLayout = nullptr;
-
-        ThrowIfFailed(dwriteFactory->CreateTextLayout(m_text.data(),
-                                                      static_cast<UINT32>(m_text.size()),
-                                                      m_textStyle->GetTextFormat(dwriteFactory),
-                                                      m_container.right - m_container.left,
-                                                      m_container.bottom - m_container.top,
-                                                      m_textLayout.ReleaseAndGetAddressOf()));
+        CDWriteTextShaper shaper(dwriteFactory);
+        m_textLayout = shaper.CreateLayout(m_text, m_textStyle, width, height);
+        m_textLayout->GetExtents(extents);
     }
+
+    m_textStyleId = m_textStyle->GetId();
+    m_textExtents = RectF(extents.fLeft, extents.fTop, extents.fRight, extents.fBottom);
+}
+
+IDWriteTextLayout* TextElement::GetTextLayout() const
+{
+    return static_cast<CDWriteTextLayout*>(m_textLayout.get())->Get();
+}
+#pragma endregion
+
+#pragma region CDWriteTextShaper
+std::unique_ptr<CTextLayout> CDWriteTextShaper::CreateLayout(std::wstring_view text, void* pStyle, float fWidth, float fHeight)
+{
+    TextStyle* textStyle = static_cast<TextStyle*>(pStyle);
+    ComPtr<IDWriteTextLayout> textLayout;
+    ThrowIfFailed(m_dwriteFactory->CreateTextLayout(text.data(),
+                                                    static_cast<UINT32>(text.size()),
+                                                    textStyle->GetTextFormat(m_dwriteFactory),
+                                                    fWidth,
+                                                    fHeight,
+                                                    &textLayout));
+    return std::make_unique<CDWriteTextLayout>(textLayout.Get());
+}
+
+bool CDWriteTextMeasurer::Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float fWidth, float fHeight, td_textsize& size)
+{
+    std::unique_ptr<CTextLayout> layout = m_shaper.CreateLayout(text, GetStyle(face, bBold, bItalic, fSize), fWidth, fHeight);
+    if (!layout)
+        return false;
+    td_textextents extents;
+    layout->GetExtents(extents);
+    size = {extents.fRight - extents.fLeft, extents.fBottom - extents.fTop};
+    return true;
+}
+
+TextStyle* CDWriteTextMeasurer::GetStyle(std::wstring_view face, bool bBold, bool bItalic, float fSize)
+{
+    std::unique_ptr<TextStyle>& style = m_styles[std::make_tuple(std::wstring(face), bBold, bItalic, fSize)];
+    if (!style)
+        style = std::make_unique<TextStyle>(std::wstring(face),
+                                            fSize,
+                                            bBold ? DWRITE_FONT_WEIGHT_BLACK : DWRITE_FONT_WEIGHT_REGULAR,
+                                            bItalic ? DWRITE_FONT_STYLE_ITALIC : DWRITE_FONT_STYLE_NORMAL,
+                                            DWRITE_TEXT_ALIGNMENT_CENTER,
+                                            DWRITE_TRIMMING_GRANULARITY_NONE);
+    return style.get();
+}
+
+void CDWriteTextLayout::GetExtents(td_textextents& extents) const
+{
+    DWRITE_TEXT_METRICS metrics;
+    DWRITE_OVERHANG_METRICS overhangMetrics;
+    ThrowIfFailed(m_textLayout->GetMetrics(&metrics));
+    ThrowIfFailed(m_textLayout->GetOverhangMetrics(&overhangMetrics));
+
+    extents = {-overhangMetrics.left,
+               -overhangMetrics.top,
+               overhangMetrics.right + metrics.layoutWidth,
+               overhangMetrics.bottom + metrics.layoutHeight};
 }
 #pragma endregion
 
@@ -429,6 +517,8 @@ void CTextManager::Init(DXContext* lpDX
 {
     m_lpDX = lpDX;
     m_dwriteFactory = m_lpDX->GetDWriteFactory();
+    m_shaper.SetFactory(m_dwriteFactory.Get());
+    m_layouts.Clear();
     m_d2dDevice = m_lpDX->GetD2DDevice();
     m_d2dContext = m_lpDX->GetD2DDeviceContext();
 #ifndef _FOOBAR
@@ -485,6 +575,7 @@ void CTextManager::DrawBox(D2D1_RECT_F* pRect, DWORD boxColor)
         m_msg[m_b][m_nMsg[m_b]].flags = 0;
         m_msg[m_b][m_nMsg[m_b]].color = 0xFFFFFFFF;
         m_msg[m_b][m_nMsg[m_b]].bgColor = boxColor;
+        m_msgHash[m_b][m_nMsg[m_b]] = HashMessage(m_msg[m_b][m_nMsg[m_b]]);
         m_nMsg[m_b]++;
         m_next_msg_start_ptr += 1;
     }
@@ -497,6 +588,8 @@ int CTextManager::DrawD2DText(TextStyle* pFont, TextElement* pElement, const wch
     if (!(pFont && pElement && pRect && szText))
         return 0;
 
+    pElement->SetLayoutCache(&m_layouts);
+
     if (flags & DT_CALCRECT)
     {
         *pRect = pElement->GetBounds(m_lpDX->GetDWriteFactory());
@@ -527,6 +620,7 @@ int CTextManager::DrawD2DText(TextStyle* pFont, TextElement* pElement, const wch
         // Shrink rectangles on new frame's text strings; important for deletions.
         m_msg[m_b][m_nMsg[m_b]].rect = pElement->GetBounds(m_lpDX->GetDWriteFactory());
         int h = static_cast<int>(ceilf(m_msg[m_b][m_nMsg[m_b]].rect.bottom - m_msg[m_b][m_nMsg[m_b]].rect.top));
+        m_msgHash[m_b][m_nMsg[m_b]] = HashMessage(m_msg[m_b][m_nMsg[m_b]]);
 
         m_nMsg[m_b]++;
         m_next_msg_start_ptr += len + 1;
@@ -541,6 +635,7 @@ int CTextManager::DrawD2DText(TextStyle* pFont, TextElement* pElement, const wch
             td_string x = m_msg[m_b][m_nMsg[m_b] - 1];
             m_msg[m_b][m_nMsg[m_b] - 1] = m_msg[m_b][m_nMsg[m_b] - 2];
             m_msg[m_b][m_nMsg[m_b] - 2] = x;
+            std::swap(m_msgHash[m_b][m_nMsg[m_b] - 1], m_msgHash[m_b][m_nMsg[m_b] - 2]);
             //pElement->SetTextBox(D2D1::ColorF(boxColor, static_cast<FLOAT>(((boxColor & 0xFF000000) >> 24) / 255.0f)));
         }
         return h;
@@ -552,14 +647,6 @@ int CTextManager::DrawD2DText(TextStyle* pFont, TextElement* pElement, const wch
     return static_cast<int>(ceilf(r2.bottom - r2.top));
 }
 
-#define MATCH(i, j) \
-    (m_msg[m_b][i].font == m_msg[1 - m_b][j].font && \
-     m_msg[m_b][i].flags == m_msg[1 - m_b][j].flags && \
-     m_msg[m_b][i].color == m_msg[1 - m_b][j].color && \
-     m_msg[m_b][i].bgColor == m_msg[1 - m_b][j].bgColor && \
-     memcmp(&m_msg[m_b][i].rect, &m_msg[1 - m_b][j].rect, sizeof(D2D1_RECT_F)) == 0 && \
-     wcscmp(m_msg[m_b][i].msg, m_msg[1 - m_b][j].msg) == 0)
-
 void CTextManager::DrawNow()
 {
     if (!m_d2dDevice)
@@ -607,110 +694,18 @@ void CTextManager::DrawNow()
         }
         else
         {
-            // Try to synchronize the text strings from last frame plus this frame,
-            // and label additions and deletions. Algorithm will catch:
-            //  - Insertion of any number of items in one spot.
-            //  - Deletion of any number of items from one spot.
-            //  - Changes to 1 item.
-            //  - Changes to 2 consecutive items.
-            //    (provided that the 2 text strings immediately bounding the
-            //     additions/deletions/change(s) are left unchanged)
-            // In any other case, all the text is just re-rendered.
-            int i = 0, j = 0;
-            while (i < m_nMsg[m_b] && j < m_nMsg[1 - m_b])
+            // Match the text strings from last frame and this frame by hash, from
+            // both ends, and label what is left in between as additions and
+            // deletions. This catches insertions, deletions and changes in one
+            // spot; anything else is redrawn from where the lists differ.
+            td_textdiff diff;
+            if (DiffTextLists(m_msgHash[m_b], static_cast<size_t>(m_nMsg[m_b]), m_msgHash[1 - m_b], static_cast<size_t>(m_nMsg[1 - m_b]), diff))
             {
-                // MATCH macro: first index is record number for current stuff;
-                //              second index is record number for previous frame stuff.
-                if (MATCH(i, j))
-                {
-                    i++;
-                    j++;
-                }
-                else
-                {
-                    int continue_now = 0;
-
-                    // Scan to see if something was added.
-                    for (int i2 = i + 1; i2 < m_nMsg[m_b]; i2++)
-                        if (MATCH(i2, j))
-                        {
-                            for (int i3 = i; i3 < i2; i3++)
-                                m_msg[m_b][i3].added = 1;
-                            i = i2;
-                            bRedrawText = 1;
-                            continue_now = 1;
-                            break;
-                        }
-                    if (continue_now)
-                        continue;
-
-                    // Scan to see if something was deleted.
-                    for (int j2 = j + 1; j2 < m_nMsg[1 - m_b]; j2++)
-                        if (MATCH(i, j2))
-                        {
-                            for (int j3 = j; j3 < j2; j3++)
-                                m_msg[1 - m_b][j3].deleted = 1;
-                            j = j2;
-                            bRedrawText = 1;
-                            continue_now = 1;
-                            break;
-                        }
-                    if (continue_now)
-                        continue;
-
-                    // Scan to see if just a small group of 1-4 items were changed
-                    // [and are followed by two identical items again].
-                    int break_now = 0;
-                    for (int chgd = 1; chgd <= 4; chgd++)
-                    {
-                        if (i >= m_nMsg[m_b] - chgd || j >= m_nMsg[1 - m_b] - chgd)
-                        {
-                            // Only a few items left in one of the lists -> just finish it.
-                            bRedrawText = 1;
-                            break_now = 1;
-                            break;
-                        }
-                        if (i < m_nMsg[m_b] - chgd && j < m_nMsg[1 - m_b] - chgd && MATCH(i + chgd, j + chgd))
-                        {
-                            for (int k = 0; k < chgd; k++)
-                            {
-                                m_msg[m_b][i + k].added = 1;
-                                m_msg[1 - m_b][j + k].deleted = 1;
-                            }
-                            i += chgd;
-                            j += chgd;
-
-                            bRedrawText = 1;
-                            continue_now = 1;
-                            break;
-                        }
-                    }
-                    if (break_now)
-                        break;
-                    if (continue_now)
-                        continue;
-
-                    // Otherwise, nontrivial case -> just re-render whole thing.
-                    bRedrawText = 2; // redraw ALL
-                    break;
-                }
-            }
-
-            if (bRedrawText < 2)
-            {
-                while (i < m_nMsg[m_b])
-                {
+                for (size_t i = diff.nPrefix; i < diff.nCurEnd; i++)
                     m_msg[m_b][i].added = 1;
-                    bRedrawText = 1;
-                    i++;
-                }
-
-                while (j < m_nMsg[1 - m_b])
-                {
+                for (size_t j = diff.nPrefix; j < diff.nPrevEnd; j++)
                     m_msg[1 - m_b][j].deleted = 1;
-                    bRedrawText = 1;
-                    j++;
-                }
+                bRedrawText = 1;
             }
         }
 
@@ -1076,6 +1071,7 @@ void CTextManager::DrawNow()
 #endif
 
     Render();
+    m_layouts.EndFrame();
 
 #ifndef _FOOBAR
     // Flip.
@@ -31,8 +31,12 @@
 #ifndef GEISS_TEXT_DRAWING_MANAGER
 #define GEISS_TEXT_DRAWING_MANAGER
 
+#include <map>
 #include <set>
+#include <tuple>
 #include "dxcontext.h"
+#include "fontfit.h"
+#include "textlayout.h"
 
 #define MAX_MSGS 4096
 
@@ -69,7 +73,12 @@ class TextStyle
 
     bool HasTextFormatChanged() const { return (m_textFormat == nullptr); }
 
+    // Unique among all styles, and changes whenever the style does.
+    uint64_t GetId() const { return m_id; }
+
   private:
+    void Changed();
+
     std::wstring m_fontName;
     float m_fontSize;
     DWRITE_FONT_WEIGHT m_fontWeight;
@@ -78,6 +87,7 @@ class TextStyle
     DWRITE_PARAGRAPH_ALIGNMENT m_paragraphAlignment;
     DWRITE_WORD_WRAPPING m_wordWrapping;
     DWRITE_TRIMMING_GRANULARITY m_trimmingGranularity;
+    uint64_t m_id;
 
     Microsoft::WRL::ComPtr<IDWriteTextFormat> m_textFormat;
 };
@@ -137,17 +147,24 @@ class TextElement : public ElementBase
     TextStyle* GetTextStyle() { return m_textStyle; }
     void SetTextStyle(TextStyle* textStyle) { m_textStyle = textStyle; }
 
+    // Layouts are shared through `layoutCache` when set.
+    void SetLayoutCache(CTextLayoutCache* layoutCache) { m_layoutCache = layoutCache; }
+
     void FadeOut(float fadeOutTime);
     void FadeIn(float fadeOutTime);
 
   protected:
     virtual void CalculateSize(IDWriteFactory* dwriteFactory);
     void CreateTextLayout(IDWriteFactory* dwriteFactory);
+    IDWriteTextLayout* GetTextLayout() const;
 
     std::wstring m_text;
     D2D1_RECT_F m_textExtents;
 
     TextStyle* m_textStyle;
+    uint64_t m_textStyleId; // of the style the layout was created with
+    CTextLayoutCache* m_layoutCache;
+    std::shared_ptr<CTextLayout> m_textLayout;
 
     bool m_hasShadow;
     bool m_hasBox;
@@ -162,6 +179,54 @@ class TextElement : public ElementBase
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_textColorBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_shadowColorBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_boxColorBrush;
+};
+
+// Lays out texts with DirectWrite, in a `TextStyle`.
+class CDWriteTextShaper : public CTextShaper
+{
+  public:
+    explicit CDWriteTextShaper(IDWriteFactory* dwriteFactory = nullptr) : m_dwriteFactory(dwriteFactory) {}
+
+    void SetFactory(IDWriteFactory* dwriteFactory) { m_dwriteFactory = dwriteFactory; }
+
+    std::unique_ptr<CTextLayout> CreateLayout(std::wstring_view text, void* pStyle, float fWidth, float fHeight) override;
+
+  private:
+    IDWriteFactory* m_dwriteFactory;
+};
+
+// Measures texts with DirectWrite, in centered and untrimmed styles that
+// it keeps, so that fitting the same font again creates no text formats.
+class CDWriteTextMeasurer : public CTextMeasurer
+{
+  public:
+    explicit CDWriteTextMeasurer(IDWriteFactory* dwriteFactory = nullptr) : m_shaper(dwriteFactory) {}
+
+    void SetFactory(IDWriteFactory* dwriteFactory) { m_shaper.SetFactory(dwriteFactory); }
+
+    bool Measure(std::wstring_view text, std::wstring_view face, bool bBold, bool bItalic, float fSize, float fWidth, float fHeight, td_textsize& size) override;
+
+    // Returns the style for the font, created the first time. Styles are
+    // valid until `Clear()`.
+    TextStyle* GetStyle(std::wstring_view face, bool bBold, bool bItalic, float fSize);
+
+    void Clear() { m_styles.clear(); }
+
+  private:
+    CDWriteTextShaper m_shaper;
+    std::map<std::tuple<std::wstring, bool, bool, float>, std::unique_ptr<TextStyle>> m_styles;
+};
+
+class CDWriteTextLayout : public CTextLayout
+{
+  public:
+    explicit CDWriteTextLayout(IDWriteTextLayout* textLayout) : m_textLayout(textLayout) {}
+
+    void GetExtents(td_textextents& extents) const override;
+
+    IDWriteTextLayout* Get() const { return m_textLayout.Get(); }
+
+  private:
     Microsoft::WRL::ComPtr<IDWriteTextLayout> m_textLayout;
 };
 
@@ -186,7 +251,7 @@ class CTextManager
 #ifndef _FOOBAR
         m_b(0), m_nMsg{0, 0}, m_next_msg_start_ptr(nullptr), m_blit_additively(0),
 #endif
-        m_lpDX(nullptr), m_dwriteFactory(nullptr), m_d2dDevice(nullptr), m_d2dContext(nullptr) {};
+        m_lpDX(nullptr), m_dwriteFactory(nullptr), m_d2dDevice(nullptr), m_d2dContext(nullptr), m_layouts(&m_shaper) {};
     ~CTextManager() {};
 
     // Note: If unable to create `lpTextSurface` full size, do not create it at all!
@@ -218,6 +283,7 @@ class CTextManager
     int m_blit_additively;
     int m_nMsg[2];
     td_string m_msg[2][MAX_MSGS];
+    uint64_t m_msgHash[2][MAX_MSGS]; // of everything `DrawNow()` compares between frames
     wchar_t* m_next_msg_start_ptr;
     int m_b;
 #endif
@@ -226,6 +292,8 @@ class CTextManager
     void ReleaseDeviceDependentResources();
     void Release()
     {
+        m_layouts.Clear();
+        m_shaper.SetFactory(nullptr);
         m_stateBlock.Reset();
         m_d2dContext.Reset();
         m_d2dFactory.Reset();
@@ -241,6 +309,8 @@ class CTextManager
     Microsoft::WRL::ComPtr<ID2D1DrawingStateBlock> m_stateBlock;
 
     ElementSet m_elements;
+    CDWriteTextShaper m_shaper;
+    CTextLayoutCache m_layouts; // of texts drawn in recent frames
 };
 
 #endif
\ No newline at end of file
@@ -30,6 +30,7 @@
 
 #include "pch.h"
 #include "utility.h"
+#include "eelinterp.h"
 
 float PowCosineInterp(float x, float pow)
 {
@@ -361,6 +362,32 @@ char* _WideToUTF8(const wchar_t* WFilename)
     return utf8Name;
 }
 
+#ifndef _NO_EXPR_
+static_assert(sizeof(EEL_F) == sizeof(double), "EEL_F must be a double for the init code interpreter");
+
+double* ResolveEelVar(void* ctx, const char* name)
+{
+    return NSEEL_VM_regvar(static_cast<NSEEL_VMCTX>(ctx), name);
+}
+
+bool ExecuteInitCode(NSEEL_VMCTX ctx, const char* szCode)
+{
+    // Init code only runs once, so interpret it when it is simple enough
+    // instead of paying for a compile. The x86 JIT evaluates on the x87
+    // stack and would not round the same way.
+#if !(defined(NS_EEL2) && defined(_M_IX86))
+    if (EelRunOnce(szCode, ResolveEelVar, ctx))
+        return true;
+#endif
+    NSEEL_CODEHANDLE codehandle = NSEEL_code_compile(ctx, szCode, 0);
+    if (codehandle == NULL)
+        return false;
+    NSEEL_code_execute(codehandle);
+    NSEEL_code_free(codehandle);
+    return true;
+}
+#endif
+
 #ifdef _FOOBAR
 // Retrieves and outputs the system error message for the last-error code.
 void DisplayError(LPCWSTR lpszFunction)
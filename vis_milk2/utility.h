@@ -61,6 +61,14 @@ void LuidToTextA(LUID* pLUID, char* str, int nStrLen);
 #ifdef NS_EEL2
 void NSEEL_VM_resetvars(void* ctx);
 #endif
+#ifndef _NO_EXPR_
+// `EelVarResolver` for an `NSEEL_VMCTX`.
+double* ResolveEelVar(void* ctx, const char* name);
+
+// Compiles and executes run-once code in `ctx`, or interprets it directly
+// when possible. Returns false if the code does not compile.
+bool ExecuteInitCode(NSEEL_VMCTX ctx, const char* szCode);
+#endif
 
 LPWSTR GetStringW(HINSTANCE localized, HINSTANCE owner, UINT uID, LPWSTR str = NULL, int maxlen = 0);
 INT_PTR LDialogBoxParamW(HINSTANCE localized, HINSTANCE owner, UINT uID, HWND parent, DLGPROC proc, LPARAM param);
@@ -0,0 +1,81 @@
+/*
+ * viewcache.cpp - Shader resource view cache.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "viewcache.h"
+
+void* CViewCache::Get(void* pResource)
+{
+    auto it = m_views.find(pResource);
+    if (it != m_views.end())
+    {
+        m_nHits++;
+        return it->second;
+    }
+
+    void* pView = m_pFactory->CreateView(pResource);
+    if (!pView)
+        return nullptr;
+    m_nCreated++;
+    m_views.emplace(pResource, pView);
+    return pView;
+}
+
+void CViewCache::Insert(void* pResource, void* pView)
+{
+    auto [it, bInserted] = m_views.emplace(pResource, pView);
+    if (!bInserted)
+    {
+        m_pFactory->ReleaseView(it->second);
+        m_nReleased++;
+        it->second = pView;
+    }
+    m_nCreated++;
+}
+
+void CViewCache::Remove(void* pResource)
+{
+    auto it = m_views.find(pResource);
+    if (it == m_views.end())
+        return;
+    m_pFactory->ReleaseView(it->second);
+    m_nReleased++;
+    m_views.erase(it);
+}
+
+size_t CViewCache::Collect()
+{
+    size_t nCollected = 0;
+    for (auto it = m_views.begin(); it != m_views.end();)
+    {
+        if (m_pFactory->IsOrphaned(it->first))
+        {
+            m_pFactory->ReleaseView(it->second);
+            it = m_views.erase(it);
+            nCollected++;
+        }
+        else
+            ++it;
+    }
+    m_nReleased += nCollected;
+    return nCollected;
+}
+
+void CViewCache::Clear()
+{
+    for (auto& [pResource, pView] : m_views)
+        m_pFactory->ReleaseView(pView);
+    m_nReleased += m_views.size();
+    m_views.clear();
+}
+
+void CViewCache::GetStats(td_viewcachestats& stats) const
+{
+    stats.nEntries = m_views.size();
+    stats.nCreated = m_nCreated;
+    stats.nReleased = m_nReleased;
+    stats.nHits = m_nHits;
+}
@@ -0,0 +1,82 @@
+/*
+ * viewcache.h - Shader resource view cache header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Creates and releases views of resources on a device, such as Direct3D 11.
+class CViewFactory
+{
+  public:
+    virtual ~CViewFactory() = default;
+
+    // Returns a new view of `pResource`, which keeps the resource alive
+    // until it is released, or null on failure.
+    virtual void* CreateView(void* pResource) = 0;
+    virtual void ReleaseView(void* pView) = 0;
+
+    // True if nothing but its view references `pResource` anymore, that
+    // is, its owner released it.
+    virtual bool IsOrphaned(void* pResource) = 0;
+};
+
+typedef struct
+{
+    size_t nEntries;    // views kept now
+    uint64_t nCreated;  // views added, ever
+    uint64_t nReleased; // by the cache, ever
+    uint64_t nHits;
+} td_viewcachestats;
+
+// One view per resource, so that binding a texture does not create a view
+// every time.
+//
+// Views are created when their resource is created, or when it is first
+// bound if it was created elsewhere. Resources have no destruction
+// callback and a view keeps its resource alive, so the cache finds the
+// resources their owners released in `Collect()`, once a frame, and
+// releases their views, which destroys them. A resource therefore outlives
+// its owner by at most a frame, and its address cannot be reused for
+// another resource while its view is cached.
+class CViewCache
+{
+  public:
+    explicit CViewCache(CViewFactory* pFactory) : m_pFactory(pFactory), m_nCreated(0), m_nReleased(0), m_nHits(0) {}
+    CViewCache(const CViewCache&) = delete;
+    CViewCache& operator=(const CViewCache&) = delete;
+    ~CViewCache() { Clear(); }
+
+    // Returns the view of `pResource`, creating it if not cached. Returns
+    // null if the factory failed; failures are not cached.
+    void* Get(void* pResource);
+
+    // Keeps `pView` as the view of `pResource`, for views created along
+    // with their resource. Takes over the caller's reference.
+    void Insert(void* pResource, void* pView);
+
+    // Releases the view of `pResource`, if any.
+    void Remove(void* pResource);
+
+    // Releases the views of resources their owners released. Returns how
+    // many there were.
+    size_t Collect();
+
+    // Releases every view.
+    void Clear();
+
+    void GetStats(td_viewcachestats& stats) const;
+
+  private:
+    CViewFactory* m_pFactory;
+    std::unordered_map<void*, void*> m_views; // by resource
+    uint64_t m_nCreated;
+    uint64_t m_nReleased;
+    uint64_t m_nHits;
+};
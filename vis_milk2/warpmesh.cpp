@@ -0,0 +1,71 @@
+/*
+ * warpmesh.cpp - Warp mesh index lists.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#include "warpmesh.h"
+
+size_t GetWarpSeamStart(int nGridX, int nGridY)
+{
+    return static_cast<size_t>(nGridY / 2) * (nGridX + 1);
+}
+
+size_t GetWarpSeamCount(int nGridX)
+{
+    return static_cast<size_t>(nGridX / 2);
+}
+
+size_t GetWarpVertexCount(int nGridX, int nGridY)
+{
+    return static_cast<size_t>(nGridX + 1) * (nGridY + 1) + GetWarpSeamCount(nGridX);
+}
+
+void BuildWarpIndices(int nGridX, int nGridY, std::vector<uint16_t>& indices)
+{
+    const size_t nGrid = static_cast<size_t>(nGridX + 1) * (nGridY + 1);
+    const size_t nSeamStart = GetWarpSeamStart(nGridX, nGridY);
+    const size_t nSeamEnd = nSeamStart + GetWarpSeamCount(nGridX);
+    indices.reserve(indices.size() + static_cast<size_t>(nGridX / 2) * (nGridY / 2) * 24);
+    for (int quadrant = 0; quadrant < 4; quadrant++)
+    {
+        for (int slice = 0; slice < nGridY / 2; slice++)
+        {
+            for (int i = 0; i < nGridX / 2; i++)
+            {
+                // Quadrants: 2 3
+                //            0 1
+                int xref = (quadrant & 1) ? nGridX - 1 - i : i;
+                int yref = (quadrant & 2) ? nGridY - 1 - slice : slice;
+                size_t v = static_cast<size_t>(xref) + static_cast<size_t>(yref) * (nGridX + 1);
+                const size_t cell[6] = {v, v + 1, v + nGridX + 1, v + 1, v + nGridX + 1, v + nGridX + 2};
+                for (size_t n : cell)
+                {
+                    if (quadrant >= 2 && n >= nSeamStart && n < nSeamEnd)
+                        n = nGrid + (n - nSeamStart);
+                    indices.push_back(static_cast<uint16_t>(n));
+                }
+            }
+        }
+    }
+}
+
+size_t CullTriangles(const uint16_t* pIndices, size_t nIndices, const float* pAlpha, size_t nAlphaStride, bool bFlipCulling, uint16_t* pOut)
+{
+    size_t nOut = 0;
+    for (size_t i = 0; i + 2 < nIndices; i += 3)
+    {
+        uint32_t d1 = static_cast<uint32_t>(pAlpha[pIndices[i] * nAlphaStride] * 255);
+        uint32_t d2 = static_cast<uint32_t>(pAlpha[pIndices[i + 1] * nAlphaStride] * 255);
+        uint32_t d3 = static_cast<uint32_t>(pAlpha[pIndices[i + 2] * nAlphaStride] * 255);
+        bool bIsNeeded = bFlipCulling ? (d1 & d2 & d3) < 255 : (d1 | d2 | d3) > 0;
+        if (bIsNeeded)
+        {
+            pOut[nOut++] = pIndices[i];
+            pOut[nOut++] = pIndices[i + 1];
+            pOut[nOut++] = pIndices[i + 2];
+        }
+    }
+    return nOut;
+}
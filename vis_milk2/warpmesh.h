@@ -0,0 +1,31 @@
+/*
+ * warpmesh.h - Warp mesh index lists header file.
+ *
+ * Copyright (c) 2023-2024 Jimmy Cassis
+ * SPDX-License-Identifier: MPL-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The warp mesh is a grid of `(nGridX + 1) * (nGridY + 1)` vertices, row
+// by row. The warp shader's `ang` wraps from pi to -pi along the left half
+// of the middle row, the seam, where the bottom half of the mesh needs -pi
+// and the top half pi. Vertex buffers for the mesh hold the grid followed
+// by a copy of the seam, which the top half uses instead.
+size_t GetWarpSeamStart(int nGridX, int nGridY);
+size_t GetWarpSeamCount(int nGridX);
+size_t GetWarpVertexCount(int nGridX, int nGridY); // grid and seam copy
+
+// Appends the triangle list of the mesh, two triangles per cell, by
+// quadrant from the center outward so that the bottom half comes first.
+void BuildWarpIndices(int nGridX, int nGridY, std::vector<uint16_t>& indices);
+
+// Copies the triangles of `pIndices` that blending does not entirely hide
+// to `pOut` and returns how many indices it copied. Vertex `i` has its
+// alpha at `pAlpha[i * nAlphaStride]`. A triangle is hidden if all its
+// vertices are transparent, or with `bFlipCulling`, opaque.
+size_t CullTriangles(const uint16_t* pIndices, size_t nIndices, const float* pAlpha, size_t nAlphaStride, bool bFlipCulling, uint16_t* pOut);